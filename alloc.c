@@ -0,0 +1,267 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "alloc.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef CHOCC_COUNTERS
+
+/* counts are a thread's own, linked into a list to be totalled */
+struct counts {
+  long calls[ALLOC_TAGS];
+  long bytes[ALLOC_TAGS];
+  long events[COUNT_EVENTS];
+  struct counts *next;
+};
+
+const char *alloc_tag_names[ALLOC_TAGS] = {"io",    "lex",  "cpp",
+                                           "parse", "unit", "sema"};
+const char *count_event_names[COUNT_EVENTS] = {
+    "tokens_lexed", "advance", "set_pos", "backtracks", "macro_lookups"};
+
+struct counts *counts_all;
+pthread_key_t counts_key;
+pthread_once_t counts_once = PTHREAD_ONCE_INIT;
+pthread_mutex_t counts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void counts_key_create(void) {
+  pthread_key_create(&counts_key, NULL);
+}
+
+/* Returns the calling thread's counts, made on first use */
+struct counts *counts_self(void) {
+  struct counts *c;
+
+  pthread_once(&counts_once, counts_key_create);
+  if ((c = pthread_getspecific(counts_key))) {
+    return c;
+  }
+  c = calloc(1, sizeof(*c));
+  pthread_setspecific(counts_key, c);
+  pthread_mutex_lock(&counts_lock);
+  c->next = counts_all;
+  counts_all = c;
+  pthread_mutex_unlock(&counts_lock);
+  return c;
+}
+
+/* Counts an allocation of bytes under tag */
+void alloc_count(alloc_tag tag, size_t bytes) {
+  struct counts *c = counts_self();
+
+  c->calls[tag]++;
+  c->bytes[tag] += bytes;
+}
+
+void count_event_add(count_event e) {
+  counts_self()->events[e]++;
+}
+
+/* Totals the counts of every thread into total */
+void counts_total(struct counts *total) {
+  struct counts *c;
+  int i;
+
+  memset(total, 0, sizeof(*total));
+  pthread_mutex_lock(&counts_lock);
+  for (c = counts_all; c; c = c->next) {
+    for (i = 0; i < ALLOC_TAGS; i++) {
+      total->calls[i] += c->calls[i];
+      total->bytes[i] += c->bytes[i];
+    }
+    for (i = 0; i < COUNT_EVENTS; i++) {
+      total->events[i] += c->events[i];
+    }
+  }
+  pthread_mutex_unlock(&counts_lock);
+}
+
+void write_counts(writer *w) {
+  struct counts total;
+  char buf[96];
+  int i;
+
+  counts_total(&total);
+  sprintf(buf, "%-16s %12s %14s\n", "alloc", "calls", "bytes");
+  write_str(w, buf);
+  for (i = 0; i < ALLOC_TAGS; i++) {
+    sprintf(buf, "%-16s %12ld %14ld\n", alloc_tag_names[i], total.calls[i],
+            total.bytes[i]);
+    write_str(w, buf);
+  }
+  sprintf(buf, "%-16s %12s\n", "event", "count");
+  write_str(w, buf);
+  for (i = 0; i < COUNT_EVENTS; i++) {
+    sprintf(buf, "%-16s %12ld\n", count_event_names[i], total.events[i]);
+    write_str(w, buf);
+  }
+}
+
+void write_counts_json(writer *w) {
+  struct counts total;
+  char buf[96];
+  int i;
+
+  counts_total(&total);
+  write_str(w, "{\"alloc\":{");
+  for (i = 0; i < ALLOC_TAGS; i++) {
+    sprintf(buf, "%s\"%s\":{\"calls\":%ld,\"bytes\":%ld}", i ? "," : "",
+            alloc_tag_names[i], total.calls[i], total.bytes[i]);
+    write_str(w, buf);
+  }
+  write_str(w, "},\"events\":{");
+  for (i = 0; i < COUNT_EVENTS; i++) {
+    sprintf(buf, "%s\"%s\":%ld", i ? "," : "", count_event_names[i],
+            total.events[i]);
+    write_str(w, buf);
+  }
+  write_str(w, "}}\n");
+}
+
+#else
+
+#define alloc_count(tag, bytes) ((void)(tag), (void)(bytes))
+
+#endif
+
+#ifdef CHOCC_ARENA
+
+/*
+ * block heads every allocation, linking it into the arena it was made in,
+ * if any, so it can be freed alone or with the arena. The union keeps what
+ * follows aligned for any type.
+ */
+union block {
+  struct {
+    union block *prev;
+    union block *next;
+    struct arena *arena;
+  } h;
+  long double align;
+};
+
+struct arena {
+  union block head; /* both ends of the list of blocks */
+};
+
+pthread_key_t arena_key;
+pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+void arena_key_create(void) {
+  pthread_key_create(&arena_key, NULL);
+}
+
+struct arena *arena_new(void) {
+  struct arena *a = malloc(sizeof(*a));
+
+  a->head.h.prev = a->head.h.next = &a->head;
+  a->head.h.arena = a;
+  return a;
+}
+
+struct arena *arena_enter(struct arena *a) {
+  struct arena *last;
+
+  pthread_once(&arena_once, arena_key_create);
+  last = pthread_getspecific(arena_key);
+  pthread_setspecific(arena_key, a);
+  return last;
+}
+
+void arena_free(struct arena *a) {
+  union block *b, *next;
+
+  if (!a) {
+    return;
+  }
+  for (b = a->head.h.next; b != &a->head; b = next) {
+    next = b->h.next;
+    free(b);
+  }
+  free(a);
+}
+
+/* Links a new block into the calling thread's arena. Returns its memory. */
+void *block_link(union block *b) {
+  struct arena *a;
+
+  if (!b) {
+    return NULL;
+  }
+  pthread_once(&arena_once, arena_key_create);
+  if ((a = b->h.arena = pthread_getspecific(arena_key))) {
+    b->h.prev = &a->head;
+    b->h.next = a->head.h.next;
+    a->head.h.next->h.prev = b;
+    a->head.h.next = b;
+  }
+  return b + 1;
+}
+
+void *block_malloc(size_t size) {
+  return block_link(malloc(sizeof(union block) + size));
+}
+
+void *block_calloc(size_t n, size_t size) {
+  return block_link(calloc(1, sizeof(union block) + n * size));
+}
+
+void *block_realloc(void *ptr, size_t size) {
+  union block *b;
+
+  if (!ptr) {
+    return block_malloc(size);
+  }
+  /* it stays in its arena, whichever the thread is in now */
+  if (!(b = realloc((union block *)ptr - 1, sizeof(*b) + size))) {
+    return NULL;
+  }
+  if (b->h.arena) {
+    b->h.prev->h.next = b;
+    b->h.next->h.prev = b;
+  }
+  return b + 1;
+}
+
+void alloc_free(void *ptr) {
+  union block *b;
+
+  if (!ptr) {
+    return;
+  }
+  b = (union block *)ptr - 1;
+  if (b->h.arena) {
+    b->h.prev->h.next = b->h.next;
+    b->h.next->h.prev = b->h.prev;
+  }
+  free(b);
+}
+
+#else
+
+#define block_malloc(size) malloc(size)
+#define block_calloc(n, size) calloc(n, size)
+#define block_realloc(ptr, size) realloc(ptr, size)
+
+#endif
+
+#if defined(CHOCC_COUNTERS) || defined(CHOCC_ARENA)
+
+void *alloc_malloc(alloc_tag tag, size_t size) {
+  alloc_count(tag, size);
+  return block_malloc(size);
+}
+
+void *alloc_calloc(alloc_tag tag, size_t n, size_t size) {
+  alloc_count(tag, n * size);
+  return block_calloc(n, size);
+}
+
+void *alloc_realloc(alloc_tag tag, void *ptr, size_t size) {
+  alloc_count(tag, size);
+  return block_realloc(ptr, size);
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef CHOCC_ALLOC_H
+#define CHOCC_ALLOC_H
+#pragma once
+
+#include <stdlib.h>
+
+#include "chocc.h"
+#include "io.h"
+
+/* the subsystems the front end allocates for */
+typedef enum alloc_tag {
+  IoAlloc,
+  LexAlloc,
+  CppAlloc,
+  ParseAlloc,
+  UnitAlloc,
+  SemaAlloc
+} alloc_tag;
+#define ALLOC_TAGS 6
+
+/* the events of the front end's hot paths */
+typedef enum count_event {
+  TokensLexed,
+  Advances,
+  SetPos,
+  Backtracks,
+  MacroLookups
+} count_event;
+#define COUNT_EVENTS 5
+
+/*
+ * Built with CHOCC_COUNTERS, allocations are counted in calls and bytes
+ * under their tag and the events are counted, per thread and totalled
+ * over every thread. Built with CHOCC_ARENA, as chocc.so is, allocations
+ * belong to the arena of the calling thread, if it has one. Without
+ * either, the allocations are plain calls to the C library and the events
+ * compile to nothing.
+ */
+#if defined(CHOCC_COUNTERS) || defined(CHOCC_ARENA)
+
+void *alloc_malloc(alloc_tag, size_t size);
+void *alloc_calloc(alloc_tag, size_t n, size_t size);
+void *alloc_realloc(alloc_tag, void *ptr, size_t size);
+
+#else
+
+#define alloc_malloc(tag, size) malloc(size)
+#define alloc_calloc(tag, n, size) calloc(n, size)
+#define alloc_realloc(tag, ptr, size) realloc(ptr, size)
+
+#endif
+
+#ifdef CHOCC_COUNTERS
+
+void count_event_add(count_event);
+#define COUNT(e) count_event_add(e)
+
+/* Writes the counts totalled over every thread so far, or as JSON */
+void write_counts(writer *);
+void write_counts_json(writer *);
+
+#else
+
+#define COUNT(e) ((void)0)
+
+#endif
+
+#ifdef CHOCC_ARENA
+
+/*
+ * arena owns what a thread allocates while it is the thread's arena, so
+ * it can all be freed at once. An arena is used by one thread at a time.
+ */
+struct arena;
+
+struct arena *arena_new(void);
+/* Makes a the calling thread's arena, or none with NULL. Returns the last. */
+struct arena *arena_enter(struct arena *a);
+/* Frees a and everything allocated in it not freed already */
+void arena_free(struct arena *a);
+
+/* Frees what alloc_malloc, alloc_calloc or alloc_realloc returned */
+void alloc_free(void *ptr);
+
+#else
+
+#define alloc_free(ptr) free(ptr)
+
+#endif
+
+#endif
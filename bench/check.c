@@ -0,0 +1,80 @@
+/*
+ * Measures type checking of struct-heavy code as structs grow wider. With
+ * memoized layouts and hashed member lookup, time per member access stays
+ * flat.
+ *
+ * usage: bench_check [total fields]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../check.h"
+#include "../cpp.h"
+#include "../fold.h"
+#include "../lex.h"
+#include "../parse.h"
+#include "../resolve.h"
+#include "../unit.h"
+
+/*
+ * Generates structs of width fields each, totalling about total fields, and
+ * a function reading every field of each through a pointer.
+ */
+char *gen(long total, long width) {
+  long structs = total / width;
+  char *src = malloc(structs * width * 64 + structs * 128 + 1);
+  char *pos = src;
+  long i, j;
+
+  for (i = 0; i < structs; i++) {
+    pos += sprintf(pos, "struct s%ld {\n", i);
+    for (j = 0; j < width; j++) {
+      pos += sprintf(pos, "  %s f%ld;\n", j % 3 ? "int" : "char", j);
+    }
+    pos += sprintf(pos, "};\nlong g%ld(struct s%ld *p) {\n  long n = 0;\n", i,
+                   i);
+    for (j = 0; j < width; j++) {
+      pos += sprintf(pos, "  n += p->f%ld;\n", j);
+    }
+    pos += sprintf(pos, "  return n + sizeof(struct s%ld);\n}\n", i);
+  }
+
+  return src;
+}
+
+double secs(clock_t begin) {
+  return (double)(clock() - begin) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[]) {
+  long total = argc > 1 ? atol(argv[1]) : 100000;
+  long width;
+
+  printf("%-8s %10s %10s %12s\n", "width", "structs", "secs", "ns/field");
+
+  for (width = 100; width <= 1600; width *= 2) {
+    struct unit u;
+    clock_t begin;
+    double s;
+
+    u = new_unit();
+    u.file = src_to_file(gen(total, width));
+    lex(&u);
+    u = filter_newline(&u);
+    parse(&u);
+    fold(&u);
+    resolve(&u);
+
+    begin = clock();
+    check(&u);
+    s = secs(begin);
+
+    printf("%-8ld %10ld %10.3f %12.1f\n", width, total / width, s,
+           s * 1e9 / (total / width * width));
+  }
+
+  return 0;
+}
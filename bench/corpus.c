@@ -0,0 +1,182 @@
+/*
+ * Measures the front end on real code: each file is compiled through check
+ * as a unit of its own, and the median time, the memory it grew by and how
+ * far it got are written per file. make corpus preprocesses chocc's own
+ * sources against the stub system headers in bench/corpus/include.
+ *
+ * usage: bench_corpus [-r runs] file ...
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../driver.h"
+#include "../error.h"
+#include "../io.h"
+#include "../stats.h"
+#include "../unit.h"
+
+/* what one run of a file sends back */
+struct result {
+  double secs;
+  long bytes;
+  long lines;
+  long toks;
+  long grew_kb; /* the peak resident memory, less what it was before */
+  bool ok;
+  char msg[96]; /* the last line of the error, if not ok */
+};
+
+/* Returns the peak resident memory of the process in KB */
+long peak_kb(void) {
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+/* Copies the last line of the error text in buf to r */
+void set_msg(struct result *r, char *buf, size_t len) {
+  char *line;
+
+  while (len && buf[len - 1] == '\n') {
+    buf[--len] = '\0';
+  }
+  line = strrchr(buf, '\n');
+  strncpy(r->msg, line ? line + 1 : buf, sizeof(r->msg) - 1);
+}
+
+/* Compiles path through check, filling r. Runs in a process of its own. */
+void run_file(char *path, struct result *r) {
+  struct options opts;
+  struct stats stats;
+  struct fatal_catch c;
+  struct unit u;
+  size_t len = 0;
+  char *buf = NULL;
+  writer w = new_writer(open_memstream(&buf, &len));
+  long kb = peak_kb();
+  file *f;
+  int s;
+
+  memset(&opts, 0, sizeof(opts));
+  memset(&stats, 0, sizeof(stats));
+  memset(r, 0, sizeof(*r));
+  stats.path = path;
+
+  c.w = &w;
+  if (!setjmp(c.env)) {
+    fatal_catch(&c);
+    stats_begin(&stats);
+    f = load_file(path);
+    stats_end(&stats, StageLoad);
+    r->bytes = f->lines_len ? f->lines[f->lines_len - 1].off +
+                                  f->lines[f->lines_len - 1].len
+                            : 0;
+    u = compile_toks(f, &stats);
+    if (u.err) {
+      write_error(&w, u.err);
+    } else {
+      r->toks = u.toks_len;
+      compile_nodes(&u, &opts);
+      r->ok = true;
+    }
+  }
+  fatal_catch(NULL);
+  free_writer(&w);
+  fclose(w.stream);
+  if (!r->ok) {
+    set_msg(r, buf, len);
+  }
+
+  for (s = 0; s < StageWrite; s++) {
+    r->secs += stats.wall[s];
+  }
+  r->lines = stats.lines;
+  r->grew_kb = peak_kb() - kb;
+}
+
+int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* Runs path runs times, each in a child, and returns the median run */
+struct result bench_file(char *path, int runs) {
+  struct result r, *rs = calloc(runs, sizeof(*rs));
+  double *secs = calloc(runs, sizeof(*secs));
+  int i, fds[2], status;
+
+  for (i = 0; i < runs; i++) {
+    if (pipe(fds)) {
+      puts("bench_corpus: could not make a pipe");
+      exit(1);
+    }
+    /* _exit, or the child flushes what stdout buffers */
+    if (!fork()) {
+      run_file(path, &r);
+      _exit(write(fds[1], &r, sizeof(r)) != sizeof(r));
+    }
+    wait(&status);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) ||
+        read(fds[0], rs + i, sizeof(*rs)) != sizeof(*rs)) {
+      /* a crash is reported like an error, with nothing measured */
+      memset(rs + i, 0, sizeof(*rs));
+      strcpy(rs[i].msg, "crashed");
+    }
+    close(fds[0]);
+    close(fds[1]);
+    secs[i] = rs[i].secs;
+  }
+
+  qsort(secs, runs, sizeof(*secs), cmp_double);
+  r = rs[0];
+  for (i = 0; i < runs; i++) {
+    if (rs[i].secs == secs[runs / 2]) {
+      r = rs[i];
+    }
+  }
+  free(rs);
+  free(secs);
+  return r;
+}
+
+int main(int argc, char *argv[]) {
+  int runs = 5, first = 1, ok = 0, i;
+  double secs = 0;
+  long bytes = 0;
+
+  if (argc > 2 && !strcmp(argv[1], "-r")) {
+    runs = atoi(argv[2]) > 0 ? atoi(argv[2]) : 1;
+    first = 3;
+  }
+  if (first >= argc) {
+    puts("usage: bench_corpus [-r runs] file ...");
+    return 1;
+  }
+
+  printf("%-32s %8s %7s %8s %9s %8s %8s  %s\n", "file", "KB", "lines",
+         "tokens", "ms", "MB/s", "grew KB", "result");
+  for (i = first; i < argc; i++) {
+    struct result r = bench_file(argv[i], runs);
+
+    printf("%-32s %8.1f %7ld %8ld %9.3f %8.1f %8ld  %s\n", argv[i],
+           r.bytes / 1024.0, r.lines, r.toks, r.secs * 1e3,
+           r.secs > 0 ? r.bytes / r.secs / 1e6 : 0.0, r.grew_kb,
+           r.ok ? "ok" : r.msg);
+    if (r.ok) {
+      ok++;
+      secs += r.secs;
+      bytes += r.bytes;
+    }
+  }
+  printf("%d of %d files compiled, %.1f KB in %.3f ms, %.1f MB/s\n", ok,
+         argc - first, bytes / 1024.0, secs * 1e3,
+         secs > 0 ? bytes / secs / 1e6 : 0.0);
+  return 0;
+}
@@ -0,0 +1,11 @@
+/* the parts of <ctype.h> chocc's sources use */
+#ifndef CORPUS_CTYPE_H
+#define CORPUS_CTYPE_H
+
+int isdigit(int c);
+int isspace(int c);
+int isxdigit(int c);
+int isalpha(int c);
+int isalnum(int c);
+
+#endif
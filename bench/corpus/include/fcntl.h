@@ -0,0 +1,12 @@
+/* the parts of <fcntl.h> chocc's sources use */
+#ifndef CORPUS_FCNTL_H
+#define CORPUS_FCNTL_H
+
+#define O_RDONLY 0
+#define O_WRONLY 1
+#define O_RDWR 2
+
+/* without a prototype, since chocc does not parse ... yet */
+int open();
+
+#endif
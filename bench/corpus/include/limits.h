@@ -0,0 +1,11 @@
+/* the limits chocc's sources use, for x86-64 */
+#ifndef CORPUS_LIMITS_H
+#define CORPUS_LIMITS_H
+
+#define CHAR_BIT 8
+#define INT_MAX 2147483647
+#define INT_MIN (-INT_MAX - 1)
+#define LONG_MAX 9223372036854775807L
+#define LONG_MIN (-LONG_MAX - 1)
+
+#endif
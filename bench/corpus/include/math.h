@@ -0,0 +1,11 @@
+/* the parts of <math.h> chocc's sources use */
+#ifndef CORPUS_MATH_H
+#define CORPUS_MATH_H
+
+double ceil(double x);
+double floor(double x);
+double fabs(double x);
+double fmod(double x, double y);
+double sqrt(double x);
+
+#endif
@@ -0,0 +1,29 @@
+/* the parts of <pthread.h> chocc's sources use */
+#ifndef CORPUS_PTHREAD_H
+#define CORPUS_PTHREAD_H
+
+typedef unsigned long pthread_t;
+typedef struct {
+  long opaque[5];
+} pthread_mutex_t;
+typedef unsigned int pthread_key_t;
+typedef int pthread_once_t;
+
+#define PTHREAD_MUTEX_INITIALIZER {{0}}
+#define PTHREAD_ONCE_INIT 0
+
+int pthread_create(pthread_t *t, const void *attr, void *(*fn)(void *),
+                   void *arg);
+int pthread_detach(pthread_t t);
+int pthread_join(pthread_t t, void **ret);
+int pthread_key_create(pthread_key_t *key, void (*dtor)(void *));
+int pthread_key_delete(pthread_key_t key);
+void *pthread_getspecific(pthread_key_t key);
+int pthread_setspecific(pthread_key_t key, const void *val);
+int pthread_mutex_init(pthread_mutex_t *m, const void *attr);
+int pthread_mutex_destroy(pthread_mutex_t *m);
+int pthread_mutex_lock(pthread_mutex_t *m);
+int pthread_mutex_unlock(pthread_mutex_t *m);
+int pthread_once(pthread_once_t *once, void (*fn)(void));
+
+#endif
@@ -0,0 +1,10 @@
+/* the parts of <setjmp.h> chocc's sources use */
+#ifndef CORPUS_SETJMP_H
+#define CORPUS_SETJMP_H
+
+typedef long jmp_buf[8];
+
+int setjmp(jmp_buf env);
+void longjmp(jmp_buf env, int val);
+
+#endif
@@ -0,0 +1,12 @@
+/* the parts of <signal.h> chocc's sources use */
+#ifndef CORPUS_SIGNAL_H
+#define CORPUS_SIGNAL_H
+
+typedef void (*sighandler_t)(int);
+
+#define SIGPIPE 13
+#define SIG_IGN ((sighandler_t)1)
+
+sighandler_t signal(int sig, sighandler_t handler);
+
+#endif
@@ -0,0 +1,11 @@
+/* <stdarg.h> as types and macros chocc can parse */
+#ifndef CORPUS_STDARG_H
+#define CORPUS_STDARG_H
+
+typedef char *va_list;
+
+#define va_start(ap, last) ((ap) = (char *)&(last))
+#define va_arg(ap, type) (*(type *)((ap) += sizeof(type)))
+#define va_end(ap) ((void)(ap))
+
+#endif
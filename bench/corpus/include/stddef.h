@@ -0,0 +1,10 @@
+/* the size and null pointer types of the corpus */
+#ifndef CORPUS_STDDEF_H
+#define CORPUS_STDDEF_H
+
+typedef unsigned long size_t;
+typedef long ptrdiff_t;
+
+#define NULL ((void *)0)
+
+#endif
@@ -0,0 +1,43 @@
+/* the parts of <stdio.h> chocc's sources use */
+#ifndef CORPUS_STDIO_H
+#define CORPUS_STDIO_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct corpus_file FILE;
+
+extern FILE *stdin;
+extern FILE *stdout;
+extern FILE *stderr;
+
+#define EOF (-1)
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+FILE *fopen(const char *path, const char *mode);
+FILE *fdopen(int fd, const char *mode);
+FILE *open_memstream(char **buf, size_t *len);
+int fclose(FILE *f);
+int fflush(FILE *f);
+int ferror(FILE *f);
+int fileno(FILE *f);
+int fseek(FILE *f, long off, int whence);
+long ftell(FILE *f);
+size_t fread(void *p, size_t size, size_t n, FILE *f);
+size_t fwrite(const void *p, size_t size, size_t n, FILE *f);
+int fputc(int c, FILE *f);
+int fputs(const char *s, FILE *f);
+int puts(const char *s);
+/* without prototypes, since chocc does not parse ... yet */
+int printf();
+int fprintf();
+int sprintf();
+int vprintf(const char *fmt, va_list ap);
+int vfprintf(FILE *f, const char *fmt, va_list ap);
+ssize_t getline(char **line, size_t *cap, FILE *f);
+int remove(const char *path);
+
+#endif
@@ -0,0 +1,22 @@
+/* the parts of <stdlib.h> chocc's sources use */
+#ifndef CORPUS_STDLIB_H
+#define CORPUS_STDLIB_H
+
+#include <stddef.h>
+
+void *malloc(size_t size);
+void *calloc(size_t n, size_t size);
+void *realloc(void *p, size_t size);
+void free(void *p);
+void exit(int status);
+int atoi(const char *s);
+long atol(const char *s);
+long strtol(const char *s, char **end, int base);
+char *getenv(const char *name);
+char *mkdtemp(char *tmpl);
+void qsort(void *base, size_t n, size_t size,
+           int (*cmp)(const void *, const void *));
+void *bsearch(const void *key, const void *base, size_t n, size_t size,
+              int (*cmp)(const void *, const void *));
+
+#endif
@@ -0,0 +1,18 @@
+/* the parts of <sys/mman.h> chocc's sources use */
+#ifndef CORPUS_SYS_MMAN_H
+#define CORPUS_SYS_MMAN_H
+
+#include <stddef.h>
+
+#define PROT_NONE 0
+#define PROT_READ 1
+#define PROT_WRITE 2
+#define PROT_EXEC 4
+#define MAP_PRIVATE 2
+#define MAP_FAILED ((void *)-1)
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, long off);
+int mprotect(void *addr, size_t len, int prot);
+int munmap(void *addr, size_t len);
+
+#endif
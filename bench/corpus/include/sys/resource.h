@@ -0,0 +1,20 @@
+/* the parts of <sys/resource.h> chocc's sources use */
+#ifndef CORPUS_SYS_RESOURCE_H
+#define CORPUS_SYS_RESOURCE_H
+
+struct timeval {
+  long tv_sec;
+  long tv_usec;
+};
+
+struct rusage {
+  struct timeval ru_utime;
+  struct timeval ru_stime;
+  long ru_maxrss;
+};
+
+#define RUSAGE_SELF 0
+
+int getrusage(int who, struct rusage *usage);
+
+#endif
@@ -0,0 +1,21 @@
+/* the parts of <sys/socket.h> chocc's sources use */
+#ifndef CORPUS_SYS_SOCKET_H
+#define CORPUS_SYS_SOCKET_H
+
+typedef unsigned int socklen_t;
+
+struct sockaddr {
+  unsigned short sa_family;
+  char sa_data[14];
+};
+
+#define AF_UNIX 1
+#define SOCK_STREAM 1
+
+int socket(int domain, int type, int protocol);
+int bind(int fd, const struct sockaddr *addr, socklen_t len);
+int listen(int fd, int backlog);
+int accept(int fd, struct sockaddr *addr, socklen_t *len);
+int connect(int fd, const struct sockaddr *addr, socklen_t len);
+
+#endif
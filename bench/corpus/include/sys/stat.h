@@ -0,0 +1,18 @@
+/* the parts of <sys/stat.h> chocc's sources use */
+#ifndef CORPUS_SYS_STAT_H
+#define CORPUS_SYS_STAT_H
+
+#include <time.h>
+
+struct stat {
+  unsigned int st_mode;
+  long st_size;
+  struct timespec st_mtim;
+};
+
+#define S_ISREG(m) (((m) & 61440) == 32768)
+
+int stat(const char *path, struct stat *st);
+int fstat(int fd, struct stat *st);
+
+#endif
@@ -0,0 +1,9 @@
+/* the POSIX types shared by the headers of the corpus */
+#ifndef CORPUS_SYS_TYPES_H
+#define CORPUS_SYS_TYPES_H
+
+typedef long ssize_t;
+typedef long off_t;
+typedef int pid_t;
+
+#endif
@@ -0,0 +1,10 @@
+/* the parts of <sys/un.h> chocc's sources use */
+#ifndef CORPUS_SYS_UN_H
+#define CORPUS_SYS_UN_H
+
+struct sockaddr_un {
+  unsigned short sun_family;
+  char sun_path[108];
+};
+
+#endif
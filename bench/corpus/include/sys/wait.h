@@ -0,0 +1,12 @@
+/* the parts of <sys/wait.h> chocc's sources use */
+#ifndef CORPUS_SYS_WAIT_H
+#define CORPUS_SYS_WAIT_H
+
+#include <sys/types.h>
+
+#define WIFEXITED(s) (((s) & 127) == 0)
+#define WEXITSTATUS(s) (((s) >> 8) & 255)
+
+pid_t waitpid(pid_t pid, int *status, int options);
+
+#endif
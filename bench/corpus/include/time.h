@@ -0,0 +1,22 @@
+/* the parts of <time.h> chocc's sources use */
+#ifndef CORPUS_TIME_H
+#define CORPUS_TIME_H
+
+typedef long clock_t;
+typedef long time_t;
+typedef int clockid_t;
+
+struct timespec {
+  time_t tv_sec;
+  long tv_nsec;
+};
+
+#define CLOCKS_PER_SEC 1000000L
+#define CLOCK_MONOTONIC 1
+#define CLOCK_PROCESS_CPUTIME_ID 2
+#define CLOCK_THREAD_CPUTIME_ID 3
+
+clock_t clock(void);
+int clock_gettime(clockid_t clock, struct timespec *ts);
+
+#endif
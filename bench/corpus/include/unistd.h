@@ -0,0 +1,26 @@
+/* the parts of <unistd.h> chocc's sources use */
+#ifndef CORPUS_UNISTD_H
+#define CORPUS_UNISTD_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define _SC_NPROCESSORS_ONLN 84
+
+ssize_t read(int fd, void *buf, size_t n);
+ssize_t write(int fd, const void *buf, size_t n);
+int close(int fd);
+int dup(int fd);
+int dup2(int fd, int to);
+int pipe(int fds[2]);
+pid_t fork(void);
+void _exit(int status);
+int execv(const char *path, char *const argv[]);
+/* without a prototype, since chocc does not parse ... yet */
+int execlp();
+int unlink(const char *path);
+int rmdir(const char *path);
+char *getcwd(char *buf, size_t size);
+long sysconf(int name);
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Measures AST dump throughput of the text and JSON writers.
+ *
+ * usage: bench_dump [functions]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../cpp.h"
+#include "../io.h"
+#include "../lex.h"
+#include "../parse.h"
+#include "../unit.h"
+
+/* Generates fns functions with a mix of statements and expressions */
+char *gen(long fns) {
+  char *src = malloc(fns * 256 + 1);
+  char *pos = src;
+  long i;
+
+  for (i = 0; i < fns; i++) {
+    pos += sprintf(pos,
+                   "int f%ld(int a, char *b) {\n"
+                   "  int i = 0, j = %ld;\n"
+                   "  for (i = 0; i < a; i++) {\n"
+                   "    if (b[i] == 'x') j += i * 2; else j = j - f%ld(i, b);\n"
+                   "  }\n"
+                   "  while (j > 0) j = j >> 1;\n"
+                   "  return j ? i : \"none\"[a %% 4];\n"
+                   "}\n",
+                   i, i, i / 2);
+  }
+
+  return src;
+}
+
+double secs(clock_t begin) {
+  return (double)(clock() - begin) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[]) {
+  long fns = argc > 1 ? atol(argv[1]) : 20000;
+  const char *names[] = {"text", "ndjson"};
+  struct unit u;
+  int fmt;
+
+  u = new_unit();
+  u.file = src_to_file(gen(fns));
+  lex(&u);
+  u = filter_newline(&u);
+  parse(&u);
+
+  printf("%-8s %10s %10s %10s\n", "format", "MB", "secs", "MB/s");
+
+  for (fmt = 0; fmt < 2; fmt++) {
+    FILE *out = tmpfile();
+    writer w;
+    clock_t begin;
+    double s;
+    double mb;
+    int i;
+
+    begin = clock();
+    w = new_writer(out);
+    for (i = 0; i < u.nodes_len; i++) {
+      if (fmt) {
+        write_ast_json(&w, u.nodes + i);
+        write_char(&w, '\n');
+      } else {
+        write_ast(&w, u.nodes + i, i == u.nodes_len - 1);
+      }
+    }
+    free_writer(&w);
+    s = secs(begin);
+
+    mb = ftell(out) / 1e6;
+    printf("%-8s %10.1f %10.3f %10.1f\n", names[fmt], mb, s, mb / s);
+    fclose(out);
+  }
+
+  return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Parses machine-generated expressions with a large number of terms.
+ *
+ * usage: bench_expr [terms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../cpp.h"
+#include "../io.h"
+#include "../lex.h"
+#include "../parse.h"
+#include "../unit.h"
+
+typedef enum shape { Chain, Ternary, Nested, Assign } shape;
+
+const char *shape_names[] = {"a + b + ...", "c ? 0 : c ? 1 : ...",
+                             "((((...))))", "a = a = ..."};
+
+/* Generates "int x = <expr>;" with the given number of terms */
+char *gen(shape s, long terms) {
+  char *src = malloc(terms * 16 + 32);
+  char *pos = src;
+  long i;
+
+  pos += sprintf(pos, "int x = ");
+  for (i = 0; i < terms; i++) {
+    switch (s) {
+    case Chain:
+      pos += sprintf(pos, i ? " + a%ld" : "a%ld", i % 1000);
+      break;
+    case Ternary:
+      pos += sprintf(pos, "c ? %ld : ", i % 1000);
+      break;
+    case Nested:
+      *pos++ = '(';
+      break;
+    case Assign:
+      pos += sprintf(pos, "a = ");
+      break;
+    }
+  }
+  switch (s) {
+  case Ternary:
+  case Assign:
+    pos += sprintf(pos, "0");
+    break;
+  case Nested:
+    *pos++ = 'a';
+    for (i = 0; i < terms; i++) {
+      *pos++ = ')';
+    }
+    break;
+  default:
+    break;
+  }
+  sprintf(pos, ";\n");
+
+  return src;
+}
+
+double secs(clock_t begin) {
+  return (double)(clock() - begin) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[]) {
+  long terms = argc > 1 ? atol(argv[1]) : 1000000;
+  int s;
+
+  printf("%-22s %10s %10s %10s %12s\n", "shape", "terms", "lex (s)",
+         "parse (s)", "terms/s");
+
+  for (s = Chain; s <= Assign; s++) {
+    struct unit u;
+    clock_t begin;
+    double lex_secs;
+    double parse_secs;
+
+    u = new_unit();
+    u.file = src_to_file(gen(s, terms));
+
+    begin = clock();
+    lex(&u);
+    u = filter_newline(&u);
+    lex_secs = secs(begin);
+
+    begin = clock();
+    parse(&u);
+    parse_secs = secs(begin);
+
+    printf("%-22s %10ld %10.3f %10.3f %12.0f\n", shape_names[s], terms,
+           lex_secs, parse_secs, terms / parse_secs);
+  }
+
+  return 0;
+}
@@ -0,0 +1,436 @@
+/*
+ * Measures the throughput of each stage of the front end, in MB/s of source
+ * and tokens/s, on generated units whose size, macros, typedefs, #if nesting,
+ * expression depth and function count are set by workloads. Each workload
+ * runs until the median of its total time is stable, and the medians can be
+ * written as a baseline that later runs are compared against.
+ *
+ * usage: bench_front [-g] [-r runs] [-b baseline] [-w baseline]
+ *                    [workload[:knob=n,...] ...]
+ *
+ * -g writes the source of each workload instead of timing it. A knob
+ * overrides one field of a workload, e.g. plain:kb=256,expr=6.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../driver.h"
+#include "../io.h"
+#include "../stats.h"
+#include "../unit.h"
+
+/* the knobs of a generated unit */
+struct workload {
+  const char *name;
+  long kb;       /* the size the source grows to */
+  long fns;      /* functions the size is spread over */
+  long macros;   /* percent of operands that are macro calls */
+  long nest;     /* object-like macros each call expands through */
+  long typedefs; /* typedef'd structs, each with a pointer typedef */
+  long ifs;      /* #if blocks nested around each function */
+  long expr;     /* operators in each expression, nested to the right */
+};
+
+struct workload workloads[] = {
+    {"plain", 64, 200, 0, 0, 0, 0, 2},
+    {"macros", 64, 200, 60, 6, 0, 0, 2},
+    {"typedefs", 64, 200, 0, 0, 400, 0, 2},
+    {"ifs", 64, 200, 0, 0, 0, 12, 2},
+    {"exprs", 64, 100, 0, 0, 0, 0, 16},
+    {"mixed", 256, 400, 20, 3, 50, 3, 4}};
+
+#define WORKLOADS (sizeof(workloads) / sizeof(*workloads))
+
+/* runs of a workload beyond its minimum, until its total is stable */
+#define MAX_RUNS_FACTOR 4
+/*
+ * the uncertainty of the median total counted as stable, in percent: the
+ * spread of the runs over the square root of their number
+ */
+#define STABLE_PCT 2.0
+
+/* Returns the next of a fixed sequence of numbers below 2^31 */
+long rnd(unsigned long *seed) {
+  *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+  return (long)(*seed >> 8);
+}
+
+/* Writes an operand, a macro call as often as w asks */
+void gen_operand(FILE *f, struct workload *w, unsigned long *seed) {
+  const char *vars[] = {"a", "b", "x"};
+  long r = rnd(seed);
+
+  if (w->nest && r % 100 < w->macros) {
+    fprintf(f, "M(%s)", vars[r % 3]);
+  } else if (r % 4 == 3) {
+    fprintf(f, "%ld", r % 1000);
+  } else {
+    fputs(vars[r % 3], f);
+  }
+}
+
+/* Writes an expression of depth operators, nested to the right */
+void gen_expr(FILE *f, struct workload *w, unsigned long *seed, long depth) {
+  const char *ops[] = {"+", "-", "*", "&", "|", "^", "<", "=="};
+
+  if (!depth) {
+    gen_operand(f, w, seed);
+    return;
+  }
+  fputc('(', f);
+  gen_operand(f, w, seed);
+  fprintf(f, " %s ", ops[rnd(seed) % 8]);
+  gen_expr(f, w, seed, depth - 1);
+  fputc(')', f);
+}
+
+/* Writes the i-th function, growing it until it has its share of the size */
+void gen_fn(FILE *f, struct workload *w, unsigned long *seed, long i) {
+  long begin = ftell(f);
+  long size = w->kb * 1024 / w->fns;
+  long k, t = w->typedefs ? i % w->typedefs : 0;
+
+  for (k = 0; k < w->ifs; k++) {
+    fprintf(f, "#if LEVEL > %ld\n", k);
+  }
+  fprintf(f, "int f%ld(int a, int b) {\n", i);
+  if (w->typedefs) {
+    fprintf(f, "  r%ld v;\n  p%ld q = &v;\n", t, t);
+  }
+  fputs("  int x = a;\n", f);
+  for (k = 0; ftell(f) - begin < size; k++) {
+    switch (k % (w->typedefs ? 4 : 2)) {
+    case 0:
+      fputs("  x = ", f);
+      gen_expr(f, w, seed, w->expr);
+      fputs(";\n", f);
+      break;
+    case 1:
+      fputs("  if ", f);
+      gen_expr(f, w, seed, w->expr / 2 + 1);
+      fputs("\n    x += b;\n  else\n    x = ", f);
+      gen_expr(f, w, seed, w->expr / 2);
+      fputs(";\n", f);
+      break;
+    case 2:
+      fputs("  v.a = ", f);
+      gen_expr(f, w, seed, w->expr);
+      fputs(";\n", f);
+      break;
+    default:
+      fputs("  q->b = q->a + x;\n  x = v.b > 0;\n", f);
+    }
+  }
+  fputs("  return x;\n}\n", f);
+  for (k = w->ifs; k > 0; k--) {
+    fprintf(f, "#else\nint skip%ld_%ld;\n#endif\n", i, k);
+  }
+}
+
+/* Returns the source of the unit w describes, and its length in len */
+char *gen(struct workload *w, long *len) {
+  unsigned long seed = 1;
+  size_t size;
+  char *src;
+  FILE *f = open_memstream(&src, &size);
+  long i;
+
+  fprintf(f, "/* %s: kb=%ld fns=%ld macros=%ld nest=%ld typedefs=%ld ifs=%ld "
+             "expr=%ld */\n",
+          w->name, w->kb, w->fns, w->macros, w->nest, w->typedefs, w->ifs,
+          w->expr);
+  fprintf(f, "#define LEVEL %ld\n", w->ifs);
+  if (w->nest) {
+    fputs("#define K0 3\n", f);
+    for (i = 1; i < w->nest; i++) {
+      fprintf(f, "#define K%ld (K%ld + %ld)\n", i, i - 1, i);
+    }
+    fprintf(f, "#define M(x) ((x) * K%ld)\n", w->nest - 1);
+  }
+  for (i = 0; i < w->typedefs; i++) {
+    fprintf(f, "typedef struct r%ld { int a; long b; } r%ld;\n", i, i);
+    fprintf(f, "typedef r%ld *p%ld;\n", i, i);
+  }
+  for (i = 0; i < w->fns; i++) {
+    gen_fn(f, w, &seed, i);
+  }
+  fclose(f);
+  *len = size;
+  return src;
+}
+
+/* Sets the knobs of w from a spec like name:kb=256,expr=6 */
+struct workload *parse_workload(char *spec) {
+  struct workload *w = NULL;
+  char *knob;
+  size_t i, name_len = strcspn(spec, ":");
+
+  for (i = 0; i < WORKLOADS; i++) {
+    if (strlen(workloads[i].name) == name_len &&
+        !strncmp(workloads[i].name, spec, name_len)) {
+      w = malloc(sizeof(*w));
+      *w = workloads[i];
+    }
+  }
+  if (!w) {
+    printf("bench_front: no workload %s\n", spec);
+    exit(1);
+  }
+  for (knob = strtok(spec[name_len] ? spec + name_len + 1 : spec + name_len,
+                     ",");
+       knob; knob = strtok(NULL, ",")) {
+    char *eq = strchr(knob, '=');
+    long *field = NULL;
+
+    if (eq) {
+      *eq = '\0';
+      field = !strcmp(knob, "kb")         ? &w->kb
+              : !strcmp(knob, "fns")      ? &w->fns
+              : !strcmp(knob, "macros")   ? &w->macros
+              : !strcmp(knob, "nest")     ? &w->nest
+              : !strcmp(knob, "typedefs") ? &w->typedefs
+              : !strcmp(knob, "ifs")      ? &w->ifs
+              : !strcmp(knob, "expr")     ? &w->expr
+                                          : NULL;
+    }
+    if (!field) {
+      printf("bench_front: no knob %s\n", knob);
+      exit(1);
+    }
+    *field = atol(eq + 1);
+  }
+  if (w->fns < 1) {
+    w->fns = 1;
+  }
+  return w;
+}
+
+int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* Returns the median of xs, which it sorts */
+double median(double *xs, int len) {
+  qsort(xs, len, sizeof(*xs), cmp_double);
+  return len % 2 ? xs[len / 2] : (xs[len / 2 - 1] + xs[len / 2]) / 2;
+}
+
+/*
+ * Returns the median absolute deviation of xs from med, in percent of med.
+ * Unlike the standard deviation, one run interrupted by the system does not
+ * move it.
+ */
+double spread(double *xs, int len, double med) {
+  double *devs = malloc(len * sizeof(*devs));
+  double d;
+  int i;
+
+  for (i = 0; i < len; i++) {
+    devs[i] = xs[i] > med ? xs[i] - med : med - xs[i];
+  }
+  d = median(devs, len);
+  free(devs);
+  return med > 0 ? 100 * d / med : 0;
+}
+
+/*
+ * Compiles src once, recording the time of each stage in stats. Units are
+ * never freed, so each run is a process of its own, starting from the same
+ * heap rather than one grown by every run before it.
+ */
+void run_once(char *src, struct stats *stats) {
+  struct options opts;
+  struct unit u;
+  file *f;
+  int fds[2], status;
+
+  if (pipe(fds)) {
+    puts("bench_front: could not make a pipe");
+    exit(1);
+  }
+  /* _exit, or the child flushes the buffers of stdout and the baseline */
+  if (!fork()) {
+    memset(&opts, 0, sizeof(opts));
+    stats_begin(stats);
+    f = src_to_file(src);
+    stats_end(stats, StageLoad);
+    u = compile_toks(f, stats);
+    if (u.err) {
+      _exit(1);
+    }
+    compile_nodes(&u, &opts);
+    stats->toks = u.toks_len;
+    _exit(write(fds[1], stats, sizeof(*stats)) != sizeof(*stats));
+  }
+  wait(&status);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) ||
+      read(fds[0], stats, sizeof(*stats)) != sizeof(*stats)) {
+    printf("bench_front: %s does not compile\n", stats->path);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+/* Returns the seconds the baseline records for a stage of a workload, or 0 */
+double baseline_secs(FILE *base, const char *name, const char *stage) {
+  char line[256], w[64], s[64];
+  double secs;
+
+  if (!base) {
+    return 0;
+  }
+  rewind(base);
+  while (fgets(line, sizeof(line), base)) {
+    if (sscanf(line, "%63s %63s %lf", w, s, &secs) == 3 && !strcmp(w, name) &&
+        !strcmp(s, stage)) {
+      return secs;
+    }
+  }
+  return 0;
+}
+
+/* Writes the median time, throughput and spread of one stage */
+void report(FILE *base, FILE *out, const char *name, const char *stage,
+            double *xs, int len, long bytes, long toks) {
+  double med = median(xs, len);
+  double dev = spread(xs, len, med);
+  double was = baseline_secs(base, name, stage);
+
+  if (med > 0) {
+    printf("  %-16s %9.3f %9.1f %9.2f %6.1f", stage, med * 1e3,
+           bytes / med / 1e6, toks / med / 1e6, dev);
+  } else {
+    printf("  %-16s %9.3f %9s %9s %6s", stage, 0.0, "-", "-", "-");
+  }
+  if (was > 0 && med > 0) {
+    printf(" %7.2fx", was / med);
+  }
+  putchar('\n');
+  if (out) {
+    fprintf(out, "%s %s %.9f\n", name, stage, med);
+  }
+}
+
+/* Times w until its total is stable, writing a row per stage */
+void bench(struct workload *w, int min_runs, FILE *base, FILE *out) {
+  int max_runs = min_runs * MAX_RUNS_FACTOR;
+  double *wall = calloc((size_t)max_runs * (STAGES + 1), sizeof(*wall));
+  double *xs = malloc(max_runs * sizeof(*xs));
+  struct stats stats;
+  long len, toks = 0, toks_lexed = 0;
+  char *src = gen(w, &len);
+  int runs, i, s;
+
+  /* once first, so the caches are warm */
+  memset(&stats, 0, sizeof(stats));
+  stats.path = w->name;
+  run_once(src, &stats);
+
+  for (runs = 0; runs < max_runs; runs++) {
+    double *row = wall + runs * (STAGES + 1);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.path = w->name;
+    run_once(src, &stats);
+    toks_lexed = stats.toks_lexed;
+    toks = stats.toks;
+    for (s = 0; s < StageWrite; s++) {
+      row[s] = stats.wall[s];
+      row[STAGES] += stats.wall[s];
+    }
+    if (runs + 1 >= min_runs) {
+      for (i = 0; i <= runs; i++) {
+        xs[i] = wall[i * (STAGES + 1) + STAGES];
+      }
+      if (spread(xs, runs + 1, median(xs, runs + 1)) / sqrt(runs + 1) <=
+          STABLE_PCT) {
+        runs++;
+        break;
+      }
+    }
+  }
+
+  printf("%s: %ld bytes, %ld tokens lexed, %ld after cpp, %d runs\n", w->name,
+         len, toks_lexed, toks, runs);
+  printf("  %-16s %9s %9s %9s %6s %8s\n", "stage", "ms", "MB/s", "Mtok/s",
+         "+-%", "vs base");
+  for (s = 0; s <= StageWrite; s++) {
+    /* nothing is written, so the last stage is the total */
+    for (i = 0; i < runs; i++) {
+      xs[i] = wall[i * (STAGES + 1) + (s == StageWrite ? STAGES : s)];
+    }
+    /* tokens lexed go through the preprocessor, the rest after it */
+    report(base, out, w->name, s == StageWrite ? "total" : stage_names[s], xs,
+           runs, len, s < StageParse ? toks_lexed : toks);
+  }
+  free(src);
+  free(xs);
+  free(wall);
+}
+
+int main(int argc, char *argv[]) {
+  struct workload **ws = calloc(argc + WORKLOADS, sizeof(*ws));
+  int ws_len = 0, runs = 15, i;
+  bool write_src = false;
+  FILE *base = NULL, *out = NULL;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-g")) {
+      write_src = true;
+    } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      /* a missing baseline is not an error, there is just nothing to show */
+      base = fopen(argv[++i], "r");
+    } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+      if (!(out = fopen(argv[++i], "w"))) {
+        printf("bench_front: could not write %s\n", argv[i]);
+        return 1;
+      }
+    } else if (argv[i][0] == '-') {
+      puts("usage: bench_front [-g] [-r runs] [-b baseline] [-w baseline] "
+           "[workload[:knob=n,...] ...]");
+      return 1;
+    } else {
+      ws[ws_len++] = parse_workload(argv[i]);
+    }
+  }
+  if (!ws_len) {
+    for (i = 0; i < (int)WORKLOADS; i++) {
+      ws[ws_len++] = workloads + i;
+    }
+  }
+  if (runs < 1) {
+    runs = 1;
+  }
+
+  if (write_src) {
+    for (i = 0; i < ws_len; i++) {
+      long len;
+      char *src = gen(ws[i], &len);
+
+      fwrite(src, 1, len, stdout);
+      free(src);
+    }
+    return 0;
+  }
+
+  if (out) {
+    fputs("# bench_front medians: workload stage seconds\n", out);
+  }
+  for (i = 0; i < ws_len; i++) {
+    bench(ws[i], runs, base, out);
+  }
+  if (out) {
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,12 @@
+/* Recursive calls */
+int fib(int n) {
+  if (n < 2) {
+    return n;
+  }
+  return fib(n - 1) + fib(n - 2);
+}
+
+int main(void) {
+  printf("%d\n", fib(30));
+  return 0;
+}
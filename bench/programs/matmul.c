@@ -0,0 +1,30 @@
+/* Nested loops over two dimensional arrays */
+#define N 120
+
+double a[N][N], b[N][N], c[N][N];
+
+int main(void) {
+  int i, j, k;
+  double sum = 0;
+
+  for (i = 0; i < N; i++) {
+    for (j = 0; j < N; j++) {
+      a[i][j] = i + j;
+      b[i][j] = i * 2 - j;
+    }
+  }
+  for (i = 0; i < N; i++) {
+    for (j = 0; j < N; j++) {
+      double s = 0;
+      for (k = 0; k < N; k++) {
+        s += a[i][k] * b[k][j];
+      }
+      c[i][j] = s;
+    }
+  }
+  for (i = 0; i < N; i++) {
+    sum += c[i][i];
+  }
+  printf("%.1f\n", sum);
+  return 0;
+}
@@ -0,0 +1,84 @@
+/* Floating point arithmetic over an array of structs */
+double sqrt(double);
+
+struct body {
+  double x, y, z;
+  double vx, vy, vz;
+  double mass;
+};
+
+struct body bodies[5];
+
+void init(void) {
+  double pi = 314159265, days = 36524;
+  double solar;
+  int i;
+
+  pi = pi / 100000000;
+  days = days / 100;
+  solar = 4 * pi * pi;
+  for (i = 0; i < 5; i++) {
+    struct body *b = bodies + i;
+    b->x = i * 3;
+    b->y = (i % 2) * 2 - 1;
+    b->z = i - 2;
+    b->vx = (i - 2) * days / 1000;
+    b->vy = (3 - i) * days / 700;
+    b->vz = i * days / 5000;
+    b->mass = i ? solar / (1000 * (i + 1)) : solar;
+  }
+}
+
+void advance(double dt) {
+  int i, j;
+  for (i = 0; i < 5; i++) {
+    struct body *a = &bodies[i];
+    for (j = i + 1; j < 5; j++) {
+      struct body *b = &bodies[j];
+      double dx = a->x - b->x, dy = a->y - b->y, dz = a->z - b->z;
+      double d2 = dx * dx + dy * dy + dz * dz;
+      double mag = dt / (d2 * sqrt(d2));
+      a->vx -= dx * b->mass * mag;
+      a->vy -= dy * b->mass * mag;
+      a->vz -= dz * b->mass * mag;
+      b->vx += dx * a->mass * mag;
+      b->vy += dy * a->mass * mag;
+      b->vz += dz * a->mass * mag;
+    }
+  }
+  for (i = 0; i < 5; i++) {
+    struct body *b = &bodies[i];
+    b->x += dt * b->vx;
+    b->y += dt * b->vy;
+    b->z += dt * b->vz;
+  }
+}
+
+double energy(void) {
+  double e = 0;
+  int i, j;
+  for (i = 0; i < 5; i++) {
+    struct body *a = &bodies[i];
+    e += a->mass * (a->vx * a->vx + a->vy * a->vy + a->vz * a->vz) / 2;
+    for (j = i + 1; j < 5; j++) {
+      struct body *b = &bodies[j];
+      double dx = a->x - b->x, dy = a->y - b->y, dz = a->z - b->z;
+      e -= a->mass * b->mass / sqrt(dx * dx + dy * dy + dz * dz);
+    }
+  }
+  return e;
+}
+
+int main(void) {
+  double dt = 1;
+  int i;
+
+  dt = dt / 100;
+  init();
+  printf("%.9f\n", energy());
+  for (i = 0; i < 50000; i++) {
+    advance(dt);
+  }
+  printf("%.9f\n", energy());
+  return 0;
+}
@@ -0,0 +1,30 @@
+/* Array loads and stores in tight loops */
+char flags[1000001];
+
+int sieve(int n) {
+  int i, j, count = 0;
+
+  for (i = 2; i <= n; i++) {
+    flags[i] = 1;
+  }
+  for (i = 2; i * i <= n; i++) {
+    if (flags[i]) {
+      for (j = i * i; j <= n; j += i) {
+        flags[j] = 0;
+      }
+    }
+  }
+  for (i = 2; i <= n; i++) {
+    count += flags[i];
+  }
+  return count;
+}
+
+int main(void) {
+  int round, count = 0;
+  for (round = 0; round < 3; round++) {
+    count = sieve(1000000);
+  }
+  printf("%d\n", count);
+  return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * Measures incremental reparsing of edits inside a large file, and checks
+ * every result against parsing the edited source from scratch.
+ *
+ * usage: bench_reparse [functions]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../cpp.h"
+#include "../io.h"
+#include "../lex.h"
+#include "../parse.h"
+#include "../reparse.h"
+#include "../unit.h"
+
+#define HEADER_LINES 8
+#define FN_LINES 10
+#define REPS 1000
+
+/* Generates a header and fns functions of FN_LINES lines each */
+char *gen(long fns) {
+  char *src = malloc(fns * 256 + 256);
+  char *pos = src;
+  long i;
+
+  pos += sprintf(pos, "typedef int num;\n"
+                      "#define TWO 2\n"
+                      "int g = TWO;\n"
+                      "#if TWO\n"
+                      "int h;\n"
+                      "#endif\n"
+                      "/* generated\n"
+                      " */\n");
+  for (i = 0; i < fns; i++) {
+    pos += sprintf(pos,
+                   "int f%ld(int a, num *b) {\n"
+                   "  int i = 0, j = %ld;\n"
+                   "  for (i = 0; i < a; i++) {\n"
+                   "    if (b[i] == 'x') j += i * 2; else j = j - f%ld(i, b);\n"
+                   "  }\n"
+                   "  while (j > TWO - 2)\n"
+                   "    j = j >> 1;\n"
+                   "  /* halved */\n"
+                   "  return j ? i : \"none\"[a %% 4];\n"
+                   "}\n",
+                   i, i, i / 2);
+  }
+
+  return src;
+}
+
+/* Returns the current source of f */
+char *source(file *f) {
+  int len = 0;
+  char *src, *pos;
+  int i;
+
+  for (i = 0; i < f->lines_len; i++) {
+    len += f->lines[i].len + 1;
+  }
+  src = pos = calloc(len + 1, 1);
+  for (i = 0; i < f->lines_len; i++) {
+    memcpy(pos, f->lines[i].src, f->lines[i].len);
+    pos += f->lines[i].len;
+    if (i < f->lines_len - 1) {
+      *pos++ = '\n';
+    }
+  }
+  return src;
+}
+
+struct unit compile(char *src) {
+  struct unit u = new_unit();
+  u.file = src_to_file(src);
+  lex(&u);
+  cpp(&u);
+  parse(&u);
+  return u;
+}
+
+/* Writes the tokens and nodes of u to a temporary file */
+FILE *dump(struct unit *u) {
+  FILE *out = tmpfile();
+  writer w = new_writer(out);
+  int i;
+
+  for (i = 0; i < u->toks_len; i++) {
+    write_str(&w, u->toks[i].text);
+    write_char(&w, ' ');
+    write_long(&w, u->toks[i].line);
+    write_char(&w, ':');
+    write_long(&w, u->toks[i].column);
+    write_char(&w, '\n');
+  }
+  for (i = 0; i < u->nodes_len; i++) {
+    write_ast(&w, u->nodes + i, i == u->nodes_len - 1);
+  }
+  free_writer(&w);
+  rewind(out);
+  return out;
+}
+
+/* Returns true if u matches a unit compiled from its source */
+bool check_reparse(struct unit *u) {
+  struct unit fresh = compile(source(u->file));
+  FILE *a, *b;
+  int ca, cb;
+
+  reparse_flush(u);
+  a = dump(u);
+  b = dump(&fresh);
+
+  do {
+    ca = getc(a);
+    cb = getc(b);
+  } while (ca == cb && ca != EOF);
+
+  fclose(a);
+  fclose(b);
+  return ca == cb;
+}
+
+/* Byte offset of column col of line ln (1-based) */
+int off(struct unit *u, int ln, int col) {
+  return u->file->lines[ln - 1].off + col - 1;
+}
+
+double secs(clock_t begin) {
+  return (double)(clock() - begin) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[]) {
+  long fns = argc > 1 ? atol(argv[1]) : 5000;
+  long mid = fns / 2;
+  int ln = HEADER_LINES + mid * FN_LINES + 1; /* first line of f<mid> */
+  const char *fn = "int k(void) { f(); }\n";
+  const char *names[] = {"token",     "line",  "function",
+                         "signature", "macro", "spread"};
+  struct unit u;
+  clock_t begin;
+  double full;
+  int failed = 0;
+  int kind;
+
+  u = compile(gen(fns));
+
+  begin = clock();
+  reparse_full(&u);
+  full = secs(begin);
+  printf("%d lines, full parse %.3f ms\n\n", u.file->lines_len, full * 1e3);
+  printf("%-10s %12s %12s %8s\n", "edit", "incremental", "us/edit", "check");
+
+  for (kind = 0; kind < 6; kind++) {
+    bool incremental = true;
+    int reps = kind == 4 ? 2 : kind == 5 && fns < REPS ? (int)fns : REPS;
+    int i;
+
+    begin = clock();
+    for (i = 0; i < reps; i++) {
+      struct edit e;
+      int b = off(&u, ln, 1);
+
+      /* every pair of edits restores the source, until the last kind */
+      switch (kind) {
+      case 0: /* a literal in the body, "j = <mid>;" */
+        e.begin = off(&u, ln + 1, 18);
+        e.end = e.begin + 1;
+        e.text = i % 2 ? "1" : "2";
+        break;
+      case 1: /* a statement on a line of its own */
+        e.begin = off(&u, ln + 8, 1);
+        e.end = e.begin + (i % 2 ? 7 : 0);
+        e.text = i % 2 ? "" : "  j++;\n";
+        break;
+      case 2: /* a function before f<mid> */
+        e.begin = b;
+        e.end = b + (i % 2 ? (int)strlen(fn) : 0);
+        e.text = i % 2 ? "" : fn;
+        break;
+      case 3: /* the name of f<mid> */
+        e.begin = b + 4;
+        e.end = e.begin + 1;
+        e.text = i % 2 ? "f" : "h";
+        break;
+      case 4: /* a macro use falls back to a full reparse */
+        e.begin = off(&u, ln + 1, 18);
+        e.end = e.begin + (i % 2 ? 4 : 0);
+        e.text = i % 2 ? "" : "TWO+";
+        break;
+      default: /* a statement in f<i>, below the one added to each before */
+        e.begin = off(&u, HEADER_LINES + i * (FN_LINES + 1) + 9, 1);
+        e.end = e.begin;
+        e.text = "  j++;\n";
+        break;
+      }
+      incremental &= reparse(&u, &e, 1);
+    }
+    printf("%-10s %12s %12.1f", names[kind], incremental ? "yes" : "no",
+           secs(begin) / reps * 1e6);
+
+    if (check_reparse(&u)) {
+      puts(" ok");
+    } else {
+      puts(" MISMATCH");
+      failed = 1;
+    }
+  }
+
+  return failed;
+}
@@ -0,0 +1,183 @@
+/*
+ * Times the tree-walking interpreter, the bytecode vm, the wasm runtime, the
+ * SSA form interpreted, tiered with its hot functions compiled in process,
+ * and compiled in process before running, and native x86-64 code on the
+ * programs in bench/programs, checking they print the same.
+ *
+ * usage: bench_run [program.c ...]
+ */
+
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../driver.h"
+#include "../interp.h"
+#include "../ir.h"
+#include "../jit.h"
+#include "../unit.h"
+#include "../vm.h"
+#include "../wasm.h"
+#include "../wasmrt.h"
+#include "../x86.h"
+
+char *programs[] = {"bench/programs/fib.c", "bench/programs/sieve.c",
+                    "bench/programs/nbody.c", "bench/programs/matmul.c"};
+
+double secs(clock_t begin) {
+  return (double)(clock() - begin) / CLOCKS_PER_SEC;
+}
+
+/* Returns the seconds since some fixed point, for other processes' time */
+double wall(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns the contents of f from its start */
+char *read_back(FILE *f) {
+  long len = ftell(f);
+  char *s = calloc(len + 1, 1);
+
+  rewind(f);
+  if (fread(s, 1, len, f) != (size_t)len) {
+    s[0] = '\0';
+  }
+  fclose(f);
+  return s;
+}
+
+int main(int argc, char *argv[]) {
+  char **paths = argc > 1 ? argv + 1 : programs;
+  int len = argc > 1 ? argc - 1 : 4;
+  struct options opts;
+  double tree_total = 0, vm_total = 0, wasm_total = 0, ir_total = 0;
+  double jit_total = 0, jit0_total = 0, native_total = 0;
+  int i, k;
+
+  memset(&opts, 0, sizeof(opts));
+  printf("%-28s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "program", "load",
+         "tree", "vm", "wasm", "ir", "jit", "jit=0", "native", "speedup");
+
+  for (i = 0; i < len; i++) {
+    struct unit u = compile_toks(load_file(paths[i]), NULL);
+    struct interp *in;
+    struct vm *vm;
+    struct wasm_buf mod;
+    struct wasm_module *m;
+    struct ir_prog *ir;
+    const char *err;
+    clock_t begin;
+    double begin_wall;
+    double load_s, tree_s, vm_s, wasm_s, ir_s, jit_s[2], native_s;
+    char *tree_out, *exe;
+    FILE *out;
+
+    if (u.err) {
+      printf("%s: could not compile\n", paths[i]);
+      return 1;
+    }
+    compile_nodes(&u, &opts);
+
+    begin = clock();
+    in = interp_load(&u);
+    vm = vm_load(in);
+    load_s = secs(begin);
+
+    /* linked before the interpreters run, which write to the globals */
+    if (!(exe = x86_link(ir_load(in, true, false, NULL), "cc"))) {
+      printf("%s: could not link\n", paths[i]);
+      return 1;
+    }
+
+    /* the program's output is not timed on the terminal */
+    in->out = tmpfile();
+    begin = clock();
+    interp_run(in, 1, paths + i);
+    tree_s = secs(begin);
+    tree_out = read_back(in->out);
+
+    /* initializers run again, the programs set every other global */
+    in->out = tmpfile();
+    begin = clock();
+    vm_run(vm, 1, paths + i);
+    vm_s = secs(begin);
+    if (strcmp(tree_out, read_back(in->out))) {
+      printf("%s: tree and vm output differ\n", paths[i]);
+      return 1;
+    }
+
+    /* compiled and validated before it is timed */
+    mod = wasm_compile(in);
+    if (!(m = wasm_decode(mod.data, mod.len, &err))) {
+      printf("%s: invalid module: %s\n", paths[i], err);
+      return 1;
+    }
+    out = tmpfile();
+    begin = clock();
+    wasm_run_main(m, out, 1, paths + i);
+    wasm_s = secs(begin);
+    if (strcmp(tree_out, read_back(out))) {
+      printf("%s: tree and wasm output differ\n", paths[i]);
+      return 1;
+    }
+    wasm_free(m);
+    free(mod.data);
+
+    /* optimized, but not verified, before it is timed */
+    ir = ir_load(in, true, false, NULL);
+    in->out = tmpfile();
+    begin = clock();
+    ir_run(ir, 1, paths + i);
+    ir_s = secs(begin);
+    if (strcmp(tree_out, read_back(in->out))) {
+      printf("%s: tree and ir output differ\n", paths[i]);
+      return 1;
+    }
+
+    /* tiered as --run=jit does, then with everything compiled up front */
+    for (k = 0; k < 2; k++) {
+      ir = ir_load(in, true, false, NULL);
+      jit_attach(ir, k ? 0 : JIT_HOT);
+      in->out = tmpfile();
+      begin = clock();
+      ir_run(ir, 1, paths + i);
+      jit_s[k] = secs(begin);
+      if (strcmp(tree_out, read_back(in->out))) {
+        printf("%s: tree and jit output differ\n", paths[i]);
+        return 1;
+      }
+    }
+
+    /* a process of its own, timed by the wall clock */
+    out = tmpfile();
+    begin_wall = wall();
+    x86_exec(exe, 1, paths + i, out);
+    native_s = wall() - begin_wall;
+    x86_unlink(exe);
+    if (strcmp(tree_out, read_back(out))) {
+      printf("%s: tree and native output differ\n", paths[i]);
+      return 1;
+    }
+
+    printf("%-28s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %7.2fx\n",
+           paths[i], load_s, tree_s, vm_s, wasm_s, ir_s, jit_s[0], jit_s[1],
+           native_s, tree_s / vm_s);
+    tree_total += tree_s;
+    vm_total += vm_s;
+    wasm_total += wasm_s;
+    ir_total += ir_s;
+    jit_total += jit_s[0];
+    jit0_total += jit_s[1];
+    native_total += native_s;
+  }
+  printf("%-28s %8s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %7.2fx\n",
+         "total", "", tree_total, vm_total, wasm_total, ir_total, jit_total,
+         jit0_total, native_total, tree_total / vm_total);
+
+  return 0;
+}
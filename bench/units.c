@@ -0,0 +1,149 @@
+/*
+ * Measures how compiling many translation units scales from 1 to N threads,
+ * on a generated corpus of files of uneven sizes, checking every thread
+ * count writes the same. Units are never freed, so each thread count runs
+ * in a process of its own.
+ *
+ * usage: bench_units [files] [threads]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../driver.h"
+#include "../io.h"
+#include "../pool.h"
+
+/* Returns the seconds since some fixed point */
+double wall(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Writes the i-th file of the corpus, every seventh one much larger */
+void gen(FILE *f, int i) {
+  int fns = i % 7 ? 2 + i % 5 : 24;
+  int k;
+
+  fprintf(f, "#define SCALE%d(x) ((x) * %d)\n", i, i % 13 + 1);
+  fprintf(f, "typedef struct pt%d { int x; int y; } pt%d;\n", i, i);
+  for (k = 0; k < fns; k++) {
+    fprintf(f,
+            "int f%d_%d(pt%d *p, char *b) {\n"
+            "  int i = 0, j = SCALE%d(%d);\n"
+            "  for (i = 0; i < p->x; i++) {\n"
+            "    if (b[i] == 'x') j += i * 2; else j = j - p->y;\n"
+            "  }\n"
+            "  while (j > 0) j = j >> 1;\n"
+            "  return j ? i : \"none\"[p->x %% 4];\n"
+            "}\n",
+            i, k, i, i, k);
+  }
+}
+
+/* Returns the contents of f from its start, and their length in len */
+char *read_back(FILE *f, long *len) {
+  char *s;
+
+  *len = ftell(f);
+  s = calloc(*len + 1, 1);
+  rewind(f);
+  if (fread(s, 1, *len, f) != (size_t)*len) {
+    *len = 0;
+  }
+  fclose(f);
+  return s;
+}
+
+int main(int argc, char *argv[]) {
+  int files = argc > 1 ? atoi(argv[1]) : 2000;
+  int max = argc > 2 ? atoi(argv[2]) : pool_default_threads();
+  char dir[] = "/tmp/chocc-units-XXXXXX";
+  struct options opts;
+  char *first = NULL;
+  long first_len = 0;
+  double one = 0;
+  int i, t;
+
+  if (!mkdtemp(dir)) {
+    puts("could not make the corpus directory");
+    return 1;
+  }
+  memset(&opts, 0, sizeof(opts));
+  opts.paths = calloc(files, sizeof(*opts.paths));
+  opts.paths_len = files;
+  for (i = 0; i < files; i++) {
+    FILE *f;
+
+    opts.paths[i] = malloc(strlen(dir) + 16);
+    sprintf(opts.paths[i], "%s/u%d.c", dir, i);
+    if (!(f = fopen(opts.paths[i], "w"))) {
+      puts("could not write the corpus");
+      return 1;
+    }
+    gen(f, i);
+    fclose(f);
+  }
+  opts.path = opts.paths[0];
+  opts.dump_source = opts.dump_tokens = opts.dump_ast = true;
+
+  printf("%d files\n", files);
+  printf("%-8s %10s %10s %10s\n", "threads", "secs", "files/s", "speedup");
+  for (t = 1; t <= max; t++) {
+    FILE *out = tmpfile();
+    FILE *times = tmpfile();
+    double s = 0;
+    char *got;
+    long got_len;
+    int status;
+
+    /* or the child writes what is buffered again */
+    fflush(stdout);
+    if (!fork()) {
+      writer w = new_writer(out);
+      double begin = wall();
+
+      opts.jobs = t;
+      run_units(&w, &opts);
+      free_writer(&w);
+      fprintf(times, "%f\n", wall() - begin);
+      fclose(times);
+      exit(0);
+    }
+    wait(&status);
+    rewind(times);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) ||
+        fscanf(times, "%lf", &s) != 1) {
+      printf("%d threads: failed\n", t);
+      return 1;
+    }
+    fclose(times);
+
+    fseek(out, 0, SEEK_END);
+    got = read_back(out, &got_len);
+    if (!first) {
+      first = got;
+      first_len = got_len;
+      one = s;
+    } else if (got_len != first_len || memcmp(got, first, got_len)) {
+      printf("%d threads: output differs\n", t);
+      return 1;
+    } else {
+      free(got);
+    }
+    printf("%-8d %10.3f %10.0f %9.2fx\n", t, s, files / s, one / s);
+  }
+
+  for (i = 0; i < files; i++) {
+    remove(opts.paths[i]);
+  }
+  rmdir(dir);
+  return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Measures the wasm backend emitting modules of more and more functions,
+ * and the loader validating them. Functions emitted per second should stay
+ * flat as modules grow.
+ *
+ * usage: bench_wasm [most functions]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../check.h"
+#include "../cpp.h"
+#include "../fold.h"
+#include "../interp.h"
+#include "../lex.h"
+#include "../parse.h"
+#include "../resolve.h"
+#include "../unit.h"
+#include "../wasm.h"
+#include "../wasmrt.h"
+
+/*
+ * Generates fns functions mixing loops, branches, arrays in memory and
+ * calls of the one before, and a main calling the last.
+ */
+char *gen(long fns) {
+  char *src = malloc(fns * 512 + 256);
+  char *pos = src;
+  long i;
+
+  pos += sprintf(pos, "int g[64];\n");
+  for (i = 0; i < fns; i++) {
+    pos += sprintf(pos,
+                   "int f%ld(int n) {\n"
+                   "  int a[8];\n"
+                   "  int i, s = %ld;\n"
+                   "  for (i = 0; i < 8; i++) {\n"
+                   "    a[i] = i * n + s;\n"
+                   "    s += a[i] %% 7 ? a[i] >> 1 : -a[i];\n"
+                   "  }\n"
+                   "  if (s > 1000)\n"
+                   "    s = s / 3;\n"
+                   "  g[%ld] += s;\n"
+                   "  return s ^ ",
+                   i, i, i % 64);
+    pos += i ? sprintf(pos, "f%ld(n - 1);\n}\n", i - 1)
+             : sprintf(pos, "n;\n}\n");
+  }
+  sprintf(pos, "int main(void) { return f%ld(3) & 1; }\n", fns - 1);
+  return src;
+}
+
+double secs(clock_t begin) {
+  return (double)(clock() - begin) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[]) {
+  long most = argc > 1 ? atol(argv[1]) : 16000;
+  long fns;
+
+  printf("%-8s %10s %10s %12s %12s\n", "fns", "bytes", "emit", "fns/s",
+         "validate");
+
+  for (fns = 1000; fns <= most; fns *= 2) {
+    struct unit u;
+    struct interp *in;
+    struct wasm_buf mod;
+    struct wasm_module *m;
+    const char *err;
+    clock_t begin;
+    double emit_s, validate_s;
+
+    u = new_unit();
+    u.file = src_to_file(gen(fns));
+    lex(&u);
+    u = filter_newline(&u);
+    parse(&u);
+    fold(&u);
+    resolve(&u);
+    check(&u);
+    in = interp_load(&u);
+
+    begin = clock();
+    mod = wasm_compile(in);
+    emit_s = secs(begin);
+
+    begin = clock();
+    m = wasm_decode(mod.data, mod.len, &err);
+    validate_s = secs(begin);
+    if (!m) {
+      printf("invalid module: %s\n", err);
+      return 1;
+    }
+    wasm_free(m);
+
+    printf("%-8ld %10ld %10.3f %12.0f %12.3f\n", fns, mod.len, emit_s,
+           fns / emit_s, validate_s);
+    free(mod.data);
+  }
+
+  return 0;
+}
@@ -0,0 +1,676 @@
+#include "check.h"
+#include "alloc.h"
+#include "lex.h"
+#include "resolve.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Layout
+ */
+
+type *type_complete(type *t, struct scope *tags) {
+  struct scope_entry *e;
+  if ((t->kind != StructT && t->kind != UnionT) || t->struct_fields ||
+      !t->name || !tags) {
+    return t;
+  }
+  e = scope_lookup(tags, t->name->u.ident.name, TagNs);
+  return e && ((type *)e->ptr)->kind == t->kind ? e->ptr : t;
+}
+
+/* Lays out the fields of a struct or union and indexes their names */
+bool layout_fields(struct layout *l, type *t, struct scope *tags) {
+  ast_node_t *fields = t->struct_fields;
+  int len = fields->u.list.len;
+  long offset = 0;
+  int i;
+
+  l->offsets = alloc_calloc(SemaAlloc, len ? len : 1, sizeof(*l->offsets));
+  l->chain = alloc_calloc(SemaAlloc, len ? len : 1, sizeof(*l->chain));
+  for (l->buckets_len = 8; l->buckets_len < len * 2; l->buckets_len *= 2) {
+  }
+  l->buckets = alloc_malloc(SemaAlloc, l->buckets_len * sizeof(*l->buckets));
+  memset(l->buckets, -1, l->buckets_len * sizeof(*l->buckets));
+
+  l->align = 1;
+  for (i = 0; i < len; i++) {
+    ast_decl *field = &ast_list_at(fields, i)->u.decl;
+    struct layout *fl = type_layout(field->type, tags);
+
+    if (!fl) {
+      return false;
+    }
+    if (fl->align > l->align) {
+      l->align = fl->align;
+    }
+    if (t->kind == StructT) {
+      offset = (offset + fl->align - 1) / fl->align * fl->align;
+      l->offsets[i] = offset;
+      offset += fl->size;
+    } else if (fl->size > offset) {
+      offset = fl->size;
+    }
+  }
+  l->size = (offset + l->align - 1) / l->align * l->align;
+
+  /* pushed in reverse, so the first of duplicate names is found */
+  for (i = len - 1; i >= 0; i--) {
+    ast_decl *field = &ast_list_at(fields, i)->u.decl;
+    if (field->name) {
+      int h = name_hash(field->name->u.ident.name) & (l->buckets_len - 1);
+      l->chain[i] = l->buckets[h];
+      l->buckets[h] = i;
+    }
+  }
+  return true;
+}
+
+struct layout *type_layout(type *t, struct scope *tags) {
+  struct layout *l;
+  type *def;
+
+  if (t->layout) {
+    /* a size below 0 marks a struct containing itself */
+    return t->layout->size < 0 ? NULL : t->layout;
+  }
+
+  switch (t->kind) {
+  case NumericT: {
+    l = alloc_calloc(SemaAlloc, 1, sizeof(*l));
+    switch (t->numeric.base) {
+    case Char:
+      l->size = 1;
+      break;
+    case Float:
+      l->size = 4;
+      break;
+    case Double:
+      l->size = t->numeric.is_long ? 16 : 8;
+      break;
+    default:
+      l->size = t->numeric.is_short ? 2 : t->numeric.is_long ? 8 : 4;
+      break;
+    }
+    l->align = l->size;
+    break;
+  }
+  case PtrT:
+  case EnumT: {
+    l = alloc_calloc(SemaAlloc, 1, sizeof(*l));
+    l->size = l->align = t->kind == PtrT ? 8 : 4;
+    break;
+  }
+  case ArrT: {
+    struct layout *inner;
+    if (t->arr_size <= 0 || !(inner = type_layout(t->inner, tags))) {
+      return NULL;
+    }
+    l = alloc_calloc(SemaAlloc, 1, sizeof(*l));
+    l->size = inner->size * t->arr_size;
+    l->align = inner->align;
+    break;
+  }
+  case StructT:
+  case UnionT: {
+    if ((def = type_complete(t, tags)) != t) {
+      /* references are completed again in each scope */
+      return type_layout(def, tags);
+    }
+    if (!t->struct_fields) {
+      return NULL;
+    }
+    l = t->layout = alloc_calloc(SemaAlloc, 1, sizeof(*l));
+    l->size = -1;
+    if (!layout_fields(l, t, tags)) {
+      t->layout = NULL;
+      return NULL;
+    }
+    return l;
+  }
+  default:
+    return NULL;
+  }
+
+  t->layout = l;
+  return l;
+}
+
+int type_member(type *t, struct scope *tags, const char *name) {
+  struct layout *l;
+  int i;
+
+  t = type_complete(t, tags);
+  if ((t->kind != StructT && t->kind != UnionT) ||
+      !(l = type_layout(t, tags))) {
+    return -1;
+  }
+  for (i = l->buckets[name_hash(name) & (l->buckets_len - 1)]; i >= 0;
+       i = l->chain[i]) {
+    if (!strcmp(ast_list_at(t->struct_fields, i)->u.decl.name->u.ident.name,
+                name)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void declare_tags(type *t, struct scope *tags) {
+  ast_node_t *fields;
+  int i;
+
+  for (; t; t = t->inner) {
+    if ((t->kind != StructT && t->kind != UnionT) || !t->struct_fields) {
+      continue;
+    }
+    fields = t->struct_fields;
+    for (i = 0; i < fields->u.list.len; i++) {
+      declare_tags(ast_list_at(fields, i)->u.decl.type, tags);
+    }
+    if (t->name) {
+      scope_push(tags, t->name->u.ident.name, TagNs)->ptr = t;
+    }
+  }
+}
+
+/*
+ * Expressions
+ */
+
+/* arithmetic conversion ranks, integers after promotion */
+typedef enum arith_rank {
+  NoRank,
+  IntRank,
+  UIntRank,
+  LongRank,
+  ULongRank,
+  FloatRank,
+  DoubleRank,
+  LongDoubleRank
+} arith_rank;
+
+/*
+ * checker holds the struct and union tags in scope and the types of
+ * results, which nodes of the unit share.
+ */
+struct checker {
+  struct unit *unit;
+  struct scope tags;
+
+  type *int_t;
+  type *uint_t;
+  type *long_t;
+  type *ulong_t;
+  type *char_t;
+};
+
+type *check_expr(struct checker *, ast_node_t *);
+void check_node(struct checker *, ast_node_t *);
+
+type *new_numeric(token_kind_t base, bool is_unsigned, bool is_long) {
+  type *t = alloc_calloc(SemaAlloc, 1, sizeof(type));
+  t->kind = NumericT;
+  t->numeric.base = base;
+  t->numeric.is_unsigned = is_unsigned;
+  t->numeric.is_long = is_long;
+  return t;
+}
+
+type *new_ptr(type *inner) {
+  type *t = alloc_calloc(SemaAlloc, 1, sizeof(type));
+  t->kind = PtrT;
+  t->inner = inner;
+  return t;
+}
+
+arith_rank type_rank(type *t) {
+  if (!t) {
+    return NoRank;
+  }
+  if (t->kind == EnumT) {
+    return IntRank;
+  }
+  if (t->kind != NumericT) {
+    return NoRank;
+  }
+  switch (t->numeric.base) {
+  case Float:
+    return FloatRank;
+  case Double:
+    return t->numeric.is_long ? LongDoubleRank : DoubleRank;
+  case Char:
+    return IntRank;
+  default:
+    if (t->numeric.is_short) {
+      return IntRank; /* int holds every unsigned short */
+    }
+    if (t->numeric.is_long) {
+      return t->numeric.is_unsigned ? ULongRank : LongRank;
+    }
+    return t->numeric.is_unsigned ? UIntRank : IntRank;
+  }
+}
+
+bool is_integer(type *t) {
+  arith_rank rank = type_rank(t);
+  return rank != NoRank && rank < FloatRank;
+}
+
+bool is_ptr(type *t) { return t && t->kind == PtrT; }
+
+/* Returns the type of integer operand t after promotion */
+type *promote(struct checker *c, type *t) {
+  switch (type_rank(t)) {
+  case IntRank:
+    return c->int_t;
+  case UIntRank:
+    return c->uint_t;
+  case LongRank:
+    return c->long_t;
+  case ULongRank:
+    return c->ulong_t;
+  case NoRank:
+    return NULL;
+  default:
+    return t;
+  }
+}
+
+/* usual arithmetic conversions, long holds every unsigned int */
+type *arith_conv(struct checker *c, type *a, type *b) {
+  arith_rank ra = type_rank(a), rb = type_rank(b);
+
+  if (!ra || !rb) {
+    return NULL;
+  }
+  if (ra == UIntRank && rb == LongRank) {
+    return c->long_t;
+  }
+  return promote(c, ra >= rb ? a : b);
+}
+
+/* Returns the type of an operand after array and function decay */
+type *decay(type *t) {
+  if (t && t->kind == ArrT) {
+    return new_ptr(t->inner);
+  }
+  if (t && t->kind == FnT) {
+    return new_ptr(t);
+  }
+  return t;
+}
+
+/* Returns the type of member name of t, typing the Ident naming it */
+type *member(struct checker *c, type *t, ast_node_t *name) {
+  int i;
+
+  if (!t || (i = type_member(t, &c->tags, name->u.ident.name)) < 0) {
+    return NULL;
+  }
+  t = type_complete(t, &c->tags);
+  return name->u.ident.type = ast_list_at(t->struct_fields, i)->u.decl.type;
+}
+
+type *check_lit(struct checker *c, ast_lit *lit) {
+  switch (lit->kind) {
+  case DecLit:
+  case HexLit:
+  case OctLit:
+    return lit->is_long ? lit->is_unsigned ? c->ulong_t : c->long_t
+           : lit->is_unsigned ? c->uint_t
+                              : c->int_t;
+  case CharLit:
+    return c->int_t;
+  case StrLit: {
+    type *t = alloc_calloc(SemaAlloc, 1, sizeof(type));
+    t->kind = ArrT;
+    t->inner = c->char_t;
+    t->arr_size = strlen(lit->string) + 1;
+    return t;
+  }
+  default:
+    return NULL;
+  }
+}
+
+type *check_ident(struct checker *c, ast_node_t *ident) {
+  struct symbol *sym = ident_sym(c->unit, ident);
+
+  if (!sym || sym->kind == TypedefSym) {
+    return NULL;
+  }
+  if (sym->kind == EnumSym) {
+    return c->int_t;
+  }
+  return sym->decl->type;
+}
+
+type *check_prefix(struct checker *c, ast_expr *e) {
+  type *t;
+
+  if (e->op == Sizeof) {
+    return c->ulong_t;
+  }
+
+  t = expr_type(e->rhs);
+  switch (e->op) {
+  case Amp:
+    return t ? new_ptr(t) : NULL;
+  case Star:
+    t = decay(t);
+    return is_ptr(t) ? t->inner : NULL;
+  case Plus:
+  case Minus:
+  case Tilde:
+    return promote(c, t);
+  case Exclaim:
+    return c->int_t;
+  default: /* ++, -- */
+    return t;
+  }
+}
+
+type *check_postfix(struct checker *c, ast_expr *e) {
+  type *l = expr_type(e->lhs);
+  type *r;
+
+  switch (e->op) {
+  case LBrack: {
+    /* a[i] is *(a + i), so i[a] is too */
+    l = decay(l);
+    r = decay(expr_type(e->rhs));
+    return is_ptr(l) ? l->inner : is_ptr(r) ? r->inner : NULL;
+  }
+  case Dot:
+    return member(c, l, e->rhs);
+  case Arrow:
+    l = decay(l);
+    return member(c, is_ptr(l) ? l->inner : NULL, e->rhs);
+  default: /* ++, -- */
+    return l;
+  }
+}
+
+type *check_call(struct checker *c, ast_expr *e) {
+  type *fn;
+
+  if (e->lhs->kind == Ident && !ident_sym(c->unit, e->lhs)) {
+    /* implicitly declared, returning int */
+    fn = NULL;
+  } else {
+    fn = decay(expr_type(e->lhs));
+  }
+
+  if (!fn) {
+    return c->int_t;
+  }
+  return is_ptr(fn) && fn->inner->kind == FnT ? fn->inner->inner : NULL;
+}
+
+type *check_infix(struct checker *c, ast_expr *e) {
+  type *l = expr_type(e->lhs);
+  type *m = expr_type(e->mhs);
+  type *r = expr_type(e->rhs);
+
+  switch (e->op) {
+  case Assn:
+  case PlusAssn:
+  case MinusAssn:
+  case StarAssn:
+  case SlashAssn:
+  case PercentAssn:
+  case LShftAssn:
+  case RShftAssn:
+  case AmpAssn:
+  case CaretAssn:
+  case BarAssn:
+    return l;
+  case Question: {
+    m = decay(m);
+    r = decay(r);
+    if (type_rank(m) && type_rank(r)) {
+      return arith_conv(c, m, r);
+    }
+    /* a null pointer constant takes the other's type */
+    return is_ptr(m) ? m : is_ptr(r) ? r : m;
+  }
+  case AmpAmp:
+  case BarBar:
+  case Eq:
+  case Neq:
+  case Lt:
+  case Leq:
+  case Gt:
+  case Geq:
+    return c->int_t;
+  case LShft:
+  case RShft:
+    return is_integer(r) ? promote(c, l) : NULL;
+  case Plus:
+  case Minus: {
+    l = decay(l);
+    r = decay(r);
+    if (is_ptr(l) && is_ptr(r)) {
+      return e->op == Minus ? c->long_t : NULL; /* ptrdiff_t */
+    }
+    if (is_ptr(l) && is_integer(r)) {
+      return l;
+    }
+    if (is_integer(l) && is_ptr(r)) {
+      return e->op == Plus ? r : NULL;
+    }
+    return arith_conv(c, l, r);
+  }
+  case Percent:
+  case Amp:
+  case Caret:
+  case Bar:
+    return is_integer(l) && is_integer(r) ? arith_conv(c, l, r) : NULL;
+  default: /* *, / */
+    return arith_conv(c, l, r);
+  }
+}
+
+/* Types node, its operands already typed */
+void check_op(struct checker *c, ast_node_t *node) {
+  ast_expr *e = &node->u.expr;
+  type *t = NULL;
+
+  switch (node->kind) {
+  case Lit:
+    node->u.lit.type = check_lit(c, &node->u.lit);
+    return;
+  case Ident:
+    node->u.ident.type = check_ident(c, node);
+    return;
+  case Expr:
+    break;
+  default:
+    check_node(c, node);
+    return;
+  }
+
+  switch (e->kind) {
+  case PrefixExpr:
+    t = check_prefix(c, e);
+    break;
+  case PostfixExpr:
+    t = check_postfix(c, e);
+    break;
+  case CallExpr:
+    t = check_call(c, e);
+    break;
+  case InfixExpr:
+    t = check_infix(c, e);
+    break;
+  case CastExpr:
+    t = &e->lhs->u.type_name;
+    break;
+  case CommaExpr:
+    t = e->mhs_len ? expr_type(e->mhs + e->mhs_len - 1) : NULL;
+    break;
+  }
+  e->type = t;
+}
+
+/*
+ * Types expression node and its operands, returning its type. Operands are
+ * typed before the operators applying them, by a walk rather than by
+ * recursion.
+ */
+type *check_expr(struct checker *c, ast_node_t *node) {
+  struct expr_walk w;
+  ast_node_t *n;
+
+  expr_walk_init(&w, node, NULL);
+  while ((n = expr_walk_next(&w))) {
+    check_op(c, n);
+  }
+  return expr_type(node);
+}
+
+type *expr_type(ast_node_t *node) {
+  if (!node) {
+    return NULL;
+  }
+  switch (node->kind) {
+  case Expr:
+    return node->u.expr.type;
+  case Ident:
+    return node->u.ident.type;
+  case Lit:
+    return node->u.lit.type;
+  default:
+    return NULL;
+  }
+}
+
+/*
+ * Declarations and statements
+ */
+
+/* Declares the struct and union tags of t and types its array sizes */
+void check_type(struct checker *c, type *t) {
+  int i;
+
+  for (; t; t = t->inner) {
+    switch (t->kind) {
+    case ArrT: {
+      if (t->arr_expr) {
+        check_expr(c, t->arr_expr);
+      }
+      break;
+    }
+    case FnT: {
+      for (i = 0; i < t->fn_param_decls_len; i++) {
+        check_type(c, t->fn_param_decls[i].u.decl.type);
+      }
+      break;
+    }
+    case StructT:
+    case UnionT: {
+      ast_node_t *fields = t->struct_fields;
+      for (i = 0; fields && i < fields->u.list.len; i++) {
+        check_type(c, ast_list_at(fields, i)->u.decl.type);
+      }
+      if (fields && t->name) {
+        scope_push(&c->tags, t->name->u.ident.name, TagNs)->ptr = t;
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+void check_stmt(struct checker *c, ast_stmt *s) {
+  int len = c->tags.len;
+  int i;
+
+  if (s->kind == BlockStmt) {
+    for (i = 0; i < s->inner->u.list.len; i++) {
+      check_node(c, ast_list_at(s->inner, i));
+    }
+    scope_pop(&c->tags, len);
+    return;
+  }
+
+  if (s->case_expr) {
+    check_node(c, s->case_expr);
+  }
+  if (s->init) {
+    check_node(c, s->init);
+  }
+  if (s->cond) {
+    check_node(c, s->cond);
+  }
+  if (s->iter) {
+    check_node(c, s->iter);
+  }
+  if (s->inner && !(s->jump && s->jump->u.tok.kind == Goto)) { /* label */
+    check_node(c, s->inner);
+  }
+  if (s->inner_else) {
+    check_node(c, s->inner_else);
+  }
+}
+
+void check_node(struct checker *c, ast_node_t *node) {
+  int len;
+  int i;
+
+  switch (node->kind) {
+  case Decl:
+    check_type(c, node->u.decl.type);
+    if (node->u.decl.init) {
+      check_node(c, node->u.decl.init);
+    }
+    break;
+  case FnDefn:
+    check_type(c, node->u.fn_defn.decl->type);
+    if (node->u.fn_defn.body) {
+      len = c->tags.len;
+      check_node(c, node->u.fn_defn.body);
+      scope_pop(&c->tags, len);
+    }
+    break;
+  case Stmt:
+    check_stmt(c, &node->u.stmt);
+    break;
+  case List: /* initializers */
+    for (i = 0; i < node->u.list.len; i++) {
+      check_node(c, node->u.list.nodes[i]);
+    }
+    break;
+  case TypeName:
+    check_type(c, &node->u.type_name);
+    break;
+  case Ident:
+  case Lit:
+  case Expr:
+    check_expr(c, node);
+    break;
+  default:
+    break;
+  }
+}
+
+void check(struct unit *u) {
+  struct checker c;
+  int i;
+
+  c.unit = u;
+  scope_init(&c.tags);
+  c.int_t = new_numeric(Int, false, false);
+  c.uint_t = new_numeric(Int, true, false);
+  c.long_t = new_numeric(Int, false, true);
+  c.ulong_t = new_numeric(Int, true, true);
+  c.char_t = new_numeric(Char, false, false);
+
+  for (i = 0; i < u->nodes_len; i++) {
+    check_node(&c, u->nodes + i);
+  }
+  scope_free(&c.tags);
+}
@@ -0,0 +1,59 @@
+#ifndef CHOCC_CHECK_H
+#define CHOCC_CHECK_H
+#pragma once
+
+#include "chocc.h"
+#include "parse.h"
+#include "scope.h"
+#include "unit.h"
+
+/*
+ * layout is the size and alignment of a type on LP64 targets and, for
+ * structs and unions, the offsets of their members with a hash index of
+ * their names. It is computed once per type by type_layout.
+ */
+struct layout {
+  long size;
+  long align;
+
+  /* struct and union, by field index in struct_fields */
+  long *offsets;
+  int *buckets; /* first field in each bucket, -1 if none */
+  int *chain;   /* next field in the same bucket, -1 if none */
+  int buckets_len;
+};
+
+/*
+ * Returns the struct or union type defining the fields of t, looking up the
+ * tag of a reference like "struct s" in tags, or t if it is not one.
+ */
+type *type_complete(type *t, struct scope *tags);
+
+/*
+ * Returns the layout of t, computing it on first use, or NULL if t has no
+ * size, as with incomplete, function and void types. tags completes struct
+ * and union references.
+ */
+struct layout *type_layout(type *t, struct scope *tags);
+
+/*
+ * Returns the index in struct_fields of member name of the struct or union
+ * t, or -1 if it has none. Lookups are hashed.
+ */
+int type_member(type *t, struct scope *tags, const char *name);
+
+/* Declares in tags the struct and union tags that t and its members define */
+void declare_tags(type *t, struct scope *tags);
+
+/*
+ * Types the expressions of the parsed, folded and resolved unit u: every
+ * Expr, Ident and Lit node used as a value gets its type, after the usual
+ * conversions, in its type field. Expressions over undeclared names or
+ * operands of the wrong type are left without one.
+ */
+void check(struct unit *u);
+
+/* Returns the type check gave an Expr, Ident or Lit node, or NULL */
+type *expr_type(ast_node_t *node);
+
+#endif
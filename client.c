@@ -0,0 +1,101 @@
+/*
+ * chocc-client forwards a chocc command line to a server started with
+ * chocc --serve=socket, and prints what chocc would.
+ *
+ * usage: chocc-client [chocc flags] input.c
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "chocc.h"
+#include "io.h"
+#include "server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Writes arg as a JSON string, with a relative path made absolute */
+void write_arg(writer *w, const char *cwd, const char *arg) {
+  int prefix = 0;
+  char *abs;
+
+  if (!strncmp(arg, "--emit-ast=", 11) || !strncmp(arg, "--load-ast=", 11)) {
+    prefix = 11;
+  } else if (arg[0] == '-') {
+    write_json_str(w, arg);
+    return;
+  }
+  if (arg[prefix] == '/') {
+    write_json_str(w, arg);
+    return;
+  }
+
+  abs = malloc(strlen(arg) + strlen(cwd) + 2);
+  sprintf(abs, "%.*s%s/%s", prefix, arg, cwd, arg + prefix);
+  write_json_str(w, abs);
+  free(abs);
+}
+
+int main(int argc, char *argv[]) {
+  const char *sock = getenv("CHOCC_SOCKET");
+  struct sockaddr_un addr;
+  char cwd[4096];
+  FILE *in, *out;
+  writer w;
+  char *line = NULL;
+  size_t cap = 0;
+  const char *result, *status;
+  char *output;
+  int fd, i;
+
+  sock = sock ? sock : CHOCC_SOCKET;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, sock, sizeof(addr.sun_path) - 1);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    printf("could not connect to %s\n", sock);
+    return 1;
+  }
+  if (!getcwd(cwd, sizeof(cwd))) {
+    puts("could not get working directory");
+    return 1;
+  }
+
+  out = fdopen(fd, "w");
+  in = fdopen(dup(fd), "r");
+
+  w = new_writer(out);
+  write_str(&w, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"run\","
+                "\"params\":{\"args\":[");
+  for (i = 1; i < argc; i++) {
+    if (i > 1) {
+      write_char(&w, ',');
+    }
+    write_arg(&w, cwd, argv[i]);
+  }
+  write_str(&w, "]}}\n");
+  free_writer(&w);
+
+  if (getline(&line, &cap, in) <= 0) {
+    puts("no response from server");
+    return 1;
+  }
+
+  result = json_get(line, "result");
+  status = json_get(result, "status");
+  output = json_str(json_get(result, "output"));
+  if (!status || !output) {
+    char *msg = json_str(json_get(json_get(line, "error"), "message"));
+    printf("chocc server: %s\n", msg ? msg : "malformed response");
+    return 1;
+  }
+
+  fputs(output, stdout);
+  return atoi(status);
+}
@@ -1,7 +1,10 @@
 #include "cpp.h"
+#include "alloc.h"
 #include "chocc.h"
+#include "error.h"
 #include "lex.h"
 #include "parse.h"
+#include "stats.h"
 #include "unit.h"
 
 #include <stdio.h>
@@ -9,36 +12,61 @@
 #include <string.h>
 
 void cpp(struct unit *u) {
-  int i;
-
+  file *f = u->file;
+  struct stats *stats = u->stats;
+  char **macros;
+  int macros_len;
+  int *conds;
+  int conds_len;
+
+  stats_begin(stats);
   *u = cpp_replace(u);
+  u->stats = stats;
+  stats_end(stats, StageCppReplace);
   if (u->err) {
     return;
   }
+  macros = u->macros;
+  macros_len = u->macros_len;
 
+  stats_begin(stats);
   *u = cpp_cond(u);
+  u->stats = stats;
+  stats_end(stats, StageCppCond);
   if (u->err) {
     return;
   }
+  conds = u->conds;
+  conds_len = u->conds_len;
 
+  stats_begin(stats);
   *u = cpp_pragma(u);
+  u->stats = stats;
+  stats_end(stats, StageCppPragma);
   if (u->err) {
     return;
   }
 
+  stats_begin(stats);
   *u = cpp_include(u);
+  u->stats = stats;
+  stats_end(stats, StageCppInclude);
   if (u->err) {
     return;
   }
 
+  stats_begin(stats);
   *u = filter_newline(u);
+  u->stats = stats;
+  stats_end(stats, StageCppNewline);
   if (u->err) {
     return;
   }
-
-  for (i = 0; i < u->toks_len; i++) {
-    print_token(u->toks[i]);
-  }
+  u->file = f;
+  u->macros = macros;
+  u->macros_len = macros_len;
+  u->conds = conds;
+  u->conds_len = conds_len;
 }
 
 int cpp_replace_define(parser_t *p, def **defs, int defs_len) {
@@ -47,7 +75,7 @@ int cpp_replace_define(parser_t *p, def **defs, int defs_len) {
   int hideset_len = 0;
   int macro_cap = 1;
 
-  *defs = realloc(*defs, sizeof(def) * (defs_len + 1));
+  *defs = alloc_realloc(CppAlloc, *defs, sizeof(def) * (defs_len + 1));
 
   if (p->kind == Directive && !strcmp(p->tok.text, "#define")) {
     (*defs)[defs_len].macro = NULL;
@@ -57,7 +85,8 @@ int cpp_replace_define(parser_t *p, def **defs, int defs_len) {
     (*defs)[defs_len].id = peek(p, 1);
 
     /* do not recursively expand */
-    hideset = realloc(hideset, sizeof(token_t) * (hideset_len + 1));
+    hideset = alloc_realloc(CppAlloc, hideset,
+                            sizeof(token_t) * (hideset_len + 1));
     hideset[hideset_len++] = (*defs)[defs_len].id;
 
     if (peek(p, 1).kind == Id && peek(p, 2).kind == Lf) {
@@ -70,7 +99,7 @@ int cpp_replace_define(parser_t *p, def **defs, int defs_len) {
       /* #define id(...) macro */
       int params_cap = 1;
       int params_len = 0;
-      token_t *params = calloc(params_cap, sizeof(token_t));
+      token_t *params = alloc_calloc(CppAlloc, params_cap, sizeof(token_t));
       int i = 0;
 
       expect(p, Directive);
@@ -79,7 +108,8 @@ int cpp_replace_define(parser_t *p, def **defs, int defs_len) {
       for (; p->kind != RParen;) {
         if (params_len == params_cap) {
           params_cap *= 2;
-          params = realloc(params, sizeof(token_t) * params_cap);
+          params =
+              alloc_realloc(CppAlloc, params, sizeof(token_t) * params_cap);
         }
 
         params[params_len++] = p->tok;
@@ -95,7 +125,8 @@ int cpp_replace_define(parser_t *p, def **defs, int defs_len) {
 
       /* do not expand params */
       for (i = 0; i < params_len; i++) {
-        hideset = realloc(hideset, sizeof(token_t) * (hideset_len + 1));
+        hideset = alloc_realloc(CppAlloc, hideset,
+                                sizeof(token_t) * (hideset_len + 1));
         hideset[hideset_len++] = params[i];
       }
 
@@ -109,7 +140,8 @@ int cpp_replace_define(parser_t *p, def **defs, int defs_len) {
       (*defs)[defs_len].kind = Macro;
     }
 
-    (*defs)[defs_len].macro = calloc(macro_cap, sizeof(token_t));
+    (*defs)[defs_len].macro =
+        alloc_calloc(CppAlloc, macro_cap, sizeof(token_t));
     for (; p->kind != Lf && p->kind != Eof; advance(p)) {
       struct unit expanded;
       int k;
@@ -120,7 +152,8 @@ int cpp_replace_define(parser_t *p, def **defs, int defs_len) {
         if ((*defs)[defs_len].macro_len >= macro_cap) {
           macro_cap *= 2;
           (*defs)[defs_len].macro =
-              realloc((*defs)[defs_len].macro, sizeof(token_t) * macro_cap);
+              alloc_realloc(CppAlloc, (*defs)[defs_len].macro,
+                            sizeof(token_t) * macro_cap);
         }
         (*defs)[defs_len].macro[(*defs)[defs_len].macro_len++] =
             expanded.toks[k];
@@ -129,7 +162,8 @@ int cpp_replace_define(parser_t *p, def **defs, int defs_len) {
         if ((*defs)[defs_len].macro_len >= macro_cap) {
           macro_cap *= 2;
           (*defs)[defs_len].macro =
-              realloc((*defs)[defs_len].macro, sizeof(token_t) * macro_cap);
+              alloc_realloc(CppAlloc, (*defs)[defs_len].macro,
+                            sizeof(token_t) * macro_cap);
         }
         (*defs)[defs_len].macro[(*defs)[defs_len].macro_len++] = p->tok;
       }
@@ -151,8 +185,8 @@ int cpp_replace_define(parser_t *p, def **defs, int defs_len) {
       memmove(*defs + i, *defs + i + 1, (defs_len - i) * sizeof(def));
       defs_len--;
     } else {
-      puts("could not #undef");
-      exit(1);
+      fatal_printf("could not #undef\n");
+      fatal_exit();
     }
 
     delta = -1;
@@ -169,13 +203,15 @@ int cpp_replace_expand(struct unit *out, parser_t *p, def *defs, int defs_len,
     int cap;
   };
   int i;
+
+  COUNT(MacroLookups);
   for (i = 0; i < defs_len; i++) {
     if (!strcmp(defs[i].id.text, p->tok.text) && peek(p, 1).kind == LParen &&
         defs[i].kind == FnMacro) {
       int j;
       int args_len = 0;
       int args_cap = 1;
-      struct arg *args = calloc(args_cap, sizeof(struct arg));
+      struct arg *args = alloc_calloc(CppAlloc, args_cap, sizeof(struct arg));
       int stack = 0;
 
       expect(p, Id);
@@ -185,11 +221,11 @@ int cpp_replace_expand(struct unit *out, parser_t *p, def *defs, int defs_len,
       for (; p->kind != RParen;) {
         struct arg a = {0};
         a.cap = 1;
-        a.toks = calloc(a.cap, sizeof(token_t));
+        a.toks = alloc_calloc(CppAlloc, a.cap, sizeof(token_t));
 
         if (args_len == args_cap) {
           args_cap *= 2;
-          args = realloc(args, sizeof(struct arg) * args_cap);
+          args = alloc_realloc(CppAlloc, args, sizeof(struct arg) * args_cap);
         }
 
         for (;; advance(p)) {
@@ -223,21 +259,21 @@ int cpp_replace_expand(struct unit *out, parser_t *p, def *defs, int defs_len,
           for (j = 0; j < arg_expanded.toks_len; j++) {
             if (a.len == a.cap) {
               a.cap *= 2;
-              a.toks = realloc(a.toks, sizeof(token_t) * a.cap);
+              a.toks = alloc_realloc(CppAlloc, a.toks, sizeof(token_t) * a.cap);
             }
             a.toks[a.len++] = arg_expanded.toks[j];
           }
           if (!expanded) {
             if (a.len == a.cap) {
               a.cap *= 2;
-              a.toks = realloc(a.toks, sizeof(token_t) * a.cap);
+              a.toks = alloc_realloc(CppAlloc, a.toks, sizeof(token_t) * a.cap);
             }
             a.toks[a.len++] = p->tok;
           }
         }
         if (a.len == a.cap) {
           a.cap *= 2;
-          a.toks = realloc(a.toks, sizeof(token_t) * a.cap);
+          a.toks = alloc_realloc(CppAlloc, a.toks, sizeof(token_t) * a.cap);
         }
         args[args_len++] = a;
         if (p->kind != Comma) {
@@ -269,7 +305,7 @@ int cpp_replace_expand(struct unit *out, parser_t *p, def *defs, int defs_len,
               !strcmp(defs[i].macro[j + 1].text, defs[i].params[k].text)) {
             int str_len = 0;
             unsigned long str_cap = 1;
-            char *str = calloc(str_cap + 1, 1);
+            char *str = alloc_calloc(CppAlloc, str_cap + 1, 1);
             loc pos;
             int l;
 
@@ -278,7 +314,7 @@ int cpp_replace_expand(struct unit *out, parser_t *p, def *defs, int defs_len,
               unsigned long m;
               if (str_len + strlen(args[k].toks[l].text) >= str_cap) {
                 str_cap = str_len + strlen(args[k].toks[l].text) + 4;
-                str = realloc(str, str_cap + 1);
+                str = alloc_realloc(CppAlloc, str, str_cap + 1);
               }
 
               for (m = 0; m < strlen(args[k].toks[l].text); m++) {
@@ -440,11 +476,11 @@ int cpp_replace_expand(struct unit *out, parser_t *p, def *defs, int defs_len,
               cat_kind = -1;
             }
             if (cat_kind < 0) {
-              puts("invalid cpp concatenation tokens");
-              exit(1);
+              fatal_printf("invalid cpp concatenation tokens\n");
+              fatal_exit();
             }
 
-            cat_str = calloc(
+            cat_str = alloc_calloc(CppAlloc, 
                 strlen(prev->text) + strlen(args[k].toks[0].text) + 1, 1);
             strcpy(cat_str, prev->text);
             strcpy(cat_str + strlen(prev->text), args[k].toks[0].text);
@@ -505,11 +541,15 @@ int cpp_replace_expand(struct unit *out, parser_t *p, def *defs, int defs_len,
 struct unit cpp_replace(struct unit *in) {
   struct unit out;
   parser_t p;
+  struct trace *trace = stats_trace(in->stats);
+  const char *name;
+  double begin;
 
   int defs_len = 0;
   def *defs = NULL;
 
   bool cpp_line = false;
+  int expanded_begin;
 
   out = new_unit();
   p = new_parser(in);
@@ -574,12 +614,27 @@ struct unit cpp_replace(struct unit *in) {
     }
 
     /* perform macro expansion */
+    expanded_begin = out.toks_len;
+    name = p.tok.text;
+    begin = trace_now(trace);
     expanded = cpp_replace_expand(&out, &p, defs, defs_len, NULL, 0);
     if (!defined && !expanded) {
       unit_append_tok(&out, p.tok);
     }
+    if (expanded && out.toks_len - expanded_begin >= CPP_TRACE_TOKS) {
+      trace_span(trace, "macro", name, begin, "tokens",
+                 out.toks_len - expanded_begin);
+    }
+    for (; expanded && expanded_begin < out.toks_len; expanded_begin++) {
+      out.toks[expanded_begin].expanded = true;
+    }
   }
   unit_append_tok(&out, p.tok);
+
+  out.macros = alloc_calloc(CppAlloc, defs_len + 1, sizeof(*out.macros));
+  for (out.macros_len = 0; out.macros_len < defs_len; out.macros_len++) {
+    out.macros[out.macros_len] = defs[out.macros_len].id.text;
+  }
   return out;
 }
 
@@ -588,8 +643,8 @@ bool cpp_cond_cond(parser_t *p) {
 
   ast_node_t *x = expr(p, 0);
   if (p->kind != Lf) {
-    puts("malformed cpp constexpr");
-    exit(1);
+    fatal_printf("malformed cpp constexpr\n");
+    fatal_exit();
   }
   cond = eval_cpp_const_expr(x);
   advance(p);
@@ -608,7 +663,7 @@ struct unit cpp_cond_if(parser_t *p) {
   /* #if */
   if (p->kind != Directive ||
       (strcmp(p->tok.text, "#if") && strcmp(p->tok.text, "#elif"))) {
-    printf("expected #if, got %s\n", p->tok.text);
+    fatal_printf("expected #if, got %s\n", p->tok.text);
   }
   advance(p);
   cond = cpp_cond_cond(p);
@@ -692,8 +747,8 @@ struct unit cpp_cond_if(parser_t *p) {
   /* #endif */
 
   if (p->kind != Directive || strcmp(p->tok.text, "#endif")) {
-    printf("expected #endif, got %s\n", p->tok.text);
-    exit(1);
+    fatal_printf("expected #endif, got %s\n", p->tok.text);
+    fatal_exit();
   }
   advance(p);
 
@@ -712,7 +767,11 @@ struct unit cpp_cond(struct unit *in) {
       struct unit unit_if;
       int j;
 
+      out.conds = alloc_realloc(CppAlloc, out.conds,
+                                sizeof(int) * (out.conds_len + 2));
+      out.conds[out.conds_len++] = p.tok.line;
       unit_if = cpp_cond_if(&p);
+      out.conds[out.conds_len++] = p.toks[p.pos - 1].line;
       for (j = 0; j < unit_if.toks_len; j++) {
         unit_append_tok(&out, unit_if.toks[j]);
       }
@@ -748,9 +807,30 @@ struct unit cpp_pragma(struct unit *in) {
   return out;
 }
 
+/*
+ * Marks the file included by the tokens of in from i to the end of the
+ * line. Headers are not read, so it is an instant rather than a span.
+ */
+void cpp_include_mark(struct trace *trace, struct unit *in, int i) {
+  char name[256];
+  int len = 0;
+
+  for (; i < in->toks_len && in->toks[i].kind != Lf; i++) {
+    int n = strlen(in->toks[i].text);
+    if (len + n >= (int)sizeof(name)) {
+      break;
+    }
+    memcpy(name + len, in->toks[i].text, n);
+    len += n;
+  }
+  name[len] = '\0';
+  trace_mark(trace, "include", name);
+}
+
 /* TODO: handle includes properly */
 struct unit cpp_include(struct unit *in) {
   struct unit out = new_unit();
+  struct trace *trace = stats_trace(in->stats);
   bool include_ln = false;
   int i;
 
@@ -759,6 +839,9 @@ struct unit cpp_include(struct unit *in) {
     tok = in->toks[i];
     if (tok.kind == Directive && !strcmp(tok.text, "#include")) {
       include_ln = true;
+      if (trace) {
+        cpp_include_mark(trace, in, i + 1);
+      }
     }
     if (tok.kind == Lf) {
       include_ln = false;
@@ -801,8 +884,9 @@ unsigned long eval_cpp_const_expr(ast_node_t *root) {
     case OctLit:
       return root->u.lit.integer;
     default:
-      puts("invalid literal in cpp constant expression");
-      exit(1);
+      fatal_printf("invalid literal in cpp constant expression\n");
+      fatal_exit();
+      return 0;
     }
   }
   case Expr: {
@@ -811,8 +895,9 @@ unsigned long eval_cpp_const_expr(ast_node_t *root) {
     case CallExpr:
     case CommaExpr:
     case PostfixExpr:
-      puts("invalid expression in cpp constant expression");
-      exit(1);
+      fatal_printf("invalid expression in cpp constant expression\n");
+      fatal_exit();
+      return 0;
     case PrefixExpr: {
       unsigned long rhs = eval_cpp_const_expr(root->u.expr.rhs);
       switch (root->u.expr.op) {
@@ -825,8 +910,9 @@ unsigned long eval_cpp_const_expr(ast_node_t *root) {
       case Exclaim:
         return !rhs;
       default:
-        puts("invalid expression in cpp constant expression");
-        exit(1);
+        fatal_printf("invalid expression in cpp constant expression\n");
+        fatal_exit();
+        return 0;
       }
     }
     case InfixExpr: {
@@ -874,16 +960,18 @@ unsigned long eval_cpp_const_expr(ast_node_t *root) {
       case Question:
         return lhs ? mhs : rhs;
       default:
-        puts("invalid expression in cpp constant expression");
-        exit(1);
+        fatal_printf("invalid expression in cpp constant expression\n");
+        fatal_exit();
+        return 0;
       }
     }
     }
     break;
   }
   default: {
-    puts("invalid cpp constant expression");
-    exit(1);
+    fatal_printf("invalid cpp constant expression\n");
+    fatal_exit();
+    return 0;
   }
   }
 
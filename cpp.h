@@ -18,8 +18,15 @@ typedef struct def {
   def_kind kind;
 } def;
 
+/*
+ * Preprocesses the tokens of the unit, keeping the macro names and #if line
+ * ranges it saw.
+ */
 void cpp(struct unit *in);
 
+/* the tokens a top-level macro expansion makes for it to be traced */
+#define CPP_TRACE_TOKS 32
+
 struct unit cpp_replace(struct unit *in);
 int cpp_replace_define(parser_t *p, def **defs, int defs_len);
 int cpp_replace_expand(struct unit *out, parser_t *p, def *defs, int defs_len,
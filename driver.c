@@ -0,0 +1,593 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "driver.h"
+#include "check.h"
+#include "cpp.h"
+#include "error.h"
+#include "fold.h"
+#include "interp.h"
+#include "ir.h"
+#include "jit.h"
+#include "lex.h"
+#include "parse.h"
+#include "pool.h"
+#include "resolve.h"
+#include "ser.h"
+#include "stats.h"
+#include "trace.h"
+#include "vm.h"
+#include "wasm.h"
+#include "wasmrt.h"
+#include "x86.h"
+
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool parse_options(struct options *opts, int argc, char *argv[]) {
+  int i;
+
+  memset(opts, 0, sizeof(*opts));
+  opts->paths = calloc(argc, sizeof(*opts->paths));
+  opts->fmt = TextFmt;
+  opts->jit_hot = JIT_HOT;
+
+  for (i = 1; i < argc; i++) {
+    if (!strncmp(argv[i], "-j", 2)) {
+      /* -j alone uses every core */
+      opts->jobs = argv[i][2] ? atoi(argv[i] + 2) : pool_default_threads();
+    } else if (!strcmp(argv[i], "-fsyntax-only")) {
+      opts->syntax_only = true;
+    } else if (!strcmp(argv[i], "--dump-source")) {
+      opts->dump_source = true;
+    } else if (!strcmp(argv[i], "--dump-tokens")) {
+      opts->dump_tokens = true;
+    } else if (!strcmp(argv[i], "--dump-ast")) {
+      opts->dump_ast = true;
+    } else if (!strcmp(argv[i], "--decls")) {
+      opts->decls_only = true;
+    } else if (!strcmp(argv[i], "--symbols")) {
+      opts->symbols = true;
+    } else if (!strcmp(argv[i], "--run") || !strcmp(argv[i], "--run=vm")) {
+      opts->run = true;
+    } else if (!strcmp(argv[i], "--run=tree")) {
+      opts->run = true;
+      opts->tree = true;
+    } else if (!strcmp(argv[i], "--run=wasm")) {
+      opts->run = true;
+      opts->wasm = true;
+    } else if (!strcmp(argv[i], "--run=ir")) {
+      opts->run = true;
+      opts->ir = true;
+    } else if (!strcmp(argv[i], "--run=jit")) {
+      opts->run = true;
+      opts->jit = true;
+    } else if (!strncmp(argv[i], "--jit-hot=", 10)) {
+      opts->jit_hot = atol(argv[i] + 10);
+    } else if (!strcmp(argv[i], "--run=native")) {
+      opts->run = true;
+      opts->native = true;
+    } else if (!strcmp(argv[i], "--dump-ir")) {
+      opts->dump_ir = true;
+    } else if (!strcmp(argv[i], "--dump-ir=raw")) {
+      opts->dump_ir = true;
+      opts->ir_raw = true;
+    } else if (!strcmp(argv[i], "--ir-stats")) {
+      opts->ir_stats = true;
+    } else if (!strcmp(argv[i], "--stats")) {
+      opts->stats = true;
+    } else if (!strcmp(argv[i], "--stats=json")) {
+      opts->stats = true;
+      opts->stats_json = true;
+    } else if (!strncmp(argv[i], "--trace=", 8)) {
+      opts->trace_path = argv[i] + 8;
+    } else if (!strcmp(argv[i], "--types")) {
+      opts->types = true;
+    } else if (!strcmp(argv[i], "--json")) {
+      opts->fmt = JsonFmt;
+    } else if (!strcmp(argv[i], "--ndjson")) {
+      opts->fmt = NdjsonFmt;
+    } else if (!strncmp(argv[i], "--emit-ast=", 11)) {
+      opts->emit_path = argv[i] + 11;
+    } else if (!strncmp(argv[i], "--emit-wasm=", 12)) {
+      opts->wasm_path = argv[i] + 12;
+    } else if (!strncmp(argv[i], "--emit-asm=", 11)) {
+      opts->asm_path = argv[i] + 11;
+    } else if (!strncmp(argv[i], "--load-ast=", 11)) {
+      opts->load_path = argv[i] + 11;
+    } else if (!strcmp(argv[i], "--serve")) {
+      opts->serve = true;
+    } else if (!strncmp(argv[i], "--serve=", 8)) {
+      opts->serve = true;
+      opts->serve_path = argv[i] + 8;
+    } else if (argv[i][0] == '-') {
+      return false;
+    } else {
+      opts->paths[opts->paths_len++] = argv[i];
+    }
+  }
+  opts->path = opts->paths[0];
+
+  /* without a choice, everything is written */
+  if (!opts->syntax_only && !opts->dump_source && !opts->dump_tokens &&
+      !opts->dump_ast) {
+    opts->dump_source = opts->dump_tokens = opts->dump_ast = true;
+  }
+
+  /* only the tokens and nodes are written for more than one input, and
+   * only they are timed */
+  if ((opts->paths_len > 1 || opts->stats || opts->trace_path) &&
+      (opts->run || opts->dump_ir || opts->ir_stats || opts->emit_path ||
+       opts->wasm_path || opts->asm_path || opts->load_path)) {
+    return false;
+  }
+
+  if (opts->serve) {
+    return !opts->path && !opts->load_path;
+  }
+  return !opts->path != !opts->load_path;
+}
+
+void write_usage(writer *w) {
+  write_str(w, "usage: chocc [-j[N]] [--decls] "
+               "[--json | --ndjson | --symbols | --types] [--emit-ast=out] "
+               "input.c\n");
+  write_str(w, "       chocc [-j[N]] [--decls] [-fsyntax-only | --dump-source] "
+               "[--dump-tokens] [--dump-ast] [--stats[=json]] "
+               "[--trace=out.json] input.c ...\n");
+  write_str(w, "       chocc --run[=vm | =tree | =wasm | =ir | =jit | =native] "
+               "[--jit-hot=N] input.c\n");
+  write_str(w, "       chocc [--dump-ir[=raw]] [--ir-stats] input.c\n");
+  write_str(w, "       chocc --emit-wasm=out.wasm input.c\n");
+  write_str(w, "       chocc --emit-asm=out.s input.c\n");
+  write_str(w, "       chocc [--json | --ndjson] --load-ast=in\n");
+  write_str(w, "       chocc --serve[=socket]\n");
+}
+
+struct unit compile_toks(file *f, struct stats *stats) {
+  struct unit u = new_unit();
+  u.file = f;
+  u.stats = stats;
+
+  stats_begin(stats);
+  lex(&u);
+  stats_end(stats, StageLex);
+  if (u.err) {
+    return u;
+  }
+  if (stats) {
+    stats->lines = f->lines_len;
+    stats->toks_lexed = u.toks_len;
+  }
+  cpp(&u);
+  return u;
+}
+
+void compile_nodes(struct unit *u, struct options *opts) {
+  struct stats *stats = u->stats;
+
+  stats_begin(stats);
+  if (opts->decls_only) {
+    /* bodies are never needed, so never parsed */
+    parse_lazy(u);
+  } else if (opts->jobs) {
+    parse_parallel(u, opts->jobs);
+  } else {
+    parse(u);
+  }
+  stats_end(stats, StageParse);
+  stats_begin(stats);
+  fold(u);
+  stats_end(stats, StageFold);
+  stats_begin(stats);
+  resolve(u);
+  stats_end(stats, StageResolve);
+  stats_begin(stats);
+  check(u);
+  stats_end(stats, StageCheck);
+}
+
+void write_node(writer *w, ast_node_t *node, int i, int len, ast_format fmt,
+                bool decls_only) {
+  ast_node_t sig;
+
+  if (decls_only && node->kind == FnDefn) {
+    /* without a body or its source, fn_defn_body does not parse */
+    sig = *node;
+    sig.u.fn_defn.body = NULL;
+    sig.u.fn_defn.toks = NULL;
+    node = &sig;
+  }
+
+  switch (fmt) {
+  case TextFmt: {
+    if (decls_only && node->kind == FnDefn) {
+      write_fn_sig(w, node);
+    } else {
+      write_ast(w, node, i == len - 1);
+    }
+    break;
+  }
+  case JsonFmt: {
+    if (i) {
+      write_char(w, ',');
+    }
+    write_ast_json(w, node);
+    break;
+  }
+  case NdjsonFmt: {
+    write_ast_json(w, node);
+    write_char(w, '\n');
+    break;
+  }
+  }
+}
+
+/*
+ * Writes the source and tokens of u as opts asks, then its error if it has
+ * one. Returns the exit status.
+ */
+int write_toks(writer *w, struct unit *u, struct options *opts) {
+  int i;
+
+  if (opts->dump_source) {
+    write_file(w, u->file);
+  }
+  if (u->err) {
+    write_error(w, u->err);
+    return 1;
+  }
+  for (i = 0; opts->dump_tokens && i < u->toks_len; i++) {
+    write_token(w, u->toks[i]);
+  }
+  return 0;
+}
+
+/* Emits and writes the nodes of u. Returns the exit status. */
+int write_nodes(writer *w, struct unit *u, struct options *opts) {
+  int i;
+
+  if (opts->emit_path && ser_write(u, opts->emit_path)) {
+    write_str(w, "could not write ");
+    write_str(w, opts->emit_path);
+    write_char(w, '\n');
+    return 1;
+  }
+
+  if (!opts->dump_ast) {
+    return 0;
+  }
+  if (opts->symbols) {
+    write_syms(w, u);
+    return 0;
+  }
+  w->types = opts->types;
+  /* a unit without nodes is still an array */
+  if (opts->fmt == JsonFmt) {
+    write_char(w, '[');
+  }
+  for (i = 0; i < u->nodes_len; i++) {
+    write_node(w, u->nodes + i, i, u->nodes_len, opts->fmt, opts->decls_only);
+  }
+  if (opts->fmt == JsonFmt) {
+    write_str(w, "]\n");
+  }
+  return 0;
+}
+
+int write_unit(writer *w, struct unit *u, struct options *opts) {
+  return write_toks(w, u, opts) || write_nodes(w, u, opts);
+}
+
+/* Writes the counts and times of stats as opts asks */
+void run_stats(writer *w, struct stats *stats, struct unit *u,
+               struct options *opts) {
+  stats->toks = u->toks_len;
+  stats->macros = u->macros_len;
+  ser_count(u, &stats->nodes, &stats->types);
+  if (opts->stats_json) {
+    write_stats_json(w, stats);
+  } else {
+    write_stats(w, stats);
+  }
+}
+
+/* Compiles the file at opts->path as run does, exiting at a fatal error */
+int run_unit(writer *w, struct options *opts) {
+  struct stats stats;
+  struct stats *s = opts->stats || opts->trace ? &stats : NULL;
+  double begin = trace_now(opts->trace);
+  struct unit u;
+  file *f;
+  int status;
+
+  memset(&stats, 0, sizeof(stats));
+  stats.path = opts->path;
+  stats.thread = opts->paths_len > 1;
+  stats.trace = opts->trace;
+  stats_begin(s);
+  f = load_file(opts->path);
+  stats_end(s, StageLoad);
+  u = compile_toks(f, s);
+
+  stats_begin(s);
+  status = write_toks(w, &u, opts);
+  stats_end(s, StageWrite);
+  if (status) {
+    trace_span(opts->trace, "unit", opts->path, begin, NULL, 0);
+    return 1;
+  }
+
+  compile_nodes(&u, opts);
+  stats_begin(s);
+  status = write_nodes(w, &u, opts);
+  writer_flush(w);
+  stats_end(s, StageWrite);
+  trace_span(opts->trace, "unit", opts->path, begin, NULL, 0);
+  if (opts->stats) {
+    run_stats(w, s, &u, opts);
+  }
+  return status;
+}
+
+int run(writer *w, struct options *opts) {
+  struct fatal_catch c;
+  int status;
+
+  /* the message goes to w after what the unit wrote */
+  c.w = w;
+  if (setjmp(c.env)) {
+    fatal_catch(NULL);
+    return 1;
+  }
+  fatal_catch(&c);
+  status = run_unit(w, opts);
+  fatal_catch(NULL);
+  return status;
+}
+
+/* the units of run_units and how many of them have been written */
+struct run_units {
+  struct options *opts;
+  writer *w;
+  char **outs;
+  size_t *outs_len;
+  bool *done;
+  int status;
+  int next;
+  pthread_mutex_t lock;
+};
+
+/*
+ * Compiles the idx-th input into a buffer of its own, then writes out every
+ * finished buffer whose inputs before it have all been written.
+ */
+void run_unit_job(void *arg, int idx) {
+  struct run_units *r = arg;
+  struct options opts = *r->opts;
+  FILE *mem = open_memstream(r->outs + idx, r->outs_len + idx);
+  writer w = new_writer(mem);
+  int status;
+
+  /* the units are the parallelism, each parsed by the thread running it */
+  opts.path = opts.paths[idx];
+  opts.jobs = 0;
+  status = run(&w, &opts);
+  free_writer(&w);
+  fclose(mem);
+
+  pthread_mutex_lock(&r->lock);
+  r->status |= status;
+  r->done[idx] = true;
+  for (; r->next < opts.paths_len && r->done[r->next]; r->next++) {
+    write_mem(r->w, r->outs[r->next], r->outs_len[r->next]);
+    free(r->outs[r->next]);
+  }
+  writer_flush(r->w);
+  pthread_mutex_unlock(&r->lock);
+}
+
+int run_units(writer *w, struct options *opts) {
+  struct run_units r;
+  int n = opts->paths_len;
+
+  r.opts = opts;
+  r.w = w;
+  r.outs = calloc(n, sizeof(*r.outs));
+  r.outs_len = calloc(n, sizeof(*r.outs_len));
+  r.done = calloc(n, sizeof(*r.done));
+  r.status = 0;
+  r.next = 0;
+  pthread_mutex_init(&r.lock, NULL);
+
+  pool_run(opts->jobs ? opts->jobs : pool_default_threads(), n, run_unit_job,
+           &r);
+
+  pthread_mutex_destroy(&r.lock);
+  free(r.outs);
+  free(r.outs_len);
+  free(r.done);
+  return r.status;
+}
+
+/* Compiles in to a module and runs its main in the wasm runtime */
+int run_wasm(writer *w, struct interp *in, char **argv) {
+  struct wasm_buf mod = wasm_compile(in);
+  struct wasm_module *m;
+  const char *err;
+  int status;
+
+  if (!(m = wasm_decode(mod.data, mod.len, &err))) {
+    write_str(w, "wasm: invalid module: ");
+    write_str(w, err);
+    write_char(w, '\n');
+    return 1;
+  }
+  status = wasm_run_main(m, in->out, 1, argv);
+  wasm_free(m);
+  free(mod.data);
+  return status;
+}
+
+/* Compiles in to an executable with the system's cc and runs it */
+int run_native(writer *w, struct interp *in, char **argv) {
+  char *path = x86_link(ir_load(in, true, true, NULL), "cc");
+  int status;
+
+  if (!path) {
+    write_str(w, "x86: could not link the program\n");
+    return 1;
+  }
+  status = x86_exec(path, 1, argv, in->out);
+  x86_unlink(path);
+  return status;
+}
+
+int run_program(writer *w, struct options *opts) {
+  struct unit u = compile_toks(load_file(opts->path), NULL);
+  struct interp *in;
+  struct ir_prog *p;
+  char *argv[2];
+
+  if (u.err) {
+    write_error(w, u.err);
+    return 1;
+  }
+  compile_nodes(&u, opts);
+  writer_flush(w);
+
+  argv[0] = opts->path;
+  argv[1] = NULL;
+  in = interp_load(&u);
+  if (opts->wasm) {
+    return run_wasm(w, in, argv);
+  }
+  if (opts->native) {
+    return run_native(w, in, argv);
+  }
+  if (opts->ir || opts->jit) {
+    p = ir_load(in, true, true, NULL);
+    if (opts->jit) {
+      jit_attach(p, opts->jit_hot);
+      return jit_run(p, 1, argv);
+    }
+    return ir_run(p, 1, argv);
+  }
+  return opts->tree ? interp_run(in, 1, argv) : vm_run(vm_load(in), 1, argv);
+}
+
+int write_ir_prog(writer *w, struct options *opts) {
+  struct unit u = compile_toks(load_file(opts->path), NULL);
+  struct ir_stats stats;
+  struct ir_prog *p;
+  int i;
+
+  if (u.err) {
+    write_error(w, u.err);
+    return 1;
+  }
+  compile_nodes(&u, opts);
+  writer_flush(w);
+
+  memset(&stats, 0, sizeof(stats));
+  p = ir_load(interp_load(&u), !opts->ir_raw, true, &stats);
+  /* the initializers too, if there are any */
+  for (i = 0; opts->dump_ir && i < p->fns_len + (p->in->inits_len > 0); i++) {
+    write_ir(w, p->fns[i]);
+  }
+  if (opts->ir_stats) {
+    write_ir_stats(w, &stats);
+  }
+  return 0;
+}
+
+int emit_wasm(writer *w, struct options *opts) {
+  struct unit u = compile_toks(load_file(opts->path), NULL);
+  struct wasm_module *m;
+  struct wasm_buf mod;
+  const char *err;
+  FILE *f;
+
+  if (u.err) {
+    write_error(w, u.err);
+    return 1;
+  }
+  compile_nodes(&u, opts);
+  writer_flush(w);
+
+  mod = wasm_compile(interp_load(&u));
+  if (!(m = wasm_decode(mod.data, mod.len, &err))) {
+    write_str(w, "wasm: invalid module: ");
+    write_str(w, err);
+    write_char(w, '\n');
+    free(mod.data);
+    return 1;
+  }
+  wasm_free(m);
+
+  if (!(f = fopen(opts->wasm_path, "wb")) ||
+      fwrite(mod.data, 1, mod.len, f) != (size_t)mod.len) {
+    write_str(w, "could not write ");
+    write_str(w, opts->wasm_path);
+    write_char(w, '\n');
+    if (f) {
+      fclose(f);
+    }
+    free(mod.data);
+    return 1;
+  }
+  fclose(f);
+  free(mod.data);
+  return 0;
+}
+
+int emit_asm(writer *w, struct options *opts) {
+  struct unit u = compile_toks(load_file(opts->path), NULL);
+  writer out;
+  FILE *f;
+
+  if (u.err) {
+    write_error(w, u.err);
+    return 1;
+  }
+  compile_nodes(&u, opts);
+  writer_flush(w);
+
+  if (!(f = fopen(opts->asm_path, "w"))) {
+    write_str(w, "could not write ");
+    write_str(w, opts->asm_path);
+    write_char(w, '\n');
+    return 1;
+  }
+  out = new_writer(f);
+  x86_compile(&out, ir_load(interp_load(&u), true, true, NULL));
+  free_writer(&out);
+  fclose(f);
+  return 0;
+}
+
+int write_loaded(writer *w, struct options *opts) {
+  /* print a unit serialized by --emit-ast */
+  ser_file *sf = ser_open(opts->load_path);
+  int i;
+
+  if (!sf) {
+    write_str(w, "could not load ");
+    write_str(w, opts->load_path);
+    write_char(w, '\n');
+    return 1;
+  }
+  if (opts->fmt == JsonFmt) {
+    write_char(w, '[');
+  }
+  for (i = 0; i < sf->hdr->roots_len; i++) {
+    write_node(w, ser_root(sf, i), i, sf->hdr->roots_len, opts->fmt, false);
+  }
+  if (opts->fmt == JsonFmt) {
+    write_str(w, "]\n");
+  }
+  ser_close(sf);
+  return 0;
+}
@@ -0,0 +1,136 @@
+#ifndef CHOCC_DRIVER_H
+#define CHOCC_DRIVER_H
+#pragma once
+
+#include "chocc.h"
+#include "io.h"
+#include "unit.h"
+
+typedef enum ast_format { TextFmt, JsonFmt, NdjsonFmt } ast_format;
+
+/*
+ * options are the command line flags of chocc.
+ */
+struct options {
+  char *path;   /* the first of paths */
+  char **paths; /* every input file, in the order given */
+  int paths_len;
+  int jobs;
+  bool decls_only;
+  bool syntax_only; /* write nothing but errors */
+  bool dump_source; /* write the source lines */
+  bool dump_tokens; /* write the preprocessed tokens */
+  bool dump_ast;    /* write the nodes, all three unless one is chosen */
+  bool symbols;     /* write the symbols instead of the nodes */
+  bool types;       /* write the types of expressions in the nodes */
+  bool run;         /* interpret main instead of writing anything */
+  bool tree;        /* interpret by walking the lowered tree, not bytecode */
+  bool wasm;        /* run as a wasm module in the runtime, not bytecode */
+  bool ir;          /* run the optimized SSA form, not bytecode */
+  bool native;      /* compile to x86-64 and run that, not bytecode */
+  bool jit;         /* run the SSA form, its hot functions as machine code */
+  long jit_hot;     /* the calls and loop iterations making a function hot */
+  bool dump_ir;     /* write the SSA form of each function */
+  bool ir_raw;      /* as built, before the passes */
+  bool ir_stats;    /* write the time and size of each pass */
+  bool stats;       /* write the time, memory and output of each stage */
+  bool stats_json;  /* as JSON */
+  ast_format fmt;
+  char *emit_path;
+  char *load_path;
+  char *wasm_path;  /* compile to a wasm module there */
+  char *asm_path;   /* compile to x86-64 assembler there */
+
+  char *trace_path;    /* write Chrome trace events there */
+  struct trace *trace; /* open while compiling */
+
+  bool serve;
+  char *serve_path; /* NULL serves stdin/stdout */
+};
+
+/*
+ * Parses command line flags into opts. Returns false on a usage error.
+ */
+bool parse_options(struct options *opts, int argc, char *argv[]);
+void write_usage(writer *);
+
+/*
+ * Lexes and preprocesses f into a new unit, timing the stages into stats if
+ * it is not NULL. Check u->err for errors.
+ */
+struct unit compile_toks(file *f, struct stats *stats);
+
+/*
+ * Parses a preprocessed unit as opts asks, timed into its stats.
+ */
+void compile_nodes(struct unit *u, struct options *opts);
+
+/*
+ * Writes the i-th of len top-level nodes. As JsonFmt, the caller writes the
+ * brackets of the array, so that a unit without nodes is one too.
+ */
+void write_node(writer *w, ast_node_t *node, int i, int len, ast_format fmt,
+                bool decls_only);
+
+/*
+ * Compiles the file at opts->path, writing the source, tokens and nodes opts
+ * asks for and, with opts->stats, the time each stage took after them.
+ * Everything, fatal errors included, goes through w. Returns the exit
+ * status, 1 after a fatal error.
+ */
+int run(writer *w, struct options *opts);
+
+/*
+ * Compiles each of opts->paths as run does, concurrently on opts->jobs
+ * threads or one per core, and writes what run would for each in input
+ * order. A fatal error ends only its own unit. Returns 1 if any unit
+ * failed, otherwise 0.
+ */
+int run_units(writer *w, struct options *opts);
+
+/*
+ * Writes the source and tokens of u as opts asks, then its error if it has
+ * one. Returns the exit status.
+ */
+int write_toks(writer *w, struct unit *u, struct options *opts);
+
+/* Emits and writes the nodes of a parsed u. Returns the exit status. */
+int write_nodes(writer *w, struct unit *u, struct options *opts);
+
+/*
+ * Writes what run prints for an already compiled unit: the source, then the
+ * error or the tokens and nodes, as opts asks. Returns the exit status.
+ */
+int write_unit(writer *w, struct unit *u, struct options *opts);
+
+/*
+ * Compiles the file at opts->path and interprets its main, writing only
+ * errors. Returns the exit status of the program.
+ */
+int run_program(writer *w, struct options *opts);
+
+/*
+ * Compiles the file at opts->path to SSA form, writing it or the stats of
+ * its passes as opts asks. Returns the exit status.
+ */
+int write_ir_prog(writer *w, struct options *opts);
+
+/*
+ * Compiles the file at opts->path to a wasm module at opts->wasm_path,
+ * validating it first and writing only errors. Returns the exit status.
+ */
+int emit_wasm(writer *w, struct options *opts);
+
+/*
+ * Compiles the file at opts->path to x86-64 assembler at opts->asm_path,
+ * writing only errors. Returns the exit status.
+ */
+int emit_asm(writer *w, struct options *opts);
+
+/*
+ * Writes the nodes of the AST file at opts->load_path. Returns the exit
+ * status.
+ */
+int write_loaded(writer *w, struct options *opts);
+
+#endif
@@ -1,10 +1,16 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include "error.h"
+#include "alloc.h"
+
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdlib.h>
 
 struct error *new_error(error_kind kind, char *msg, loc pos) {
   struct error *err;
 
-  err = calloc(1, sizeof(*err));
+  err = alloc_calloc(UnitAlloc, 1, sizeof(*err));
   err->kind = kind;
   err->msg = msg;
   err->pos = pos;
@@ -13,18 +19,74 @@ struct error *new_error(error_kind kind, char *msg, loc pos) {
 }
 
 void print_error(struct error *err) {
+  writer w = new_writer(stdout);
+  write_error(&w, err);
+  free_writer(&w);
+}
+
+void write_error(writer *w, struct error *err) {
   switch (err->kind) {
   case ParseErr:
-    printf("Parse");
+    write_str(w, "Parse");
     break;
   case LexErr:
-    printf("Lex");
+    write_str(w, "Lex");
     break;
   case CppErr:
-    printf("Preprocessor");
+    write_str(w, "Preprocessor");
     break;
   }
 
-  printf(" error at %d:%d\n", err->pos.ln, err->pos.col);
-  puts(err->msg);
+  write_str(w, " error at ");
+  write_long(w, err->pos.ln);
+  write_char(w, ':');
+  write_long(w, err->pos.col);
+  write_char(w, '\n');
+  write_str(w, err->msg);
+  write_char(w, '\n');
+}
+
+/* each thread's fatal_catch, made once */
+pthread_key_t fatal_key;
+pthread_once_t fatal_once = PTHREAD_ONCE_INIT;
+
+void fatal_key_create(void) {
+  pthread_key_create(&fatal_key, NULL);
+}
+
+struct fatal_catch *fatal_catch(struct fatal_catch *c) {
+  struct fatal_catch *prev;
+
+  pthread_once(&fatal_once, fatal_key_create);
+  prev = pthread_getspecific(fatal_key);
+  pthread_setspecific(fatal_key, c);
+  return prev;
+}
+
+void fatal_printf(const char *fmt, ...) {
+  struct fatal_catch *c;
+  va_list ap;
+
+  pthread_once(&fatal_once, fatal_key_create);
+  c = pthread_getspecific(fatal_key);
+  va_start(ap, fmt);
+  if (c) {
+    /* after what the unit has written so far */
+    writer_flush(c->w);
+    vfprintf(c->w->stream, fmt, ap);
+  } else {
+    vprintf(fmt, ap);
+  }
+  va_end(ap);
+}
+
+void fatal_exit(void) {
+  struct fatal_catch *c;
+
+  pthread_once(&fatal_once, fatal_key_create);
+  c = pthread_getspecific(fatal_key);
+  if (c) {
+    longjmp(c->env, 1);
+  }
+  exit(1);
 }
@@ -2,6 +2,7 @@
 #define CHOCC_ERROR_H
 #pragma once
 
+#include <setjmp.h>
 #include <stdio.h>
 
 #include "chocc.h"
@@ -16,5 +17,27 @@ struct error {
 
 struct error *new_error(error_kind kind, char *msg, loc pos);
 void print_error(struct error *);
+void write_error(writer *, struct error *);
+
+/*
+ * fatal_catch is where the errors the front end cannot recover from go on
+ * the thread that set it. Without one they are printed and the process
+ * exits; with one the message is written to w after what it holds, and
+ * fatal_exit jumps back to env.
+ */
+struct fatal_catch {
+  writer *w;
+  jmp_buf env;
+};
+
+/*
+ * Sets the calling thread's catch, or restores exiting with NULL. Returns
+ * the catch it replaces.
+ */
+struct fatal_catch *fatal_catch(struct fatal_catch *);
+/* Prints a fatal error message like printf */
+void fatal_printf(const char *fmt, ...);
+/* Ends the unit after a fatal error message */
+void fatal_exit(void);
 
 #endif
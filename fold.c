@@ -0,0 +1,608 @@
+#include "fold.h"
+#include "check.h"
+#include "lex.h"
+#include "scope.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * fold_value is the value of an integer constant expression after integral
+ * promotion: its bits, sign-extended for signed ranks, and its type.
+ */
+typedef enum fold_rank { IntR, UIntR, LongR, ULongR } fold_rank;
+
+struct fold_value {
+  unsigned long bits;
+  fold_rank rank;
+};
+
+/* kinds of ordinary names in scope */
+typedef enum fold_sym_kind { ConstSym, ShadowSym } fold_sym_kind;
+
+/*
+ * folder holds the enum constants, the ordinary identifiers shadowing them
+ * and the struct and union tags in scope.
+ */
+struct folder {
+  struct scope scope;
+};
+
+void fold_node(struct folder *, ast_node_t *);
+bool fold_expr(struct folder *, ast_node_t *, struct fold_value *);
+void fold_type(struct folder *, type *);
+
+/* Declares an ordinary identifier, hiding enum constants of the same name */
+void fold_shadow(struct folder *f, ast_node_t *name) {
+  if (name) {
+    scope_push(&f->scope, name->u.ident.name, OrdNs)->kind = ShadowSym;
+  }
+}
+
+/*
+ * Values
+ */
+
+int rank_bits(fold_rank rank) {
+  return rank == IntR || rank == UIntR ? 32 : CHAR_BIT * sizeof(long);
+}
+
+bool rank_signed(fold_rank rank) { return rank == IntR || rank == LongR; }
+
+/* Truncates v->bits to its rank */
+void value_norm(struct fold_value *v) {
+  if (rank_bits(v->rank) == 32) {
+    v->bits &= 0xffffffffUL;
+    if (rank_signed(v->rank) && v->bits & 0x80000000UL) {
+      v->bits |= ~0xffffffffUL;
+    }
+  }
+}
+
+struct fold_value value_of(unsigned long bits, fold_rank rank) {
+  struct fold_value v;
+  v.bits = bits;
+  v.rank = rank;
+  value_norm(&v);
+  return v;
+}
+
+/* usual arithmetic conversions, long holds every unsigned int */
+fold_rank rank_common(fold_rank a, fold_rank b) {
+  if (a == ULongR || b == ULongR) {
+    return ULongR;
+  }
+  if (a == LongR || b == LongR) {
+    return LongR;
+  }
+  if (a == UIntR || b == UIntR) {
+    return UIntR;
+  }
+  return IntR;
+}
+
+/* Returns the value of a character constant without its quotes */
+long char_value(const char *c) {
+  long v = 0;
+  int i;
+
+  if (*c != '\\') {
+    return (signed char)*c;
+  }
+  switch (c[1]) {
+  case 'n':
+    return '\n';
+  case 't':
+    return '\t';
+  case 'r':
+    return '\r';
+  case 'a':
+    return '\a';
+  case 'b':
+    return '\b';
+  case 'f':
+    return '\f';
+  case 'v':
+    return '\v';
+  case 'x':
+    return (signed char)strtol(c + 2, NULL, 16);
+  default:
+    break;
+  }
+  if ('0' <= c[1] && c[1] <= '7') {
+    for (i = 1; i < 4 && '0' <= c[i] && c[i] <= '7'; i++) {
+      v = v * 8 + c[i] - '0';
+    }
+    return (signed char)v;
+  }
+  return (signed char)c[1];
+}
+
+/* Replaces node with a literal of value v */
+void fold_replace(ast_node_t *node, struct fold_value v) {
+  node->kind = Lit;
+  memset(&node->u.lit, 0, sizeof(node->u.lit));
+  node->u.lit.kind = DecLit;
+  node->u.lit.integer = (long)v.bits;
+  node->u.lit.is_unsigned = !rank_signed(v.rank);
+  node->u.lit.is_long = rank_bits(v.rank) != 32;
+}
+
+/*
+ * Types
+ */
+
+/* Converts v to the integer type t, returning false if t is not one */
+bool value_cast(type *t, struct fold_value *v) {
+  int bits;
+
+  if (t->kind == EnumT) {
+    *v = value_of(v->bits, IntR);
+    return true;
+  }
+  if (t->kind != NumericT || t->numeric.base == Float ||
+      t->numeric.base == Double) {
+    return false;
+  }
+
+  if (t->numeric.base == Char || t->numeric.is_short) {
+    /* promoted back to int */
+    bits = t->numeric.base == Char ? CHAR_BIT : 16;
+    v->bits &= (1UL << bits) - 1;
+    if (!t->numeric.is_unsigned && v->bits >> (bits - 1)) {
+      v->bits |= ~((1UL << bits) - 1);
+    }
+    *v = value_of(v->bits, IntR);
+  } else if (t->numeric.is_long) {
+    *v = value_of(v->bits, t->numeric.is_unsigned ? ULongR : LongR);
+  } else {
+    *v = value_of(v->bits, t->numeric.is_unsigned ? UIntR : IntR);
+  }
+  return true;
+}
+
+/* Declares the constants of an enum type in order */
+void fold_enum(struct folder *f, type *t) {
+  struct fold_value v = {(unsigned long)-1, IntR};
+  bool known = true;
+  int i;
+
+  for (i = 0; i < t->enum_idents->u.list.len; i++) {
+    ast_node_t *ex = ast_list_at(t->enum_exprs, i);
+    if (ex) {
+      known = fold_expr(f, ex, &v);
+      v = value_of(v.bits, IntR);
+      if (known) {
+        fold_replace(ex, v);
+      }
+    } else {
+      v = value_of(v.bits + 1, IntR);
+    }
+
+    if (known) {
+      struct scope_entry *e = scope_push(
+          &f->scope, ast_list_at(t->enum_idents, i)->u.ident.name, OrdNs);
+      e->kind = ConstSym;
+      e->value = (long)v.bits;
+    } else {
+      fold_shadow(f, ast_list_at(t->enum_idents, i));
+    }
+  }
+}
+
+/* Folds the array sizes and enum constants of t, declaring its tag */
+void fold_type(struct folder *f, type *t) {
+  struct fold_value v;
+  int i;
+
+  for (; t; t = t->inner) {
+    switch (t->kind) {
+    case ArrT: {
+      if (t->arr_expr && !t->arr_size && fold_expr(f, t->arr_expr, &v) &&
+          (long)v.bits > 0 && v.bits <= INT_MAX) {
+        t->arr_size = v.bits;
+      }
+      break;
+    }
+    case FnT: {
+      for (i = 0; i < t->fn_param_decls_len; i++) {
+        fold_type(f, t->fn_param_decls[i].u.decl.type);
+      }
+      break;
+    }
+    case StructT:
+    case UnionT: {
+      if (t->struct_fields) {
+        ast_node_t *fields = t->struct_fields;
+        for (i = 0; i < fields->u.list.len; i++) {
+          fold_type(f, ast_list_at(fields, i)->u.decl.type);
+        }
+        if (t->name) {
+          scope_push(&f->scope, t->name->u.ident.name, TagNs)->ptr = t;
+        }
+      }
+      break;
+    }
+    case EnumT: {
+      if (t->enum_idents) {
+        fold_enum(f, t);
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+/*
+ * Expressions
+ */
+
+/* Folds an operator over constant operands, returning false if undefined */
+bool fold_infix(token_kind_t op, struct fold_value l, struct fold_value r,
+                struct fold_value *v) {
+  fold_rank rank = rank_common(l.rank, r.rank);
+  bool is_signed = rank_signed(rank);
+
+  switch (op) {
+  case LShft:
+  case RShft: {
+    /* the type is that of the promoted left operand */
+    if ((rank_signed(r.rank) && (long)r.bits < 0) ||
+        r.bits >= (unsigned long)rank_bits(l.rank)) {
+      return false;
+    }
+    if (op == LShft) {
+      *v = value_of(l.bits << r.bits, l.rank);
+    } else if (rank_signed(l.rank)) {
+      *v = value_of((unsigned long)((long)l.bits >> r.bits), l.rank);
+    } else {
+      *v = value_of(l.bits >> r.bits, l.rank);
+    }
+    return true;
+  }
+  case AmpAmp:
+    *v = value_of(l.bits && r.bits, IntR);
+    return true;
+  case BarBar:
+    *v = value_of(l.bits || r.bits, IntR);
+    return true;
+  default:
+    break;
+  }
+
+  /* converted to the common type */
+  l = value_of(l.bits, rank);
+  r = value_of(r.bits, rank);
+
+  switch (op) {
+  case Plus:
+    *v = value_of(l.bits + r.bits, rank);
+    return true;
+  case Minus:
+    *v = value_of(l.bits - r.bits, rank);
+    return true;
+  case Star:
+    *v = value_of(l.bits * r.bits, rank);
+    return true;
+  case Slash:
+  case Percent: {
+    long min = rank_bits(rank) == 32 ? -2147483647L - 1 : LONG_MIN;
+    if (!r.bits || (is_signed && (long)l.bits == min && (long)r.bits == -1)) {
+      return false;
+    }
+    if (is_signed) {
+      long q = op == Slash ? (long)l.bits / (long)r.bits
+                           : (long)l.bits % (long)r.bits;
+      *v = value_of((unsigned long)q, rank);
+    } else {
+      *v = value_of(op == Slash ? l.bits / r.bits : l.bits % r.bits, rank);
+    }
+    return true;
+  }
+  case Amp:
+    *v = value_of(l.bits & r.bits, rank);
+    return true;
+  case Caret:
+    *v = value_of(l.bits ^ r.bits, rank);
+    return true;
+  case Bar:
+    *v = value_of(l.bits | r.bits, rank);
+    return true;
+  case Eq:
+    *v = value_of(l.bits == r.bits, IntR);
+    return true;
+  case Neq:
+    *v = value_of(l.bits != r.bits, IntR);
+    return true;
+  case Lt:
+  case Leq:
+  case Gt:
+  case Geq: {
+    int cmp;
+    if (is_signed) {
+      cmp = ((long)l.bits > (long)r.bits) - ((long)l.bits < (long)r.bits);
+    } else {
+      cmp = (l.bits > r.bits) - (l.bits < r.bits);
+    }
+    *v = value_of(op == Lt    ? cmp < 0
+                  : op == Leq ? cmp <= 0
+                  : op == Gt  ? cmp > 0
+                              : cmp >= 0,
+                  IntR);
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+/* Folds sizeof operand, which is not evaluated */
+bool fold_sizeof(struct folder *f, ast_node_t *operand, struct fold_value *v) {
+  struct layout *l;
+  type *t = NULL;
+
+  if (!operand) {
+    return false;
+  }
+  if (operand->kind == TypeName) {
+    fold_type(f, &operand->u.type_name);
+    t = &operand->u.type_name;
+  } else if (operand->kind == Expr && operand->u.expr.kind == CastExpr) {
+    /* a cast to char or short is not promoted */
+    t = &operand->u.expr.lhs->u.type_name;
+    fold_node(f, operand);
+  } else if (operand->kind == Lit && operand->u.lit.kind == StrLit) {
+    *v = value_of(strlen(operand->u.lit.string) + 1, ULongR);
+    return true;
+  }
+
+  if (t) {
+    if (!(l = type_layout(t, &f->scope))) {
+      return false;
+    }
+    *v = value_of(l->size, ULongR);
+    return true;
+  }
+  if (fold_expr(f, operand, v)) {
+    *v = value_of(rank_bits(v->rank) / CHAR_BIT, ULongR);
+    return true;
+  }
+  return false;
+}
+
+/* Sets v and returns true if node is an integer constant, once folded */
+bool fold_lit(ast_node_t *node, struct fold_value *v) {
+  ast_lit *lit;
+
+  if (!node || node->kind != Lit) {
+    return false;
+  }
+  lit = &node->u.lit;
+  switch (lit->kind) {
+  case DecLit:
+  case HexLit:
+  case OctLit:
+    *v = value_of(lit->integer, lit->is_long ? lit->is_unsigned ? ULongR
+                                                                : LongR
+                                : lit->is_unsigned ? UIntR
+                                                   : IntR);
+    return true;
+  case CharLit:
+    *v = value_of(char_value(lit->character), IntR);
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* sizeof is folded from its operand as a whole, casts included */
+bool fold_descends(ast_node_t *node) {
+  return node->u.expr.kind != PrefixExpr || node->u.expr.op != Sizeof;
+}
+
+/* Folds node in place, its operands already folded */
+void fold_op(struct folder *f, ast_node_t *node) {
+  ast_expr *e = &node->u.expr;
+  struct fold_value l, m, r, v;
+  bool l_const, m_const, r_const = false;
+
+  switch (node->kind) {
+  case Lit:
+    return;
+  case Ident: {
+    struct scope_entry *se =
+        scope_lookup(&f->scope, node->u.ident.name, OrdNs);
+    if (se && se->kind == ConstSym) {
+      fold_replace(node, value_of(se->value, IntR));
+    }
+    return;
+  }
+  case Expr:
+    break;
+  default:
+    fold_node(f, node);
+    return;
+  }
+
+  switch (e->kind) {
+  case PrefixExpr: {
+    if (e->op == Sizeof) {
+      r_const = fold_sizeof(f, e->rhs, &v);
+      break;
+    }
+    if (!(r_const = fold_lit(e->rhs, &r))) {
+      break;
+    }
+    switch (e->op) {
+    case Plus:
+      v = r;
+      break;
+    case Minus:
+      v = value_of(-r.bits, r.rank);
+      break;
+    case Tilde:
+      v = value_of(~r.bits, r.rank);
+      break;
+    case Exclaim:
+      v = value_of(!r.bits, IntR);
+      break;
+    default: /* ++, --, &, * */
+      r_const = false;
+      break;
+    }
+    break;
+  }
+  case CastExpr: {
+    r_const = fold_lit(e->rhs, &v) && value_cast(&e->lhs->u.type_name, &v);
+    break;
+  }
+  case InfixExpr: {
+    l_const = fold_lit(e->lhs, &l);
+    m_const = fold_lit(e->mhs, &m);
+    r_const = fold_lit(e->rhs, &r);
+    if (e->op == Question) {
+      r_const = l_const && m_const && r_const;
+      if (r_const) {
+        fold_rank rank = rank_common(m.rank, r.rank);
+        v = value_of(l.bits ? m.bits : r.bits, rank);
+      }
+    } else {
+      r_const = l_const && r_const && fold_infix(e->op, l, r, &v);
+    }
+    break;
+  }
+  default: /* postfix, call and comma, folded within */
+    break;
+  }
+
+  if (r_const) {
+    fold_replace(node, v);
+  }
+}
+
+/*
+ * Folds the constant subexpressions of node in place. Returns true and sets
+ * v if node is an integer constant expression. Operands are folded before
+ * the operators applying them, by a walk rather than by recursion.
+ */
+bool fold_expr(struct folder *f, ast_node_t *node, struct fold_value *v) {
+  struct expr_walk w;
+  ast_node_t *n;
+
+  expr_walk_init(&w, node, fold_descends);
+  while ((n = expr_walk_next(&w))) {
+    fold_op(f, n);
+  }
+  return fold_lit(node, v);
+}
+
+/*
+ * Declarations and statements
+ */
+
+void fold_decl(struct folder *f, ast_decl *d) {
+  fold_type(f, d->type);
+  fold_shadow(f, d->name);
+  if (d->init) {
+    fold_node(f, d->init);
+  }
+}
+
+void fold_stmt(struct folder *f, ast_stmt *s) {
+  int len = f->scope.len;
+  int i;
+
+  if (s->kind == BlockStmt) {
+    for (i = 0; i < s->inner->u.list.len; i++) {
+      fold_node(f, ast_list_at(s->inner, i));
+    }
+    scope_pop(&f->scope, len);
+    return;
+  }
+
+  if (s->case_expr) {
+    fold_node(f, s->case_expr);
+  }
+  if (s->init) {
+    fold_node(f, s->init);
+  }
+  if (s->cond) {
+    fold_node(f, s->cond);
+  }
+  if (s->iter) {
+    fold_node(f, s->iter);
+  }
+  if (s->inner && !(s->jump && s->jump->u.tok.kind == Goto)) { /* label */
+    fold_node(f, s->inner);
+  }
+  if (s->inner_else) {
+    fold_node(f, s->inner_else);
+  }
+}
+
+void fold_fn_defn(struct folder *f, ast_fn_defn *fn) {
+  type *t = fn->decl->type;
+  int len;
+  int i;
+
+  fold_type(f, t);
+  fold_shadow(f, fn->decl->name);
+  if (!fn->body) {
+    return;
+  }
+
+  len = f->scope.len;
+  for (; t && t->kind != FnT; t = t->inner) {
+  }
+  for (i = 0; t && i < t->fn_param_decls_len; i++) {
+    fold_shadow(f, t->fn_param_decls[i].u.decl.name);
+  }
+  fold_node(f, fn->body);
+  scope_pop(&f->scope, len);
+}
+
+void fold_node(struct folder *f, ast_node_t *node) {
+  struct fold_value v;
+  int i;
+
+  switch (node->kind) {
+  case Decl:
+    fold_decl(f, &node->u.decl);
+    break;
+  case FnDefn:
+    fold_fn_defn(f, &node->u.fn_defn);
+    break;
+  case Stmt:
+    fold_stmt(f, &node->u.stmt);
+    break;
+  case List:
+    for (i = 0; i < node->u.list.len; i++) {
+      fold_node(f, node->u.list.nodes[i]);
+    }
+    break;
+  case TypeName:
+    fold_type(f, &node->u.type_name);
+    break;
+  case Ident:
+  case Expr:
+    fold_expr(f, node, &v);
+    break;
+  default:
+    break;
+  }
+}
+
+void fold(struct unit *u) {
+  struct folder f;
+  int i;
+
+  scope_init(&f.scope);
+
+  for (i = 0; i < u->nodes_len; i++) {
+    fold_node(&f, u->nodes + i);
+  }
+  scope_free(&f.scope);
+}
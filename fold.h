@@ -0,0 +1,24 @@
+#ifndef CHOCC_FOLD_H
+#define CHOCC_FOLD_H
+#pragma once
+
+#include "chocc.h"
+#include "parse.h"
+#include "unit.h"
+
+/*
+ * Folds the integer constant expressions of the parsed unit u in place:
+ * literals, enum constants, sizeof, casts to integer types and the
+ * arithmetic, bitwise, relational, logical and conditional operators over
+ * them. Folded expressions become DecLit Lit nodes, enum constants get
+ * their values and array types get their sizes.
+ *
+ * Sizes are those of LP64 targets. Bodies not parsed yet, as with
+ * parse_lazy, are left as they are.
+ */
+void fold(struct unit *u);
+
+/* Returns the value of character constant c, as written between quotes */
+long char_value(const char *c);
+
+#endif
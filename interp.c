@@ -0,0 +1,2115 @@
+#include "interp.h"
+#include "check.h"
+#include "fold.h"
+#include "lex.h"
+#include "resolve.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* bytes of the call stack frames are allocated on */
+#define INTERP_STACK (64L << 20)
+
+/* bytes of C stack the tree walker may recurse into, of a usual 8 MiB */
+#define INTERP_C_STACK (6L << 20)
+
+/* kinds of names in interp.names */
+typedef enum name_kind { GlobalName, FnName } name_kind;
+
+void interp_fail(struct interp *in, const char *msg, const char *name) {
+  if (in && in->out) {
+    fflush(in->out);
+  }
+  if (name) {
+    printf("run: %s %s\n", msg, name);
+  } else {
+    printf("run: %s\n", msg);
+  }
+  exit(1);
+}
+
+/*
+ * Kinds
+ */
+
+long kind_size(val_kind k) {
+  switch (k) {
+  case I8V:
+  case U8V:
+    return 1;
+  case I16V:
+  case U16V:
+    return 2;
+  case I32V:
+  case U32V:
+  case F32V:
+    return 4;
+  default:
+    return 8;
+  }
+}
+
+val_kind val_kind_of(type *t) {
+  switch (t->kind) {
+  case NumericT: {
+    numeric_type *n = &t->numeric;
+    switch (n->base) {
+    case Char:
+      return n->is_unsigned ? U8V : I8V;
+    case Float:
+      return F32V;
+    case Double:
+      return F64V;
+    default:
+      if (n->is_short) {
+        return n->is_unsigned ? U16V : I16V;
+      }
+      if (n->is_long) {
+        return n->is_unsigned ? U64V : I64V;
+      }
+      return n->is_unsigned ? U32V : I32V;
+    }
+  }
+  case EnumT:
+    return I32V;
+  case PtrT:
+  case ArrT:
+  case FnT:
+    return PtrV;
+  case StructT:
+  case UnionT:
+    return AggV;
+  default:
+    return VoidV;
+  }
+}
+
+bool is_float_kind(val_kind k) { return k == F32V || k == F64V; }
+
+bool is_unsigned_kind(val_kind k) {
+  return k == U8V || k == U16V || k == U32V || k == U64V || k == PtrV;
+}
+
+bool is_int_kind(val_kind k) { return I8V <= k && k <= U64V; }
+
+/* Returns the kind of an integer operand after promotion */
+val_kind promote_kind(val_kind k) { return k < I32V ? I32V : k; }
+
+/* usual arithmetic conversions, pointers compare as unsigned long */
+val_kind common_kind(val_kind a, val_kind b) {
+  a = promote_kind(a);
+  b = promote_kind(b);
+  if (a == F64V || b == F64V) {
+    return F64V;
+  }
+  if (a == F32V || b == F32V) {
+    return F32V;
+  }
+  if (a == PtrV || b == PtrV) {
+    return PtrV;
+  }
+  if ((a == U32V && b == I64V) || (a == I64V && b == U32V)) {
+    return I64V;
+  }
+  return a > b ? a : b;
+}
+
+/* Returns whether every value of kind from is held the same in kind to */
+bool kind_fits(val_kind from, val_kind to) {
+  if (from == to || (from == F32V && to == F64V)) {
+    return true;
+  }
+  if (!is_int_kind(from) && from != PtrV) {
+    return false;
+  }
+  switch (to) {
+  case I64V:
+  case U64V:
+  case PtrV:
+    return true;
+  case I16V:
+    return from == I8V || from == U8V;
+  case U16V:
+    return from == U8V;
+  case I32V:
+    return from < I32V;
+  case U32V:
+    return from == U8V || from == U16V;
+  default:
+    return false;
+  }
+}
+
+/* Truncates v to integer kind k, extending it back to a long */
+long norm(val_kind k, long v) {
+  switch (k) {
+  case I8V:
+    return (signed char)v;
+  case U8V:
+    return (unsigned char)v;
+  case I16V:
+    return (short)v;
+  case U16V:
+    return (unsigned short)v;
+  case I32V:
+    return (int)v;
+  case U32V:
+    return (unsigned int)v;
+  default:
+    return v;
+  }
+}
+
+value convert(val_kind from, val_kind to, value v) {
+  if (is_float_kind(to)) {
+    if (!is_float_kind(from)) {
+      v.d = is_unsigned_kind(from) ? (double)(unsigned long)v.i : (double)v.i;
+    }
+    if (to == F32V) {
+      v.d = (float)v.d;
+    }
+    return v;
+  }
+  if (is_float_kind(from)) {
+    v.i = to == U64V ? (long)(unsigned long)v.d : (long)v.d;
+  }
+  v.i = norm(to, v.i);
+  return v;
+}
+
+value load(val_kind k, char *p) {
+  value v;
+  switch (k) {
+  case I8V:
+    v.i = *(signed char *)p;
+    break;
+  case U8V:
+    v.i = *(unsigned char *)p;
+    break;
+  case I16V:
+    v.i = *(short *)p;
+    break;
+  case U16V:
+    v.i = *(unsigned short *)p;
+    break;
+  case I32V:
+    v.i = *(int *)p;
+    break;
+  case U32V:
+    v.i = *(unsigned int *)p;
+    break;
+  case F32V:
+    v.d = *(float *)p;
+    break;
+  case F64V:
+    v.d = *(double *)p;
+    break;
+  case AggV:
+    v.i = (long)p;
+    break;
+  default:
+    v.i = *(long *)p;
+    break;
+  }
+  return v;
+}
+
+void store(val_kind k, char *p, value v) {
+  switch (k) {
+  case I8V:
+  case U8V:
+    *(char *)p = (char)v.i;
+    break;
+  case I16V:
+  case U16V:
+    *(short *)p = (short)v.i;
+    break;
+  case I32V:
+  case U32V:
+    *(int *)p = (int)v.i;
+    break;
+  case F32V:
+    *(float *)p = (float)v.d;
+    break;
+  case F64V:
+    *(double *)p = v.d;
+    break;
+  case VoidV:
+  case AggV:
+    break;
+  default:
+    *(long *)p = v.i;
+    break;
+  }
+}
+
+/*
+ * Builtins
+ */
+
+const char *builtin_names[] = {"",       "printf", "putchar", "puts",
+                               "malloc", "calloc", "free",    "memset",
+                               "memcpy", "strlen", "abs",     "sqrt",
+                               "fabs",   "exit"};
+
+builtin builtin_named(const char *name) {
+  int i;
+  for (i = PrintfB; i <= ExitB; i++) {
+    if (!strcmp(builtin_names[i], name)) {
+      return i;
+    }
+  }
+  return NoBuiltin;
+}
+
+val_kind builtin_kind(builtin b) {
+  switch (b) {
+  case MallocB:
+  case CallocB:
+  case MemsetB:
+  case MemcpyB:
+    return PtrV;
+  case StrlenB:
+    return U64V;
+  case SqrtB:
+  case FabsB:
+    return F64V;
+  case FreeB:
+  case ExitB:
+    return VoidV;
+  default:
+    return I32V;
+  }
+}
+
+int interp_printf(FILE *out, const char *fmt, value *args, int len,
+                  const char *mem, long mem_len) {
+  char spec[32];
+  int n = 0;
+  int arg = 0;
+  const char *s;
+
+  while (*fmt) {
+    const char *begin = fmt;
+    bool is_long = false;
+    int spec_len;
+
+    if (*fmt != '%') {
+      for (; *fmt && *fmt != '%'; fmt++) {
+      }
+      n += fwrite(begin, 1, fmt - begin, out);
+      continue;
+    }
+    if (fmt[1] == '%') {
+      fputc('%', out);
+      fmt += 2;
+      n++;
+      continue;
+    }
+
+    for (fmt++; *fmt && strchr("-+ #0123456789.", *fmt); fmt++) {
+    }
+    for (; *fmt == 'l' || *fmt == 'h'; fmt++) {
+      is_long = is_long || *fmt == 'l';
+    }
+    spec_len = fmt - begin + 1;
+    if (!*fmt || spec_len >= (int)sizeof(spec) - 2 || arg >= len) {
+      break;
+    }
+    memcpy(spec, begin, spec_len);
+    spec[spec_len] = '\0';
+
+    switch (*fmt) {
+    case 'd':
+    case 'i':
+      n += is_long ? fprintf(out, spec, args[arg].i)
+                   : fprintf(out, spec, (int)args[arg].i);
+      break;
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+      n += is_long ? fprintf(out, spec, (unsigned long)args[arg].i)
+                   : fprintf(out, spec, (unsigned int)args[arg].i);
+      break;
+    case 'c':
+      n += fprintf(out, spec, (int)args[arg].i);
+      break;
+    case 's':
+      s = (char *)args[arg].i;
+      if (mem) {
+        s = (unsigned long)args[arg].i < (unsigned long)mem_len &&
+                    memchr(mem + args[arg].i, 0, mem_len - args[arg].i)
+                ? mem + args[arg].i
+                : "(null)";
+      }
+      n += fprintf(out, spec, s);
+      break;
+    case 'p':
+      n += fprintf(out, spec, (void *)args[arg].i);
+      break;
+    case 'f':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+      n += fprintf(out, spec, args[arg].d);
+      break;
+    default:
+      n += fwrite(spec, 1, spec_len, out);
+      arg--;
+      break;
+    }
+    arg++;
+    fmt++;
+  }
+  return n;
+}
+
+/*
+ * Lowering
+ */
+
+struct inode *new_inode(inode_op op, val_kind kind) {
+  struct inode *n = calloc(1, sizeof(*n));
+  n->op = op;
+  n->kind = kind;
+  return n;
+}
+
+void inode_append(struct inode *n, struct inode *item) {
+  n->list = realloc(n->list, (n->len + 1) * sizeof(*n->list));
+  n->list[n->len++] = item;
+}
+
+struct inode *const_inode(long k, val_kind kind) {
+  struct inode *n = new_inode(ConstOp, kind);
+  n->k = k;
+  return n;
+}
+
+struct inode *unary(inode_op op, val_kind kind, struct inode *a) {
+  struct inode *n = new_inode(op, kind);
+  n->a = a;
+  return n;
+}
+
+struct inode *binary(inode_op op, val_kind kind, struct inode *a,
+                     struct inode *b) {
+  struct inode *n = new_inode(op, kind);
+  n->a = a;
+  n->b = b;
+  return n;
+}
+
+/* Converts the value of n from kind from to kind to */
+struct inode *conv(struct inode *n, val_kind from, val_kind to) {
+  struct inode *c;
+
+  if (to == VoidV || kind_fits(from, to)) {
+    return n;
+  }
+  if (n->op == ConstOp && !is_float_kind(to) && !is_float_kind(from)) {
+    return const_inode(norm(to, n->k), to);
+  }
+  c = unary(ConvOp, to, n);
+  c->x = from;
+  return c;
+}
+
+/* Returns whether evaluating n has no side effects */
+bool pure(struct inode *n) {
+  if (!n) {
+    return true;
+  }
+  switch (n->op) {
+  case StoreOp:
+  case StoreLocalOp:
+  case CopyOp:
+  case IncOp:
+  case IncLocalOp:
+  case CallOp:
+  case CallPtrOp:
+  case BuiltinOp:
+    return false;
+  default:
+    return pure(n->a) && pure(n->b) && pure(n->c);
+  }
+}
+
+/* Returns the type pointed to by a pointer or array type, or NULL */
+type *pointee(type *t) {
+  return t && (t->kind == PtrT || t->kind == ArrT) ? t->inner : NULL;
+}
+
+long inode_type_size(struct interp *in, type *t) {
+  struct layout *l = type_layout(t, &in->tags);
+  if (!l) {
+    interp_fail(in, "incomplete type", NULL);
+  }
+  return l->size;
+}
+
+/* Records an object of the frame of fn, a scalar if it holds one value */
+void add_slot(struct interp_fn *fn, long off, long size, bool scalar) {
+  struct frame_slot *s;
+
+  fn->slots = realloc(fn->slots, (fn->slots_len + 1) * sizeof(*fn->slots));
+  s = fn->slots + fn->slots_len++;
+  s->off = off;
+  s->size = size;
+  s->scalar = scalar;
+}
+
+/* Allocates size bytes aligned to align in the frame of the function */
+long frame_alloc(struct interp *in, long size, long align, bool scalar) {
+  long off = (in->frame_len + align - 1) / align * align;
+  in->frame_len = off + size;
+  if (in->frame_len > in->fn->frame_size) {
+    in->fn->frame_size = in->frame_len;
+  }
+  add_slot(in->fn, off, size, scalar);
+  return off;
+}
+
+/* Records the storage of a global, static or string literal */
+void add_object(struct interp *in, char *p, long size) {
+  if (in->objs_len == in->objs_cap) {
+    in->objs_cap = in->objs_cap ? in->objs_cap * 2 : 64;
+    in->objs = realloc(in->objs, in->objs_cap * sizeof(*in->objs));
+  }
+  in->objs[in->objs_len].p = p;
+  in->objs[in->objs_len++].size = size;
+}
+
+/* Appends the frame bytes [off, end) n or its operands address */
+void frame_taken(struct inode *n, long **ranges, int *len) {
+  int i;
+
+  if (!n) {
+    return;
+  }
+  if (n->op == LocalOp || n->op == ZeroOp) {
+    *ranges = realloc(*ranges, (*len + 2) * sizeof(long));
+    (*ranges)[(*len)++] = n->x;
+    (*ranges)[(*len)++] = n->x + (n->op == ZeroOp ? n->k : 1);
+  }
+  frame_taken(n->a, ranges, len);
+  frame_taken(n->b, ranges, len);
+  frame_taken(n->c, ranges, len);
+  frame_taken(n->d, ranges, len);
+  for (i = 0; i < n->len; i++) {
+    frame_taken(n->list[i], ranges, len);
+  }
+}
+
+bool *slot_promotable(struct interp_fn *fn) {
+  struct frame_slot *s = fn->slots;
+  bool *ok = malloc((fn->slots_len + 1) * sizeof(bool));
+  long *ranges = NULL;
+  int ranges_len = 0;
+  int i, j;
+
+  frame_taken(fn->body, &ranges, &ranges_len);
+  for (i = 0; i < fn->slots_len; i++) {
+    ok[i] = s[i].scalar;
+    for (j = 0; j < ranges_len && ok[i]; j += 2) {
+      if (ranges[j] < s[i].off + s[i].size && s[i].off < ranges[j + 1]) {
+        ok[i] = false;
+      }
+    }
+    /* a member of an aggregate of another block is read by offset too */
+    for (j = 0; j < fn->slots_len && ok[i]; j++) {
+      if (!s[j].scalar && s[j].off < s[i].off + s[i].size &&
+          s[i].off < s[j].off + s[j].size) {
+        ok[i] = false;
+      }
+    }
+  }
+  /* the scalars at an offset are held alike */
+  for (i = 0; i < fn->slots_len; i++) {
+    for (j = 0; j < fn->slots_len; j++) {
+      if (s[j].off == s[i].off && !ok[j]) {
+        ok[i] = false;
+      }
+    }
+  }
+  free(ranges);
+  return ok;
+}
+
+/* Returns whether objects of type t hold one value */
+bool is_scalar(type *t) {
+  return t->kind != ArrT && t->kind != StructT && t->kind != UnionT;
+}
+
+struct inode *lower_expr(struct interp *, ast_node_t *);
+struct inode *lower_addr(struct interp *, ast_node_t *);
+struct inode *lower_stmt(struct interp *, ast_node_t *);
+
+type *node_type(struct interp *in, ast_node_t *node) {
+  type *t = expr_type(node);
+  if (!t) {
+    interp_fail(in, "untyped expression",
+                node->kind == Ident ? node->u.ident.name : NULL);
+  }
+  return t;
+}
+
+val_kind node_kind(struct interp *in, ast_node_t *node) {
+  return val_kind_of(node_type(in, node));
+}
+
+/* Lowers node as a condition, true if its value.i is not 0 */
+struct inode *lower_cond(struct interp *in, ast_node_t *node) {
+  struct inode *n = lower_expr(in, node);
+  struct inode *zero;
+
+  if (!is_float_kind(n->kind)) {
+    return n;
+  }
+  zero = new_inode(FConstOp, F64V);
+  return binary(FNeOp, I32V, conv(n, n->kind, F64V), zero);
+}
+
+struct interp_fn *interp_find(struct interp *in, const char *name) {
+  struct scope_entry *e = scope_lookup(&in->names, name, OrdNs);
+  return e && e->kind == FnName ? e->ptr : NULL;
+}
+
+/* Returns the storage of the global or extern object named name */
+char *global_addr(struct interp *in, const char *name) {
+  struct scope_entry *e = scope_lookup(&in->names, name, OrdNs);
+  if (!e || e->kind != GlobalName) {
+    interp_fail(in, "undefined object", name);
+  }
+  return e->ptr;
+}
+
+struct inode *lower_ident_addr(struct interp *in, ast_node_t *node) {
+  int idx = node->u.ident.sym - 1;
+  struct symbol *sym = ident_sym(in->unit, node);
+  struct inode *n;
+
+  if (!sym) {
+    interp_fail(in, "undeclared", node->u.ident.name);
+  }
+  switch (sym->kind) {
+  case ParamSym:
+  case LocalSym:
+    n = new_inode(LocalOp, PtrV);
+    n->x = in->sym_off[idx];
+    return n;
+  case GlobalSym:
+  case StaticSym:
+    if (!in->sym_addr[idx]) {
+      in->sym_addr[idx] = global_addr(in, node->u.ident.name);
+    }
+    n = new_inode(GlobalOp, PtrV);
+    n->p = in->sym_addr[idx];
+    return n;
+  case FnSym:
+    n = new_inode(FnOp, PtrV);
+    if (!(n->fn = interp_find(in, node->u.ident.name))) {
+      interp_fail(in, "undefined function", node->u.ident.name);
+    }
+    return n;
+  default:
+    interp_fail(in, "not an object", node->u.ident.name);
+    return NULL;
+  }
+}
+
+/* Loads a value of type t from address a, leaving arrays and aggregates */
+struct inode *load_from(struct inode *a, type *t) {
+  struct inode *n;
+
+  if (t->kind == ArrT || t->kind == FnT || t->kind == StructT ||
+      t->kind == UnionT) {
+    return a;
+  }
+  if (a->op == LocalOp) {
+    n = new_inode(LoadLocalOp, val_kind_of(t));
+    n->x = a->x;
+    return n;
+  }
+  return unary(LoadOp, val_kind_of(t), a);
+}
+
+/* Stores b of type t at address a, yielding it */
+struct inode *store_to(struct interp *in, struct inode *a, struct inode *b,
+                       type *t) {
+  val_kind k = val_kind_of(t);
+  struct inode *n;
+
+  if (k == AggV) {
+    n = binary(CopyOp, AggV, a, b);
+    n->k = inode_type_size(in, t);
+    return n;
+  }
+  if (a->op == LocalOp) {
+    n = unary(StoreLocalOp, k, NULL);
+    n->b = b;
+    n->x = a->x;
+    return n;
+  }
+  return binary(StoreOp, k, a, b);
+}
+
+/* Returns the address of member name of the aggregate at a of type t */
+struct inode *member_addr(struct interp *in, struct inode *a, type *t,
+                          ast_node_t *name) {
+  int i = type_member(t, &in->tags, name->u.ident.name);
+  long off;
+  struct inode *n;
+
+  if (i < 0) {
+    interp_fail(in, "no member", name->u.ident.name);
+  }
+  off = type_layout(type_complete(t, &in->tags), &in->tags)->offsets[i];
+  if (!off) {
+    return a;
+  }
+  if (a->op == LocalOp || a->op == GlobalOp) {
+    n = new_inode(a->op, PtrV);
+    n->x = a->x + off;
+    n->p = a->p ? a->p + off : NULL;
+    return n;
+  }
+  n = binary(PtrAddOp, PtrV, a, const_inode(off, I64V));
+  n->k = 1;
+  return n;
+}
+
+struct inode *index_addr(struct interp *in, ast_expr *e) {
+  type *lt = node_type(in, e->lhs);
+  type *rt = node_type(in, e->rhs);
+  struct inode *l = lower_expr(in, e->lhs);
+  struct inode *r = lower_expr(in, e->rhs);
+  struct inode *n;
+
+  if (!pointee(lt)) {
+    /* i[a] */
+    struct inode *tmp = l;
+    type *tmp_t = lt;
+    l = r;
+    r = tmp;
+    lt = rt;
+    rt = tmp_t;
+  }
+  n = binary(PtrAddOp, PtrV, l, conv(r, val_kind_of(rt), I64V));
+  n->k = inode_type_size(in, pointee(lt));
+  return n;
+}
+
+struct inode *lower_addr(struct interp *in, ast_node_t *node) {
+  ast_expr *e = &node->u.expr;
+
+  switch (node->kind) {
+  case Ident:
+    return lower_ident_addr(in, node);
+  case Lit:
+    return lower_expr(in, node);
+  case Expr:
+    break;
+  default:
+    interp_fail(in, "not an lvalue", NULL);
+  }
+
+  if (e->kind == PrefixExpr && e->op == Star) {
+    return lower_expr(in, e->rhs);
+  }
+  if (e->kind == PostfixExpr && e->op == LBrack) {
+    return index_addr(in, e);
+  }
+  if (e->kind == PostfixExpr && e->op == Dot) {
+    return member_addr(in, lower_addr(in, e->lhs), node_type(in, e->lhs),
+                       e->rhs);
+  }
+  if (e->kind == PostfixExpr && e->op == Arrow) {
+    return member_addr(in, lower_expr(in, e->lhs),
+                       pointee(node_type(in, e->lhs)), e->rhs);
+  }
+  if (node_kind(in, node) == AggV) {
+    return lower_expr(in, node);
+  }
+  interp_fail(in, "not an lvalue", NULL);
+  return NULL;
+}
+
+/* Returns the string literal c, as written between the quotes, decoded */
+char *decode_str(const char *c) {
+  char *s = malloc(strlen(c) + 1);
+  int len = 0;
+  int i;
+
+  while (*c) {
+    if (*c != '\\') {
+      s[len++] = *c++;
+      continue;
+    }
+    s[len++] = char_value(c++);
+    if (*c == 'x') {
+      for (c++; isxdigit((unsigned char)*c); c++) {
+      }
+    } else if ('0' <= *c && *c <= '7') {
+      for (i = 0; i < 3 && '0' <= *c && *c <= '7'; i++, c++) {
+      }
+    } else if (*c) {
+      c++;
+    }
+  }
+  s[len] = '\0';
+  return s;
+}
+
+struct inode *lower_lit(struct interp *in, ast_node_t *node) {
+  ast_lit *lit = &node->u.lit;
+  struct inode *n;
+
+  switch (lit->kind) {
+  case DecLit:
+  case HexLit:
+  case OctLit:
+    return const_inode(lit->integer, node_kind(in, node));
+  case CharLit:
+    return const_inode(char_value(lit->character), I32V);
+  case FloatingLit:
+    n = new_inode(FConstOp, lit->is_float ? F32V : F64V);
+    n->f = lit->floating;
+    return n;
+  case StrLit:
+    /* decoded once, shared by every evaluation */
+    n = new_inode(GlobalOp, PtrV);
+    n->p = decode_str(lit->string);
+    add_object(in, n->p, strlen(n->p) + 1);
+    return n;
+  }
+  return NULL;
+}
+
+struct inode *lower_ident(struct interp *in, ast_node_t *node) {
+  struct symbol *sym = ident_sym(in->unit, node);
+
+  if (sym && sym->kind == EnumSym) {
+    return const_inode(sym->value, I32V);
+  }
+  if (sym && sym->kind == FnSym) {
+    return lower_ident_addr(in, node);
+  }
+  return load_from(lower_ident_addr(in, node), node_type(in, node));
+}
+
+/*
+ * Lowers op over l of type lt and r of type rt, both after decay, as in an
+ * infix or compound assignment expression.
+ */
+struct inode *lower_arith(struct interp *in, token_kind_t op, struct inode *l,
+                          type *lt, struct inode *r, type *rt) {
+  val_kind lk = val_kind_of(lt), rk = val_kind_of(rt);
+  val_kind k = common_kind(lk, rk);
+  bool f = is_float_kind(k), u = is_unsigned_kind(k);
+  inode_op iop;
+  struct inode *n;
+
+  switch (op) {
+  case Plus:
+  case PlusAssn:
+    if (pointee(lt) || pointee(rt)) {
+      if (!pointee(lt)) {
+        n = binary(PtrAddOp, PtrV, r, conv(l, lk, I64V));
+        n->k = inode_type_size(in, pointee(rt));
+        return n;
+      }
+      n = binary(PtrAddOp, PtrV, l, conv(r, rk, I64V));
+      n->k = inode_type_size(in, pointee(lt));
+      return n;
+    }
+    iop = f ? FAddOp : AddOp;
+    break;
+  case Minus:
+  case MinusAssn:
+    if (pointee(lt) && pointee(rt)) {
+      n = binary(PtrDiffOp, I64V, l, r);
+      n->k = inode_type_size(in, pointee(lt));
+      return n;
+    }
+    if (pointee(lt)) {
+      n = binary(PtrAddOp, PtrV, l,
+                 unary(NegOp, I64V, conv(r, rk, I64V)));
+      n->k = inode_type_size(in, pointee(lt));
+      return n;
+    }
+    iop = f ? FSubOp : SubOp;
+    break;
+  case Star:
+  case StarAssn:
+    iop = f ? FMulOp : MulOp;
+    break;
+  case Slash:
+  case SlashAssn:
+    iop = f ? FDivOp : u ? UDivOp : DivOp;
+    break;
+  case Percent:
+  case PercentAssn:
+    iop = u ? UModOp : ModOp;
+    break;
+  case Amp:
+  case AmpAssn:
+    iop = AndOp;
+    break;
+  case Bar:
+  case BarAssn:
+    iop = OrOp;
+    break;
+  case Caret:
+  case CaretAssn:
+    iop = XorOp;
+    break;
+  case LShft:
+  case LShftAssn:
+  case RShft:
+  case RShftAssn:
+    k = promote_kind(lk);
+    iop = op == LShft || op == LShftAssn ? ShlOp
+          : is_unsigned_kind(k)          ? UShrOp
+                                         : ShrOp;
+    return binary(iop, k, conv(l, lk, k), r);
+  case Eq:
+  case Neq:
+  case Lt:
+  case Leq:
+  case Gt:
+  case Geq: {
+    l = conv(l, lk, k);
+    r = conv(r, rk, k);
+    if (op == Gt || op == Geq) {
+      /* a > b is b < a */
+      struct inode *tmp = l;
+      l = r;
+      r = tmp;
+    }
+    switch (op) {
+    case Eq:
+      iop = f ? FEqOp : EqOp;
+      break;
+    case Neq:
+      iop = f ? FNeOp : NeOp;
+      break;
+    case Lt:
+    case Gt:
+      iop = f ? FLtOp : u ? ULtOp : LtOp;
+      break;
+    default:
+      iop = f ? FLeOp : u ? ULeOp : LeOp;
+      break;
+    }
+    return binary(iop, I32V, l, r);
+  }
+  default:
+    interp_fail(in, "unsupported operator", token_kind_map[op]);
+    return NULL;
+  }
+  return binary(iop, k, conv(l, lk, k), conv(r, rk, k));
+}
+
+/* Returns a pointer type to t, for decay */
+type *decayed(type *t) {
+  type *p;
+  if (t->kind != ArrT && t->kind != FnT) {
+    return t;
+  }
+  p = calloc(1, sizeof(*p));
+  p->kind = PtrT;
+  p->inner = t->kind == ArrT ? t->inner : t;
+  return p;
+}
+
+struct inode *lower_assign(struct interp *in, ast_expr *e) {
+  type *lt = node_type(in, e->lhs);
+  type *rt = decayed(node_type(in, e->rhs));
+  val_kind lk = val_kind_of(lt);
+  struct inode *a = lower_addr(in, e->lhs);
+  struct inode *r = lower_expr(in, e->rhs);
+  struct inode *first = NULL;
+  struct inode *n;
+
+  if (e->op == Assn) {
+    return store_to(in, a, lk == AggV ? r : conv(r, val_kind_of(rt), lk), lt);
+  }
+
+  if (!pure(a)) {
+    /* the address is evaluated once, into a frame temporary */
+    long off = frame_alloc(in, 8, 8, true);
+    first = unary(StoreLocalOp, PtrV, NULL);
+    first->b = a;
+    first->x = off;
+    a = new_inode(LoadLocalOp, PtrV);
+    a->x = off;
+  }
+  n = lower_arith(in, e->op, load_from(a, lt), lt, r, rt);
+  n = store_to(in, a, conv(n, n->kind, lk), lt);
+  return first ? binary(SeqOp, lk, first, n) : n;
+}
+
+struct inode *lower_inc(struct interp *in, ast_node_t *node, int delta,
+                        bool post) {
+  type *t = node_type(in, node);
+  struct inode *a = lower_addr(in, node);
+  struct inode *n;
+
+  if (a->op == LocalOp) {
+    n = new_inode(IncLocalOp, val_kind_of(t));
+    n->x = a->x;
+  } else {
+    n = unary(IncOp, val_kind_of(t), a);
+  }
+  n->post = post;
+  n->k = pointee(t) ? delta * inode_type_size(in, pointee(t)) : delta;
+  n->f = delta;
+  return n;
+}
+
+/* Appends the arguments of call e to n, converted to the kinds of params */
+void lower_args(struct interp *in, struct inode *n, ast_expr *e,
+                type *fn_type) {
+  ast_node_t *args = e->rhs;
+  int len = 0;
+  int params = 0;
+  int i;
+
+  if (args && args->kind == Expr && args->u.expr.kind == CommaExpr) {
+    len = args->u.expr.mhs_len;
+    args = args->u.expr.mhs;
+  } else if (args) {
+    len = 1;
+  }
+  if (fn_type) {
+    params = fn_type->fn_param_decls_len;
+    if (params == 1 && fn_type->fn_param_decls->u.decl.type->kind == VoidT) {
+      params = 0;
+    }
+  }
+
+  for (i = 0; i < len; i++) {
+    struct inode *arg = lower_expr(in, args + i);
+    val_kind k = arg->kind;
+
+    if (i < params) {
+      type *pt = fn_type->fn_param_decls[i].u.decl.type;
+      k = val_kind_of(pt);
+      arg = conv(arg, val_kind_of(decayed(node_type(in, args + i))), k);
+      if (n->op == CallPtrOp && arg->kind != k && k != AggV) {
+        /* callees through pointers may be typed by exactly these kinds */
+        arg = unary(ConvOp, k, arg);
+        arg->x = arg->a->kind;
+      }
+    } else if (k == F32V) {
+      arg = conv(arg, F32V, F64V);
+    }
+    inode_append(n, arg);
+  }
+}
+
+/* Returns the function type of a definition's declaration */
+type *fn_type_of(type *t) {
+  for (; t && t->kind != FnT; t = t->inner) {
+  }
+  return t;
+}
+
+struct inode *lower_call(struct interp *in, ast_node_t *node) {
+  ast_expr *e = &node->u.expr;
+  struct symbol *sym = NULL;
+  struct inode *n;
+  type *t;
+
+  if (e->lhs->kind == Ident) {
+    sym = ident_sym(in->unit, e->lhs);
+  }
+
+  if (e->lhs->kind == Ident && (!sym || sym->kind == FnSym)) {
+    const char *name = e->lhs->u.ident.name;
+    struct interp_fn *fn = interp_find(in, name);
+    builtin b;
+
+    if (fn) {
+      n = new_inode(CallOp, fn->ret_kind);
+      n->fn = fn;
+      lower_args(in, n, e, fn_type_of(fn->defn->decl->type));
+      if (n->len != fn->params_len) {
+        interp_fail(in, "wrong number of arguments to", name);
+      }
+    } else if ((b = builtin_named(name))) {
+      n = new_inode(BuiltinOp, builtin_kind(b));
+      n->k = b;
+      /* a prototype, as from an #include, converts the args */
+      lower_args(in, n, e, sym && sym->decl ? fn_type_of(sym->decl->type)
+                                            : NULL);
+      if (n->len > BUILTIN_ARGS) {
+        interp_fail(in, "too many arguments to", name);
+      }
+    } else {
+      interp_fail(in, "undefined function", name);
+      return NULL;
+    }
+  } else {
+    t = decayed(node_type(in, e->lhs));
+    if (!pointee(t) || t->inner->kind != FnT) {
+      interp_fail(in, "call of a non-function", NULL);
+    }
+    t = t->inner;
+    n = new_inode(CallPtrOp, val_kind_of(t->inner));
+    n->a = lower_expr(in, e->lhs);
+    lower_args(in, n, e, t);
+  }
+
+  /* implicitly declared functions are typed int by check */
+  t = expr_type(node);
+  return t && t->kind != VoidT ? conv(n, n->kind, val_kind_of(t)) : n;
+}
+
+struct inode *lower_prefix(struct interp *in, ast_node_t *node) {
+  ast_expr *e = &node->u.expr;
+  val_kind k = node_kind(in, node);
+  struct inode *r;
+
+  switch (e->op) {
+  case Sizeof:
+    return const_inode(inode_type_size(in, e->rhs->kind == TypeName
+                                               ? &e->rhs->u.type_name
+                                               : node_type(in, e->rhs)),
+                       U64V);
+  case Amp:
+    return lower_addr(in, e->rhs);
+  case Star:
+    return load_from(lower_expr(in, e->rhs), node_type(in, node));
+  case PlusPlus:
+  case MinusMinus:
+    return lower_inc(in, e->rhs, e->op == PlusPlus ? 1 : -1, false);
+  case Exclaim:
+    return unary(NotOp, I32V, lower_cond(in, e->rhs));
+  default:
+    break;
+  }
+
+  r = lower_expr(in, e->rhs);
+  r = conv(r, r->kind, k);
+  switch (e->op) {
+  case Minus:
+    return unary(is_float_kind(k) ? FNegOp : NegOp, k, r);
+  case Tilde:
+    return unary(ComplOp, k, r);
+  default: /* + */
+    return r;
+  }
+}
+
+struct inode *lower_infix(struct interp *in, ast_node_t *node) {
+  ast_expr *e = &node->u.expr;
+  val_kind k;
+  struct inode *n;
+
+  switch (e->op) {
+  case Assn:
+  case PlusAssn:
+  case MinusAssn:
+  case StarAssn:
+  case SlashAssn:
+  case PercentAssn:
+  case LShftAssn:
+  case RShftAssn:
+  case AmpAssn:
+  case CaretAssn:
+  case BarAssn:
+    return lower_assign(in, e);
+  case AmpAmp:
+  case BarBar:
+    return binary(e->op == AmpAmp ? LogAndOp : LogOrOp, I32V,
+                  lower_cond(in, e->lhs), lower_cond(in, e->rhs));
+  case Question: {
+    type *t = expr_type(node);
+    k = t ? val_kind_of(t) : VoidV;
+    n = new_inode(CondOp, k);
+    n->a = lower_cond(in, e->lhs);
+    n->b = lower_expr(in, e->mhs);
+    n->c = lower_expr(in, e->rhs);
+    n->b = conv(n->b, n->b->kind, k);
+    n->c = conv(n->c, n->c->kind, k);
+    return n;
+  }
+  default:
+    return lower_arith(in, e->op, lower_expr(in, e->lhs),
+                       decayed(node_type(in, e->lhs)), lower_expr(in, e->rhs),
+                       decayed(node_type(in, e->rhs)));
+  }
+}
+
+/*
+ * Lowers expression node to a node yielding its value, the address for
+ * arrays, functions and aggregates.
+ */
+struct inode *lower_expr(struct interp *in, ast_node_t *node) {
+  ast_expr *e = &node->u.expr;
+  struct inode *n;
+  int i;
+
+  switch (node->kind) {
+  case Lit:
+    return lower_lit(in, node);
+  case Ident:
+    return lower_ident(in, node);
+  case Expr:
+    break;
+  default:
+    interp_fail(in, "not an expression", NULL);
+  }
+
+  switch (e->kind) {
+  case PrefixExpr:
+    return lower_prefix(in, node);
+  case PostfixExpr:
+    if (e->op == PlusPlus || e->op == MinusMinus) {
+      return lower_inc(in, e->lhs, e->op == PlusPlus ? 1 : -1, true);
+    }
+    return load_from(lower_addr(in, node), node_type(in, node));
+  case CallExpr:
+    return lower_call(in, node);
+  case InfixExpr:
+    return lower_infix(in, node);
+  case CastExpr: {
+    type *t = &e->lhs->u.type_name;
+    n = lower_expr(in, e->rhs);
+    return t->kind == VoidT ? n : conv(n, n->kind, val_kind_of(t));
+  }
+  case CommaExpr:
+    n = lower_expr(in, e->mhs);
+    for (i = 1; i < e->mhs_len; i++) {
+      struct inode *r = lower_expr(in, e->mhs + i);
+      n = binary(SeqOp, r->kind, n, r);
+    }
+    return n;
+  }
+  return NULL;
+}
+
+/*
+ * Declarations
+ */
+
+/* Sets the size of an array declared without one from its initializer */
+void size_from_init(type *t, ast_node_t *init) {
+  if (t->kind != ArrT || t->arr_size || !init) {
+    return;
+  }
+  if (init->kind == List) {
+    t->arr_size = init->u.list.len;
+  } else if (init->kind == Lit && init->u.lit.kind == StrLit) {
+    /* counted decoded, with its NUL */
+    char *s = decode_str(init->u.lit.string);
+    t->arr_size = strlen(s) + 1;
+    free(s);
+  }
+}
+
+/* Returns a LocalOp or GlobalOp off bytes past base */
+struct inode *offset_addr(struct inode *base, long off) {
+  struct inode *n = new_inode(base->op, PtrV);
+  n->x = base->x + off;
+  n->p = base->p ? base->p + off : NULL;
+  return n;
+}
+
+/*
+ * Appends to block the stores initializing the object of type t at base,
+ * which is already zeroed.
+ */
+void lower_init(struct interp *in, struct inode *block, struct inode *base,
+                type *t, ast_node_t *init) {
+  int i;
+
+  if (init->kind == Lit && init->u.lit.kind == StrLit && t->kind == ArrT) {
+    struct inode *s = lower_lit(in, init);
+    struct inode *n = binary(CopyOp, AggV, base, s);
+    n->k = strlen(s->p) + 1;
+    if (n->k > t->arr_size) {
+      n->k = t->arr_size;
+    }
+    inode_append(block, unary(ExprOp, VoidV, n));
+    return;
+  }
+
+  if (init->kind != List) {
+    struct inode *r = lower_expr(in, init);
+    val_kind k = val_kind_of(t);
+    if (k != AggV) {
+      r = conv(r, val_kind_of(decayed(node_type(in, init))), k);
+    }
+    inode_append(block, unary(ExprOp, VoidV, store_to(in, base, r, t)));
+    return;
+  }
+
+  if (t->kind == ArrT) {
+    long size = inode_type_size(in, t->inner);
+    for (i = 0; i < init->u.list.len && i < t->arr_size; i++) {
+      lower_init(in, block, offset_addr(base, i * size), t->inner,
+                 ast_list_at(init, i));
+    }
+  } else if (t->kind == StructT || t->kind == UnionT) {
+    type *def = type_complete(t, &in->tags);
+    struct layout *l = type_layout(def, &in->tags);
+    ast_node_t *fields = def->struct_fields;
+    int len = t->kind == UnionT ? 1 : fields->u.list.len;
+
+    for (i = 0; i < init->u.list.len && i < len; i++) {
+      lower_init(in, block, offset_addr(base, l->offsets[i]),
+                 ast_list_at(fields, i)->u.decl.type, ast_list_at(init, i));
+    }
+  } else if (init->u.list.len) {
+    lower_init(in, block, base, t, ast_list_at(init, 0));
+  }
+}
+
+/* Adds the initializer of a global or static object to the program's */
+void lower_global_init(struct interp *in, char *addr, ast_decl *d) {
+  struct inode *block, *base;
+
+  if (!d->init) {
+    return;
+  }
+  block = new_inode(BlockOp, VoidV);
+  base = new_inode(GlobalOp, PtrV);
+  base->p = addr;
+  lower_init(in, block, base, d->type, d->init);
+
+  if (in->inits_len == in->inits_cap) {
+    in->inits_cap = in->inits_cap ? in->inits_cap * 2 : 16;
+    in->inits = realloc(in->inits, in->inits_cap * sizeof(*in->inits));
+  }
+  in->inits[in->inits_len++] = block;
+}
+
+struct inode *lower_local(struct interp *in, ast_decl *d) {
+  int idx;
+  struct symbol *sym;
+  struct layout *l;
+  struct inode *block, *base;
+
+  declare_tags(d->type, &in->tags);
+  if (!d->name) {
+    return new_inode(NopOp, VoidV);
+  }
+  idx = d->name->u.ident.sym - 1;
+  sym = in->unit->syms + idx;
+
+  switch (sym->kind) {
+  case StaticSym:
+    if (d->type->store_class == Static) {
+      size_from_init(d->type, d->init);
+      l = type_layout(d->type, &in->tags);
+      if (!l) {
+        interp_fail(in, "incomplete type of", d->name->u.ident.name);
+      }
+      in->sym_addr[idx] = calloc(1, l->size);
+      add_object(in, in->sym_addr[idx], l->size);
+      lower_global_init(in, in->sym_addr[idx], d);
+    }
+    return new_inode(NopOp, VoidV);
+  case LocalSym:
+    break;
+  default:
+    return new_inode(NopOp, VoidV);
+  }
+
+  size_from_init(d->type, d->init);
+  if (!(l = type_layout(d->type, &in->tags))) {
+    interp_fail(in, "incomplete type of", d->name->u.ident.name);
+  }
+  in->sym_off[idx] = frame_alloc(in, l->size, l->align, is_scalar(d->type));
+  if (!d->init) {
+    return new_inode(NopOp, VoidV);
+  }
+
+  block = new_inode(BlockOp, VoidV);
+  base = new_inode(LocalOp, PtrV);
+  base->x = in->sym_off[idx];
+  if (d->init->kind == List || d->type->kind == ArrT) {
+    struct inode *zero = new_inode(ZeroOp, VoidV);
+    zero->x = base->x;
+    zero->k = l->size;
+    inode_append(block, zero);
+  }
+  lower_init(in, block, base, d->type, d->init);
+  return block->len == 1 ? block->list[0] : block;
+}
+
+/*
+ * Statements
+ */
+
+struct inode *lower_body(struct interp *, ast_node_t *);
+
+/* Lowers the items of a switch body, recording its case labels */
+struct inode *lower_switch(struct interp *in, ast_stmt *s) {
+  struct inode *n = new_inode(SwitchOp, VoidV);
+  ast_node_t *body = s->inner;
+  long frame_len = in->frame_len;
+  int tags_len = in->tags.len;
+  int len = 1;
+  int i;
+
+  n->a = lower_expr(in, s->cond);
+  n->kind = promote_kind(n->a->kind);
+  n->a = conv(n->a, n->a->kind, n->kind);
+  n->d = new_inode(BlockOp, VoidV);
+  n->default_at = -1;
+
+  if (body->kind == Stmt && body->u.stmt.kind == BlockStmt) {
+    len = body->u.stmt.inner->u.list.len;
+  }
+  for (i = 0; i < len; i++) {
+    ast_node_t *item = len == 1 && body->u.stmt.kind != BlockStmt
+                           ? body
+                           : ast_list_at(body->u.stmt.inner, i);
+    ast_stmt *label = &item->u.stmt;
+
+    if (item->kind == Stmt && label->kind == LabelStmt &&
+        label->label->kind == Tok) {
+      if (label->case_expr) {
+        if (label->case_expr->kind != Lit) {
+          interp_fail(in, "non-constant case", NULL);
+        }
+        n->cases = realloc(n->cases, (n->cases_len + 1) * sizeof(long));
+        n->case_at = realloc(n->case_at, (n->cases_len + 1) * sizeof(int));
+        n->cases[n->cases_len] =
+            norm(n->kind, lower_lit(in, label->case_expr)->k);
+        n->case_at[n->cases_len++] = n->d->len;
+      } else {
+        n->default_at = n->d->len;
+      }
+      continue;
+    }
+    inode_append(n->d, lower_body(in, item));
+  }
+  if (n->default_at < 0) {
+    n->default_at = n->d->len;
+  }
+
+  in->frame_len = frame_len;
+  scope_pop(&in->tags, tags_len);
+  return n;
+}
+
+struct inode *lower_stmt(struct interp *in, ast_node_t *node) {
+  ast_stmt *s = &node->u.stmt;
+  struct inode *n;
+  int i;
+
+  if (node->kind == Decl) {
+    return lower_local(in, &node->u.decl);
+  }
+
+  switch (s->kind) {
+  case LabelStmt:
+    if (s->label->kind == Tok) {
+      interp_fail(in, "case label outside the body of its switch", NULL);
+    }
+    /* without goto, a label is only a name */
+    return new_inode(NopOp, VoidV);
+  case BlockStmt: {
+    long frame_len = in->frame_len;
+    int tags_len = in->tags.len;
+
+    n = new_inode(BlockOp, VoidV);
+    for (i = 0; i < s->inner->u.list.len; i++) {
+      inode_append(n, lower_body(in, ast_list_at(s->inner, i)));
+    }
+    in->frame_len = frame_len;
+    scope_pop(&in->tags, tags_len);
+    return n;
+  }
+  case ExprStmt:
+    if (!s->inner) {
+      return new_inode(NopOp, VoidV);
+    }
+    return unary(ExprOp, VoidV, lower_expr(in, s->inner));
+  case IfStmt:
+  case IfElseStmt:
+    n = unary(IfOp, VoidV, lower_cond(in, s->cond));
+    n->b = lower_body(in, s->inner);
+    n->c = s->inner_else ? lower_body(in, s->inner_else) : NULL;
+    return n;
+  case SwitchStmt:
+    return lower_switch(in, s);
+  case WhileStmt:
+  case DoWhileStmt:
+    n = unary(s->kind == WhileStmt ? WhileOp : DoOp, VoidV,
+              lower_cond(in, s->cond));
+    n->b = lower_body(in, s->inner);
+    return n;
+  case ForStmt:
+    n = new_inode(ForOp, VoidV);
+    n->a = s->init ? lower_expr(in, s->init) : NULL;
+    n->b = s->cond ? lower_cond(in, s->cond) : NULL;
+    n->c = s->iter ? lower_expr(in, s->iter) : NULL;
+    n->d = lower_body(in, s->inner);
+    return n;
+  case JumpStmt:
+    switch (s->jump->u.tok.kind) {
+    case Break:
+      return new_inode(BreakOp, VoidV);
+    case Continue:
+      return new_inode(ContinueOp, VoidV);
+    case Return:
+      n = new_inode(ReturnOp, in->fn->ret_kind);
+      if (s->inner) {
+        n->a = lower_expr(in, s->inner);
+        n->a = conv(n->a, n->a->kind, n->kind);
+      }
+      return n;
+    default:
+      interp_fail(in, "goto is not supported", NULL);
+    }
+  }
+  return NULL;
+}
+
+/* Lowers a statement or declaration */
+struct inode *lower_body(struct interp *in, ast_node_t *node) {
+  if (node->kind == Stmt || node->kind == Decl) {
+    return lower_stmt(in, node);
+  }
+  return unary(ExprOp, VoidV, lower_expr(in, node));
+}
+
+/*
+ * Loading
+ */
+
+/* Declares fn, laying out its params at the bottom of its frame */
+void load_fn(struct interp *in, ast_fn_defn *defn) {
+  struct interp_fn *fn = calloc(1, sizeof(*fn));
+  type *t = fn_type_of(defn->decl->type);
+  struct scope_entry *e;
+  long off = 0;
+  int i;
+
+  fn->name = defn->decl->name->u.ident.name;
+  fn->id = in->fns_len;
+  fn->defn = defn;
+  fn->ret_kind = val_kind_of(t->inner);
+  if (fn->ret_kind == AggV) {
+    interp_fail(in, "struct return is not supported in", fn->name);
+  }
+
+  fn->params_len = t->fn_param_decls_len;
+  if (fn->params_len == 1 &&
+      t->fn_param_decls->u.decl.type->kind == VoidT) {
+    fn->params_len = 0;
+  }
+  fn->param_off = calloc(fn->params_len + 1, sizeof(long));
+  fn->param_kind = calloc(fn->params_len + 1, sizeof(val_kind));
+  fn->param_size = calloc(fn->params_len + 1, sizeof(long));
+  for (i = 0; i < fn->params_len; i++) {
+    ast_decl *p = &t->fn_param_decls[i].u.decl;
+    struct layout *l = type_layout(decayed(p->type), &in->tags);
+
+    if (!l) {
+      interp_fail(in, "incomplete param type in", fn->name);
+    }
+    off = (off + l->align - 1) / l->align * l->align;
+    fn->param_off[i] = off;
+    fn->param_kind[i] = val_kind_of(p->type);
+    fn->param_size[i] = l->size;
+    add_slot(fn, off, l->size, fn->param_kind[i] != AggV);
+    if (p->name && p->name->u.ident.sym) {
+      in->sym_off[p->name->u.ident.sym - 1] = off;
+    }
+    off += l->size;
+  }
+  fn->frame_size = off;
+
+  if (in->fns_len == in->fns_cap) {
+    in->fns_cap = in->fns_cap ? in->fns_cap * 2 : 16;
+    in->fns = realloc(in->fns, in->fns_cap * sizeof(*in->fns));
+  }
+  in->fns[in->fns_len++] = fn;
+
+  e = scope_lookup(&in->names, fn->name, OrdNs);
+  if (e && e->kind == FnName) {
+    interp_fail(in, "redefinition of", fn->name);
+  }
+  e = scope_push(&in->names, fn->name, OrdNs);
+  e->kind = FnName;
+  e->ptr = fn;
+}
+
+/* Records the size of the global declared by d, the largest of its decls */
+void load_global(struct interp *in, ast_decl *d) {
+  struct scope_entry *e;
+  struct layout *l;
+
+  declare_tags(d->type, &in->tags);
+  if (!d->name || !d->type || d->type->store_class == Typedef ||
+      d->type->kind == FnT) {
+    return;
+  }
+
+  size_from_init(d->type, d->init);
+  l = type_layout(d->type, &in->tags);
+  e = scope_lookup(&in->names, d->name->u.ident.name, OrdNs);
+  if (!e) {
+    e = scope_push(&in->names, d->name->u.ident.name, OrdNs);
+    e->kind = GlobalName;
+  }
+  if (l && l->size > e->value) {
+    e->value = l->size;
+  }
+}
+
+struct interp *interp_load(struct unit *u) {
+  struct interp *in = calloc(1, sizeof(*in));
+  int fns = 0;
+  int i;
+
+  in->unit = u;
+  in->out = stdout;
+  in->sym_off = calloc(u->syms_len + 1, sizeof(long));
+  in->sym_addr = calloc(u->syms_len + 1, sizeof(char *));
+  scope_init(&in->names);
+  scope_init(&in->tags);
+
+  /* functions and the storage of globals, before any use */
+  for (i = 0; i < u->nodes_len; i++) {
+    ast_node_t *node = u->nodes + i;
+    if (node->kind == FnDefn) {
+      load_fn(in, &node->u.fn_defn);
+    } else if (node->kind == Decl) {
+      load_global(in, &node->u.decl);
+    }
+  }
+  for (i = 0; i < in->names.len; i++) {
+    struct scope_entry *e = in->names.entries + i;
+    if (e->kind == GlobalName) {
+      e->ptr = calloc(1, e->value ? e->value : 1);
+      add_object(in, e->ptr, e->value ? e->value : 1);
+    }
+  }
+
+  /* tags are declared again in order as bodies are lowered */
+  scope_free(&in->tags);
+  scope_init(&in->tags);
+  for (i = 0; i < u->nodes_len; i++) {
+    ast_node_t *node = u->nodes + i;
+    if (node->kind == FnDefn) {
+      struct interp_fn *fn = in->fns[fns++];
+      declare_tags(fn->defn->decl->type, &in->tags);
+
+      in->fn = fn;
+      in->frame_len = fn->frame_size;
+      fn->body = lower_stmt(in, fn_defn_body(node));
+      /* 16 byte aligned, like the stack */
+      fn->frame_size = (fn->frame_size + 15) / 16 * 16;
+    } else if (node->kind == Decl && node->u.decl.name &&
+               node->u.decl.type->store_class != Typedef &&
+               node->u.decl.type->kind != FnT) {
+      declare_tags(node->u.decl.type, &in->tags);
+      lower_global_init(in, global_addr(in, node->u.decl.name->u.ident.name),
+                        &node->u.decl);
+    } else if (node->kind == Decl) {
+      declare_tags(node->u.decl.type, &in->tags);
+    }
+  }
+  in->fn = NULL;
+  return in;
+}
+
+/*
+ * Evaluation
+ */
+
+typedef enum exec_status { NextSt, BreakSt, ContinueSt, ReturnSt } exec_status;
+
+value eval(struct interp *, struct inode *);
+exec_status exec(struct interp *, struct inode *);
+
+/* Calls fn, storing its args from n's list into a new frame */
+value call(struct interp *in, struct interp_fn *fn, struct inode *n) {
+  char *frame = in->sp;
+  char *fp = in->fp;
+  char here;
+  int i;
+
+  /* each call nests eval and exec on the C stack too */
+  if (frame + fn->frame_size > in->stack_end ||
+      (in->c_stack && labs((long)in->c_stack - (long)&here) > INTERP_C_STACK)) {
+    interp_fail(in, "stack overflow in", fn->name);
+  }
+  /* the frame is reserved first, so calls among the args go above it */
+  in->sp += fn->frame_size;
+  for (i = 0; i < fn->params_len; i++) {
+    value v = eval(in, n->list[i]);
+    if (fn->param_kind[i] == AggV) {
+      memcpy(frame + fn->param_off[i], (char *)v.i, fn->param_size[i]);
+    } else {
+      store(fn->param_kind[i], frame + fn->param_off[i], v);
+    }
+  }
+  for (; i < n->len; i++) {
+    eval(in, n->list[i]);
+  }
+
+  in->fp = frame;
+  in->ret.i = 0;
+  exec(in, fn->body);
+  in->fp = fp;
+  in->sp = frame;
+  return in->ret;
+}
+
+value builtin_call(struct interp *in, builtin b, value *args, int len) {
+  value v;
+  int i;
+
+  for (i = len; i < 3; i++) {
+    args[i].i = 0;
+  }
+
+  v.i = 0;
+  switch (b) {
+  case PrintfB:
+    v.i = interp_printf(in->out, (char *)args[0].i, args + 1, len - 1, NULL,
+                        0);
+    break;
+  case PutcharB:
+    v.i = fputc((int)args[0].i, in->out);
+    break;
+  case PutsB:
+    v.i = fputs((char *)args[0].i, in->out);
+    fputc('\n', in->out);
+    break;
+  case MallocB:
+    v.i = (long)malloc(args[0].i);
+    break;
+  case CallocB:
+    v.i = (long)calloc(args[0].i, args[1].i);
+    break;
+  case FreeB:
+    free((void *)args[0].i);
+    break;
+  case MemsetB:
+    v.i = (long)memset((void *)args[0].i, (int)args[1].i, args[2].i);
+    break;
+  case MemcpyB:
+    v.i = (long)memcpy((void *)args[0].i, (void *)args[1].i, args[2].i);
+    break;
+  case StrlenB:
+    v.i = strlen((char *)args[0].i);
+    break;
+  case AbsB:
+    v.i = (int)args[0].i < 0 ? -(int)args[0].i : (int)args[0].i;
+    break;
+  case SqrtB:
+    v.d = sqrt(args[0].d);
+    break;
+  case FabsB:
+    v.d = fabs(args[0].d);
+    break;
+  case ExitB:
+    fflush(in->out);
+    exit((int)args[0].i);
+    break;
+  case NoBuiltin:
+    break;
+  }
+  return v;
+}
+
+/* Adds delta to the value at p of kind k, yielding the new or old value */
+value call_builtin(struct interp *in, struct inode *n) {
+  value args[BUILTIN_ARGS];
+  int i;
+
+  for (i = 0; i < n->len; i++) {
+    args[i] = eval(in, n->list[i]);
+  }
+  return builtin_call(in, n->k, args, n->len);
+}
+
+value inc(struct inode *n, char *p) {
+  value old = load(n->kind, p);
+  value v;
+
+  if (is_float_kind(n->kind)) {
+    v.d = old.d + n->f;
+  } else {
+    v.i = norm(n->kind, (long)((unsigned long)old.i + n->k));
+  }
+  store(n->kind, p, v);
+  return n->post ? old : v;
+}
+
+/* evaluates the operands of binary n into a and b */
+#define OPERANDS()                                                             \
+  a = eval(in, n->a);                                                          \
+  b = eval(in, n->b)
+
+value eval(struct interp *in, struct inode *n) {
+  value a, b, v;
+
+  switch (n->op) {
+  case ConstOp:
+    v.i = n->k;
+    return v;
+  case FConstOp:
+    v.d = n->f;
+    return v;
+  case LocalOp:
+    v.i = (long)(in->fp + n->x);
+    return v;
+  case GlobalOp:
+    v.i = (long)n->p;
+    return v;
+  case FnOp:
+    v.i = (long)n->fn;
+    return v;
+  case LoadOp:
+    return load(n->kind, (char *)eval(in, n->a).i);
+  case LoadLocalOp:
+    return load(n->kind, in->fp + n->x);
+  case StoreOp:
+    a = eval(in, n->a);
+    v = eval(in, n->b);
+    store(n->kind, (char *)a.i, v);
+    return v;
+  case StoreLocalOp:
+    v = eval(in, n->b);
+    store(n->kind, in->fp + n->x, v);
+    return v;
+  case CopyOp:
+    OPERANDS();
+    memmove((char *)a.i, (char *)b.i, n->k);
+    return a;
+  case ConvOp:
+    return convert(n->x, n->kind, eval(in, n->a));
+
+  case AddOp:
+    OPERANDS();
+    v.i = norm(n->kind, (long)((unsigned long)a.i + (unsigned long)b.i));
+    return v;
+  case SubOp:
+    OPERANDS();
+    v.i = norm(n->kind, (long)((unsigned long)a.i - (unsigned long)b.i));
+    return v;
+  case MulOp:
+    OPERANDS();
+    v.i = norm(n->kind, (long)((unsigned long)a.i * (unsigned long)b.i));
+    return v;
+  case DivOp:
+  case ModOp:
+    OPERANDS();
+    if (!b.i) {
+      interp_fail(in, "division by zero", NULL);
+    }
+    if (b.i == -1) {
+      /* LONG_MIN / -1 traps */
+      v.i = n->op == DivOp ? norm(n->kind, (long)-(unsigned long)a.i) : 0;
+    } else {
+      v.i = norm(n->kind, n->op == DivOp ? a.i / b.i : a.i % b.i);
+    }
+    return v;
+  case UDivOp:
+  case UModOp:
+    OPERANDS();
+    if (!b.i) {
+      interp_fail(in, "division by zero", NULL);
+    }
+    v.i = n->op == UDivOp ? (long)((unsigned long)a.i / (unsigned long)b.i)
+                          : (long)((unsigned long)a.i % (unsigned long)b.i);
+    v.i = norm(n->kind, v.i);
+    return v;
+  case ShlOp:
+    OPERANDS();
+    v.i = norm(n->kind, (long)((unsigned long)a.i << (b.i & 63)));
+    return v;
+  case ShrOp:
+    OPERANDS();
+    v.i = a.i >> (b.i & 63);
+    return v;
+  case UShrOp:
+    OPERANDS();
+    v.i = (long)((unsigned long)a.i >> (b.i & 63));
+    return v;
+  case AndOp:
+    OPERANDS();
+    v.i = a.i & b.i;
+    return v;
+  case OrOp:
+    OPERANDS();
+    v.i = a.i | b.i;
+    return v;
+  case XorOp:
+    OPERANDS();
+    v.i = a.i ^ b.i;
+    return v;
+  case NegOp:
+    v.i = norm(n->kind, (long)-(unsigned long)eval(in, n->a).i);
+    return v;
+  case ComplOp:
+    v.i = norm(n->kind, ~eval(in, n->a).i);
+    return v;
+  case EqOp:
+    OPERANDS();
+    v.i = a.i == b.i;
+    return v;
+  case NeOp:
+    OPERANDS();
+    v.i = a.i != b.i;
+    return v;
+  case LtOp:
+    OPERANDS();
+    v.i = a.i < b.i;
+    return v;
+  case LeOp:
+    OPERANDS();
+    v.i = a.i <= b.i;
+    return v;
+  case ULtOp:
+    OPERANDS();
+    v.i = (unsigned long)a.i < (unsigned long)b.i;
+    return v;
+  case ULeOp:
+    OPERANDS();
+    v.i = (unsigned long)a.i <= (unsigned long)b.i;
+    return v;
+
+  case FAddOp:
+    OPERANDS();
+    v.d = a.d + b.d;
+    break;
+  case FSubOp:
+    OPERANDS();
+    v.d = a.d - b.d;
+    break;
+  case FMulOp:
+    OPERANDS();
+    v.d = a.d * b.d;
+    break;
+  case FDivOp:
+    OPERANDS();
+    v.d = a.d / b.d;
+    break;
+  case FNegOp:
+    v.d = -eval(in, n->a).d;
+    return v;
+  case FEqOp:
+    OPERANDS();
+    v.i = a.d == b.d;
+    return v;
+  case FNeOp:
+    OPERANDS();
+    v.i = a.d != b.d;
+    return v;
+  case FLtOp:
+    OPERANDS();
+    v.i = a.d < b.d;
+    return v;
+  case FLeOp:
+    OPERANDS();
+    v.i = a.d <= b.d;
+    return v;
+
+  case PtrAddOp:
+    OPERANDS();
+    v.i = a.i + b.i * n->k;
+    return v;
+  case PtrDiffOp:
+    OPERANDS();
+    v.i = (a.i - b.i) / n->k;
+    return v;
+  case NotOp:
+    v.i = !eval(in, n->a).i;
+    return v;
+  case LogAndOp:
+    v.i = eval(in, n->a).i && eval(in, n->b).i;
+    return v;
+  case LogOrOp:
+    v.i = eval(in, n->a).i || eval(in, n->b).i;
+    return v;
+  case CondOp:
+    return eval(in, n->a).i ? eval(in, n->b) : eval(in, n->c);
+  case SeqOp:
+    eval(in, n->a);
+    return eval(in, n->b);
+  case IncOp:
+    return inc(n, (char *)eval(in, n->a).i);
+  case IncLocalOp:
+    return inc(n, in->fp + n->x);
+  case CallOp:
+    return call(in, n->fn, n);
+  case CallPtrOp: {
+    struct interp_fn *fn = (struct interp_fn *)eval(in, n->a).i;
+    if (!fn) {
+      interp_fail(in, "call through a null pointer", NULL);
+    }
+    if (n->len < fn->params_len) {
+      interp_fail(in, "wrong number of arguments to", fn->name);
+    }
+    return call(in, fn, n);
+  }
+  case BuiltinOp:
+    return call_builtin(in, n);
+  default:
+    interp_fail(in, "not an expression", NULL);
+    v.i = 0;
+    return v;
+  }
+
+  /* float arithmetic, rounded to float */
+  if (n->kind == F32V) {
+    v.d = (float)v.d;
+  }
+  return v;
+}
+
+/* Executes the list of n from index i */
+exec_status exec_list(struct interp *in, struct inode *n, int i) {
+  exec_status st;
+  for (; i < n->len; i++) {
+    if ((st = exec(in, n->list[i])) != NextSt) {
+      return st;
+    }
+  }
+  return NextSt;
+}
+
+exec_status exec(struct interp *in, struct inode *n) {
+  exec_status st;
+
+  switch (n->op) {
+  case NopOp:
+    return NextSt;
+  case ExprOp:
+    eval(in, n->a);
+    return NextSt;
+  case BlockOp:
+    return exec_list(in, n, 0);
+  case IfOp:
+    if (eval(in, n->a).i) {
+      return exec(in, n->b);
+    }
+    return n->c ? exec(in, n->c) : NextSt;
+  case WhileOp:
+    while (eval(in, n->a).i) {
+      if ((st = exec(in, n->b)) == BreakSt) {
+        break;
+      } else if (st == ReturnSt) {
+        return st;
+      }
+    }
+    return NextSt;
+  case DoOp:
+    do {
+      if ((st = exec(in, n->b)) == BreakSt) {
+        break;
+      } else if (st == ReturnSt) {
+        return st;
+      }
+    } while (eval(in, n->a).i);
+    return NextSt;
+  case ForOp:
+    if (n->a) {
+      eval(in, n->a);
+    }
+    while (!n->b || eval(in, n->b).i) {
+      if ((st = exec(in, n->d)) == BreakSt) {
+        break;
+      } else if (st == ReturnSt) {
+        return st;
+      }
+      if (n->c) {
+        eval(in, n->c);
+      }
+    }
+    return NextSt;
+  case SwitchOp: {
+    long v = eval(in, n->a).i;
+    int at = n->default_at;
+    int i;
+
+    for (i = 0; i < n->cases_len; i++) {
+      if (n->cases[i] == v) {
+        at = n->case_at[i];
+        break;
+      }
+    }
+    st = exec_list(in, n->d, at);
+    return st == BreakSt ? NextSt : st;
+  }
+  case BreakOp:
+    return BreakSt;
+  case ContinueOp:
+    return ContinueSt;
+  case ReturnOp:
+    if (n->a) {
+      in->ret = eval(in, n->a);
+    }
+    return ReturnSt;
+  case ZeroOp:
+    memset(in->fp + n->x, 0, n->k);
+    return NextSt;
+  default:
+    eval(in, n);
+    return NextSt;
+  }
+}
+
+struct interp_fn *interp_main(struct interp *in) {
+  struct interp_fn *main_fn = interp_find(in, "main");
+
+  if (!main_fn) {
+    interp_fail(in, "no main function", NULL);
+  }
+  if (main_fn->params_len > 2) {
+    interp_fail(in, "main takes too many params", NULL);
+  }
+  return main_fn;
+}
+
+void interp_init(struct interp *in) {
+  int i;
+
+  if (!in->stack) {
+    in->stack = malloc(INTERP_STACK);
+    in->stack_end = in->stack + INTERP_STACK;
+  }
+  in->sp = in->stack;
+  in->fp = NULL;
+
+  for (i = 0; i < in->inits_len; i++) {
+    exec(in, in->inits[i]);
+  }
+}
+
+int interp_run(struct interp *in, int argc, char **argv) {
+  struct interp_fn *main_fn = interp_main(in);
+  struct inode call_main;
+  struct inode *args[2];
+
+  interp_init(in);
+
+  memset(&call_main, 0, sizeof(call_main));
+  args[0] = const_inode(argc, I32V);
+  args[1] = new_inode(GlobalOp, PtrV);
+  args[1]->p = (char *)argv;
+  call_main.list = args;
+  call_main.len = main_fn->params_len;
+
+  in->c_stack = (char *)&call_main;
+  call(in, main_fn, &call_main);
+  in->c_stack = NULL;
+  fflush(in->out);
+  return main_fn->ret_kind == VoidV ? 0 : (int)in->ret.i;
+}
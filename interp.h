@@ -0,0 +1,333 @@
+#ifndef CHOCC_INTERP_H
+#define CHOCC_INTERP_H
+#pragma once
+
+#include <stdio.h>
+
+#include "chocc.h"
+#include "parse.h"
+#include "scope.h"
+#include "unit.h"
+
+/*
+ * val_kind is how a value is held and accessed in memory. Integers are
+ * held in value.i, sign or zero extended from their width, and pointers
+ * too. Floats are held in value.d, rounded to their width. Aggregates are
+ * held by address.
+ */
+typedef enum val_kind {
+  VoidV,
+  I8V,
+  U8V,
+  I16V,
+  U16V,
+  I32V,
+  U32V,
+  I64V,
+  U64V,
+  F32V,
+  F64V,
+  PtrV,
+  AggV
+} val_kind;
+
+typedef union value {
+  long i;
+  double d;
+} value;
+
+/* the builtin library functions a program may call */
+typedef enum builtin {
+  NoBuiltin,
+  PrintfB,
+  PutcharB,
+  PutsB,
+  MallocB,
+  CallocB,
+  FreeB,
+  MemsetB,
+  MemcpyB,
+  StrlenB,
+  AbsB,
+  SqrtB,
+  FabsB,
+  ExitB
+} builtin;
+
+struct interp;
+
+/* the names of the builtins, by builtin */
+extern const char *builtin_names[];
+
+/* Returns the builtin named name, or NoBuiltin */
+builtin builtin_named(const char *name);
+
+/* Returns how the result of builtin b is held */
+val_kind builtin_kind(builtin b);
+
+/* arguments a builtin is called with at most */
+#define BUILTIN_ARGS 16
+
+/*
+ * Calls builtin b with the len args, which has room for BUILTIN_ARGS.
+ * Output goes to the program's stdout.
+ */
+value builtin_call(struct interp *, builtin b, value *args, int len);
+
+/*
+ * printf over decoded arguments, one conversion at a time. Strings are at
+ * their args, or if mem is not NULL at those offsets into its mem_len
+ * bytes, where one running past them prints as (null).
+ */
+int interp_printf(FILE *out, const char *fmt, value *args, int len,
+                  const char *mem, long mem_len);
+
+/*
+ * inode_op enumerates the operations of the lowered tree. Operators are
+ * split by operand kind at lowering, integer ones normalizing their result
+ * to inode.kind.
+ */
+typedef enum inode_op {
+  /* values */
+  ConstOp,  /* k */
+  FConstOp, /* f */
+  LocalOp,  /* address of the frame at offset x */
+  GlobalOp, /* address p */
+  FnOp,     /* function fn */
+  LoadOp,   /* *a */
+  LoadLocalOp,
+  StoreOp, /* *a = b */
+  StoreLocalOp,
+  CopyOp, /* copies k bytes from b to a, yielding a */
+  ConvOp, /* a converted from kind x to kind */
+
+  /* integer arithmetic */
+  AddOp,
+  SubOp,
+  MulOp,
+  DivOp,
+  UDivOp,
+  ModOp,
+  UModOp,
+  ShlOp,
+  ShrOp,
+  UShrOp,
+  AndOp,
+  OrOp,
+  XorOp,
+  NegOp,
+  ComplOp,
+  EqOp,
+  NeOp,
+  LtOp,
+  LeOp,
+  ULtOp,
+  ULeOp,
+
+  /* float arithmetic */
+  FAddOp,
+  FSubOp,
+  FMulOp,
+  FDivOp,
+  FNegOp,
+  FEqOp,
+  FNeOp,
+  FLtOp,
+  FLeOp,
+
+  PtrAddOp,  /* a + b * k */
+  PtrDiffOp, /* (a - b) / k */
+  NotOp,     /* !a */
+  LogAndOp,
+  LogOrOp,
+  CondOp, /* a ? b : c */
+  SeqOp,  /* a, b */
+  IncOp,  /* *a += k, or f for floats, yielding the old value if post */
+  IncLocalOp,
+  CallOp,    /* fn(list) */
+  CallPtrOp, /* a(list) */
+  BuiltinOp, /* k(list) */
+
+  /* statements */
+  NopOp,
+  ExprOp,
+  BlockOp,
+  IfOp, /* if (a) b else c */
+  WhileOp,
+  DoOp,
+  ForOp, /* for (a; b; c) d */
+  SwitchOp,
+  BreakOp,
+  ContinueOp,
+  ReturnOp,
+  ZeroOp /* clears k bytes at the frame offset x */
+} inode_op;
+
+struct interp_fn;
+
+/*
+ * frame_slot is a param, local or temporary of a frame. Scalars are only
+ * read and written whole, by LoadLocalOp, StoreLocalOp and IncLocalOp,
+ * unless their address is taken by a LocalOp.
+ */
+struct frame_slot {
+  long off;
+  long size;
+  bool scalar;
+};
+
+/*
+ * inode is a node of the lowered tree the interpreter walks. Names are
+ * bound to frame offsets or addresses, literals are decoded and operators
+ * are chosen by the types check gave, so nothing is looked up at run time.
+ */
+struct inode {
+  inode_op op;
+  val_kind kind; /* of the result, or of the access for loads and stores */
+
+  struct inode *a;
+  struct inode *b;
+  struct inode *c;
+  struct inode *d;
+  struct inode **list; /* block statements and call arguments */
+  int len;
+
+  long k;
+  long x;
+  double f;
+  char *p;
+  struct interp_fn *fn;
+  bool post;
+
+  /* switch, matching the values in cases to statement indices in case_at */
+  long *cases;
+  int *case_at;
+  int cases_len;
+  int default_at; /* len if none */
+};
+
+/*
+ * interp_fn is a function definition lowered for the interpreter. Its
+ * params and locals live in a frame of frame_size bytes, laid out by the
+ * frame slots resolve gave them.
+ */
+struct interp_fn {
+  const char *name;
+  int id; /* index in interp.fns */
+  ast_fn_defn *defn;
+  struct inode *body;
+  long frame_size;
+
+  long *param_off;
+  val_kind *param_kind;
+  long *param_size;
+  int params_len;
+  val_kind ret_kind;
+
+  /* params first, then the locals and temporaries of every block */
+  struct frame_slot *slots;
+  int slots_len;
+};
+
+struct interp_obj {
+  char *p;
+  long size;
+};
+
+/*
+ * interp is a program loaded for interpretation, with its globals
+ * allocated and initialized.
+ */
+struct interp {
+  struct unit *unit;
+  FILE *out; /* stdout of the program */
+
+  struct interp_fn **fns;
+  int fns_len;
+  int fns_cap;
+
+  /* by symbol index */
+  long *sym_off;   /* frame offset of params and locals */
+  char **sym_addr; /* address of globals and statics */
+
+  struct scope names; /* globals and functions by name */
+  struct scope tags;
+
+  /* storage of globals, statics and string literals */
+  struct interp_obj *objs;
+  int objs_len;
+  int objs_cap;
+
+  struct inode **inits; /* initializers of globals and statics */
+  int inits_len;
+  int inits_cap;
+
+  /* lowering state of the current function */
+  struct interp_fn *fn;
+  long frame_len;
+
+  /* run time */
+  char *stack;
+  char *stack_end;
+  char *sp;
+  char *fp;
+  value ret;
+  char *c_stack; /* C stack at interp_run, bounding the tree walker */
+};
+
+/*
+ * Lowers the function definitions and globals of the parsed, folded,
+ * resolved and checked unit u. Constructs the program cannot run, like
+ * goto or struct returns, exit with a message.
+ */
+struct interp *interp_load(struct unit *u);
+
+/* Returns the function named name, or NULL */
+struct interp_fn *interp_find(struct interp *, const char *name);
+
+/* Returns main, checking its params, or exits with a message */
+struct interp_fn *interp_main(struct interp *);
+
+/* Allocates the stack and runs the initializers of globals and statics */
+void interp_init(struct interp *);
+
+/*
+ * Initializes the globals and calls main, returning its result. argv holds
+ * argc strings.
+ */
+int interp_run(struct interp *, int argc, char **argv);
+
+/* Reports an error of a program that cannot run and exits */
+void interp_fail(struct interp *, const char *msg, const char *name);
+
+bool is_float_kind(val_kind k);
+bool is_unsigned_kind(val_kind k);
+
+/* Returns whether every value of kind from is held the same in kind to */
+bool kind_fits(val_kind from, val_kind to);
+
+/* Returns v truncated to integer kind k, extended back to a long */
+long norm(val_kind k, long v);
+
+/* Returns v of kind from converted to kind to */
+value convert(val_kind from, val_kind to, value v);
+
+/* Returns the value of kind k at p, or p itself for aggregates */
+value load(val_kind k, char *p);
+
+/* Stores v as kind k at p, truncated to its width */
+void store(val_kind k, char *p, value v);
+
+/*
+ * Returns by slot of fn whether its scalar is never addressed, nor overlaps
+ * an aggregate of another block, so it may be held out of the frame.
+ */
+bool *slot_promotable(struct interp_fn *fn);
+
+/* Returns the size of a value of kind k, which is not an aggregate */
+long kind_size(val_kind k);
+
+/* Returns how values of type t are held, after array and function decay */
+val_kind val_kind_of(type *t);
+
+#endif
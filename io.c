@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "io.h"
+#include "alloc.h"
 
 void read_file(char *fname, char **fcontent) {
   FILE *file = fopen(fname, "rb");
@@ -13,14 +14,14 @@ void read_file(char *fname, char **fcontent) {
   fsize = ftell(file);
   fseek(file, 0, SEEK_SET);
 
-  *fcontent = calloc(fsize + 1, sizeof(char));
+  *fcontent = alloc_calloc(IoAlloc, fsize + 1, sizeof(char));
   fread(*fcontent, sizeof(char), fsize, file);
 
   fclose(file);
 }
 
 file *src_to_file(char *src) {
-  file *f = calloc(1, sizeof(file));
+  file *f = alloc_calloc(IoAlloc, 1, sizeof(file));
 
   char *pos = src;
   char *ln_begin = src;
@@ -29,7 +30,7 @@ file *src_to_file(char *src) {
 
   f->lines_len = 0;
   f->lines_cap = 64;
-  f->lines = calloc(f->lines_cap, sizeof(line));
+  f->lines = alloc_calloc(IoAlloc, f->lines_cap, sizeof(line));
 
   for (;; pos++) {
     if (*pos == '\n' || !*pos) {
@@ -39,12 +40,13 @@ file *src_to_file(char *src) {
       bool space = true;
 
       ln.num = i++;
+      ln.off = ln_begin - src;
       if (pos > src) {
         ln.splice = *(pos - 1) == '\\';
       }
 
       ln_end = pos;
-      ln.src = calloc(ln_end - ln_begin + 1, 1);
+      ln.src = alloc_calloc(IoAlloc, ln_end - ln_begin + 1, 1);
       ln.len = ln_end - ln_begin;
       strncpy(ln.src, ln_begin, ln.len);
 
@@ -61,7 +63,8 @@ file *src_to_file(char *src) {
 
       if (f->lines_cap == f->lines_len) {
         f->lines_cap *= 2;
-        f->lines = realloc(f->lines, sizeof(line) * f->lines_cap);
+        f->lines =
+            alloc_realloc(IoAlloc, f->lines, sizeof(line) * f->lines_cap);
       }
       f->lines[f->lines_len++] = ln;
 
@@ -77,6 +80,74 @@ file *src_to_file(char *src) {
   return f;
 }
 
+int file_line_at(file *f, int off) {
+  int lo = 0, hi = f->lines_len - 1;
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo + 1) / 2;
+    if (f->lines[mid].off <= off) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+
+int file_edit(file *f, int begin, int end, const char *text, int *old_lines,
+              int *new_lines) {
+  int first, last, delta, i;
+  line *a, *b;
+  char *src;
+  file *ins;
+  int a_len, b_len, text_len;
+
+  first = file_line_at(f, begin);
+  last = file_line_at(f, end);
+  a = &f->lines[first];
+  b = &f->lines[last];
+
+  /* clamp offsets to the lines they fall in */
+  a_len = begin - a->off;
+  a_len = a_len > a->len ? a->len : a_len;
+  b_len = end - b->off;
+  b_len = b_len > b->len ? b->len : b_len;
+  text_len = strlen(text);
+
+  src = alloc_calloc(IoAlloc, a_len + text_len + (b->len - b_len) + 1, 1);
+  memcpy(src, a->src, a_len);
+  memcpy(src + a_len, text, text_len);
+  memcpy(src + a_len + text_len, b->src + b_len, b->len - b_len);
+  ins = src_to_file(src);
+  alloc_free(src);
+
+  for (i = first; i <= last; i++) {
+    alloc_free(f->lines[i].src);
+  }
+
+  delta = ins->lines_len - (last - first + 1);
+  if (f->lines_len + delta > f->lines_cap) {
+    f->lines_cap = (f->lines_len + delta) * 2;
+    f->lines = alloc_realloc(IoAlloc, f->lines, sizeof(line) * f->lines_cap);
+  }
+  memmove(f->lines + last + 1 + delta, f->lines + last + 1,
+          sizeof(line) * (f->lines_len - last - 1));
+  memcpy(f->lines + first, ins->lines, sizeof(line) * ins->lines_len);
+  f->lines_len += delta;
+
+  for (i = first; i < f->lines_len; i++) {
+    f->lines[i].num = i + 1;
+    f->lines[i].off =
+        i ? f->lines[i - 1].off + f->lines[i - 1].len + 1 : 0;
+  }
+
+  *old_lines = last - first + 1;
+  *new_lines = ins->lines_len;
+  alloc_free(ins->lines);
+  alloc_free(ins);
+  return first;
+}
+
 file *load_file(char *fname) {
   char *fcontent;
   read_file(fname, &fcontent);
@@ -84,8 +155,281 @@ file *load_file(char *fname) {
 }
 
 void print_file(file *f) {
+  writer w = new_writer(stdout);
+  write_file(&w, f);
+  free_writer(&w);
+}
+
+void write_file(writer *w, file *f) {
   int i;
   for (i = 0; i < f->lines_len; i++) {
-    printf("%3d | %s\n", f->lines[i].num, f->lines[i].src);
+    int num = f->lines[i].num;
+
+    /* %3d */
+    if (num < 100) {
+      write_char(w, ' ');
+    }
+    if (num < 10) {
+      write_char(w, ' ');
+    }
+    write_long(w, num);
+    write_str(w, " | ");
+    write_str(w, f->lines[i].src);
+    write_char(w, '\n');
+  }
+}
+
+writer new_writer(FILE *stream) {
+  writer w = {0};
+
+  w.stream = stream;
+  w.cap = 1 << 16;
+  w.buf = alloc_malloc(IoAlloc, w.cap);
+
+  w.pad_cap = 256;
+  w.pad = alloc_malloc(IoAlloc, w.pad_cap);
+
+  return w;
+}
+
+void writer_flush(writer *w) {
+  if (w->len) {
+    fwrite(w->buf, 1, w->len, w->stream);
+    w->len = 0;
+  }
+}
+
+void free_writer(writer *w) {
+  writer_flush(w);
+  fflush(w->stream);
+  alloc_free(w->buf);
+  alloc_free(w->pad);
+  w->buf = NULL;
+  w->pad = NULL;
+}
+
+void write_mem(writer *w, const char *src, int len) {
+  if (w->len + len > w->cap) {
+    writer_flush(w);
+    if (len > w->cap) {
+      fwrite(src, 1, len, w->stream);
+      return;
+    }
+  }
+  memcpy(w->buf + w->len, src, len);
+  w->len += len;
+}
+
+void write_str(writer *w, const char *s) {
+  write_mem(w, s, strlen(s));
+}
+
+void write_char(writer *w, char c) {
+  if (w->len == w->cap) {
+    writer_flush(w);
   }
+  w->buf[w->len++] = c;
+}
+
+void write_long(writer *w, long n) {
+  if (n < 0) {
+    write_char(w, '-');
+  }
+  write_ulong(w, n < 0 ? -(unsigned long)n : (unsigned long)n);
+}
+
+void write_ulong(writer *w, unsigned long n) {
+  char digits[24];
+  int i = sizeof(digits);
+
+  do {
+    digits[--i] = '0' + n % 10;
+    n /= 10;
+  } while (n);
+
+  write_mem(w, digits + i, sizeof(digits) - i);
+}
+
+void write_json_str(writer *w, const char *s) {
+  const char *begin = s;
+
+  write_char(w, '"');
+  for (; *s; s++) {
+    unsigned char c = *s;
+    if (c != '"' && c != '\\' && c >= 0x20) {
+      continue;
+    }
+
+    /* flush the unescaped run */
+    write_mem(w, begin, s - begin);
+    begin = s + 1;
+
+    write_char(w, '\\');
+    switch (c) {
+    case '"':
+    case '\\':
+      write_char(w, c);
+      break;
+    case '\n':
+      write_char(w, 'n');
+      break;
+    case '\t':
+      write_char(w, 't');
+      break;
+    default: {
+      const char *hex = "0123456789abcdef";
+      write_str(w, "u00");
+      write_char(w, hex[c >> 4]);
+      write_char(w, hex[c & 0xf]);
+    }
+    }
+  }
+  write_mem(w, begin, s - begin);
+  write_char(w, '"');
+}
+
+const char *json_ws(const char *s) {
+  for (; *s && isspace((unsigned char)*s); s++) {
+  }
+  return s;
+}
+
+const char *json_skip(const char *val) {
+  int depth = 0;
+  const char *s = json_ws(val);
+
+  do {
+    if (*s == '"') {
+      for (s++; *s != '"'; s++) {
+        if (!*s || (*s == '\\' && !*++s)) {
+          return NULL;
+        }
+      }
+      s++;
+    } else if (*s == '{' || *s == '[') {
+      depth++;
+      s++;
+    } else if ((*s == '}' || *s == ']') && depth) {
+      depth--;
+      s++;
+    } else if ((*s == ',' || *s == ':') && depth) {
+      s++;
+    } else if (*s && !strchr("}],:", *s)) {
+      /* numbers and literals */
+      for (; *s && !strchr(",:{}[]\"", *s) && !isspace((unsigned char)*s);
+           s++) {
+      }
+    } else {
+      return NULL;
+    }
+    s = json_ws(s);
+  } while (depth);
+
+  return s;
+}
+
+const char *json_get(const char *obj, const char *key) {
+  const char *s;
+
+  if (!obj || *(s = json_ws(obj)) != '{') {
+    return NULL;
+  }
+  for (s = json_ws(s + 1); *s == '"';) {
+    char *k = json_str(s);
+    bool match = k && !strcmp(k, key);
+
+    alloc_free(k);
+    if (!(s = json_skip(s)) || *s != ':') {
+      return NULL;
+    }
+    if (match) {
+      return json_ws(s + 1);
+    }
+    if (!(s = json_skip(s + 1))) {
+      return NULL;
+    }
+    if (*s == ',') {
+      s = json_ws(s + 1);
+    }
+  }
+  return NULL;
+}
+
+const char *json_at(const char *val, int i) {
+  const char *s;
+
+  if (!val || *(s = json_ws(val)) != '[') {
+    return NULL;
+  }
+  for (s = json_ws(s + 1); *s && *s != ']'; i--) {
+    if (!i) {
+      return s;
+    }
+    if (!(s = json_skip(s))) {
+      return NULL;
+    }
+    if (*s == ',') {
+      s = json_ws(s + 1);
+    }
+  }
+  return NULL;
+}
+
+char *json_str(const char *val) {
+  const char *s, *end;
+  char *str, *out;
+
+  if (!val || *(s = json_ws(val)) != '"' || !(end = json_skip(s))) {
+    return NULL;
+  }
+
+  str = out = alloc_calloc(IoAlloc, end - s, 1);
+  for (s++; *s != '"'; s++) {
+    if (*s != '\\') {
+      *out++ = *s;
+      continue;
+    }
+    switch (*++s) {
+    case 'b':
+      *out++ = '\b';
+      break;
+    case 'f':
+      *out++ = '\f';
+      break;
+    case 'n':
+      *out++ = '\n';
+      break;
+    case 'r':
+      *out++ = '\r';
+      break;
+    case 't':
+      *out++ = '\t';
+      break;
+    case 'u': {
+      /* BMP code points only, encoded as UTF-8 */
+      unsigned long c = 0;
+      int j;
+      for (j = 0; j < 4 && isxdigit((unsigned char)s[1]); j++, s++) {
+        c = c * 16 + (isdigit((unsigned char)s[1]) ? s[1] - '0'
+                                                   : (s[1] | 0x20) - 'a' + 10);
+      }
+      if (c < 0x80) {
+        *out++ = c;
+      } else if (c < 0x800) {
+        *out++ = 0xc0 | c >> 6;
+        *out++ = 0x80 | (c & 0x3f);
+      } else {
+        *out++ = 0xe0 | c >> 12;
+        *out++ = 0x80 | (c >> 6 & 0x3f);
+        *out++ = 0x80 | (c & 0x3f);
+      }
+      break;
+    }
+    default:
+      *out++ = *s;
+      break;
+    }
+  }
+
+  return str;
 }
@@ -2,6 +2,8 @@
 #define CHOCC_IO_H
 #pragma once
 
+#include <stdio.h>
+
 #include "chocc.h"
 
 typedef struct loc {
@@ -21,13 +23,85 @@ typedef struct line {
   int len;
   bool splice;
   bool cpp;
+  int off;      /* byte offset in the source */
+  bool comment; /* part of a block comment spanning lines */
 } line;
 
+/*
+ * Reads the whole file at fname into a NUL terminated fcontent.
+ */
+void read_file(char *fname, char **fcontent);
+
 /*
  * Loads file from path.
  */
 file *load_file(char *fname);
 
+/*
+ * Splits source text into a file.
+ */
+file *src_to_file(char *src);
+
+/*
+ * Returns the index of the line containing byte offset off of the source.
+ */
+int file_line_at(file *f, int off);
+
+/*
+ * Replaces bytes [begin, end) of the source with text, splitting the result
+ * into lines. Returns the index of the first replaced line; old_lines and
+ * new_lines receive the number of lines removed and inserted there.
+ */
+int file_edit(file *f, int begin, int end, const char *text, int *old_lines,
+              int *new_lines);
+
 void print_file(file *);
 
+/*
+ * writer buffers output to a stream.
+ * Nothing is allocated after new_writer, so it can be used in hot loops.
+ */
+typedef struct writer {
+  FILE *stream;
+  char *buf;
+  int len;
+  int cap;
+
+  /* tree drawing prefix of write_ast */
+  char *pad;
+  int pad_len;
+  int pad_cap;
+
+  bool types; /* write_ast annotates expressions with their types */
+} writer;
+
+writer new_writer(FILE *stream);
+void writer_flush(writer *);
+/* Flushes and frees the writer's buffers. */
+void free_writer(writer *);
+
+void write_mem(writer *, const char *src, int len);
+void write_str(writer *, const char *);
+void write_char(writer *, char);
+void write_long(writer *, long);
+void write_ulong(writer *, unsigned long);
+/* Writes a quoted and escaped JSON string. */
+void write_json_str(writer *, const char *);
+
+void write_file(writer *, file *);
+
+/*
+ * Reading JSON values in place. val points at the first character of a value
+ * and may be preceded by whitespace.
+ */
+
+/* Returns the first character after the value at val, or NULL if malformed. */
+const char *json_skip(const char *val);
+/* Returns the value of key in the object at obj, or NULL. */
+const char *json_get(const char *obj, const char *key);
+/* Returns the decoded string at val, or NULL if it is not a string. */
+char *json_str(const char *val);
+/* Returns the i-th element of the array at val, or NULL. */
+const char *json_at(const char *val, int i);
+
 #endif
@@ -0,0 +1,2259 @@
+#include "ir.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* values and frames the running calls of a program may use */
+#define IR_VALUES (1 << 22)
+#define IR_FRAMES (1 << 18)
+
+/*
+ * Instructions and blocks
+ */
+
+/* Returns a new instruction of f in no block */
+int ir_new(struct ir_fn *f, ir_op op, val_kind kind) {
+  struct ir_insn *i;
+
+  if (f->insns_len == f->insns_cap) {
+    f->insns_cap = f->insns_cap ? f->insns_cap * 2 : 64;
+    f->insns = realloc(f->insns, f->insns_cap * sizeof(*f->insns));
+  }
+  i = f->insns + f->insns_len;
+  memset(i, 0, sizeof(*i));
+  i->op = op;
+  i->kind = kind;
+  i->block = -1;
+  i->a = i->b = -1;
+  return f->insns_len++;
+}
+
+int ir_new_block(struct ir_fn *f) {
+  if (f->blocks_len == f->blocks_cap) {
+    f->blocks_cap = f->blocks_cap ? f->blocks_cap * 2 : 16;
+    f->blocks = realloc(f->blocks, f->blocks_cap * sizeof(*f->blocks));
+  }
+  memset(f->blocks + f->blocks_len, 0, sizeof(*f->blocks));
+  return f->blocks_len++;
+}
+
+/* Inserts instruction v into block at index at */
+void ir_insert(struct ir_fn *f, int block, int at, int v) {
+  struct ir_block *b = f->blocks + block;
+
+  if (b->len == b->cap) {
+    b->cap = b->cap ? b->cap * 2 : 8;
+    b->insns = realloc(b->insns, b->cap * sizeof(int));
+  }
+  memmove(b->insns + at + 1, b->insns + at, (b->len - at) * sizeof(int));
+  b->insns[at] = v;
+  b->len++;
+  f->insns[v].block = block;
+}
+
+/* Returns the number of phis block starts with */
+int ir_phis(struct ir_fn *f, int block) {
+  struct ir_block *b = f->blocks + block;
+  int i;
+
+  for (i = 0; i < b->len && f->insns[b->insns[i]].op == IrPhi; i++) {
+  }
+  return i;
+}
+
+bool ir_is_terminator(ir_op op) { return op >= IrJump; }
+
+/* Returns the terminator of block, or NULL if it has none yet */
+struct ir_insn *ir_terminator(struct ir_fn *f, int block) {
+  struct ir_block *b = f->blocks + block;
+  struct ir_insn *i;
+
+  if (!b->len) {
+    return NULL;
+  }
+  i = f->insns + b->insns[b->len - 1];
+  return ir_is_terminator(i->op) ? i : NULL;
+}
+
+/* Returns the index of pred among the predecessors of block, or -1 */
+int ir_pred_index(struct ir_fn *f, int block, int pred) {
+  struct ir_block *b = f->blocks + block;
+  int i;
+
+  for (i = 0; i < b->preds_len; i++) {
+    if (b->preds[i] == pred) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void ir_add_pred(struct ir_fn *f, int block, int pred) {
+  struct ir_block *b = f->blocks + block;
+
+  if (ir_pred_index(f, block, pred) >= 0) {
+    return;
+  }
+  if (b->preds_len == b->preds_cap) {
+    b->preds_cap = b->preds_cap ? b->preds_cap * 2 : 4;
+    b->preds = realloc(b->preds, b->preds_cap * sizeof(int));
+  }
+  b->preds[b->preds_len++] = pred;
+}
+
+/* Removes the i-th predecessor of block and its operand of every phi */
+void ir_remove_pred(struct ir_fn *f, int block, int i) {
+  struct ir_block *b = f->blocks + block;
+  int phis = ir_phis(f, block);
+  int j;
+
+  for (j = 0; j < phis; j++) {
+    struct ir_insn *phi = f->insns + b->insns[j];
+    memmove(phi->args + i, phi->args + i + 1,
+            (phi->args_len - i - 1) * sizeof(int));
+    phi->args_len--;
+  }
+  memmove(b->preds + i, b->preds + i + 1,
+          (b->preds_len - i - 1) * sizeof(int));
+  b->preds_len--;
+}
+
+/* Returns whether the terminator of from still has an edge to to */
+bool ir_has_edge(struct ir_fn *f, int from, int to) {
+  struct ir_insn *t = ir_terminator(f, from);
+  int i;
+
+  for (i = 0; t && i < t->targets_len; i++) {
+    if (t->targets[i] == to) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Drops from as a predecessor of to once it has no edge there */
+void ir_unlink(struct ir_fn *f, int from, int to) {
+  int i = ir_pred_index(f, to, from);
+
+  if (i >= 0 && !ir_has_edge(f, from, to)) {
+    ir_remove_pred(f, to, i);
+  }
+}
+
+/* Removes instruction v from its block and f */
+void ir_remove(struct ir_fn *f, int v) {
+  struct ir_insn *i = f->insns + v;
+  struct ir_block *b = f->blocks + i->block;
+  int j;
+
+  for (j = 0; b->insns[j] != v; j++) {
+  }
+  memmove(b->insns + j, b->insns + j + 1, (b->len - j - 1) * sizeof(int));
+  b->len--;
+  free(i->args);
+  free(i->targets);
+  free(i->cases);
+  memset(i, 0, sizeof(*i));
+  i->op = IrNop;
+  i->block = -1;
+  i->a = i->b = -1;
+}
+
+/* Returns the j-th operand slot of i, which has 2 + i->args_len */
+int *ir_use(struct ir_insn *i, int j) {
+  return j == 0 ? &i->a : j == 1 ? &i->b : i->args + j - 2;
+}
+
+/* Makes i jump to target, dropping its other edges */
+void ir_make_jump(struct ir_fn *f, struct ir_insn *i, int target) {
+  int from = i->block;
+  int *old = i->targets;
+  int old_len = i->targets_len;
+  int j;
+
+  i->op = IrJump;
+  i->a = -1;
+  free(i->cases);
+  i->cases = NULL;
+  i->targets = malloc(sizeof(int));
+  i->targets[0] = target;
+  i->targets_len = 1;
+  for (j = 0; j < old_len; j++) {
+    ir_unlink(f, from, old[j]);
+  }
+  free(old);
+}
+
+/*
+ * Construction
+ */
+
+/* ir_build_block is the state of a block while its function is built */
+struct ir_build_block {
+  int *defs;    /* the value of each var so far, -1 if unknown */
+  bool sealed;  /* once its predecessors are all known */
+  int *pending; /* phis and their vars, given operands when sealed */
+  int pending_len;
+};
+
+/*
+ * ir_builder is the state of building one function. Promoted scalars are
+ * vars, and are read and written as values, phis being placed where their
+ * definitions meet as in Braun et al.'s construction.
+ */
+struct ir_builder {
+  struct interp *in;
+  struct ir_fn *f;
+  struct interp_fn *fn;
+  int cur; /* the block appended to */
+
+  long *var_off; /* frame offset of each var */
+  int vars_len;
+
+  struct ir_build_block *bb; /* by block */
+  int bb_cap;
+
+  int brk; /* blocks of the innermost loop or switch */
+  int cont;
+};
+
+int ir_block(struct ir_builder *b) {
+  int block = ir_new_block(b->f);
+  struct ir_build_block *s;
+  int i;
+
+  if (block >= b->bb_cap) {
+    b->bb_cap = b->bb_cap ? b->bb_cap * 2 : 16;
+    b->bb = realloc(b->bb, b->bb_cap * sizeof(*b->bb));
+  }
+  s = b->bb + block;
+  memset(s, 0, sizeof(*s));
+  s->defs = malloc((b->vars_len + 1) * sizeof(int));
+  for (i = 0; i < b->vars_len; i++) {
+    s->defs[i] = -1;
+  }
+  return block;
+}
+
+/* Returns the var at frame offset off, or -1 if it is kept in the frame */
+int ir_var(struct ir_builder *b, long off) {
+  int i;
+  for (i = 0; i < b->vars_len; i++) {
+    if (b->var_off[i] == off) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* Appends a new instruction to the current block */
+int ir_emit(struct ir_builder *b, ir_op op, val_kind kind, int x, int y) {
+  int v = ir_new(b->f, op, kind);
+
+  b->f->insns[v].a = x;
+  b->f->insns[v].b = y;
+  ir_insert(b->f, b->cur, b->f->blocks[b->cur].len, v);
+  return v;
+}
+
+int ir_const(struct ir_builder *b, val_kind kind, long k) {
+  int v = ir_emit(b, IrConst, kind, -1, -1);
+  b->f->insns[v].k = norm(kind, k);
+  return v;
+}
+
+int ir_frame(struct ir_builder *b, long off) {
+  int v = ir_emit(b, IrFrame, PtrV, -1, -1);
+  b->f->insns[v].k = off;
+  return v;
+}
+
+/* Ends the current block with a jump to target */
+void ir_jump(struct ir_builder *b, int target) {
+  int v = ir_emit(b, IrJump, VoidV, -1, -1);
+
+  b->f->insns[v].targets = malloc(sizeof(int));
+  b->f->insns[v].targets[0] = target;
+  b->f->insns[v].targets_len = 1;
+  ir_add_pred(b->f, target, b->cur);
+}
+
+/* Ends the current block with a branch on cond */
+void ir_branch(struct ir_builder *b, int cond, int then, int other) {
+  int v = ir_emit(b, IrBranch, VoidV, cond, -1);
+
+  b->f->insns[v].targets = malloc(2 * sizeof(int));
+  b->f->insns[v].targets[0] = then;
+  b->f->insns[v].targets[1] = other;
+  b->f->insns[v].targets_len = 2;
+  ir_add_pred(b->f, then, b->cur);
+  ir_add_pred(b->f, other, b->cur);
+}
+
+/* Continues in a new block no edge reaches, after a jump or return */
+void ir_dead(struct ir_builder *b) {
+  b->cur = ir_block(b);
+  b->bb[b->cur].sealed = true;
+}
+
+int ir_read_var(struct ir_builder *b, int var, int block, val_kind kind);
+
+/* Gives phi an operand from each predecessor of its block */
+void ir_phi_operands(struct ir_builder *b, int phi, int var) {
+  struct ir_fn *f = b->f;
+  int block = f->insns[phi].block;
+  int n = f->blocks[block].preds_len;
+  int *args = malloc((n + 1) * sizeof(int));
+  int i;
+
+  for (i = 0; i < n; i++) {
+    args[i] = ir_read_var(b, var, f->blocks[block].preds[i],
+                          f->insns[phi].kind);
+  }
+  f->insns[phi].args = args;
+  f->insns[phi].args_len = n;
+}
+
+/* Returns a new phi at the start of block, without operands */
+int ir_new_phi(struct ir_builder *b, int block, val_kind kind) {
+  int v = ir_new(b->f, IrPhi, kind);
+  ir_insert(b->f, block, ir_phis(b->f, block), v);
+  return v;
+}
+
+/* Returns the value of var at the end of block, as a kind */
+int ir_read_var(struct ir_builder *b, int var, int block, val_kind kind) {
+  struct ir_build_block *s = b->bb + block;
+  struct ir_block *blk = b->f->blocks + block;
+  int v;
+
+  if (s->defs[var] >= 0) {
+    return s->defs[var];
+  }
+  if (!s->sealed) {
+    v = ir_new_phi(b, block, kind);
+    s->pending = realloc(s->pending, (s->pending_len + 2) * sizeof(int));
+    s->pending[s->pending_len++] = v;
+    s->pending[s->pending_len++] = var;
+  } else if (!blk->preds_len) {
+    /* read before it is written */
+    v = ir_new(b->f, IrConst, kind);
+    ir_insert(b->f, block, ir_phis(b->f, block), v);
+  } else if (blk->preds_len == 1) {
+    v = ir_read_var(b, var, blk->preds[0], kind);
+  } else {
+    /* defined first, to end the cycles through loops */
+    v = ir_new_phi(b, block, kind);
+    b->bb[block].defs[var] = v;
+    ir_phi_operands(b, v, var);
+  }
+  b->bb[block].defs[var] = v;
+  return v;
+}
+
+void ir_write_var(struct ir_builder *b, int var, int v) {
+  b->bb[b->cur].defs[var] = v;
+}
+
+/* Marks block as having all its predecessors, completing its phis */
+void ir_seal(struct ir_builder *b, int block) {
+  struct ir_build_block *s = b->bb + block;
+  int i;
+
+  for (i = 0; i < s->pending_len; i += 2) {
+    ir_phi_operands(b, b->bb[block].pending[i], b->bb[block].pending[i + 1]);
+  }
+  s = b->bb + block;
+  free(s->pending);
+  s->pending = NULL;
+  s->pending_len = 0;
+  s->sealed = true;
+}
+
+int ir_expr(struct ir_builder *, struct inode *);
+
+/* Appends a call of n to the current block, with its args as operands */
+int ir_call(struct ir_builder *b, struct inode *n) {
+  int callee = n->op == CallPtrOp ? ir_expr(b, n->a) : -1;
+  int *args = malloc((n->len + 1) * sizeof(int));
+  int i, v;
+
+  for (i = 0; i < n->len; i++) {
+    args[i] = ir_expr(b, n->list[i]);
+  }
+  v = ir_emit(b,
+              n->op == CallOp      ? IrCall
+              : n->op == CallPtrOp ? IrCallPtr
+                                   : IrBuiltin,
+              n->kind, callee, -1);
+  b->f->insns[v].args = args;
+  b->f->insns[v].args_len = n->len;
+  b->f->insns[v].fn = n->fn;
+  b->f->insns[v].k = n->k;
+  return v;
+}
+
+/* Returns a phi of kind joining x and y from the two preds of the block */
+int ir_phi2(struct ir_builder *b, val_kind kind, int x, int y) {
+  int v = ir_new_phi(b, b->cur, kind);
+
+  b->f->insns[v].args = malloc(2 * sizeof(int));
+  b->f->insns[v].args[0] = x;
+  b->f->insns[v].args[1] = y;
+  b->f->insns[v].args_len = 2;
+  return v;
+}
+
+/* Ends the current block with a branch to then if n is true, else other */
+void ir_cond(struct ir_builder *b, struct inode *n, int then, int other) {
+  int mid;
+
+  switch (n->op) {
+  case ConstOp:
+    ir_jump(b, n->k ? then : other);
+    return;
+  case NotOp:
+    ir_cond(b, n->a, other, then);
+    return;
+  case LogAndOp:
+  case LogOrOp:
+    /* a && b is false if a is, a || b is true if a is */
+    mid = ir_block(b);
+    if (n->op == LogAndOp) {
+      ir_cond(b, n->a, mid, other);
+    } else {
+      ir_cond(b, n->a, then, mid);
+    }
+    ir_seal(b, mid);
+    b->cur = mid;
+    ir_cond(b, n->b, then, other);
+    return;
+  default:
+    ir_branch(b, ir_expr(b, n), then, other);
+    return;
+  }
+}
+
+/* Returns the value n is at the frame offset x, as a var if it is one */
+int ir_load_local(struct ir_builder *b, struct inode *n) {
+  int var = ir_var(b, n->x);
+
+  if (var >= 0) {
+    return ir_read_var(b, var, b->cur, n->kind);
+  }
+  if (n->kind == AggV) {
+    return ir_frame(b, n->x);
+  }
+  return ir_emit(b, IrLoad, n->kind, ir_frame(b, n->x), -1);
+}
+
+/* Stores v of kind at address addr, or in var if it is not -1 */
+void ir_store(struct ir_builder *b, val_kind kind, int var, int addr, int v) {
+  if (var >= 0) {
+    ir_write_var(b, var, v);
+  } else if (kind != AggV && kind != VoidV) {
+    ir_emit(b, IrStore, kind, addr, v);
+  }
+}
+
+/* Returns the value of increment n */
+int ir_inc(struct ir_builder *b, struct inode *n) {
+  int var = n->op == IncLocalOp ? ir_var(b, n->x) : -1;
+  int addr = -1;
+  int old, delta, v;
+
+  if (var >= 0) {
+    old = ir_read_var(b, var, b->cur, n->kind);
+  } else {
+    addr = n->op == IncLocalOp ? ir_frame(b, n->x) : ir_expr(b, n->a);
+    old = ir_emit(b, IrLoad, n->kind, addr, -1);
+  }
+  if (is_float_kind(n->kind)) {
+    delta = ir_emit(b, IrConst, n->kind, -1, -1);
+    b->f->insns[delta].f = n->f;
+    v = ir_emit(b, IrFAdd, n->kind, old, delta);
+  } else {
+    delta = ir_const(b, n->kind == PtrV ? I64V : n->kind, n->k);
+    v = ir_emit(b, IrAdd, n->kind, old, delta);
+  }
+  ir_store(b, n->kind, var, addr, v);
+  return n->post ? old : v;
+}
+
+/* Returns the value of a && b, a || b or a ? b : c, joining two paths */
+int ir_join(struct ir_builder *b, struct inode *n) {
+  int then = ir_block(b), other = ir_block(b), join = ir_block(b);
+  int x, y;
+
+  ir_cond(b, n->op == CondOp ? n->a : n, then, other);
+  ir_seal(b, then);
+  ir_seal(b, other);
+
+  b->cur = then;
+  x = n->op == CondOp ? ir_expr(b, n->b) : ir_const(b, I32V, 1);
+  ir_jump(b, join);
+  b->cur = other;
+  y = n->op == CondOp ? ir_expr(b, n->c) : ir_const(b, I32V, 0);
+  ir_jump(b, join);
+  ir_seal(b, join);
+  b->cur = join;
+
+  return n->kind == VoidV ? -1 : ir_phi2(b, n->kind, x, y);
+}
+
+/* Returns the value of expression n, appending what computes it */
+int ir_expr(struct ir_builder *b, struct inode *n) {
+  int v, a;
+
+  switch (n->op) {
+  case ConstOp:
+    return ir_const(b, n->kind, n->k);
+  case FConstOp:
+    v = ir_emit(b, IrConst, n->kind, -1, -1);
+    b->f->insns[v].f = n->f;
+    return v;
+  case LocalOp:
+    return ir_frame(b, n->x);
+  case GlobalOp:
+    v = ir_emit(b, IrGlobal, PtrV, -1, -1);
+    b->f->insns[v].p = n->p;
+    return v;
+  case FnOp:
+    v = ir_emit(b, IrFn, PtrV, -1, -1);
+    b->f->insns[v].fn = n->fn;
+    return v;
+  case LoadOp:
+    a = ir_expr(b, n->a);
+    /* aggregates are held by address */
+    return n->kind == AggV ? a : ir_emit(b, IrLoad, n->kind, a, -1);
+  case LoadLocalOp:
+    return ir_load_local(b, n);
+  case StoreOp:
+    a = ir_expr(b, n->a);
+    v = ir_expr(b, n->b);
+    ir_store(b, n->kind, -1, a, v);
+    return v;
+  case StoreLocalOp:
+    a = ir_var(b, n->x);
+    if (a < 0) {
+      a = ir_frame(b, n->x);
+      v = ir_expr(b, n->b);
+      ir_store(b, n->kind, -1, a, v);
+    } else {
+      v = ir_expr(b, n->b);
+      ir_store(b, n->kind, a, -1, v);
+    }
+    return v;
+  case CopyOp:
+    a = ir_expr(b, n->a);
+    v = ir_emit(b, IrMemCopy, VoidV, a, ir_expr(b, n->b));
+    b->f->insns[v].k = n->k;
+    return a;
+  case ConvOp:
+    v = ir_emit(b, IrConv, n->kind, ir_expr(b, n->a), -1);
+    b->f->insns[v].x = n->x;
+    return v;
+
+  case AddOp:
+  case SubOp:
+  case MulOp:
+  case DivOp:
+  case UDivOp:
+  case ModOp:
+  case UModOp:
+  case ShlOp:
+  case ShrOp:
+  case UShrOp:
+  case AndOp:
+  case OrOp:
+  case XorOp:
+  case EqOp:
+  case NeOp:
+  case LtOp:
+  case LeOp:
+  case ULtOp:
+  case ULeOp:
+  case FAddOp:
+  case FSubOp:
+  case FMulOp:
+  case FDivOp:
+  case FEqOp:
+  case FNeOp:
+  case FLtOp:
+  case FLeOp:
+  case PtrAddOp:
+  case PtrDiffOp:
+    a = ir_expr(b, n->a);
+    v = ir_emit(b, IrAdd + (n->op - AddOp), n->kind, a, ir_expr(b, n->b));
+    b->f->insns[v].k = n->k;
+    return v;
+  case NegOp:
+  case ComplOp:
+  case FNegOp:
+  case NotOp:
+    return ir_emit(b, IrAdd + (n->op - AddOp), n->kind, ir_expr(b, n->a), -1);
+
+  case LogAndOp:
+  case LogOrOp:
+  case CondOp:
+    return ir_join(b, n);
+  case SeqOp:
+    ir_expr(b, n->a);
+    return ir_expr(b, n->b);
+  case IncOp:
+  case IncLocalOp:
+    return ir_inc(b, n);
+  case CallOp:
+  case CallPtrOp:
+  case BuiltinOp:
+    return ir_call(b, n);
+  default:
+    interp_fail(b->in, "not an expression", NULL);
+    return -1;
+  }
+}
+
+void ir_stmt(struct ir_builder *, struct inode *);
+
+/* Appends a loop, testing cond before the first pass if test_first */
+void ir_loop(struct ir_builder *b, struct inode *cond, struct inode *iter,
+             struct inode *body, bool test_first) {
+  int brk = b->brk, cont = b->cont;
+  int top = ir_block(b), test = ir_block(b);
+  int step = iter ? ir_block(b) : test;
+  int out = ir_block(b);
+
+  b->brk = out;
+  b->cont = step;
+  ir_jump(b, test_first ? test : top);
+  if (test_first) {
+    b->cur = test;
+    if (cond) {
+      ir_cond(b, cond, top, out);
+    } else {
+      ir_jump(b, top);
+    }
+    ir_seal(b, top);
+  }
+
+  b->cur = top;
+  ir_stmt(b, body);
+  ir_jump(b, step);
+  if (iter) {
+    ir_seal(b, step);
+    b->cur = step;
+    ir_expr(b, iter);
+    ir_jump(b, test);
+  }
+  ir_seal(b, test);
+
+  if (!test_first) {
+    b->cur = test;
+    ir_cond(b, cond, top, out);
+    ir_seal(b, top);
+  }
+  ir_seal(b, out);
+  b->cur = out;
+
+  b->brk = brk;
+  b->cont = cont;
+}
+
+void ir_switch(struct ir_builder *b, struct inode *n) {
+  int brk = b->brk;
+  int len = n->d->len;
+  int *at = malloc((len + 1) * sizeof(int));
+  int v = ir_expr(b, n->a);
+  struct ir_insn *sw;
+  int i, s;
+
+  /* a block for each statement with a label, the last being the exit */
+  for (i = 0; i <= len; i++) {
+    at[i] = -1;
+  }
+  for (i = 0; i < n->cases_len; i++) {
+    at[n->case_at[i]] = 0;
+  }
+  at[n->default_at] = 0;
+  for (i = 0; i < len; i++) {
+    if (!at[i]) {
+      at[i] = ir_block(b);
+    }
+  }
+  at[len] = b->brk = ir_block(b);
+
+  s = ir_emit(b, IrSwitch, VoidV, v, -1);
+  sw = b->f->insns + s;
+  sw->targets_len = n->cases_len + 1;
+  sw->targets = malloc(sw->targets_len * sizeof(int));
+  sw->cases = malloc((n->cases_len + 1) * sizeof(long));
+  for (i = 0; i < n->cases_len; i++) {
+    sw->cases[i] = n->cases[i];
+    sw->targets[i] = at[n->case_at[i]];
+    ir_add_pred(b->f, sw->targets[i], b->cur);
+  }
+  sw->targets[i] = at[n->default_at];
+  ir_add_pred(b->f, sw->targets[i], b->cur);
+
+  ir_dead(b);
+  for (i = 0; i < len; i++) {
+    if (at[i] >= 0) {
+      ir_jump(b, at[i]);
+      ir_seal(b, at[i]);
+      b->cur = at[i];
+    }
+    ir_stmt(b, n->d->list[i]);
+  }
+  ir_jump(b, at[len]);
+  ir_seal(b, at[len]);
+  b->cur = at[len];
+
+  b->brk = brk;
+  free(at);
+}
+
+void ir_stmt(struct ir_builder *b, struct inode *n) {
+  int then, other, join, v;
+  int i;
+
+  switch (n->op) {
+  case NopOp:
+    return;
+  case ExprOp:
+    ir_expr(b, n->a);
+    return;
+  case BlockOp:
+    for (i = 0; i < n->len; i++) {
+      ir_stmt(b, n->list[i]);
+    }
+    return;
+  case IfOp:
+    then = ir_block(b);
+    join = ir_block(b);
+    other = n->c ? ir_block(b) : join;
+    ir_cond(b, n->a, then, other);
+    ir_seal(b, then);
+    b->cur = then;
+    ir_stmt(b, n->b);
+    ir_jump(b, join);
+    if (n->c) {
+      ir_seal(b, other);
+      b->cur = other;
+      ir_stmt(b, n->c);
+      ir_jump(b, join);
+    }
+    ir_seal(b, join);
+    b->cur = join;
+    return;
+  case WhileOp:
+    ir_loop(b, n->a, NULL, n->b, true);
+    return;
+  case DoOp:
+    ir_loop(b, n->a, NULL, n->b, false);
+    return;
+  case ForOp:
+    if (n->a) {
+      ir_expr(b, n->a);
+    }
+    ir_loop(b, n->b, n->c, n->d, true);
+    return;
+  case SwitchOp:
+    ir_switch(b, n);
+    return;
+  case BreakOp:
+    ir_jump(b, b->brk);
+    ir_dead(b);
+    return;
+  case ContinueOp:
+    ir_jump(b, b->cont);
+    ir_dead(b);
+    return;
+  case ReturnOp:
+    ir_emit(b, IrRet, VoidV, n->a ? ir_expr(b, n->a) : -1, -1);
+    ir_dead(b);
+    return;
+  case ZeroOp:
+    v = ir_emit(b, IrMemZero, VoidV, ir_frame(b, n->x), -1);
+    b->f->insns[v].k = n->k;
+    return;
+  default:
+    ir_expr(b, n);
+    return;
+  }
+}
+
+struct ir_fn *ir_build(struct interp *in, struct interp_fn *fn) {
+  struct ir_fn *f = calloc(1, sizeof(*f));
+  struct ir_builder b;
+  bool *ok = slot_promotable(fn);
+  int i, v, var;
+
+  memset(&b, 0, sizeof(b));
+  b.in = in;
+  b.f = f;
+  b.fn = fn;
+  b.brk = b.cont = -1;
+  f->in = in;
+  f->fn = fn;
+
+  /* the scalars at an offset are one var */
+  b.var_off = malloc((fn->slots_len + 1) * sizeof(long));
+  for (i = 0; i < fn->slots_len; i++) {
+    if (ok[i] && ir_var(&b, fn->slots[i].off) < 0) {
+      b.var_off[b.vars_len++] = fn->slots[i].off;
+    }
+  }
+  free(ok);
+
+  b.cur = ir_block(&b);
+  b.bb[b.cur].sealed = true;
+  for (i = 0; i < fn->params_len; i++) {
+    v = ir_emit(&b, IrParam, fn->param_kind[i], -1, -1);
+    f->insns[v].k = i;
+    if ((var = ir_var(&b, fn->param_off[i])) >= 0) {
+      ir_write_var(&b, var, v);
+    } else if (fn->param_kind[i] == AggV) {
+      v = ir_emit(&b, IrMemCopy, VoidV, ir_frame(&b, fn->param_off[i]), v);
+      f->insns[v].k = fn->param_size[i];
+    } else {
+      ir_store(&b, fn->param_kind[i], -1, ir_frame(&b, fn->param_off[i]), v);
+    }
+  }
+  ir_stmt(&b, fn->body);
+  ir_emit(&b, IrRet, VoidV, -1, -1);
+
+  for (i = 0; i < f->blocks_len; i++) {
+    free(b.bb[i].defs);
+    free(b.bb[i].pending);
+  }
+  free(b.bb);
+  free(b.var_off);
+  return f;
+}
+
+struct interp_fn *ir_init_fn(struct interp *in) {
+  struct interp_fn *fn = calloc(1, sizeof(*fn));
+  struct inode *body = calloc(1, sizeof(*body));
+
+  body->op = BlockOp;
+  body->kind = VoidV;
+  body->list = in->inits;
+  body->len = in->inits_len;
+  fn->name = "chocc.init";
+  fn->id = in->fns_len;
+  fn->body = body;
+  fn->ret_kind = VoidV;
+  return fn;
+}
+
+/*
+ * Evaluation
+ */
+
+/* Returns whether op computes its value from its operands alone */
+bool ir_pure(ir_op op) {
+  return op == IrConst || op == IrCopy || op == IrConv ||
+         (IrAdd <= op && op <= IrNot);
+}
+
+bool ir_eval(struct ir_insn *i, value a, value b, value *v) {
+  value r;
+
+  r.i = 0;
+  switch (i->op) {
+  case IrConst:
+    if (is_float_kind(i->kind)) {
+      r.d = i->f;
+    } else {
+      r.i = i->k;
+    }
+    break;
+  case IrCopy:
+    r = a;
+    break;
+  case IrConv:
+    r = convert(i->x, i->kind, a);
+    break;
+
+  case IrAdd:
+    r.i = norm(i->kind, (long)((unsigned long)a.i + (unsigned long)b.i));
+    break;
+  case IrSub:
+    r.i = norm(i->kind, (long)((unsigned long)a.i - (unsigned long)b.i));
+    break;
+  case IrMul:
+    r.i = norm(i->kind, (long)((unsigned long)a.i * (unsigned long)b.i));
+    break;
+  case IrDiv:
+  case IrMod:
+    if (!b.i) {
+      return false;
+    }
+    if (b.i == -1) {
+      /* LONG_MIN / -1 traps */
+      r.i = i->op == IrDiv ? norm(i->kind, (long)-(unsigned long)a.i) : 0;
+    } else {
+      r.i = norm(i->kind, i->op == IrDiv ? a.i / b.i : a.i % b.i);
+    }
+    break;
+  case IrUDiv:
+  case IrUMod:
+    if (!b.i) {
+      return false;
+    }
+    r.i = i->op == IrUDiv ? (long)((unsigned long)a.i / (unsigned long)b.i)
+                          : (long)((unsigned long)a.i % (unsigned long)b.i);
+    r.i = norm(i->kind, r.i);
+    break;
+  case IrShl:
+    r.i = norm(i->kind, (long)((unsigned long)a.i << (b.i & 63)));
+    break;
+  case IrShr:
+    r.i = a.i >> (b.i & 63);
+    break;
+  case IrUShr:
+    r.i = (long)((unsigned long)a.i >> (b.i & 63));
+    break;
+  case IrAnd:
+    r.i = a.i & b.i;
+    break;
+  case IrOr:
+    r.i = a.i | b.i;
+    break;
+  case IrXor:
+    r.i = a.i ^ b.i;
+    break;
+  case IrNeg:
+    r.i = norm(i->kind, (long)-(unsigned long)a.i);
+    break;
+  case IrCompl:
+    r.i = norm(i->kind, ~a.i);
+    break;
+  case IrEq:
+    r.i = a.i == b.i;
+    break;
+  case IrNe:
+    r.i = a.i != b.i;
+    break;
+  case IrLt:
+    r.i = a.i < b.i;
+    break;
+  case IrLe:
+    r.i = a.i <= b.i;
+    break;
+  case IrULt:
+    r.i = (unsigned long)a.i < (unsigned long)b.i;
+    break;
+  case IrULe:
+    r.i = (unsigned long)a.i <= (unsigned long)b.i;
+    break;
+
+  case IrFAdd:
+    r.d = a.d + b.d;
+    break;
+  case IrFSub:
+    r.d = a.d - b.d;
+    break;
+  case IrFMul:
+    r.d = a.d * b.d;
+    break;
+  case IrFDiv:
+    r.d = a.d / b.d;
+    break;
+  case IrFNeg:
+    r.d = -a.d;
+    break;
+  case IrFEq:
+    r.i = a.d == b.d;
+    break;
+  case IrFNe:
+    r.i = a.d != b.d;
+    break;
+  case IrFLt:
+    r.i = a.d < b.d;
+    break;
+  case IrFLe:
+    r.i = a.d <= b.d;
+    break;
+
+  case IrPtrAdd:
+    r.i = (long)((unsigned long)a.i + (unsigned long)b.i * i->k);
+    break;
+  case IrPtrDiff:
+    r.i = (long)((unsigned long)a.i - (unsigned long)b.i) / i->k;
+    break;
+  case IrNot:
+    r.i = !a.i;
+    break;
+  default:
+    return false;
+  }
+
+  /* float arithmetic, rounded to float */
+  if (IrFAdd <= i->op && i->op <= IrFDiv && i->kind == F32V) {
+    r.d = (float)r.d;
+  }
+  *v = r;
+  return true;
+}
+
+/*
+ * Passes
+ */
+
+/* ir_uses lists the users of each value v, from users + at[v] to at[v+1] */
+struct ir_uses {
+  int *at;
+  int *users;
+};
+
+void ir_find_uses(struct ir_fn *f, struct ir_uses *u) {
+  int n = f->insns_len;
+  int *next;
+  int v, j;
+
+  u->at = calloc(n + 2, sizeof(int));
+  for (v = 0; v < n; v++) {
+    struct ir_insn *i = f->insns + v;
+    for (j = 0; i->block >= 0 && j < 2 + i->args_len; j++) {
+      if (*ir_use(i, j) >= 0) {
+        u->at[*ir_use(i, j) + 1]++;
+      }
+    }
+  }
+  for (v = 0; v < n; v++) {
+    u->at[v + 1] += u->at[v];
+  }
+  u->users = malloc((u->at[n] + 1) * sizeof(int));
+  next = malloc((n + 1) * sizeof(int));
+  memcpy(next, u->at, n * sizeof(int));
+  for (v = 0; v < n; v++) {
+    struct ir_insn *i = f->insns + v;
+    for (j = 0; i->block >= 0 && j < 2 + i->args_len; j++) {
+      if (*ir_use(i, j) >= 0) {
+        u->users[next[*ir_use(i, j)]++] = v;
+      }
+    }
+  }
+  free(next);
+}
+
+/* the lattice of constant propagation, each value only moving down it */
+typedef enum ir_lattice { IrUnknown, IrConstant, IrVarying } ir_lattice;
+
+/*
+ * ir_sccp is the state of sparse conditional constant propagation, after
+ * Wegman and Zadeck. Blocks are visited once an edge to them is found
+ * executable, and values are revisited when their operands change.
+ */
+struct ir_sccp {
+  struct ir_fn *f;
+  struct ir_uses uses;
+  ir_lattice *state;
+  value *vals;
+  bool *reached; /* by block */
+  bool *edges;   /* by predecessor of each block, from edge_at[block] */
+  int *edge_at;
+
+  int *blocks; /* worklists */
+  int blocks_len;
+  int *work;
+  int work_len;
+};
+
+void ir_sccp_set(struct ir_sccp *s, int v, ir_lattice st, value val) {
+  if (st == IrConstant && s->state[v] == IrConstant &&
+      s->vals[v].i != val.i) {
+    st = IrVarying;
+  }
+  if (st <= s->state[v]) {
+    return;
+  }
+  s->state[v] = st;
+  s->vals[v] = val;
+  s->work[s->work_len++] = v;
+}
+
+void ir_sccp_visit(struct ir_sccp *, int v);
+
+/* Marks the edge from block to target executable */
+void ir_sccp_edge(struct ir_sccp *s, int block, int target) {
+  struct ir_fn *f = s->f;
+  int at = s->edge_at[target] + ir_pred_index(f, target, block);
+  int phis = ir_phis(f, target);
+  int j;
+
+  if (s->edges[at]) {
+    return;
+  }
+  s->edges[at] = true;
+  if (!s->reached[target]) {
+    s->reached[target] = true;
+    s->blocks[s->blocks_len++] = target;
+    return;
+  }
+  /* a new operand for each phi */
+  for (j = 0; j < phis; j++) {
+    ir_sccp_visit(s, f->blocks[target].insns[j]);
+  }
+}
+
+/* Returns the target of switch i for value k */
+int ir_switch_target(struct ir_insn *i, long k) {
+  int j;
+  for (j = 0; j < i->targets_len - 1 && i->cases[j] != k; j++) {
+  }
+  return i->targets[j];
+}
+
+void ir_sccp_terminator(struct ir_sccp *s, struct ir_insn *i) {
+  ir_lattice st = i->a >= 0 ? s->state[i->a] : IrVarying;
+  int j;
+
+  if (i->op == IrJump || st == IrVarying) {
+    for (j = 0; j < i->targets_len; j++) {
+      ir_sccp_edge(s, i->block, i->targets[j]);
+    }
+  } else if (st == IrConstant && i->op == IrBranch) {
+    ir_sccp_edge(s, i->block, i->targets[s->vals[i->a].i ? 0 : 1]);
+  } else if (st == IrConstant && i->op == IrSwitch) {
+    ir_sccp_edge(s, i->block, ir_switch_target(i, s->vals[i->a].i));
+  }
+}
+
+void ir_sccp_visit(struct ir_sccp *s, int v) {
+  struct ir_insn *i = s->f->insns + v;
+  ir_lattice st = IrUnknown, sa, sb;
+  value val;
+  int j;
+
+  val.i = 0;
+  if (ir_is_terminator(i->op)) {
+    ir_sccp_terminator(s, i);
+    return;
+  }
+  if (i->op == IrPhi) {
+    /* the meet of the operands along executable edges */
+    for (j = 0; j < i->args_len && st != IrVarying; j++) {
+      int arg = i->args[j];
+      if (!s->edges[s->edge_at[i->block] + j] ||
+          s->state[arg] == IrUnknown) {
+        continue;
+      }
+      if (s->state[arg] == IrVarying ||
+          (st == IrConstant && s->vals[arg].i != val.i)) {
+        st = IrVarying;
+      } else {
+        st = IrConstant;
+        val = s->vals[arg];
+      }
+    }
+  } else if (ir_pure(i->op)) {
+    sa = i->a >= 0 ? s->state[i->a] : IrConstant;
+    sb = i->b >= 0 ? s->state[i->b] : IrConstant;
+    if (sa == IrVarying || sb == IrVarying) {
+      st = IrVarying;
+    } else if (sa == IrConstant && sb == IrConstant) {
+      st = ir_eval(i, i->a >= 0 ? s->vals[i->a] : val,
+                   i->b >= 0 ? s->vals[i->b] : val, &val)
+               ? IrConstant
+               : IrVarying;
+    }
+  } else {
+    st = IrVarying;
+  }
+  ir_sccp_set(s, v, st, val);
+}
+
+/*
+ * Replaces the values constant propagation proves constant with constants
+ * and the branches it proves one way with jumps.
+ */
+void ir_constprop(struct ir_fn *f) {
+  struct ir_sccp s;
+  int v, j, b, n;
+
+  memset(&s, 0, sizeof(s));
+  s.f = f;
+  ir_find_uses(f, &s.uses);
+  s.state = calloc(f->insns_len + 1, sizeof(ir_lattice));
+  s.vals = calloc(f->insns_len + 1, sizeof(value));
+  s.reached = calloc(f->blocks_len + 1, sizeof(bool));
+  s.edge_at = malloc((f->blocks_len + 1) * sizeof(int));
+  for (b = n = 0; b < f->blocks_len; b++) {
+    s.edge_at[b] = n;
+    n += f->blocks[b].preds_len;
+  }
+  s.edges = calloc(n + 1, sizeof(bool));
+  s.blocks = malloc((f->blocks_len + 1) * sizeof(int));
+  /* values are queued when they change, at most twice */
+  s.work = malloc((2 * f->insns_len + 1) * sizeof(int));
+
+  s.reached[0] = true;
+  s.blocks[s.blocks_len++] = 0;
+  while (s.blocks_len || s.work_len) {
+    if (s.blocks_len) {
+      b = s.blocks[--s.blocks_len];
+      for (j = 0; j < f->blocks[b].len; j++) {
+        ir_sccp_visit(&s, f->blocks[b].insns[j]);
+      }
+      continue;
+    }
+    v = s.work[--s.work_len];
+    for (j = s.uses.at[v]; j < s.uses.at[v + 1]; j++) {
+      if (s.reached[f->insns[s.uses.users[j]].block]) {
+        ir_sccp_visit(&s, s.uses.users[j]);
+      }
+    }
+  }
+
+  for (v = 0; v < f->insns_len; v++) {
+    struct ir_insn *i = f->insns + v;
+    if (i->block < 0 || !s.reached[i->block] || s.state[v] != IrConstant ||
+        i->op == IrConst || (i->op != IrPhi && !ir_pure(i->op))) {
+      continue;
+    }
+    free(i->args);
+    i->args = NULL;
+    i->args_len = 0;
+    i->a = i->b = -1;
+    i->op = IrConst;
+    if (is_float_kind(i->kind)) {
+      i->f = s.vals[v].d;
+    } else {
+      i->k = s.vals[v].i;
+    }
+  }
+
+  /* phis made constants move after the rest */
+  for (b = 0; b < f->blocks_len; b++) {
+    struct ir_block *blk = f->blocks + b;
+    int *order = malloc((blk->len + 1) * sizeof(int));
+    n = 0;
+    for (j = 0; j < blk->len; j++) {
+      if (f->insns[blk->insns[j]].op == IrPhi) {
+        order[n++] = blk->insns[j];
+      }
+    }
+    for (j = 0; j < blk->len; j++) {
+      if (f->insns[blk->insns[j]].op != IrPhi) {
+        order[n++] = blk->insns[j];
+      }
+    }
+    free(blk->insns);
+    blk->insns = order;
+    blk->cap = blk->len + 1;
+  }
+
+  /* only then are edges dropped, with the phi operands along them */
+  for (b = 0; b < f->blocks_len; b++) {
+    struct ir_insn *t = ir_terminator(f, b);
+    if (s.reached[b] && t && (t->op == IrBranch || t->op == IrSwitch) &&
+        s.state[t->a] == IrConstant) {
+      ir_make_jump(f, t,
+                   t->op == IrBranch
+                       ? t->targets[s.vals[t->a].i ? 0 : 1]
+                       : ir_switch_target(t, s.vals[t->a].i));
+    }
+  }
+
+  free(s.uses.at);
+  free(s.uses.users);
+  free(s.state);
+  free(s.vals);
+  free(s.reached);
+  free(s.edge_at);
+  free(s.edges);
+  free(s.blocks);
+  free(s.work);
+}
+
+/*
+ * Returns the value v copies, following copies, conversions keeping the
+ * value and phis of one value besides themselves.
+ */
+int ir_copied(struct ir_fn *f, int v) {
+  int steps, j, w;
+
+  for (steps = 0; steps < f->insns_len; steps++) {
+    struct ir_insn *i = f->insns + v;
+
+    w = -1;
+    if (i->op == IrCopy ||
+        (i->op == IrConv && kind_fits((val_kind)i->x, i->kind))) {
+      w = i->a;
+    } else if (i->op == IrPhi) {
+      for (j = 0; j < i->args_len; j++) {
+        if (i->args[j] == v || i->args[j] == w) {
+          continue;
+        }
+        if (w >= 0) {
+          return v;
+        }
+        w = i->args[j];
+      }
+    }
+    if (w < 0) {
+      return v;
+    }
+    v = w;
+  }
+  return v;
+}
+
+/* Makes the users of copies use the values they copy */
+void ir_copyprop(struct ir_fn *f) {
+  bool changed = true;
+  int rounds, v, j, w;
+
+  /* phis become copies as their operands do */
+  for (rounds = 0; changed && rounds < f->insns_len; rounds++) {
+    changed = false;
+    for (v = 0; v < f->insns_len; v++) {
+      struct ir_insn *i = f->insns + v;
+      for (j = 0; i->block >= 0 && j < 2 + i->args_len; j++) {
+        int *use = ir_use(i, j);
+        if (*use >= 0 && (w = ir_copied(f, *use)) != *use) {
+          *use = w;
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+/* Returns whether i must run even if its value is unused */
+bool ir_has_effect(struct ir_fn *f, struct ir_insn *i) {
+  switch (i->op) {
+  case IrStore:
+  case IrMemCopy:
+  case IrMemZero:
+  case IrCall:
+  case IrCallPtr:
+  case IrBuiltin:
+    return true;
+  case IrDiv:
+  case IrUDiv:
+  case IrMod:
+  case IrUMod:
+    /* dividing by zero fails */
+    return f->insns[i->b].op != IrConst || !f->insns[i->b].k;
+  default:
+    return ir_is_terminator(i->op);
+  }
+}
+
+/* Removes the instructions whose values nothing with an effect needs */
+void ir_dce(struct ir_fn *f) {
+  bool *live = calloc(f->insns_len + 1, sizeof(bool));
+  int *work = malloc((f->insns_len + 1) * sizeof(int));
+  int len = 0;
+  int v, j;
+
+  for (v = 0; v < f->insns_len; v++) {
+    if (f->insns[v].block >= 0 && ir_has_effect(f, f->insns + v)) {
+      live[v] = true;
+      work[len++] = v;
+    }
+  }
+  while (len) {
+    struct ir_insn *i = f->insns + work[--len];
+    for (j = 0; j < 2 + i->args_len; j++) {
+      int u = *ir_use(i, j);
+      if (u >= 0 && !live[u]) {
+        live[u] = true;
+        work[len++] = u;
+      }
+    }
+  }
+  for (v = 0; v < f->insns_len; v++) {
+    if (f->insns[v].block >= 0 && !live[v]) {
+      ir_remove(f, v);
+    }
+  }
+  free(live);
+  free(work);
+}
+
+/* Removes the instructions and edges of block, leaving it empty */
+void ir_clear_block(struct ir_fn *f, int block) {
+  struct ir_insn *t = ir_terminator(f, block);
+  int *targets = NULL;
+  int len = 0, j;
+
+  if (t) {
+    targets = t->targets;
+    len = t->targets_len;
+    t->targets = NULL;
+    t->targets_len = 0;
+  }
+  for (j = 0; j < len; j++) {
+    ir_unlink(f, block, targets[j]);
+  }
+  free(targets);
+  while (f->blocks[block].len) {
+    ir_remove(f, f->blocks[block].insns[f->blocks[block].len - 1]);
+  }
+  f->blocks[block].preds_len = 0;
+}
+
+/* Returns by block whether it is reachable from the entry */
+bool *ir_reachable(struct ir_fn *f) {
+  bool *seen = calloc(f->blocks_len + 1, sizeof(bool));
+  int *stack = malloc((f->blocks_len + 1) * sizeof(int));
+  int len = 0, j;
+
+  seen[0] = true;
+  stack[len++] = 0;
+  while (len) {
+    struct ir_insn *t = ir_terminator(f, stack[--len]);
+    for (j = 0; t && j < t->targets_len; j++) {
+      if (!seen[t->targets[j]]) {
+        seen[t->targets[j]] = true;
+        stack[len++] = t->targets[j];
+      }
+    }
+  }
+  free(stack);
+  return seen;
+}
+
+/* Makes a branch or switch with one target, or a constant operand, jump */
+bool ir_fold_branch(struct ir_fn *f, struct ir_insn *t) {
+  int j;
+
+  if (t->op != IrBranch && t->op != IrSwitch) {
+    return false;
+  }
+  if (f->insns[t->a].op == IrConst) {
+    ir_make_jump(f, t,
+                 t->op == IrBranch
+                     ? t->targets[f->insns[t->a].k ? 0 : 1]
+                     : ir_switch_target(t, f->insns[t->a].k));
+    return true;
+  }
+  for (j = 1; j < t->targets_len; j++) {
+    if (t->targets[j] != t->targets[0]) {
+      return false;
+    }
+  }
+  ir_make_jump(f, t, t->targets[0]);
+  return true;
+}
+
+/* Appends the block a jump to its only successor ends into it */
+bool ir_merge(struct ir_fn *f, int block) {
+  struct ir_insn *t = ir_terminator(f, block);
+  struct ir_block *s;
+  int succ, j, k;
+
+  if (t->op != IrJump) {
+    return false;
+  }
+  succ = t->targets[0];
+  s = f->blocks + succ;
+  if (succ == block || !succ || s->preds_len != 1 || ir_phis(f, succ)) {
+    return false;
+  }
+
+  ir_remove(f, f->blocks[block].insns[f->blocks[block].len - 1]);
+  for (j = 0; j < s->len; j++) {
+    ir_insert(f, block, f->blocks[block].len, s->insns[j]);
+  }
+  s->len = 0;
+  s->preds_len = 0;
+  t = ir_terminator(f, block);
+  for (j = 0; j < t->targets_len; j++) {
+    k = ir_pred_index(f, t->targets[j], succ);
+    if (k >= 0) {
+      f->blocks[t->targets[j]].preds[k] = block;
+    }
+  }
+  return true;
+}
+
+/*
+ * Makes the predecessors of a block holding only a jump jump past it,
+ * where the phis of the target allow.
+ */
+bool ir_thread(struct ir_fn *f, int block) {
+  struct ir_block *e = f->blocks + block;
+  struct ir_insn *t, *pt;
+  bool changed = false;
+  int target, from, phis, at, i, j;
+
+  if (!block || e->len != 1 || (t = ir_terminator(f, block))->op != IrJump) {
+    return false;
+  }
+  target = t->targets[0];
+  phis = ir_phis(f, target);
+  at = ir_pred_index(f, target, block);
+  /* through a chain of such blocks from its end, never round a cycle */
+  if (target == block || (f->blocks[target].len == 1 &&
+                          ir_terminator(f, target)->op == IrJump)) {
+    return false;
+  }
+
+  for (i = 0; i < e->preds_len;) {
+    from = e->preds[i];
+    if (phis && ir_pred_index(f, target, from) >= 0) {
+      i++;
+      continue;
+    }
+    pt = ir_terminator(f, from);
+    for (j = 0; j < pt->targets_len; j++) {
+      if (pt->targets[j] == block) {
+        pt->targets[j] = target;
+      }
+    }
+    if (ir_pred_index(f, target, from) < 0) {
+      ir_add_pred(f, target, from);
+      for (j = 0; j < phis; j++) {
+        struct ir_insn *phi = f->insns + f->blocks[target].insns[j];
+        phi->args = realloc(phi->args, (phi->args_len + 1) * sizeof(int));
+        phi->args[phi->args_len++] = phi->args[at];
+      }
+    }
+    ir_remove_pred(f, block, i);
+    changed = true;
+  }
+  return changed;
+}
+
+/* Renumbers the blocks left, dropping the empty ones */
+void ir_compact(struct ir_fn *f) {
+  int *map = malloc((f->blocks_len + 1) * sizeof(int));
+  int n = 0, b, j;
+
+  for (b = 0; b < f->blocks_len; b++) {
+    map[b] = !b || f->blocks[b].len ? n++ : -1;
+  }
+  for (b = 0; b < f->blocks_len; b++) {
+    struct ir_block *blk = f->blocks + b;
+    struct ir_insn *t;
+
+    if (map[b] < 0) {
+      free(blk->insns);
+      free(blk->preds);
+      continue;
+    }
+    for (j = 0; j < blk->len; j++) {
+      f->insns[blk->insns[j]].block = map[b];
+    }
+    for (j = 0; j < blk->preds_len; j++) {
+      blk->preds[j] = map[blk->preds[j]];
+    }
+    t = ir_terminator(f, b);
+    for (j = 0; t && j < t->targets_len; j++) {
+      t->targets[j] = map[t->targets[j]];
+    }
+    f->blocks[map[b]] = *blk;
+  }
+  f->blocks_len = n;
+  free(map);
+}
+
+/*
+ * Simplifies the control flow graph: folds branches going one way, removes
+ * unreachable blocks, merges blocks into their only predecessor and jumps
+ * past blocks that only jump.
+ */
+void ir_simplify(struct ir_fn *f) {
+  bool changed = true;
+  bool *reached;
+  int b;
+
+  while (changed) {
+    changed = false;
+    reached = ir_reachable(f);
+    for (b = 0; b < f->blocks_len; b++) {
+      if (!reached[b] && f->blocks[b].len) {
+        ir_clear_block(f, b);
+        changed = true;
+      }
+    }
+    free(reached);
+
+    for (b = 0; b < f->blocks_len; b++) {
+      if (!f->blocks[b].len) {
+        continue;
+      }
+      if (ir_fold_branch(f, ir_terminator(f, b))) {
+        changed = true;
+      }
+      while (ir_merge(f, b)) {
+        changed = true;
+      }
+      if (ir_thread(f, b)) {
+        changed = true;
+      }
+    }
+  }
+  ir_compact(f);
+}
+
+struct ir_pass ir_passes[IR_PASSES] = {{"constprop", ir_constprop},
+                                       {"simplify", ir_simplify},
+                                       {"copyprop", ir_copyprop},
+                                       {"dce", ir_dce},
+                                       {"simplify", ir_simplify}};
+
+/*
+ * Verification
+ */
+
+/* Returns whether op defines a value other instructions may use */
+bool ir_has_value(ir_op op) {
+  return op != IrNop && op != IrStore && op != IrMemCopy &&
+         op != IrMemZero && !ir_is_terminator(op);
+}
+
+/* Returns the number of operands a and b op needs */
+int ir_arity(ir_op op) {
+  switch (op) {
+  case IrCopy:
+  case IrLoad:
+  case IrMemZero:
+  case IrConv:
+  case IrNeg:
+  case IrCompl:
+  case IrFNeg:
+  case IrNot:
+  case IrCallPtr:
+  case IrBranch:
+  case IrSwitch:
+    return 1;
+  case IrStore:
+  case IrMemCopy:
+    return 2;
+  default:
+    return IrAdd <= op && op <= IrPtrDiff ? 2 : 0;
+  }
+}
+
+/*
+ * Returns the immediate dominator of each block, -1 if it is unreachable,
+ * by Cooper, Harvey and Kennedy's iteration over the reverse postorder.
+ * order receives each block's index in that order.
+ */
+int *ir_dominators(struct ir_fn *f, int *order) {
+  int n = f->blocks_len;
+  int *idom = malloc((n + 1) * sizeof(int));
+  int *rpo = malloc((n + 1) * sizeof(int));
+  int *stack = malloc((2 * n + 2) * sizeof(int));
+  int len = 0, post = n, b, j, p, x, y;
+  bool changed = true;
+
+  for (b = 0; b < n; b++) {
+    idom[b] = -1;
+    order[b] = -1;
+  }
+
+  /* postorder by a depth first search holding each block's next edge */
+  order[0] = 0;
+  stack[len++] = 0;
+  stack[len++] = 0;
+  while (len) {
+    struct ir_insn *t = ir_terminator(f, stack[len - 2]);
+    j = stack[len - 1]++;
+    if (t && j < t->targets_len) {
+      b = t->targets[j];
+      if (order[b] < 0) {
+        order[b] = 0;
+        stack[len++] = b;
+        stack[len++] = 0;
+      }
+      continue;
+    }
+    rpo[--post] = stack[len - 2];
+    len -= 2;
+  }
+  for (j = post; j < n; j++) {
+    order[rpo[j]] = j;
+  }
+
+  idom[0] = 0;
+  while (changed) {
+    changed = false;
+    for (j = post + 1; j < n; j++) {
+      struct ir_block *blk = f->blocks + rpo[j];
+      int d = -1;
+      for (p = 0; p < blk->preds_len; p++) {
+        if (idom[blk->preds[p]] < 0) {
+          continue;
+        }
+        if (d < 0) {
+          d = blk->preds[p];
+          continue;
+        }
+        x = blk->preds[p];
+        y = d;
+        while (x != y) {
+          while (order[x] > order[y]) {
+            x = idom[x];
+          }
+          while (order[y] > order[x]) {
+            y = idom[y];
+          }
+        }
+        d = x;
+      }
+      if (idom[rpo[j]] != d) {
+        idom[rpo[j]] = d;
+        changed = true;
+      }
+    }
+  }
+  free(rpo);
+  free(stack);
+  return idom;
+}
+
+/* Returns whether block d dominates block b */
+bool ir_dominates(int *idom, int d, int b) {
+  while (b != d && idom[b] != b) {
+    b = idom[b];
+  }
+  return b == d;
+}
+
+/* Returns why the uses of i, at index at of its block, are malformed */
+const char *ir_verify_uses(struct ir_fn *f, struct ir_insn *i, int at,
+                           int *idom, int *pos) {
+  int j, u, in;
+
+  if ((ir_arity(i->op) > 0 && i->a < 0) || (ir_arity(i->op) > 1 && i->b < 0)) {
+    return "missing operand";
+  }
+  for (j = 0; j < 2 + i->args_len; j++) {
+    if ((u = *ir_use(i, j)) < 0) {
+      continue;
+    }
+    if (u >= f->insns_len || f->insns[u].block < 0) {
+      return "use of a removed value";
+    }
+    if (!ir_has_value(f->insns[u].op)) {
+      return "use of an instruction without a value";
+    }
+    /* a phi uses its operands at the end of their predecessors */
+    in = i->op == IrPhi && j >= 2 ? f->blocks[i->block].preds[j - 2]
+                                  : i->block;
+    if (idom[in] < 0) {
+      continue;
+    }
+    if (f->insns[u].block == in ? i->op != IrPhi && pos[u] >= at
+                                : !ir_dominates(idom, f->insns[u].block, in)) {
+      return "use not dominated by its definition";
+    }
+  }
+  return NULL;
+}
+
+const char *ir_verify(struct ir_fn *f) {
+  int *order = malloc((f->blocks_len + 1) * sizeof(int));
+  int *idom = ir_dominators(f, order);
+  int *pos = malloc((f->insns_len + 1) * sizeof(int));
+  const char *err = NULL;
+  long listed = 0, placed = 0;
+  int b, j, k;
+
+  for (j = 0; j < f->insns_len; j++) {
+    placed += f->insns[j].block >= 0;
+  }
+  for (b = 0; b < f->blocks_len && !err; b++) {
+    struct ir_block *blk = f->blocks + b;
+    for (j = 0; j < blk->len; j++) {
+      pos[blk->insns[j]] = j;
+    }
+    listed += blk->len;
+    if (!blk->len || !ir_terminator(f, b)) {
+      err = "block without a terminator";
+    }
+    for (j = 0; j < blk->preds_len && !err; j++) {
+      if (blk->preds[j] < 0 || blk->preds[j] >= f->blocks_len ||
+          !ir_has_edge(f, blk->preds[j], b) ||
+          ir_pred_index(f, b, blk->preds[j]) != j) {
+        err = "predecessor without an edge";
+      }
+    }
+  }
+
+  for (b = 0; b < f->blocks_len && !err; b++) {
+    struct ir_block *blk = f->blocks + b;
+    int phis = ir_phis(f, b);
+    for (j = 0; j < blk->len && !err; j++) {
+      struct ir_insn *i = f->insns + blk->insns[j];
+      if (i->block != b || i->op == IrNop) {
+        err = "instruction in the wrong block";
+      } else if (ir_is_terminator(i->op) != (j == blk->len - 1)) {
+        err = "terminator before the end of a block";
+      } else if (i->op == IrPhi && j >= phis) {
+        err = "phi after the start of a block";
+      } else if (i->op == IrPhi && i->args_len != blk->preds_len) {
+        err = "phi without an operand per predecessor";
+      } else {
+        err = ir_verify_uses(f, i, j, idom, pos);
+      }
+      for (k = 0; !err && k < i->targets_len; k++) {
+        if (i->targets[k] < 0 || i->targets[k] >= f->blocks_len ||
+            ir_pred_index(f, i->targets[k], b) < 0) {
+          err = "edge missing from the predecessors of its target";
+        }
+      }
+    }
+  }
+  if (!err && listed != placed) {
+    err = "instruction missing from its block";
+  }
+  free(order);
+  free(idom);
+  free(pos);
+  return err;
+}
+
+/*
+ * Loading
+ */
+
+/* Exits with a message if f is malformed after step */
+void ir_check(struct ir_fn *f, const char *step) {
+  const char *err = ir_verify(f);
+
+  if (err) {
+    printf("ir: %s after %s in %s\n", err, step, f->fn->name);
+    exit(1);
+  }
+}
+
+/* Adds the blocks and instructions of f to a row of stats */
+void ir_count(struct ir_fn *f, struct ir_stats *stats, int row) {
+  int b;
+
+  stats->blocks[row] += f->blocks_len;
+  for (b = 0; b < f->blocks_len; b++) {
+    stats->insns[row] += f->blocks[b].len;
+  }
+}
+
+struct ir_prog *ir_load(struct interp *in, bool optimize, bool verify,
+                        struct ir_stats *stats) {
+  struct ir_prog *p = calloc(1, sizeof(*p));
+  struct ir_stats unused;
+  clock_t begin;
+  int i, j;
+
+  if (!stats) {
+    stats = &unused;
+  }
+  p->in = in;
+  p->fns_len = in->fns_len;
+  p->fns = calloc(in->fns_len + 1, sizeof(*p->fns));
+
+  /* each step over every function, so short ones are timed together */
+  begin = clock();
+  for (i = 0; i <= in->fns_len; i++) {
+    p->fns[i] = ir_build(in, i < in->fns_len ? in->fns[i] : ir_init_fn(in));
+  }
+  stats->secs[0] += (double)(clock() - begin) / CLOCKS_PER_SEC;
+  for (i = 0; i <= in->fns_len; i++) {
+    if (verify) {
+      ir_check(p->fns[i], "building");
+    }
+    ir_count(p->fns[i], stats, 0);
+  }
+
+  for (j = 0; j < IR_PASSES; j++) {
+    begin = clock();
+    for (i = 0; optimize && i <= in->fns_len; i++) {
+      ir_passes[j].run(p->fns[i]);
+    }
+    stats->secs[j + 1] += (double)(clock() - begin) / CLOCKS_PER_SEC;
+    for (i = 0; i <= in->fns_len; i++) {
+      if (verify && optimize) {
+        ir_check(p->fns[i], ir_passes[j].name);
+      }
+      ir_count(p->fns[i], stats, j + 1);
+    }
+  }
+  return p;
+}
+
+/*
+ * Writing
+ */
+
+const char *ir_op_names[] = {
+    "nop",    "const",  "param",   "frame",  "global", "fn",     "copy",
+    "phi",    "load",   "store",   "memcpy", "memset", "conv",   "add",
+    "sub",    "mul",    "div",     "udiv",   "mod",    "umod",   "shl",
+    "shr",    "ushr",   "and",     "or",     "xor",    "neg",    "compl",
+    "eq",     "ne",     "lt",      "le",     "ult",    "ule",    "fadd",
+    "fsub",   "fmul",   "fdiv",    "fneg",   "feq",    "fne",    "flt",
+    "fle",    "ptradd", "ptrdiff", "not",    "call",   "callptr",
+    "builtin", "jump",  "br",      "switch", "ret"};
+
+const char *ir_kind_names[] = {"void", "i8",  "u8",  "i16", "u16",
+                               "i32",  "u32", "i64", "u64", "f32",
+                               "f64",  "ptr", "agg"};
+
+void write_value(writer *w, int v) {
+  write_char(w, 'v');
+  write_long(w, v);
+}
+
+void write_block(writer *w, int b) {
+  write_char(w, 'b');
+  write_long(w, b);
+}
+
+/* Writes address p as the object of in holding it and an offset */
+void write_global(writer *w, struct interp *in, char *p) {
+  int j;
+
+  for (j = 0; j < in->objs_len; j++) {
+    if (in->objs[j].p <= p && p < in->objs[j].p + in->objs[j].size) {
+      write_str(w, "@");
+      write_long(w, j);
+      if (p != in->objs[j].p) {
+        write_char(w, '+');
+        write_long(w, p - in->objs[j].p);
+      }
+      return;
+    }
+  }
+  write_str(w, "@?");
+}
+
+void write_insn(writer *w, struct ir_fn *f, int v) {
+  struct ir_insn *i = f->insns + v;
+  char buf[64];
+  int j;
+
+  write_str(w, "  ");
+  if (ir_has_value(i->op)) {
+    write_value(w, v);
+    write_str(w, " = ");
+  }
+  write_str(w, ir_op_names[i->op]);
+  if (ir_has_value(i->op) || i->op == IrStore) {
+    write_char(w, ' ');
+    write_str(w, ir_kind_names[i->kind]);
+  }
+
+  switch (i->op) {
+  case IrConst:
+    if (is_float_kind(i->kind)) {
+      sprintf(buf, " %.17g", i->f);
+      write_str(w, buf);
+    } else {
+      write_char(w, ' ');
+      write_long(w, i->k);
+    }
+    break;
+  case IrParam:
+  case IrFrame:
+    write_char(w, ' ');
+    write_long(w, i->k);
+    break;
+  case IrGlobal:
+    write_char(w, ' ');
+    write_global(w, f->in, i->p);
+    break;
+  case IrFn:
+  case IrCall:
+    write_char(w, ' ');
+    write_str(w, i->fn->name);
+    break;
+  case IrBuiltin:
+    write_char(w, ' ');
+    write_str(w, builtin_names[i->k]);
+    break;
+  case IrConv:
+    write_str(w, " from ");
+    write_str(w, ir_kind_names[i->x]);
+    break;
+  default:
+    break;
+  }
+
+  if (i->a >= 0) {
+    write_char(w, ' ');
+    write_value(w, i->a);
+  }
+  if (i->b >= 0) {
+    write_str(w, ", ");
+    write_value(w, i->b);
+  }
+  if (i->op == IrMemCopy || i->op == IrMemZero || i->op == IrPtrAdd ||
+      i->op == IrPtrDiff) {
+    write_str(w, ", ");
+    write_long(w, i->k);
+  }
+  for (j = 0; j < i->args_len; j++) {
+    write_str(w, j ? ", " : i->op == IrPhi ? " (" : "(");
+    if (i->op == IrPhi) {
+      write_block(w, f->blocks[i->block].preds[j]);
+      write_char(w, ' ');
+    }
+    write_value(w, i->args[j]);
+  }
+  if (i->args_len || i->op == IrCall || i->op == IrCallPtr ||
+      i->op == IrBuiltin) {
+    write_str(w, i->args_len ? ")" : "()");
+  }
+  for (j = 0; j < i->targets_len; j++) {
+    write_str(w, i->a >= 0 || j ? ", " : " ");
+    if (i->op == IrSwitch) {
+      if (j < i->targets_len - 1) {
+        write_long(w, i->cases[j]);
+      } else {
+        write_str(w, "default");
+      }
+      write_str(w, ": ");
+    }
+    write_block(w, i->targets[j]);
+  }
+  write_char(w, '\n');
+}
+
+void write_ir(writer *w, struct ir_fn *f) {
+  int b, j;
+
+  write_str(w, "fn ");
+  write_str(w, f->fn->name);
+  write_str(w, ", frame ");
+  write_long(w, f->fn->frame_size);
+  write_char(w, '\n');
+  for (b = 0; b < f->blocks_len; b++) {
+    struct ir_block *blk = f->blocks + b;
+    write_block(w, b);
+    write_char(w, ':');
+    for (j = 0; j < blk->preds_len; j++) {
+      write_str(w, j ? ", " : " from ");
+      write_block(w, blk->preds[j]);
+    }
+    write_char(w, '\n');
+    for (j = 0; j < blk->len; j++) {
+      write_insn(w, f, blk->insns[j]);
+    }
+  }
+}
+
+void write_ir_stats(writer *w, struct ir_stats *stats) {
+  char buf[96];
+  int j;
+
+  sprintf(buf, "%-10s %10s %10s %10s\n", "pass", "secs", "blocks", "insns");
+  write_str(w, buf);
+  for (j = 0; j <= IR_PASSES; j++) {
+    sprintf(buf, "%-10s %10.6f %10ld %10ld\n",
+            j ? ir_passes[j - 1].name : "build", stats->secs[j],
+            stats->blocks[j], stats->insns[j]);
+    write_str(w, buf);
+  }
+}
+
+/*
+ * Execution
+ */
+
+/* Runs f with len args until it returns */
+value ir_exec(struct ir_prog *p, struct ir_fn *f, value *args, int len) {
+  struct interp *in = p->in;
+  struct ir_frame *base = p->frames_top, *frame = base;
+  struct interp_fn *callee;
+  struct ir_block *b;
+  struct ir_insn *i;
+  value *vals, *phis;
+  char *fp;
+  int block, from, at, id, k;
+  value zero, v;
+
+  zero.i = 0;
+call:
+  vals = p->vals_top;
+  fp = in->sp;
+  /* room for the values, then the phis or args of a call */
+  if (vals + 2 * f->insns_len + BUILTIN_ARGS > p->vals_end ||
+      fp + f->fn->frame_size > in->stack_end) {
+    interp_fail(in, "stack overflow in", f->fn->name);
+  }
+  in->sp += f->fn->frame_size;
+  p->vals_top += f->insns_len;
+  block = 0;
+  from = -1;
+
+enter:
+  b = f->blocks + block;
+  at = 0;
+  /* phis take their operands from the predecessor all at once */
+  if (from >= 0) {
+    if (p->heat && block <= from) {
+      p->heat[f->fn->id]++;
+    }
+    phis = p->vals_top;
+    k = ir_pred_index(f, block, from);
+    for (; at < b->len && f->insns[b->insns[at]].op == IrPhi; at++) {
+      phis[at] = vals[f->insns[b->insns[at]].args[k]];
+    }
+    for (k = 0; k < at; k++) {
+      vals[b->insns[k]] = phis[k];
+    }
+  }
+
+resume:
+  for (; at < b->len; at++) {
+    id = b->insns[at];
+    i = f->insns + id;
+
+    switch (i->op) {
+    case IrParam:
+      vals[id] = i->k < len ? args[i->k] : zero;
+      break;
+    case IrFrame:
+      vals[id].i = (long)(fp + i->k);
+      break;
+    case IrGlobal:
+      vals[id].i = (long)i->p;
+      break;
+    case IrFn:
+      vals[id].i = (long)i->fn;
+      break;
+    case IrLoad:
+      vals[id] = load(i->kind, (char *)vals[i->a].i);
+      break;
+    case IrStore:
+      store(i->kind, (char *)vals[i->a].i, vals[i->b]);
+      break;
+    case IrMemCopy:
+      memmove((char *)vals[i->a].i, (char *)vals[i->b].i, i->k);
+      break;
+    case IrMemZero:
+      memset((char *)vals[i->a].i, 0, i->k);
+      break;
+
+    case IrCall:
+    case IrCallPtr:
+    case IrBuiltin:
+      /* the args go above the values, where the callee's start after */
+      for (k = 0; k < i->args_len; k++) {
+        p->vals_top[k] = vals[i->args[k]];
+      }
+      if (i->op == IrBuiltin) {
+        vals[id] = builtin_call(in, i->k, p->vals_top, i->args_len);
+        break;
+      }
+      callee = i->op == IrCall ? i->fn : (struct interp_fn *)vals[i->a].i;
+      if (!callee) {
+        interp_fail(in, "call through a null pointer", NULL);
+      }
+      if (i->args_len < callee->params_len) {
+        interp_fail(in, "wrong number of arguments to", callee->name);
+      }
+      if (p->heat && ++p->heat[callee->id] >= p->hot) {
+        /* what the tier calls back into goes above this call */
+        p->frames_top = frame;
+        p->vals_top += i->args_len;
+        vals[id] = p->tier(p, callee, p->vals_top - i->args_len, i->args_len);
+        p->vals_top -= i->args_len;
+        p->frames_top = base;
+        break;
+      }
+      if (frame == p->frames_end) {
+        interp_fail(in, "stack overflow in", f->fn->name);
+      }
+      frame->f = f;
+      frame->vals = vals;
+      frame->args = args;
+      frame->len = len;
+      frame->fp = fp;
+      frame->block = block;
+      frame->at = at;
+      frame++;
+      args = p->vals_top;
+      len = i->args_len;
+      p->vals_top += len;
+      f = p->fns[callee->id];
+      goto call;
+
+    case IrJump:
+      from = block;
+      block = i->targets[0];
+      goto enter;
+    case IrBranch:
+      from = block;
+      block = i->targets[vals[i->a].i ? 0 : 1];
+      goto enter;
+    case IrSwitch:
+      from = block;
+      block = ir_switch_target(i, vals[i->a].i);
+      goto enter;
+    case IrRet:
+      v = i->a >= 0 ? vals[i->a] : zero;
+      in->sp = fp;
+      p->vals_top = vals;
+      if (frame == base) {
+        return v;
+      }
+      frame--;
+      f = frame->f;
+      vals = frame->vals;
+      args = frame->args;
+      len = frame->len;
+      fp = frame->fp;
+      block = frame->block;
+      at = frame->at;
+      p->vals_top = vals + f->insns_len;
+      b = f->blocks + block;
+      vals[b->insns[at++]] = v;
+      goto resume;
+
+    default:
+      if (!ir_eval(i, i->a >= 0 ? vals[i->a] : zero,
+                   i->b >= 0 ? vals[i->b] : zero, vals + id)) {
+        interp_fail(in, "division by zero", NULL);
+      }
+      break;
+    }
+  }
+  interp_fail(in, "block without a terminator in", f->fn->name);
+  return zero;
+}
+
+value ir_invoke(struct ir_prog *p, struct interp_fn *fn, value *args,
+                int len) {
+  if (!fn) {
+    interp_fail(p->in, "call through a null pointer", NULL);
+  }
+  if (len < fn->params_len) {
+    interp_fail(p->in, "wrong number of arguments to", fn->name);
+  }
+  if (p->heat && ++p->heat[fn->id] >= p->hot) {
+    return p->tier(p, fn, args, len);
+  }
+  return ir_exec(p, p->fns[fn->id], args, len);
+}
+
+int ir_run(struct ir_prog *p, int argc, char **argv) {
+  struct interp *in = p->in;
+  struct interp_fn *main_fn = interp_main(in);
+  value args[2];
+  value v;
+
+  interp_init(in);
+  if (!p->vals) {
+    p->vals = malloc(IR_VALUES * sizeof(value));
+    p->vals_end = p->vals + IR_VALUES;
+    p->frames = malloc(IR_FRAMES * sizeof(struct ir_frame));
+    p->frames_end = p->frames + IR_FRAMES;
+  }
+  p->vals_top = p->vals;
+  p->frames_top = p->frames;
+
+  args[0].i = argc;
+  args[1].i = (long)argv;
+  v = ir_invoke(p, main_fn, args, main_fn->params_len);
+  fflush(in->out);
+  return main_fn->ret_kind == VoidV ? 0 : (int)v.i;
+}
@@ -0,0 +1,255 @@
+#ifndef CHOCC_IR_H
+#define CHOCC_IR_H
+#pragma once
+
+#include "chocc.h"
+#include "interp.h"
+#include "io.h"
+
+/*
+ * ir_op enumerates the instructions of the SSA form. Every instruction is
+ * also the value it defines, named by its index in ir_fn.insns. Operands
+ * a and b are such values, or -1. Integer results are normalized to the
+ * kind of the instruction, as in the lowered tree.
+ */
+typedef enum ir_op {
+  IrNop,    /* removed */
+  IrConst,  /* k, or f for floats */
+  IrParam,  /* the k-th param */
+  IrFrame,  /* address of the frame at offset k */
+  IrGlobal, /* address p */
+  IrFn,     /* function fn */
+  IrCopy,   /* a */
+  IrPhi,    /* args, one per predecessor of the block */
+
+  IrLoad,    /* *a */
+  IrStore,   /* *a = b */
+  IrMemCopy, /* copies k bytes from b to a */
+  IrMemZero, /* clears k bytes at a */
+  IrConv,    /* a converted from kind x */
+
+  /* integer and float arithmetic, in the order of inode_op */
+  IrAdd,
+  IrSub,
+  IrMul,
+  IrDiv,
+  IrUDiv,
+  IrMod,
+  IrUMod,
+  IrShl,
+  IrShr,
+  IrUShr,
+  IrAnd,
+  IrOr,
+  IrXor,
+  IrNeg,
+  IrCompl,
+  IrEq,
+  IrNe,
+  IrLt,
+  IrLe,
+  IrULt,
+  IrULe,
+
+  IrFAdd,
+  IrFSub,
+  IrFMul,
+  IrFDiv,
+  IrFNeg,
+  IrFEq,
+  IrFNe,
+  IrFLt,
+  IrFLe,
+
+  IrPtrAdd,  /* a + b * k */
+  IrPtrDiff, /* (a - b) / k */
+  IrNot,
+
+  IrCall,    /* fn(args) */
+  IrCallPtr, /* a(args) */
+  IrBuiltin, /* builtin k(args) */
+
+  /* terminators, the last instruction of every block */
+  IrJump,   /* to targets[0] */
+  IrBranch, /* to targets[0] if a is not 0, else targets[1] */
+  IrSwitch, /* to targets[i] for the first cases[i] a is, else the last */
+  IrRet     /* returns a, or 0 if it is -1 */
+} ir_op;
+
+struct ir_insn {
+  ir_op op;
+  val_kind kind; /* of the result, or of the access for loads and stores */
+  int block;     /* holding it, -1 once removed */
+  int a;
+  int b;
+  int *args; /* phi operands by predecessor, or call args */
+  int args_len;
+  int *targets; /* successor blocks of a terminator */
+  int targets_len;
+  long *cases; /* of a switch, one fewer than its targets */
+
+  long k;
+  long x;
+  double f;
+  char *p;
+  struct interp_fn *fn;
+};
+
+/*
+ * ir_block is a basic block, its phis first and its terminator last.
+ * Each predecessor is listed once, however many edges it has to the block.
+ */
+struct ir_block {
+  int *insns;
+  int len;
+  int cap;
+  int *preds;
+  int preds_len;
+  int preds_cap;
+};
+
+/*
+ * ir_fn is a function in SSA form, its entry the first block. Scalars
+ * slot_promotable allows are values, the rest stay in a frame of
+ * fn->frame_size bytes.
+ */
+struct ir_fn {
+  struct interp *in;
+  struct interp_fn *fn;
+  struct ir_insn *insns;
+  int insns_len;
+  int insns_cap;
+  struct ir_block *blocks;
+  int blocks_len;
+  int blocks_cap;
+};
+
+/* ir_pass is a transformation of the optimization pipeline */
+struct ir_pass {
+  const char *name;
+  void (*run)(struct ir_fn *);
+};
+
+/* the passes ir_load runs, in order */
+#define IR_PASSES 5
+extern struct ir_pass ir_passes[IR_PASSES];
+
+/*
+ * ir_stats totals the time building and each pass took, and the blocks
+ * and instructions left after each, over the functions of a program.
+ */
+struct ir_stats {
+  double secs[IR_PASSES + 1];
+  long blocks[IR_PASSES + 1];
+  long insns[IR_PASSES + 1];
+};
+
+/* ir_frame is a call returned to, and the state of its function */
+struct ir_frame {
+  struct ir_fn *f;
+  value *vals;
+  value *args;
+  int len;
+  char *fp;
+  int block;
+  int at; /* of the call in the block */
+};
+
+/*
+ * ir_prog is the functions of a program loaded by an interpreter, whose
+ * globals, stack and builtins it shares.
+ */
+struct ir_prog {
+  struct interp *in;
+  struct ir_fn **fns; /* by interp_fn.id, then the initializers */
+  int fns_len;        /* not counting the initializers */
+
+  value *vals; /* of the running calls */
+  value *vals_end;
+  value *vals_top;
+  struct ir_frame *frames;
+  struct ir_frame *frames_end;
+  struct ir_frame *frames_top; /* past those of the running ir_exec calls */
+
+  /*
+   * A second tier a function is handed to once its calls and loop back
+   * edges reach hot. tier runs the call and returns its value.
+   */
+  long *heat; /* by interp_fn.id, NULL if there is no second tier */
+  long hot;
+  value (*tier)(struct ir_prog *, struct interp_fn *, value *args, int len);
+  void *tier_env;
+};
+
+/* Builds the SSA form of fn */
+struct ir_fn *ir_build(struct interp *in, struct interp_fn *fn);
+
+/*
+ * Returns a function of no params running the initializers of the globals
+ * and statics of in, for backends that cannot run them at load time.
+ */
+struct interp_fn *ir_init_fn(struct interp *in);
+
+/* Returns the number of phis block starts with */
+int ir_phis(struct ir_fn *f, int block);
+
+/* Returns the terminator of block, or NULL if it has none yet */
+struct ir_insn *ir_terminator(struct ir_fn *f, int block);
+
+/* Returns the index of pred among the predecessors of block, or -1 */
+int ir_pred_index(struct ir_fn *f, int block, int pred);
+
+/* Returns the j-th operand slot of i, which has 2 + i->args_len */
+int *ir_use(struct ir_insn *i, int j);
+
+/* Returns whether op defines a value other instructions may use */
+bool ir_has_value(ir_op op);
+
+/*
+ * Returns the immediate dominator of each block of f, -1 if it is
+ * unreachable. order receives each block's index in reverse postorder, or
+ * -1.
+ */
+int *ir_dominators(struct ir_fn *f, int *order);
+
+/*
+ * Returns a message for the first malformed instruction or block of fn, or
+ * NULL. Every use must be dominated by its definition.
+ */
+const char *ir_verify(struct ir_fn *);
+
+/*
+ * Builds the functions loaded by in and their initializers, running the
+ * passes over each unless optimize is false. Each step is verified if
+ * verify is set, a failure exiting with a message. stats, if not NULL, is
+ * added to.
+ */
+struct ir_prog *ir_load(struct interp *in, bool optimize, bool verify,
+                        struct ir_stats *stats);
+
+/* Writes the IR of fn as text */
+void write_ir(writer *, struct ir_fn *);
+
+/* Writes the table of stats */
+void write_ir_stats(writer *, struct ir_stats *);
+
+/*
+ * Evaluates op with operands a and b into v, as the lowered tree does.
+ * Returns false for a division by zero.
+ */
+bool ir_eval(struct ir_insn *, value a, value b, value *v);
+
+/*
+ * Calls fn with the len args, in the second tier once it is hot. Fails as
+ * the interpreter does for a null fn or too few args.
+ */
+value ir_invoke(struct ir_prog *, struct interp_fn *fn, value *args,
+                int len);
+
+/*
+ * Initializes the globals and calls main, returning its result. argv holds
+ * argc strings.
+ */
+int ir_run(struct ir_prog *, int argc, char **argv);
+
+#endif
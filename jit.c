@@ -0,0 +1,670 @@
+#define _POSIX_C_SOURCE 200809L
+#include "jit.h"
+#include "interp.h"
+#include "x86.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Assembling
+ */
+
+typedef enum jit_kind { JitReg, JitImm, JitMem, JitLabel } jit_kind;
+
+/* jit_operand is an operand of an instruction as x86_jit_fn writes it */
+struct jit_operand {
+  jit_kind kind;
+  int reg;  /* in encoding order */
+  int size; /* in bytes, of a general purpose register */
+  bool xmm;
+  long imm; /* or the displacement of memory */
+  int base;
+  int index; /* -1 if none */
+  int scale;
+  const char *name; /* of a label, len chars */
+  int len;
+};
+
+/* jit_label is a label at off, or a rel32 at off to be fixed up to one */
+struct jit_label {
+  const char *name;
+  int len;
+  long off;
+};
+
+struct jit_asm {
+  unsigned char *code;
+  long len;
+  long cap;
+  struct jit_label *labels;
+  int labels_len;
+  int labels_cap;
+  struct jit_label *fixups;
+  int fixups_len;
+  int fixups_cap;
+};
+
+/* the condition codes in encoding order */
+const char *jit_conds[16] = {"o", "no", "b",  "ae", "e", "ne", "be", "a",
+                             "s", "ns", "p", "np", "l", "ge", "le", "g"};
+
+/* the ALU instructions in the order of their opcodes and /digits */
+const char *jit_alus[8] = {"add", "or", "adc", "sbb", "and", "sub", "xor",
+                           "cmp"};
+
+void jit_byte(struct jit_asm *a, int b) {
+  if (a->len == a->cap) {
+    a->cap = a->cap ? 2 * a->cap : 256;
+    a->code = realloc(a->code, a->cap);
+  }
+  a->code[a->len++] = (unsigned char)b;
+}
+
+/* Writes the low n bytes of k, little endian */
+void jit_imm(struct jit_asm *a, long k, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    jit_byte(a, (int)((unsigned long)k >> 8 * i & 0xff));
+  }
+}
+
+bool jit_fits8(long k) { return k >= -128 && k <= 127; }
+
+void jit_add_label(struct jit_label **labels, int *len, int *cap,
+                   const char *name, int name_len, long off) {
+  if (*len == *cap) {
+    *cap = *cap ? 2 * *cap : 64;
+    *labels = realloc(*labels, *cap * sizeof(**labels));
+  }
+  (*labels)[*len].name = name;
+  (*labels)[*len].len = name_len;
+  (*labels)[(*len)++].off = off;
+}
+
+/* Writes a rel32 to the label o, fixed up once every label is known */
+void jit_rel(struct jit_asm *a, struct jit_operand *o) {
+  jit_add_label(&a->fixups, &a->fixups_len, &a->fixups_cap, o->name, o->len,
+                a->len);
+  jit_imm(a, 0, 4);
+}
+
+/* Returns whether o is one of %spl to %dil, which need a REX prefix */
+bool jit_low8(struct jit_operand *o) {
+  return o->kind == JitReg && !o->xmm && o->size == 1 && o->reg >= 4 &&
+         o->reg < 8;
+}
+
+int jit_scale(int scale) {
+  return scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+}
+
+/*
+ * Writes an instruction: prefix unless it is 0, REX if needed, the len
+ * bytes of op, then ModRM with reg and the register or memory rm. w selects
+ * 64 bits, and byte forces REX for the byte registers needing it.
+ */
+void jit_enc(struct jit_asm *a, int prefix, bool w, long op, int len, int reg,
+             struct jit_operand *rm, bool byte) {
+  int rex = (w ? 8 : 0) | (reg & 8 ? 4 : 0), mod, k;
+  long disp = rm->imm;
+
+  if (rm->kind == JitReg) {
+    rex |= rm->reg & 8 ? 1 : 0;
+  } else {
+    rex |= rm->index >= 0 && rm->index & 8 ? 2 : 0;
+    rex |= rm->base & 8 ? 1 : 0;
+  }
+  if (prefix) {
+    jit_byte(a, prefix);
+  }
+  if (rex || byte) {
+    jit_byte(a, 0x40 | rex);
+  }
+  for (k = len - 1; k >= 0; k--) {
+    jit_byte(a, (int)(op >> 8 * k & 0xff));
+  }
+  if (rm->kind == JitReg) {
+    jit_byte(a, 0xc0 | (reg & 7) << 3 | (rm->reg & 7));
+    return;
+  }
+  /* %rbp and %r13 have no form without a displacement */
+  mod = !disp && (rm->base & 7) != 5 ? 0 : jit_fits8(disp) ? 1 : 2;
+  if (rm->index < 0 && (rm->base & 7) != 4) {
+    jit_byte(a, mod << 6 | (reg & 7) << 3 | (rm->base & 7));
+  } else {
+    /* as do %rsp and %r12 without a SIB byte */
+    jit_byte(a, mod << 6 | (reg & 7) << 3 | 4);
+    jit_byte(a, jit_scale(rm->scale) << 6 |
+                    (rm->index < 0 ? 4 : rm->index & 7) << 3 |
+                    (rm->base & 7));
+  }
+  if (mod) {
+    jit_imm(a, disp, mod == 1 ? 1 : 4);
+  }
+}
+
+/* Returns the register named by the len chars at s, or -1 */
+int jit_reg(const char *s, int len, int *size, bool *xmm) {
+  int k, r;
+
+  *xmm = len > 3 && !strncmp(s, "xmm", 3);
+  if (*xmm) {
+    *size = 8;
+    return atoi(s + 3);
+  }
+  for (k = 0; k < 4; k++) {
+    for (r = 0; r < 16; r++) {
+      if ((int)strlen(x86_gpr_names[k][r]) == len &&
+          !strncmp(s, x86_gpr_names[k][r], len)) {
+        *size = 8 >> k;
+        return r;
+      }
+    }
+  }
+  return -1;
+}
+
+/* Parses the len chars at s into o, returning false if they are no operand */
+bool jit_operand(const char *s, int len, struct jit_operand *o) {
+  const char *end = s + len, *p, *q;
+  char *e;
+  bool xmm;
+  int size;
+
+  o->index = o->base = -1;
+  o->scale = 1;
+  o->imm = 0;
+  o->xmm = false;
+  if (*s == '*') {
+    /* the target of an indirect call, encoded as any other */
+    s++;
+  }
+  if (*s == '%') {
+    o->kind = JitReg;
+    o->reg = jit_reg(s + 1, end - s - 1, &o->size, &o->xmm);
+    return o->reg >= 0;
+  }
+  if (*s == '$') {
+    o->kind = JitImm;
+    o->imm = strtol(s + 1, &e, 10);
+    return e == end;
+  }
+  if (!(p = memchr(s, '(', end - s))) {
+    o->kind = JitLabel;
+    o->name = s;
+    o->len = end - s;
+    return true;
+  }
+
+  o->kind = JitMem;
+  if (p > s && ((o->imm = strtol(s, &e, 10)), e != p)) {
+    return false;
+  }
+  for (q = ++p; q < end && *q != ',' && *q != ')'; q++) {
+  }
+  if (*p != '%' || (o->base = jit_reg(p + 1, q - p - 1, &size, &xmm)) < 0) {
+    return false;
+  }
+  if (*q == ',') {
+    for (q = p = q + 1; q < end && *q != ',' && *q != ')'; q++) {
+    }
+    if (*p != '%' ||
+        (o->index = jit_reg(p + 1, q - p - 1, &size, &xmm)) < 0) {
+      return false;
+    }
+    if (*q == ',') {
+      o->scale = (int)strtol(q + 1, &e, 10);
+      q = e;
+    }
+  }
+  return q == end - 1 && *q == ')';
+}
+
+/* Returns the condition code named by the len chars at s, or -1 */
+int jit_cond(const char *s, int len) {
+  int c;
+
+  if (len == 1 && *s == 'z') {
+    return 4;
+  }
+  if (len == 2 && !strncmp(s, "nz", 2)) {
+    return 5;
+  }
+  for (c = 0; c < 16; c++) {
+    if ((int)strlen(jit_conds[c]) == len && !strncmp(s, jit_conds[c], len)) {
+      return c;
+    }
+  }
+  return -1;
+}
+
+bool jit_is(const char *m, int len, const char *name) {
+  return (int)strlen(name) == len && !strncmp(m, name, len);
+}
+
+/* Returns the size in bytes a mnemonic's suffix c gives, or 0 */
+int jit_suffix(char c) {
+  return c == 'q' ? 8 : c == 'l' ? 4 : c == 'w' ? 2 : c == 'b' ? 1 : 0;
+}
+
+/* Encodes an ALU instruction of the given /digit and operand size */
+void jit_alu(struct jit_asm *a, int digit, int size, struct jit_operand *src,
+             struct jit_operand *dst) {
+  bool w = size == 8, byte = size == 1;
+
+  if (src->kind == JitImm) {
+    if (byte || jit_fits8(src->imm)) {
+      jit_enc(a, 0, w, byte ? 0x80 : 0x83, 1, digit, dst, jit_low8(dst));
+      jit_imm(a, src->imm, 1);
+    } else {
+      jit_enc(a, 0, w, 0x81, 1, digit, dst, false);
+      jit_imm(a, src->imm, 4);
+    }
+  } else if (src->kind == JitReg) {
+    jit_enc(a, 0, w, 8 * digit + !byte, 1, src->reg, dst,
+            jit_low8(src) || jit_low8(dst));
+  } else {
+    jit_enc(a, 0, w, 8 * digit + 2 + !byte, 1, dst->reg, src, jit_low8(dst));
+  }
+}
+
+/* Encodes a mov of size bytes, between general and vector registers too */
+void jit_mov(struct jit_asm *a, int size, struct jit_operand *src,
+             struct jit_operand *dst) {
+  int prefix = size == 2 ? 0x66 : 0;
+  bool w = size == 8, byte = size == 1;
+
+  if (src->kind == JitImm && dst->kind == JitReg && size == 4) {
+    if (dst->reg & 8) {
+      jit_byte(a, 0x41);
+    }
+    jit_byte(a, 0xb8 + (dst->reg & 7));
+    jit_imm(a, src->imm, 4);
+  } else if (src->kind == JitImm) {
+    jit_enc(a, prefix, w, byte ? 0xc6 : 0xc7, 1, 0, dst, jit_low8(dst));
+    jit_imm(a, src->imm, size < 4 ? size : 4);
+  } else if (src->xmm) {
+    jit_enc(a, 0x66, true, 0x0f7e, 2, src->reg, dst, false);
+  } else if (dst->xmm) {
+    jit_enc(a, 0x66, true, 0x0f6e, 2, dst->reg, src, false);
+  } else if (src->kind == JitReg) {
+    jit_enc(a, prefix, w, byte ? 0x88 : 0x89, 1, src->reg, dst,
+            jit_low8(src) || jit_low8(dst));
+  } else {
+    jit_enc(a, prefix, w, byte ? 0x8a : 0x8b, 1, dst->reg, src,
+            jit_low8(dst));
+  }
+}
+
+/*
+ * Encodes the instruction m, mlen chars, with its n operands in AT&T order.
+ * Returns false if it is not one x86_jit_fn writes.
+ */
+bool jit_ins(struct jit_asm *a, const char *m, int mlen, struct jit_operand *o,
+             int n) {
+  struct jit_operand *src = o, *dst = o + n - 1;
+  int size = mlen > 1 ? jit_suffix(m[mlen - 1]) : 0, k;
+
+  /* vector instructions: mandatory prefix, opcode, the destination in reg */
+  const char *sse[9] = {"movapd", "addsd",    "mulsd",    "subsd", "divsd",
+                        "ucomisd", "cvtsd2ss", "cvtss2sd", "xorpd"};
+  const int sse_prefix[9] = {0x66, 0xf2, 0xf2, 0xf2, 0xf2,
+                             0x66, 0xf2, 0xf3, 0x66};
+  const long sse_op[9] = {0x0f28, 0x0f58, 0x0f59, 0x0f5c, 0x0f5e,
+                          0x0f2e, 0x0f5a, 0x0f5a, 0x0f57};
+  /* the F7 group of one operand, and the shifts, by /digit */
+  const char *unary[4] = {"notq", "negq", "divq", "idivq"};
+  const int unary_digit[4] = {2, 3, 6, 7};
+  const char *shifts[3] = {"shlq", "shrq", "sarq"};
+  const int shift_digit[3] = {4, 5, 7};
+
+  if (n > 0 && size) {
+    for (k = 0; k < 8; k++) {
+      if (jit_is(m, mlen - 1, jit_alus[k]) && n == 2) {
+        jit_alu(a, k, size, src, dst);
+        return true;
+      }
+    }
+  }
+  for (k = 0; k < 9; k++) {
+    if (jit_is(m, mlen, sse[k]) && n == 2) {
+      jit_enc(a, sse_prefix[k], false, sse_op[k], 2, dst->reg, src, false);
+      return true;
+    }
+  }
+  for (k = 0; k < 4; k++) {
+    if (jit_is(m, mlen, unary[k]) && n == 1) {
+      jit_enc(a, 0, true, 0xf7, 1, unary_digit[k], src, false);
+      return true;
+    }
+  }
+  for (k = 0; k < 3; k++) {
+    if (!jit_is(m, mlen, shifts[k])) {
+      continue;
+    }
+    if (n == 1) {
+      jit_enc(a, 0, true, 0xd1, 1, shift_digit[k], src, false);
+    } else if (src->kind == JitImm) {
+      jit_enc(a, 0, true, 0xc1, 1, shift_digit[k], dst, false);
+      jit_imm(a, src->imm, 1);
+    } else {
+      jit_enc(a, 0, true, 0xd3, 1, shift_digit[k], dst, false);
+    }
+    return true;
+  }
+
+  if (mlen == 4 && !strncmp(m, "mov", 3) && size && n == 2) {
+    jit_mov(a, size, src, dst);
+  } else if (jit_is(m, mlen, "movabsq") && n == 2) {
+    jit_byte(a, 0x48 | (dst->reg & 8 ? 1 : 0));
+    jit_byte(a, 0xb8 + (dst->reg & 7));
+    jit_imm(a, src->imm, 8);
+  } else if (jit_is(m, mlen, "movsbq") && n == 2) {
+    jit_enc(a, 0, true, 0x0fbe, 2, dst->reg, src, jit_low8(src));
+  } else if (jit_is(m, mlen, "movzbl") && n == 2) {
+    jit_enc(a, 0, false, 0x0fb6, 2, dst->reg, src, jit_low8(src));
+  } else if (jit_is(m, mlen, "movswq") && n == 2) {
+    jit_enc(a, 0, true, 0x0fbf, 2, dst->reg, src, false);
+  } else if (jit_is(m, mlen, "movzwl") && n == 2) {
+    jit_enc(a, 0, false, 0x0fb7, 2, dst->reg, src, false);
+  } else if (jit_is(m, mlen, "movslq") && n == 2) {
+    jit_enc(a, 0, true, 0x63, 1, dst->reg, src, false);
+  } else if (jit_is(m, mlen, "leaq") && n == 2) {
+    jit_enc(a, 0, true, 0x8d, 1, dst->reg, src, false);
+  } else if (jit_is(m, mlen, "movsd") && n == 2) {
+    if (dst->xmm) {
+      jit_enc(a, 0xf2, false, 0x0f10, 2, dst->reg, src, false);
+    } else {
+      jit_enc(a, 0xf2, false, 0x0f11, 2, src->reg, dst, false);
+    }
+  } else if (jit_is(m, mlen, "movss") && n == 2) {
+    if (dst->xmm) {
+      jit_enc(a, 0xf3, false, 0x0f10, 2, dst->reg, src, false);
+    } else {
+      jit_enc(a, 0xf3, false, 0x0f11, 2, src->reg, dst, false);
+    }
+  } else if (jit_is(m, mlen, "cvtsi2sdq") && n == 2) {
+    jit_enc(a, 0xf2, true, 0x0f2a, 2, dst->reg, src, false);
+  } else if (jit_is(m, mlen, "cvttsd2siq") && n == 2) {
+    jit_enc(a, 0xf2, true, 0x0f2c, 2, dst->reg, src, false);
+  } else if (jit_is(m, mlen, "imulq") && src->kind == JitImm) {
+    /* imulq $k, %r is imulq $k, %r, %r */
+    k = jit_fits8(src->imm);
+    jit_enc(a, 0, true, k ? 0x6b : 0x69, 1, dst->reg, o + 1, false);
+    jit_imm(a, src->imm, k ? 1 : 4);
+  } else if (jit_is(m, mlen, "imulq") && n == 2) {
+    jit_enc(a, 0, true, 0x0faf, 2, dst->reg, src, false);
+  } else if (jit_is(m, mlen, "testq") && n == 2) {
+    jit_enc(a, 0, true, 0x85, 1, src->reg, dst, false);
+  } else if (jit_is(m, mlen, "btcq") && n == 2) {
+    jit_enc(a, 0, true, 0x0fba, 2, 7, dst, false);
+    jit_imm(a, src->imm, 1);
+  } else if (jit_is(m, mlen, "cqto") && !n) {
+    jit_byte(a, 0x48);
+    jit_byte(a, 0x99);
+  } else if (jit_is(m, mlen, "ret") && !n) {
+    jit_byte(a, 0xc3);
+  } else if (jit_is(m, mlen, "pushq") && n == 1 && src->kind == JitReg) {
+    if (src->reg & 8) {
+      jit_byte(a, 0x41);
+    }
+    jit_byte(a, 0x50 + (src->reg & 7));
+  } else if (jit_is(m, mlen, "popq") && n == 1 && src->kind == JitReg) {
+    if (src->reg & 8) {
+      jit_byte(a, 0x41);
+    }
+    jit_byte(a, 0x58 + (src->reg & 7));
+  } else if (jit_is(m, mlen, "call") && n == 1 && src->kind != JitLabel) {
+    jit_enc(a, 0, false, 0xff, 1, 2, src, false);
+  } else if (jit_is(m, mlen, "jmp") && n == 1 && src->kind == JitLabel) {
+    jit_byte(a, 0xe9);
+    jit_rel(a, src);
+  } else if (mlen > 3 && !strncmp(m, "set", 3) && n == 1 &&
+             (k = jit_cond(m + 3, mlen - 3)) >= 0) {
+    jit_enc(a, 0, false, 0x0f90 + k, 2, 0, src, jit_low8(src));
+  } else if (mlen > 1 && *m == 'j' && n == 1 && src->kind == JitLabel &&
+             (k = jit_cond(m + 1, mlen - 1)) >= 0) {
+    jit_byte(a, 0x0f);
+    jit_byte(a, 0x80 + k);
+    jit_rel(a, src);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+unsigned char *jit_assemble(const char *text, long *len, const char **at) {
+  struct jit_asm a;
+  struct jit_operand o[3];
+  const char *line, *end, *s, *m, *p;
+  int mlen, n, depth, i, j;
+  long rel;
+
+  memset(&a, 0, sizeof(a));
+  for (line = text; *line; line = *end ? end + 1 : end) {
+    if (!(end = strchr(line, '\n'))) {
+      end = line + strlen(line);
+    }
+    for (s = line; s < end && (*s == ' ' || *s == '\t'); s++) {
+    }
+    if (s == end) {
+      continue;
+    }
+    if (end[-1] == ':') {
+      jit_add_label(&a.labels, &a.labels_len, &a.labels_cap, s,
+                    end - 1 - s, a.len);
+      continue;
+    }
+    if (*s == '.') {
+      /* directives only align, or name sections, which code has no use for */
+      continue;
+    }
+
+    for (m = s; s < end && *s != ' '; s++) {
+    }
+    mlen = s - m;
+    for (n = 0; s < end; n++) {
+      for (s++; s < end && *s == ' '; s++) {
+      }
+      for (p = s, depth = 0; s < end && (depth || *s != ','); s++) {
+        depth += (*s == '(') - (*s == ')');
+      }
+      if (n == 3 || !jit_operand(p, s - p, o + n)) {
+        break;
+      }
+    }
+    if (s < end || !jit_ins(&a, m, mlen, o, n)) {
+      *at = line;
+      goto fail;
+    }
+  }
+
+  for (i = 0; i < a.fixups_len; i++) {
+    struct jit_label *f = a.fixups + i;
+    for (j = 0; j < a.labels_len; j++) {
+      if (a.labels[j].len == f->len &&
+          !strncmp(a.labels[j].name, f->name, f->len)) {
+        break;
+      }
+    }
+    if (j == a.labels_len) {
+      *at = f->name;
+      goto fail;
+    }
+    rel = a.len;
+    a.len = f->off;
+    jit_imm(&a, a.labels[j].off - f->off - 4, 4);
+    a.len = rel;
+  }
+  free(a.labels);
+  free(a.fixups);
+  *len = a.len;
+  return a.code;
+
+fail:
+  free(a.code);
+  free(a.labels);
+  free(a.fixups);
+  return NULL;
+}
+
+/*
+ * Tiering
+ */
+
+/* the stack compiled code leaves unused, of the 8MB a main thread has */
+#define JIT_STACK (6L << 20)
+
+/*
+ * the stack compiled code may use under jit_run, twice the bytes of the
+ * interpreter's values, and what C code called from it needs past that
+ */
+#define JIT_RUN_STACK (64L << 20)
+#define JIT_RUN_SLACK (8L << 20)
+
+/* jit is the second tier of a program, the code compiled for it so far */
+struct jit {
+  struct x86_jit env;
+  int compiled;
+};
+
+void jit_fail(struct jit *jit, const char *msg, const char *name) {
+  fflush(jit->env.p->in->out);
+  printf("jit: %s %s\n", msg, name);
+  exit(1);
+}
+
+/* Copies the len bytes of code to new executable pages */
+void *jit_map(unsigned char *code, long len) {
+  int fd = open("/dev/zero", O_RDWR);
+  void *p;
+
+  if (fd < 0) {
+    return NULL;
+  }
+  p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+  memcpy(p, code, len);
+  if (mprotect(p, len, PROT_READ | PROT_EXEC)) {
+    munmap(p, len);
+    return NULL;
+  }
+  return p;
+}
+
+void *jit_compile(struct jit *jit, struct ir_fn *f) {
+  char *text = NULL;
+  size_t size = 0;
+  FILE *stream = open_memstream(&text, &size);
+  unsigned char *code;
+  const char *at;
+  long len;
+  writer w;
+  void *p;
+
+  if (!stream) {
+    jit_fail(jit, "out of memory compiling", f->fn->name);
+  }
+  w = new_writer(stream);
+  x86_jit_fn(&w, &jit->env, f);
+  free_writer(&w);
+  fclose(stream);
+  if (!(code = jit_assemble(text, &len, &at))) {
+    fflush(jit->env.p->in->out);
+    printf("jit: cannot assemble %.*s in %s\n", (int)strcspn(at, "\n"), at,
+           f->fn->name);
+    exit(1);
+  }
+  if (!(p = jit_map(code, len))) {
+    jit_fail(jit, "no executable memory for", f->fn->name);
+  }
+  free(code);
+  free(text);
+  jit->compiled++;
+  return p;
+}
+
+/* Runs a hot function, compiling it first if it is not yet */
+value jit_tier(struct ir_prog *p, struct interp_fn *fn, value *args,
+               int len) {
+  struct jit *jit = p->tier_env;
+  value (*code)(value *);
+
+  (void)len;
+  if (!jit->env.code[fn->id]) {
+    jit->env.code[fn->id] = jit_compile(jit, p->fns[fn->id]);
+  }
+  memcpy(&code, jit->env.code + fn->id, sizeof(code));
+  return code(args);
+}
+
+void jit_attach(struct ir_prog *p, long hot) {
+  struct jit *jit = calloc(1, sizeof(*jit));
+  char here;
+
+  jit->env.p = p;
+  jit->env.code = calloc(p->fns_len + 1, sizeof(void *));
+  jit->env.call = ir_invoke;
+  jit->env.builtin = builtin_call;
+  jit->env.fail = interp_fail;
+  jit->env.move = memmove;
+  jit->env.zero = memset;
+  jit->env.limit = (char *)((long)&here - JIT_STACK);
+  p->heat = calloc(p->fns_len + 1, sizeof(long));
+  p->hot = hot;
+  p->tier = jit_tier;
+  p->tier_env = jit;
+}
+
+/* arg of jit_run_main */
+struct jit_run {
+  struct ir_prog *p;
+  int argc;
+  char **argv;
+  int status;
+};
+
+void *jit_run_main(void *arg) {
+  struct jit_run *r = arg;
+  struct jit *jit = r->p->tier_env;
+  char here;
+
+  jit->env.limit = (char *)((long)&here - JIT_RUN_STACK);
+  r->status = ir_run(r->p, r->argc, r->argv);
+  return NULL;
+}
+
+int jit_run(struct ir_prog *p, int argc, char **argv) {
+  struct jit_run r;
+  pthread_attr_t attr;
+  pthread_t thread;
+  int err;
+
+  r.p = p;
+  r.argc = argc;
+  r.argv = argv;
+  r.status = 0;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, JIT_RUN_STACK + JIT_RUN_SLACK);
+  err = pthread_create(&thread, &attr, jit_run_main, &r);
+  pthread_attr_destroy(&attr);
+  if (err) {
+    /* with the limit jit_attach set for this thread */
+    return ir_run(p, argc, argv);
+  }
+  pthread_join(thread, NULL);
+  return r.status;
+}
+
+int jit_compiled(struct ir_prog *p) {
+  return p->tier_env ? ((struct jit *)p->tier_env)->compiled : 0;
+}
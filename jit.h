@@ -0,0 +1,35 @@
+#ifndef CHOCC_JIT_H
+#define CHOCC_JIT_H
+#pragma once
+
+#include "chocc.h"
+#include "ir.h"
+
+/*
+ * Assembles the x86-64 text x86_jit_fn writes. Returns len bytes of machine
+ * code, or NULL with at pointing to the line it could not assemble.
+ */
+unsigned char *jit_assemble(const char *text, long *len, const char **at);
+
+/* the hot a program is tiered at unless told otherwise */
+#define JIT_HOT 1000
+
+/*
+ * Makes machine code the second tier of p's interpreter: a function whose
+ * calls and loop back edges reach hot is compiled into executable pages and
+ * called directly from then on. A hot of 0 compiles every function before
+ * it first runs.
+ */
+void jit_attach(struct ir_prog *p, long hot);
+
+/*
+ * Runs p as ir_run does, on a thread of its own whose stack gives compiled
+ * frames at least the depth the interpreter allows. jit_attach leaves them
+ * the 6MB of the calling thread's stack that remain.
+ */
+int jit_run(struct ir_prog *p, int argc, char **argv);
+
+/* Returns the number of functions of p compiled so far */
+int jit_compiled(struct ir_prog *p);
+
+#endif
@@ -1,4 +1,5 @@
 #include "lex.h"
+#include "alloc.h"
 #include "error.h"
 #include "io.h"
 #include "unit.h"
@@ -49,7 +50,7 @@ token_t new_token(token_kind_t kind, loc pos, const char *text) {
   tok.kind = kind;
   tok.line = pos.ln;
   tok.column = pos.col;
-  tok.text = calloc(strlen(text) + 1, 1);
+  tok.text = alloc_calloc(LexAlloc, strlen(text) + 1, 1);
   strcpy(tok.text, text);
 
   return tok;
@@ -166,10 +167,18 @@ token_t lex_next(struct lexer *l) {
         }
       } else if (c_peek == '*') {
         /* block comment, skip until match */
+        int ln;
         for (; l->c != '*' || lexer_peek(l) != '/';) {
           lexer_advance(l);
         }
         lexer_advance(l);
+        if (l->pos.ln > pos.ln) {
+          /* mark for incremental relexing */
+          for (ln = pos.ln;
+               ln <= l->pos.ln && ln <= l->unit->file->lines_len; ln++) {
+            l->unit->file->lines[ln - 1].comment = true;
+          }
+        }
       } else {
         return new_token(Slash, pos, "/");
       }
@@ -398,8 +407,9 @@ void lex(struct unit *u) {
       return;
     }
     unit_append_tok(u, tok);
+    COUNT(TokensLexed);
   }
-  if (u->toks[u->toks_len].kind != Eof) {
+  if (!u->toks_len || u->toks[u->toks_len - 1].kind != Eof) {
     token_t tok = new_token(Eof, l.pos, "");
     unit_append_tok(u, tok);
   }
@@ -410,6 +420,17 @@ void print_token(token_t tok) {
          tok.column);
 }
 
+void write_token(writer *w, token_t tok) {
+  write_str(w, tok.text);
+  write_char(w, '\t');
+  write_str(w, token_kind_map[tok.kind]);
+  write_char(w, '\t');
+  write_long(w, tok.line);
+  write_char(w, ':');
+  write_long(w, tok.column);
+  write_char(w, '\n');
+}
+
 const char *token_kind_map[] = {
     "Number",    "String",      "Character", "LBrace",     "RBrace",
     "LBrack",    "RBrack",      "LParen",    "RParen",     "Comma",
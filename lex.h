@@ -138,11 +138,14 @@ typedef struct {
   unsigned int line;
   unsigned int column;
   char *text;
+  bool expanded; /* produced by macro expansion, line is not physical */
 } token_t;
 
 token_t new_token(token_kind_t kind, loc pos, const char *text);
 
 void print_token(token_t token);
+/* Writes a token as print_token does */
+void write_token(writer *, token_t token);
 
 /*
  * Lexes and returns the next token in the given file.
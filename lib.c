@@ -0,0 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "lib.h"
+#include "alloc.h"
+#include "driver.h"
+#include "error.h"
+#include "io.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct chocc_ctx {
+  struct options opts;
+  struct arena *arena; /* what the last compile allocated */
+  struct unit *unit;   /* the last compile's, if it had no error */
+  char *out;           /* what it wrote */
+  size_t out_len;
+  char *err; /* its error, or NULL */
+  size_t err_len;
+};
+
+chocc_ctx *chocc_new(int argc, char **argv) {
+  chocc_ctx *ctx = calloc(1, sizeof(*ctx));
+  char **args = calloc(argc + 2, sizeof(*args));
+  struct options *o = &ctx->opts;
+  bool ok;
+  int i;
+
+  /* parsed as a command line compiling one file, given later */
+  args[0] = "chocc";
+  for (i = 0; i < argc; i++) {
+    args[i + 1] = argv[i];
+  }
+  args[argc + 1] = "input.c";
+  ok = parse_options(o, argc + 2, args);
+  free(args);
+
+  if (!ok || o->paths_len != 1 || o->run || o->dump_ir || o->ir_stats ||
+      o->stats || o->emit_path || o->wasm_path || o->asm_path ||
+      o->load_path || o->trace_path || o->serve) {
+    free(o->paths);
+    free(ctx);
+    return NULL;
+  }
+  o->jobs = 0;
+  return ctx;
+}
+
+/* Frees what the last compile of ctx made */
+void chocc_drop(chocc_ctx *ctx) {
+  arena_free(ctx->arena);
+  free(ctx->out);
+  free(ctx->err);
+  ctx->arena = NULL;
+  ctx->unit = NULL;
+  ctx->out = ctx->err = NULL;
+  ctx->out_len = ctx->err_len = 0;
+}
+
+/*
+ * Compiles src, writing the output to w and fatal errors to err. Returns
+ * the exit status, or -1 after a fatal error.
+ */
+int chocc_run(chocc_ctx *ctx, writer *w, writer *err, char *src) {
+  struct fatal_catch c;
+  struct unit *u;
+  int status;
+
+  c.w = err;
+  if (setjmp(c.env)) {
+    fatal_catch(NULL);
+    return -1;
+  }
+  fatal_catch(&c);
+  u = alloc_malloc(UnitAlloc, sizeof(*u));
+  *u = compile_toks(src_to_file(src), NULL);
+  if ((status = write_toks(w, u, &ctx->opts))) {
+    write_error(err, u->err);
+  } else {
+    compile_nodes(u, &ctx->opts);
+    status = write_nodes(w, u, &ctx->opts);
+    ctx->unit = u;
+  }
+  fatal_catch(NULL);
+  return status;
+}
+
+int chocc_compile(chocc_ctx *ctx, const char *src, size_t len) {
+  struct arena *last;
+  FILE *out, *err;
+  writer w, ew;
+  char *buf;
+  int status;
+
+  chocc_drop(ctx);
+  ctx->arena = arena_new();
+  last = arena_enter(ctx->arena);
+
+  out = open_memstream(&ctx->out, &ctx->out_len);
+  err = open_memstream(&ctx->err, &ctx->err_len);
+  w = new_writer(out);
+  ew = new_writer(err);
+  buf = alloc_malloc(IoAlloc, len + 1);
+  memcpy(buf, src, len);
+  buf[len] = '\0';
+
+  status = chocc_run(ctx, &w, &ew, buf);
+  free_writer(&ew);
+  fclose(err);
+  if (status < 0) {
+    /* after what was written, as run has it */
+    write_str(&w, ctx->err);
+    ctx->unit = NULL;
+    status = 1;
+  }
+  free_writer(&w);
+  fclose(out);
+
+  while (ctx->err_len && ctx->err[ctx->err_len - 1] == '\n') {
+    ctx->err[--ctx->err_len] = '\0';
+  }
+  if (!ctx->err_len) {
+    free(ctx->err);
+    ctx->err = NULL;
+  }
+  arena_enter(last);
+  return status;
+}
+
+const char *chocc_output(chocc_ctx *ctx, size_t *len) {
+  if (len) {
+    *len = ctx->out_len;
+  }
+  return ctx->out ? ctx->out : "";
+}
+
+const char *chocc_error(chocc_ctx *ctx) {
+  return ctx->err;
+}
+
+struct unit *chocc_unit(chocc_ctx *ctx) {
+  return ctx->unit;
+}
+
+void chocc_free(chocc_ctx *ctx) {
+  if (!ctx) {
+    return;
+  }
+  chocc_drop(ctx);
+  free(ctx->opts.paths);
+  free(ctx);
+}
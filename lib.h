@@ -0,0 +1,50 @@
+#ifndef CHOCC_LIB_H
+#define CHOCC_LIB_H
+#pragma once
+
+#include <stddef.h>
+
+#include "unit.h"
+
+/*
+ * chocc_ctx compiles buffers for a host that loads chocc.so. What a compile
+ * allocates belongs to its context and is freed with the next compile or
+ * with the context, and errors are returned instead of ending the process.
+ * A context is used by one thread at a time; contexts share nothing, so
+ * each thread of a host can compile with its own at once.
+ */
+typedef struct chocc_ctx chocc_ctx;
+
+/*
+ * Returns a context writing what chocc with the argc options in argv writes,
+ * as --json, --symbols, --decls or -fsyntax-only, or NULL if they are not
+ * options of a compile to text. The source is given to chocc_compile, and
+ * -j is ignored, as a context compiles on the calling thread.
+ */
+chocc_ctx *chocc_new(int argc, char **argv);
+
+/*
+ * Compiles the len bytes at src, dropping what the last compile of ctx
+ * made. Returns 0, or 1 if src has an error.
+ */
+int chocc_compile(chocc_ctx *ctx, const char *src, size_t len);
+
+/*
+ * Returns what chocc would have written for the last compile, its error
+ * included, and its length in len unless len is NULL.
+ */
+const char *chocc_output(chocc_ctx *ctx, size_t *len);
+
+/* Returns the error of the last compile, or NULL if it had none */
+const char *chocc_error(chocc_ctx *ctx);
+
+/*
+ * Returns the unit the last compile made, checked, or NULL if it had an
+ * error. It lives until the next compile of ctx.
+ */
+struct unit *chocc_unit(chocc_ctx *ctx);
+
+/* Frees ctx and everything its compiles made */
+void chocc_free(chocc_ctx *ctx);
+
+#endif
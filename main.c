@@ -1,43 +1,63 @@
-#include <stdio.h>
-#include <stdlib.h>
-
+#include "alloc.h"
 #include "chocc.h"
-#include "cpp.h"
-#include "error.h"
+#include "driver.h"
 #include "io.h"
-#include "lex.h"
-#include "parse.h"
-#include "unit.h"
+#include "server.h"
+#include "trace.h"
 
 int main(int argc, char *argv[]) {
-  file *f;
-  struct unit u;
-  int i;
-
-  if (argc != 2) {
-    puts("usage: chocc input.c");
-    exit(1);
+  struct options opts;
+  writer w;
+  int status;
+
+  w = new_writer(stdout);
+  if (!parse_options(&opts, argc, argv)) {
+    write_usage(&w);
+    free_writer(&w);
+    return 1;
   }
 
-  f = load_file(argv[1]);
-  print_file(f);
-
-  u = new_unit();
-  u.file = f;
+  if (opts.serve) {
+    free_writer(&w);
+    return serve(opts.serve_path);
+  }
 
-  lex(&u);
-  if (u.err) {
-    print_error(u.err);
+  if (opts.trace_path && !(opts.trace = trace_open(opts.trace_path))) {
+    write_str(&w, "could not write ");
+    write_str(&w, opts.trace_path);
+    write_char(&w, '\n');
+    free_writer(&w);
     return 1;
   }
 
-  cpp(&u);
-
-  parse(&u);
-
-  for (i = 0; i < u.nodes_len; i++) {
-    print_ast(u.nodes + i, 0, i == u.nodes_len - 1, "");
+  if (opts.load_path) {
+    status = write_loaded(&w, &opts);
+  } else if (opts.dump_ir || opts.ir_stats) {
+    status = write_ir_prog(&w, &opts);
+  } else if (opts.wasm_path) {
+    status = emit_wasm(&w, &opts);
+  } else if (opts.asm_path) {
+    status = emit_asm(&w, &opts);
+  } else if (opts.paths_len > 1) {
+    status = run_units(&w, &opts);
+  } else if (opts.run) {
+    status = run_program(&w, &opts);
+  } else {
+    status = run(&w, &opts);
   }
-
-  return 0;
+#ifdef CHOCC_COUNTERS
+  if (opts.stats && opts.stats_json) {
+    write_counts_json(&w);
+  } else if (opts.stats) {
+    write_counts(&w);
+  }
+#endif
+  if (opts.trace && !trace_close(opts.trace)) {
+    write_str(&w, "could not write ");
+    write_str(&w, opts.trace_path);
+    write_char(&w, '\n');
+    status = 1;
+  }
+  free_writer(&w);
+  return status;
 }
@@ -1,78 +1,117 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "parse.h"
+#include "alloc.h"
 #include "chocc.h"
+#include "error.h"
 #include "lex.h"
+#include "pool.h"
+#include "stats.h"
 #include "unit.h"
 
+#include <pthread.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* writes the value of an integer literal */
+void write_lit_int(writer *w, ast_lit *lit) {
+  if (lit->is_unsigned) {
+    write_ulong(w, lit->integer);
+  } else {
+    write_long(w, lit->integer);
+  }
+}
+
 void print_type(type *t) {
+  writer w = new_writer(stdout);
+  write_type(&w, t);
+  free_writer(&w);
+}
+
+void write_type(writer *w, type *t) {
   if (t->store_class) {
-    printf("%s ", token_kind_map[t->store_class]);
+    write_str(w, token_kind_map[t->store_class]);
+    write_char(w, ' ');
   }
   if (t->is_const) {
-    printf("Const ");
+    write_str(w, "Const ");
   }
   if (t->is_volatile) {
-    printf("Volatile ");
+    write_str(w, "Volatile ");
   }
 
   switch (t->kind) {
   case PtrT: {
-    printf("*");
+    write_char(w, '*');
     if (t->inner->is_const || t->inner->is_volatile) {
-      printf(" ");
+      write_char(w, ' ');
     }
 
     if (t->inner->kind == FnT || t->inner->kind == ArrT) {
-      printf("(");
+      write_char(w, '(');
     }
-    print_type(t->inner);
+    write_type(w, t->inner);
     if (t->inner->kind == FnT || t->inner->kind == ArrT) {
-      printf(")");
+      write_char(w, ')');
     }
     return;
   }
   case ArrT: {
     if (t->inner->kind == PtrT) {
-      printf("(");
+      write_char(w, '(');
     }
-    print_type(t->inner);
+    write_type(w, t->inner);
     if (t->inner->kind == PtrT) {
-      printf(")");
+      write_char(w, ')');
     }
-    printf("[");
+    write_char(w, '[');
     if (t->arr_size) {
-      printf("%d", t->arr_size);
+      write_long(w, t->arr_size);
+    } else if (t->arr_expr) { /* not constant */
+      write_char(w, '?');
     }
-    printf("]");
+    write_char(w, ']');
     return;
   }
   case FnT: {
     int i;
     if (t->fn_param_decls_len != 1) {
-      printf("(");
+      write_char(w, '(');
     }
     for (i = 0; i < t->fn_param_decls_len; i++) {
       ast_node_t *decl = t->fn_param_decls + i;
       if (decl->u.decl.name) {
-        printf("%s: ", decl->u.decl.name->u.ident);
+        write_str(w, decl->u.decl.name->u.ident.name);
+        write_str(w, ": ");
       }
-      print_type(decl->u.decl.type);
+      write_type(w, decl->u.decl.type);
       if (i != t->fn_param_decls_len - 1) {
-        printf(", ");
+        write_str(w, ", ");
       }
     }
     if (t->fn_param_decls_len != 1) {
-      printf(")");
+      write_char(w, ')');
     }
-    printf(" -> ");
-    print_type(t->inner);
+    write_str(w, " -> ");
+    write_type(w, t->inner);
     return;
   }
   case NumericT: {
-    printf("%s", token_kind_map[t->numeric.base]);
+    if (t->numeric.is_signed) {
+      write_str(w, "Signed ");
+    }
+    if (t->numeric.is_unsigned) {
+      write_str(w, "Unsigned ");
+    }
+    if (t->numeric.is_short) {
+      write_str(w, "Short ");
+    }
+    if (t->numeric.is_long) {
+      write_str(w, "Long ");
+    }
+    write_str(w, token_kind_map[t->numeric.base]);
     return;
   }
   case UnionT:
@@ -80,52 +119,67 @@ void print_type(type *t) {
     ast_node_t *fields = t->struct_fields;
     int i;
     if (t->kind == StructT) {
-      printf("Struct ");
+      write_str(w, "Struct ");
     } else {
-      printf("Union ");
+      write_str(w, "Union ");
     }
     if (t->name) {
-      printf("%s ", t->name->u.ident);
+      write_str(w, t->name->u.ident.name);
+      if (!fields) { /* incomplete */
+        return;
+      }
+      write_char(w, ' ');
     }
-    printf("{ ");
-    for (i = 0; i < fields->u.list.len; i++) {
+    write_str(w, "{ ");
+    for (i = 0; fields && i < fields->u.list.len; i++) {
       ast_decl decl = ast_list_at(fields, i)->u.decl;
       if (decl.name) {
-        printf("%s: ", decl.name->u.ident);
+        write_str(w, decl.name->u.ident.name);
+        write_str(w, ": ");
       }
-      print_type(decl.type);
+      write_type(w, decl.type);
       if (i != fields->u.list.len - 1) {
-        printf(", ");
+        write_str(w, ", ");
       }
     }
-    printf(" }");
+    write_str(w, " }");
     return;
   }
   case EnumT: {
     ast_node_t *idents = t->enum_idents;
     ast_node_t *exprs = t->enum_exprs;
     int i;
-    printf("Enum ");
+    write_str(w, "Enum ");
     if (t->name) {
-      printf("%s ", t->name->u.ident);
+      write_str(w, t->name->u.ident.name);
+      if (!idents) { /* incomplete */
+        return;
+      }
+      write_char(w, ' ');
     }
-    printf("{ ");
-    for (i = 0; i < idents->u.list.len; i++) {
-      printf("%s", ast_list_at(idents, i)->u.ident);
+    write_str(w, "{ ");
+    for (i = 0; idents && i < idents->u.list.len; i++) {
+      write_str(w, ast_list_at(idents, i)->u.ident.name);
 
       if (ast_list_at(exprs, i)) {
-        printf(" = ?");
+        ast_node_t *ex = ast_list_at(exprs, i);
+        write_str(w, " = ");
+        if (ex->kind == Lit && ex->u.lit.kind == DecLit) { /* folded */
+          write_lit_int(w, &ex->u.lit);
+        } else {
+          write_char(w, '?');
+        }
       }
 
       if (i != idents->u.list.len - 1) {
-        printf(", ");
+        write_str(w, ", ");
       }
     }
-    printf(" }");
+    write_str(w, " }");
     return;
   }
   case VoidT: {
-    printf("Void");
+    write_str(w, "Void");
     return;
   }
   default:
@@ -133,248 +187,605 @@ void print_type(type *t) {
   }
 }
 
+void print_fn_sig(ast_node_t *fn) {
+  writer w = new_writer(stdout);
+  write_fn_sig(&w, fn);
+  free_writer(&w);
+}
+
+void write_fn_sig(writer *w, ast_node_t *fn) {
+  write_str(w, "\033[1mFnDefn\033[0m ");
+  if (fn->u.fn_defn.decl->name) {
+    write_str(w, fn->u.fn_defn.decl->name->u.ident.name);
+    write_char(w, ' ');
+  }
+  write_type(w, fn->u.fn_defn.decl->type);
+  write_char(w, '\n');
+}
+
 void print_ast(ast_node_t *root, int depth, bool last, char *pad) {
-  int i;
-  int len_pad;
-  char *pad_new;
+  writer w = new_writer(stdout);
+  int len = strlen(pad);
 
-  for (i = 2; i < depth * 2; i++) {
-    printf("%c", pad[i]);
+  if (len > w.pad_cap) {
+    w.pad_cap = len;
+    w.pad = alloc_realloc(ParseAlloc, w.pad, w.pad_cap);
   }
+  memcpy(w.pad, pad, len);
+  w.pad_len = len;
+
+  write_ast_node(&w, root, depth, last);
+  free_writer(&w);
+}
 
-  len_pad = strlen(pad);
-  pad_new = calloc(1, len_pad + 3);
-  strcpy(pad_new, pad);
+void write_ast(writer *w, ast_node_t *root, bool last) {
+  w->pad_len = 0;
+  write_ast_node(w, root, 0, last);
+}
 
-  pad = pad_new;
-  if (last) {
-    pad[len_pad] = ' ';
-  } else {
-    pad[len_pad] = '|';
+/* writes a bold node name */
+void write_name(writer *w, const char *name) {
+  write_str(w, "\033[1m");
+  write_str(w, name);
+  write_str(w, "\033[0m");
+}
+
+/* ends the line of an expression node, with its type if the writer asks */
+void write_line_type(writer *w, type *t) {
+  if (w->types && t) {
+    write_str(w, " <");
+    write_type(w, t);
+    write_char(w, '>');
+  }
+  write_char(w, '\n');
+}
+
+void write_ast_node(writer *w, ast_node_t *root, int depth, bool last) {
+  /* an empty statement or expression */
+  if (!root) {
+    return;
   }
-  pad[len_pad + 1] = ' ';
-  pad[len_pad + 2] = 0;
+
+  /* the pad holds two characters per level, the first level is not drawn */
+  if (w->pad_len > 2) {
+    write_mem(w, w->pad + 2, w->pad_len - 2);
+  }
+
+  if (w->pad_len + 2 > w->pad_cap) {
+    w->pad_cap *= 2;
+    w->pad = alloc_realloc(ParseAlloc, w->pad, w->pad_cap);
+  }
+  w->pad[w->pad_len++] = last ? ' ' : '|';
+  w->pad[w->pad_len++] = ' ';
 
   if (depth && last) {
-    printf("`-");
+    write_str(w, "`-");
   } else if (depth && !last) {
-    printf("|-");
+    write_str(w, "|-");
   }
 
   switch (root->kind) {
   case Ident: {
-    printf("\033[1mIdent\033[0m: %s\n", root->u.ident);
+    write_name(w, "Ident");
+    write_str(w, ": ");
+    write_str(w, root->u.ident.name);
+    write_line_type(w, root->u.ident.type);
     break;
   }
   case FnDefn: {
-    printf("\033[1mFnDefn\033[0m ");
-    if (root->u.fn_defn.decl->name) {
-      printf("%s ", root->u.fn_defn.decl->name->u.ident);
-    }
-    print_type(root->u.fn_defn.decl->type);
-    puts("");
-    print_ast(root->u.fn_defn.body, depth + 1, true, pad);
+    write_fn_sig(w, root);
+    write_ast_node(w, fn_defn_body(root), depth + 1, true);
     break;
   }
   case Stmt: {
     switch (root->u.stmt.kind) {
     case LabelStmt: {
-      printf("\033[1mLabelStmt\033[0m ");
+      write_name(w, "LabelStmt");
+      write_char(w, ' ');
       if (root->u.stmt.label->kind == Ident) {
-        printf("%s:\n", root->u.stmt.label->u.ident);
+        write_str(w, root->u.stmt.label->u.ident.name);
       } else {
-        printf("%s:\n", token_kind_map[root->u.stmt.label->u.tok.kind]);
+        write_str(w, token_kind_map[root->u.stmt.label->u.tok.kind]);
       }
+      write_str(w, ":\n");
       if (root->u.stmt.case_expr) {
-        print_ast(root->u.stmt.case_expr, depth + 1, true, pad);
+        write_ast_node(w, root->u.stmt.case_expr, depth + 1, true);
       }
       break;
     }
     case BlockStmt: {
       int i;
-      puts("\033[1mBlockStmt\033[0m");
+      write_name(w, "BlockStmt");
+      write_char(w, '\n');
       for (i = 0; i < root->u.stmt.inner->u.list.len; i++) {
-        print_ast(ast_list_at(root->u.stmt.inner, i), depth + 1,
-                  i == root->u.stmt.inner->u.list.len - 1, pad);
+        write_ast_node(w, ast_list_at(root->u.stmt.inner, i), depth + 1,
+                       i == root->u.stmt.inner->u.list.len - 1);
       }
       break;
     }
     case ExprStmt: {
-      puts("\033[1mExprStmt\033[0m");
-      print_ast(root->u.stmt.inner, depth + 1, true, pad);
+      write_name(w, "ExprStmt");
+      write_char(w, '\n');
+      write_ast_node(w, root->u.stmt.inner, depth + 1, true);
       break;
     }
     case IfStmt: {
-      puts("\033[1mIfStmt\033[0m");
-      print_ast(root->u.stmt.cond, depth + 1, false, pad);
-      print_ast(root->u.stmt.inner, depth + 1, true, pad);
+      write_name(w, "IfStmt");
+      write_char(w, '\n');
+      write_ast_node(w, root->u.stmt.cond, depth + 1, false);
+      write_ast_node(w, root->u.stmt.inner, depth + 1, true);
       break;
     }
     case IfElseStmt: {
-      puts("\033[1mIfElseStmt\033[0m");
-      print_ast(root->u.stmt.cond, depth + 1, false, pad);
-      print_ast(root->u.stmt.inner, depth + 1, false, pad);
-      print_ast(root->u.stmt.inner_else, depth + 1, true, pad);
+      write_name(w, "IfElseStmt");
+      write_char(w, '\n');
+      write_ast_node(w, root->u.stmt.cond, depth + 1, false);
+      write_ast_node(w, root->u.stmt.inner, depth + 1, false);
+      write_ast_node(w, root->u.stmt.inner_else, depth + 1, true);
       break;
     }
     case SwitchStmt: {
-      puts("\033[1mSwitchStmt\033[0m");
-      print_ast(root->u.stmt.cond, depth + 1, false, pad);
-      print_ast(root->u.stmt.inner, depth + 1, true, pad);
+      write_name(w, "SwitchStmt");
+      write_char(w, '\n');
+      write_ast_node(w, root->u.stmt.cond, depth + 1, false);
+      write_ast_node(w, root->u.stmt.inner, depth + 1, true);
       break;
     }
     case WhileStmt: {
-      puts("\033[1mWhileStmt\033[0m");
-      print_ast(root->u.stmt.cond, depth + 1, false, pad);
-      print_ast(root->u.stmt.inner, depth + 1, true, pad);
+      write_name(w, "WhileStmt");
+      write_char(w, '\n');
+      write_ast_node(w, root->u.stmt.cond, depth + 1, false);
+      write_ast_node(w, root->u.stmt.inner, depth + 1, true);
       break;
     }
     case DoWhileStmt: {
-      puts("\033[1mWhileStmt\033[0m");
-      print_ast(root->u.stmt.inner, depth + 1, false, pad);
-      print_ast(root->u.stmt.cond, depth + 1, true, pad);
+      write_name(w, "WhileStmt");
+      write_char(w, '\n');
+      write_ast_node(w, root->u.stmt.inner, depth + 1, false);
+      write_ast_node(w, root->u.stmt.cond, depth + 1, true);
       break;
     }
     case ForStmt: {
-      puts("\033[1mForStmt\033[0m");
+      write_name(w, "ForStmt");
+      write_char(w, '\n');
       if (root->u.stmt.init) {
-        print_ast(root->u.stmt.init, depth + 1, false, pad);
+        write_ast_node(w, root->u.stmt.init, depth + 1, false);
       }
       if (root->u.stmt.cond) {
-        print_ast(root->u.stmt.cond, depth + 1, false, pad);
+        write_ast_node(w, root->u.stmt.cond, depth + 1, false);
       }
       if (root->u.stmt.iter) {
-        print_ast(root->u.stmt.iter, depth + 1, false, pad);
+        write_ast_node(w, root->u.stmt.iter, depth + 1, false);
       }
-      print_ast(root->u.stmt.inner, depth + 1, true, pad);
+      write_ast_node(w, root->u.stmt.inner, depth + 1, true);
       break;
     }
     case JumpStmt: {
-      printf("\033[1mJumpStmt\033[0m");
-      printf(" %s\n", token_kind_map[root->u.stmt.jump->u.tok.kind]);
+      write_name(w, "JumpStmt");
+      write_char(w, ' ');
+      write_str(w, token_kind_map[root->u.stmt.jump->u.tok.kind]);
+      write_char(w, '\n');
       if (root->u.stmt.inner) {
-        print_ast(root->u.stmt.inner, depth + 1, true, pad);
+        write_ast_node(w, root->u.stmt.inner, depth + 1, true);
       }
       break;
     }
     default: {
-      printf("expr\n");
+      write_str(w, "expr\n");
     }
     }
     break;
   }
   case Lit: {
-    printf("\033[1mLit\033[0m: ");
+    write_name(w, "Lit");
+    write_str(w, ": ");
     switch (root->u.lit.kind) {
     case DecLit: {
-      printf("%ld\n", root->u.lit.integer);
+      write_lit_int(w, &root->u.lit);
       break;
     }
     case StrLit: {
-      printf("\"%s\"\n", root->u.lit.string);
+      write_char(w, '"');
+      write_str(w, root->u.lit.string);
+      write_char(w, '"');
       break;
     }
     case CharLit: {
-      printf("'%s'\n", root->u.lit.character);
+      write_char(w, '\'');
+      write_str(w, root->u.lit.character);
+      write_char(w, '\'');
       break;
     }
     default: {
-      puts("not yet implemented");
+      write_str(w, "not yet implemented");
       break;
     }
     }
+    write_line_type(w, root->u.lit.type);
     break;
   }
   case Decl: {
-    printf("\033[1mDecl\033[0m");
+    write_name(w, "Decl");
     if (root->u.decl.name) {
-      printf(" %s: ", root->u.decl.name->u.ident);
+      write_char(w, ' ');
+      write_str(w, root->u.decl.name->u.ident.name);
+      write_str(w, ": ");
     }
-    print_type(root->u.decl.type);
-    puts("");
+    write_type(w, root->u.decl.type);
+    write_char(w, '\n');
     if (root->u.decl.init) {
-      print_ast(root->u.decl.init, depth + 1, true, pad);
+      write_ast_node(w, root->u.decl.init, depth + 1, true);
     }
     break;
   }
   case Tok: {
-    printf("Tok: %s [%s]\n", root->u.tok.text,
-           token_kind_map[root->u.tok.kind]);
+    write_str(w, "Tok: ");
+    write_str(w, root->u.tok.text);
+    write_str(w, " [");
+    write_str(w, token_kind_map[root->u.tok.kind]);
+    write_str(w, "]\n");
     break;
   }
   case Expr: {
     switch (root->u.expr.kind) {
     case PrefixExpr: {
-      printf("\033[1mPrefixExpr\033[0m: %s", token_kind_map[root->u.expr.op]);
+      write_name(w, "PrefixExpr");
+      write_str(w, ": ");
+      write_str(w, token_kind_map[root->u.expr.op]);
       if (root->u.expr.op == Sizeof && root->u.expr.rhs->kind == TypeName) {
-        printf(" (");
-        print_type(&root->u.expr.rhs->u.type_name);
-        puts(")");
+        write_str(w, " (");
+        write_type(w, &root->u.expr.rhs->u.type_name);
+        write_char(w, ')');
+        write_line_type(w, root->u.expr.type);
       } else {
-        puts("");
-        print_ast(root->u.expr.rhs, depth + 1, true, pad);
+        write_line_type(w, root->u.expr.type);
+        write_ast_node(w, root->u.expr.rhs, depth + 1, true);
       }
       break;
     }
     case PostfixExpr: {
-      printf("\033[1mPostfixExpr\033[0m: %s\n",
-             token_kind_map[root->u.expr.op]);
-      print_ast(root->u.expr.lhs, depth + 1, false, pad);
+      write_name(w, "PostfixExpr");
+      write_str(w, ": ");
+      write_str(w, token_kind_map[root->u.expr.op]);
+      write_line_type(w, root->u.expr.type);
+      write_ast_node(w, root->u.expr.lhs, depth + 1, false);
       if (root->u.expr.op == LBrack || root->u.expr.op == Dot ||
           root->u.expr.op == Arrow)
-        print_ast(root->u.expr.rhs, depth + 1, true, pad);
+        write_ast_node(w, root->u.expr.rhs, depth + 1, true);
       break;
     }
     case InfixExpr: {
-      printf("\033[1mInfixExpr\033[0m: %s\n", token_kind_map[root->u.expr.op]);
-      print_ast(root->u.expr.lhs, depth + 1, false, pad);
+      write_name(w, "InfixExpr");
+      write_str(w, ": ");
+      write_str(w, token_kind_map[root->u.expr.op]);
+      write_line_type(w, root->u.expr.type);
+      write_ast_node(w, root->u.expr.lhs, depth + 1, false);
       if (root->u.expr.op == Question) {
-        print_ast(root->u.expr.mhs, depth + 1, false, pad);
+        write_ast_node(w, root->u.expr.mhs, depth + 1, false);
       }
-      print_ast(root->u.expr.rhs, depth + 1, true, pad);
+      write_ast_node(w, root->u.expr.rhs, depth + 1, true);
       break;
     }
     case CommaExpr: {
       int i;
-      puts("\033[1mCommaExpr\033[0m");
+      write_name(w, "CommaExpr");
+      write_line_type(w, root->u.expr.type);
       for (i = 0; i < root->u.expr.mhs_len; i++) {
-        print_ast(root->u.expr.mhs + i, depth + 1,
-                  i == root->u.expr.mhs_len - 1, pad);
+        write_ast_node(w, root->u.expr.mhs + i, depth + 1,
+                       i == root->u.expr.mhs_len - 1);
       }
       break;
     }
     case CallExpr: {
-      puts("\033[1mCallExpr\033[0m");
-      print_ast(root->u.expr.lhs, depth + 1, root->u.expr.rhs == NULL, pad);
+      write_name(w, "CallExpr");
+      write_line_type(w, root->u.expr.type);
+      write_ast_node(w, root->u.expr.lhs, depth + 1, root->u.expr.rhs == NULL);
       if (root->u.expr.rhs) {
-        print_ast(root->u.expr.rhs, depth + 1, true, pad);
+        write_ast_node(w, root->u.expr.rhs, depth + 1, true);
       }
       break;
     }
     case CastExpr: {
-      printf("\033[1mCastExpr\033[0m (");
-      print_type(&root->u.expr.lhs->u.type_name);
-      puts(")");
-      print_ast(root->u.expr.rhs, depth + 1, true, pad);
+      write_name(w, "CastExpr");
+      write_str(w, " (");
+      write_type(w, &root->u.expr.lhs->u.type_name);
+      write_char(w, ')');
+      write_line_type(w, root->u.expr.type);
+      write_ast_node(w, root->u.expr.rhs, depth + 1, true);
     }
     }
     break;
   }
   case List: {
     int i;
-    printf("\033[1mList\033[0m (len %d)\n", root->u.list.len);
+    write_name(w, "List");
+    write_str(w, " (len ");
+    write_long(w, root->u.list.len);
+    write_str(w, ")\n");
     for (i = 0; i < root->u.list.len; i++) {
-      print_ast(root->u.list.nodes[i], depth + 1, i == root->u.list.len - 1,
-                pad);
+      write_ast_node(w, root->u.list.nodes[i], depth + 1,
+                     i == root->u.list.len - 1);
     }
     break;
   }
   default: {
-    printf("\033[1m%s\033[0m\n ", ast_node_kind_map[root->kind]);
+    write_name(w, ast_node_kind_map[root->kind]);
+    write_str(w, "\n ");
+  }
+  }
+
+  w->pad_len -= 2;
+}
+
+/*
+ * JSON
+ *
+ * Nodes are objects with a "kind" key and one key per child, types are
+ * objects with a "type" key. Absent children are omitted.
+ */
+
+void write_json_key(writer *w, const char *key) {
+  write_str(w, ",\"");
+  write_str(w, key);
+  write_str(w, "\":");
+}
+
+void write_type_json(writer *w, type *t) {
+  const char *kinds[] = {"Numeric", "Ptr",    "Arr",   "Fn",
+                         "Void",    "Struct", "Union", "Enum"};
+
+  write_str(w, "{\"type\":\"");
+  write_str(w, kinds[t->kind]);
+  write_char(w, '"');
+  if (t->store_class) {
+    write_json_key(w, "storage");
+    write_json_str(w, token_kind_map[t->store_class]);
+  }
+  if (t->is_const) {
+    write_json_key(w, "const");
+    write_str(w, "true");
+  }
+  if (t->is_volatile) {
+    write_json_key(w, "volatile");
+    write_str(w, "true");
   }
+
+  switch (t->kind) {
+  case NumericT: {
+    write_json_key(w, "base");
+    write_json_str(w, token_kind_map[t->numeric.base]);
+    if (t->numeric.is_signed) {
+      write_json_key(w, "signed");
+      write_str(w, "true");
+    }
+    if (t->numeric.is_unsigned) {
+      write_json_key(w, "unsigned");
+      write_str(w, "true");
+    }
+    if (t->numeric.is_short) {
+      write_json_key(w, "short");
+      write_str(w, "true");
+    }
+    if (t->numeric.is_long) {
+      write_json_key(w, "long");
+      write_str(w, "true");
+    }
+    break;
+  }
+  case ArrT: {
+    if (t->arr_size) {
+      write_json_key(w, "size");
+      write_long(w, t->arr_size);
+    }
+  }
+  /* fallthrough */
+  case PtrT: {
+    write_json_key(w, "inner");
+    write_type_json(w, t->inner);
+    break;
+  }
+  case FnT: {
+    int i;
+    write_json_key(w, "params");
+    write_char(w, '[');
+    for (i = 0; i < t->fn_param_decls_len; i++) {
+      if (i) {
+        write_char(w, ',');
+      }
+      write_ast_json(w, t->fn_param_decls + i);
+    }
+    write_char(w, ']');
+    write_json_key(w, "ret");
+    write_type_json(w, t->inner);
+    break;
+  }
+  case StructT:
+  case UnionT:
+  case EnumT: {
+    if (t->name) {
+      write_json_key(w, "name");
+      write_json_str(w, t->name->u.ident.name);
+    }
+    if (t->struct_fields) {
+      write_json_key(w, "fields");
+      write_ast_json(w, t->struct_fields);
+    }
+    if (t->enum_idents) {
+      int i;
+      write_json_key(w, "consts");
+      write_char(w, '[');
+      for (i = 0; i < t->enum_idents->u.list.len; i++) {
+        ast_node_t *ex = ast_list_at(t->enum_exprs, i);
+        if (i) {
+          write_char(w, ',');
+        }
+        write_str(w, "{\"name\":");
+        write_json_str(w, ast_list_at(t->enum_idents, i)->u.ident.name);
+        if (ex) {
+          write_json_key(w, "value");
+          write_ast_json(w, ex);
+        }
+        write_char(w, '}');
+      }
+      write_char(w, ']');
+    }
+    break;
+  }
+  default:
+    break;
+  }
+
+  write_char(w, '}');
+}
+
+/* writes ,"key":node if node is present */
+void write_json_child(writer *w, const char *key, ast_node_t *node) {
+  if (node) {
+    write_json_key(w, key);
+    write_ast_json(w, node);
   }
 }
 
+void write_ast_json(writer *w, ast_node_t *root) {
+  const char *stmt_kinds[] = {"LabelStmt",  "BlockStmt",   "ExprStmt",
+                              "IfStmt",     "IfElseStmt",  "SwitchStmt",
+                              "WhileStmt",  "DoWhileStmt", "ForStmt",
+                              "JumpStmt"};
+  const char *expr_kinds[] = {"InfixExpr", "PrefixExpr", "PostfixExpr",
+                              "CommaExpr", "CallExpr",   "CastExpr"};
+
+  if (!root) {
+    write_str(w, "null");
+    return;
+  }
+
+  write_str(w, "{\"kind\":\"");
+  switch (root->kind) {
+  case Stmt:
+    write_str(w, stmt_kinds[root->u.stmt.kind]);
+    break;
+  case Expr:
+    write_str(w, expr_kinds[root->u.expr.kind]);
+    break;
+  default:
+    write_str(w, ast_node_kind_map[root->kind]);
+  }
+  write_char(w, '"');
+
+  switch (root->kind) {
+  case Ident: {
+    write_json_key(w, "name");
+    write_json_str(w, root->u.ident.name);
+    break;
+  }
+  case Lit: {
+    write_json_key(w, "value");
+    switch (root->u.lit.kind) {
+    case StrLit: {
+      write_json_str(w, root->u.lit.string);
+      break;
+    }
+    case CharLit: {
+      write_json_str(w, root->u.lit.character);
+      write_json_key(w, "char");
+      write_str(w, "true");
+      break;
+    }
+    default: {
+      write_lit_int(w, &root->u.lit);
+    }
+    }
+    break;
+  }
+  case FnDefn: {
+    ast_decl *d = root->u.fn_defn.decl;
+    if (d->name) {
+      write_json_key(w, "name");
+      write_json_str(w, d->name->u.ident.name);
+    }
+    write_json_key(w, "type");
+    write_type_json(w, d->type);
+    write_json_child(w, "body", fn_defn_body(root));
+    break;
+  }
+  case Decl: {
+    if (root->u.decl.name) {
+      write_json_key(w, "name");
+      write_json_str(w, root->u.decl.name->u.ident.name);
+    }
+    write_json_key(w, "type");
+    write_type_json(w, root->u.decl.type);
+    write_json_child(w, "init", root->u.decl.init);
+    break;
+  }
+  case Tok: {
+    write_json_key(w, "tok");
+    write_json_str(w, token_kind_map[root->u.tok.kind]);
+    break;
+  }
+  case Stmt: {
+    ast_stmt *s = &root->u.stmt;
+    if (s->kind == JumpStmt) {
+      write_json_key(w, "jump");
+      write_json_str(w, token_kind_map[s->jump->u.tok.kind]);
+    } else {
+      write_json_child(w, "label", s->label);
+    }
+    write_json_child(w, "case", s->case_expr);
+    write_json_child(w, "init", s->init);
+    write_json_child(w, "cond", s->cond);
+    write_json_child(w, "iter", s->iter);
+    write_json_child(w, "inner", s->inner);
+    write_json_child(w, "else", s->inner_else);
+    break;
+  }
+  case Expr: {
+    ast_expr *e = &root->u.expr;
+    write_json_key(w, "op");
+    write_json_str(w, token_kind_map[e->op]);
+    if (e->kind == CommaExpr) {
+      int i;
+      write_json_key(w, "items");
+      write_char(w, '[');
+      for (i = 0; i < e->mhs_len; i++) {
+        if (i) {
+          write_char(w, ',');
+        }
+        write_ast_json(w, e->mhs + i);
+      }
+      write_char(w, ']');
+      break;
+    }
+    write_json_child(w, "lhs", e->lhs);
+    write_json_child(w, "mhs", e->mhs);
+    write_json_child(w, "rhs", e->rhs);
+    break;
+  }
+  case List: {
+    int i;
+    write_json_key(w, "items");
+    write_char(w, '[');
+    for (i = 0; i < root->u.list.len; i++) {
+      if (i) {
+        write_char(w, ',');
+      }
+      write_ast_json(w, root->u.list.nodes[i]);
+    }
+    write_char(w, ']');
+    break;
+  }
+  case TypeName: {
+    write_json_key(w, "type");
+    write_type_json(w, &root->u.type_name);
+    break;
+  }
+  default:
+    break;
+  }
+
+  write_char(w, '}');
+}
+
 parser_t new_parser(struct unit *u) {
   parser_t p = {0};
   p.toks = u->toks;
@@ -390,36 +801,42 @@ void append_node(ast_node_t **parent, int *len, int *cap, ast_node_t child) {
 
   if (*cap == 0) {
     *cap = 16;
-    *parent = calloc(*cap, sizeof(ast_node_t));
+    *parent = alloc_calloc(ParseAlloc, *cap, sizeof(ast_node_t));
   }
   if (*cap <= *len + 1) {
     *cap *= 2;
-    *parent = realloc(*parent, sizeof(ast_node_t) * *cap);
+    *parent = alloc_realloc(ParseAlloc, *parent, sizeof(ast_node_t) * *cap);
   }
 
   (*parent)[(*len)++] = child;
 }
 
 void throw(parser_t * parser) {
-  printf("parsing error at %s [%d:%d]\n", parser->tok.text, parser->tok.line,
-         parser->tok.column);
-  exit(1);
+  fatal_printf("parsing error at %s [%d:%d]\n", parser->tok.text,
+               parser->tok.line, parser->tok.column);
+  fatal_exit();
 }
 
 void expect(parser_t *parser, token_kind_t kind) {
   if (parser->tok.kind == kind) {
     advance(parser);
   } else {
-    printf("expected %s, got %s\n", token_kind_map[kind], parser->tok.text);
+    fatal_printf("expected %s, got %s\n", token_kind_map[kind],
+                 parser->tok.text);
     throw(parser);
   }
 }
 
 void advance(parser_t *parser) {
+  COUNT(Advances);
   set_pos(parser, ++parser->pos);
 }
 
 void set_pos(parser_t *parser, int pos) {
+  COUNT(SetPos);
+  if (pos < parser->pos) {
+    COUNT(Backtracks);
+  }
   parser->pos = pos;
   parser->tok = parser->toks[pos];
   parser->kind = parser->tok.kind;
@@ -430,13 +847,14 @@ token_t peek(parser_t *parser, int delta) {
 }
 
 ast_node_t *new_node(ast_node_kind_t kind) {
-  ast_node_t *node = calloc(1, sizeof(ast_node_t));
+  ast_node_t *node = alloc_calloc(ParseAlloc, 1, sizeof(ast_node_t));
   node->kind = kind;
 
   if (kind == List) {
     node->u.list.cap = 16;
     node->u.list.len = 0;
-    node->u.list.nodes = calloc(node->u.list.cap, sizeof(ast_node_t *));
+    node->u.list.nodes =
+        alloc_calloc(ParseAlloc, node->u.list.cap, sizeof(ast_node_t *));
   }
 
   return node;
@@ -451,14 +869,14 @@ ast_node_t *parse_lit(parser_t *p) {
     advance(p);
   } else if (p->kind == String) {
     int len = strlen(p->tok.text) - 2;
-    char *str = calloc(len + 1, 1);
+    char *str = alloc_calloc(ParseAlloc, len + 1, 1);
     node->u.lit.kind = StrLit;
     strncpy(str, p->tok.text + 1, len);
     advance(p);
 
     for (; p->kind == String;) {
       int len_new = strlen(p->tok.text) - 2;
-      str = realloc(str, len + len_new + 1);
+      str = alloc_realloc(ParseAlloc, str, len + len_new + 1);
       strncpy(str + len, p->tok.text + 1, len_new);
       str[len += len_new] = 0;
       advance(p);
@@ -467,7 +885,7 @@ ast_node_t *parse_lit(parser_t *p) {
     node->u.lit.string = str;
   } else if (p->kind == Character) {
     int len = strlen(p->tok.text) - 2;
-    char *str = calloc(len + 1, 1);
+    char *str = alloc_calloc(ParseAlloc, len + 1, 1);
     node->u.lit.kind = CharLit;
     strncpy(str, p->tok.text + 1, len);
     node->u.lit.character = str;
@@ -480,8 +898,8 @@ ast_node_t *parse_lit(parser_t *p) {
 ast_node_t *parse_ident(parser_t *p) {
   ast_node_t *node = new_node(Ident);
 
-  node->u.ident = malloc(strlen(p->tok.text) + 1);
-  strcpy(node->u.ident, p->tok.text);
+  node->u.ident.name = alloc_malloc(ParseAlloc, strlen(p->tok.text) + 1);
+  strcpy(node->u.ident.name, p->tok.text);
   expect(p, Id);
 
   return node;
@@ -490,27 +908,83 @@ ast_node_t *parse_ident(parser_t *p) {
 ast_node_t *parse_into_ident(parser_t *p) {
   ast_node_t *node = new_node(Ident);
 
-  node->u.ident = malloc(strlen(p->tok.text) + 1);
-  strcpy(node->u.ident, p->tok.text);
+  node->u.ident.name = alloc_malloc(ParseAlloc, strlen(p->tok.text) + 1);
+  strcpy(node->u.ident.name, p->tok.text);
   advance(p);
 
   return node;
 }
 
 ast_node_t *parse_fn_defn(parser_t *p) {
-  ast_node_t *node = new_node(FnDefn);
+  ast_node_t *decl_specs = parse_decl_specs(p);
+  ast_node_t *decltor = parse_decltor(p);
+  return parse_fn_rest(p, decl_specs, decltor, false);
+}
 
+ast_node_t *parse_fn_sig(parser_t *p) {
   ast_node_t *decl_specs = parse_decl_specs(p);
   ast_node_t *decltor = parse_decltor(p);
-  ast_node_t *block_stmt = parse_stmt(p);
+  return parse_fn_rest(p, decl_specs, decltor, true);
+}
 
+ast_node_t *parse_fn_rest(parser_t *p, ast_node_t *decl_specs,
+                          ast_node_t *decltor, bool lazy) {
+  ast_node_t *node = new_node(FnDefn);
   ast_fn_defn *fn_defn = &node->u.fn_defn;
+
   fn_defn->decl = decl(decl_specs, decltor);
-  fn_defn->body = block_stmt;
+  fn_defn->body_begin = p->pos;
+  if (lazy) {
+    skip_block(p);
+  } else {
+    fn_defn->body = parse_stmt(p);
+  }
+  fn_defn->body_end = p->pos;
 
   return node;
 }
 
+ast_node_t *fn_defn_body(ast_node_t *node) {
+  ast_fn_defn *fn_defn = &node->u.fn_defn;
+  parser_t p = {0};
+
+  if (fn_defn->body || !fn_defn->toks) {
+    return fn_defn->body;
+  }
+
+  p.toks = fn_defn->toks;
+  p.toks_len = fn_defn->toks_len;
+  p.tdefs = fn_defn->tdefs;
+  p.tdefs_len = fn_defn->tdefs_len;
+  p.tdefs_shared = true;
+  set_pos(&p, fn_defn->body_begin);
+
+  fn_defn->body = parse_stmt(&p);
+  return fn_defn->body;
+}
+
+void skip_block(parser_t *p) {
+  int depth = 0;
+  int i;
+
+  if (p->kind != LBrace) {
+    expect(p, LBrace);
+  }
+
+  /* scan tokens directly, the parser state is only needed at the end */
+  for (i = p->pos; i < p->toks_len && p->toks[i].kind != Eof; i++) {
+    if (p->toks[i].kind == LBrace) {
+      depth++;
+    } else if (p->toks[i].kind == RBrace && !--depth) {
+      set_pos(p, i + 1);
+      return;
+    }
+  }
+
+  fatal_printf("unterminated block\n");
+  throw(p);
+}
+
 ast_node_t *parse_decl_specs(parser_t *p) { /* -> ast_decl_specs */
   ast_node_t *specs = new_node(List);
 
@@ -540,8 +1014,7 @@ ast_node_t *parse_decl_specs(parser_t *p) { /* -> ast_decl_specs */
       type *alias = NULL;
 
       for (i = 0; i < p->tdefs_len; i++) {
-        puts(p->tdefs[i].u.decl.name->u.ident);
-        if (!strcmp(p->tdefs[i].u.decl.name->u.ident, p->tok.text)) {
+        if (!strcmp(p->tdefs[i].u.decl.name->u.ident.name, p->tok.text)) {
           alias = p->tdefs[i].u.decl.type;
           break;
         }
@@ -574,8 +1047,15 @@ ast_node_t *parse_decl_specs(parser_t *p) { /* -> ast_decl_specs */
       }
       if (p->kind == LBrace) {
         ast_node_t *ls;
+        int i;
         expect(p, LBrace);
         ls = parse_decl(p);
+        for (; p->kind != RBrace;) {
+          ast_node_t *more = parse_decl(p);
+          for (i = 0; i < more->u.list.len; i++) {
+            ast_list_append(ls, ast_list_at(more, i));
+          }
+        }
         spec->struct_fields = ls;
         expect(p, RBrace);
       }
@@ -629,7 +1109,7 @@ ast_node_t *parse_decl_specs(parser_t *p) { /* -> ast_decl_specs */
       break;
     }
     default:
-      puts("invalid type");
+      fatal_printf("invalid type\n");
       throw(p);
     }
 
@@ -637,7 +1117,7 @@ ast_node_t *parse_decl_specs(parser_t *p) { /* -> ast_decl_specs */
   }
 
   if (!specs->u.list.len) {
-    puts("empty declaration specifiers");
+    fatal_printf("empty declaration specifiers\n");
     throw(p);
   }
 
@@ -697,7 +1177,7 @@ ast_node_t *parse_decltor(parser_t *p) { /* -> ast_decltor */
       outer_decltor->kind = ArrDecltor;
       expect(p, LBrack);
       if (p->kind != RBrack) {
-        outer_decltor->data.arr_size = parse_lit(p);
+        outer_decltor->data.arr_size = expr(p, 0);
       }
       expect(p, RBrack);
     } else {
@@ -764,7 +1244,7 @@ bool is_decl_spec(parser_t *p, token_t token) {
     int i;
     bool tdef = false;
     for (i = 0; i < p->tdefs_len; i++) {
-      if (!strcmp(p->tdefs[i].u.decl.name->u.ident, p->tok.text)) {
+      if (!strcmp(p->tdefs[i].u.decl.name->u.ident.name, token.text)) {
         tdef = true;
         break;
       }
@@ -777,14 +1257,14 @@ bool is_decl_spec(parser_t *p, token_t token) {
 }
 
 ast_decl *decl(struct ast_node_t *decl_specs, struct ast_node_t *decltor) {
-  ast_decl *d = calloc(1, sizeof(ast_decl));
+  ast_decl *d = alloc_calloc(ParseAlloc, 1, sizeof(ast_decl));
   type *t = NULL;
 
   /* Since types are outside-in and decltors are inside-out, decltors are
    * inverted recursively with a stack */
 
-  ast_node_t **stack =
-      calloc(256, sizeof(ast_node_t *)); /* worry about size later */
+  /* worry about size later */
+  ast_node_t **stack = alloc_calloc(ParseAlloc, 256, sizeof(ast_node_t *));
   ast_node_t **stack_top = stack;
   ast_node_t *cur;
   type *prev = NULL;
@@ -798,7 +1278,7 @@ ast_decl *decl(struct ast_node_t *decl_specs, struct ast_node_t *decltor) {
 
   for (; stack < stack_top;) {
     ast_node_t *top = *--stack_top;
-    t = calloc(1, sizeof(type));
+    t = alloc_calloc(ParseAlloc, 1, sizeof(type));
 
     switch (top->u.decltor.kind) {
     case IdentDecltor: {
@@ -816,10 +1296,9 @@ ast_decl *decl(struct ast_node_t *decl_specs, struct ast_node_t *decltor) {
     }
     case ArrDecltor: {
       t->kind = ArrT;
-      if (top->u.decltor.data.arr_size) {
-        t->arr_size = top->u.decltor.data.arr_size->u.lit.integer;
-      } else {
-        t->arr_size = 0;
+      t->arr_expr = top->u.decltor.data.arr_size;
+      if (t->arr_expr && t->arr_expr->kind == Lit) {
+        t->arr_size = t->arr_expr->u.lit.integer;
       }
       if (prev) {
         prev->inner = t;
@@ -838,7 +1317,8 @@ ast_decl *decl(struct ast_node_t *decl_specs, struct ast_node_t *decltor) {
       }
       if (top->u.decltor.data.params.decl_specs_len == 0) {
         t->fn_param_decls = new_node(Decl);
-        t->fn_param_decls->u.decl.type = calloc(1, sizeof(type));
+        t->fn_param_decls->u.decl.type =
+            alloc_calloc(ParseAlloc, 1, sizeof(type));
         t->fn_param_decls->u.decl.type->kind = VoidT;
         t->fn_param_decls_len = 1;
       }
@@ -872,7 +1352,7 @@ ast_decl *decl(struct ast_node_t *decl_specs, struct ast_node_t *decltor) {
     bool is_volatile = false;
     int i;
 
-    t = calloc(1, sizeof(type));
+    t = alloc_calloc(ParseAlloc, 1, sizeof(type));
     for (i = 0; i < decl_specs->u.list.len; i++) {
       ast_decl_spec specs = ast_list_at(decl_specs, i)->u.decl_spec;
       token_kind_t tok = specs.tok;
@@ -896,7 +1376,9 @@ ast_decl *decl(struct ast_node_t *decl_specs, struct ast_node_t *decltor) {
 
       switch (tok) {
       case Id: {
-        t = specs.alias;
+        /* a copy, as storage and qualifiers are set below */
+        t = alloc_calloc(ParseAlloc, 1, sizeof(type));
+        *t = *specs.alias;
         break;
       }
       case Char:
@@ -907,6 +1389,21 @@ ast_decl *decl(struct ast_node_t *decl_specs, struct ast_node_t *decltor) {
         t->numeric.base = tok;
         break;
       }
+      case Short:
+      case Long:
+      case Signed:
+      case Unsigned: {
+        /* int unless another specifier says otherwise */
+        t->kind = NumericT;
+        if (!t->numeric.base) {
+          t->numeric.base = Int;
+        }
+        t->numeric.is_short |= tok == Short;
+        t->numeric.is_long |= tok == Long;
+        t->numeric.is_signed |= tok == Signed;
+        t->numeric.is_unsigned |= tok == Unsigned;
+        break;
+      }
       case Void: {
         t->kind = VoidT;
         break;
@@ -999,7 +1496,7 @@ ast_node_t *parse_stmt_label(parser_t *p) {
   } else if (p->kind == Default) {
     node->u.stmt.label = parse_tok(p);
   } else {
-    puts("invalid label statement");
+    fatal_printf("invalid label statement\n");
     throw(p);
   }
 
@@ -1019,6 +1516,7 @@ ast_node_t *parse_stmt_block(parser_t *p) {
 
   ast_node_t *item = NULL;
   ast_node_t *ls = new_node(List);
+  int tdefs_len = p->tdefs_len;
   node->u.stmt.inner = ls;
 
   expect(p, LBrace);
@@ -1038,6 +1536,8 @@ ast_node_t *parse_stmt_block(parser_t *p) {
   }
 
   expect(p, RBrace);
+  /* typedefs declared in the block end with it */
+  p->tdefs_len = tdefs_len;
 
   node->u.stmt.kind = BlockStmt;
   return node;
@@ -1147,7 +1647,7 @@ ast_node_t *parse_stmt_jump(parser_t *p) {
     break;
   }
   default: {
-    puts("invalid jump stmt");
+    fatal_printf("invalid jump stmt\n");
     throw(p);
   }
   }
@@ -1175,19 +1675,41 @@ ast_node_t *parse_init(parser_t *p) {
   }
 }
 
+void add_tdef(parser_t *p, ast_node_t *tdef) {
+  if (p->tdefs_len == p->tdefs_cap || p->tdefs_shared) {
+    ast_node_t *tdefs;
+    p->tdefs_cap = p->tdefs_len ? p->tdefs_len * 2 : 16;
+    tdefs = alloc_malloc(ParseAlloc, sizeof(*p->tdefs) * p->tdefs_cap);
+    if (p->tdefs_len) {
+      memcpy(tdefs, p->tdefs, sizeof(*p->tdefs) * p->tdefs_len);
+    }
+    if (!p->tdefs_shared) {
+      alloc_free(p->tdefs);
+    }
+    p->tdefs = tdefs;
+    p->tdefs_shared = false;
+  }
+  p->tdefs[p->tdefs_len++] = *tdef;
+}
+
 ast_node_t *parse_decl(parser_t *p) {
-  ast_node_t *node = new_node(List);
   ast_node_t *decl_specs = parse_decl_specs(p);
+  ast_node_t *decltor = parse_decltor(p);
+  return parse_decl_rest(p, decl_specs, decltor);
+}
+
+ast_node_t *parse_decl_rest(parser_t *p, ast_node_t *decl_specs,
+                            ast_node_t *decltor) {
+  ast_node_t *node = new_node(List);
   ast_node_t *new;
 
   new = new_node(Decl);
-  new->u.decl = *decl(decl_specs, parse_decltor(p));
+  new->u.decl = *decl(decl_specs, decltor);
   ast_list_append(node, new);
 
   /* TODO: scope typedefs properly */
   if (new->u.decl.type->store_class == Typedef) {
-    p->tdefs = realloc(p->tdefs, sizeof(*p->tdefs) * (p->tdefs_len + 1));
-    p->tdefs[p->tdefs_len++] = *new;
+    add_tdef(p, new);
   }
 
   if (p->kind == Assn) {
@@ -1205,8 +1727,7 @@ ast_node_t *parse_decl(parser_t *p) {
     }
     ast_list_append(node, new);
     if (new->u.decl.type->store_class == Typedef) {
-      p->tdefs = realloc(p->tdefs, sizeof(*p->tdefs) * (p->tdefs_len + 1));
-      p->tdefs[p->tdefs_len++] = *new;
+      add_tdef(p, new);
     }
   }
 
@@ -1223,129 +1744,364 @@ struct ast_node_t *parse_tok(parser_t *p) {
 }
 
 ast_node_t *expr(parser_t *p, int min_bp) {
-  ast_node_t *lhs = new_node(Expr);
+  return expr_iter(p, min_bp, false);
+}
 
-  switch (p->kind) {
-  case Id: {
-    lhs = parse_ident(p);
-    break;
-  }
-  case Number:
-  case Character:
-  case String: {
-    lhs = parse_lit(p);
-    break;
-  }
-  case LParen: { /* group or cast */
-    advance(p);
-    if (is_decl_spec(p, p->tok)) {
-      expr_power power = expr_power_prefix(LParen);
+void expr_push(struct expr_stack *s, expr_frame_kind kind, ast_node_t *node,
+               int min_bp) {
+  if (s->len == s->cap) {
+    struct expr_frame *frames =
+        alloc_malloc(ParseAlloc, sizeof(*frames) * s->cap * 2);
+    memcpy(frames, s->frames, sizeof(*frames) * s->len);
+    if (s->frames != s->local) {
+      alloc_free(s->frames);
+    }
+    s->frames = frames;
+    s->cap *= 2;
+  }
+  s->frames[s->len].kind = kind;
+  s->frames[s->len].node = node;
+  s->frames[s->len].min_bp = min_bp;
+  s->len++;
+}
 
-      ast_node_t *type_name = parse_type_name(p);
-      expect(p, RParen);
+/*
+ * Operands are parsed in the Start state, operators in the Loop state.
+ * Where the recursive formulation would call expr(), a frame recording what
+ * to do with the result is pushed and parsing restarts in Start; finished
+ * operands are handed to the top frame in the Ret state.
+ */
+ast_node_t *expr_iter(parser_t *p, int min_bp, bool comma) {
+  enum { Start, Loop, Ret } state = Start;
+  struct expr_stack s;
+  ast_node_t *lhs = NULL;
 
-      lhs->u.expr.kind = CastExpr;
-      lhs->u.expr.op = LParen;
-      lhs->u.expr.lhs = type_name;
-      lhs->u.expr.rhs = expr(p, power.right);
-    } else {
-      lhs = parse_expr(p);
-      expect(p, RParen);
-    }
-    break;
-  }
-  case PlusPlus:
-  case MinusMinus:
-  case Amp:
-  case Star:
-  case Plus:
-  case Minus:
-  case Tilde:
-  case Exclaim:
-  case Sizeof: { /* prefix */
-    token_kind_t op = p->kind;
-    expr_power power = expr_power_prefix(op);
-    advance(p);
-
-    lhs->u.expr.kind = PrefixExpr;
-    lhs->u.expr.op = op;
+  s.frames = s.local;
+  s.len = 0;
+  s.cap = EXPR_STACK_LOCAL;
 
-    if (op == Sizeof && p->kind == LParen &&
-        is_decl_spec(p, peek(p, 1))) { /* sizeof(type_name) */
-      advance(p);
-      lhs->u.expr.rhs = parse_type_name(p);
-      expect(p, RParen);
-    } else {
-      lhs->u.expr.rhs = expr(p, power.right);
-    }
-    break;
-  }
-  default:
-    break;
+  expr_push(&s, DoneFrame, NULL, min_bp);
+  if (comma) {
+    expr_push(&s, CommaFrame, NULL, 0);
+    min_bp = 0;
   }
 
   for (;;) {
-    expr_power power = expr_power_postfix(p->kind);
-    if (power.left) { /* postfix */
-      ast_node_t *lhs_old = lhs;
-      token_kind_t op = p->kind;
+    switch (state) {
+    case Start: {
+      state = Loop;
 
-      if (power.left < min_bp) {
+      switch (p->kind) {
+      case Id: {
+        lhs = parse_ident(p);
+        break;
+      }
+      case Number:
+      case Character:
+      case String: {
+        lhs = parse_lit(p);
         break;
       }
+      case LParen: { /* group or cast */
+        advance(p);
+        if (is_decl_spec(p, p->tok)) {
+          ast_node_t *node = new_node(Expr);
 
-      advance(p);
+          node->u.expr.kind = CastExpr;
+          node->u.expr.op = LParen;
+          node->u.expr.lhs = parse_type_name(p);
+          expect(p, RParen);
 
-      lhs = new_node(Expr);
-      lhs->u.expr.kind = PostfixExpr;
-      lhs->u.expr.op = op;
-      lhs->u.expr.lhs = lhs_old;
-
-      if (op == Dot || op == Arrow) {
-        lhs->u.expr.rhs = parse_ident(p);
-      } else if (op == LParen) {
-        lhs->u.expr.kind = CallExpr;
-        if (p->kind != RParen) {
-          lhs->u.expr.rhs = parse_expr(p);
+          expr_push(&s, RhsFrame, node, min_bp);
+          min_bp = expr_power_prefix(LParen).right;
+          state = Start;
+        } else {
+          expr_push(&s, GroupFrame, NULL, min_bp);
+          expr_push(&s, CommaFrame, NULL, 0);
+          min_bp = 0;
+          state = Start;
         }
-        expect(p, RParen);
-      } else if (op == LBrack) {
-        lhs->u.expr.rhs = expr(p, 0);
-        expect(p, RBrack);
+        break;
       }
+      case PlusPlus:
+      case MinusMinus:
+      case Amp:
+      case Star:
+      case Plus:
+      case Minus:
+      case Tilde:
+      case Exclaim:
+      case Sizeof: { /* prefix */
+        ast_node_t *node = new_node(Expr);
+        token_kind_t op = p->kind;
+        advance(p);
 
-      continue;
-    }
+        node->u.expr.kind = PrefixExpr;
+        node->u.expr.op = op;
 
-    power = expr_power_infix(p->kind);
-    if (power.left && power.right) {
-      ast_node_t *lhs_old = lhs;
+        if (op == Sizeof && p->kind == LParen &&
+            is_decl_spec(p, peek(p, 1))) { /* sizeof(type_name) */
+          advance(p);
+          node->u.expr.rhs = parse_type_name(p);
+          expect(p, RParen);
+          lhs = node;
+        } else {
+          expr_push(&s, RhsFrame, node, min_bp);
+          min_bp = expr_power_prefix(op).right;
+          state = Start;
+        }
+        break;
+      }
+      default:
+        lhs = new_node(Expr);
+        break;
+      }
+      break;
+    }
+    case Loop: {
+      expr_power power = expr_power_postfix(p->kind);
+      ast_node_t *node;
       token_kind_t op = p->kind;
 
-      if (power.left < min_bp) {
+      if (power.left) { /* postfix */
+        if (power.left < min_bp) {
+          state = Ret;
+          break;
+        }
+
+        advance(p);
+
+        node = new_node(Expr);
+        node->u.expr.kind = PostfixExpr;
+        node->u.expr.op = op;
+        node->u.expr.lhs = lhs;
+        lhs = node;
+
+        if (op == Dot || op == Arrow) {
+          node->u.expr.rhs = parse_ident(p);
+        } else if (op == LParen) {
+          node->u.expr.kind = CallExpr;
+          if (p->kind != RParen) {
+            expr_push(&s, CallFrame, node, min_bp);
+            expr_push(&s, CommaFrame, NULL, 0);
+            min_bp = 0;
+            state = Start;
+          } else {
+            expect(p, RParen);
+          }
+        } else if (op == LBrack) {
+          expr_push(&s, IndexFrame, node, min_bp);
+          min_bp = 0;
+          state = Start;
+        }
         break;
       }
 
-      advance(p);
+      power = expr_power_infix(op);
+      if (power.left && power.right) {
+        if (power.left < min_bp) {
+          state = Ret;
+          break;
+        }
+
+        advance(p);
 
-      lhs = new_node(Expr);
-      lhs->u.expr.kind = InfixExpr;
-      lhs->u.expr.op = op;
-      lhs->u.expr.lhs = lhs_old;
+        node = new_node(Expr);
+        node->u.expr.kind = InfixExpr;
+        node->u.expr.op = op;
+        node->u.expr.lhs = lhs;
 
-      if (op == Question) {
-        lhs->u.expr.mhs = expr(p, 0);
+        if (op == Question) {
+          expr_push(&s, MhsFrame, node, min_bp);
+          min_bp = 0;
+        } else {
+          expr_push(&s, RhsFrame, node, min_bp);
+          min_bp = power.right;
+        }
+        state = Start;
+        break;
+      }
+
+      state = Ret;
+      break;
+    }
+    case Ret: {
+      struct expr_frame *top = s.frames + s.len - 1;
+      ast_node_t *node = top->node;
+
+      /* by default resume the operator loop of the frame's level */
+      state = Loop;
+      min_bp = top->min_bp;
+
+      switch (top->kind) {
+      case DoneFrame: {
+        if (s.frames != s.local) {
+          alloc_free(s.frames);
+        }
+        return lhs;
+      }
+      case RhsFrame: {
+        node->u.expr.rhs = lhs;
+        lhs = node;
+        s.len--;
+        break;
+      }
+      case MhsFrame: {
+        node->u.expr.mhs = lhs;
         expect(p, Colon);
+        top->kind = RhsFrame;
+        min_bp = expr_power_infix(Question).right;
+        state = Start;
+        break;
+      }
+      case GroupFrame: {
+        expect(p, RParen);
+        s.len--;
+        break;
+      }
+      case CallFrame: {
+        node->u.expr.rhs = lhs;
+        lhs = node;
+        expect(p, RParen);
+        s.len--;
+        break;
+      }
+      case IndexFrame: {
+        node->u.expr.rhs = lhs;
+        lhs = node;
+        expect(p, RBrack);
+        s.len--;
+        break;
       }
-      lhs->u.expr.rhs = expr(p, power.right);
+      case CommaFrame: {
+        /* lhs, lhs, ... */
+        if (p->kind == Comma) {
+          if (!node) {
+            node = new_node(Expr);
+            node->u.expr.kind = CommaExpr;
+            node->u.expr.op = Comma;
+            top->node = node;
+          }
+          append_node(&node->u.expr.mhs, &node->u.expr.mhs_len,
+                      &node->u.expr.mhs_cap, *lhs);
+          expect(p, Comma);
+          state = Start;
+          break;
+        }
+        if (node) {
+          append_node(&node->u.expr.mhs, &node->u.expr.mhs_len,
+                      &node->u.expr.mhs_cap, *lhs);
+          lhs = node;
+        }
+        /* the comma list is complete, hand it to the frame below */
+        s.len--;
+        state = Ret;
+        break;
+      }
+      }
+      break;
+    }
+    }
+  }
+}
 
-      continue;
+int expr_kids(ast_node_t *node) {
+  ast_expr *e = &node->u.expr;
+  ast_node_t *args;
+
+  if (node->kind != Expr) {
+    return 0;
+  }
+  switch (e->kind) {
+  case PrefixExpr:
+    return 1;
+  case PostfixExpr:
+    return e->op == LBrack ? 2 : 1;
+  case CallExpr:
+    args = e->rhs;
+    if (args && args->kind == Expr && args->u.expr.kind == CommaExpr) {
+      return 1 + args->u.expr.mhs_len;
+    }
+    return args ? 2 : 1;
+  case CommaExpr:
+    return e->mhs_len;
+  case CastExpr:
+    return 2;
+  default:
+    return 3;
+  }
+}
+
+ast_node_t *expr_kid(ast_node_t *node, int i) {
+  ast_expr *e = &node->u.expr;
+
+  switch (e->kind) {
+  case PrefixExpr:
+    return e->rhs;
+  case CallExpr:
+    if (i && e->rhs->kind == Expr && e->rhs->u.expr.kind == CommaExpr) {
+      return e->rhs->u.expr.mhs + i - 1;
     }
+    return i ? e->rhs : e->lhs;
+  case CommaExpr:
+    return e->mhs + i;
+  default:
+    return i == 0 ? e->lhs : i == 1 && e->kind == InfixExpr ? e->mhs : e->rhs;
+  }
+}
 
-    break;
+void expr_walk_push(struct expr_walk *w, ast_node_t *node) {
+  struct expr_walk_frame *f;
+
+  if (w->len == w->cap) {
+    struct expr_walk_frame *frames =
+        alloc_malloc(SemaAlloc, sizeof(*frames) * w->cap * 2);
+    memcpy(frames, w->frames, sizeof(*frames) * w->len);
+    if (w->frames != w->local) {
+      alloc_free(w->frames);
+    }
+    w->frames = frames;
+    w->cap *= 2;
   }
+  f = w->frames + w->len++;
+  f->node = node;
+  f->kid = 0;
+  f->kids = !w->descend || w->descend(node) ? expr_kids(node) : 0;
+}
+
+void expr_walk_init(struct expr_walk *w, ast_node_t *node,
+                    bool (*descend)(ast_node_t *)) {
+  w->frames = w->local;
+  w->len = 0;
+  w->cap = EXPR_STACK_LOCAL;
+  w->descend = descend;
+  if (node) {
+    expr_walk_push(w, node);
+  }
+}
+
+ast_node_t *expr_walk_next(struct expr_walk *w) {
+  while (w->len) {
+    struct expr_walk_frame *top = w->frames + w->len - 1;
+    ast_node_t *kid;
 
-  return lhs;
+    if (top->kid < top->kids) {
+      if ((kid = expr_kid(top->node, top->kid++))) {
+        expr_walk_push(w, kid);
+      }
+      continue;
+    }
+    if (!--w->len && w->frames != w->local) {
+      /* the walk is over, and top is still the last frame */
+      kid = top->node;
+      alloc_free(w->frames);
+      w->frames = w->local;
+      w->cap = EXPR_STACK_LOCAL;
+      return kid;
+    }
+    return top->node;
+  }
+  return NULL;
 }
 
 expr_power expr_power_prefix(token_kind_t op) {
@@ -1462,32 +2218,15 @@ expr_power expr_power_postfix(token_kind_t op) {
 }
 
 ast_node_t *parse_expr(parser_t *p) {
-  ast_node_t *root = expr(p, 0);
-  ast_node_t *root_comma;
-
-  if (p->kind != Comma) {
-    return root;
-  }
-
-  root_comma = new_node(Expr);
-  root_comma->u.expr.kind = CommaExpr;
-  root_comma->u.expr.op = Comma;
-  append_node(&root_comma->u.expr.mhs, &root_comma->u.expr.mhs_len,
-              &root_comma->u.expr.mhs_cap, *root);
-  for (; p->kind == Comma;) {
-    expect(p, Comma);
-    append_node(&root_comma->u.expr.mhs, &root_comma->u.expr.mhs_len,
-                &root_comma->u.expr.mhs_cap, *expr(p, 0));
-  }
-
-  return root_comma;
+  return expr_iter(p, 0, true);
 }
 
 void ast_list_append(ast_node_t *list, struct ast_node_t *item) {
   if (list->u.list.len >= list->u.list.cap) {
     list->u.list.cap *= 2;
     list->u.list.nodes =
-        realloc(list->u.list.nodes, sizeof(ast_node_t *) * list->u.list.cap);
+        alloc_realloc(ParseAlloc, list->u.list.nodes,
+                      sizeof(ast_node_t *) * list->u.list.cap);
   }
 
   list->u.list.nodes[list->u.list.len++] = item;
@@ -1495,8 +2234,8 @@ void ast_list_append(ast_node_t *list, struct ast_node_t *item) {
 
 ast_node_t *ast_list_at(ast_node_t *list, int idx) {
   if (idx == list->u.list.len) {
-    puts("out of bounds");
-    exit(1);
+    fatal_printf("out of bounds\n");
+    fatal_exit();
   }
   return list->u.list.nodes[idx];
 }
@@ -1511,11 +2250,11 @@ ast_node_t *parse_type_name(parser_t *p) {
   decltor = parse_decltor(p);
   decltion = decl(decl_specs, decltor);
   if (decltion->init || decltion->name) {
-    puts("malformed type name");
+    fatal_printf("malformed type name\n");
     throw(p);
   }
   if (decltion->type->store_class) {
-    puts("type name cannot have storage class specifier");
+    fatal_printf("type name cannot have storage class specifier\n");
     throw(p);
   }
 
@@ -1524,36 +2263,218 @@ ast_node_t *parse_type_name(parser_t *p) {
   return node;
 }
 
+/* Returns the name a top-level node declares, or its kind if none */
+const char *top_name(ast_node_t *node) {
+  ast_decl *decl =
+      node->kind == FnDefn ? node->u.fn_defn.decl
+      : node->kind == Decl ? &node->u.decl
+                           : NULL;
+
+  if (decl && decl->name && decl->name->kind == Ident) {
+    return decl->name->u.ident.name;
+  }
+  return ast_node_kind_map[node->kind];
+}
+
+/*
+ * Parses a top-level declaration or function definition into u.
+ * Returns the index of the node if it is a FnDefn, otherwise -1.
+ */
+int parse_top(struct unit *u, parser_t *p, bool lazy) {
+  struct unit_item item;
+  ast_node_t *decl_specs, *decltor;
+  struct trace *trace = stats_trace(u->stats);
+  double begin = trace_now(trace);
+  int fn = -1;
+  int i;
+
+  item.tdefs_begin = p->tdefs_len;
+  item.toks_begin = p->pos;
+  item.nodes_begin = u->nodes_len;
+
+  /* the leading specifiers and declarator decide between FnDefn and Decl, and
+   * are shared by both */
+  decl_specs = parse_decl_specs(p);
+  decltor = parse_decltor(p);
+
+  if (p->kind == LBrace) { /* FnDefn */
+    unit_append_node(u, *parse_fn_rest(p, decl_specs, decltor, lazy));
+    fn = u->nodes_len - 1;
+  } else if (p->kind == Semi || p->kind == Comma || p->kind == Assn) { /* Decl */
+    ast_node_t *decls = parse_decl_rest(p, decl_specs, decltor);
+
+    for (i = 0; i < decls->u.list.len; i++) {
+      unit_append_node(u, *decls->u.list.nodes[i]);
+    }
+  } else {
+    fatal_printf("unexpected token %s (%s)\n", p->tok.text,
+                 token_kind_map[p->kind]);
+    throw(p);
+  }
+
+  item.toks_end = p->pos;
+  item.nodes_end = u->nodes_len;
+  item.tdefs_end = p->tdefs_len;
+  item.ln_begin = item.ln_end = 0;
+  for (i = item.toks_begin; i < item.toks_end; i++) {
+    if (p->toks[i].expanded) {
+      continue;
+    }
+    if (!item.ln_begin) {
+      item.ln_begin = p->toks[i].line;
+    }
+    item.ln_end = p->toks[i].line;
+  }
+  unit_append_item(u, item);
+
+  if (trace && item.nodes_end > item.nodes_begin) {
+    trace_span(trace, "decl", top_name(u->nodes + item.nodes_begin), begin,
+               "line", item.ln_begin);
+  }
+  return fn;
+}
+
 void parse(struct unit *u) {
   parser_t p;
 
   p = new_parser(u);
 
   for (; p.kind != Eof;) {
-    ast_node_t *node = NULL;
-    int pos = p.pos;
-
-    parse_decl_specs(&p);
-    parse_decltor(&p);
-
-    if (p.kind == LBrace) { /* FnDefn */
-      set_pos(&p, pos);
-      node = parse_fn_defn(&p);
-      unit_append_node(u, *node);
-    } else if (p.kind == Semi || p.kind == Comma || p.kind == Assn) { /* Decl */
-      ast_node_t *decls;
-      int i;
+    parse_top(u, &p, false);
+  }
+  u->tdefs = p.tdefs;
+  u->tdefs_len = p.tdefs_len;
+}
 
-      set_pos(&p, pos);
-      decls = parse_decl(&p);
+/*
+ * Parses top-level declarations of u, skipping function bodies.
+ * Returns the indices of the FnDefn nodes in fns.
+ */
+int parse_lazy_fns(struct unit *u, int **fns) {
+  parser_t p;
+  int *tdefs_lens = NULL;
+  int fns_len = 0;
+  int fns_cap = 0;
+  int i;
 
-      for (i = 0; i < decls->u.list.len; i++) {
-        unit_append_node(u, *decls->u.list.nodes[i]);
-      }
-    } else {
-      printf("unexpected token %s (%s)\n", p.tok.text, token_kind_map[p.kind]);
-      throw(&p);
+  p = new_parser(u);
+  *fns = NULL;
+
+  /* declarations and typedefs must be seen in order */
+  for (; p.kind != Eof;) {
+    int node = parse_top(u, &p, true);
+    if (node < 0) {
+      continue;
     }
+
+    if (fns_len == fns_cap) {
+      fns_cap = fns_cap ? fns_cap * 2 : 64;
+      *fns = alloc_realloc(ParseAlloc, *fns, sizeof(**fns) * fns_cap);
+      tdefs_lens = alloc_realloc(ParseAlloc, tdefs_lens,
+                                 sizeof(*tdefs_lens) * fns_cap);
+    }
+    (*fns)[fns_len] = node;
+    tdefs_lens[fns_len] = p.tdefs_len; /* typedefs in scope */
+    fns_len++;
+  }
+
+  /* p.tdefs only grew by appending, so every body sees its own prefix */
+  for (i = 0; i < fns_len; i++) {
+    ast_fn_defn *fn_defn = &u->nodes[(*fns)[i]].u.fn_defn;
+    fn_defn->toks = u->toks;
+    fn_defn->toks_len = u->toks_len;
+    fn_defn->tdefs = p.tdefs;
+    fn_defn->tdefs_len = tdefs_lens[i];
+  }
+
+  u->tdefs = p.tdefs;
+  u->tdefs_len = p.tdefs_len;
+  alloc_free(tdefs_lens);
+  return fns_len;
+}
+
+void parse_lazy(struct unit *u) {
+  int *fns;
+  parse_lazy_fns(u, &fns);
+  alloc_free(fns);
+}
+
+/* arg for parse_body_job */
+struct body_jobs {
+  struct unit *unit;
+  int *fns;
+  /* the fatal error of the first body that failed, as parse would see it */
+  pthread_mutex_t lock;
+  char *err;
+  int err_idx;
+};
+
+/*
+ * Parses one body. A fatal error is caught, so it neither exits from a
+ * worker nor jumps out of pool_run, and kept if no earlier body failed.
+ */
+void parse_body_job(void *arg, int idx) {
+  struct body_jobs *jobs = arg;
+  ast_node_t *fn = jobs->unit->nodes + jobs->fns[idx];
+  struct trace *trace = stats_trace(jobs->unit->stats);
+  double begin = trace_now(trace);
+  struct fatal_catch c, *prev;
+  char *err;
+  size_t len;
+  FILE *mem;
+  writer w;
+  int skip;
+
+  /* parse never reaches bodies after one that failed */
+  pthread_mutex_lock(&jobs->lock);
+  skip = jobs->err && jobs->err_idx < idx;
+  pthread_mutex_unlock(&jobs->lock);
+  if (skip) {
+    return;
+  }
+
+  mem = open_memstream(&err, &len);
+  w = new_writer(mem);
+  c.w = &w;
+  prev = fatal_catch(&c);
+  if (!setjmp(c.env)) {
+    fn_defn_body(fn);
+  }
+  fatal_catch(prev);
+  free_writer(&w);
+  fclose(mem);
+
+  pthread_mutex_lock(&jobs->lock);
+  if (len && (!jobs->err || idx < jobs->err_idx)) {
+    free(jobs->err);
+    jobs->err = err;
+    jobs->err_idx = idx;
+    err = NULL;
+  }
+  pthread_mutex_unlock(&jobs->lock);
+  free(err);
+  trace_span(trace, "body", top_name(fn), begin, NULL, 0);
+}
+
+void parse_parallel(struct unit *u, int nthreads) {
+  struct body_jobs jobs;
+  int fns_len;
+
+  jobs.unit = u;
+  jobs.err = NULL;
+  jobs.err_idx = 0;
+  pthread_mutex_init(&jobs.lock, NULL);
+  fns_len = parse_lazy_fns(u, &jobs.fns);
+
+  pool_run(nthreads, fns_len, parse_body_job, &jobs);
+  pthread_mutex_destroy(&jobs.lock);
+  alloc_free(jobs.fns);
+
+  /* raised on this thread only once every worker is done */
+  if (jobs.err) {
+    fatal_printf("%s", jobs.err);
+    free(jobs.err);
+    fatal_exit();
   }
 }
 
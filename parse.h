@@ -3,6 +3,7 @@
 #pragma once
 
 #include "chocc.h"
+#include "io.h"
 #include "lex.h"
 
 #include <stdlib.h>
@@ -20,6 +21,8 @@ typedef struct parser_t {
 
   struct ast_node_t *tdefs;
   int tdefs_len;
+  int tdefs_cap;
+  bool tdefs_shared; /* tdefs is borrowed, copy before appending */
 } parser_t;
 
 void throw(parser_t * parser);
@@ -105,7 +108,8 @@ typedef struct type {
   struct type *inner;
 
   /* arr */
-  int arr_size;
+  int arr_size;                /* 0 if unknown */
+  struct ast_node_t *arr_expr; /* size as written, folded into arr_size */
 
   /* fn */
   struct type *fn_return_ty;
@@ -127,9 +131,13 @@ typedef struct type {
 
   /* storage class specifers */
   token_kind_t store_class;
+
+  struct layout *layout; /* memoized by type_layout */
 } type;
 
 void print_type(type *);
+void write_type(writer *, type *);
+void write_type_json(writer *, type *);
 
 struct ast_node_t;
 
@@ -143,7 +151,11 @@ struct ast_node_t;
  * identifier := [a-zA-Z_][a-zA-Z0-9_]+
  */
 
-typedef char *ast_ident;
+typedef struct ast_ident {
+  char *name;
+  int sym;           /* 1 + index into the unit's symbols if resolved */
+  struct type *type; /* set by check */
+} ast_ident;
 
 struct ast_node_t *parse_ident(parser_t *);
 
@@ -180,6 +192,8 @@ typedef struct ast_lit {
   bool is_unsigned;
   bool is_long;
   bool is_float;
+
+  struct type *type; /* set by check */
 } ast_lit;
 
 /*
@@ -193,11 +207,45 @@ typedef struct ast_lit {
 
 typedef struct ast_fn_defn {
   struct ast_decl *decl;
-  struct ast_node_t *body; /* stmt */
+  struct ast_node_t *body; /* stmt, NULL until parsed if lazy */
+
+  /* token range of body, [body_begin, body_end) */
+  int body_begin;
+  int body_end;
+
+  /* source of a lazily parsed body, see fn_defn_body */
+  token_t *toks;
+  int toks_len;
+  struct ast_node_t *tdefs; /* typedefs in scope */
+  int tdefs_len;
+
+  int frame_size; /* slots of params and locals, set by resolve */
 } ast_fn_defn;
 
 struct ast_node_t *parse_fn_defn(parser_t *);
 
+/*
+ * Parses the function signature and skips its body by brace matching,
+ * recording the body token range but leaving body unset.
+ */
+struct ast_node_t *parse_fn_sig(parser_t *);
+
+/*
+ * Parses the rest of a function definition after its DeclSpecs and Decltor.
+ * If lazy, the body is skipped instead of parsed.
+ */
+struct ast_node_t *parse_fn_rest(parser_t *, struct ast_node_t *decl_specs,
+                                 struct ast_node_t *decltor, bool lazy);
+
+/*
+ * Returns the body of a FnDefn, parsing it on first access if it was skipped
+ * by parse_lazy. Not thread safe for the same node.
+ */
+struct ast_node_t *fn_defn_body(struct ast_node_t *);
+
+/* skip_block advances the parser past the {} block at the cursor. */
+void skip_block(parser_t *);
+
 /*
  * DeclSpecs (declaration specifiers)
  *
@@ -276,7 +324,7 @@ typedef struct ast_decltor {
   bool is_const;
   bool is_volatile;
   union {
-    struct ast_node_t *arr_size; /* ast_lit */
+    struct ast_node_t *arr_size; /* ast_expr */
     struct {
       struct ast_node_t *decl_specs; /* ast_declspec */
       struct ast_node_t *decltors;   /* ast_decltor */
@@ -308,6 +356,10 @@ typedef struct ast_decl {
  */
 struct ast_node_t *parse_decl(parser_t *p);
 
+/* Parses the rest of a declaration after its DeclSpecs and first Decltor. */
+struct ast_node_t *parse_decl_rest(parser_t *p, struct ast_node_t *decl_specs,
+                                   struct ast_node_t *decltor);
+
 /*
  * decl consumes DeclSpecs and Decltor into a parsed declaration
  */
@@ -342,6 +394,8 @@ typedef struct ast_expr {
   int mhs_cap;
   ast_expr_kind_t kind;
   token_kind_t op;
+
+  struct type *type; /* set by check */
 } ast_expr;
 
 typedef struct expr_power {
@@ -349,9 +403,86 @@ typedef struct expr_power {
   int right;
 } expr_power;
 
+/*
+ * expr_frame is a pending operator waiting for an operand in expr_iter,
+ * which keeps them on an explicit stack so that nesting depth is bounded by
+ * memory rather than by the C stack.
+ */
+typedef enum expr_frame_kind {
+  DoneFrame,  /* result of expr_iter */
+  RhsFrame,   /* prefix, cast and infix rhs */
+  MhsFrame,   /* ?mhs: */
+  GroupFrame, /* (expr) */
+  CallFrame,  /* fn(args) */
+  IndexFrame, /* arr[expr] */
+  CommaFrame  /* expr, expr, ... */
+} expr_frame_kind;
+
+struct expr_frame {
+  expr_frame_kind kind;
+  struct ast_node_t *node;
+  int min_bp; /* binding power to resume at */
+};
+
+/* frames kept on the C stack before spilling to the heap */
+#define EXPR_STACK_LOCAL 32
+
+struct expr_stack {
+  struct expr_frame *frames;
+  int len;
+  int cap;
+  struct expr_frame local[EXPR_STACK_LOCAL];
+};
+
 struct ast_node_t *parse_expr(parser_t *);
 struct ast_node_t *expr(parser_t *, int min_bp);
 
+/*
+ * Iterative Pratt parser behind expr and parse_expr.
+ * If comma, a comma separated list is parsed into a CommaExpr.
+ */
+struct ast_node_t *expr_iter(parser_t *, int min_bp, bool comma);
+
+/*
+ * expr_walk visits an expression in post-order, each operand left to right
+ * before the expression applying it, for the passes over parsed units. Like
+ * expr_iter it keeps its place on an explicit stack, so any expression the
+ * parser builds can be walked.
+ */
+struct expr_walk_frame {
+  struct ast_node_t *node;
+  int kid;  /* next operand to visit */
+  int kids; /* operands to visit */
+};
+
+struct expr_walk {
+  struct expr_walk_frame *frames;
+  int len;
+  int cap;
+  bool (*descend)(struct ast_node_t *); /* NULL for every Expr */
+  struct expr_walk_frame local[EXPR_STACK_LOCAL];
+};
+
+/*
+ * Returns the number of operands of node, in the order they are evaluated:
+ * a member name is not one, and the arguments of a call are, rather than
+ * the CommaExpr holding them. Nodes other than Expr have none.
+ */
+int expr_kids(struct ast_node_t *node);
+
+/* Returns operand i of node, or NULL if absent, as the mhs of most infixes */
+struct ast_node_t *expr_kid(struct ast_node_t *node, int i);
+
+/*
+ * Starts a walk of node, which may be NULL. Only Expr nodes for which
+ * descend returns true have their operands visited, if descend is given.
+ */
+void expr_walk_init(struct expr_walk *, struct ast_node_t *node,
+                    bool (*descend)(struct ast_node_t *));
+
+/* Returns the next node of the walk, or NULL after the last */
+struct ast_node_t *expr_walk_next(struct expr_walk *);
+
 expr_power expr_power_infix(token_kind_t);
 expr_power expr_power_prefix(token_kind_t);
 expr_power expr_power_postfix(token_kind_t);
@@ -463,6 +594,39 @@ typedef struct ast_node_t {
 } ast_node_t;
 
 void print_ast(ast_node_t *root, int depth, bool last, char *pad);
+void print_fn_sig(ast_node_t *fn);
+
+/*
+ * Writes the tree representation of a top-level node.
+ * last is whether it is the last of its siblings.
+ */
+void write_ast(writer *, ast_node_t *root, bool last);
+void write_ast_node(writer *, ast_node_t *root, int depth, bool last);
+void write_fn_sig(writer *, ast_node_t *fn);
+
+/*
+ * Writes the JSON representation of a node on a single line.
+ */
+void write_ast_json(writer *, ast_node_t *root);
 void parse(struct unit *);
 
+/*
+ * Parses one top-level declaration or function definition into u, recording
+ * it in u->items. Returns the index of the FnDefn node, or -1 for Decls.
+ */
+int parse_top(struct unit *u, parser_t *p, bool lazy);
+
+/*
+ * Parses like parse(), but function bodies are skipped by brace matching and
+ * only parsed on first access through fn_defn_body.
+ */
+void parse_lazy(struct unit *);
+
+/*
+ * Parses like parse(), but function bodies are skipped during the serial pass
+ * over top-level declarations and parsed afterwards on nthreads threads.
+ * The resulting nodes are identical to parse().
+ */
+void parse_parallel(struct unit *, int nthreads);
+
 #endif
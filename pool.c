@@ -0,0 +1,139 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "pool.h"
+#include "chocc.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * pool_range is the items [lo, hi) a worker has left. The worker takes from
+ * the front, and a worker with none left steals the back half.
+ */
+struct pool_range {
+  int lo;
+  int hi;
+  pthread_mutex_t lock;
+};
+
+struct pool {
+  pool_fn fn;
+  void *arg;
+  struct pool_range *ranges;
+  int nthreads;
+};
+
+/* arg of a worker thread */
+struct pool_worker_arg {
+  struct pool *pool;
+  int self;
+};
+
+/* Takes the back half of another worker's items into own. Returns false if
+ * every worker has run out. */
+bool pool_steal(struct pool *pool, int self) {
+  struct pool_range *own = pool->ranges + self;
+  int i;
+
+  for (i = 1; i < pool->nthreads; i++) {
+    struct pool_range *victim = pool->ranges + (self + i) % pool->nthreads;
+    int lo;
+    int hi;
+
+    pthread_mutex_lock(&victim->lock);
+    hi = victim->hi;
+    lo = victim->lo + (victim->hi - victim->lo) / 2;
+    victim->hi = lo;
+    pthread_mutex_unlock(&victim->lock);
+
+    if (lo < hi) {
+      pthread_mutex_lock(&own->lock);
+      own->lo = lo;
+      own->hi = hi;
+      pthread_mutex_unlock(&own->lock);
+      return true;
+    }
+  }
+  return false;
+}
+
+void pool_work(struct pool *pool, int self) {
+  struct pool_range *own = pool->ranges + self;
+
+  for (;;) {
+    int i;
+
+    pthread_mutex_lock(&own->lock);
+    i = own->lo < own->hi ? own->lo++ : -1;
+    pthread_mutex_unlock(&own->lock);
+
+    if (i >= 0) {
+      pool->fn(pool->arg, i);
+    } else if (!pool_steal(pool, self)) {
+      return;
+    }
+  }
+}
+
+void *pool_worker(void *arg) {
+  struct pool_worker_arg *w = arg;
+
+  pool_work(w->pool, w->self);
+  return NULL;
+}
+
+void pool_run(int nthreads, int n, pool_fn fn, void *arg) {
+  struct pool pool;
+  struct pool_worker_arg *args;
+  pthread_t *threads;
+  int i;
+
+  /* a thread without an item would only steal */
+  nthreads = nthreads < n ? nthreads : n;
+  if (nthreads <= 1) {
+    for (i = 0; i < n; i++) {
+      fn(arg, i);
+    }
+    return;
+  }
+
+  pool.fn = fn;
+  pool.arg = arg;
+  pool.nthreads = nthreads;
+  pool.ranges = calloc(nthreads, sizeof(*pool.ranges));
+  for (i = 0; i < nthreads; i++) {
+    pool.ranges[i].lo = (long)n * i / nthreads;
+    pool.ranges[i].hi = (long)n * (i + 1) / nthreads;
+    pthread_mutex_init(&pool.ranges[i].lock, NULL);
+  }
+
+  /* the calling thread is worker 0 */
+  threads = calloc(nthreads, sizeof(*threads));
+  args = calloc(nthreads, sizeof(*args));
+  for (i = 1; i < nthreads; i++) {
+    args[i].pool = &pool;
+    args[i].self = i;
+    if (pthread_create(threads + i, NULL, pool_worker, args + i)) {
+      puts("could not create thread");
+      exit(1);
+    }
+  }
+  pool_work(&pool, 0);
+  for (i = 1; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    pthread_mutex_destroy(&pool.ranges[i].lock);
+  }
+  free(pool.ranges);
+  free(threads);
+  free(args);
+}
+
+int pool_default_threads(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? n : 1;
+}
@@ -0,0 +1,23 @@
+#ifndef CHOCC_POOL_H
+#define CHOCC_POOL_H
+#pragma once
+
+/*
+ * pool_fn is a unit of work, called with the shared argument and the index of
+ * the item to process.
+ */
+typedef void (*pool_fn)(void *arg, int idx);
+
+/*
+ * Runs fn for every index in [0, n) on nthreads threads and waits for all of
+ * them to finish. Each thread starts with an even share of the indices and
+ * runs them in increasing order, stealing half of another thread's share
+ * when it runs out. Which thread runs an index is not fixed, so callers
+ * write to disjoint slots to get the same results regardless of nthreads.
+ */
+void pool_run(int nthreads, int n, pool_fn fn, void *arg);
+
+/* Returns the number of online processors, at least 1. */
+int pool_default_threads(void);
+
+#endif
@@ -0,0 +1,425 @@
+#include "reparse.h"
+#include "alloc.h"
+#include "cpp.h"
+#include "io.h"
+#include "lex.h"
+#include "parse.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Returns true if lines [first, last] of f lex the same on their own as they
+ * do in the whole file.
+ */
+bool lines_local(file *f, int first, int last) {
+  int i;
+
+  if (first > 0 && f->lines[first - 1].splice) {
+    return false;
+  }
+  for (i = first; i <= last; i++) {
+    line *ln = f->lines + i;
+    if (ln->cpp || ln->splice || ln->comment || strstr(ln->src, "/*") ||
+        strstr(ln->src, "*/")) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Returns true if lines [first, last] overlap an #if group */
+bool lines_in_cond(struct unit *u, int first, int last) {
+  int i;
+  for (i = 0; i < u->conds_len; i += 2) {
+    if (u->conds[i] <= last && u->conds[i + 1] >= first) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool is_macro(struct unit *u, const char *id) {
+  int i;
+  for (i = 0; i < u->macros_len; i++) {
+    if (!strcmp(u->macros[i], id)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Returns true if the brackets of toks are balanced */
+bool toks_balanced(token_t *toks, int len) {
+  int braces = 0, parens = 0, bracks = 0;
+  int i;
+
+  for (i = 0; i < len && braces >= 0 && parens >= 0 && bracks >= 0; i++) {
+    braces += (toks[i].kind == LBrace) - (toks[i].kind == RBrace);
+    parens += (toks[i].kind == LParen) - (toks[i].kind == RParen);
+    bracks += (toks[i].kind == LBrack) - (toks[i].kind == RBrack);
+  }
+  return !braces && !parens && !bracks;
+}
+
+/* Gives tok the line shifts of g it missed */
+void gap_line(struct unit_gap *g, token_t *tok) {
+  int i;
+
+  if (!tok->expanded) {
+    tok->line += g->shift;
+    return;
+  }
+  /* the line of its macro, which only moves for edits before it */
+  for (i = 0; i < g->shifts_len; i += 2) {
+    tok->line += (int)tok->line > g->shifts[i] ? g->shifts[i + 1] : 0;
+  }
+}
+
+/* Gives the tokens after the gap of u the line shifts they missed */
+void gap_settle(struct unit *u) {
+  struct unit_gap *g = &u->gap;
+  int i;
+
+  for (i = g->at; i < u->toks_len; i++) {
+    gap_line(g, u->toks + i + g->len);
+  }
+  g->shift = 0;
+  g->shifts_len = 0;
+}
+
+/*
+ * Moves the gap of u to before token at, giving the tokens it passes their
+ * lines as they are in front of the gap. Moving back over a macro expansion
+ * while shifts are pending settles every token after the gap first.
+ */
+void gap_move(struct unit *u, int at) {
+  struct unit_gap *g = &u->gap;
+  int i;
+
+  if (!g->len && !g->shifts_len) {
+    /* an empty gap is anywhere */
+    g->at = at;
+    return;
+  }
+  for (; g->at < at; g->at++) {
+    token_t tok = u->toks[g->at + g->len];
+    gap_line(g, &tok);
+    u->toks[g->at] = tok;
+  }
+  for (i = at; i < g->at && g->shifts_len; i++) {
+    if (u->toks[i].expanded) {
+      /* has no line that the shifts turn back into its own */
+      gap_settle(u);
+      break;
+    }
+  }
+  for (; g->at > at; g->at--) {
+    token_t tok = u->toks[g->at - 1];
+    tok.line -= tok.expanded ? 0 : g->shift;
+    u->toks[g->at - 1 + g->len] = tok;
+  }
+}
+
+/*
+ * Replaces tokens [begin, end) of u, where the gap is, with the len tokens
+ * of toks, growing the gap if they do not fit.
+ */
+void gap_splice(struct unit *u, int begin, int end, token_t *toks, int len) {
+  struct unit_gap *g = &u->gap;
+  int delta = len - (end - begin);
+  int tail = u->toks_len - end;
+
+  if (delta > g->len) {
+    u->toks_cap = (u->toks_len + delta) * 2;
+    u->toks = alloc_realloc(UnitAlloc, u->toks, u->toks_cap * sizeof(*u->toks));
+    memmove(u->toks + u->toks_cap - tail, u->toks + end + g->len,
+            tail * sizeof(*u->toks));
+    g->len = u->toks_cap - u->toks_len;
+  }
+  memcpy(u->toks + begin, toks, len * sizeof(*u->toks));
+  g->at = begin + len;
+  g->len -= delta;
+  u->toks_len += delta;
+}
+
+/* Shifts the lines after ln_end by ln_delta for the tokens after the gap */
+void gap_shift(struct unit *u, int ln_end, int ln_delta) {
+  struct unit_gap *g = &u->gap;
+
+  if (!ln_delta) {
+    return;
+  }
+  if (g->shifts_len == g->shifts_cap) {
+    g->shifts_cap = g->shifts_cap ? g->shifts_cap * 2 : 16;
+    g->shifts = alloc_realloc(UnitAlloc, g->shifts,
+                              g->shifts_cap * sizeof(*g->shifts));
+  }
+  g->shifts[g->shifts_len++] = ln_end;
+  g->shifts[g->shifts_len++] = ln_delta;
+  g->shift += ln_delta;
+}
+
+/*
+ * Applies e to the source of u and reparses around it. Returns false,
+ * leaving tokens and nodes stale, if u must be rebuilt.
+ */
+bool reparse_edit(struct unit *u, struct edit *e, bool rebuild) {
+  file *f = u->file;
+  file lines;
+  struct unit lexed, region;
+  parser_t p;
+  bool local;
+  int first, old_n, new_n, ln_begin, ln_end, ln_delta;
+  int ia, ib, tb, te, k0, k1, nb, ne, tok_delta, node_delta, item_delta;
+  int i, n;
+
+  first = file_line_at(f, e->begin);
+  ln_begin = first + 1;
+  ln_end = file_line_at(f, e->end) + 1;
+  local = !rebuild && !u->err && u->toks_len &&
+          lines_local(f, first, ln_end - 1) &&
+          !lines_in_cond(u, ln_begin, ln_end);
+
+  first = file_edit(f, e->begin, e->end, e->text, &old_n, &new_n);
+  ln_delta = new_n - old_n;
+  if (!local || !lines_local(f, first, first + new_n - 1)) {
+    return false;
+  }
+
+  /* relex the new lines alone */
+  lines.lines = f->lines + first;
+  lines.lines_len = lines.lines_cap = new_n;
+  lexed = new_unit();
+  lexed.file = &lines;
+  lex(&lexed);
+  if (lexed.err) {
+    return false;
+  }
+  for (i = n = 0; i < lexed.toks_len; i++) {
+    token_t tok = lexed.toks[i];
+    if (tok.kind == Lf || tok.kind == Eof) {
+      continue;
+    }
+    if (tok.kind == Directive || (tok.kind == Id && is_macro(u, tok.text))) {
+      return false;
+    }
+    tok.line += first;
+    lexed.toks[n++] = tok;
+  }
+  lexed.toks_len = n;
+
+  /* items overlapping the edited lines */
+  for (ia = 0; ia < u->items_len && u->items[ia].ln_end < ln_begin; ia++) {
+    if (!u->items[ia].ln_begin) {
+      return false;
+    }
+  }
+  for (ib = ia; ib < u->items_len && u->items[ib].ln_begin <= ln_end; ib++) {
+    if (!u->items[ib].ln_begin ||
+        u->items[ib].tdefs_begin != u->items[ib].tdefs_end) {
+      return false;
+    }
+  }
+  tb = ia < u->items_len ? u->items[ia].toks_begin : u->toks_len - 1;
+  te = ib > ia ? u->items[ib - 1].toks_end : tb;
+  nb = ia < u->items_len ? u->items[ia].nodes_begin : u->nodes_len;
+  ne = ib > ia ? u->items[ib - 1].nodes_end : nb;
+  gap_move(u, te);
+
+  /* old tokens of the edited lines, [k0, k1) */
+  k0 = k1 = -1;
+  for (i = tb; i < te; i++) {
+    token_t tok = u->toks[i];
+    if (!tok.expanded && (int)tok.line >= ln_begin &&
+        (int)tok.line <= ln_end) {
+      k0 = k0 < 0 ? i : k0;
+      k1 = i + 1;
+    }
+  }
+  if (k0 < 0) {
+    for (k0 = tb; k0 < te && (u->toks[k0].expanded ||
+                              (int)u->toks[k0].line <= ln_end);
+         k0++) {
+    }
+    if (k0 > tb && u->toks[k0 - 1].expanded) {
+      return false;
+    }
+    k1 = k0;
+  }
+  for (i = k0; i < k1; i++) {
+    if (u->toks[i].expanded) {
+      return false;
+    }
+  }
+
+  /* reparse the overlapping items with the new tokens in place */
+  region = new_unit();
+  for (i = tb; i < k0; i++) {
+    unit_append_tok(&region, u->toks[i]);
+  }
+  for (i = 0; i < lexed.toks_len; i++) {
+    unit_append_tok(&region, lexed.toks[i]);
+  }
+  for (i = k1; i < te; i++) {
+    token_t tok = u->toks[i];
+    tok.line += (int)tok.line > ln_end ? ln_delta : 0;
+    unit_append_tok(&region, tok);
+  }
+  unit_append_tok(&region, u->toks[u->toks_len - 1 + u->gap.len]);
+  if (!toks_balanced(region.toks, region.toks_len)) {
+    return false;
+  }
+
+  p = new_parser(&region);
+  p.tdefs = u->tdefs;
+  p.tdefs_len = p.tdefs_cap =
+      ia < u->items_len ? u->items[ia].tdefs_begin : u->tdefs_len;
+  p.tdefs_shared = true;
+  for (; p.kind != Eof;) {
+    parse_top(&region, &p, false);
+  }
+  if (p.tdefs != u->tdefs) {
+    /* a new typedef changes how everything after it parses */
+    return false;
+  }
+
+  /* splice tokens */
+  n = region.toks_len - 1;
+  tok_delta = n - (te - tb);
+  gap_splice(u, tb, te, region.toks, n);
+  gap_shift(u, ln_end, ln_delta);
+
+  /* splice nodes */
+  node_delta = region.nodes_len - (ne - nb);
+  if (u->nodes_len + node_delta > u->nodes_cap) {
+    u->nodes_cap = (u->nodes_len + node_delta) * 2;
+    u->nodes =
+        alloc_realloc(UnitAlloc, u->nodes, u->nodes_cap * sizeof(*u->nodes));
+  }
+  memmove(u->nodes + ne + node_delta, u->nodes + ne,
+          (u->nodes_len - ne) * sizeof(*u->nodes));
+  memcpy(u->nodes + nb, region.nodes, region.nodes_len * sizeof(*u->nodes));
+  u->nodes_len += node_delta;
+  /* function bodies follow their tokens */
+  for (i = 0; i < u->nodes_len; i++) {
+    ast_fn_defn *fn_defn = &u->nodes[i].u.fn_defn;
+    int shift = i < nb ? 0 : i < nb + region.nodes_len ? tb : tok_delta;
+
+    if (u->nodes[i].kind != FnDefn) {
+      continue;
+    }
+    fn_defn->body_begin += shift;
+    fn_defn->body_end += shift;
+    if (fn_defn->toks) {
+      fn_defn->toks = u->toks;
+      fn_defn->toks_len = u->toks_len;
+    }
+  }
+
+  /* splice items */
+  item_delta = region.items_len - (ib - ia);
+  if (u->items_len + item_delta > u->items_cap) {
+    u->items_cap = (u->items_len + item_delta) * 2;
+    u->items =
+        alloc_realloc(UnitAlloc, u->items, u->items_cap * sizeof(*u->items));
+  }
+  memmove(u->items + ib + item_delta, u->items + ib,
+          (u->items_len - ib) * sizeof(*u->items));
+  for (i = 0; i < region.items_len; i++) {
+    struct unit_item item = region.items[i];
+    item.toks_begin += tb;
+    item.toks_end += tb;
+    item.nodes_begin += nb;
+    item.nodes_end += nb;
+    u->items[ia + i] = item;
+  }
+  u->items_len += item_delta;
+  for (i = ia + region.items_len; i < u->items_len; i++) {
+    struct unit_item *item = u->items + i;
+    item->toks_begin += tok_delta;
+    item->toks_end += tok_delta;
+    item->nodes_begin += node_delta;
+    item->nodes_end += node_delta;
+    if (item->ln_begin) {
+      item->ln_begin += ln_delta;
+      item->ln_end += ln_delta;
+    }
+  }
+
+  for (i = 0; i < u->conds_len; i++) {
+    u->conds[i] += u->conds[i] > ln_end ? ln_delta : 0;
+  }
+
+  alloc_free(lexed.toks);
+  alloc_free(lexed.nodes);
+  alloc_free(region.toks);
+  alloc_free(region.nodes);
+  alloc_free(region.items);
+  return true;
+}
+
+bool reparse(struct unit *u, struct edit *edits, int edits_len) {
+  bool rebuild = false;
+  int i;
+
+  for (i = 0; i < edits_len; i++) {
+    if (!reparse_edit(u, edits + i, rebuild)) {
+      rebuild = true;
+    }
+  }
+  if (rebuild) {
+    reparse_full(u);
+  }
+  return !rebuild;
+}
+
+void reparse_flush(struct unit *u) {
+  file *f = u->file;
+
+  gap_move(u, u->toks_len);
+  u->gap.at = u->gap.len = 0;
+  u->gap.shift = u->gap.shifts_len = 0;
+  if (u->toks_len) {
+    /* Eof sits past the last character */
+    u->toks[u->toks_len - 1].line = f->lines_len;
+    u->toks[u->toks_len - 1].column = f->lines[f->lines_len - 1].len + 1;
+  }
+}
+
+void reparse_full(struct unit *u) {
+  file *f = u->file;
+  struct unit fresh;
+  char *src, *pos;
+  int len = 0;
+  int i;
+
+  for (i = 0; i < f->lines_len; i++) {
+    len += f->lines[i].len + 1;
+  }
+  src = pos = calloc(len + 1, 1);
+  for (i = 0; i < f->lines_len; i++) {
+    memcpy(pos, f->lines[i].src, f->lines[i].len);
+    pos += f->lines[i].len;
+    if (i < f->lines_len - 1) {
+      *pos++ = '\n';
+    }
+    alloc_free(f->lines[i].src);
+  }
+  alloc_free(f->lines);
+  alloc_free(f);
+  alloc_free(u->gap.shifts);
+
+  fresh = new_unit();
+  fresh.file = src_to_file(src);
+  free(src);
+
+  lex(&fresh);
+  if (!fresh.err) {
+    cpp(&fresh);
+  }
+  if (!fresh.err) {
+    parse(&fresh);
+  }
+  *u = fresh;
+}
@@ -0,0 +1,43 @@
+#ifndef CHOCC_REPARSE_H
+#define CHOCC_REPARSE_H
+#pragma once
+
+#include "chocc.h"
+#include "unit.h"
+
+/*
+ * edit replaces bytes [begin, end) of the source with text. Offsets are into
+ * the source as it is after the previous edits.
+ */
+struct edit {
+  int begin;
+  int end;
+  const char *text;
+};
+
+/*
+ * Applies edits to the source of a lexed, preprocessed and parsed unit and
+ * brings its nodes up to date. Only the edited lines are relexed and only
+ * the top-level declarations overlapping them are reparsed; other nodes are
+ * kept as they are. The tokens after the last edit are left behind the gap
+ * in u->gap, so reparse_flush must run before they are read, as by
+ * fn_defn_body.
+ *
+ * Edits touching preprocessor lines, #if groups, macro uses, splices,
+ * multi-line comments or typedefs rebuild the unit from scratch instead.
+ * Returns true if every edit was applied incrementally.
+ */
+bool reparse(struct unit *u, struct edit *edits, int edits_len);
+
+/*
+ * Closes the gap reparse leaves in the tokens of u and gives them their
+ * current lines. Takes time in the number of tokens after the gap.
+ */
+void reparse_flush(struct unit *u);
+
+/*
+ * Lexes, preprocesses and parses the current source of u again.
+ */
+void reparse_full(struct unit *u);
+
+#endif
@@ -0,0 +1,318 @@
+#include "resolve.h"
+#include "alloc.h"
+#include "lex.h"
+#include "scope.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const char *sym_kind_map[] = {"Global", "Fn",     "Typedef", "Param",
+                              "Local",  "Static", "Enum"};
+
+/*
+ * resolver holds the names in scope, whose values are symbol indices, and
+ * the frame slots in use.
+ */
+struct resolver {
+  struct unit *unit;
+  struct scope scope;
+
+  ast_fn_defn *fn; /* body being resolved, NULL at file scope */
+  int slots;
+};
+
+void resolve_node(struct resolver *, ast_node_t *);
+void resolve_type(struct resolver *, type *);
+
+/* Returns true if the Ident name already declared a symbol in this pass */
+bool declared(struct resolver *r, ast_node_t *name) {
+  int sym = name->u.ident.sym;
+  return sym && sym <= r->unit->syms_len &&
+         r->unit->syms[sym - 1].name == name;
+}
+
+/* Adds a symbol declared by the Ident name and brings it into scope */
+struct symbol *declare(struct resolver *r, ast_node_t *name, sym_kind kind) {
+  struct unit *u = r->unit;
+  struct symbol *sym;
+
+  if (u->syms_len == u->syms_cap) {
+    u->syms_cap = u->syms_cap ? u->syms_cap * 2 : 64;
+    u->syms =
+        alloc_realloc(SemaAlloc, u->syms, u->syms_cap * sizeof(*u->syms));
+  }
+  sym = u->syms + u->syms_len++;
+  memset(sym, 0, sizeof(*sym));
+  sym->kind = kind;
+  sym->name = name;
+  sym->slot = -1;
+  name->u.ident.sym = u->syms_len;
+
+  if (kind == ParamSym || kind == LocalSym) {
+    sym->slot = r->slots++;
+    if (r->slots > r->fn->frame_size) {
+      r->fn->frame_size = r->slots;
+    }
+  }
+
+  scope_push(&r->scope, name->u.ident.name, OrdNs)->value = u->syms_len - 1;
+  return sym;
+}
+
+/* Declares the name of d, if any, by its storage and scope */
+void declare_decl(struct resolver *r, ast_decl *d, sym_kind kind) {
+  if (!d->name) {
+    return;
+  }
+  if (!d->type) {
+    /* no specifiers */
+  } else if (d->type->store_class == Typedef) {
+    kind = TypedefSym;
+  } else if (d->type->kind == FnT) {
+    kind = FnSym;
+  } else if (kind == LocalSym && (d->type->store_class == Static ||
+                                  d->type->store_class == Extern)) {
+    kind = StaticSym;
+  }
+  declare(r, d->name, kind)->decl = d;
+}
+
+/* Declares the constants of an enum type in order */
+void declare_enum(struct resolver *r, type *t) {
+  long value = -1;
+  bool known = true;
+  int i;
+
+  if (declared(r, ast_list_at(t->enum_idents, 0))) {
+    /* the type is shared with a typedef */
+    return;
+  }
+  for (i = 0; i < t->enum_idents->u.list.len; i++) {
+    ast_node_t *ex = ast_list_at(t->enum_exprs, i);
+    struct symbol *sym;
+
+    if (ex) {
+      resolve_node(r, ex);
+      known = ex->kind == Lit && ex->u.lit.kind == DecLit;
+      value = known ? ex->u.lit.integer : 0;
+    } else {
+      value++;
+    }
+    sym = declare(r, ast_list_at(t->enum_idents, i), EnumSym);
+    sym->value = value;
+    sym->value_known = known;
+  }
+}
+
+/* Resolves the names in array sizes of t and declares its enum constants */
+void resolve_type(struct resolver *r, type *t) {
+  int i;
+
+  for (; t; t = t->inner) {
+    switch (t->kind) {
+    case ArrT: {
+      if (t->arr_expr) {
+        resolve_node(r, t->arr_expr);
+      }
+      break;
+    }
+    case FnT: {
+      /* names of a prototype go out of scope with it */
+      for (i = 0; i < t->fn_param_decls_len; i++) {
+        resolve_type(r, t->fn_param_decls[i].u.decl.type);
+      }
+      break;
+    }
+    case StructT:
+    case UnionT: {
+      ast_node_t *fields = t->struct_fields;
+      for (i = 0; fields && i < fields->u.list.len; i++) {
+        resolve_type(r, ast_list_at(fields, i)->u.decl.type);
+      }
+      break;
+    }
+    case EnumT: {
+      if (t->enum_idents && t->enum_idents->u.list.len) {
+        declare_enum(r, t);
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+void resolve_ident(struct resolver *r, ast_node_t *ident) {
+  struct scope_entry *e = scope_lookup(&r->scope, ident->u.ident.name, OrdNs);
+  if (e) {
+    ident->u.ident.sym = e->value + 1;
+    r->unit->syms[e->value].uses++;
+  } else {
+    ident->u.ident.sym = 0;
+  }
+}
+
+/* Resolves the names of expression node, operands by a walk */
+void resolve_expr(struct resolver *r, ast_node_t *node) {
+  struct expr_walk w;
+  ast_node_t *n;
+
+  expr_walk_init(&w, node, NULL);
+  while ((n = expr_walk_next(&w))) {
+    if (n->kind != Expr) {
+      resolve_node(r, n);
+    }
+  }
+}
+
+void resolve_stmt(struct resolver *r, ast_stmt *s) {
+  int len = r->scope.len;
+  int slots = r->slots;
+  int i;
+
+  if (s->kind == BlockStmt) {
+    for (i = 0; i < s->inner->u.list.len; i++) {
+      resolve_node(r, ast_list_at(s->inner, i));
+    }
+    scope_pop(&r->scope, len);
+    r->slots = slots;
+    return;
+  }
+
+  if (s->case_expr) {
+    resolve_node(r, s->case_expr);
+  }
+  if (s->init) {
+    resolve_node(r, s->init);
+  }
+  if (s->cond) {
+    resolve_node(r, s->cond);
+  }
+  if (s->iter) {
+    resolve_node(r, s->iter);
+  }
+  if (s->inner && !(s->jump && s->jump->u.tok.kind == Goto)) { /* label */
+    resolve_node(r, s->inner);
+  }
+  if (s->inner_else) {
+    resolve_node(r, s->inner_else);
+  }
+}
+
+void resolve_fn_defn(struct resolver *r, ast_fn_defn *fn) {
+  type *t = fn->decl->type;
+  int len;
+  int i;
+
+  resolve_type(r, t);
+  declare_decl(r, fn->decl, FnSym);
+  if (fn->decl->name) {
+    ident_sym(r->unit, fn->decl->name)->defn = fn;
+  }
+  if (!fn->body) {
+    return;
+  }
+
+  len = r->scope.len;
+  r->fn = fn;
+  r->slots = 0;
+  fn->frame_size = 0;
+  for (; t && t->kind != FnT; t = t->inner) {
+  }
+  for (i = 0; t && i < t->fn_param_decls_len; i++) {
+    ast_decl *param = &t->fn_param_decls[i].u.decl;
+    if (param->name) {
+      declare(r, param->name, ParamSym)->decl = param;
+    }
+  }
+  resolve_node(r, fn->body);
+  scope_pop(&r->scope, len);
+  r->fn = NULL;
+}
+
+void resolve_node(struct resolver *r, ast_node_t *node) {
+  int i;
+
+  switch (node->kind) {
+  case Ident:
+    resolve_ident(r, node);
+    break;
+  case Decl:
+    resolve_type(r, node->u.decl.type);
+    declare_decl(r, &node->u.decl, r->fn ? LocalSym : GlobalSym);
+    if (node->u.decl.init) {
+      resolve_node(r, node->u.decl.init);
+    }
+    break;
+  case FnDefn:
+    resolve_fn_defn(r, &node->u.fn_defn);
+    break;
+  case Stmt:
+    resolve_stmt(r, &node->u.stmt);
+    break;
+  case Expr:
+    resolve_expr(r, node);
+    break;
+  case List:
+    for (i = 0; i < node->u.list.len; i++) {
+      resolve_node(r, node->u.list.nodes[i]);
+    }
+    break;
+  case TypeName:
+    resolve_type(r, &node->u.type_name);
+    break;
+  default:
+    break;
+  }
+}
+
+void resolve(struct unit *u) {
+  struct resolver r;
+  int i;
+
+  memset(&r, 0, sizeof(r));
+  scope_init(&r.scope);
+  r.unit = u;
+  u->syms_len = 0;
+
+  for (i = 0; i < u->nodes_len; i++) {
+    resolve_node(&r, u->nodes + i);
+  }
+  scope_free(&r.scope);
+}
+
+struct symbol *ident_sym(struct unit *u, ast_node_t *ident) {
+  int sym = ident->u.ident.sym;
+  return sym && sym <= u->syms_len ? u->syms + sym - 1 : NULL;
+}
+
+void write_syms(writer *w, struct unit *u) {
+  int i;
+
+  for (i = 0; i < u->syms_len; i++) {
+    struct symbol *sym = u->syms + i;
+
+    write_str(w, sym_kind_map[sym->kind]);
+    write_char(w, ' ');
+    write_str(w, sym->name->u.ident.name);
+    if (sym->decl) {
+      write_str(w, ": ");
+      write_type(w, sym->decl->type);
+    } else if (sym->value_known) {
+      write_str(w, " = ");
+      write_long(w, sym->value);
+    }
+    if (sym->slot >= 0) {
+      write_str(w, ", slot ");
+      write_long(w, sym->slot);
+    }
+    if (sym->defn) {
+      write_str(w, ", frame ");
+      write_long(w, sym->defn->frame_size);
+    }
+    write_str(w, ", uses ");
+    write_long(w, sym->uses);
+    write_char(w, '\n');
+  }
+}
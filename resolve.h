@@ -0,0 +1,57 @@
+#ifndef CHOCC_RESOLVE_H
+#define CHOCC_RESOLVE_H
+#pragma once
+
+#include "chocc.h"
+#include "io.h"
+#include "parse.h"
+#include "unit.h"
+
+typedef enum sym_kind {
+  GlobalSym,  /* file scope object */
+  FnSym,      /* function, declared or defined */
+  TypedefSym, /* typedef name */
+  ParamSym,   /* parameter of a function definition */
+  LocalSym,   /* automatic or register local */
+  StaticSym,  /* static or extern local */
+  EnumSym     /* enumeration constant */
+} sym_kind;
+
+extern const char *sym_kind_map[];
+
+/*
+ * symbol is a declared name. Every Ident naming it, including the one that
+ * declares it, holds its index in ast_ident.sym.
+ */
+struct symbol {
+  sym_kind kind;
+  struct ast_node_t *name; /* declaring Ident */
+  struct ast_decl *decl;   /* NULL for enum constants */
+  ast_fn_defn *defn;       /* functions with a body */
+
+  int slot; /* frame slot of params and locals, else -1 */
+  int uses;
+
+  /* enum constants */
+  long value;
+  bool value_known; /* false if its expression did not fold */
+};
+
+/*
+ * Binds the Ident uses of the parsed and folded unit u to their
+ * declarations, following block scopes, and numbers the params and locals of
+ * each function body with frame slots. Slots of a block are reused after it
+ * ends, and ast_fn_defn.frame_size is the most a body needs at once.
+ *
+ * Undeclared names, struct members and labels are left unresolved. Running
+ * resolve again, as after reparse, rebuilds every binding.
+ */
+void resolve(struct unit *u);
+
+/* Returns the symbol ident is bound to, or NULL */
+struct symbol *ident_sym(struct unit *u, struct ast_node_t *ident);
+
+/* Writes each symbol of u on a line, in declaration order */
+void write_syms(writer *, struct unit *u);
+
+#endif
@@ -0,0 +1,62 @@
+#include "scope.h"
+#include "alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+unsigned long name_hash(const char *name) {
+  unsigned long h = 5381;
+  for (; *name; name++) {
+    h = h * 33 + (unsigned char)*name;
+  }
+  return h;
+}
+
+int scope_hash(const char *name) { return name_hash(name) % SCOPE_BUCKETS; }
+
+void scope_init(struct scope *s) {
+  s->entries = NULL;
+  s->len = 0;
+  s->cap = 0;
+  memset(s->buckets, -1, sizeof(s->buckets));
+}
+
+void scope_free(struct scope *s) { alloc_free(s->entries); }
+
+struct scope_entry *scope_push(struct scope *s, const char *name,
+                               scope_ns ns) {
+  struct scope_entry *e;
+  int h = scope_hash(name);
+
+  if (s->len == s->cap) {
+    s->cap = s->cap ? s->cap * 2 : 64;
+    s->entries =
+        alloc_realloc(SemaAlloc, s->entries, s->cap * sizeof(*s->entries));
+  }
+  e = s->entries + s->len;
+  memset(e, 0, sizeof(*e));
+  e->name = name;
+  e->ns = ns;
+  e->next = s->buckets[h];
+  s->buckets[h] = s->len++;
+  return e;
+}
+
+void scope_pop(struct scope *s, int len) {
+  for (; s->len > len; s->len--) {
+    struct scope_entry *e = s->entries + s->len - 1;
+    s->buckets[scope_hash(e->name)] = e->next;
+  }
+}
+
+struct scope_entry *scope_lookup(struct scope *s, const char *name,
+                                 scope_ns ns) {
+  int i;
+  for (i = s->buckets[scope_hash(name)]; i >= 0; i = s->entries[i].next) {
+    struct scope_entry *e = s->entries + i;
+    if (e->ns == ns && !strcmp(e->name, name)) {
+      return e;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,53 @@
+#ifndef CHOCC_SCOPE_H
+#define CHOCC_SCOPE_H
+#pragma once
+
+#include "chocc.h"
+
+/* name spaces of C, 6.1.2.3 */
+typedef enum scope_ns { OrdNs, TagNs } scope_ns;
+
+/*
+ * scope_entry is a declared name and what a pass knows about it. kind, value
+ * and ptr are the pass's own.
+ */
+struct scope_entry {
+  const char *name;
+  scope_ns ns;
+  int kind;
+  long value;
+  void *ptr;
+  int next; /* previous entry in the same bucket, or -1 */
+};
+
+#define SCOPE_BUCKETS 1024
+
+/*
+ * scope holds the names declared in the enclosing blocks as a stack chained
+ * into hash buckets. Entering a block is remembering scope.len, leaving it is
+ * scope_pop to that length.
+ */
+struct scope {
+  struct scope_entry *entries;
+  int len;
+  int cap;
+  int buckets[SCOPE_BUCKETS];
+};
+
+/* djb2 hash of an identifier */
+unsigned long name_hash(const char *name);
+
+void scope_init(struct scope *);
+void scope_free(struct scope *);
+
+/* Declares name in the innermost block, returning its entry */
+struct scope_entry *scope_push(struct scope *, const char *name, scope_ns ns);
+
+/* Leaves the blocks entered after the scope had len entries */
+void scope_pop(struct scope *, int len);
+
+/* Returns the innermost entry named name in ns, or NULL */
+struct scope_entry *scope_lookup(struct scope *, const char *name,
+                                 scope_ns ns);
+
+#endif
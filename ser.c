@@ -0,0 +1,944 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "ser.h"
+#include "unit.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* the format relies on 32-bit ints */
+typedef char ser_int_check[sizeof(int) == 4 ? 1 : -1];
+
+#define SER_ALIGN(n) (((n) + 7) & ~7L)
+
+/* masks of node kinds, for validation */
+#define SER_KIND(k) (1U << (k))
+#define SER_ANY (~0U)
+
+/*
+ * Writing
+ */
+
+/* ser_map maps pointers to 1-based indices, to preserve sharing */
+struct ser_map {
+  const void **keys;
+  int *vals;
+  int len;
+  int cap;
+};
+
+unsigned long ser_hash_ptr(const void *p) {
+  unsigned long h = (unsigned long)p;
+  h ^= h >> 17;
+  h *= 0x9E3779B1UL;
+  return h ^ (h >> 13);
+}
+
+int ser_map_get(struct ser_map *m, const void *key) {
+  unsigned long i;
+  if (!m->cap) {
+    return 0;
+  }
+  for (i = ser_hash_ptr(key) & (m->cap - 1); m->keys[i];
+       i = (i + 1) & (m->cap - 1)) {
+    if (m->keys[i] == key) {
+      return m->vals[i];
+    }
+  }
+  return 0;
+}
+
+void ser_map_put(struct ser_map *m, const void *key, int val) {
+  unsigned long i;
+
+  if (2 * (m->len + 1) > m->cap) {
+    struct ser_map old = *m;
+    int j;
+
+    m->cap = m->cap ? m->cap * 2 : 1024;
+    m->keys = calloc(m->cap, sizeof(*m->keys));
+    m->vals = calloc(m->cap, sizeof(*m->vals));
+    m->len = 0;
+    for (j = 0; j < old.cap; j++) {
+      if (old.keys[j]) {
+        ser_map_put(m, old.keys[j], old.vals[j]);
+      }
+    }
+    free(old.keys);
+    free(old.vals);
+  }
+
+  for (i = ser_hash_ptr(key) & (m->cap - 1); m->keys[i];
+       i = (i + 1) & (m->cap - 1)) {
+  }
+  m->keys[i] = key;
+  m->vals[i] = val;
+  m->len++;
+}
+
+struct ser_out {
+  ser_node *nodes;
+  int nodes_len;
+  int nodes_cap;
+
+  ser_type *types;
+  int types_len;
+  int types_cap;
+
+  int *edges;
+  int edges_len;
+  int edges_cap;
+
+  char *strs;
+  int strs_len;
+  int strs_cap;
+
+  /* interned string offsets, open addressing, -1 if empty */
+  int *str_ids;
+  int str_ids_len;
+  int str_ids_cap;
+
+  struct ser_map node_ids;
+  struct ser_map type_ids;
+};
+
+unsigned long ser_hash_str(const char *s) {
+  unsigned long h = 5381;
+  for (; *s; s++) {
+    h = h * 33 + (unsigned char)*s;
+  }
+  return h;
+}
+
+void ser_str_ids_grow(struct ser_out *out) {
+  int *old = out->str_ids;
+  int old_cap = out->str_ids_cap;
+  int i;
+
+  out->str_ids_cap = old_cap ? old_cap * 2 : 1024;
+  out->str_ids = malloc(sizeof(int) * out->str_ids_cap);
+  for (i = 0; i < out->str_ids_cap; i++) {
+    out->str_ids[i] = -1;
+  }
+  for (i = 0; i < old_cap; i++) {
+    if (old[i] >= 0) {
+      unsigned long j = ser_hash_str(out->strs + old[i]);
+      for (j &= out->str_ids_cap - 1; out->str_ids[j] >= 0;
+           j = (j + 1) & (out->str_ids_cap - 1)) {
+      }
+      out->str_ids[j] = old[i];
+    }
+  }
+  free(old);
+}
+
+/* Interns s, returning its offset into strs */
+int ser_str(struct ser_out *out, const char *s) {
+  unsigned long i;
+  int len;
+
+  if (!s) {
+    return -1;
+  }
+
+  if (2 * (out->str_ids_len + 1) > out->str_ids_cap) {
+    ser_str_ids_grow(out);
+  }
+  for (i = ser_hash_str(s) & (out->str_ids_cap - 1); out->str_ids[i] >= 0;
+       i = (i + 1) & (out->str_ids_cap - 1)) {
+    if (!strcmp(out->strs + out->str_ids[i], s)) {
+      return out->str_ids[i];
+    }
+  }
+
+  len = strlen(s) + 1;
+  for (; out->strs_len + len > out->strs_cap;) {
+    out->strs_cap = out->strs_cap ? out->strs_cap * 2 : 4096;
+    out->strs = realloc(out->strs, out->strs_cap);
+  }
+  memcpy(out->strs + out->strs_len, s, len);
+  out->str_ids[i] = out->strs_len;
+  out->str_ids_len++;
+  out->strs_len += len;
+
+  return out->str_ids[i];
+}
+
+/* Appends a run of node references to edges, returning its offset */
+int ser_edges(struct ser_out *out, int *kids, int len) {
+  int off = out->edges_len;
+  if (!len) {
+    return off;
+  }
+  for (; out->edges_len + len > out->edges_cap;) {
+    out->edges_cap = out->edges_cap ? out->edges_cap * 2 : 1024;
+    out->edges = realloc(out->edges, sizeof(int) * out->edges_cap);
+  }
+  memcpy(out->edges + off, kids, sizeof(int) * len);
+  out->edges_len += len;
+  return off;
+}
+
+int ser_out_node(struct ser_out *out, ast_node_t *n);
+
+int ser_out_type(struct ser_out *out, type *t) {
+  ser_type r = {0};
+  int idx;
+
+  if (!t) {
+    return 0;
+  }
+  if ((idx = ser_map_get(&out->type_ids, t))) {
+    return idx;
+  }
+
+  if (out->types_len == out->types_cap) {
+    out->types_cap = out->types_cap ? out->types_cap * 2 : 256;
+    out->types = realloc(out->types, sizeof(ser_type) * out->types_cap);
+  }
+  idx = ++out->types_len;
+  ser_map_put(&out->type_ids, t, idx);
+
+  r.kind = t->kind;
+  r.store_class = t->store_class;
+  r.base = t->numeric.base;
+  r.flags = (t->numeric.is_signed ? SER_SIGNED : 0) |
+            (t->numeric.is_unsigned ? SER_UNSIGNED : 0) |
+            (t->numeric.is_short ? SER_SHORT : 0) |
+            (t->numeric.is_long ? SER_LONG : 0) |
+            (t->is_const ? SER_CONST : 0) |
+            (t->is_volatile ? SER_VOLATILE : 0);
+  r.inner = ser_out_type(out, t->inner);
+  r.arr_size = t->arr_size;
+  r.name = ser_out_node(out, t->name);
+  r.fields = ser_out_node(out, t->struct_fields);
+  r.enum_idents = ser_out_node(out, t->enum_idents);
+  r.enum_exprs = ser_out_node(out, t->enum_exprs);
+  if (t->fn_param_decls_len) {
+    int *params = malloc(sizeof(int) * t->fn_param_decls_len);
+    int i;
+    for (i = 0; i < t->fn_param_decls_len; i++) {
+      params[i] = ser_out_node(out, t->fn_param_decls + i);
+    }
+    r.params = ser_edges(out, params, t->fn_param_decls_len);
+    r.params_len = t->fn_param_decls_len;
+    free(params);
+  }
+
+  out->types[idx - 1] = r;
+  return idx;
+}
+
+int ser_out_node(struct ser_out *out, ast_node_t *n) {
+  ser_node r = {0};
+  int fixed[8];
+  int *kids = fixed;
+  int idx;
+
+  if (!n) {
+    return 0;
+  }
+  if ((idx = ser_map_get(&out->node_ids, n))) {
+    return idx;
+  }
+
+  if (out->nodes_len == out->nodes_cap) {
+    out->nodes_cap = out->nodes_cap ? out->nodes_cap * 2 : 1024;
+    out->nodes = realloc(out->nodes, sizeof(ser_node) * out->nodes_cap);
+  }
+  idx = ++out->nodes_len;
+  ser_map_put(&out->node_ids, n, idx);
+
+  r.kind = n->kind;
+  r.str = -1;
+
+  switch (n->kind) {
+  case Ident: {
+    r.str = ser_str(out, n->u.ident.name);
+    break;
+  }
+  case Lit: {
+    unsigned long v = n->u.lit.integer;
+    r.sub = n->u.lit.kind;
+    r.op = (n->u.lit.is_unsigned ? SER_UNSIGNED : 0) |
+           (n->u.lit.is_long ? SER_LONG : 0);
+    r.value[0] = (int)(v & 0xffffffffUL);
+    r.value[1] = (int)((v >> 16 >> 16) & 0xffffffffUL);
+    if (n->u.lit.kind == StrLit) {
+      r.str = ser_str(out, n->u.lit.string);
+    } else if (n->u.lit.kind == CharLit) {
+      r.str = ser_str(out, n->u.lit.character);
+    }
+    break;
+  }
+  case FnDefn: {
+    r.type = ser_out_type(out, n->u.fn_defn.decl->type);
+    kids[0] = ser_out_node(out, n->u.fn_defn.decl->name);
+    kids[1] = ser_out_node(out, fn_defn_body(n));
+    r.kids_len = 2;
+    break;
+  }
+  case Decl: {
+    r.type = ser_out_type(out, n->u.decl.type);
+    kids[0] = ser_out_node(out, n->u.decl.name);
+    kids[1] = ser_out_node(out, n->u.decl.init);
+    r.kids_len = 2;
+    break;
+  }
+  case Stmt: {
+    ast_stmt *s = &n->u.stmt;
+    r.sub = s->kind;
+    kids[0] = ser_out_node(out, s->label);
+    kids[1] = ser_out_node(out, s->case_expr);
+    kids[2] = ser_out_node(out, s->init);
+    kids[3] = ser_out_node(out, s->cond);
+    kids[4] = ser_out_node(out, s->iter);
+    kids[5] = ser_out_node(out, s->inner);
+    kids[6] = ser_out_node(out, s->inner_else);
+    kids[7] = ser_out_node(out, s->jump);
+    r.kids_len = 8;
+    break;
+  }
+  case Tok: {
+    r.sub = n->u.tok.kind;
+    r.str = ser_str(out, n->u.tok.text);
+    r.value[0] = n->u.tok.line;
+    r.value[1] = n->u.tok.column;
+    break;
+  }
+  case Expr: {
+    ast_expr *e = &n->u.expr;
+    r.sub = e->kind;
+    r.op = e->op;
+    if (e->kind == CommaExpr) {
+      int i;
+      kids = malloc(sizeof(int) * (e->mhs_len + 1));
+      for (i = 0; i < e->mhs_len; i++) {
+        kids[i] = ser_out_node(out, e->mhs + i);
+      }
+      r.kids_len = e->mhs_len;
+    } else {
+      kids[0] = ser_out_node(out, e->lhs);
+      kids[1] = ser_out_node(out, e->mhs);
+      kids[2] = ser_out_node(out, e->rhs);
+      r.kids_len = 3;
+    }
+    break;
+  }
+  case List: {
+    int i;
+    kids = malloc(sizeof(int) * (n->u.list.len + 1));
+    for (i = 0; i < n->u.list.len; i++) {
+      kids[i] = ser_out_node(out, n->u.list.nodes[i]);
+    }
+    r.kids_len = n->u.list.len;
+    break;
+  }
+  case TypeName: {
+    r.type = ser_out_type(out, &n->u.type_name);
+    break;
+  }
+  default:
+    break;
+  }
+
+  r.kids = ser_edges(out, kids, r.kids_len);
+  if (kids != fixed) {
+    free(kids);
+  }
+
+  out->nodes[idx - 1] = r;
+  return idx;
+}
+
+/* Frees the tables of out */
+void ser_out_free(struct ser_out *out) {
+  free(out->nodes);
+  free(out->types);
+  free(out->edges);
+  free(out->strs);
+  free(out->str_ids);
+  free(out->node_ids.keys);
+  free(out->node_ids.vals);
+  free(out->type_ids.keys);
+  free(out->type_ids.vals);
+}
+
+/* Writes len bytes of src followed by padding to 8 bytes */
+void ser_fwrite(FILE *f, const void *src, long len) {
+  static const char zeros[8] = {0};
+  if (len) {
+    fwrite(src, 1, len, f);
+  }
+  fwrite(zeros, 1, SER_ALIGN(len) - len, f);
+}
+
+int ser_write(struct unit *u, const char *path) {
+  struct ser_out out = {0};
+  struct ser_header hdr;
+  int *roots = malloc(sizeof(int) * (u->nodes_len + 1));
+  long off;
+  FILE *f;
+  int i;
+
+  for (i = 0; i < u->nodes_len; i++) {
+    roots[i] = ser_out_node(&out, u->nodes + i);
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, SER_MAGIC, sizeof(hdr.magic));
+  hdr.version = SER_VERSION;
+  hdr.endian = 0x01020304;
+
+  off = SER_ALIGN(sizeof(hdr));
+  hdr.roots = off;
+  hdr.roots_len = u->nodes_len;
+  off += SER_ALIGN(sizeof(int) * hdr.roots_len);
+  hdr.nodes = off;
+  hdr.nodes_len = out.nodes_len;
+  off += SER_ALIGN(sizeof(ser_node) * hdr.nodes_len);
+  hdr.types = off;
+  hdr.types_len = out.types_len;
+  off += SER_ALIGN(sizeof(ser_type) * hdr.types_len);
+  hdr.edges = off;
+  hdr.edges_len = out.edges_len;
+  off += SER_ALIGN(sizeof(int) * hdr.edges_len);
+  hdr.strs = off;
+  hdr.strs_len = out.strs_len;
+
+  f = fopen(path, "wb");
+  if (!f) {
+    return 1;
+  }
+  ser_fwrite(f, &hdr, sizeof(hdr));
+  ser_fwrite(f, roots, sizeof(int) * hdr.roots_len);
+  ser_fwrite(f, out.nodes, sizeof(ser_node) * hdr.nodes_len);
+  ser_fwrite(f, out.types, sizeof(ser_type) * hdr.types_len);
+  ser_fwrite(f, out.edges, sizeof(int) * hdr.edges_len);
+  ser_fwrite(f, out.strs, hdr.strs_len);
+
+  free(roots);
+  ser_out_free(&out);
+
+  return fclose(f) != 0;
+}
+
+void ser_count(struct unit *u, long *nodes, long *types) {
+  struct ser_out out = {0};
+  int i;
+
+  for (i = 0; i < u->nodes_len; i++) {
+    ser_out_node(&out, u->nodes + i);
+  }
+  *nodes = out.nodes_len;
+  *types = out.types_len;
+  ser_out_free(&out);
+}
+
+/*
+ * Reading
+ */
+
+/* Checks that a section lies within the file */
+bool ser_section_ok(ser_file *sf, int off, int len, int size) {
+  return off >= 0 && len >= 0 && off % 8 == 0 &&
+         (long)off + (long)len * size <= sf->size;
+}
+
+/* Checks a run of node references */
+bool ser_refs_ok(ser_file *sf, int off, int len) {
+  int i;
+  if (off < 0 || len < 0 || (long)off + len > sf->hdr->edges_len) {
+    return false;
+  }
+  for (i = 0; i < len; i++) {
+    if (sf->edges[off + i] < 0 || sf->edges[off + i] > sf->hdr->nodes_len) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Checks that ref is a node of a kind in mask, or NULL if not required */
+bool ser_kind_ok(ser_file *sf, int ref, unsigned mask, bool required) {
+  unsigned kind;
+  if (!ref) {
+    return !required;
+  }
+  kind = sf->nodes[ref - 1].kind;
+  return kind <= TypeName && (mask >> kind & 1);
+}
+
+/* Checks that every item of the List ref is a node of a kind in mask */
+bool ser_items_ok(ser_file *sf, int ref, unsigned mask) {
+  ser_node *r;
+  int i;
+  if (!ref) {
+    return true;
+  }
+  r = sf->nodes + ref - 1;
+  for (i = 0; i < r->kids_len; i++) {
+    if (!ser_kind_ok(sf, sf->edges[r->kids + i], mask, true)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Checks the enum fields of r and the kinds of the children writers rely on */
+bool ser_node_ok(ser_file *sf, ser_node *r) {
+  int *kids = sf->edges + r->kids;
+  int i;
+
+  if (r->type && r->kind != FnDefn && r->kind != Decl &&
+      r->kind != TypeName) {
+    return false;
+  }
+
+  switch (r->kind) {
+  case Ident:
+    return r->str >= 0 && !r->kids_len;
+  case Lit:
+    return r->sub >= OctLit && r->sub <= StrLit &&
+           !(r->op & ~(SER_UNSIGNED | SER_LONG)) && !r->kids_len &&
+           (r->str >= 0 || (r->sub != StrLit && r->sub != CharLit));
+  case Tok:
+    return r->sub >= 0 && r->sub <= Nil && r->str >= 0 && !r->kids_len;
+  case TypeName:
+    return r->type && !r->kids_len;
+  case FnDefn:
+  case Decl:
+    return r->type && r->kids_len == 2 &&
+           ser_kind_ok(sf, kids[0], SER_KIND(Ident), false) &&
+           (r->kind == Decl ||
+            ser_kind_ok(sf, kids[1], SER_KIND(Stmt), false));
+  case Stmt:
+    return r->sub >= LabelStmt && r->sub <= JumpStmt && r->kids_len == 8 &&
+           ser_kind_ok(sf, kids[0], SER_KIND(Ident) | SER_KIND(Tok),
+                       r->sub == LabelStmt) &&
+           ser_kind_ok(sf, kids[5], r->sub == BlockStmt ? SER_KIND(List)
+                                                        : SER_ANY,
+                       r->sub == BlockStmt) &&
+           ser_kind_ok(sf, kids[7], SER_KIND(Tok), r->sub == JumpStmt);
+  case Expr:
+    if (r->sub < InfixExpr || r->sub > CastExpr || r->op < 0 ||
+        r->op > Nil) {
+      return false;
+    }
+    if (r->sub == CommaExpr) {
+      for (i = 0; i < r->kids_len; i++) {
+        if (!kids[i]) {
+          return false;
+        }
+      }
+      return true;
+    }
+    return r->kids_len == 3 &&
+           ser_kind_ok(sf, kids[0],
+                       r->sub == CastExpr ? SER_KIND(TypeName) : SER_ANY,
+                       r->sub == CastExpr) &&
+           ser_kind_ok(sf, kids[2], SER_ANY,
+                       r->sub == PrefixExpr && r->op == Sizeof);
+  case List:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* Checks the enum fields of r and the nodes it names, fields and params */
+bool ser_type_ok(ser_file *sf, ser_type *r) {
+  int i;
+
+  if (r->kind < NumericT || r->kind > EnumT || r->store_class < 0 ||
+      r->store_class > Nil || r->base < 0 || r->base > Nil ||
+      r->flags & ~(SER_SIGNED | SER_UNSIGNED | SER_SHORT | SER_LONG |
+                   SER_CONST | SER_VOLATILE)) {
+    return false;
+  }
+  if (!r->inner && (r->kind == PtrT || r->kind == ArrT || r->kind == FnT)) {
+    return false;
+  }
+  if (!ser_kind_ok(sf, r->name, SER_KIND(Ident), false) ||
+      !ser_kind_ok(sf, r->fields, SER_KIND(List), false) ||
+      !ser_items_ok(sf, r->fields, SER_KIND(Decl)) ||
+      !ser_kind_ok(sf, r->enum_idents, SER_KIND(List), false) ||
+      !ser_items_ok(sf, r->enum_idents, SER_KIND(Ident)) ||
+      !ser_kind_ok(sf, r->enum_exprs, SER_KIND(List), r->enum_idents != 0)) {
+    return false;
+  }
+  /* a value, possibly NULL, for each constant */
+  if (r->enum_idents && sf->nodes[r->enum_exprs - 1].kids_len !=
+                            sf->nodes[r->enum_idents - 1].kids_len) {
+    return false;
+  }
+  for (i = 0; i < r->params_len; i++) {
+    if (!ser_kind_ok(sf, sf->edges[r->params + i], SER_KIND(Decl), true)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * References as a graph: node idx is vertex idx - 1 and type idx vertex
+ * nodes_len + idx - 1. Sharing makes it a DAG, views are materialized
+ * recursively, so it must not have cycles.
+ */
+
+/* Returns the number of references out of vertex v */
+int ser_succ_len(ser_file *sf, int v) {
+  if (v < sf->hdr->nodes_len) {
+    return 1 + sf->nodes[v].kids_len;
+  }
+  return 5 + sf->types[v - sf->hdr->nodes_len].params_len;
+}
+
+/* Returns the i-th reference out of vertex v as a vertex, -1 if NULL */
+int ser_succ(ser_file *sf, int v, int i) {
+  int nodes_len = sf->hdr->nodes_len;
+  ser_type *t;
+  int refs[5];
+
+  if (v < nodes_len) {
+    ser_node *r = sf->nodes + v;
+    if (!i) {
+      return r->type ? nodes_len + r->type - 1 : -1;
+    }
+    return sf->edges[r->kids + i - 1] - 1;
+  }
+
+  t = sf->types + v - nodes_len;
+  if (i >= 5) {
+    return sf->edges[t->params + i - 5] - 1;
+  }
+  refs[0] = t->inner ? nodes_len + t->inner : 0;
+  refs[1] = t->name;
+  refs[2] = t->fields;
+  refs[3] = t->enum_idents;
+  refs[4] = t->enum_exprs;
+  return refs[i] - 1;
+}
+
+/* Checks that no reference leads back to a node or type on its own path */
+bool ser_acyclic(ser_file *sf) {
+  struct ser_frame {
+    int v;
+    int i;
+  } *stack;
+  int n = sf->hdr->nodes_len + sf->hdr->types_len;
+  char *state = calloc(n + 1, 1); /* 0 unseen, 1 on the path, 2 done */
+  int len = 0;
+  bool ok = true;
+  int v;
+
+  /* each vertex is pushed once, when first seen */
+  stack = malloc(sizeof(*stack) * (n + 1));
+  for (v = 0; v < n && ok; v++) {
+    if (state[v]) {
+      continue;
+    }
+    state[v] = 1;
+    stack[len].v = v;
+    stack[len++].i = 0;
+    while (len && ok) {
+      struct ser_frame *f = stack + len - 1;
+      int u;
+      if (f->i == ser_succ_len(sf, f->v)) {
+        state[f->v] = 2;
+        len--;
+        continue;
+      }
+      u = ser_succ(sf, f->v, f->i++);
+      if (u < 0 || state[u] == 2) {
+        continue;
+      }
+      if (state[u] == 1) {
+        ok = false;
+        break;
+      }
+      state[u] = 1;
+      stack[len].v = u;
+      stack[len++].i = 0;
+    }
+  }
+
+  free(stack);
+  free(state);
+  return ok;
+}
+
+bool ser_validate(ser_file *sf) {
+  struct ser_header *h = sf->hdr;
+  int i;
+
+  if (sf->size < (long)sizeof(*h) || memcmp(h->magic, SER_MAGIC, 8) ||
+      h->version != SER_VERSION || h->endian != 0x01020304) {
+    return false;
+  }
+  if (!ser_section_ok(sf, h->roots, h->roots_len, sizeof(int)) ||
+      !ser_section_ok(sf, h->nodes, h->nodes_len, sizeof(ser_node)) ||
+      !ser_section_ok(sf, h->types, h->types_len, sizeof(ser_type)) ||
+      !ser_section_ok(sf, h->edges, h->edges_len, sizeof(int)) ||
+      !ser_section_ok(sf, h->strs, h->strs_len, 1)) {
+    return false;
+  }
+  if (h->strs_len && sf->base[h->strs + h->strs_len - 1]) {
+    return false;
+  }
+
+  for (i = 0; i < h->roots_len; i++) {
+    if (sf->roots[i] < 1 || sf->roots[i] > h->nodes_len) {
+      return false;
+    }
+  }
+  for (i = 0; i < h->nodes_len; i++) {
+    ser_node *r = sf->nodes + i;
+    if (r->type < 0 || r->type > h->types_len || r->str < -1 ||
+        r->str >= h->strs_len || !ser_refs_ok(sf, r->kids, r->kids_len)) {
+      return false;
+    }
+  }
+  for (i = 0; i < h->types_len; i++) {
+    ser_type *r = sf->types + i;
+    if (r->inner < 0 || r->inner > h->types_len ||
+        !ser_refs_ok(sf, r->params, r->params_len) || r->name < 0 ||
+        r->name > h->nodes_len || r->fields < 0 ||
+        r->fields > h->nodes_len || r->enum_idents < 0 ||
+        r->enum_idents > h->nodes_len || r->enum_exprs < 0 ||
+        r->enum_exprs > h->nodes_len) {
+      return false;
+    }
+  }
+
+  /* only now are references safe to follow */
+  for (i = 0; i < h->nodes_len; i++) {
+    if (!ser_node_ok(sf, sf->nodes + i)) {
+      return false;
+    }
+  }
+  for (i = 0; i < h->types_len; i++) {
+    if (!ser_type_ok(sf, sf->types + i)) {
+      return false;
+    }
+  }
+
+  return ser_acyclic(sf);
+}
+
+ser_file *ser_open(const char *path) {
+  ser_file *sf;
+  struct stat st;
+  void *base;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &st) || st.st_size < (long)sizeof(struct ser_header)) {
+    close(fd);
+    return NULL;
+  }
+
+  /* private and writable, so views can be patched without touching the file */
+  base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+
+  sf = calloc(1, sizeof(*sf));
+  sf->base = base;
+  sf->size = st.st_size;
+  sf->hdr = base;
+  sf->roots = (int *)(sf->base + sf->hdr->roots);
+  sf->nodes = (ser_node *)(sf->base + sf->hdr->nodes);
+  sf->types = (ser_type *)(sf->base + sf->hdr->types);
+  sf->edges = (int *)(sf->base + sf->hdr->edges);
+  sf->strs = sf->base + sf->hdr->strs;
+
+  if (!ser_validate(sf)) {
+    munmap(base, st.st_size);
+    free(sf);
+    return NULL;
+  }
+
+  sf->views = calloc(sf->hdr->nodes_len + 1, sizeof(*sf->views));
+  sf->type_views = calloc(sf->hdr->types_len + 1, sizeof(*sf->type_views));
+
+  return sf;
+}
+
+void ser_close(ser_file *sf) {
+  munmap(sf->base, sf->size);
+  free(sf->views);
+  free(sf->type_views);
+  free(sf);
+}
+
+char *ser_str_at(ser_file *sf, int off) {
+  return off < 0 ? NULL : sf->strs + off;
+}
+
+type *ser_type_view(ser_file *sf, int idx) {
+  ser_type *r;
+  type *t;
+
+  if (!idx) {
+    return NULL;
+  }
+  if (sf->type_views[idx - 1]) {
+    return sf->type_views[idx - 1];
+  }
+
+  r = sf->types + idx - 1;
+  t = calloc(1, sizeof(*t));
+  sf->type_views[idx - 1] = t;
+
+  t->kind = r->kind;
+  t->store_class = r->store_class;
+  t->numeric.base = r->base;
+  t->numeric.is_signed = (r->flags & SER_SIGNED) != 0;
+  t->numeric.is_unsigned = (r->flags & SER_UNSIGNED) != 0;
+  t->numeric.is_short = (r->flags & SER_SHORT) != 0;
+  t->numeric.is_long = (r->flags & SER_LONG) != 0;
+  t->is_const = (r->flags & SER_CONST) != 0;
+  t->is_volatile = (r->flags & SER_VOLATILE) != 0;
+  t->inner = ser_type_view(sf, r->inner);
+  t->arr_size = r->arr_size;
+  t->name = ser_view(sf, r->name);
+  t->struct_fields = ser_view(sf, r->fields);
+  t->enum_idents = ser_view(sf, r->enum_idents);
+  t->enum_exprs = ser_view(sf, r->enum_exprs);
+  if (r->params_len) {
+    int i;
+    t->fn_param_decls = calloc(r->params_len, sizeof(ast_node_t));
+    t->fn_param_decls_len = r->params_len;
+    t->fn_param_decls_cap = r->params_len;
+    for (i = 0; i < r->params_len; i++) {
+      t->fn_param_decls[i] = *ser_view(sf, sf->edges[r->params + i]);
+    }
+  }
+
+  return t;
+}
+
+ast_node_t *ser_view(ser_file *sf, int idx) {
+  ser_node *r;
+  ast_node_t *n;
+  int *kids;
+
+  if (!idx) {
+    return NULL;
+  }
+  if (sf->views[idx - 1]) {
+    return sf->views[idx - 1];
+  }
+
+  r = sf->nodes + idx - 1;
+  kids = sf->edges + r->kids;
+  n = calloc(1, sizeof(*n));
+  n->kind = r->kind;
+  sf->views[idx - 1] = n;
+
+  switch (n->kind) {
+  case Ident: {
+    n->u.ident.name = ser_str_at(sf, r->str);
+    break;
+  }
+  case Lit: {
+    unsigned long v = (unsigned long)(unsigned int)r->value[1] << 16 << 16 |
+                      (unsigned int)r->value[0];
+    n->u.lit.kind = r->sub;
+    n->u.lit.integer = v;
+    n->u.lit.is_unsigned = (r->op & SER_UNSIGNED) != 0;
+    n->u.lit.is_long = (r->op & SER_LONG) != 0;
+    if (r->sub == StrLit) {
+      n->u.lit.string = ser_str_at(sf, r->str);
+    } else if (r->sub == CharLit) {
+      n->u.lit.character = ser_str_at(sf, r->str);
+    }
+    break;
+  }
+  case FnDefn: {
+    n->u.fn_defn.decl = calloc(1, sizeof(ast_decl));
+    n->u.fn_defn.decl->type = ser_type_view(sf, r->type);
+    n->u.fn_defn.decl->name = ser_view(sf, kids[0]);
+    n->u.fn_defn.body = ser_view(sf, kids[1]);
+    break;
+  }
+  case Decl: {
+    n->u.decl.type = ser_type_view(sf, r->type);
+    n->u.decl.name = ser_view(sf, kids[0]);
+    n->u.decl.init = ser_view(sf, kids[1]);
+    break;
+  }
+  case Stmt: {
+    ast_stmt *s = &n->u.stmt;
+    s->kind = r->sub;
+    s->label = ser_view(sf, kids[0]);
+    s->case_expr = ser_view(sf, kids[1]);
+    s->init = ser_view(sf, kids[2]);
+    s->cond = ser_view(sf, kids[3]);
+    s->iter = ser_view(sf, kids[4]);
+    s->inner = ser_view(sf, kids[5]);
+    s->inner_else = ser_view(sf, kids[6]);
+    s->jump = ser_view(sf, kids[7]);
+    break;
+  }
+  case Tok: {
+    n->u.tok.kind = r->sub;
+    n->u.tok.text = ser_str_at(sf, r->str);
+    n->u.tok.line = r->value[0];
+    n->u.tok.column = r->value[1];
+    break;
+  }
+  case Expr: {
+    ast_expr *e = &n->u.expr;
+    e->kind = r->sub;
+    e->op = r->op;
+    if (e->kind == CommaExpr) {
+      int i;
+      e->mhs = calloc(r->kids_len, sizeof(ast_node_t));
+      e->mhs_len = r->kids_len;
+      e->mhs_cap = r->kids_len;
+      for (i = 0; i < r->kids_len; i++) {
+        e->mhs[i] = *ser_view(sf, kids[i]);
+      }
+    } else {
+      e->lhs = ser_view(sf, kids[0]);
+      e->mhs = ser_view(sf, kids[1]);
+      e->rhs = ser_view(sf, kids[2]);
+    }
+    break;
+  }
+  case List: {
+    int i;
+    n->u.list.len = r->kids_len;
+    n->u.list.cap = r->kids_len ? r->kids_len : 1;
+    n->u.list.nodes = calloc(n->u.list.cap, sizeof(ast_node_t *));
+    for (i = 0; i < r->kids_len; i++) {
+      n->u.list.nodes[i] = ser_view(sf, kids[i]);
+    }
+    break;
+  }
+  case TypeName: {
+    n->u.type_name = *ser_type_view(sf, r->type);
+    break;
+  }
+  default:
+    break;
+  }
+
+  return n;
+}
+
+ast_node_t *ser_root(ser_file *sf, int idx) {
+  return ser_view(sf, sf->roots[idx]);
+}
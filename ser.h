@@ -0,0 +1,134 @@
+#ifndef CHOCC_SER_H
+#define CHOCC_SER_H
+#pragma once
+
+#include "parse.h"
+
+/*
+ * Binary AST format
+ *
+ * A serialized unit is a header followed by flat sections that refer to each
+ * other by index or offset only, so a file can be mmapped and traversed in
+ * place. All references to nodes and types are 1-based, 0 meaning NULL.
+ *
+ *    header | roots | nodes | types | edges | strs
+ *
+ * roots are the top-level nodes of the unit. Children of a node (and the
+ * parameters of a function type) are a run of node references in edges,
+ * in the order documented at ser_node. strs holds interned NUL-terminated
+ * strings.
+ */
+
+#define SER_MAGIC "CHOCCAST"
+#define SER_VERSION 1
+
+struct ser_header {
+  char magic[8];
+  int version;
+  int endian; /* 0x01020304 in host order of the writer */
+
+  /* byte offsets from start of file and lengths in elements */
+  int roots;
+  int roots_len;
+  int nodes;
+  int nodes_len;
+  int types;
+  int types_len;
+  int edges;
+  int edges_len;
+  int strs;
+  int strs_len;
+};
+
+/*
+ * ser_node is a serialized ast_node_t. Children by kind:
+ *    FnDefn: name, body
+ *    Decl: name, init
+ *    Stmt: label, case_expr, init, cond, iter, inner, inner_else, jump
+ *    Expr: lhs, mhs, rhs, or the items of a CommaExpr
+ *    List: items
+ */
+typedef struct ser_node {
+  int kind; /* ast_node_kind_t */
+  int sub;  /* stmt, expr or lit kind, token kind for Tok */
+  int op;   /* expr op, lit flags */
+  int type; /* Decl, FnDefn, TypeName */
+  int str;  /* offset into strs of ident, literal or token text, -1 if none */
+  int kids;
+  int kids_len;
+  int pad;
+  int value[2]; /* lit integer, or Tok line and column */
+} ser_node;
+
+#define SER_SIGNED 1
+#define SER_UNSIGNED 2
+#define SER_SHORT 4
+#define SER_LONG 8
+#define SER_CONST 16
+#define SER_VOLATILE 32
+
+typedef struct ser_type {
+  int kind; /* type_kind */
+  int store_class;
+  int base;  /* numeric base */
+  int flags; /* SER_* */
+  int inner;
+  int arr_size;
+  int name;        /* Ident */
+  int fields;      /* List of Decl */
+  int enum_idents; /* List of Ident */
+  int enum_exprs;  /* List of Expr */
+  int params;      /* offset into edges of Decl nodes */
+  int params_len;
+} ser_type;
+
+/*
+ * Serializes the top-level nodes of u to path, parsing lazy bodies.
+ * Returns 0 on success.
+ */
+int ser_write(struct unit *u, const char *path);
+
+/*
+ * Counts the distinct nodes and types ser_write would write for u, parsing
+ * lazy bodies.
+ */
+void ser_count(struct unit *u, long *nodes, long *types);
+
+/*
+ * ser_file is an mmapped serialized unit.
+ */
+typedef struct ser_file {
+  char *base;
+  long size;
+
+  struct ser_header *hdr;
+  int *roots;
+  ser_node *nodes;
+  ser_type *types;
+  int *edges;
+  char *strs;
+
+  /* materialized views, by index */
+  ast_node_t **views;
+  type **type_views;
+} ser_file;
+
+/*
+ * Maps and validates a serialized unit: its enum fields, the kinds of the
+ * nodes it refers to and that references have no cycles. Returns NULL on
+ * failure.
+ */
+ser_file *ser_open(const char *path);
+void ser_close(ser_file *);
+
+/*
+ * Returns an ast_node_t view of node idx and its subtree, materialized on
+ * first access. Strings point into the mapping.
+ */
+ast_node_t *ser_view(ser_file *, int idx);
+type *ser_type_view(ser_file *, int idx);
+
+/* Returns the view of the idx-th top-level node. */
+ast_node_t *ser_root(ser_file *, int idx);
+
+#endif
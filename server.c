@@ -0,0 +1,506 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "server.h"
+#include "alloc.h"
+#include "check.h"
+#include "driver.h"
+#include "error.h"
+#include "fold.h"
+#include "io.h"
+#include "lex.h"
+#include "parse.h"
+#include "resolve.h"
+#include "unit.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* JSON-RPC error codes */
+#define RPC_PARSE_ERROR -32700
+#define RPC_NO_METHOD -32601
+#define RPC_BAD_PARAMS -32602
+#define RPC_FILE_ERROR -32000
+#define RPC_COMPILE_ERROR -32001
+
+/*
+ * cache_entry is a compiled file. Units are never freed, as a request may
+ * still be writing one that was replaced.
+ */
+struct cache_entry {
+  char *path;
+  struct timespec mtime;
+  off_t size;
+  unsigned long hash;
+  struct unit *unit;
+  char *fatal; /* message of a fatal error past lexing, or NULL */
+};
+
+struct server {
+  char *path;
+
+  /* compiled units by path, shared by all connections */
+  struct cache_entry *cache;
+  int cache_len;
+  int cache_cap;
+  pthread_mutex_t lock;
+};
+
+/* FNV-1a */
+unsigned long hash_src(const char *src) {
+  unsigned long h = 2166136261UL;
+  for (; *src; src++) {
+    h = (h ^ (unsigned char)*src) * 16777619UL;
+  }
+  return h;
+}
+
+/* Returns the entry of path, or NULL. Called with s->lock held. */
+struct cache_entry *cache_find(struct server *s, const char *path) {
+  int i;
+  for (i = 0; i < s->cache_len; i++) {
+    if (!strcmp(s->cache[i].path, path)) {
+      return s->cache + i;
+    }
+  }
+  return NULL;
+}
+
+/* Returns a new empty entry for path. Called with s->lock held. */
+struct cache_entry *cache_add(struct server *s, const char *path) {
+  struct cache_entry *e;
+
+  if (s->cache_len == s->cache_cap) {
+    s->cache_cap = s->cache_cap ? s->cache_cap * 2 : 16;
+    s->cache = realloc(s->cache, sizeof(*s->cache) * s->cache_cap);
+  }
+  e = s->cache + s->cache_len++;
+  memset(e, 0, sizeof(*e));
+  e->path = calloc(strlen(path) + 1, 1);
+  strcpy(e->path, path);
+  return e;
+}
+
+/*
+ * Compiles src to a new unit. A fatal error is caught rather than exiting
+ * the server, and its message, without the last newline, returned in fatal.
+ * The unit has no file if the error came before its tokens were complete.
+ */
+struct unit *cache_compile(char *src, char **fatal) {
+  struct unit *u = calloc(1, sizeof(*u));
+  struct fatal_catch c;
+  size_t len;
+  FILE *mem = open_memstream(fatal, &len);
+  writer w = new_writer(mem);
+
+  c.w = &w;
+  if (!setjmp(c.env)) {
+    fatal_catch(&c);
+    *u = compile_toks(src_to_file(src), NULL);
+    if (!u->err) {
+      parse(u);
+      fold(u);
+      resolve(u);
+      check(u);
+    }
+  }
+  fatal_catch(NULL);
+  free_writer(&w);
+  fclose(mem);
+
+  if (!len) {
+    free(*fatal);
+    *fatal = NULL;
+  } else if ((*fatal)[len - 1] == '\n') {
+    (*fatal)[len - 1] = '\0';
+  }
+  return u;
+}
+
+/*
+ * Returns the compiled unit of the file at path, compiling it if it is not
+ * cached or changed, and the message of a fatal error compiling it in
+ * fatal. Returns NULL if the file cannot be read. The lock is only held to
+ * look entries up and update them, so compiles of other files go on.
+ */
+struct unit *cache_get(struct server *s, const char *path, bool *cached,
+                       char **fatal) {
+  struct stat st;
+  struct cache_entry *e;
+  struct unit *u = NULL;
+  char *src;
+  unsigned long hash;
+
+  if (stat(path, &st) || !S_ISREG(st.st_mode)) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&s->lock);
+  e = cache_find(s, path);
+  if (e && e->mtime.tv_sec == st.st_mtim.tv_sec &&
+      e->mtime.tv_nsec == st.st_mtim.tv_nsec && e->size == st.st_size) {
+    u = e->unit;
+    *fatal = e->fatal;
+  }
+  pthread_mutex_unlock(&s->lock);
+  if ((*cached = u != NULL)) {
+    return u;
+  }
+
+  read_file((char *)path, &src);
+  hash = hash_src(src);
+
+  /* touched with the same contents */
+  pthread_mutex_lock(&s->lock);
+  e = cache_find(s, path);
+  if (e && e->hash == hash) {
+    e->mtime = st.st_mtim;
+    e->size = st.st_size;
+    u = e->unit;
+    *fatal = e->fatal;
+  }
+  pthread_mutex_unlock(&s->lock);
+  if ((*cached = u != NULL)) {
+    alloc_free(src);
+    return u;
+  }
+
+  u = cache_compile(src, fatal);
+  alloc_free(src);
+
+  pthread_mutex_lock(&s->lock);
+  if (!(e = cache_find(s, path))) {
+    e = cache_add(s, path);
+  }
+  e->unit = u;
+  e->fatal = *fatal;
+  e->mtime = st.st_mtim;
+  e->size = st.st_size;
+  e->hash = hash;
+  pthread_mutex_unlock(&s->lock);
+
+  return u;
+}
+
+void write_response(writer *w, const char *id) {
+  write_str(w, "{\"jsonrpc\":\"2.0\",\"id\":");
+  if (id) {
+    write_mem(w, id, json_skip(id) - id);
+  } else {
+    write_str(w, "null");
+  }
+}
+
+void write_rpc_error(writer *w, const char *id, int code, const char *msg) {
+  write_response(w, id);
+  write_str(w, ",\"error\":{\"code\":");
+  write_long(w, code);
+  write_str(w, ",\"message\":");
+  write_json_str(w, msg);
+  write_str(w, "}}\n");
+}
+
+void write_parse_result(writer *w, struct unit *u, bool cached) {
+  write_str(w, "{\"cached\":");
+  write_str(w, cached ? "true" : "false");
+  write_str(w, ",\"lines\":");
+  write_long(w, u->file->lines_len);
+  write_str(w, ",\"tokens\":");
+  write_long(w, u->toks_len);
+  write_str(w, ",\"nodes\":");
+  write_long(w, u->nodes_len);
+  write_str(w, ",\"macros\":");
+  write_long(w, u->macros_len);
+  if (u->err) {
+    write_str(w, ",\"error\":");
+    write_json_str(w, u->err->msg);
+  }
+  write_char(w, '}');
+}
+
+void write_tokens_result(writer *w, struct unit *u) {
+  int i;
+
+  write_char(w, '[');
+  for (i = 0; i < u->toks_len; i++) {
+    write_str(w, i ? ",{\"text\":" : "{\"text\":");
+    write_json_str(w, u->toks[i].text);
+    write_str(w, ",\"kind\":\"");
+    write_str(w, token_kind_map[u->toks[i].kind]);
+    write_str(w, "\",\"line\":");
+    write_long(w, u->toks[i].line);
+    write_str(w, ",\"column\":");
+    write_long(w, u->toks[i].column);
+    write_char(w, '}');
+  }
+  write_char(w, ']');
+}
+
+void write_ast_result(writer *w, struct unit *u, bool decls_only) {
+  int i;
+
+  write_char(w, '[');
+  for (i = 0; i < u->nodes_len; i++) {
+    ast_node_t node = u->nodes[i];
+    if (decls_only && node.kind == FnDefn) {
+      /* signature only, as with --decls */
+      node.u.fn_defn.body = NULL;
+      node.u.fn_defn.toks = NULL;
+    }
+    if (i) {
+      write_char(w, ',');
+    }
+    write_ast_json(w, &node);
+  }
+  write_char(w, ']');
+}
+
+/* Frees the argv of serve_run and the len args after its first */
+void serve_free_args(char **argv, int len) {
+  int i;
+  for (i = 1; i <= len; i++) {
+    alloc_free(argv[i]);
+  }
+  free(argv);
+}
+
+/*
+ * Runs chocc with the JSON array args as its arguments, writing the output
+ * and exit status as the result.
+ */
+void serve_run(struct server *s, writer *w, const char *id, const char *args) {
+  struct options opts;
+  char **argv;
+  int argc;
+  char *out = NULL;
+  size_t out_len = 0;
+  FILE *mem;
+  writer ow;
+  int status = 0;
+
+  for (argc = 0; json_at(args, argc); argc++) {
+  }
+  argv = calloc(argc + 2, sizeof(*argv));
+  argv[0] = "chocc";
+  for (argc = 0; json_at(args, argc); argc++) {
+    if (!(argv[argc + 1] = json_str(json_at(args, argc)))) {
+      write_rpc_error(w, id, RPC_BAD_PARAMS, "args must be strings");
+      serve_free_args(argv, argc);
+      return;
+    }
+  }
+
+  mem = open_memstream(&out, &out_len);
+  ow = new_writer(mem);
+  /* modes that run or write more than a unit's output are not served */
+  if (!parse_options(&opts, argc + 1, argv) || opts.paths_len > 1 ||
+      opts.jobs || opts.run || opts.dump_ir || opts.ir_stats || opts.stats ||
+      opts.wasm_path || opts.asm_path || opts.trace_path || opts.serve) {
+    write_usage(&ow);
+    status = 1;
+  } else if (opts.load_path) {
+    status = write_loaded(&ow, &opts);
+  } else {
+    bool cached;
+    char *fatal;
+    struct unit *u = cache_get(s, opts.path, &cached, &fatal);
+    if (!u) {
+      free_writer(&ow);
+      fclose(mem);
+      free(out);
+      free(opts.paths);
+      serve_free_args(argv, argc);
+      write_rpc_error(w, id, RPC_FILE_ERROR, "cannot read file");
+      return;
+    }
+    if (fatal) {
+      /* as chocc prints it, after the source and tokens if it got them */
+      if (u->file) {
+        write_toks(&ow, u, &opts);
+      }
+      write_str(&ow, fatal);
+      write_char(&ow, '\n');
+      status = 1;
+    } else {
+      status = write_unit(&ow, u, &opts);
+    }
+  }
+  free_writer(&ow);
+  fclose(mem);
+  free(opts.paths);
+  serve_free_args(argv, argc);
+
+  write_response(w, id);
+  write_str(w, ",\"result\":{\"status\":");
+  write_long(w, status);
+  write_str(w, ",\"output\":");
+  write_json_str(w, out);
+  write_str(w, "}}\n");
+  free(out);
+}
+
+/* Answers a parse, tokens or ast request for the file at params.path */
+void serve_file(struct server *s, writer *w, const char *id,
+                const char *method, const char *params) {
+  char *path, *fatal;
+  struct unit *u;
+  bool cached;
+
+  if (!(path = json_str(json_get(params, "path")))) {
+    write_rpc_error(w, id, RPC_BAD_PARAMS, "expected a path");
+    return;
+  }
+  u = cache_get(s, path, &cached, &fatal);
+  alloc_free(path);
+  if (!u) {
+    write_rpc_error(w, id, RPC_FILE_ERROR, "cannot read file");
+    return;
+  }
+  if (fatal) {
+    write_rpc_error(w, id, RPC_COMPILE_ERROR, fatal);
+    return;
+  }
+  if (u->err && strcmp(method, "parse")) {
+    write_rpc_error(w, id, RPC_COMPILE_ERROR, u->err->msg);
+    return;
+  }
+
+  write_response(w, id);
+  write_str(w, ",\"result\":");
+  if (!strcmp(method, "parse")) {
+    write_parse_result(w, u, cached);
+  } else if (!strcmp(method, "tokens")) {
+    write_tokens_result(w, u);
+  } else {
+    const char *decls = json_get(params, "decls");
+    write_ast_result(w, u, decls && !strncmp(decls, "true", 4));
+  }
+  write_str(w, "}\n");
+}
+
+/* Answers one request line */
+void serve_request(struct server *s, writer *w, const char *req) {
+  const char *id, *params;
+  char *method;
+
+  if (!json_skip(req) || !(method = json_str(json_get(req, "method")))) {
+    write_rpc_error(w, NULL, RPC_PARSE_ERROR, "malformed request");
+    return;
+  }
+  id = json_get(req, "id");
+  params = json_get(req, "params");
+
+  if (!strcmp(method, "shutdown")) {
+    write_response(w, id);
+    write_str(w, ",\"result\":null}\n");
+    free_writer(w);
+    if (s->path) {
+      unlink(s->path);
+    }
+    exit(0);
+  }
+  if (!strcmp(method, "run")) {
+    serve_run(s, w, id, json_get(params, "args"));
+  } else if (!strcmp(method, "parse") || !strcmp(method, "tokens") ||
+             !strcmp(method, "ast")) {
+    serve_file(s, w, id, method, params);
+  } else {
+    write_rpc_error(w, id, RPC_NO_METHOD, "unknown method");
+  }
+  alloc_free(method);
+}
+
+/* Answers requests from in on out until in ends */
+void serve_stream(struct server *s, FILE *in, FILE *out) {
+  char *line = NULL;
+  size_t cap = 0;
+  writer w = new_writer(out);
+
+  while (getline(&line, &cap, in) > 0) {
+    if (!*line || !strcmp(line, "\n")) {
+      continue;
+    }
+    serve_request(s, &w, line);
+    writer_flush(&w);
+    fflush(out);
+  }
+  free(line);
+  free_writer(&w);
+}
+
+/* arg of serve_conn */
+struct conn {
+  struct server *server;
+  int fd;
+};
+
+void *serve_conn(void *arg) {
+  struct conn *conn = arg;
+  FILE *in = fdopen(conn->fd, "r");
+  FILE *out = fdopen(dup(conn->fd), "w");
+
+  serve_stream(conn->server, in, out);
+  fclose(in);
+  fclose(out);
+  free(conn);
+  return NULL;
+}
+
+int serve(char *path) {
+  struct server s;
+  struct sockaddr_un addr;
+  int fd;
+
+  memset(&s, 0, sizeof(s));
+  s.path = path;
+  pthread_mutex_init(&s.lock, NULL);
+
+  if (!path) {
+    serve_stream(&s, stdin, stdout);
+    return 0;
+  }
+
+  /* a client hanging up must not stop the server */
+  signal(SIGPIPE, SIG_IGN);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    puts("socket path too long");
+    return 1;
+  }
+  strcpy(addr.sun_path, path);
+
+  unlink(path);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(fd, 64)) {
+    printf("could not listen on %s\n", path);
+    return 1;
+  }
+
+  for (;;) {
+    pthread_t thread;
+    struct conn *conn;
+    int c = accept(fd, NULL, NULL);
+
+    if (c < 0) {
+      continue;
+    }
+    conn = malloc(sizeof(*conn));
+    conn->server = &s;
+    conn->fd = c;
+    if (pthread_create(&thread, NULL, serve_conn, conn)) {
+      close(c);
+      free(conn);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+}
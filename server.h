@@ -0,0 +1,29 @@
+#ifndef CHOCC_SERVER_H
+#define CHOCC_SERVER_H
+#pragma once
+
+/* socket of chocc-client unless CHOCC_SOCKET is set */
+#define CHOCC_SOCKET "/tmp/chocc.sock"
+
+/*
+ * Serves JSON-RPC 2.0 requests, one per line, from stdin/stdout if path is
+ * NULL, else from a Unix socket at path with a thread per connection.
+ * Compiled units stay cached by path, and are rebuilt when the file's mtime
+ * or size changed and its contents hash differently. Returns the exit status.
+ *
+ * Methods:
+ *   parse     {"path"} -> {"cached", "lines", "tokens", "nodes", "macros"}
+ *   tokens    {"path"} -> [{"text", "kind", "line", "column"}, ...]
+ *   ast       {"path", "decls"?} -> [node, ...] as written by --json
+ *   run       {"args"} -> {"status", "output"} as chocc args would print,
+ *             the usage for -j, --run, --dump-ir, --ir-stats, --stats,
+ *             --emit-wasm, --emit-asm and --trace
+ *   shutdown  stops the server
+ *
+ * A file that does not lex has "error" in its parse result, and one that
+ * does not compile past lexing fails every method but run with the message
+ * chocc would print.
+ */
+int serve(char *path);
+
+#endif
@@ -0,0 +1,101 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "stats.h"
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+const char *stage_names[STAGES] = {
+    "load_file",  "lex",         "cpp_replace",    "cpp_cond",
+    "cpp_pragma", "cpp_include", "filter_newline", "parse",
+    "fold",       "resolve",     "check",          "write"};
+
+/* Returns the seconds of clock since some fixed point */
+double stats_clock(clockid_t clock) {
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns the CPU seconds s is timed in */
+double stats_cpu(struct stats *s) {
+  return stats_clock(s->thread ? CLOCK_THREAD_CPUTIME_ID
+                               : CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void stats_begin(struct stats *s) {
+  if (!s) {
+    return;
+  }
+  s->wall_begin = stats_clock(CLOCK_MONOTONIC);
+  s->cpu_begin = stats_cpu(s);
+  s->trace_begin = trace_now(s->trace);
+}
+
+void stats_end(struct stats *s, stage st) {
+  struct rusage ru;
+
+  if (!s) {
+    return;
+  }
+  s->wall[st] += stats_clock(CLOCK_MONOTONIC) - s->wall_begin;
+  s->cpu[st] += stats_cpu(s) - s->cpu_begin;
+  getrusage(RUSAGE_SELF, &ru);
+  s->peak_kb[st] = ru.ru_maxrss;
+  trace_span(s->trace, "stage", stage_names[st], s->trace_begin, NULL, 0);
+}
+
+struct trace *stats_trace(struct stats *s) {
+  return s ? s->trace : NULL;
+}
+
+void write_stats(writer *w, struct stats *s) {
+  char buf[96];
+  double wall = 0, cpu = 0;
+  long peak = 0;
+  int i;
+
+  sprintf(buf, "%-16s %10s %10s %10s\n", "stage", "wall", "cpu", "peak KB");
+  write_str(w, buf);
+  for (i = 0; i < STAGES; i++) {
+    sprintf(buf, "%-16s %10.6f %10.6f %10ld\n", stage_names[i], s->wall[i],
+            s->cpu[i], s->peak_kb[i]);
+    write_str(w, buf);
+    wall += s->wall[i];
+    cpu += s->cpu[i];
+    peak = s->peak_kb[i] > peak ? s->peak_kb[i] : peak;
+  }
+  sprintf(buf, "%-16s %10.6f %10.6f %10ld\n", "total", wall, cpu, peak);
+  write_str(w, buf);
+
+  sprintf(buf, "%ld lines, %ld tokens lexed, %ld after cpp, %ld macros\n",
+          s->lines, s->toks_lexed, s->toks, s->macros);
+  write_str(w, buf);
+  sprintf(buf, "%ld nodes, %ld types\n", s->nodes, s->types);
+  write_str(w, buf);
+}
+
+void write_stats_json(writer *w, struct stats *s) {
+  char buf[128];
+  int i;
+
+  write_str(w, "{\"file\":");
+  write_json_str(w, s->path);
+  write_str(w, ",\"stages\":[");
+  for (i = 0; i < STAGES; i++) {
+    sprintf(buf,
+            "%s{\"name\":\"%s\",\"wall\":%.6f,\"cpu\":%.6f,\"peak_kb\":%ld}",
+            i ? "," : "", stage_names[i], s->wall[i], s->cpu[i],
+            s->peak_kb[i]);
+    write_str(w, buf);
+  }
+  sprintf(buf,
+          "],\"lines\":%ld,\"tokens_lexed\":%ld,\"tokens\":%ld,"
+          "\"macros\":%ld,",
+          s->lines, s->toks_lexed, s->toks, s->macros);
+  write_str(w, buf);
+  sprintf(buf, "\"nodes\":%ld,\"types\":%ld}\n", s->nodes, s->types);
+  write_str(w, buf);
+}
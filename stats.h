@@ -0,0 +1,67 @@
+#ifndef CHOCC_STATS_H
+#define CHOCC_STATS_H
+#pragma once
+
+#include "chocc.h"
+#include "io.h"
+#include "trace.h"
+
+/* the stages of compiling a unit, named for the functions running them */
+typedef enum stage {
+  StageLoad,
+  StageLex,
+  StageCppReplace,
+  StageCppCond,
+  StageCppPragma,
+  StageCppInclude,
+  StageCppNewline,
+  StageParse,
+  StageFold,
+  StageResolve,
+  StageCheck,
+  StageWrite
+} stage;
+
+#define STAGES 12
+extern const char *stage_names[STAGES];
+
+/*
+ * stats totals the wall and CPU time each stage of a unit took, and the
+ * peak resident memory of the process when it ended, along with the sizes
+ * of what the stages made.
+ */
+struct stats {
+  const char *path;
+  double wall[STAGES];
+  double cpu[STAGES];
+  long peak_kb[STAGES];
+  bool thread; /* CPU time of the calling thread, not the process */
+
+  /* when the running stage began */
+  double wall_begin;
+  double cpu_begin;
+  double trace_begin;
+
+  struct trace *trace; /* where each stage is a span too, or NULL */
+
+  long lines;
+  long toks_lexed;
+  long toks; /* after cpp */
+  long macros;
+  long nodes; /* distinct nodes and types, as --emit-ast writes them */
+  long types;
+};
+
+/* Starts timing a stage. Does nothing if s is NULL, as stats_end. */
+void stats_begin(struct stats *s);
+/* Adds the time since stats_begin to a stage */
+void stats_end(struct stats *s, stage);
+
+/* Returns the trace of s, or NULL if s is NULL or there is none */
+struct trace *stats_trace(struct stats *s);
+
+/* Writes the stats as a table, or as one line of JSON */
+void write_stats(writer *, struct stats *);
+void write_stats_json(writer *, struct stats *);
+
+#endif
@@ -1,5 +1,7 @@
 import pytest
 import os
+import re
+import subprocess
 from ctypes import *
 from distutils.sysconfig import parse_makefile
 
@@ -39,6 +41,23 @@ class UNIT(Structure):
     ]
 
 
+def run_chocc(*args):
+    """Runs ./chocc with args, returning the finished process"""
+    return subprocess.run(["./chocc", *args], capture_output=True)
+
+
+def chocc_out(*args):
+    """Runs ./chocc with args, returning its output if it succeeded"""
+    return subprocess.run(["./chocc", *args], capture_output=True,
+                          check=True).stdout
+
+
+def make_sources():
+    """Returns the SOURCES the Makefile builds chocc from"""
+    with open("Makefile") as f:
+        return re.search(r"^SOURCES\s*=\s*(.*)$", f.read(), re.M)[1].split()
+
+
 @pytest.fixture
 def chocc():
     makefile = parse_makefile("Makefile")
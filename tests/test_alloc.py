@@ -0,0 +1,35 @@
+import json
+import subprocess
+
+SRC = """#define SQ(x) ((x) * (x))
+int f(int a) { return SQ(a) + 1; }
+"""
+
+
+def test_counters(tmp_path):
+    binary = str(tmp_path / "chocc-counters")
+    subprocess.run(["make", "-s", "COUNTERS=" + binary, binary], check=True)
+    path = tmp_path / "alloc.c"
+    path.write_text(SRC)
+    out = subprocess.run([binary, "--stats=json", str(path)],
+                         capture_output=True, check=True).stdout
+    counts = json.loads(out.splitlines()[-1])
+    assert list(counts["alloc"]) == ["io", "lex", "cpp", "parse", "unit",
+                                    "sema"]
+    assert all(c["calls"] > 0 and c["bytes"] > 0
+               for c in counts["alloc"].values())
+    events = counts["events"]
+    assert events["tokens_lexed"] > 0
+    assert events["set_pos"] >= events["advance"] > 0
+    assert events["macro_lookups"] > 0
+
+
+def test_counters_compiled_out(tmp_path):
+    path = tmp_path / "alloc.c"
+    path.write_text(SRC)
+    out = subprocess.run(["./chocc", "--stats", str(path)],
+                         capture_output=True, check=True).stdout
+    assert b"macro_lookups" not in out
+    syms = subprocess.run(["nm", "./chocc"], capture_output=True,
+                          check=True).stdout
+    assert b"count_event_add" not in syms
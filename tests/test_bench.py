@@ -0,0 +1,82 @@
+import os
+import re
+import subprocess
+
+import pytest
+
+from chocc import make_sources
+
+WORKLOADS = ["plain", "macros", "typedefs", "ifs", "exprs", "mixed"]
+
+
+def build(tmp_path_factory, name):
+    sources = make_sources()
+    binary = str(tmp_path_factory.mktemp("bench") / ("bench_" + name))
+    cc = os.environ.get("CC", "cc")
+    subprocess.run([cc, "-std=c90", *sources, "bench/" + name + ".c", "-o",
+                    binary, "-pthread", "-lm"], check=True)
+    return binary
+
+
+@pytest.fixture(scope="module")
+def bench_front(tmp_path_factory):
+    return build(tmp_path_factory, "front")
+
+
+@pytest.mark.parametrize("workload", WORKLOADS)
+def test_bench_workloads_compile(tmp_path, bench_front, workload):
+    path = tmp_path / (workload + ".c")
+    path.write_bytes(subprocess.run([bench_front, "-g", workload + ":kb=8"],
+                                    capture_output=True, check=True).stdout)
+    out = subprocess.run(["./chocc", "-fsyntax-only", str(path)],
+                         capture_output=True)
+    assert (out.stdout, out.returncode) == (b"", 0)
+
+
+def test_bench_baseline(tmp_path, bench_front):
+    base = str(tmp_path / "baseline.txt")
+    spec = "mixed:kb=4,fns=4"
+    subprocess.run([bench_front, "-r", "1", "-w", base, spec],
+                   capture_output=True, check=True)
+    rows = [line.split() for line in open(base) if not line.startswith("#")]
+    assert [r[1] for r in rows][-2:] == ["check", "total"]
+    assert all(r[0] == "mixed" and float(r[2]) >= 0 for r in rows)
+    out = subprocess.run([bench_front, "-r", "1", "-b", base, spec],
+                         capture_output=True, check=True).stdout.decode()
+    assert re.search(r"^  total .* [0-9.]+x$", out, re.M)
+
+
+@pytest.fixture(scope="module")
+def bench_corpus(tmp_path_factory):
+    return build(tmp_path_factory, "corpus")
+
+
+@pytest.fixture(scope="module")
+def corpus(tmp_path_factory):
+    path = tmp_path_factory.mktemp("corpus")
+    subprocess.run(["make", "-s", "corpus", "CORPUS=" + str(path),
+                    "CC=" + os.environ.get("CC", "cc")],
+                   capture_output=True, check=True)
+    return path
+
+
+def test_bench_corpus(tmp_path, bench_corpus, corpus):
+    bad = tmp_path / "bad.c"
+    bad.write_text("int main(void) { return 1 }\n")
+    paths = [str(corpus / "pool.c"), "bench/programs/nbody.c", str(bad)]
+    out = subprocess.run([bench_corpus, "-r", "1", *paths],
+                         capture_output=True, check=True).stdout.decode()
+    rows = out.splitlines()
+    assert rows[1].split()[0] == paths[0] and rows[1].endswith("  ok")
+    assert rows[2].split()[2] == "85"
+    assert rows[3].endswith("  parsing error at } [1:27]")
+    assert rows[-1].startswith("2 of 3 files compiled")
+
+
+def test_bench_corpus_no_crash(bench_corpus, corpus):
+    # files may stop at an error chocc raises, but none may crash it
+    paths = sorted(str(p) for p in corpus.iterdir())
+    assert len(paths) > 50
+    out = subprocess.run([bench_corpus, "-r", "1", *paths],
+                         capture_output=True, check=True).stdout.decode()
+    assert "crashed" not in out
@@ -0,0 +1,57 @@
+import re
+import subprocess
+
+SRC = """struct s { char c; int i; long l; };
+struct node { int v; struct node *next; };
+union u { char c[5]; int i; };
+unsigned u1;
+long l1;
+char a[sizeof(struct s)], b[sizeof(union u)];
+int f(struct node *n, char *p) {
+  return n->next->v + (u1 + l1) + (p - p) + "ab"[1] + g(*p);
+}
+"""
+
+
+def types(tmp_path):
+    path = tmp_path / "check.c"
+    path.write_text(SRC)
+    out = subprocess.run(["./chocc", "--types", str(path)],
+                         capture_output=True, check=True).stdout.decode()
+    out = re.sub("\033\\[[0-9;]*m", "", out)
+    return [l.lstrip("|`- ") for l in out.splitlines()
+            if "\t" not in l and not re.match(r" *[0-9]+ \| ", l)]
+
+
+def test_check_layout(tmp_path):
+    lines = types(tmp_path)
+    assert "Decl a: Char[16]" in lines
+    assert "Decl b: Char[8]" in lines
+
+
+def test_check_exprs(tmp_path):
+    lines = types(tmp_path)
+    assert lines[lines.index("JumpStmt Return") + 1:] == [
+        "InfixExpr: Plus <Long Int>",
+        "InfixExpr: Plus <Long Int>",
+        "InfixExpr: Plus <Long Int>",
+        "InfixExpr: Plus <Long Int>",
+        "PostfixExpr: Arrow <Int>",
+        "PostfixExpr: Arrow <*Struct node>",
+        "Ident: n <*Struct node>",
+        "Ident: next <*Struct node>",
+        "Ident: v <Int>",
+        "InfixExpr: Plus <Long Int>",
+        "Ident: u1 <Unsigned Int>",
+        "Ident: l1 <Long Int>",
+        "InfixExpr: Minus <Long Int>",
+        "Ident: p <*Char>",
+        "Ident: p <*Char>",
+        "PostfixExpr: LBrack <Char>",
+        'Lit: "ab" <Char[3]>',
+        "Lit: 1 <Int>",
+        "CallExpr <Int>",
+        "Ident: g",
+        "PrefixExpr: Star <Char>",
+        "Ident: p <*Char>",
+    ]
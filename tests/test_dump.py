@@ -0,0 +1,38 @@
+from chocc import run_chocc
+
+SRC = """#define ONE 1
+int x;
+int main(void) { return x + ONE; }
+"""
+
+
+
+def test_dump(tmp_path):
+    path = tmp_path / "dump.c"
+    path.write_text(SRC)
+    src = run_chocc("--dump-source", str(path)).stdout
+    toks = run_chocc("--dump-tokens", str(path)).stdout
+    ast = run_chocc("--dump-ast", str(path)).stdout
+    assert src.startswith(b"  1 | #define ONE 1\n")
+    assert toks.startswith(b"int\tInt\t2:1\n")
+    assert b"FnDefn" in ast and b"\tInt\t" not in ast
+    assert run_chocc(str(path)).stdout == src + toks + ast
+    assert run_chocc("--dump-source", "--dump-ast", str(path)).stdout == src + ast
+
+
+def test_dump_syntax_only(tmp_path):
+    path = tmp_path / "ok.c"
+    path.write_text(SRC)
+    out = run_chocc("-fsyntax-only", str(path))
+    assert (out.stdout, out.returncode) == (b"", 0)
+
+    path = tmp_path / "bad.c"
+    path.write_text("int x;\nint main(void) { return 1 }\n")
+    out = run_chocc("-fsyntax-only", str(path))
+    assert out.stdout == b"expected Semi, got }\nparsing error at } [2:27]\n"
+    assert out.returncode == 1
+
+    # the error follows what was dumped, in the same stream
+    out = run_chocc("--dump-source", str(path))
+    assert out.stdout.startswith(b"  1 | int x;\n")
+    assert out.stdout.endswith(b"parsing error at } [2:27]\n")
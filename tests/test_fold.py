@@ -0,0 +1,58 @@
+import json
+
+from chocc import chocc_out
+
+
+def decls(tmp_path, src):
+    path = tmp_path / "fold.c"
+    path.write_text(src)
+    lines = chocc_out("--ndjson", str(path)).splitlines()
+    nodes = [json.loads(l) for l in lines if l.startswith(b'{"')]
+    return {n.get("name"): n for n in nodes}
+
+
+def test_fold_array_sizes(tmp_path):
+    d = decls(
+        tmp_path,
+        "enum { A, B = A + 5, C };\n"
+        "struct s { long l, m[3]; };\n"
+        "int a[C * 2];\n"
+        "char b[sizeof(struct s) + sizeof(short)];\n"
+        "char c[(unsigned char)-1 >> 4];\n"
+        "char d[sizeof((char)1) + sizeof 1];\n",
+    )
+    assert d["a"]["type"]["size"] == 12
+    assert d["b"]["type"]["size"] == 34
+    assert d["c"]["type"]["size"] == 15
+    assert d["d"]["type"]["size"] == 5
+
+
+def test_fold_exprs(tmp_path):
+    d = decls(
+        tmp_path,
+        "enum e { A = 'a', B, C = -1 };\n"
+        "int x = B * 2 + (C < (unsigned)0);\n"
+        "int y = 1 / 0;\n"
+        "int f(int A) { return A + B; }\n",
+    )
+    consts = d[None]["type"]["consts"]
+    assert [c.get("value", {}).get("value") for c in consts] == [97, None, -1]
+    assert d["x"]["init"] == {"kind": "Lit", "value": 196}
+    assert d["y"]["init"]["kind"] == "InfixExpr"
+    ret = d["f"]["body"]["inner"]["items"][0]["inner"]
+    assert ret["lhs"] == {"kind": "Ident", "name": "A"}
+    assert ret["rhs"] == {"kind": "Lit", "value": 98}
+
+
+def test_fold_sizeof_typedef(tmp_path):
+    d = decls(
+        tmp_path,
+        "typedef long v;\n"
+        "typedef struct { char c[3]; v l; } s;\n"
+        "long n = sizeof(v);\n"
+        "int m = sizeof(s) + sizeof(v *);\n"
+        "int k = sizeof (v) - 1;\n",
+    )
+    assert d["n"]["init"] == {"kind": "Lit", "value": 8}
+    assert d["m"]["init"] == {"kind": "Lit", "value": 24}
+    assert d["k"]["init"] == {"kind": "Lit", "value": 7}
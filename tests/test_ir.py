@@ -0,0 +1,51 @@
+import subprocess
+
+SRC = """int f(int a) {
+  int x = 2, y = 3;
+  if (x * y != 6)
+    a = y / 0;
+  return a + x;
+}
+"""
+
+
+def dump(tmp_path, *flags):
+    path = tmp_path / "ir.c"
+    path.write_text(SRC)
+    return subprocess.run(["./chocc", *flags, str(path)],
+                          capture_output=True, check=True).stdout.decode()
+
+
+def test_dump_ir(tmp_path):
+    # the branch folds away, and the division with it
+    assert dump(tmp_path, "--dump-ir") == ("fn f, frame 16\n"
+                                           "b0:\n"
+                                           "  v0 = param i32 0\n"
+                                           "  v11 = const i32 2\n"
+                                           "  v12 = add i32 v0, v11\n"
+                                           "  ret v12\n")
+
+
+def test_dump_ir_raw(tmp_path):
+    out = dump(tmp_path, "--dump-ir=raw")
+    assert "  br v5, b1, b2\n" in out
+    assert "  v8 = div i32 v2, v7\n" in out
+    assert "  v10 = phi i32 (b0 v0, b1 v8)\n" in out
+
+
+def test_ir_stats(tmp_path):
+    lines = dump(tmp_path, "--ir-stats").splitlines()
+    assert lines[0].split() == ["pass", "secs", "blocks", "insns"]
+    assert [line.split()[0] for line in lines[1:]] == [
+        "build", "constprop", "simplify", "copyprop", "dce", "simplify"]
+    assert lines[-1].split()[2:] == ["2", "5"]
+
+
+def test_run_ir_stack_overflow(tmp_path):
+    path = tmp_path / "deep.c"
+    path.write_text("int f(int n) { return f(n + 1) + 1; }\n"
+                    "int main(void) { return f(0); }\n")
+    out = subprocess.run(["./chocc", "--run=ir", str(path)],
+                         capture_output=True)
+    assert out.stdout == b"run: stack overflow in f\n"
+    assert out.returncode == 1
@@ -0,0 +1,80 @@
+import subprocess
+
+import pytest
+
+# interpreter only, every function compiled, and compiled once hot
+MODES = [["--run=ir"], ["--run=jit", "--jit-hot=0"],
+         ["--run=jit", "--jit-hot=2"]]
+
+
+@pytest.mark.parametrize("program", ["fib", "sieve", "nbody", "matmul"])
+def test_jit_programs(program):
+    outs = [subprocess.run(["./chocc"] + mode +
+                           ["bench/programs/" + program + ".c"],
+                           capture_output=True, check=True).stdout
+            for mode in MODES]
+    assert outs[1] == outs[0]
+    assert outs[2] == outs[0]
+
+
+def test_jit_calls_between_tiers(tmp_path):
+    # compiled code calls back into interpreted functions, through pointers
+    # too, and they into it
+    path = tmp_path / "tiers.c"
+    path.write_text("int odd(int n);\n"
+                    "int even(int n) { return n ? odd(n - 1) : 1; }\n"
+                    "int odd(int n) { return n ? even(n - 1) : 0; }\n"
+                    "double half(double x) { return x / 2; }\n"
+                    "int apply(int (*f)(int), int n) { return f(n); }\n"
+                    "int main(void) {\n"
+                    "  int i, n = 0;\n"
+                    "  double d = 0;\n"
+                    "  for (i = 0; i < 50; i++) {\n"
+                    "    n += apply(i % 3 ? even : odd, i);\n"
+                    "    d += half(i);\n"
+                    "  }\n"
+                    "  printf(\"%d %.1f\\n\", n, d);\n"
+                    "  return 0;\n"
+                    "}\n")
+    for mode in MODES:
+        out = subprocess.run(["./chocc"] + mode + [str(path)],
+                             capture_output=True, check=True)
+        assert out.stdout == b"24 612.5\n"
+
+
+def test_jit_traps(tmp_path):
+    path = tmp_path / "div.c"
+    path.write_text("int zero;\n"
+                    "int main(void) {\n"
+                    "  printf(\"%d\\n\", 7 / (zero + 1));\n"
+                    "  return 1 / zero;\n"
+                    "}\n")
+    out = subprocess.run(["./chocc", "--run=jit", "--jit-hot=0", str(path)],
+                         capture_output=True)
+    assert out.stdout == b"7\nrun: division by zero\n"
+    assert out.returncode == 1
+
+
+def test_jit_stack_overflow(tmp_path):
+    # compiled code recurses on the native stack, checked on entry
+    path = tmp_path / "down.c"
+    path.write_text("int down(int n) { return down(n + 1) + 1; }\n"
+                    "int main(void) { return down(0); }\n")
+    out = subprocess.run(["./chocc", "--run=jit", "--jit-hot=0", str(path)],
+                         capture_output=True)
+    assert out.stdout == b"run: stack overflow in down\n"
+    assert out.returncode == 1
+
+
+@pytest.mark.parametrize("hot", ["--jit-hot=0", "--jit-hot=1000"])
+def test_jit_as_deep_as_ir(tmp_path, hot):
+    # compiled frames get at least the depth the interpreter allows
+    path = tmp_path / "deep.c"
+    path.write_text("int d(int n) { return n ? 1 + d(n - 1) : 0; }\n"
+                    "int main(void) { return d(200000) % 256; }\n")
+    ir = subprocess.run(["./chocc", "--run=ir", str(path)],
+                        capture_output=True)
+    jit = subprocess.run(["./chocc", "--run=jit", hot, str(path)],
+                         capture_output=True)
+    assert ir.stdout == jit.stdout == b""
+    assert ir.returncode == jit.returncode == 200000 % 256
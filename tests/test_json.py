@@ -0,0 +1,32 @@
+import json
+
+import pytest
+
+from chocc import chocc_out
+
+# literals are written as spelled, so escapes reach the JSON writer raw
+STRINGS = [r'"a\"b\\c\n\t\001"', "'\"'", r"'\\'", '"x\ty\fz"', '"é"']
+
+
+def test_json_strings(tmp_path):
+    path = tmp_path / "strings.c"
+    path.write_text("".join(f"char *s{i} = {s};\n"
+                            for i, s in enumerate(STRINGS)))
+    nodes = json.loads(chocc_out("--json", "--dump-ast", str(path)))
+    assert [n["init"]["value"] for n in nodes] == [s[1:-1] for s in STRINGS]
+    assert [n["init"].get("char", False) for n in nodes] == [
+        False, True, True, False, False]
+
+
+def test_json_empty(tmp_path):
+    path = tmp_path / "empty.c"
+    path.write_text("/* nothing */\n")
+    assert json.loads(chocc_out("--json", "--dump-ast", str(path))) == []
+    assert chocc_out("--ndjson", "--dump-ast", str(path)) == b""
+
+
+@pytest.mark.parametrize("flags", [[], ["--types"], ["--decls"]])
+def test_json_ndjson(flags):
+    nodes = json.loads(chocc_out("--json", "--dump-ast", *flags, "test.c"))
+    lines = chocc_out("--ndjson", "--dump-ast", *flags, "test.c")
+    assert nodes and nodes == [json.loads(l) for l in lines.splitlines()]
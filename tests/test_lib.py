@@ -0,0 +1,108 @@
+import ctypes
+import os
+import resource
+import subprocess
+from concurrent.futures import ThreadPoolExecutor
+
+import pytest
+
+SRC = b"""#define SQ(x) ((x) * (x))
+typedef struct pt { int x; int y; } pt;
+int f(pt *p) { return SQ(p->x) + p->y; }
+"""
+
+
+@pytest.fixture
+def lib():
+    lib = ctypes.CDLL(os.path.join(os.getcwd(), "chocc.so"))
+    lib.chocc_new.restype = ctypes.c_void_p
+    lib.chocc_new.argtypes = [ctypes.c_int, ctypes.POINTER(ctypes.c_char_p)]
+    lib.chocc_compile.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                  ctypes.c_size_t]
+    lib.chocc_output.restype = ctypes.c_void_p
+    lib.chocc_output.argtypes = [ctypes.c_void_p,
+                                 ctypes.POINTER(ctypes.c_size_t)]
+    lib.chocc_error.restype = ctypes.c_char_p
+    lib.chocc_error.argtypes = [ctypes.c_void_p]
+    lib.chocc_unit.restype = ctypes.c_void_p
+    lib.chocc_unit.argtypes = [ctypes.c_void_p]
+    lib.chocc_free.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+def new(lib, *args):
+    argv = (ctypes.c_char_p * len(args))(*[a.encode() for a in args])
+    return lib.chocc_new(len(args), argv)
+
+
+def compile(lib, ctx, src):
+    status = lib.chocc_compile(ctx, src, len(src))
+    n = ctypes.c_size_t()
+    out = ctypes.string_at(lib.chocc_output(ctx, ctypes.byref(n)), n.value)
+    return status, out, lib.chocc_error(ctx)
+
+
+def test_lib_compile(lib, tmp_path):
+    path = tmp_path / "lib.c"
+    path.write_bytes(SRC)
+    for args in [[], ["--json"], ["--symbols"], ["--dump-ast", "--types"]]:
+        ctx = new(lib, *args)
+        expected = subprocess.run(["./chocc", *args, str(path)],
+                                  capture_output=True, check=True).stdout
+        assert compile(lib, ctx, SRC) == (0, expected, None)
+        assert lib.chocc_unit(ctx)
+        lib.chocc_free(ctx)
+
+
+def test_lib_errors(lib):
+    ctx = new(lib, "-fsyntax-only")
+    status, out, err = compile(lib, ctx, b"int main(void) { return 1 }\n")
+    assert (status, err) == (1, b"expected Semi, got }\n"
+                                b"parsing error at } [1:27]")
+    assert out == err + b"\n"
+    assert not lib.chocc_unit(ctx)
+
+    status, out, err = compile(lib, ctx, b"#undef X\n")
+    assert status == 1 and err.startswith(b"could not #undef")
+
+    # the process goes on, and so does the context
+    assert compile(lib, ctx, SRC) == (0, b"", None)
+    lib.chocc_free(ctx)
+
+
+def test_lib_options(lib):
+    for args in [["--run"], ["--stats"], ["a.c"], ["--emit-ast=x"],
+                 ["--bogus"]]:
+        assert not new(lib, *args)
+
+
+def test_lib_threads(lib):
+    srcs = [SRC + b"".join(b"int g%d(void) { return %d; }\n" % (k, k)
+                           for k in range(i)) for i in range(8)]
+    ctx = new(lib, "--json")
+    expected = [compile(lib, ctx, src)[1] for src in srcs]
+    lib.chocc_free(ctx)
+
+    def work(i):
+        ctx = new(lib, "--json")
+        outs = [compile(lib, ctx, srcs[i])[1] for _ in range(20)]
+        lib.chocc_free(ctx)
+        return outs
+
+    with ThreadPoolExecutor(8) as pool:
+        for i, outs in enumerate(pool.map(work, range(8))):
+            assert outs == [expected[i]] * 20
+
+
+def test_lib_frees(lib):
+    src = b"".join(b"int f%d(int a, int b) { int i, s = 0;\n"
+                   b"  for (i = 0; i < a; i++) s += i * b - %d;\n"
+                   b"  return s; }\n" % (i, i) for i in range(400))
+    ctx = new(lib, "-fsyntax-only")
+    compile(lib, ctx, src)
+    before = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    for _ in range(200):
+        assert compile(lib, ctx, src)[0] == 0
+    lib.chocc_free(ctx)
+    grew_kb = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss - before
+    assert grew_kb < 16 * 1024
@@ -0,0 +1,127 @@
+import json
+
+import pytest
+
+from chocc import chocc_out, run_chocc
+
+# u is a typedef name only after g, whose parameter it names
+LAZY = """typedef int t;
+int f(int a, t *b) { t c = a; return c + *b; }
+int g(int u) { int r = 0; while (u) { r = r + u; u = u - 1; } return r; }
+typedef char u;
+int h(void) { u v = 0; return v * 2 + g(3); }
+"""
+
+
+@pytest.mark.parametrize(
+    "path",
+    ["test.c", "test_cpp.c"],
+)
+def test_parse_parallel(path):
+    assert chocc_out(path) == chocc_out("-j4", path)
+
+
+def test_parse_parallel_many(tmp_path):
+    src = []
+    for i in range(500):
+        if i % 50 == 0:
+            src.append(f"typedef int t{i};")
+        src.append(f"t{i // 50 * 50} f{i}(int a) {{ return (t0) * a + {i}; }}")
+    path = tmp_path / "many.c"
+    path.write_text("\n".join(src) + "\n")
+    assert chocc_out(str(path)) == chocc_out("-j4", str(path))
+
+
+
+
+def test_parse_parallel_block_typedef(tmp_path):
+    # t names a type only inside f's block, so g's parameter is an int named t
+    path = tmp_path / "scope.c"
+    path.write_text("int f(void) { typedef int t; { t a = 1; return a; } }\n"
+                    "int g(int t) { return t * 2; }\n")
+    out = chocc_out(str(path))
+    assert b" g t: Int -> Int\n" in out
+    assert chocc_out("-j4", str(path)) == out
+
+
+def test_parse_parallel_error(tmp_path):
+    src = [f"int f{i}(int a) {{ return a + {i}; }}" for i in range(200)]
+    src[60] = "int bad(void) { return ); }"
+    src[150] = "int worse(void) { int ; }"
+    path = tmp_path / "bad.c"
+    path.write_text("\n".join(src) + "\n")
+    expected = run_chocc("--dump-source", str(path))
+    assert expected.returncode == 1
+    assert expected.stdout.endswith(b"parsing error at ) [61:24]\n")
+    for _ in range(10):
+        out = run_chocc("-j4", "--dump-source", str(path))
+        assert (out.returncode, out.stdout) == (1, expected.stdout)
+
+def test_parse_units(tmp_path):
+    paths = []
+    for i in range(40):
+        path = tmp_path / f"u{i}.c"
+        body = "".join(f"int f{i}_{k}(int a) {{ return a * {k}; }}\n"
+                       for k in range(i % 7 * 20 + 1))
+        path.write_text(f"#define N{i} {i}\nint g = N{i};\n" + body)
+        paths.append(str(path))
+    expected = b"".join(chocc_out(p) for p in paths)
+    assert chocc_out(*paths) == expected
+    assert chocc_out("-j1", *paths) == expected
+    assert chocc_out("-j8", *paths) == expected
+
+
+def test_parse_units_errors(tmp_path):
+    good = tmp_path / "good.c"
+    good.write_text("int a;\n")
+    bad = tmp_path / "bad.c"
+    bad.write_text("int f(void) { return }\n")
+    undef = tmp_path / "undef.c"
+    undef.write_text("#undef X\nint b;\n")
+    paths = [str(good), str(bad), str(good), str(undef), str(good)]
+    out = run_chocc("-j4", *paths)
+    assert out.returncode == 1
+    assert out.stdout == b"".join(
+        run_chocc(p).stdout
+        for p in paths)
+    assert b"parsing error at } [1:22]\n" in out.stdout
+    assert out.stdout.endswith(chocc_out(str(good)))
+
+
+def test_parse_decls(tmp_path):
+    path = tmp_path / "lazy.c"
+    path.write_text(LAZY)
+    full = chocc_out("--ndjson", "--dump-ast", str(path)).splitlines()
+    decls = chocc_out("--decls", "--ndjson", "--dump-ast", str(path))
+    sigs = [json.loads(l) for l in full]
+    for node in sigs:
+        node.pop("body", None)
+    assert [json.loads(l) for l in decls.splitlines()] == sigs
+
+
+def test_parse_fn_defn_body(tmp_path):
+    path = tmp_path / "lazy.c"
+    path.write_text(LAZY)
+    ast = tmp_path / "lazy.ast"
+    # --emit-ast writes the bodies --decls left unparsed by fn_defn_body
+    chocc_out("--decls", "-fsyntax-only", f"--emit-ast={ast}", str(path))
+    assert (chocc_out("--ndjson", f"--load-ast={ast}") ==
+            chocc_out("--ndjson", "--dump-ast", str(path)))
+
+
+@pytest.mark.parametrize(
+    "expr",
+    [" + ".join(["a"] * 100000),
+     "a ? 1 : " * 100000 + "0",
+     "(" * 100000 + "a" + ")" * 100000,
+     "-" * 100000 + "a",
+     "a = " * 100000 + "1"],
+    ids=["chain", "ternary", "parens", "prefix", "assign"],
+)
+def test_parse_deep(tmp_path, expr):
+    # nesting is bounded by memory, through parse and every pass after it
+    path = tmp_path / "deep.c"
+    path.write_text(f"int a;\nint f(void) {{ return {expr}; }}\n"
+                    f"int g = sizeof({expr});\n")
+    out = run_chocc("-fsyntax-only", str(path))
+    assert (out.returncode, out.stdout) == (0, b"")
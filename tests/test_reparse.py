@@ -0,0 +1,15 @@
+import os
+import subprocess
+
+from chocc import make_sources
+
+
+def test_reparse_matches_full(tmp_path):
+    # bench_reparse compares every incremental result with a full reparse
+    binary = str(tmp_path / "bench_reparse")
+    cc = os.environ.get("CC", "cc")
+    subprocess.run([cc, "-std=c90", *make_sources(), "bench/reparse.c", "-o",
+                    binary, "-pthread", "-lm"], check=True)
+    out = subprocess.run([binary, "200"], capture_output=True, check=True).stdout
+    assert b"MISMATCH" not in out
+    assert out.count(b" ok") == 6
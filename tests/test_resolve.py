@@ -0,0 +1,57 @@
+import subprocess
+
+SRC = """enum color { Red, Green = 4, Blue };
+typedef enum color color_t;
+int g = Green;
+int f(int a, int b) {
+  int x = a;
+  color_t c = Blue;
+  {
+    int y = x + b, a = 1;
+    x = y + a;
+  }
+  {
+    int z[2];
+    static int s;
+    z[0] = s + g;
+    goto Red;
+  }
+Red:
+  return x + c + undeclared;
+}
+struct pt { int x, y; } p;
+int h(void) { return p.x + f(1, 2); }
+"""
+
+
+def symbols(tmp_path, *args):
+    path = tmp_path / "resolve.c"
+    path.write_text(SRC)
+    out = subprocess.run(["./chocc", "--symbols", *args, str(path)],
+                         capture_output=True, check=True).stdout.decode()
+    return [l for l in out.splitlines() if "\t" not in l and " | " not in l]
+
+
+def test_resolve_symbols(tmp_path):
+    assert symbols(tmp_path) == [
+        "Enum Red = 0, uses 0",
+        "Enum Green = 4, uses 0",
+        "Enum Blue = 5, uses 0",
+        "Typedef color_t: Typedef Enum color, uses 0",
+        "Global g: Int, uses 1",
+        "Fn f: (a: Int, b: Int) -> Int, frame 6, uses 1",
+        "Param a: Int, slot 0, uses 1",
+        "Param b: Int, slot 1, uses 1",
+        "Local x: Int, slot 2, uses 3",
+        "Local c: Enum color, slot 3, uses 1",
+        "Local y: Int, slot 4, uses 1",
+        "Local a: Int, slot 5, uses 1",
+        "Local z: Int[2], slot 4, uses 1",
+        "Static s: Static Int, uses 1",
+        "Global p: Struct pt { x: Int, y: Int }, uses 1",
+        "Fn h: Void -> Int, frame 0, uses 0",
+    ]
+
+
+def test_resolve_parallel(tmp_path):
+    assert symbols(tmp_path, "-j4") == symbols(tmp_path)
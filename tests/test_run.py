@@ -0,0 +1,105 @@
+import subprocess
+
+import pytest
+
+SRC = r"""#include <stdio.h>
+struct pt { int x; int y; };
+int fib(int n) { return n < 2 ? n : fib(n - 1) + fib(n - 2); }
+int sum(int *a, int n) {
+  int s = 0, i;
+  for (i = 0; i < n; i++)
+    s += a[i];
+  return s;
+}
+int twice(int x) { return x * 2; }
+int g = 7;
+char msg[] = "hi\tthere";
+int main(void) {
+  int a[5] = {1, 2, 3, 4, 5};
+  int (*f)(int) = twice;
+  struct pt p, *q = &p;
+  unsigned u = 0;
+  unsigned char c = 255;
+  double d = 1;
+  int i;
+  static int calls;
+  p.x = 3;
+  q->y = 4;
+  u = u - 1;
+  c++;
+  for (i = 0; i < 10; i++) {
+    if (i == 3)
+      continue;
+    if (i == 7)
+      break;
+    d = d * 2;
+  }
+  switch (g) {
+  case 1:
+    puts("one");
+    break;
+  case 7:
+    puts("seven");
+  default:
+    puts("fall");
+  }
+  printf("%d %d %u %d %.1f %s %d %ld %d %d\n", fib(20), sum(a, 5), u, c, d,
+         msg, p.x * q->y, sizeof(struct pt), f(21), ++calls);
+  return g - 7 + (u >> 31);
+}
+"""
+
+
+@pytest.mark.parametrize("engine",
+                         ["tree", "vm", "wasm", "ir", "jit", "native"])
+def test_run(tmp_path, engine):
+    path = tmp_path / "run.c"
+    path.write_text(SRC)
+    out = subprocess.run(["./chocc", "--run=" + engine, str(path)],
+                         capture_output=True)
+    assert out.stdout.decode() == (
+        "seven\nfall\n6765 15 4294967295 0 64.0 hi\tthere 12 8 42 1\n")
+    assert out.returncode == 1
+
+
+@pytest.mark.parametrize("engine",
+                         ["tree", "vm", "wasm", "ir", "jit", "native"])
+def test_run_programs(engine):
+    out = subprocess.run(
+        ["./chocc", "--run=" + engine, "bench/programs/matmul.c"],
+        capture_output=True, check=True)
+    assert out.stdout == b"119238000.0\n"
+
+
+def test_run_engines_agree(tmp_path):
+    path = tmp_path / "agree.c"
+    path.write_text(r"""int g[4] = {1, 2, 3};
+int main(void) {
+  int *p = g, i, n = 0;
+  *p++ += 10;
+  for (i = 0; i < 100; i++) {
+    if (i % 7 == 3)
+      continue;
+    n += i * (i & 1 ? -1 : 2);
+  }
+  printf("%d %d %d %d\n", g[0], g[1], (int)(p - g), n);
+  return 0;
+}
+""")
+    outs = [subprocess.run(["./chocc", "--run=" + e, str(path)],
+                           capture_output=True, check=True).stdout
+            for e in ["tree", "vm", "wasm", "ir", "jit", "native"]]
+    assert outs == [b"11 2 1 1987\n"] * 6
+
+
+def test_run_tree_stack_overflow(tmp_path):
+    # the tree walker recurses on the C stack, which is bounded before it ends
+    path = tmp_path / "deep.c"
+    for depth, out, status in [(5000, b"", 5000 % 256),
+                               (30000, b"run: stack overflow in d\n", 1)]:
+        path.write_text("int d(int n) { return n ? 1 + d(n - 1) : 0; }\n"
+                        "int main(void) { return d(%d); }\n" % depth)
+        run = subprocess.run(["./chocc", "--run=tree", str(path)],
+                             capture_output=True)
+        assert run.stdout == out
+        assert run.returncode == status
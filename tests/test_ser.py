@@ -0,0 +1,117 @@
+import pytest
+import struct
+
+from chocc import run_chocc
+
+
+def ast_lines(out):
+    return [l for l in out.splitlines() if l.startswith(b'{"')]
+
+
+@pytest.mark.parametrize(
+    "path",
+    ["test.c", "test_cpp.c"],
+)
+def test_ser_roundtrip(tmp_path, path):
+    bin_path = tmp_path / "unit.ast"
+    parsed = run_chocc("--ndjson", f"--emit-ast={bin_path}", path)
+    loaded = run_chocc("--ndjson", f"--load-ast={bin_path}")
+    assert parsed.returncode == 0 and loaded.returncode == 0
+    assert ast_lines(parsed.stdout)
+    assert ast_lines(parsed.stdout) == ast_lines(loaded.stdout)
+
+
+def test_ser_roundtrip_text(tmp_path):
+    bin_path = tmp_path / "unit.ast"
+    parsed = run_chocc(f"--emit-ast={bin_path}", "test.c")
+    loaded = run_chocc(f"--load-ast={bin_path}")
+    assert parsed.stdout.endswith(loaded.stdout)
+
+
+def test_ser_rejects_corrupt(tmp_path):
+    bin_path = tmp_path / "unit.ast"
+    run_chocc(f"--emit-ast={bin_path}", "test.c")
+    data = bin_path.read_bytes()
+    bin_path.write_bytes(data[: len(data) // 2])
+    assert run_chocc(f"--load-ast={bin_path}").returncode != 0
+    bin_path.write_bytes(b"CHOCCAST" + b"\xff" * (len(data) - 8))
+    assert run_chocc(f"--load-ast={bin_path}").returncode != 0
+
+
+def ser_corrupt(data, section, size, pick, field, value):
+    """Sets field of the first record in section that pick accepts"""
+    header = struct.unpack_from("=8s12i", data)
+    off, count = header[section], header[section + 1]
+    for i in range(count):
+        rec = struct.unpack_from(f"={size}i", data, off + 4 * size * i)
+        if pick(rec, i + 1):
+            out = bytearray(data)
+            struct.pack_into("=i", out, off + 4 * (size * i + field),
+                             value(rec, i + 1))
+            return bytes(out)
+    raise AssertionError("no record to corrupt")
+
+
+NODES, TYPES, EDGES = 5, 7, 9
+
+
+@pytest.mark.parametrize(
+    "section,size,pick,field,value",
+    [
+        # node kind
+        (NODES, 10, lambda r, i: True, 0, lambda r, i: 200),
+        # token kind of a Tok
+        (NODES, 10, lambda r, i: r[0] == 7, 1, lambda r, i: 100000),
+        # expr op
+        (NODES, 10, lambda r, i: r[0] == 8, 2, lambda r, i: -1),
+        # numeric base
+        (TYPES, 12, lambda r, i: r[0] == 0, 2, lambda r, i: 100000),
+        # storage class
+        (TYPES, 12, lambda r, i: True, 1, lambda r, i: 1 << 30),
+        # a pointer to itself
+        (TYPES, 12, lambda r, i: r[0] == 1, 4, lambda r, i: i),
+        # a Decl without its name and init
+        (NODES, 10, lambda r, i: r[0] == 5 and r[6] == 2, 6,
+         lambda r, i: 0),
+    ],
+    ids=["kind", "tok", "op", "base", "store", "inner-cycle", "kids"],
+)
+def test_ser_rejects_bad_fields(tmp_path, section, size, pick, field, value):
+    bin_path = tmp_path / "unit.ast"
+    run_chocc(f"--emit-ast={bin_path}", "test.c")
+    data = ser_corrupt(bin_path.read_bytes(), section, size, pick, field,
+                       value)
+    bin_path.write_bytes(data)
+    for fmt in [[], ["--json"]]:
+        loaded = run_chocc(*fmt, f"--load-ast={bin_path}")
+        assert loaded.returncode == 1
+        assert loaded.stdout.startswith(b"could not load")
+
+
+def test_ser_rejects_cycle(tmp_path):
+    """A List holding itself passes every field check"""
+    bin_path = tmp_path / "unit.ast"
+    run_chocc(f"--emit-ast={bin_path}", "test.c")
+    data = bin_path.read_bytes()
+    header = struct.unpack_from("=8s12i", data)
+    nodes, nodes_len, edges = header[NODES], header[NODES + 1], header[EDGES]
+    for i in range(nodes_len):
+        rec = struct.unpack_from("=10i", data, nodes + 40 * i)
+        if rec[0] == 9 and rec[6]:
+            break
+    out = bytearray(data)
+    struct.pack_into("=i", out, edges + 4 * rec[5], i + 1)
+    bin_path.write_bytes(out)
+    loaded = run_chocc(f"--load-ast={bin_path}")
+    assert loaded.returncode == 1
+    assert loaded.stdout.startswith(b"could not load")
+
+
+def test_ser_empty_json(tmp_path):
+    path = tmp_path / "empty.c"
+    path.write_text("")
+    bin_path = tmp_path / "empty.ast"
+    parsed = run_chocc("--json", "--dump-ast", f"--emit-ast={bin_path}",
+                       str(path))
+    loaded = run_chocc("--json", f"--load-ast={bin_path}")
+    assert parsed.stdout == loaded.stdout == b"[]\n"
@@ -0,0 +1,119 @@
+import json
+import os
+import subprocess
+import time
+
+
+def request(server, method, **params):
+    server.stdin.write(json.dumps({"jsonrpc": "2.0", "id": 1, "method": method,
+                                   "params": params}) + "\n")
+    server.stdin.flush()
+    return json.loads(server.stdout.readline())
+
+
+def test_server_cache(tmp_path):
+    path = tmp_path / "a.c"
+    path.write_text("int x;\n")
+    server = subprocess.Popen(["./chocc", "--serve"], stdin=subprocess.PIPE,
+                              stdout=subprocess.PIPE, text=True)
+    try:
+        assert request(server, "parse", path=str(path))["result"]["cached"] is False
+        assert request(server, "parse", path=str(path))["result"]["cached"] is True
+
+        # a new mtime with the same contents keeps the unit
+        os.utime(path, (0, 0))
+        assert request(server, "parse", path=str(path))["result"]["cached"] is True
+
+        path.write_text("int x, y;\n")
+        result = request(server, "parse", path=str(path))["result"]
+        assert result["cached"] is False and result["nodes"] == 2
+
+        tokens = request(server, "tokens", path=str(path))["result"]
+        assert [t["text"] for t in tokens] == ["int", "x", ",", "y", ";", ""]
+        assert [n["name"] for n in request(server, "ast", path=str(path))["result"]] == ["x", "y"]
+        assert request(server, "ast", path=str(tmp_path / "none.c"))["error"]
+    finally:
+        server.stdin.close()
+        server.wait()
+
+
+def test_server_compile_error(tmp_path):
+    path = tmp_path / "bad.c"
+    path.write_text("int x = ;;\n")
+    server = subprocess.Popen(["./chocc", "--serve"], stdin=subprocess.PIPE,
+                              stdout=subprocess.PIPE, text=True)
+    try:
+        for method in ("parse", "tokens", "ast", "ast"):
+            error = request(server, method, path=str(path))["error"]
+            assert error["code"] == -32001
+            assert "parsing error" in error["message"]
+
+        # run answers as chocc does, after the source and tokens
+        local = subprocess.run(["./chocc", str(path)], capture_output=True,
+                               text=True)
+        result = request(server, "run", args=[str(path)])["result"]
+        assert result["status"] == local.returncode == 1
+        assert result["output"] == local.stdout
+
+        path.write_text("int x = 1;\n")
+        assert request(server, "parse", path=str(path))["result"]["nodes"] == 1
+    finally:
+        server.stdin.close()
+        server.wait()
+    assert server.returncode == 0
+
+
+def test_server_cpp_error(tmp_path):
+    path = tmp_path / "undef.c"
+    path.write_text("#undef\nint x;\n")
+    server = subprocess.Popen(["./chocc", "--serve"], stdin=subprocess.PIPE,
+                              stdout=subprocess.PIPE, text=True)
+    try:
+        # the error comes before the unit has tokens to write
+        local = subprocess.run(["./chocc", str(path)], capture_output=True,
+                               text=True)
+        result = request(server, "run", args=[str(path)])["result"]
+        assert result["status"] == local.returncode == 1
+        assert result["output"] == local.stdout
+        assert request(server, "tokens", path=str(path))["error"]["code"] == -32001
+        assert request(server, "parse", path="test.c")["result"]["nodes"]
+    finally:
+        server.stdin.close()
+        server.wait()
+    assert server.returncode == 0
+
+
+def test_server_run_rejects_modes(tmp_path):
+    server = subprocess.Popen(["./chocc", "--serve"], stdin=subprocess.PIPE,
+                              stdout=subprocess.PIPE, text=True)
+    try:
+        usage = request(server, "run", args=[])["result"]["output"]
+        assert usage.startswith("usage:")
+        for args in (["--run"], ["--run=jit"], ["-j4"], ["--dump-ir"],
+                     ["--ir-stats"], ["--stats"], ["--trace=" + str(tmp_path / "t")],
+                     ["--emit-wasm=" + str(tmp_path / "a.wasm")],
+                     ["--emit-asm=" + str(tmp_path / "a.s")]):
+            result = request(server, "run", args=args + ["test.c"])["result"]
+            assert result == {"status": 1, "output": usage}, args
+    finally:
+        server.stdin.close()
+        server.wait()
+
+
+def test_server_client(tmp_path):
+    sock = str(tmp_path / "chocc.sock")
+    server = subprocess.Popen(["./chocc", "--serve=" + sock])
+    try:
+        for _ in range(100):
+            if os.path.exists(sock):
+                break
+            time.sleep(0.05)
+        env = dict(os.environ, CHOCC_SOCKET=sock)
+        for args in (["test.c"], ["--json", "test.c"], ["--decls", "test_cpp.c"]):
+            local = subprocess.run(["./chocc", *args], capture_output=True)
+            remote = subprocess.run(["./chocc-client", *args], capture_output=True, env=env)
+            assert remote.returncode == local.returncode
+            assert remote.stdout == local.stdout
+    finally:
+        server.terminate()
+        server.wait()
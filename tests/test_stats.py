@@ -0,0 +1,53 @@
+import json
+import subprocess
+
+SRC = """#define SQ(x) ((x) * (x))
+typedef struct pt { int x; int y; } pt;
+int f(pt *p) { return SQ(p->x) + p->y; }
+"""
+
+STAGES = ["load_file", "lex", "cpp_replace", "cpp_cond", "cpp_pragma",
+          "cpp_include", "filter_newline", "parse", "fold", "resolve",
+          "check", "write"]
+
+
+def test_stats(tmp_path):
+    path = tmp_path / "stats.c"
+    path.write_text(SRC)
+    plain = subprocess.run(["./chocc", str(path)], capture_output=True,
+                           check=True).stdout
+    out = subprocess.run(["./chocc", "--stats", str(path)],
+                         capture_output=True, check=True).stdout.decode()
+    assert out.startswith(plain.decode())
+    table = out[len(plain):].splitlines()
+    assert table[0].split() == ["stage", "wall", "cpu", "peak", "KB"]
+    assert [row.split()[0] for row in table[1:-2]] == STAGES + ["total"]
+    assert table[-2].startswith("4 lines, ")
+    assert table[-2].endswith(" 1 macros")
+
+
+def test_stats_json(tmp_path):
+    paths = []
+    for name in ["a.c", "b.c"]:
+        path = tmp_path / name
+        path.write_text(SRC)
+        paths.append(str(path))
+    out = subprocess.run(["./chocc", "--stats=json", *paths],
+                         capture_output=True, check=True).stdout.decode()
+    reports = [json.loads(line) for line in out.splitlines()
+               if line.startswith('{"file"')]
+    assert [r["file"] for r in reports] == paths
+    for r in reports:
+        assert [s["name"] for s in r["stages"]] == STAGES
+        assert all(s["wall"] >= 0 and s["peak_kb"] > 0 for s in r["stages"])
+        assert r["tokens_lexed"] > r["tokens"] > 0
+        assert r["macros"] == 1 and r["nodes"] > 0 and r["types"] > 0
+
+
+def test_stats_usage(tmp_path):
+    path = tmp_path / "stats.c"
+    path.write_text(SRC)
+    out = subprocess.run(["./chocc", "--stats", "--run", str(path)],
+                         capture_output=True)
+    assert out.returncode == 1
+    assert out.stdout.startswith(b"usage: ")
@@ -0,0 +1,58 @@
+import json
+import subprocess
+
+SRC = """#include <stdio.h>
+#define MANY(x) x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x
+int g[] = {MANY(1)};
+struct pt { int x; };
+int f(int a) { return a + 1; }
+int main(void) { return f(g[0]); }
+"""
+
+
+def trace(tmp_path, *args):
+    path = tmp_path / "trace.c"
+    path.write_text(SRC)
+    out = tmp_path / "out.json"
+    subprocess.run(["./chocc", "--trace=" + str(out), *args, str(path)],
+                   capture_output=True, check=True)
+    return json.loads(out.read_text())["traceEvents"]
+
+
+def within(inner, outer):
+    return (inner["tid"] == outer["tid"] and inner["ts"] >= outer["ts"] and
+            inner["ts"] + inner["dur"] <= outer["ts"] + outer["dur"])
+
+
+def test_trace(tmp_path):
+    events = trace(tmp_path)
+    spans = [e for e in events if e["ph"] == "X"]
+    unit = next(e for e in spans if e["cat"] == "unit")
+    assert unit["name"].endswith("trace.c")
+    stages = [e["name"] for e in spans if e["cat"] == "stage"]
+    assert stages[:3] == ["load_file", "lex", "cpp_replace"]
+    assert all(within(e, unit) for e in spans if e is not unit)
+
+    parse = next(e for e in spans if e["name"] == "parse")
+    decls = [e for e in spans if e["cat"] == "decl"]
+    assert [e["name"] for e in decls] == ["g", "Decl", "f", "main"]
+    assert all(within(e, parse) for e in decls)
+
+    macro = next(e for e in spans if e["cat"] == "macro")
+    assert macro["name"] == "MANY" and macro["args"]["tokens"] == 33
+    cpp = next(e for e in spans if e["name"] == "cpp_replace")
+    assert within(macro, cpp)
+
+    marks = [e for e in events if e["ph"] == "i"]
+    assert [(e["cat"], e["name"]) for e in marks] == [
+        ("include", "<stdio.h>")]
+
+
+def test_trace_parallel(tmp_path):
+    events = trace(tmp_path, "-j2")
+    bodies = [e for e in events if e["cat"] == "body"]
+    assert sorted(e["name"] for e in bodies) == ["f", "main"]
+    parse = next(e for e in events if e["name"] == "parse")
+    assert all(parse["ts"] <= e["ts"] <= parse["ts"] + parse["dur"]
+               for e in bodies)
+    assert {e["tid"] for e in bodies} <= {1, 2}
@@ -0,0 +1,38 @@
+import subprocess
+
+import pytest
+
+from test_run import SRC
+
+
+@pytest.mark.parametrize("program", ["fib", "sieve", "nbody", "matmul"])
+def test_emit_wasm_programs(tmp_path, program):
+    out_path = tmp_path / (program + ".wasm")
+    subprocess.run(["./chocc", "--emit-wasm=" + str(out_path),
+                    "bench/programs/" + program + ".c"],
+                   capture_output=True, check=True)
+    # validated by the loader before it is written
+    assert out_path.read_bytes()[:8] == b"\0asm\1\0\0\0"
+
+
+def test_emit_wasm(tmp_path):
+    path = tmp_path / "run.c"
+    path.write_text(SRC)
+    out_path = tmp_path / "run.wasm"
+    out = subprocess.run(["./chocc", "--emit-wasm=" + str(out_path),
+                          str(path)], capture_output=True)
+    assert out.returncode == 0
+    assert out.stdout == b""
+    assert b"main" in out_path.read_bytes()
+
+
+def test_run_wasm_traps(tmp_path):
+    path = tmp_path / "trap.c"
+    path.write_text("int main(void) {\n"
+                    "  int *p = (int *)100000000;\n"
+                    "  return *p;\n"
+                    "}\n")
+    out = subprocess.run(["./chocc", "--run=wasm", str(path)],
+                         capture_output=True)
+    assert out.stdout == b"run: out of bounds memory access\n"
+    assert out.returncode == 1
@@ -0,0 +1,51 @@
+import subprocess
+
+import pytest
+
+
+@pytest.mark.parametrize("program", ["fib", "sieve", "nbody", "matmul"])
+def test_emit_asm_programs(tmp_path, program):
+    asm = tmp_path / (program + ".s")
+    exe = tmp_path / program
+    subprocess.run(["./chocc", "--emit-asm=" + str(asm),
+                    "bench/programs/" + program + ".c"],
+                   capture_output=True, check=True)
+    subprocess.run(["cc", "-o", str(exe), str(asm), "-lm"], check=True)
+    ran = subprocess.run([str(exe)], capture_output=True, check=True).stdout
+    tree = subprocess.run(["./chocc", "--run=tree",
+                           "bench/programs/" + program + ".c"],
+                          capture_output=True, check=True).stdout
+    assert ran == tree
+
+
+def test_run_native_traps(tmp_path):
+    path = tmp_path / "div.c"
+    path.write_text("int zero;\n"
+                    "int main(void) {\n"
+                    "  printf(\"%d\\n\", 7 / (zero + 1));\n"
+                    "  return 1 / zero;\n"
+                    "}\n")
+    out = subprocess.run(["./chocc", "--run=native", str(path)],
+                         capture_output=True)
+    assert out.stdout == b"7\nrun: division by zero\n"
+    assert out.returncode == 1
+
+
+def test_run_native_args(tmp_path):
+    # more args than registers, of both classes, go on the stack
+    path = tmp_path / "args.c"
+    path.write_text("double f(int a, double b, int c, int d, int e, int f,\n"
+                    "         int g, int h, double i, double j, double k,\n"
+                    "         double l, double m, double n, double o,\n"
+                    "         double p) {\n"
+                    "  return a + b + c + d + e + f + g + h * 2 + i + j + k\n"
+                    "         + l + m + n + o + p * 3;\n"
+                    "}\n"
+                    "int main(void) {\n"
+                    "  printf(\"%.1f\\n\", f(1, 2, 3, 4, 5, 6, 7, 8, 9,\n"
+                    "                      10, 11, 12, 13, 14, 15, 16));\n"
+                    "  return 0;\n"
+                    "}\n")
+    out = subprocess.run(["./chocc", "--run=native", str(path)],
+                         capture_output=True, check=True)
+    assert out.stdout == b"176.0\n"
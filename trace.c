@@ -0,0 +1,116 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "trace.h"
+#include "io.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct trace {
+  FILE *f;
+  writer w;
+  double begin; /* seconds of the monotonic clock at trace_open */
+  bool any;     /* an event was written, so the next needs a comma */
+  int tids;
+  pthread_key_t tid; /* 1 + the id of each thread */
+  pthread_mutex_t lock;
+};
+
+/* Returns the seconds of the monotonic clock */
+double trace_clock(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct trace *trace_open(const char *path) {
+  struct trace *t;
+  FILE *f = fopen(path, "w");
+
+  if (!f) {
+    return NULL;
+  }
+  t = calloc(1, sizeof(*t));
+  t->f = f;
+  t->w = new_writer(f);
+  t->begin = trace_clock();
+  pthread_key_create(&t->tid, NULL);
+  pthread_mutex_init(&t->lock, NULL);
+  write_str(&t->w, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  return t;
+}
+
+bool trace_close(struct trace *t) {
+  bool ok;
+
+  write_str(&t->w, "\n]}\n");
+  free_writer(&t->w);
+  ok = !ferror(t->f);
+  ok = !fclose(t->f) && ok;
+  pthread_key_delete(t->tid);
+  pthread_mutex_destroy(&t->lock);
+  free(t);
+  return ok;
+}
+
+double trace_now(struct trace *t) {
+  return t ? (trace_clock() - t->begin) * 1e6 : 0;
+}
+
+/* Starts an event of phase ph at ts, with t locked until it is finished */
+void trace_event(struct trace *t, const char *cat, const char *name,
+                 char ph, double ts) {
+  char buf[64];
+  long tid = (long)pthread_getspecific(t->tid);
+
+  pthread_mutex_lock(&t->lock);
+  if (!tid) {
+    /* ids are handed out as threads first write */
+    tid = ++t->tids;
+    pthread_setspecific(t->tid, (void *)tid);
+  }
+  write_str(&t->w, t->any ? ",\n" : "\n");
+  t->any = true;
+  write_str(&t->w, "{\"cat\":");
+  write_json_str(&t->w, cat);
+  write_str(&t->w, ",\"name\":");
+  write_json_str(&t->w, name);
+  sprintf(buf, ",\"ph\":\"%c\",\"pid\":1,\"tid\":%ld,\"ts\":%.3f", ph, tid,
+          ts);
+  write_str(&t->w, buf);
+}
+
+void trace_span(struct trace *t, const char *cat, const char *name,
+                double begin, const char *key, long val) {
+  char buf[64];
+  double end;
+
+  if (!t) {
+    return;
+  }
+  end = trace_now(t);
+  trace_event(t, cat, name, 'X', begin);
+  sprintf(buf, ",\"dur\":%.3f", end - begin);
+  write_str(&t->w, buf);
+  if (key) {
+    write_str(&t->w, ",\"args\":{");
+    write_json_str(&t->w, key);
+    write_char(&t->w, ':');
+    write_long(&t->w, val);
+    write_char(&t->w, '}');
+  }
+  write_char(&t->w, '}');
+  pthread_mutex_unlock(&t->lock);
+}
+
+void trace_mark(struct trace *t, const char *cat, const char *name) {
+  if (!t) {
+    return;
+  }
+  trace_event(t, cat, name, 'i', trace_now(t));
+  write_str(&t->w, ",\"s\":\"t\"}");
+  pthread_mutex_unlock(&t->lock);
+}
@@ -0,0 +1,32 @@
+#ifndef CHOCC_TRACE_H
+#define CHOCC_TRACE_H
+#pragma once
+
+#include "chocc.h"
+
+/*
+ * trace writes spans of time as Chrome trace events, a JSON file trace
+ * viewers open. Spans on a thread nest by their times, and every thread
+ * writing one gets an id of its own. Writing is thread-safe.
+ */
+struct trace;
+
+/* Returns a trace writing to path, or NULL if it cannot be written */
+struct trace *trace_open(const char *path);
+/* Finishes the file. Returns false if it could not be written. */
+bool trace_close(struct trace *);
+
+/* Returns the microseconds since t was opened, or 0 if t is NULL */
+double trace_now(struct trace *t);
+
+/*
+ * Writes a span of category cat from begin, a trace_now, until now, with
+ * key, if not NULL, as its one argument. Does nothing if t is NULL, as
+ * trace_mark.
+ */
+void trace_span(struct trace *t, const char *cat, const char *name,
+                double begin, const char *key, long val);
+/* Writes an instant event */
+void trace_mark(struct trace *t, const char *cat, const char *name);
+
+#endif
@@ -1,4 +1,5 @@
 #include "unit.h"
+#include "alloc.h"
 
 #include <stdlib.h>
 
@@ -6,10 +7,10 @@ struct unit new_unit(void) {
   struct unit u = {0};
 
   u.nodes_cap = 64;
-  u.nodes = calloc(u.nodes_cap, sizeof(*u.nodes));
+  u.nodes = alloc_calloc(UnitAlloc, u.nodes_cap, sizeof(*u.nodes));
 
   u.toks_cap = 64;
-  u.toks = calloc(u.toks_cap, sizeof(*u.toks));
+  u.toks = alloc_calloc(UnitAlloc, u.toks_cap, sizeof(*u.toks));
 
   return u;
 }
@@ -17,7 +18,7 @@ struct unit new_unit(void) {
 void unit_append_tok(struct unit *u, token_t tok) {
   if (u->toks_len == u->toks_cap) {
     u->toks_cap *= 2;
-    u->toks = realloc(u->toks, u->toks_cap * sizeof(*u->toks));
+    u->toks = alloc_realloc(UnitAlloc, u->toks, u->toks_cap * sizeof(*u->toks));
   }
   u->toks[u->toks_len++] = tok;
 }
@@ -25,7 +26,17 @@ void unit_append_tok(struct unit *u, token_t tok) {
 void unit_append_node(struct unit *u, ast_node_t node) {
   if (u->nodes_len == u->nodes_cap) {
     u->nodes_cap *= 2;
-    u->nodes = realloc(u->nodes, u->nodes_cap * sizeof(*u->nodes));
+    u->nodes =
+        alloc_realloc(UnitAlloc, u->nodes, u->nodes_cap * sizeof(*u->nodes));
   }
   u->nodes[u->nodes_len++] = node;
 }
+
+void unit_append_item(struct unit *u, struct unit_item item) {
+  if (u->items_len == u->items_cap) {
+    u->items_cap = u->items_cap ? u->items_cap * 2 : 64;
+    u->items =
+        alloc_realloc(UnitAlloc, u->items, u->items_cap * sizeof(*u->items));
+  }
+  u->items[u->items_len++] = item;
+}
@@ -7,6 +7,36 @@
 #include "lex.h"
 #include "parse.h"
 
+/*
+ * unit_item is one top-level declaration or function definition: the tokens
+ * it was parsed from and the nodes it produced.
+ */
+struct unit_item {
+  int toks_begin; /* [begin, end) in toks */
+  int toks_end;
+  int nodes_begin; /* [begin, end) in nodes */
+  int nodes_end;
+  int ln_begin; /* physical lines, 0 if made only of macro expansions */
+  int ln_end;
+  int tdefs_begin; /* typedefs in scope before and after */
+  int tdefs_end;
+};
+
+/*
+ * unit_gap is where reparse leaves toks between edits, so that edits close
+ * together only move the tokens between them. The tokens from at on are
+ * stored len slots later and miss the line shifts of the edits before them,
+ * until reparse_flush.
+ */
+struct unit_gap {
+  int at;
+  int len;
+  int shift;   /* sum of the deltas, which every physical token misses */
+  int *shifts; /* last line and delta of each edit, for expanded tokens */
+  int shifts_len;
+  int shifts_cap;
+};
+
 struct unit {
   file *file;
 
@@ -18,11 +48,34 @@ struct unit {
   int nodes_len;
   int nodes_cap;
 
+  struct unit_item *items;
+  int items_len;
+  int items_cap;
+
+  /* typedefs visible after parsing */
+  ast_node_t *tdefs;
+  int tdefs_len;
+
+  /* declared names, set by resolve */
+  struct symbol *syms;
+  int syms_len;
+  int syms_cap;
+
+  /* preprocessor state, kept for reparsing */
+  char **macros;
+  int macros_len;
+  int *conds; /* first and last line of each top-level #if group */
+  int conds_len;
+  struct unit_gap gap;
+
   struct error *err;
+
+  struct stats *stats; /* where the stages are timed, or NULL */
 };
 
 struct unit new_unit(void);
 void unit_append_tok(struct unit *u, token_t tok);
 void unit_append_node(struct unit *u, ast_node_t node);
+void unit_append_item(struct unit *u, struct unit_item item);
 
 #endif
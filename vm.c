@@ -0,0 +1,1344 @@
+#include "vm.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Compilation
+ */
+
+/* the address b + c * k + x of a load or store */
+struct vm_addr {
+  int base;
+  int index;
+  long scale;
+  long off;
+};
+
+/* vm_gen is the state of compiling one function */
+struct vm_gen {
+  struct interp *in;
+  struct vm_fn *fn;
+  struct interp_fn *ifn;
+
+  int *slot_regs; /* by slot, -1 if kept in the frame */
+  int temps;      /* the first temporary, after the locals */
+  int temp;       /* the next free one */
+
+  int *labels; /* instruction indices by label */
+  int labels_len;
+  int brk; /* labels of the innermost loop or switch */
+  int cont;
+};
+
+struct vm_insn *vm_emit(struct vm_gen *g, vm_op op, int a, int b, int c) {
+  struct vm_fn *fn = g->fn;
+  struct vm_insn *i;
+
+  if (fn->len == fn->cap) {
+    fn->cap = fn->cap ? fn->cap * 2 : 64;
+    fn->code = realloc(fn->code, fn->cap * sizeof(*fn->code));
+  }
+  i = fn->code + fn->len++;
+  memset(i, 0, sizeof(*i));
+  i->op = op;
+  i->a = a;
+  i->b = b;
+  i->c = c;
+  return i;
+}
+
+int vm_temp(struct vm_gen *g) {
+  if (++g->temp > g->fn->regs) {
+    g->fn->regs = g->temp;
+  }
+  return g->temp - 1;
+}
+
+int vm_label(struct vm_gen *g) {
+  g->labels = realloc(g->labels, (g->labels_len + 1) * sizeof(int));
+  g->labels[g->labels_len] = -1;
+  return g->labels_len++;
+}
+
+void vm_place(struct vm_gen *g, int label) { g->labels[label] = g->fn->len; }
+
+void vm_jump(struct vm_gen *g, int label) { vm_emit(g, JmpV, 0, 0, label); }
+
+void vm_mov(struct vm_gen *g, int dst, int src) {
+  if (dst != src) {
+    vm_emit(g, MovV, dst, src, 0);
+  }
+}
+
+void vm_const(struct vm_gen *g, int dst, long k) {
+  vm_emit(g, ConstV, dst, 0, 0)->k.i = k;
+}
+
+/* Returns the register of the scalar at frame offset off, or -1 */
+int vm_slot_reg(struct vm_gen *g, long off) {
+  int i;
+  for (i = 0; i < g->ifn->slots_len; i++) {
+    if (g->ifn->slots[i].off == off) {
+      return g->slot_regs[i];
+    }
+  }
+  return -1;
+}
+
+/*
+ * Gives registers to the scalars slot_promotable allows. Params get theirs
+ * from VM_PARAMS, where their args arrive, and the others are spilled.
+ */
+void vm_promote(struct vm_gen *g) {
+  struct interp_fn *ifn = g->ifn;
+  struct frame_slot *s = ifn->slots;
+  bool *ok = slot_promotable(ifn);
+  int next = VM_PARAMS + ifn->params_len;
+  int i, j;
+
+  g->slot_regs = malloc((ifn->slots_len + 1) * sizeof(int));
+  for (i = 0; i < ifn->slots_len; i++) {
+    g->slot_regs[i] = ok[i] ? 0 : -1;
+  }
+  free(ok);
+
+  for (i = 0; i < ifn->slots_len; i++) {
+    if (i < ifn->params_len) {
+      if (g->slot_regs[i] < 0) {
+        g->fn->spills = realloc(g->fn->spills,
+                                (g->fn->spills_len + 1) * sizeof(int));
+        g->fn->spills[g->fn->spills_len++] = i;
+      } else {
+        g->slot_regs[i] = VM_PARAMS + i;
+      }
+      continue;
+    }
+    if (g->slot_regs[i] < 0) {
+      continue;
+    }
+    g->slot_regs[i] = next;
+    for (j = 0; j < i; j++) {
+      if (s[j].off == s[i].off) {
+        g->slot_regs[i] = g->slot_regs[j];
+        break;
+      }
+    }
+    if (g->slot_regs[i] == next) {
+      next++;
+    }
+  }
+  g->temps = g->temp = next;
+  g->fn->regs = next;
+}
+
+vm_op vm_load_op(val_kind k) {
+  switch (k) {
+  case I8V:
+    return LdI8V;
+  case U8V:
+    return LdU8V;
+  case I16V:
+    return LdI16V;
+  case U16V:
+    return LdU16V;
+  case I32V:
+    return LdI32V;
+  case U32V:
+    return LdU32V;
+  case F32V:
+    return LdF32V;
+  case F64V:
+    return LdF64V;
+  case AggV:
+    return LeaV;
+  default:
+    return Ld64V;
+  }
+}
+
+vm_op vm_store_op(val_kind k) {
+  switch (k) {
+  case I8V:
+  case U8V:
+    return St8V;
+  case I16V:
+  case U16V:
+    return St16V;
+  case I32V:
+  case U32V:
+    return St32V;
+  case F32V:
+    return StF32V;
+  case F64V:
+    return StF64V;
+  default:
+    return St64V;
+  }
+}
+
+/*
+ * Emits the extension of register r to integer kind k into dst, returning
+ * false if k is not narrower than 64 bits
+ */
+bool vm_ext(struct vm_gen *g, int dst, int r, val_kind k) {
+  switch (k) {
+  case I8V:
+    vm_emit(g, Sx8V, dst, r, 0);
+    return true;
+  case U8V:
+    vm_emit(g, Zx8V, dst, r, 0);
+    return true;
+  case I16V:
+    vm_emit(g, Sx16V, dst, r, 0);
+    return true;
+  case U16V:
+    vm_emit(g, Zx16V, dst, r, 0);
+    return true;
+  case I32V:
+    vm_emit(g, Sx32V, dst, r, 0);
+    return true;
+  case U32V:
+    vm_emit(g, Zx32V, dst, r, 0);
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* Normalizes register r to integer kind k */
+void vm_norm(struct vm_gen *g, int r, val_kind k) { vm_ext(g, r, r, k); }
+
+void vm_access(struct vm_gen *g, vm_op op, int a, struct vm_addr *m) {
+  struct vm_insn *i = vm_emit(g, op, a, m->base, m->index);
+  i->k.i = m->scale;
+  i->x = m->off;
+}
+
+int vm_expr(struct vm_gen *, struct inode *);
+void vm_expr_to(struct vm_gen *, struct inode *, int dst);
+void vm_effect(struct vm_gen *, struct inode *);
+
+/* Adds the address n computes to m, which has no base or index yet */
+void vm_address(struct vm_gen *g, struct inode *n, struct vm_addr *m) {
+  struct vm_addr sub;
+
+  switch (n->op) {
+  case GlobalOp:
+    m->off += (long)n->p;
+    return;
+  case LocalOp:
+    m->base = VM_FP;
+    m->off += n->x;
+    return;
+  case PtrAddOp:
+    if (n->b->op == ConstOp) {
+      m->off += n->b->k * n->k;
+      vm_address(g, n->a, m);
+      return;
+    }
+    memset(&sub, 0, sizeof(sub));
+    sub.base = sub.index = VM_ZERO;
+    vm_address(g, n->a, &sub);
+    if (sub.index == VM_ZERO) {
+      m->base = sub.base;
+      m->off += sub.off;
+    } else {
+      m->base = vm_temp(g);
+      vm_access(g, LeaV, m->base, &sub);
+    }
+    m->index = vm_expr(g, n->b);
+    m->scale = n->k;
+    return;
+  default:
+    m->base = vm_expr(g, n);
+    return;
+  }
+}
+
+void vm_address_of(struct vm_gen *g, struct inode *n, struct vm_addr *m) {
+  memset(m, 0, sizeof(*m));
+  m->base = m->index = VM_ZERO;
+  vm_address(g, n, m);
+}
+
+/* Compiles store n, returning the register of the value stored */
+int vm_store(struct vm_gen *g, struct inode *n) {
+  struct vm_addr m;
+  int r;
+
+  if (n->op == StoreLocalOp) {
+    if ((r = vm_slot_reg(g, n->x)) >= 0) {
+      vm_expr_to(g, n->b, r);
+      return r;
+    }
+    memset(&m, 0, sizeof(m));
+    m.base = VM_FP;
+    m.index = VM_ZERO;
+    m.off = n->x;
+  } else {
+    vm_address_of(g, n->a, &m);
+  }
+  r = vm_expr(g, n->b);
+  vm_access(g, vm_store_op(n->kind), r, &m);
+  return r;
+}
+
+/* Adds n->k, or n->f for floats, to register r of kind k */
+void vm_add_const(struct vm_gen *g, int r, struct inode *n) {
+  int t;
+
+  switch (n->kind) {
+  case F32V:
+  case F64V:
+    t = vm_temp(g);
+    vm_emit(g, ConstV, t, 0, 0)->k.d = n->f;
+    vm_emit(g, FAddV, r, r, t);
+    if (n->kind == F32V) {
+      vm_emit(g, FRoundV, r, r, 0);
+    }
+    return;
+  case I32V:
+    vm_emit(g, IncI32V, r, 0, 0)->k.i = n->k;
+    return;
+  default:
+    vm_emit(g, IncV, r, 0, 0)->k.i = n->k;
+    vm_norm(g, r, n->kind);
+    return;
+  }
+}
+
+/* Compiles increment n, into dst unless it is -1 */
+void vm_inc(struct vm_gen *g, struct inode *n, int dst) {
+  struct vm_addr m;
+  int r, old;
+
+  if (n->op == IncLocalOp && (r = vm_slot_reg(g, n->x)) >= 0) {
+    if (n->post && dst >= 0) {
+      vm_mov(g, dst, r);
+    }
+    vm_add_const(g, r, n);
+    if (!n->post && dst >= 0) {
+      vm_mov(g, dst, r);
+    }
+    return;
+  }
+
+  if (n->op == IncLocalOp) {
+    memset(&m, 0, sizeof(m));
+    m.base = VM_FP;
+    m.index = VM_ZERO;
+    m.off = n->x;
+  } else {
+    vm_address_of(g, n->a, &m);
+  }
+  old = vm_temp(g);
+  r = vm_temp(g);
+  vm_access(g, vm_load_op(n->kind), old, &m);
+  vm_mov(g, r, old);
+  vm_add_const(g, r, n);
+  vm_access(g, vm_store_op(n->kind), r, &m);
+  if (dst >= 0) {
+    vm_mov(g, dst, n->post ? old : r);
+  }
+}
+
+/* Compiles call n into dst, its args into the registers of the callee */
+void vm_call(struct vm_gen *g, struct inode *n, int dst) {
+  int fn = n->op == CallPtrOp ? vm_expr(g, n->a) : 0;
+  int args = g->temp + VM_PARAMS;
+  struct vm_insn *i;
+  int j;
+
+  /* builtins clear up to 3 args */
+  g->temp = args + (n->len > 3 ? n->len : 3);
+  if (g->temp > g->fn->regs) {
+    g->fn->regs = g->temp;
+  }
+  for (j = 0; j < n->len; j++) {
+    vm_expr_to(g, n->list[j], args + j);
+  }
+
+  switch (n->op) {
+  case CallOp:
+    i = vm_emit(g, CallV, dst, n->fn->id, args);
+    break;
+  case CallPtrOp:
+    i = vm_emit(g, CallPtrV, dst, fn, args);
+    break;
+  default:
+    i = vm_emit(g, BuiltinV, dst, n->k, args);
+    break;
+  }
+  i->x = n->len;
+}
+
+/* Converts register r from kind from to kind to, into dst */
+void vm_conv(struct vm_gen *g, int dst, int r, val_kind from, val_kind to) {
+  if (is_float_kind(to)) {
+    if (!is_float_kind(from)) {
+      vm_emit(g, is_unsigned_kind(from) ? UToFV : IToFV, dst, r, 0);
+      r = dst;
+    }
+    if (to == F32V) {
+      vm_emit(g, FRoundV, dst, r, 0);
+    } else {
+      vm_mov(g, dst, r);
+    }
+    return;
+  }
+  if (is_float_kind(from)) {
+    vm_emit(g, to == U64V ? FToUV : FToIV, dst, r, 0);
+    vm_norm(g, dst, to);
+    return;
+  }
+  if (!vm_ext(g, dst, r, to)) {
+    vm_mov(g, dst, r);
+  }
+}
+
+/* Compiles integer arithmetic n into dst */
+void vm_arith(struct vm_gen *g, struct inode *n, int dst) {
+  bool i32 = n->kind == I32V;
+  bool wide = n->kind == I64V || n->kind == U64V || n->kind == PtrV;
+  struct inode *a = n->a, *b = n->b;
+  vm_op op;
+  long k;
+  int ra;
+
+  if ((n->op == AddOp || n->op == SubOp) && (i32 || wide) &&
+      (b->op == ConstOp || (n->op == AddOp && a->op == ConstOp))) {
+    if (b->op != ConstOp) {
+      a = n->b;
+      b = n->a;
+    }
+    k = n->op == SubOp ? (long)-(unsigned long)b->k : b->k;
+    vm_emit(g, i32 ? AddKI32V : AddKV, dst, vm_expr(g, a), 0)->k.i = k;
+    return;
+  }
+
+  switch (n->op) {
+  case AddOp:
+    op = i32 ? AddI32V : AddV;
+    break;
+  case SubOp:
+    op = i32 ? SubI32V : SubV;
+    break;
+  case MulOp:
+    op = i32 ? MulI32V : MulV;
+    break;
+  case DivOp:
+    op = DivV;
+    break;
+  case UDivOp:
+    op = UDivV;
+    break;
+  case ModOp:
+    op = ModV;
+    break;
+  case UModOp:
+    op = UModV;
+    break;
+  case ShlOp:
+    op = ShlV;
+    break;
+  case ShrOp:
+    op = ShrV;
+    break;
+  case UShrOp:
+    op = UShrV;
+    break;
+  case AndOp:
+    op = AndV;
+    break;
+  case OrOp:
+    op = OrV;
+    break;
+  case XorOp:
+    op = XorV;
+    break;
+  case EqOp:
+    op = EqV;
+    break;
+  case NeOp:
+    op = NeV;
+    break;
+  case LtOp:
+    op = LtV;
+    break;
+  case LeOp:
+    op = LeV;
+    break;
+  case ULtOp:
+    op = ULtV;
+    break;
+  default: /* ULeOp */
+    op = ULeV;
+    break;
+  }
+  ra = vm_expr(g, a);
+  vm_emit(g, op, dst, ra, vm_expr(g, b));
+  if (op == AddV || op == SubV || op == MulV || op == DivV || op == UDivV ||
+      op == ModV || op == UModV || op == ShlV) {
+    vm_norm(g, dst, n->kind);
+  }
+}
+
+/* Compiles float arithmetic n into dst */
+void vm_float(struct vm_gen *g, struct inode *n, int dst) {
+  int a = vm_expr(g, n->a);
+  int b = vm_expr(g, n->b);
+
+  switch (n->op) {
+  case FAddOp:
+    vm_emit(g, FAddV, dst, a, b);
+    break;
+  case FSubOp:
+    vm_emit(g, FSubV, dst, a, b);
+    break;
+  case FMulOp:
+    vm_emit(g, FMulV, dst, a, b);
+    break;
+  case FDivOp:
+    vm_emit(g, FDivV, dst, a, b);
+    break;
+  case FEqOp:
+    vm_emit(g, FEqV, dst, a, b);
+    return;
+  case FNeOp:
+    vm_emit(g, FNeV, dst, a, b);
+    return;
+  case FLtOp:
+    vm_emit(g, FLtV, dst, a, b);
+    return;
+  default: /* FLeOp */
+    vm_emit(g, FLeV, dst, a, b);
+    return;
+  }
+  /* rounded to float */
+  if (n->kind == F32V) {
+    vm_emit(g, FRoundV, dst, dst, 0);
+  }
+}
+
+/* Emits a jump to label if the comparison n is when */
+void vm_jump_cmp(struct vm_gen *g, struct inode *n, bool when, int label) {
+  bool is_signed = n->op != ULtOp && n->op != ULeOp;
+  vm_op op;
+  int a, b;
+
+  if (is_signed && (n->b->op == ConstOp || n->a->op == ConstOp)) {
+    bool swap = n->b->op != ConstOp;
+    switch (n->op) {
+    case EqOp:
+      op = when ? JEqKV : JNeKV;
+      break;
+    case NeOp:
+      op = when ? JNeKV : JEqKV;
+      break;
+    case LtOp:
+      /* k < a is a > k */
+      op = swap ? (when ? JGtKV : JLeKV) : (when ? JLtKV : JGeKV);
+      break;
+    default: /* LeOp */
+      op = swap ? (when ? JGeKV : JLtKV) : (when ? JLeKV : JGtKV);
+      break;
+    }
+    a = vm_expr(g, swap ? n->b : n->a);
+    vm_emit(g, op, a, 0, label)->k.i = swap ? n->a->k : n->b->k;
+    return;
+  }
+
+  a = vm_expr(g, n->a);
+  b = vm_expr(g, n->b);
+  switch (n->op) {
+  case EqOp:
+    vm_emit(g, when ? JEqV : JNeV, a, b, label);
+    return;
+  case NeOp:
+    vm_emit(g, when ? JNeV : JEqV, a, b, label);
+    return;
+  /* !(a < b) is b <= a */
+  case LtOp:
+    vm_emit(g, when ? JLtV : JLeV, when ? a : b, when ? b : a, label);
+    return;
+  case LeOp:
+    vm_emit(g, when ? JLeV : JLtV, when ? a : b, when ? b : a, label);
+    return;
+  case ULtOp:
+    vm_emit(g, when ? JULtV : JULeV, when ? a : b, when ? b : a, label);
+    return;
+  default: /* ULeOp */
+    vm_emit(g, when ? JULeV : JULtV, when ? a : b, when ? b : a, label);
+    return;
+  }
+}
+
+/* Emits a jump to label if condition n is when */
+void vm_jump_if(struct vm_gen *g, struct inode *n, bool when, int label) {
+  int skip;
+
+  switch (n->op) {
+  case ConstOp:
+    if ((n->k != 0) == when) {
+      vm_jump(g, label);
+    }
+    return;
+  case NotOp:
+    vm_jump_if(g, n->a, !when, label);
+    return;
+  case LogAndOp:
+  case LogOrOp:
+    /* a && b is false if a is, a || b is true if a is */
+    if (when == (n->op == LogOrOp)) {
+      vm_jump_if(g, n->a, when, label);
+      vm_jump_if(g, n->b, when, label);
+      return;
+    }
+    skip = vm_label(g);
+    vm_jump_if(g, n->a, !when, skip);
+    vm_jump_if(g, n->b, when, label);
+    vm_place(g, skip);
+    return;
+  case EqOp:
+  case NeOp:
+  case LtOp:
+  case LeOp:
+  case ULtOp:
+  case ULeOp:
+    vm_jump_cmp(g, n, when, label);
+    return;
+  default:
+    vm_emit(g, when ? JnzV : JzV, vm_expr(g, n), 0, label);
+    return;
+  }
+}
+
+/* Returns a register holding the value of n */
+int vm_expr(struct vm_gen *g, struct inode *n) {
+  int r;
+
+  if (n->op == LoadLocalOp && (r = vm_slot_reg(g, n->x)) >= 0) {
+    return r;
+  }
+  if (n->op == ConstOp && !n->k) {
+    return VM_ZERO;
+  }
+  r = vm_temp(g);
+  vm_expr_to(g, n, r);
+  return r;
+}
+
+void vm_expr_to(struct vm_gen *g, struct inode *n, int dst) {
+  struct vm_addr m;
+  int a, label, end;
+
+  switch (n->op) {
+  case ConstOp:
+    vm_const(g, dst, n->k);
+    return;
+  case FConstOp:
+    vm_emit(g, ConstV, dst, 0, 0)->k.d = n->f;
+    return;
+  case LocalOp:
+    vm_emit(g, AddKV, dst, VM_FP, 0)->k.i = n->x;
+    return;
+  case GlobalOp:
+    vm_const(g, dst, (long)n->p);
+    return;
+  case FnOp:
+    vm_const(g, dst, (long)n->fn);
+    return;
+  case LoadOp:
+    vm_address_of(g, n->a, &m);
+    vm_access(g, vm_load_op(n->kind), dst, &m);
+    return;
+  case LoadLocalOp:
+    if ((a = vm_slot_reg(g, n->x)) >= 0) {
+      vm_mov(g, dst, a);
+      return;
+    }
+    memset(&m, 0, sizeof(m));
+    m.base = VM_FP;
+    m.index = VM_ZERO;
+    m.off = n->x;
+    vm_access(g, vm_load_op(n->kind), dst, &m);
+    return;
+  case StoreOp:
+  case StoreLocalOp:
+    vm_mov(g, dst, vm_store(g, n));
+    return;
+  case CopyOp:
+    a = vm_expr(g, n->a);
+    vm_emit(g, CopyV, a, vm_expr(g, n->b), 0)->x = n->k;
+    vm_mov(g, dst, a);
+    return;
+  case ConvOp:
+    vm_conv(g, dst, vm_expr(g, n->a), n->x, n->kind);
+    return;
+
+  case AddOp:
+  case SubOp:
+  case MulOp:
+  case DivOp:
+  case UDivOp:
+  case ModOp:
+  case UModOp:
+  case ShlOp:
+  case ShrOp:
+  case UShrOp:
+  case AndOp:
+  case OrOp:
+  case XorOp:
+  case EqOp:
+  case NeOp:
+  case LtOp:
+  case LeOp:
+  case ULtOp:
+  case ULeOp:
+    vm_arith(g, n, dst);
+    return;
+  case NegOp:
+  case ComplOp:
+    vm_emit(g, n->op == NegOp ? NegV : ComplV, dst, vm_expr(g, n->a), 0);
+    vm_norm(g, dst, n->kind);
+    return;
+
+  case FAddOp:
+  case FSubOp:
+  case FMulOp:
+  case FDivOp:
+  case FEqOp:
+  case FNeOp:
+  case FLtOp:
+  case FLeOp:
+    vm_float(g, n, dst);
+    return;
+  case FNegOp:
+    vm_emit(g, FNegV, dst, vm_expr(g, n->a), 0);
+    return;
+
+  case PtrAddOp:
+    vm_address_of(g, n, &m);
+    vm_access(g, LeaV, dst, &m);
+    return;
+  case PtrDiffOp:
+    a = vm_expr(g, n->a);
+    vm_emit(g, PtrDiffV, dst, a, vm_expr(g, n->b))->k.i = n->k;
+    return;
+  case NotOp:
+    vm_emit(g, NotV, dst, vm_expr(g, n->a), 0);
+    return;
+  case LogAndOp:
+  case LogOrOp:
+    label = vm_label(g);
+    end = vm_label(g);
+    vm_jump_if(g, n, false, label);
+    vm_const(g, dst, 1);
+    vm_jump(g, end);
+    vm_place(g, label);
+    vm_const(g, dst, 0);
+    vm_place(g, end);
+    return;
+  case CondOp:
+    label = vm_label(g);
+    end = vm_label(g);
+    vm_jump_if(g, n->a, false, label);
+    vm_expr_to(g, n->b, dst);
+    vm_jump(g, end);
+    vm_place(g, label);
+    vm_expr_to(g, n->c, dst);
+    vm_place(g, end);
+    return;
+  case SeqOp:
+    vm_effect(g, n->a);
+    vm_expr_to(g, n->b, dst);
+    return;
+  case IncOp:
+  case IncLocalOp:
+    vm_inc(g, n, dst);
+    return;
+  case CallOp:
+  case CallPtrOp:
+  case BuiltinOp:
+    vm_call(g, n, dst);
+    return;
+  default:
+    interp_fail(g->in, "not an expression", NULL);
+  }
+}
+
+/* Compiles n for its side effects */
+void vm_effect(struct vm_gen *g, struct inode *n) {
+  switch (n->op) {
+  case StoreOp:
+  case StoreLocalOp:
+    vm_store(g, n);
+    return;
+  case IncOp:
+  case IncLocalOp:
+    vm_inc(g, n, -1);
+    return;
+  case SeqOp:
+    vm_effect(g, n->a);
+    vm_effect(g, n->b);
+    return;
+  default:
+    vm_expr_to(g, n, vm_temp(g));
+    return;
+  }
+}
+
+void vm_stmt(struct vm_gen *, struct inode *);
+
+/* Compiles a loop body, its condition after it so a pass takes one jump */
+void vm_loop(struct vm_gen *g, struct inode *cond, struct inode *iter,
+             struct inode *body, bool test_first) {
+  int brk = g->brk, cont = g->cont;
+  int top = vm_label(g), test = vm_label(g);
+
+  g->brk = vm_label(g);
+  g->cont = iter ? vm_label(g) : test;
+  if (test_first) {
+    vm_jump(g, test);
+  }
+  vm_place(g, top);
+  vm_stmt(g, body);
+  if (iter) {
+    vm_place(g, g->cont);
+    g->temp = g->temps;
+    vm_effect(g, iter);
+  }
+  vm_place(g, test);
+  g->temp = g->temps;
+  if (cond) {
+    vm_jump_if(g, cond, true, top);
+  } else {
+    vm_jump(g, top);
+  }
+  vm_place(g, g->brk);
+
+  g->brk = brk;
+  g->cont = cont;
+}
+
+void vm_switch(struct vm_gen *g, struct inode *n) {
+  int brk = g->brk;
+  int *cases = malloc((n->cases_len + 1) * sizeof(int));
+  int dflt = vm_label(g);
+  int v = vm_expr(g, n->a);
+  int i, j;
+
+  /* the first case matching is taken, as in exec */
+  g->brk = vm_label(g);
+  for (i = 0; i < n->cases_len; i++) {
+    cases[i] = vm_label(g);
+    vm_emit(g, JEqKV, v, 0, cases[i])->k.i = n->cases[i];
+  }
+  vm_jump(g, dflt);
+
+  for (i = 0; i <= n->d->len; i++) {
+    for (j = 0; j < n->cases_len; j++) {
+      if (n->case_at[j] == i) {
+        vm_place(g, cases[j]);
+      }
+    }
+    if (n->default_at == i) {
+      vm_place(g, dflt);
+    }
+    if (i < n->d->len) {
+      vm_stmt(g, n->d->list[i]);
+    }
+  }
+  vm_place(g, g->brk);
+
+  g->brk = brk;
+  free(cases);
+}
+
+void vm_stmt(struct vm_gen *g, struct inode *n) {
+  int label, end;
+  int i;
+
+  /* temporaries live within a statement */
+  g->temp = g->temps;
+
+  switch (n->op) {
+  case NopOp:
+    return;
+  case ExprOp:
+    vm_effect(g, n->a);
+    return;
+  case BlockOp:
+    for (i = 0; i < n->len; i++) {
+      vm_stmt(g, n->list[i]);
+    }
+    return;
+  case IfOp:
+    label = vm_label(g);
+    vm_jump_if(g, n->a, false, label);
+    vm_stmt(g, n->b);
+    if (n->c) {
+      end = vm_label(g);
+      vm_jump(g, end);
+      vm_place(g, label);
+      vm_stmt(g, n->c);
+      vm_place(g, end);
+    } else {
+      vm_place(g, label);
+    }
+    return;
+  case WhileOp:
+    vm_loop(g, n->a, NULL, n->b, true);
+    return;
+  case DoOp:
+    vm_loop(g, n->a, NULL, n->b, false);
+    return;
+  case ForOp:
+    if (n->a) {
+      vm_effect(g, n->a);
+    }
+    vm_loop(g, n->b, n->c, n->d, true);
+    return;
+  case SwitchOp:
+    vm_switch(g, n);
+    return;
+  case BreakOp:
+    vm_jump(g, g->brk);
+    return;
+  case ContinueOp:
+    vm_jump(g, g->cont);
+    return;
+  case ReturnOp:
+    if (n->a) {
+      vm_emit(g, RetV, vm_expr(g, n->a), 0, 0);
+    } else {
+      vm_emit(g, RetVoidV, 0, 0, 0);
+    }
+    return;
+  case ZeroOp:
+    label = vm_temp(g);
+    vm_emit(g, AddKV, label, VM_FP, 0)->k.i = n->x;
+    vm_emit(g, ZeroV, label, 0, 0)->x = n->k;
+    return;
+  default:
+    vm_effect(g, n);
+    return;
+  }
+}
+
+struct vm_fn *vm_compile(struct interp *in, struct interp_fn *ifn) {
+  struct vm_gen g;
+  struct vm_fn *fn = calloc(1, sizeof(*fn));
+  int i;
+
+  memset(&g, 0, sizeof(g));
+  g.in = in;
+  g.fn = fn;
+  g.ifn = ifn;
+  g.brk = g.cont = -1;
+  fn->fn = ifn;
+
+  vm_promote(&g);
+  vm_stmt(&g, ifn->body);
+  vm_emit(&g, RetVoidV, 0, 0, 0);
+
+  for (i = 0; i < fn->len; i++) {
+    if (JmpV <= fn->code[i].op && fn->code[i].op <= JGeKV) {
+      fn->code[i].c = g.labels[fn->code[i].c];
+    }
+  }
+  free(g.labels);
+  free(g.slot_regs);
+  return fn;
+}
+
+struct vm *vm_load(struct interp *in) {
+  struct vm *vm = calloc(1, sizeof(*vm));
+  int i;
+
+  vm->in = in;
+  vm->fns_len = in->fns_len;
+  vm->fns = calloc(in->fns_len + 1, sizeof(*vm->fns));
+  for (i = 0; i < in->fns_len; i++) {
+    vm->fns[i] = vm_compile(in, in->fns[i]);
+  }
+  return vm;
+}
+
+/*
+ * Execution
+ */
+
+/* Enters fn with its args in regs, reserving its frame */
+void vm_enter(struct vm *vm, struct vm_fn *fn, value *regs) {
+  struct interp *in = vm->in;
+  struct interp_fn *f = fn->fn;
+  int i;
+
+  if (regs + fn->regs > vm->regs_end ||
+      in->sp + f->frame_size > in->stack_end) {
+    interp_fail(in, "stack overflow in", f->name);
+  }
+  regs[VM_FP].i = (long)in->sp;
+  regs[VM_ZERO].i = 0;
+  for (i = 0; i < fn->spills_len; i++) {
+    int p = fn->spills[i];
+    char *at = in->sp + f->param_off[p];
+
+    if (f->param_kind[p] == AggV) {
+      memcpy(at, (char *)regs[VM_PARAMS + p].i, f->param_size[p]);
+    } else {
+      store(f->param_kind[p], at, regs[VM_PARAMS + p]);
+    }
+  }
+  in->sp += f->frame_size;
+}
+
+/* Returns the function fn points to, called with len args */
+struct vm_fn *vm_callee(struct vm *vm, struct interp_fn *fn, long len) {
+  if (!fn) {
+    interp_fail(vm->in, "call through a null pointer", NULL);
+  }
+  if (len < fn->params_len) {
+    interp_fail(vm->in, "wrong number of arguments to", fn->name);
+  }
+  return vm->fns[fn->id];
+}
+
+#define R(r) regs[r].i
+#define U(r) ((unsigned long)regs[r].i)
+#define F(r) regs[r].d
+#define ADDR(i) ((char *)(R(i->b) + R(i->c) * i->k.i + i->x))
+#define JUMP_IF(cond)                                                          \
+  if (cond) {                                                                  \
+    pc = code + i->c;                                                          \
+  }                                                                            \
+  break
+
+/* Runs fn with its args in regs until it returns */
+value vm_exec(struct vm *vm, struct vm_fn *fn, value *regs) {
+  struct interp *in = vm->in;
+  struct vm_frame *frame = vm->frames;
+  struct vm_insn *code, *pc, *i;
+  value v;
+
+  vm_enter(vm, fn, regs);
+  code = pc = fn->code;
+  for (;;) {
+    i = pc++;
+    switch (i->op) {
+    case ConstV:
+      regs[i->a] = i->k;
+      break;
+    case MovV:
+      regs[i->a] = regs[i->b];
+      break;
+    case LeaV:
+      R(i->a) = (long)ADDR(i);
+      break;
+
+    case LdI8V:
+      R(i->a) = *(signed char *)ADDR(i);
+      break;
+    case LdU8V:
+      R(i->a) = *(unsigned char *)ADDR(i);
+      break;
+    case LdI16V:
+      R(i->a) = *(short *)ADDR(i);
+      break;
+    case LdU16V:
+      R(i->a) = *(unsigned short *)ADDR(i);
+      break;
+    case LdI32V:
+      R(i->a) = *(int *)ADDR(i);
+      break;
+    case LdU32V:
+      R(i->a) = *(unsigned int *)ADDR(i);
+      break;
+    case Ld64V:
+      R(i->a) = *(long *)ADDR(i);
+      break;
+    case LdF32V:
+      F(i->a) = *(float *)ADDR(i);
+      break;
+    case LdF64V:
+      F(i->a) = *(double *)ADDR(i);
+      break;
+    case St8V:
+      *(char *)ADDR(i) = (char)R(i->a);
+      break;
+    case St16V:
+      *(short *)ADDR(i) = (short)R(i->a);
+      break;
+    case St32V:
+      *(int *)ADDR(i) = (int)R(i->a);
+      break;
+    case St64V:
+      *(long *)ADDR(i) = R(i->a);
+      break;
+    case StF32V:
+      *(float *)ADDR(i) = (float)F(i->a);
+      break;
+    case StF64V:
+      *(double *)ADDR(i) = F(i->a);
+      break;
+    case CopyV:
+      memmove((char *)R(i->a), (char *)R(i->b), i->x);
+      break;
+    case ZeroV:
+      memset((char *)R(i->a), 0, i->x);
+      break;
+
+    case AddV:
+      R(i->a) = (long)(U(i->b) + U(i->c));
+      break;
+    case SubV:
+      R(i->a) = (long)(U(i->b) - U(i->c));
+      break;
+    case MulV:
+      R(i->a) = (long)(U(i->b) * U(i->c));
+      break;
+    case DivV:
+    case ModV:
+      if (!R(i->c)) {
+        interp_fail(in, "division by zero", NULL);
+      }
+      if (R(i->c) == -1) {
+        /* LONG_MIN / -1 traps */
+        R(i->a) = i->op == DivV ? (long)-U(i->b) : 0;
+      } else {
+        R(i->a) = i->op == DivV ? R(i->b) / R(i->c) : R(i->b) % R(i->c);
+      }
+      break;
+    case UDivV:
+    case UModV:
+      if (!R(i->c)) {
+        interp_fail(in, "division by zero", NULL);
+      }
+      R(i->a) = (long)(i->op == UDivV ? U(i->b) / U(i->c) : U(i->b) % U(i->c));
+      break;
+    case ShlV:
+      R(i->a) = (long)(U(i->b) << (R(i->c) & 63));
+      break;
+    case ShrV:
+      R(i->a) = R(i->b) >> (R(i->c) & 63);
+      break;
+    case UShrV:
+      R(i->a) = (long)(U(i->b) >> (R(i->c) & 63));
+      break;
+    case AndV:
+      R(i->a) = R(i->b) & R(i->c);
+      break;
+    case OrV:
+      R(i->a) = R(i->b) | R(i->c);
+      break;
+    case XorV:
+      R(i->a) = R(i->b) ^ R(i->c);
+      break;
+    case EqV:
+      R(i->a) = R(i->b) == R(i->c);
+      break;
+    case NeV:
+      R(i->a) = R(i->b) != R(i->c);
+      break;
+    case LtV:
+      R(i->a) = R(i->b) < R(i->c);
+      break;
+    case LeV:
+      R(i->a) = R(i->b) <= R(i->c);
+      break;
+    case ULtV:
+      R(i->a) = U(i->b) < U(i->c);
+      break;
+    case ULeV:
+      R(i->a) = U(i->b) <= U(i->c);
+      break;
+    case AddI32V:
+      R(i->a) = (int)(U(i->b) + U(i->c));
+      break;
+    case SubI32V:
+      R(i->a) = (int)(U(i->b) - U(i->c));
+      break;
+    case MulI32V:
+      R(i->a) = (int)(U(i->b) * U(i->c));
+      break;
+    case AddKV:
+      R(i->a) = (long)(U(i->b) + (unsigned long)i->k.i);
+      break;
+    case AddKI32V:
+      R(i->a) = (int)(U(i->b) + (unsigned long)i->k.i);
+      break;
+    case PtrDiffV:
+      R(i->a) = (R(i->b) - R(i->c)) / i->k.i;
+      break;
+
+    case NegV:
+      R(i->a) = (long)-U(i->b);
+      break;
+    case ComplV:
+      R(i->a) = ~R(i->b);
+      break;
+    case NotV:
+      R(i->a) = !R(i->b);
+      break;
+    case Sx8V:
+      R(i->a) = (signed char)R(i->b);
+      break;
+    case Zx8V:
+      R(i->a) = (unsigned char)R(i->b);
+      break;
+    case Sx16V:
+      R(i->a) = (short)R(i->b);
+      break;
+    case Zx16V:
+      R(i->a) = (unsigned short)R(i->b);
+      break;
+    case Sx32V:
+      R(i->a) = (int)R(i->b);
+      break;
+    case Zx32V:
+      R(i->a) = (unsigned int)R(i->b);
+      break;
+
+    case FAddV:
+      F(i->a) = F(i->b) + F(i->c);
+      break;
+    case FSubV:
+      F(i->a) = F(i->b) - F(i->c);
+      break;
+    case FMulV:
+      F(i->a) = F(i->b) * F(i->c);
+      break;
+    case FDivV:
+      F(i->a) = F(i->b) / F(i->c);
+      break;
+    case FEqV:
+      R(i->a) = F(i->b) == F(i->c);
+      break;
+    case FNeV:
+      R(i->a) = F(i->b) != F(i->c);
+      break;
+    case FLtV:
+      R(i->a) = F(i->b) < F(i->c);
+      break;
+    case FLeV:
+      R(i->a) = F(i->b) <= F(i->c);
+      break;
+    case FNegV:
+      F(i->a) = -F(i->b);
+      break;
+    case FRoundV:
+      F(i->a) = (float)F(i->b);
+      break;
+    case IToFV:
+      F(i->a) = (double)R(i->b);
+      break;
+    case UToFV:
+      F(i->a) = (double)U(i->b);
+      break;
+    case FToIV:
+      R(i->a) = (long)F(i->b);
+      break;
+    case FToUV:
+      R(i->a) = (long)(unsigned long)F(i->b);
+      break;
+
+    case JmpV:
+      pc = code + i->c;
+      break;
+    case JzV:
+      JUMP_IF(!R(i->a));
+    case JnzV:
+      JUMP_IF(R(i->a));
+    case JEqV:
+      JUMP_IF(R(i->a) == R(i->b));
+    case JNeV:
+      JUMP_IF(R(i->a) != R(i->b));
+    case JLtV:
+      JUMP_IF(R(i->a) < R(i->b));
+    case JLeV:
+      JUMP_IF(R(i->a) <= R(i->b));
+    case JULtV:
+      JUMP_IF(U(i->a) < U(i->b));
+    case JULeV:
+      JUMP_IF(U(i->a) <= U(i->b));
+    case JEqKV:
+      JUMP_IF(R(i->a) == i->k.i);
+    case JNeKV:
+      JUMP_IF(R(i->a) != i->k.i);
+    case JLtKV:
+      JUMP_IF(R(i->a) < i->k.i);
+    case JLeKV:
+      JUMP_IF(R(i->a) <= i->k.i);
+    case JGtKV:
+      JUMP_IF(R(i->a) > i->k.i);
+    case JGeKV:
+      JUMP_IF(R(i->a) >= i->k.i);
+
+    case IncV:
+      R(i->a) = (long)(U(i->a) + (unsigned long)i->k.i);
+      break;
+    case IncI32V:
+      R(i->a) = (int)(U(i->a) + (unsigned long)i->k.i);
+      break;
+
+    case CallV:
+    case CallPtrV:
+      fn = i->op == CallV
+               ? vm->fns[i->b]
+               : vm_callee(vm, (struct interp_fn *)R(i->b), i->x);
+      if (frame == vm->frames_end) {
+        interp_fail(in, "stack overflow in", fn->fn->name);
+      }
+      frame->call = i;
+      frame->code = code;
+      frame->regs = regs;
+      frame++;
+      regs += i->c - VM_PARAMS;
+      vm_enter(vm, fn, regs);
+      code = pc = fn->code;
+      break;
+    case BuiltinV:
+      regs[i->a] = builtin_call(in, i->b, regs + i->c, i->x);
+      break;
+    case RetV:
+    case RetVoidV:
+      if (i->op == RetV) {
+        v = regs[i->a];
+      } else {
+        v.i = 0;
+      }
+      in->sp = (char *)R(VM_FP);
+      if (frame == vm->frames) {
+        return v;
+      }
+      frame--;
+      code = frame->code;
+      regs = frame->regs;
+      pc = frame->call + 1;
+      regs[frame->call->a] = v;
+      break;
+    }
+  }
+}
+
+int vm_run(struct vm *vm, int argc, char **argv) {
+  struct interp *in = vm->in;
+  struct interp_fn *main_fn = interp_main(in);
+  value v;
+
+  interp_init(in);
+  if (!vm->regs) {
+    vm->regs = calloc(VM_REGS, sizeof(value));
+    vm->regs_end = vm->regs + VM_REGS;
+    vm->frames = calloc(VM_FRAMES, sizeof(struct vm_frame));
+    vm->frames_end = vm->frames + VM_FRAMES;
+  }
+
+  vm->regs[VM_PARAMS].i = argc;
+  vm->regs[VM_PARAMS + 1].i = (long)argv;
+  v = vm_exec(vm, vm->fns[main_fn->id], vm->regs);
+  fflush(in->out);
+  return main_fn->ret_kind == VoidV ? 0 : (int)v.i;
+}
@@ -0,0 +1,189 @@
+#ifndef CHOCC_VM_H
+#define CHOCC_VM_H
+#pragma once
+
+#include "chocc.h"
+#include "interp.h"
+
+/*
+ * vm_op enumerates the instructions of the bytecode. Operands a, b and c are
+ * registers unless noted, k is an immediate and x an offset or length.
+ * Memory is addressed as b + c * k + x, register 1 being 0 for an unused
+ * base or index. Integer results are 64 bit unless the op is of a width.
+ */
+typedef enum vm_op {
+  ConstV, /* a = k */
+  MovV,   /* a = b */
+  LeaV,   /* a = the address */
+
+  /* a = the value of a kind at the address */
+  LdI8V,
+  LdU8V,
+  LdI16V,
+  LdU16V,
+  LdI32V,
+  LdU32V,
+  Ld64V,
+  LdF32V,
+  LdF64V,
+
+  /* stores a of a width at the address */
+  St8V,
+  St16V,
+  St32V,
+  St64V,
+  StF32V,
+  StF64V,
+
+  CopyV, /* copies x bytes from b to a */
+  ZeroV, /* clears x bytes at a */
+
+  /* a = b op c */
+  AddV,
+  SubV,
+  MulV,
+  DivV,
+  UDivV,
+  ModV,
+  UModV,
+  ShlV,
+  ShrV,
+  UShrV,
+  AndV,
+  OrV,
+  XorV,
+  EqV,
+  NeV,
+  LtV,
+  LeV,
+  ULtV,
+  ULeV,
+  AddI32V, /* a = b + c as an int */
+  SubI32V,
+  MulI32V,
+  AddKV,    /* a = b + k */
+  AddKI32V, /* a = b + k as an int */
+  PtrDiffV, /* a = (b - c) / k */
+
+  /* a = op b */
+  NegV,
+  ComplV,
+  NotV,
+  Sx8V, /* sign or zero extensions from a width */
+  Zx8V,
+  Sx16V,
+  Zx16V,
+  Sx32V,
+  Zx32V,
+
+  FAddV,
+  FSubV,
+  FMulV,
+  FDivV,
+  FEqV,
+  FNeV,
+  FLtV,
+  FLeV,
+  FNegV,
+  FRoundV, /* a = b rounded to float */
+  IToFV,
+  UToFV,
+  FToIV,
+  FToUV,
+
+  /* jumps to c */
+  JmpV,
+  JzV, /* if a is 0 */
+  JnzV,
+  JEqV, /* if a op b */
+  JNeV,
+  JLtV,
+  JLeV,
+  JULtV,
+  JULeV,
+  JEqKV, /* if a op k */
+  JNeKV,
+  JLtKV,
+  JLeKV,
+  JGtKV,
+  JGeKV,
+
+  IncV,    /* a += k */
+  IncI32V, /* a += k as an int */
+
+  /*
+   * a = the function b, or the one pointed to by register b, or builtin b,
+   * called with the x args from register c. A callee's registers start two
+   * below its args, which are its params.
+   */
+  CallV,
+  CallPtrV,
+  BuiltinV,
+  RetV, /* returns a */
+  RetVoidV
+} vm_op;
+
+struct vm_insn {
+  vm_op op;
+  int a;
+  int b;
+  int c;
+  value k;
+  long x;
+};
+
+/* the frame pointer and 0, in every function's registers */
+#define VM_FP 0
+#define VM_ZERO 1
+#define VM_PARAMS 2
+
+/*
+ * vm_fn is a function compiled to bytecode. Its params are its registers
+ * from VM_PARAMS, the ones kept in the frame are stored there on entry.
+ */
+struct vm_fn {
+  struct interp_fn *fn;
+  struct vm_insn *code;
+  int len;
+  int cap;
+  int regs; /* registers used */
+
+  int *spills; /* params whose address is taken */
+  int spills_len;
+};
+
+/* frames and registers a program may use */
+#define VM_FRAMES (1 << 18)
+#define VM_REGS (1 << 22)
+
+struct vm_frame {
+  struct vm_insn *call; /* the call returned to */
+  struct vm_insn *code;
+  value *regs;
+};
+
+/*
+ * vm is a program compiled from the lowered tree of an interpreter, whose
+ * globals, stack and builtins it shares.
+ */
+struct vm {
+  struct interp *in;
+  struct vm_fn **fns; /* by interp_fn.id */
+  int fns_len;
+
+  value *regs;
+  value *regs_end;
+  struct vm_frame *frames;
+  struct vm_frame *frames_end;
+};
+
+/* Compiles the functions loaded by in */
+struct vm *vm_load(struct interp *in);
+
+/*
+ * Initializes the globals and calls main, returning its result. argv holds
+ * argc strings.
+ */
+int vm_run(struct vm *, int argc, char **argv);
+
+#endif
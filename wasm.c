@@ -0,0 +1,1678 @@
+#include "wasm.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+const char *wasm_import_names[] = {"printf", "putchar", "puts",   "malloc",
+                                   "calloc", "free",    "strlen", "exit"};
+
+const char *wasm_import_types[] = {"ii:i", "i:i", "i:i", "i:i",
+                                   "ii:i", "i:",  "i:i", "i:"};
+
+/*
+ * Buffers
+ */
+
+void wasm_reserve(struct wasm_buf *b, long len) {
+  if (b->len + len <= b->cap) {
+    return;
+  }
+  while (b->len + len > b->cap) {
+    b->cap = b->cap ? b->cap * 2 : 256;
+  }
+  b->data = realloc(b->data, b->cap);
+}
+
+void wasm_byte(struct wasm_buf *b, int byte) {
+  wasm_reserve(b, 1);
+  b->data[b->len++] = (unsigned char)byte;
+}
+
+void wasm_bytes(struct wasm_buf *b, const void *bytes, long len) {
+  wasm_reserve(b, len);
+  memcpy(b->data + b->len, bytes, len);
+  b->len += len;
+}
+
+void wasm_uleb(struct wasm_buf *b, unsigned long v) {
+  do {
+    int byte = v & 0x7f;
+    v >>= 7;
+    wasm_byte(b, v ? byte | 0x80 : byte);
+  } while (v);
+}
+
+void wasm_sleb(struct wasm_buf *b, long v) {
+  for (;;) {
+    int byte = v & 0x7f;
+    v >>= 7;
+    if ((v == 0 && !(byte & 0x40)) || (v == -1 && (byte & 0x40))) {
+      wasm_byte(b, byte);
+      return;
+    }
+    wasm_byte(b, byte | 0x80);
+  }
+}
+
+void wasm_name(struct wasm_buf *b, const char *name) {
+  long len = strlen(name);
+  wasm_uleb(b, len);
+  wasm_bytes(b, name, len);
+}
+
+void wasm_section(struct wasm_buf *b, int id, struct wasm_buf *content) {
+  wasm_byte(b, id);
+  wasm_uleb(b, content->len);
+  wasm_bytes(b, content->data, content->len);
+}
+
+/*
+ * Generator
+ */
+
+struct wasm_sig {
+  unsigned char *params;
+  int params_len;
+  int result; /* a valtype, or 0 */
+};
+
+/* an object of the program placed in linear memory at addr */
+struct wasm_obj {
+  char *p;
+  long size;
+  long addr;
+};
+
+/* a wasm local holding the promoted scalars at a frame offset */
+struct wasm_local {
+  long off;
+  int type;
+  int index;
+};
+
+/* offsets folded into loads and stores stay below */
+#define WASM_MAX_OFF (1L << 30)
+
+struct wasm_gen {
+  struct interp *in;
+
+  struct wasm_sig *sigs;
+  int sigs_len;
+
+  struct wasm_obj *objs; /* sorted by p */
+  int objs_len;
+  long data_end;
+
+  /* the function being compiled, NULL for the initializers */
+  struct interp_fn *fn;
+  struct wasm_buf code;
+  int params_len;
+  unsigned char *locals; /* types of the locals after the params */
+  int locals_len;
+  int locals_cap;
+
+  bool *promoted; /* by slot */
+  struct wasm_local *slot_locals;
+  int slot_locals_len;
+  int fp; /* local of the frame, or -1 */
+  long frame_size;
+
+  /* temporaries by valtype, the used ones taken by an enclosing statement */
+  int *temps[4];
+  int temps_len[4];
+  int temps_used[4];
+
+  int depth; /* labels enclosing the code */
+  int brk;   /* depth of the label break and continue go to */
+  int cont;
+};
+
+void wasm_fail(const char *msg, const char *name) {
+  if (name) {
+    printf("wasm: %s %s\n", msg, name);
+  } else {
+    printf("wasm: %s\n", msg);
+  }
+  exit(1);
+}
+
+/* Returns the valtype values of kind k are held in, 0 for void */
+int wasm_type(val_kind k) {
+  switch (k) {
+  case VoidV:
+    return 0;
+  case F32V:
+    return WasmF32;
+  case F64V:
+    return WasmF64;
+  case I64V:
+  case U64V:
+  case PtrV:
+  case AggV:
+    return WasmI64;
+  default:
+    return WasmI32;
+  }
+}
+
+/* Returns the index of the function type of params and result */
+int wasm_sig(struct wasm_gen *g, unsigned char *params, int len, int result) {
+  struct wasm_sig *s;
+  int i;
+
+  for (i = 0; i < g->sigs_len; i++) {
+    s = g->sigs + i;
+    if (s->params_len == len && s->result == result &&
+        !memcmp(s->params, params, len)) {
+      return i;
+    }
+  }
+  g->sigs = realloc(g->sigs, (g->sigs_len + 1) * sizeof(*g->sigs));
+  s = g->sigs + g->sigs_len;
+  s->params = malloc(len + 1);
+  memcpy(s->params, params, len);
+  s->params_len = len;
+  s->result = result;
+  return g->sigs_len++;
+}
+
+int wasm_fn_sig(struct wasm_gen *g, struct interp_fn *fn) {
+  unsigned char *p = malloc(fn->params_len + 1);
+  int i;
+
+  for (i = 0; i < fn->params_len; i++) {
+    p[i] = wasm_type(fn->param_kind[i]);
+  }
+  i = wasm_sig(g, p, fn->params_len, wasm_type(fn->ret_kind));
+  free(p);
+  return i;
+}
+
+int wasm_import_sig(struct wasm_gen *g, wasm_import w) {
+  unsigned char params[4];
+  const char *t = wasm_import_types[w];
+  int len = 0;
+
+  for (; *t != ':'; t++) {
+    params[len++] = WasmI32;
+  }
+  return wasm_sig(g, params, len, t[1] ? WasmI32 : 0);
+}
+
+int wasm_obj_cmp(const void *a, const void *b) {
+  const struct wasm_obj *x = a, *y = b;
+  return x->p < y->p ? -1 : x->p > y->p;
+}
+
+/* Lays out the objects of the program from WASM_DATA */
+void wasm_place(struct wasm_gen *g) {
+  long addr = WASM_DATA;
+  int i;
+
+  g->objs_len = g->in->objs_len;
+  g->objs = malloc((g->objs_len + 1) * sizeof(*g->objs));
+  for (i = 0; i < g->objs_len; i++) {
+    g->objs[i].p = g->in->objs[i].p;
+    g->objs[i].size = g->in->objs[i].size;
+    g->objs[i].addr = addr;
+    addr += (g->objs[i].size + 15) / 16 * 16;
+  }
+  g->data_end = addr;
+  qsort(g->objs, g->objs_len, sizeof(*g->objs), wasm_obj_cmp);
+}
+
+/* Returns the address in linear memory of p, in or just past an object */
+long wasm_addr_of(struct wasm_gen *g, char *p) {
+  int lo = 0, hi = g->objs_len;
+
+  /* the last object starting at or before p */
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (g->objs[mid].p <= p) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (!lo || p > g->objs[lo - 1].p + g->objs[lo - 1].size) {
+    wasm_fail("address of no object", NULL);
+  }
+  return g->objs[lo - 1].addr + (p - g->objs[lo - 1].p);
+}
+
+/*
+ * Instructions
+ */
+
+void wasm_op(struct wasm_gen *g, int op) { wasm_byte(&g->code, op); }
+
+/* an instruction with an index immediate */
+void wasm_op_idx(struct wasm_gen *g, int op, unsigned long idx) {
+  wasm_byte(&g->code, op);
+  wasm_uleb(&g->code, idx);
+}
+
+void wasm_i32(struct wasm_gen *g, long v) {
+  wasm_byte(&g->code, WasmI32Const);
+  wasm_sleb(&g->code, (int)v);
+}
+
+void wasm_i64(struct wasm_gen *g, long v) {
+  wasm_byte(&g->code, WasmI64Const);
+  wasm_sleb(&g->code, v);
+}
+
+/* floats are written little endian, as the host holds them */
+void wasm_f32(struct wasm_gen *g, double v) {
+  float f = (float)v;
+  wasm_byte(&g->code, WasmF32Const);
+  wasm_bytes(&g->code, &f, 4);
+}
+
+void wasm_f64(struct wasm_gen *g, double v) {
+  wasm_byte(&g->code, WasmF64Const);
+  wasm_bytes(&g->code, &v, 8);
+}
+
+/* Pushes v of valtype t */
+void wasm_const(struct wasm_gen *g, int t, long v, double f) {
+  switch (t) {
+  case WasmI32:
+    wasm_i32(g, v);
+    break;
+  case WasmI64:
+    wasm_i64(g, v);
+    break;
+  case WasmF32:
+    wasm_f32(g, f);
+    break;
+  case WasmF64:
+    wasm_f64(g, f);
+    break;
+  }
+}
+
+/* a load or store at offset off of the address on the stack */
+void wasm_mem(struct wasm_gen *g, int op, long off) {
+  wasm_byte(&g->code, op);
+  wasm_uleb(&g->code, 0);
+  wasm_uleb(&g->code, off);
+}
+
+void wasm_load(struct wasm_gen *g, val_kind k, long off) {
+  switch (k) {
+  case I8V:
+    wasm_mem(g, WasmI32Load8S, off);
+    break;
+  case U8V:
+    wasm_mem(g, WasmI32Load8U, off);
+    break;
+  case I16V:
+    wasm_mem(g, WasmI32Load16S, off);
+    break;
+  case U16V:
+    wasm_mem(g, WasmI32Load16U, off);
+    break;
+  case I32V:
+  case U32V:
+    wasm_mem(g, WasmI32Load, off);
+    break;
+  case F32V:
+    wasm_mem(g, WasmF32Load, off);
+    break;
+  case F64V:
+    wasm_mem(g, WasmF64Load, off);
+    break;
+  default:
+    wasm_mem(g, WasmI64Load, off);
+    break;
+  }
+}
+
+void wasm_store(struct wasm_gen *g, val_kind k, long off) {
+  switch (k) {
+  case I8V:
+  case U8V:
+    wasm_mem(g, WasmI32Store8, off);
+    break;
+  case I16V:
+  case U16V:
+    wasm_mem(g, WasmI32Store16, off);
+    break;
+  case I32V:
+  case U32V:
+    wasm_mem(g, WasmI32Store, off);
+    break;
+  case F32V:
+    wasm_mem(g, WasmF32Store, off);
+    break;
+  case F64V:
+    wasm_mem(g, WasmF64Store, off);
+    break;
+  default:
+    wasm_mem(g, WasmI64Store, off);
+    break;
+  }
+}
+
+/*
+ * Locals
+ */
+
+int wasm_new_local(struct wasm_gen *g, int type) {
+  if (g->locals_len == g->locals_cap) {
+    g->locals_cap = g->locals_cap ? g->locals_cap * 2 : 16;
+    g->locals = realloc(g->locals, g->locals_cap);
+  }
+  g->locals[g->locals_len] = type;
+  return g->params_len + g->locals_len++;
+}
+
+int wasm_temp_pool(int type) {
+  switch (type) {
+  case WasmI32:
+    return 0;
+  case WasmI64:
+    return 1;
+  case WasmF32:
+    return 2;
+  default:
+    return 3;
+  }
+}
+
+/* Returns a local of valtype type free until the statement ends */
+int wasm_temp(struct wasm_gen *g, int type) {
+  int p = wasm_temp_pool(type);
+
+  if (g->temps_used[p] == g->temps_len[p]) {
+    g->temps[p] =
+        realloc(g->temps[p], (g->temps_len[p] + 1) * sizeof(*g->temps[p]));
+    g->temps[p][g->temps_len[p]++] = wasm_new_local(g, type);
+  }
+  return g->temps[p][g->temps_used[p]++];
+}
+
+/* Returns the local holding the scalar of kind k at frame offset off, or -1 */
+int wasm_slot_local(struct wasm_gen *g, long off, val_kind k) {
+  struct interp_fn *fn = g->fn;
+  int type = wasm_type(k);
+  int i;
+
+  if (!fn) {
+    return -1;
+  }
+  for (i = 0; i < fn->slots_len && fn->slots[i].off != off; i++) {
+  }
+  if (i == fn->slots_len || !g->promoted[i]) {
+    return -1;
+  }
+  if (i < fn->params_len) {
+    return i;
+  }
+
+  /* scalars of blocks apart may share an offset */
+  for (i = 0; i < g->slot_locals_len; i++) {
+    if (g->slot_locals[i].off == off && g->slot_locals[i].type == type) {
+      return g->slot_locals[i].index;
+    }
+  }
+  g->slot_locals = realloc(g->slot_locals, (g->slot_locals_len + 1) *
+                                               sizeof(*g->slot_locals));
+  g->slot_locals[i].off = off;
+  g->slot_locals[i].type = type;
+  g->slot_locals[i].index = wasm_new_local(g, type);
+  g->slot_locals_len++;
+  return g->slot_locals[i].index;
+}
+
+/* Pushes the address of the frame at offset off, as a pointer */
+void wasm_frame_addr(struct wasm_gen *g, long off) {
+  wasm_op_idx(g, WasmLocalGet, g->fp);
+  if (off) {
+    wasm_i32(g, off);
+    wasm_op(g, WasmI32Add);
+  }
+  wasm_op(g, WasmI64ExtendI32U);
+}
+
+/*
+ * Expressions
+ */
+
+void wasm_expr(struct wasm_gen *, struct inode *, bool want);
+
+/* Truncates the i32 on the stack to the narrow kind k, extending it back */
+void wasm_norm(struct wasm_gen *g, val_kind k) {
+  switch (k) {
+  case I8V:
+  case I16V:
+    wasm_i32(g, k == I8V ? 24 : 16);
+    wasm_op(g, WasmI32Shl);
+    wasm_i32(g, k == I8V ? 24 : 16);
+    wasm_op(g, WasmI32ShrS);
+    break;
+  case U8V:
+  case U16V:
+    wasm_i32(g, k == U8V ? 0xff : 0xffff);
+    wasm_op(g, WasmI32And);
+    break;
+  default:
+    break;
+  }
+}
+
+/* Converts the value on the stack from kind from to kind to, as convert */
+void wasm_cast(struct wasm_gen *g, val_kind from, val_kind to) {
+  int ft = wasm_type(from), tt = wasm_type(to);
+
+  if (from == to || from == VoidV || to == VoidV) {
+    return;
+  }
+  if (is_float_kind(to)) {
+    if (!is_float_kind(from)) {
+      wasm_op(g, (ft == WasmI32 ? WasmF64ConvertI32S : WasmF64ConvertI64S) +
+                     is_unsigned_kind(from));
+      from = F64V;
+    }
+    if (from == F32V && to == F64V) {
+      wasm_op(g, WasmF64PromoteF32);
+    } else if (from == F64V && to == F32V) {
+      wasm_op(g, WasmF32DemoteF64);
+    }
+    return;
+  }
+  if (is_float_kind(from)) {
+    if (from == F32V) {
+      wasm_op(g, WasmF64PromoteF32);
+    }
+    wasm_op(g, to == U64V ? WasmI64TruncF64U : WasmI64TruncF64S);
+    if (tt == WasmI32) {
+      wasm_op(g, WasmI32WrapI64);
+    }
+    wasm_norm(g, to);
+    return;
+  }
+  if (ft == WasmI32 && tt == WasmI64) {
+    wasm_op(g, is_unsigned_kind(from) ? WasmI64ExtendI32U : WasmI64ExtendI32S);
+  } else if (ft == WasmI64 && tt == WasmI32) {
+    wasm_op(g, WasmI32WrapI64);
+  }
+  if (!kind_fits(from, to)) {
+    wasm_norm(g, to);
+  }
+}
+
+/* Pushes n as kind k if want */
+void wasm_expr_as(struct wasm_gen *g, struct inode *n, val_kind k,
+                  bool want) {
+  wasm_expr(g, n, want);
+  if (want) {
+    wasm_cast(g, n->kind, k);
+  }
+}
+
+/* Pushes the i32 address of pointer n, folding constants into off */
+void wasm_addr(struct wasm_gen *g, struct inode *n, long *off) {
+  *off = 0;
+  while (n->op == PtrAddOp && n->b->op == ConstOp) {
+    long d = n->b->k * n->k;
+    if (d < 0 || *off + d >= WASM_MAX_OFF) {
+      break;
+    }
+    *off += d;
+    n = n->a;
+  }
+
+  if (n->op == LocalOp && g->fp >= 0 && *off + n->x < WASM_MAX_OFF) {
+    wasm_op_idx(g, WasmLocalGet, g->fp);
+    *off += n->x;
+    return;
+  }
+  wasm_expr(g, n, true);
+  if (wasm_type(n->kind) == WasmI64) {
+    wasm_op(g, WasmI32WrapI64);
+  }
+}
+
+/* Pushes an i32 of the truth of n, exactly 0 or 1 if exact */
+void wasm_cond(struct wasm_gen *g, struct inode *n, bool exact) {
+  switch (n->op) {
+  case EqOp:
+  case NeOp:
+  case LtOp:
+  case LeOp:
+  case ULtOp:
+  case ULeOp:
+  case FEqOp:
+  case FNeOp:
+  case FLtOp:
+  case FLeOp:
+  case NotOp:
+  case LogAndOp:
+  case LogOrOp:
+    wasm_expr(g, n, true);
+    return;
+  default:
+    break;
+  }
+
+  wasm_expr(g, n, true);
+  switch (wasm_type(n->kind)) {
+  case WasmI32:
+    if (exact) {
+      wasm_op(g, WasmI32Eqz);
+      wasm_op(g, WasmI32Eqz);
+    }
+    break;
+  case WasmI64:
+    wasm_op(g, WasmI64Eqz);
+    wasm_op(g, WasmI32Eqz);
+    break;
+  case WasmF32:
+    wasm_f32(g, 0);
+    wasm_op(g, WasmF32Ne);
+    break;
+  case WasmF64:
+    wasm_f64(g, 0);
+    wasm_op(g, WasmF64Ne);
+    break;
+  }
+}
+
+/* Returns the kind the operands of comparison n are compared as */
+val_kind wasm_cmp_kind(struct inode *n) {
+  int a = wasm_type(n->a->kind), b = wasm_type(n->b->kind);
+
+  if (a == WasmF64 || b == WasmF64) {
+    return F64V;
+  }
+  if (a == WasmF32 || b == WasmF32) {
+    return F32V;
+  }
+  return a == WasmI64 || b == WasmI64 ? I64V : I32V;
+}
+
+/* Returns the i32 instruction of integer op */
+int wasm_int_op(inode_op op) {
+  switch (op) {
+  case AddOp:
+    return WasmI32Add;
+  case SubOp:
+    return WasmI32Sub;
+  case MulOp:
+    return WasmI32Mul;
+  case DivOp:
+    return WasmI32DivS;
+  case UDivOp:
+    return WasmI32DivU;
+  case ModOp:
+    return WasmI32RemS;
+  case UModOp:
+    return WasmI32RemU;
+  case ShlOp:
+    return WasmI32Shl;
+  case ShrOp:
+    return WasmI32ShrS;
+  case UShrOp:
+    return WasmI32ShrU;
+  case AndOp:
+    return WasmI32And;
+  case OrOp:
+    return WasmI32Or;
+  case XorOp:
+    return WasmI32Xor;
+  case EqOp:
+    return WasmI32Eq;
+  case NeOp:
+    return WasmI32Ne;
+  case LtOp:
+    return WasmI32LtS;
+  case LeOp:
+    return WasmI32LeS;
+  case ULtOp:
+    return WasmI32LtU;
+  default:
+    return WasmI32LeU;
+  }
+}
+
+/* Returns the f32 instruction of float op */
+int wasm_float_op(inode_op op) {
+  switch (op) {
+  case FAddOp:
+    return WasmF32Add;
+  case FSubOp:
+    return WasmF32Sub;
+  case FMulOp:
+    return WasmF32Mul;
+  case FDivOp:
+    return WasmF32Div;
+  case FEqOp:
+    return WasmF32Eq;
+  case FNeOp:
+    return WasmF32Ne;
+  case FLtOp:
+    return WasmF32Lt;
+  default:
+    return WasmF32Le;
+  }
+}
+
+/* Pushes the value of leaf n */
+void wasm_leaf(struct wasm_gen *g, struct inode *n) {
+  switch (n->op) {
+  case ConstOp:
+    wasm_const(g, wasm_type(n->kind), n->k, (double)n->k);
+    break;
+  case FConstOp:
+    wasm_const(g, wasm_type(n->kind), 0, n->f);
+    break;
+  case LocalOp:
+    wasm_frame_addr(g, n->x);
+    break;
+  case GlobalOp:
+    wasm_i64(g, wasm_addr_of(g, n->p));
+    break;
+  default:
+    /* function pointers index the table from 1 */
+    wasm_i64(g, n->fn->id + 1);
+    break;
+  }
+}
+
+/* Adds n->k, or n->f for floats, to the value of kind n->kind on the stack */
+void wasm_add_delta(struct wasm_gen *g, struct inode *n) {
+  switch (wasm_type(n->kind)) {
+  case WasmF32:
+    /* in double, as the interpreter adds */
+    wasm_op(g, WasmF64PromoteF32);
+    wasm_f64(g, n->f);
+    wasm_op(g, WasmF32Add + F64_ARITH);
+    wasm_op(g, WasmF32DemoteF64);
+    break;
+  case WasmF64:
+    wasm_f64(g, n->f);
+    wasm_op(g, WasmF32Add + F64_ARITH);
+    break;
+  case WasmI64:
+    wasm_i64(g, n->k);
+    wasm_op(g, WasmI64Add);
+    break;
+  default:
+    wasm_i32(g, n->k);
+    wasm_op(g, WasmI32Add);
+    wasm_norm(g, n->kind);
+    break;
+  }
+}
+
+void wasm_inc(struct wasm_gen *g, struct inode *n, bool want) {
+  int type = wasm_type(n->kind);
+  int l, addr, t = -1;
+  long off;
+
+  if (n->op == IncLocalOp && (l = wasm_slot_local(g, n->x, n->kind)) >= 0) {
+    if (want && n->post) {
+      wasm_op_idx(g, WasmLocalGet, l);
+    }
+    wasm_op_idx(g, WasmLocalGet, l);
+    wasm_add_delta(g, n);
+    wasm_op_idx(g, want && !n->post ? WasmLocalTee : WasmLocalSet, l);
+    return;
+  }
+
+  if (n->op == IncLocalOp) {
+    addr = g->fp;
+    off = n->x;
+  } else {
+    wasm_addr(g, n->a, &off);
+    addr = wasm_temp(g, WasmI32);
+    wasm_op_idx(g, WasmLocalSet, addr);
+  }
+  if (want) {
+    t = wasm_temp(g, type);
+  }
+  wasm_op_idx(g, WasmLocalGet, addr);
+  wasm_op_idx(g, WasmLocalGet, addr);
+  wasm_load(g, n->kind, off);
+  if (want && n->post) {
+    wasm_op_idx(g, WasmLocalTee, t);
+  }
+  wasm_add_delta(g, n);
+  if (want && !n->post) {
+    wasm_op_idx(g, WasmLocalTee, t);
+  }
+  wasm_store(g, n->kind, off);
+  if (want) {
+    wasm_op_idx(g, WasmLocalGet, t);
+  }
+}
+
+/* Pushes arg i of builtin call n as an i32, 0 if it is missing */
+void wasm_i32_arg(struct wasm_gen *g, struct inode *n, int i) {
+  if (i < n->len) {
+    wasm_expr_as(g, n->list[i],
+                 is_unsigned_kind(n->list[i]->kind) ? U32V : I32V, true);
+  } else {
+    wasm_i32(g, 0);
+  }
+}
+
+/* Evaluates the args of builtin call n from i, which it takes no more of */
+void wasm_extra_args(struct wasm_gen *g, struct inode *n, int i) {
+  for (; i < n->len; i++) {
+    wasm_expr(g, n->list[i], false);
+  }
+}
+
+/* a bulk memory operation, of memory 0 */
+void wasm_bulk(struct wasm_gen *g, wasm_fc_opcode op) {
+  wasm_op_idx(g, WasmPrefixFC, op);
+  wasm_byte(&g->code, 0);
+  if (op == WasmMemoryCopy) {
+    wasm_byte(&g->code, 0);
+  }
+}
+
+/* the import computing builtin b, if any */
+wasm_import wasm_builtin_import(builtin b) {
+  switch (b) {
+  case PrintfB:
+    return PrintfW;
+  case PutcharB:
+    return PutcharW;
+  case PutsB:
+    return PutsW;
+  case MallocB:
+    return MallocW;
+  case CallocB:
+    return CallocW;
+  case FreeB:
+    return FreeW;
+  case StrlenB:
+    return StrlenW;
+  case ExitB:
+    return ExitW;
+  default:
+    return ImportsLen;
+  }
+}
+
+/*
+ * Calls printf with its variadic args in 8 byte slots below the stack
+ * pointer, which is moved over them for the call.
+ */
+void wasm_printf(struct wasm_gen *g, struct inode *n) {
+  long size = ((long)(n->len - 1) * 8 + 15) / 16 * 16;
+  int i;
+
+  if (!n->len) {
+    wasm_i32(g, 0);
+    wasm_i32(g, 0);
+    wasm_op_idx(g, WasmCall, PrintfW);
+    return;
+  }
+  if (size) {
+    wasm_op_idx(g, WasmGlobalGet, WASM_SP);
+    wasm_i32(g, size);
+    wasm_op(g, WasmI32Sub);
+    wasm_op_idx(g, WasmGlobalSet, WASM_SP);
+  }
+  for (i = 1; i < n->len; i++) {
+    struct inode *arg = n->list[i];
+    bool f = is_float_kind(arg->kind);
+
+    wasm_op_idx(g, WasmGlobalGet, WASM_SP);
+    wasm_expr_as(g, arg, f ? F64V : is_unsigned_kind(arg->kind) ? U64V : I64V,
+                 true);
+    wasm_mem(g, f ? WasmF64Store : WasmI64Store, (long)(i - 1) * 8);
+  }
+  wasm_expr_as(g, n->list[0], U32V, true);
+  wasm_op_idx(g, WasmGlobalGet, WASM_SP);
+  wasm_op_idx(g, WasmCall, PrintfW);
+  if (size) {
+    wasm_op_idx(g, WasmGlobalGet, WASM_SP);
+    wasm_i32(g, size);
+    wasm_op(g, WasmI32Add);
+    wasm_op_idx(g, WasmGlobalSet, WASM_SP);
+  }
+}
+
+/* Pushes the result of builtin call n, of kind n->kind */
+void wasm_builtin(struct wasm_gen *g, struct inode *n) {
+  wasm_import w = wasm_builtin_import(n->k);
+  int t, s, i;
+
+  switch (n->k) {
+  case PrintfB:
+    wasm_printf(g, n);
+    return;
+  case AbsB:
+    t = wasm_temp(g, WasmI32);
+    s = wasm_temp(g, WasmI32);
+    wasm_expr_as(g, n->list[0], I32V, true);
+    wasm_op_idx(g, WasmLocalTee, t);
+    wasm_i32(g, 31);
+    wasm_op(g, WasmI32ShrS);
+    wasm_op_idx(g, WasmLocalTee, s);
+    wasm_op_idx(g, WasmLocalGet, t);
+    wasm_op(g, WasmI32Xor);
+    wasm_op_idx(g, WasmLocalGet, s);
+    wasm_op(g, WasmI32Sub);
+    return;
+  case SqrtB:
+  case FabsB:
+    wasm_expr_as(g, n->list[0], F64V, true);
+    wasm_op(g, n->k == SqrtB ? WasmF64Sqrt : WasmF64Abs);
+    return;
+  case MemsetB:
+  case MemcpyB:
+    /* in place, yielding the destination */
+    t = wasm_temp(g, WasmI32);
+    wasm_i32_arg(g, n, 0);
+    wasm_op_idx(g, WasmLocalTee, t);
+    wasm_i32_arg(g, n, 1);
+    wasm_i32_arg(g, n, 2);
+    wasm_extra_args(g, n, 3);
+    wasm_bulk(g, n->k == MemsetB ? WasmMemoryFill : WasmMemoryCopy);
+    wasm_op_idx(g, WasmLocalGet, t);
+    wasm_op(g, WasmI64ExtendI32U);
+    return;
+  default:
+    break;
+  }
+
+  for (i = 0; wasm_import_types[w][i] != ':'; i++) {
+    wasm_i32_arg(g, n, i);
+  }
+  wasm_extra_args(g, n, i);
+  wasm_op_idx(g, WasmCall, w);
+  if (n->kind != VoidV) {
+    /* addresses and lengths come back unsigned */
+    wasm_cast(g, n->kind == I32V ? I32V : U32V, n->kind);
+  }
+}
+
+/* Pushes the result of call n, if it has one */
+void wasm_call(struct wasm_gen *g, struct inode *n) {
+  unsigned char *p;
+  int i, t;
+
+  switch (n->op) {
+  case CallOp:
+    for (i = 0; i < n->len; i++) {
+      if (i < n->fn->params_len) {
+        wasm_expr_as(g, n->list[i], n->fn->param_kind[i], true);
+      } else {
+        wasm_expr(g, n->list[i], false);
+      }
+    }
+    wasm_op_idx(g, WasmCall, ImportsLen + n->fn->id);
+    return;
+  case CallPtrOp:
+    t = wasm_temp(g, WasmI64);
+    wasm_expr_as(g, n->a, PtrV, true);
+    wasm_op_idx(g, WasmLocalSet, t);
+    p = malloc(n->len + 1);
+    for (i = 0; i < n->len; i++) {
+      wasm_expr(g, n->list[i], true);
+      p[i] = wasm_type(n->list[i]->kind);
+    }
+    wasm_op_idx(g, WasmLocalGet, t);
+    wasm_op(g, WasmI32WrapI64);
+    wasm_op_idx(g, WasmCallIndirect,
+                wasm_sig(g, p, n->len, wasm_type(n->kind)));
+    wasm_byte(&g->code, 0);
+    free(p);
+    return;
+  default:
+    wasm_builtin(g, n);
+    return;
+  }
+}
+
+/* Pushes the value of n if want, only evaluating it otherwise */
+void wasm_expr(struct wasm_gen *g, struct inode *n, bool want) {
+  int type = wasm_type(n->kind);
+  val_kind k;
+  long off;
+  int t;
+
+  want = want && n->kind != VoidV;
+  switch (n->op) {
+  case ConstOp:
+  case FConstOp:
+  case LocalOp:
+  case GlobalOp:
+  case FnOp:
+    if (want) {
+      wasm_leaf(g, n);
+    }
+    return;
+
+  case LoadOp:
+    if (n->kind == AggV) {
+      wasm_expr(g, n->a, want);
+      return;
+    }
+    wasm_addr(g, n->a, &off);
+    wasm_load(g, n->kind, off);
+    if (!want) {
+      wasm_op(g, WasmDrop);
+    }
+    return;
+  case LoadLocalOp:
+    if ((t = wasm_slot_local(g, n->x, n->kind)) >= 0) {
+      if (want) {
+        wasm_op_idx(g, WasmLocalGet, t);
+      }
+    } else if (want && n->kind == AggV) {
+      wasm_frame_addr(g, n->x);
+    } else if (want) {
+      wasm_op_idx(g, WasmLocalGet, g->fp);
+      wasm_load(g, n->kind, n->x);
+    }
+    return;
+  case StoreOp:
+  case StoreLocalOp:
+    if (n->op == StoreLocalOp &&
+        (t = wasm_slot_local(g, n->x, n->kind)) >= 0) {
+      wasm_expr_as(g, n->b, n->kind, true);
+      wasm_op_idx(g, want ? WasmLocalTee : WasmLocalSet, t);
+      return;
+    }
+    if (n->op == StoreLocalOp) {
+      wasm_op_idx(g, WasmLocalGet, g->fp);
+      off = n->x;
+    } else {
+      wasm_addr(g, n->a, &off);
+    }
+    wasm_expr_as(g, n->b, n->kind, true);
+    if (want) {
+      t = wasm_temp(g, type);
+      wasm_op_idx(g, WasmLocalTee, t);
+    }
+    wasm_store(g, n->kind, off);
+    if (want) {
+      wasm_op_idx(g, WasmLocalGet, t);
+    }
+    return;
+  case CopyOp:
+    t = wasm_temp(g, WasmI64);
+    wasm_expr_as(g, n->a, PtrV, true);
+    wasm_op_idx(g, WasmLocalTee, t);
+    wasm_op(g, WasmI32WrapI64);
+    wasm_expr_as(g, n->b, PtrV, true);
+    wasm_op(g, WasmI32WrapI64);
+    wasm_i32(g, n->k);
+    wasm_bulk(g, WasmMemoryCopy);
+    if (want) {
+      wasm_op_idx(g, WasmLocalGet, t);
+    }
+    return;
+  case ConvOp:
+    wasm_expr(g, n->a, want);
+    if (want) {
+      wasm_cast(g, n->a->kind, n->x);
+      wasm_cast(g, n->x, n->kind);
+    }
+    return;
+
+  case AddOp:
+  case SubOp:
+  case MulOp:
+  case DivOp:
+  case UDivOp:
+  case ModOp:
+  case UModOp:
+  case ShlOp:
+  case ShrOp:
+  case UShrOp:
+  case AndOp:
+  case OrOp:
+  case XorOp:
+    /* division is kept for its trap on zero */
+    wasm_expr_as(g, n->a, n->kind, true);
+    wasm_expr_as(g, n->b, n->kind, true);
+    wasm_op(g, wasm_int_op(n->op) + (type == WasmI64 ? I64_ARITH : 0));
+    wasm_norm(g, n->kind);
+    break;
+  case NegOp:
+    if (want) {
+      wasm_const(g, type, 0, 0);
+    }
+    wasm_expr_as(g, n->a, n->kind, want);
+    if (want) {
+      wasm_op(g, type == WasmI64 ? WasmI64Sub : WasmI32Sub);
+      wasm_norm(g, n->kind);
+    }
+    return;
+  case ComplOp:
+    wasm_expr_as(g, n->a, n->kind, want);
+    if (want) {
+      wasm_const(g, type, -1, 0);
+      wasm_op(g, WasmI32Xor + (type == WasmI64 ? I64_ARITH : 0));
+    }
+    return;
+  case EqOp:
+  case NeOp:
+  case LtOp:
+  case LeOp:
+  case ULtOp:
+  case ULeOp:
+    k = wasm_cmp_kind(n);
+    wasm_expr_as(g, n->a, k, want);
+    wasm_expr_as(g, n->b, k, want);
+    if (want) {
+      wasm_op(g, wasm_int_op(n->op) + (k == I64V ? I64_REL : 0));
+    }
+    return;
+
+  case FAddOp:
+  case FSubOp:
+  case FMulOp:
+  case FDivOp:
+    wasm_expr_as(g, n->a, n->kind, want);
+    wasm_expr_as(g, n->b, n->kind, want);
+    if (want) {
+      wasm_op(g, wasm_float_op(n->op) + (type == WasmF64 ? F64_ARITH : 0));
+    }
+    return;
+  case FNegOp:
+    wasm_expr_as(g, n->a, n->kind, want);
+    if (want) {
+      wasm_op(g, WasmF32Neg + (type == WasmF64 ? F64_ARITH : 0));
+    }
+    return;
+  case FEqOp:
+  case FNeOp:
+  case FLtOp:
+  case FLeOp:
+    k = wasm_cmp_kind(n);
+    wasm_expr_as(g, n->a, k, want);
+    wasm_expr_as(g, n->b, k, want);
+    if (want) {
+      wasm_op(g, wasm_float_op(n->op) + (k == F64V ? F64_REL : 0));
+    }
+    return;
+
+  case PtrAddOp:
+  case PtrDiffOp:
+    wasm_expr_as(g, n->a, PtrV, want);
+    wasm_expr_as(g, n->b, n->op == PtrAddOp ? I64V : PtrV, want);
+    if (!want) {
+      return;
+    }
+    if (n->op == PtrAddOp) {
+      if (n->k != 1) {
+        wasm_i64(g, n->k);
+        wasm_op(g, WasmI64Mul);
+      }
+      wasm_op(g, WasmI64Add);
+    } else {
+      wasm_op(g, WasmI64Sub);
+      if (n->k != 1) {
+        wasm_i64(g, n->k);
+        wasm_op(g, WasmI64DivS);
+      }
+    }
+    return;
+  case NotOp:
+    wasm_cond(g, n->a, false);
+    wasm_op(g, WasmI32Eqz);
+    break;
+  case LogAndOp:
+  case LogOrOp:
+    wasm_cond(g, n->a, false);
+    wasm_op(g, WasmIf);
+    wasm_byte(&g->code, WasmI32);
+    g->depth++;
+    if (n->op == LogAndOp) {
+      wasm_cond(g, n->b, true);
+    } else {
+      wasm_i32(g, 1);
+    }
+    wasm_op(g, WasmElse);
+    if (n->op == LogAndOp) {
+      wasm_i32(g, 0);
+    } else {
+      wasm_cond(g, n->b, true);
+    }
+    wasm_op(g, WasmEnd);
+    g->depth--;
+    break;
+  case CondOp:
+    wasm_cond(g, n->a, false);
+    wasm_op(g, WasmIf);
+    wasm_byte(&g->code, want ? type : WasmVoid);
+    g->depth++;
+    wasm_expr_as(g, n->b, n->kind, want);
+    wasm_op(g, WasmElse);
+    wasm_expr_as(g, n->c, n->kind, want);
+    wasm_op(g, WasmEnd);
+    g->depth--;
+    return;
+  case SeqOp:
+    wasm_expr(g, n->a, false);
+    wasm_expr(g, n->b, want);
+    return;
+  case IncOp:
+  case IncLocalOp:
+    wasm_inc(g, n, want);
+    return;
+  case CallOp:
+  case CallPtrOp:
+  case BuiltinOp:
+    wasm_call(g, n);
+    if (!want && n->kind != VoidV) {
+      wasm_op(g, WasmDrop);
+    }
+    return;
+  default:
+    wasm_fail("not an expression", NULL);
+    return;
+  }
+
+  /* the value of an operator evaluated whole */
+  if (!want) {
+    wasm_op(g, WasmDrop);
+  }
+}
+
+/*
+ * Statements
+ */
+
+void wasm_stmt(struct wasm_gen *, struct inode *);
+
+/* Pushes the zero of valtype t */
+void wasm_zero(struct wasm_gen *g, int t) { wasm_const(g, t, 0, 0); }
+
+/* Branches to the label opened at depth */
+void wasm_br(struct wasm_gen *g, int op, int depth) {
+  wasm_op_idx(g, op, g->depth - depth);
+}
+
+/* Opens a label of op, returning its depth */
+int wasm_open(struct wasm_gen *g, int op) {
+  wasm_op(g, op);
+  wasm_byte(&g->code, WasmVoid);
+  return ++g->depth;
+}
+
+void wasm_close(struct wasm_gen *g) {
+  wasm_op(g, WasmEnd);
+  g->depth--;
+}
+
+/* Pops the frame of the function off the stack */
+void wasm_leave(struct wasm_gen *g) {
+  if (g->fp < 0) {
+    return;
+  }
+  wasm_op_idx(g, WasmLocalGet, g->fp);
+  wasm_i32(g, g->frame_size);
+  wasm_op(g, WasmI32Add);
+  wasm_op_idx(g, WasmGlobalSet, WASM_SP);
+}
+
+/* while, do and for, the latter with the init of n->a already run */
+void wasm_loop(struct wasm_gen *g, struct inode *cond, struct inode *body,
+               struct inode *iter, bool test_first) {
+  int brk = g->brk, cont = g->cont;
+  int top;
+
+  g->brk = wasm_open(g, WasmBlock);
+  top = wasm_open(g, WasmLoop);
+  if (test_first && cond) {
+    wasm_cond(g, cond, false);
+    wasm_op(g, WasmI32Eqz);
+    wasm_br(g, WasmBrIf, g->brk);
+  }
+  g->cont = wasm_open(g, WasmBlock);
+  wasm_stmt(g, body);
+  wasm_close(g);
+  if (iter) {
+    wasm_expr(g, iter, false);
+  }
+  if (test_first) {
+    wasm_br(g, WasmBr, top);
+  } else {
+    wasm_cond(g, cond, false);
+    wasm_br(g, WasmBrIf, top);
+  }
+  wasm_close(g);
+  wasm_close(g);
+  g->brk = brk;
+  g->cont = cont;
+}
+
+int wasm_int_cmp(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * Returns the depth of the label a switch branches to for the statement at
+ * pos of its body, given the sorted positions at cases start at and their
+ * labels.
+ */
+int wasm_case_label(struct wasm_gen *g, struct inode *body, int *at,
+                    int *labels, int at_len, int pos) {
+  if (pos >= body->len) {
+    return g->brk;
+  }
+  return labels[(int *)bsearch(&pos, at, at_len, sizeof(int), wasm_int_cmp) -
+                at];
+}
+
+/*
+ * A switch opens a block per statement a case starts at, nested so that a
+ * branch out of the i-th lands on its statement, after a chain comparing
+ * the value with every case.
+ */
+void wasm_switch(struct wasm_gen *g, struct inode *n) {
+  struct inode *body = n->d;
+  int *at = malloc((n->cases_len + 2) * sizeof(int));
+  int *labels;
+  int at_len = 0;
+  int brk = g->brk;
+  val_kind k = wasm_type(n->a->kind) == WasmI64 ? I64V : I32V;
+  int t, i, j, end;
+
+  for (i = 0; i < n->cases_len; i++) {
+    at[at_len++] = n->case_at[i];
+  }
+  at[at_len++] = n->default_at;
+  qsort(at, at_len, sizeof(int), wasm_int_cmp);
+  for (i = 0, j = 0; i < at_len; i++) {
+    if ((!j || at[j - 1] != at[i]) && at[i] < body->len) {
+      at[j++] = at[i];
+    }
+  }
+  at_len = j;
+  labels = malloc((at_len + 1) * sizeof(int));
+
+  t = wasm_temp(g, wasm_type(k));
+  wasm_expr_as(g, n->a, k, true);
+  wasm_op_idx(g, WasmLocalSet, t);
+
+  g->brk = wasm_open(g, WasmBlock);
+  for (i = at_len - 1; i >= 0; i--) {
+    labels[i] = wasm_open(g, WasmBlock);
+  }
+  for (i = 0; i < n->cases_len; i++) {
+    wasm_op_idx(g, WasmLocalGet, t);
+    wasm_const(g, wasm_type(k), n->cases[i], 0);
+    wasm_op(g, k == I64V ? WasmI32Eq + I64_REL : WasmI32Eq);
+    wasm_br(g, WasmBrIf,
+            wasm_case_label(g, body, at, labels, at_len, n->case_at[i]));
+  }
+  wasm_br(g, WasmBr,
+          wasm_case_label(g, body, at, labels, at_len, n->default_at));
+
+  /* statements before the first case are never run */
+  for (i = 0; i < at_len; i++) {
+    wasm_close(g);
+    end = i + 1 < at_len ? at[i + 1] : body->len;
+    for (j = at[i]; j < end; j++) {
+      wasm_stmt(g, body->list[j]);
+    }
+  }
+  wasm_close(g);
+  g->brk = brk;
+  free(at);
+  free(labels);
+}
+
+void wasm_stmt(struct wasm_gen *g, struct inode *n) {
+  int used[4];
+  int i;
+
+  memcpy(used, g->temps_used, sizeof(used));
+  switch (n->op) {
+  case NopOp:
+    break;
+  case ExprOp:
+    wasm_expr(g, n->a, false);
+    break;
+  case BlockOp:
+    for (i = 0; i < n->len; i++) {
+      wasm_stmt(g, n->list[i]);
+    }
+    break;
+  case IfOp:
+    wasm_cond(g, n->a, false);
+    wasm_open(g, WasmIf);
+    wasm_stmt(g, n->b);
+    if (n->c) {
+      wasm_op(g, WasmElse);
+      wasm_stmt(g, n->c);
+    }
+    wasm_close(g);
+    break;
+  case WhileOp:
+    wasm_loop(g, n->a, n->b, NULL, true);
+    break;
+  case DoOp:
+    wasm_loop(g, n->a, n->b, NULL, false);
+    break;
+  case ForOp:
+    if (n->a) {
+      wasm_expr(g, n->a, false);
+    }
+    wasm_loop(g, n->b, n->d, n->c, true);
+    break;
+  case SwitchOp:
+    wasm_switch(g, n);
+    break;
+  case BreakOp:
+    wasm_br(g, WasmBr, g->brk);
+    break;
+  case ContinueOp:
+    wasm_br(g, WasmBr, g->cont);
+    break;
+  case ReturnOp:
+    if (n->a && g->fn && g->fn->ret_kind != VoidV) {
+      wasm_expr_as(g, n->a, g->fn->ret_kind, true);
+    } else if (n->a) {
+      wasm_expr(g, n->a, false);
+    }
+    wasm_leave(g);
+    wasm_op(g, WasmReturn);
+    break;
+  case ZeroOp:
+    wasm_op_idx(g, WasmLocalGet, g->fp);
+    if (n->x) {
+      wasm_i32(g, n->x);
+      wasm_op(g, WasmI32Add);
+    }
+    wasm_i32(g, 0);
+    wasm_i32(g, n->k);
+    wasm_bulk(g, WasmMemoryFill);
+    break;
+  default:
+    wasm_expr(g, n, false);
+    break;
+  }
+  memcpy(g->temps_used, used, sizeof(used));
+}
+
+/*
+ * Functions
+ */
+
+/*
+ * Compiles fn, or the initializers for NULL, appending its entry of the
+ * code section to out.
+ */
+void wasm_fn(struct wasm_gen *g, struct interp_fn *fn, struct wasm_buf *out) {
+  struct wasm_buf head;
+  int result = fn ? wasm_type(fn->ret_kind) : 0;
+  int i, runs;
+
+  g->fn = fn;
+  g->code.len = 0;
+  g->params_len = fn ? fn->params_len : 0;
+  g->locals_len = 0;
+  g->slot_locals_len = 0;
+  g->fp = -1;
+  g->frame_size = 0;
+  g->depth = 0;
+  g->brk = g->cont = -1;
+  for (i = 0; i < 4; i++) {
+    g->temps_len[i] = g->temps_used[i] = 0;
+  }
+  free(g->promoted);
+  g->promoted = fn ? slot_promotable(fn) : NULL;
+
+  for (i = 0; fn && i < fn->slots_len; i++) {
+    if (!g->promoted[i]) {
+      g->frame_size = (fn->frame_size + 15) / 16 * 16;
+    }
+  }
+  if (g->frame_size) {
+    /* the stack grows down to the data, past which it has overflowed */
+    g->fp = wasm_new_local(g, WasmI32);
+    wasm_op_idx(g, WasmGlobalGet, WASM_SP);
+    wasm_i32(g, g->frame_size);
+    wasm_op(g, WasmI32Sub);
+    wasm_op_idx(g, WasmLocalTee, g->fp);
+    wasm_op_idx(g, WasmGlobalSet, WASM_SP);
+    wasm_op_idx(g, WasmLocalGet, g->fp);
+    wasm_i32(g, g->data_end);
+    wasm_op(g, WasmI32LtU);
+    wasm_op(g, WasmIf);
+    wasm_byte(&g->code, WasmVoid);
+    wasm_op(g, WasmUnreachable);
+    wasm_op(g, WasmEnd);
+  }
+
+  /* params held in the frame are stored there */
+  for (i = 0; i < g->params_len; i++) {
+    if (g->promoted[i]) {
+      continue;
+    }
+    wasm_op_idx(g, WasmLocalGet, g->fp);
+    if (fn->param_kind[i] == AggV) {
+      wasm_i32(g, fn->param_off[i]);
+      wasm_op(g, WasmI32Add);
+      wasm_op_idx(g, WasmLocalGet, i);
+      wasm_op(g, WasmI32WrapI64);
+      wasm_i32(g, fn->param_size[i]);
+      wasm_bulk(g, WasmMemoryCopy);
+    } else {
+      wasm_op_idx(g, WasmLocalGet, i);
+      wasm_store(g, fn->param_kind[i], fn->param_off[i]);
+    }
+  }
+
+  if (fn) {
+    wasm_stmt(g, fn->body);
+  } else {
+    for (i = 0; i < g->in->inits_len; i++) {
+      wasm_stmt(g, g->in->inits[i]);
+    }
+  }
+  wasm_leave(g);
+  if (result) {
+    /* falling off the end returns 0, as in the interpreter */
+    wasm_zero(g, result);
+  }
+  wasm_op(g, WasmEnd);
+
+  /* locals are declared in runs of a type */
+  memset(&head, 0, sizeof(head));
+  for (i = 0, runs = 0; i < g->locals_len; i++) {
+    runs += !i || g->locals[i] != g->locals[i - 1];
+  }
+  wasm_uleb(&head, runs);
+  for (i = 0; i < g->locals_len;) {
+    int j = i;
+    for (; j < g->locals_len && g->locals[j] == g->locals[i]; j++) {
+    }
+    wasm_uleb(&head, j - i);
+    wasm_byte(&head, g->locals[i]);
+    i = j;
+  }
+  wasm_uleb(out, head.len + g->code.len);
+  wasm_bytes(out, head.data, head.len);
+  wasm_bytes(out, g->code.data, g->code.len);
+  free(head.data);
+}
+
+/*
+ * Module
+ */
+
+/* Writes a constant expression of an i32 */
+void wasm_init_expr(struct wasm_buf *b, long v) {
+  wasm_byte(b, WasmI32Const);
+  wasm_sleb(b, (int)v);
+  wasm_byte(b, WasmEnd);
+}
+
+/* Returns whether the len bytes at p are all 0 */
+bool wasm_zeroed(const char *p, long len) {
+  long i;
+  for (i = 0; i < len && !p[i]; i++) {
+  }
+  return i == len;
+}
+
+struct wasm_buf wasm_compile(struct interp *in) {
+  struct wasm_gen g;
+  struct wasm_buf out, sec, code;
+  int *fn_sigs = malloc((in->fns_len + 1) * sizeof(int));
+  int import_sigs[ImportsLen];
+  int init_sig, segs;
+  long heap_base;
+  int i;
+
+  memset(&g, 0, sizeof(g));
+  memset(&out, 0, sizeof(out));
+  memset(&sec, 0, sizeof(sec));
+  memset(&code, 0, sizeof(code));
+  g.in = in;
+  wasm_place(&g);
+  heap_base = g.data_end + WASM_STACK;
+
+  for (i = 0; i < ImportsLen; i++) {
+    import_sigs[i] = wasm_import_sig(&g, i);
+  }
+  for (i = 0; i < in->fns_len; i++) {
+    fn_sigs[i] = wasm_fn_sig(&g, in->fns[i]);
+  }
+  init_sig = wasm_sig(&g, (unsigned char *)"", 0, 0);
+
+  wasm_uleb(&code, in->fns_len + 1);
+  for (i = 0; i < in->fns_len; i++) {
+    wasm_fn(&g, in->fns[i], &code);
+  }
+  wasm_fn(&g, NULL, &code);
+
+  wasm_bytes(&out, "\0asm\1\0\0\0", 8);
+
+  wasm_uleb(&sec, g.sigs_len);
+  for (i = 0; i < g.sigs_len; i++) {
+    wasm_byte(&sec, WASM_FUNCTYPE);
+    wasm_uleb(&sec, g.sigs[i].params_len);
+    wasm_bytes(&sec, g.sigs[i].params, g.sigs[i].params_len);
+    wasm_uleb(&sec, g.sigs[i].result != 0);
+    if (g.sigs[i].result) {
+      wasm_byte(&sec, g.sigs[i].result);
+    }
+  }
+  wasm_section(&out, TypeSec, &sec);
+
+  sec.len = 0;
+  wasm_uleb(&sec, ImportsLen);
+  for (i = 0; i < ImportsLen; i++) {
+    wasm_name(&sec, "env");
+    wasm_name(&sec, wasm_import_names[i]);
+    wasm_byte(&sec, FuncExt);
+    wasm_uleb(&sec, import_sigs[i]);
+  }
+  wasm_section(&out, ImportSec, &sec);
+
+  sec.len = 0;
+  wasm_uleb(&sec, in->fns_len + 1);
+  for (i = 0; i < in->fns_len; i++) {
+    wasm_uleb(&sec, fn_sigs[i]);
+  }
+  wasm_uleb(&sec, init_sig);
+  wasm_section(&out, FunctionSec, &sec);
+
+  /* slot 0 of the table is the null function pointer */
+  sec.len = 0;
+  wasm_uleb(&sec, 1);
+  wasm_byte(&sec, WASM_FUNCREF);
+  wasm_byte(&sec, 0);
+  wasm_uleb(&sec, in->fns_len + 1);
+  wasm_section(&out, TableSec, &sec);
+
+  /* a page past the stack starts the heap */
+  sec.len = 0;
+  wasm_uleb(&sec, 1);
+  wasm_byte(&sec, 0);
+  wasm_uleb(&sec, (heap_base + WASM_PAGE - 1) / WASM_PAGE + 1);
+  wasm_section(&out, MemorySec, &sec);
+
+  sec.len = 0;
+  wasm_uleb(&sec, 2);
+  wasm_byte(&sec, WasmI32);
+  wasm_byte(&sec, 1);
+  wasm_init_expr(&sec, heap_base);
+  wasm_byte(&sec, WasmI32);
+  wasm_byte(&sec, 0);
+  wasm_init_expr(&sec, heap_base);
+  wasm_section(&out, GlobalSec, &sec);
+
+  sec.len = 0;
+  wasm_uleb(&sec, in->fns_len + 3);
+  wasm_name(&sec, "memory");
+  wasm_byte(&sec, MemExt);
+  wasm_uleb(&sec, 0);
+  wasm_name(&sec, "__stack_pointer");
+  wasm_byte(&sec, GlobalExt);
+  wasm_uleb(&sec, WASM_SP);
+  wasm_name(&sec, "__heap_base");
+  wasm_byte(&sec, GlobalExt);
+  wasm_uleb(&sec, WASM_HEAP_BASE);
+  for (i = 0; i < in->fns_len; i++) {
+    wasm_name(&sec, in->fns[i]->name);
+    wasm_byte(&sec, FuncExt);
+    wasm_uleb(&sec, ImportsLen + i);
+  }
+  wasm_section(&out, ExportSec, &sec);
+
+  sec.len = 0;
+  wasm_uleb(&sec, ImportsLen + in->fns_len);
+  wasm_section(&out, StartSec, &sec);
+
+  sec.len = 0;
+  wasm_uleb(&sec, 1);
+  wasm_uleb(&sec, 0);
+  wasm_init_expr(&sec, 1);
+  wasm_uleb(&sec, in->fns_len);
+  for (i = 0; i < in->fns_len; i++) {
+    wasm_uleb(&sec, ImportsLen + i);
+  }
+  wasm_section(&out, ElemSec, &sec);
+
+  wasm_section(&out, CodeSec, &code);
+
+  /* objects are 0 until initialized but for string literals */
+  sec.len = 0;
+  for (i = 0, segs = 0; i < g.objs_len; i++) {
+    segs += !wasm_zeroed(g.objs[i].p, g.objs[i].size);
+  }
+  wasm_uleb(&sec, segs);
+  for (i = 0; i < g.objs_len; i++) {
+    if (wasm_zeroed(g.objs[i].p, g.objs[i].size)) {
+      continue;
+    }
+    wasm_uleb(&sec, 0);
+    wasm_init_expr(&sec, g.objs[i].addr);
+    wasm_uleb(&sec, g.objs[i].size);
+    wasm_bytes(&sec, g.objs[i].p, g.objs[i].size);
+  }
+  wasm_section(&out, DataSec, &sec);
+
+  for (i = 0; i < g.sigs_len; i++) {
+    free(g.sigs[i].params);
+  }
+  for (i = 0; i < 4; i++) {
+    free(g.temps[i]);
+  }
+  free(g.sigs);
+  free(g.objs);
+  free(g.locals);
+  free(g.promoted);
+  free(g.slot_locals);
+  free(g.code.data);
+  free(fn_sigs);
+  free(sec.data);
+  free(code.data);
+  return out;
+}
@@ -0,0 +1,308 @@
+#ifndef CHOCC_WASM_H
+#define CHOCC_WASM_H
+#pragma once
+
+#include "chocc.h"
+#include "interp.h"
+
+/* wasm_buf is a growable byte buffer a module is written into */
+struct wasm_buf {
+  unsigned char *data;
+  long len;
+  long cap;
+};
+
+void wasm_byte(struct wasm_buf *, int byte);
+void wasm_bytes(struct wasm_buf *, const void *bytes, long len);
+/* LEB128 */
+void wasm_uleb(struct wasm_buf *, unsigned long v);
+void wasm_sleb(struct wasm_buf *, long v);
+/* a length prefixed name */
+void wasm_name(struct wasm_buf *, const char *name);
+/* Writes section id holding the bytes of content */
+void wasm_section(struct wasm_buf *, int id, struct wasm_buf *content);
+
+typedef enum wasm_valtype {
+  WasmVoid = 0x40, /* the empty block type */
+  WasmF64 = 0x7c,
+  WasmF32 = 0x7d,
+  WasmI64 = 0x7e,
+  WasmI32 = 0x7f
+} wasm_valtype;
+
+#define WASM_FUNCREF 0x70
+#define WASM_FUNCTYPE 0x60
+
+typedef enum wasm_section_id {
+  CustomSec,
+  TypeSec,
+  ImportSec,
+  FunctionSec,
+  TableSec,
+  MemorySec,
+  GlobalSec,
+  ExportSec,
+  StartSec,
+  ElemSec,
+  CodeSec,
+  DataSec
+} wasm_section_id;
+
+/* the kinds of imports and exports */
+typedef enum wasm_extern { FuncExt, TableExt, MemExt, GlobalExt } wasm_extern;
+
+/* opcodes of the MVP instruction set, and the sign extension operators */
+typedef enum wasm_opcode {
+  WasmUnreachable = 0x00,
+  WasmNop = 0x01,
+  WasmBlock = 0x02,
+  WasmLoop = 0x03,
+  WasmIf = 0x04,
+  WasmElse = 0x05,
+  WasmEnd = 0x0b,
+  WasmBr = 0x0c,
+  WasmBrIf = 0x0d,
+  WasmBrTable = 0x0e,
+  WasmReturn = 0x0f,
+  WasmCall = 0x10,
+  WasmCallIndirect = 0x11,
+  WasmDrop = 0x1a,
+  WasmSelect = 0x1b,
+  WasmLocalGet = 0x20,
+  WasmLocalSet = 0x21,
+  WasmLocalTee = 0x22,
+  WasmGlobalGet = 0x23,
+  WasmGlobalSet = 0x24,
+
+  WasmI32Load = 0x28,
+  WasmI64Load = 0x29,
+  WasmF32Load = 0x2a,
+  WasmF64Load = 0x2b,
+  WasmI32Load8S = 0x2c,
+  WasmI32Load8U = 0x2d,
+  WasmI32Load16S = 0x2e,
+  WasmI32Load16U = 0x2f,
+  WasmI64Load8S = 0x30,
+  WasmI64Load8U = 0x31,
+  WasmI64Load16S = 0x32,
+  WasmI64Load16U = 0x33,
+  WasmI64Load32S = 0x34,
+  WasmI64Load32U = 0x35,
+  WasmI32Store = 0x36,
+  WasmI64Store = 0x37,
+  WasmF32Store = 0x38,
+  WasmF64Store = 0x39,
+  WasmI32Store8 = 0x3a,
+  WasmI32Store16 = 0x3b,
+  WasmI64Store8 = 0x3c,
+  WasmI64Store16 = 0x3d,
+  WasmI64Store32 = 0x3e,
+  WasmMemorySize = 0x3f,
+  WasmMemoryGrow = 0x40,
+
+  WasmI32Const = 0x41,
+  WasmI64Const = 0x42,
+  WasmF32Const = 0x43,
+  WasmF64Const = 0x44,
+
+  /* the i64 relations follow the i32 ones at I64_REL */
+  WasmI32Eqz = 0x45,
+  WasmI32Eq = 0x46,
+  WasmI32Ne = 0x47,
+  WasmI32LtS = 0x48,
+  WasmI32LtU = 0x49,
+  WasmI32GtS = 0x4a,
+  WasmI32GtU = 0x4b,
+  WasmI32LeS = 0x4c,
+  WasmI32LeU = 0x4d,
+  WasmI32GeS = 0x4e,
+  WasmI32GeU = 0x4f,
+  WasmI64Eqz = 0x50,
+  WasmI64Eq = 0x51,
+  WasmI64Ne = 0x52,
+  WasmI64LtS = 0x53,
+  WasmI64LtU = 0x54,
+  WasmI64GtS = 0x55,
+  WasmI64GtU = 0x56,
+  WasmI64LeS = 0x57,
+  WasmI64LeU = 0x58,
+  WasmI64GeS = 0x59,
+  WasmI64GeU = 0x5a,
+
+  /* the f64 relations follow the f32 ones at F64_REL */
+  WasmF32Eq = 0x5b,
+  WasmF32Ne = 0x5c,
+  WasmF32Lt = 0x5d,
+  WasmF32Gt = 0x5e,
+  WasmF32Le = 0x5f,
+  WasmF32Ge = 0x60,
+  WasmF64Eq = 0x61,
+  WasmF64Ne = 0x62,
+  WasmF64Lt = 0x63,
+  WasmF64Gt = 0x64,
+  WasmF64Le = 0x65,
+  WasmF64Ge = 0x66,
+
+  /* the i64 arithmetic follows the i32 one at I64_ARITH */
+  WasmI32Clz = 0x67,
+  WasmI32Ctz = 0x68,
+  WasmI32Popcnt = 0x69,
+  WasmI32Add = 0x6a,
+  WasmI32Sub = 0x6b,
+  WasmI32Mul = 0x6c,
+  WasmI32DivS = 0x6d,
+  WasmI32DivU = 0x6e,
+  WasmI32RemS = 0x6f,
+  WasmI32RemU = 0x70,
+  WasmI32And = 0x71,
+  WasmI32Or = 0x72,
+  WasmI32Xor = 0x73,
+  WasmI32Shl = 0x74,
+  WasmI32ShrS = 0x75,
+  WasmI32ShrU = 0x76,
+  WasmI32Rotl = 0x77,
+  WasmI32Rotr = 0x78,
+  WasmI64Clz = 0x79,
+  WasmI64Ctz = 0x7a,
+  WasmI64Popcnt = 0x7b,
+  WasmI64Add = 0x7c,
+  WasmI64Sub = 0x7d,
+  WasmI64Mul = 0x7e,
+  WasmI64DivS = 0x7f,
+  WasmI64DivU = 0x80,
+  WasmI64RemS = 0x81,
+  WasmI64RemU = 0x82,
+  WasmI64And = 0x83,
+  WasmI64Or = 0x84,
+  WasmI64Xor = 0x85,
+  WasmI64Shl = 0x86,
+  WasmI64ShrS = 0x87,
+  WasmI64ShrU = 0x88,
+  WasmI64Rotl = 0x89,
+  WasmI64Rotr = 0x8a,
+
+  /* the f64 arithmetic follows the f32 one at F64_ARITH */
+  WasmF32Abs = 0x8b,
+  WasmF32Neg = 0x8c,
+  WasmF32Ceil = 0x8d,
+  WasmF32Floor = 0x8e,
+  WasmF32Trunc = 0x8f,
+  WasmF32Nearest = 0x90,
+  WasmF32Sqrt = 0x91,
+  WasmF32Add = 0x92,
+  WasmF32Sub = 0x93,
+  WasmF32Mul = 0x94,
+  WasmF32Div = 0x95,
+  WasmF32Min = 0x96,
+  WasmF32Max = 0x97,
+  WasmF32Copysign = 0x98,
+  WasmF64Abs = 0x99,
+  WasmF64Neg = 0x9a,
+  WasmF64Ceil = 0x9b,
+  WasmF64Floor = 0x9c,
+  WasmF64Trunc = 0x9d,
+  WasmF64Nearest = 0x9e,
+  WasmF64Sqrt = 0x9f,
+  WasmF64Add = 0xa0,
+  WasmF64Sub = 0xa1,
+  WasmF64Mul = 0xa2,
+  WasmF64Div = 0xa3,
+  WasmF64Min = 0xa4,
+  WasmF64Max = 0xa5,
+  WasmF64Copysign = 0xa6,
+
+  WasmI32WrapI64 = 0xa7,
+  WasmI32TruncF32S = 0xa8,
+  WasmI32TruncF32U = 0xa9,
+  WasmI32TruncF64S = 0xaa,
+  WasmI32TruncF64U = 0xab,
+  WasmI64ExtendI32S = 0xac,
+  WasmI64ExtendI32U = 0xad,
+  WasmI64TruncF32S = 0xae,
+  WasmI64TruncF32U = 0xaf,
+  WasmI64TruncF64S = 0xb0,
+  WasmI64TruncF64U = 0xb1,
+  WasmF32ConvertI32S = 0xb2,
+  WasmF32ConvertI32U = 0xb3,
+  WasmF32ConvertI64S = 0xb4,
+  WasmF32ConvertI64U = 0xb5,
+  WasmF32DemoteF64 = 0xb6,
+  WasmF64ConvertI32S = 0xb7,
+  WasmF64ConvertI32U = 0xb8,
+  WasmF64ConvertI64S = 0xb9,
+  WasmF64ConvertI64U = 0xba,
+  WasmF64PromoteF32 = 0xbb,
+  WasmI32ReinterpretF32 = 0xbc,
+  WasmI64ReinterpretF64 = 0xbd,
+  WasmF32ReinterpretI32 = 0xbe,
+  WasmF64ReinterpretI64 = 0xbf,
+  WasmI32Extend8S = 0xc0,
+  WasmI32Extend16S = 0xc1,
+  WasmI64Extend8S = 0xc2,
+  WasmI64Extend16S = 0xc3,
+  WasmI64Extend32S = 0xc4,
+
+  /* prefixes the bulk memory operations */
+  WasmPrefixFC = 0xfc
+} wasm_opcode;
+
+/* operations after WasmPrefixFC, copies and fills being memmove and memset */
+typedef enum wasm_fc_opcode {
+  /* the saturating truncations, in the order of WasmI32TruncF32S on */
+  WasmI32TruncSatF32S = 0,
+  WasmI64TruncSatF64U = 7,
+  WasmMemoryCopy = 10, /* [dst src n] -> [] */
+  WasmMemoryFill = 11  /* [dst byte n] -> [] */
+} wasm_fc_opcode;
+
+#define I64_REL (WasmI64Eqz - WasmI32Eqz)
+#define F64_REL (WasmF64Ne - WasmF32Ne)
+#define I64_ARITH (WasmI64Add - WasmI32Add)
+#define F64_ARITH (WasmF64Abs - WasmF32Abs)
+
+/*
+ * wasm_import enumerates the functions a module imports from "env", in
+ * order, for the builtins it cannot compute itself. Pointers and sizes are
+ * i32 addresses of linear memory. printf takes its variadic args as 8 byte
+ * slots at its second param, i64 or f64 as the format says.
+ */
+typedef enum wasm_import {
+  PrintfW,  /* (i32 fmt, i32 args) -> i32 */
+  PutcharW, /* (i32) -> i32 */
+  PutsW,    /* (i32 s) -> i32 */
+  MallocW,  /* (i32 size) -> i32 */
+  CallocW,  /* (i32 n, i32 size) -> i32 */
+  FreeW,    /* (i32 p) */
+  StrlenW,  /* (i32 s) -> i32 */
+  ExitW,    /* (i32 status) */
+  ImportsLen
+} wasm_import;
+
+extern const char *wasm_import_names[];
+/* the params and result of each import, i for i32, as in "ii:i" */
+extern const char *wasm_import_types[];
+
+/*
+ * Linear memory holds nothing below WASM_DATA, so null pointers fault, then
+ * the strings, globals and statics, then a stack of WASM_STACK bytes the
+ * exported global __stack_pointer moves down, then the heap from the
+ * exported global __heap_base.
+ */
+#define WASM_PAGE 65536L
+#define WASM_DATA 1024L
+#define WASM_STACK (1L << 20)
+
+/* the globals of a module */
+#define WASM_SP 0
+#define WASM_HEAP_BASE 1
+
+/*
+ * Compiles the program loaded by in to a binary module. C functions are
+ * exported by name and run with their params and promoted scalars in wasm
+ * locals; aggregates and objects whose address is taken live in linear
+ * memory. The initializers of globals run as the start function. Function
+ * pointers index the table from 1.
+ */
+struct wasm_buf wasm_compile(struct interp *in);
+
+#endif
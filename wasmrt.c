@@ -0,0 +1,2376 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "wasmrt.h"
+#include "interp.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Reading
+ */
+
+/* wasm_reader reads a module, failing every read after the first error */
+struct wasm_reader {
+  const unsigned char *p;
+  const unsigned char *end;
+  const char *err;
+};
+
+/* Records the first error and skips to the end */
+void wasm_error(struct wasm_reader *r, const char *msg) {
+  if (!r->err) {
+    r->err = msg;
+  }
+  r->p = r->end;
+}
+
+int wasm_read_byte(struct wasm_reader *r) {
+  if (r->p >= r->end) {
+    wasm_error(r, "unexpected end");
+    return 0;
+  }
+  return *r->p++;
+}
+
+/* Returns the next len bytes, or NULL */
+const unsigned char *wasm_read_bytes(struct wasm_reader *r, long len) {
+  const unsigned char *p = r->p;
+
+  if (len > r->end - r->p) {
+    wasm_error(r, "unexpected end");
+    return NULL;
+  }
+  r->p += len;
+  return p;
+}
+
+/* Reads an unsigned LEB128 of at most bits */
+unsigned long wasm_read_uleb(struct wasm_reader *r, int bits) {
+  unsigned long v = 0;
+  int shift = 0;
+  int byte;
+
+  for (;;) {
+    byte = wasm_read_byte(r);
+    if (r->err) {
+      return 0;
+    }
+    if (shift + 7 > bits && (byte & 0x7f) >> (bits - shift)) {
+      wasm_error(r, "integer too large");
+      return 0;
+    }
+    v |= (unsigned long)(byte & 0x7f) << shift;
+    shift += 7;
+    if (!(byte & 0x80)) {
+      return v;
+    }
+    if (shift >= bits) {
+      wasm_error(r, "integer representation too long");
+      return 0;
+    }
+  }
+}
+
+/* Reads a signed LEB128 of at most bits */
+long wasm_read_sleb(struct wasm_reader *r, int bits) {
+  unsigned long v = 0;
+  int shift = 0;
+  int byte;
+
+  for (;;) {
+    byte = wasm_read_byte(r);
+    if (r->err) {
+      return 0;
+    }
+    if (shift + 7 > bits) {
+      /* the bits past the width must extend the sign */
+      int rest = (byte & 0x7f) >> (bits - shift - 1);
+      if ((byte & 0x80) || (rest && rest != 0x7f >> (bits - shift - 1))) {
+        wasm_error(r, "integer too large");
+        return 0;
+      }
+    }
+    v |= (unsigned long)(byte & 0x7f) << shift;
+    shift += 7;
+    if (!(byte & 0x80)) {
+      break;
+    }
+  }
+  if (shift < 64 && (byte & 0x40)) {
+    v |= ~0UL << shift;
+  }
+  return bits == 32 ? (long)(int)v : (long)v;
+}
+
+int wasm_read_u32(struct wasm_reader *r) {
+  unsigned long v = wasm_read_uleb(r, 32);
+  if (v > 0x7fffffffUL) {
+    wasm_error(r, "index too large");
+    return 0;
+  }
+  return (int)v;
+}
+
+/* Reads the length of a vector of items of at least size bytes each */
+int wasm_read_count(struct wasm_reader *r, long size) {
+  int n = wasm_read_u32(r);
+  if (n > (r->end - r->p) / size) {
+    wasm_error(r, "vector longer than its section");
+    return 0;
+  }
+  return n;
+}
+
+char *wasm_read_name(struct wasm_reader *r) {
+  int len = wasm_read_count(r, 1);
+  const unsigned char *p = wasm_read_bytes(r, len);
+  char *s = malloc(len + 1);
+
+  if (p) {
+    memcpy(s, p, len);
+  }
+  s[p ? len : 0] = '\0';
+  return s;
+}
+
+int wasm_read_valtype(struct wasm_reader *r) {
+  int t = wasm_read_byte(r);
+  switch (t) {
+  case WasmI32:
+  case WasmI64:
+  case WasmF32:
+  case WasmF64:
+    return t;
+  default:
+    wasm_error(r, "unknown value type");
+    return WasmI32;
+  }
+}
+
+void wasm_read_limits(struct wasm_reader *r, struct wasm_limits *l,
+                      long most) {
+  int flag = wasm_read_byte(r);
+
+  if (flag > 1) {
+    wasm_error(r, "unknown limits");
+  }
+  l->min = (long)wasm_read_uleb(r, 32);
+  l->max = flag == 1 ? (long)wasm_read_uleb(r, 32) : -1;
+  if (l->min > most || l->max > most) {
+    wasm_error(r, "limits too large");
+  } else if (l->max >= 0 && l->max < l->min) {
+    wasm_error(r, "maximum below minimum");
+  }
+}
+
+/* Reads a constant expression of valtype t into v */
+void wasm_read_const(struct wasm_reader *r, int t, wasm_value *v) {
+  const unsigned char *p;
+  int op = wasm_read_byte(r);
+  int type = 0;
+
+  memset(v, 0, sizeof(*v));
+  switch (op) {
+  case WasmI32Const:
+    v->i32 = (int)wasm_read_sleb(r, 32);
+    type = WasmI32;
+    break;
+  case WasmI64Const:
+    v->i64 = wasm_read_sleb(r, 64);
+    type = WasmI64;
+    break;
+  case WasmF32Const:
+    if ((p = wasm_read_bytes(r, 4))) {
+      memcpy(&v->f32, p, 4);
+    }
+    type = WasmF32;
+    break;
+  case WasmF64Const:
+    if ((p = wasm_read_bytes(r, 8))) {
+      memcpy(&v->f64, p, 8);
+    }
+    type = WasmF64;
+    break;
+  default:
+    /* no globals are imported for global.get to read */
+    wasm_error(r, "constant expression required");
+    return;
+  }
+  if (type != t) {
+    wasm_error(r, "type mismatch in constant expression");
+  }
+  if (wasm_read_byte(r) != WasmEnd) {
+    wasm_error(r, "constant expression required");
+  }
+}
+
+/*
+ * Validation
+ */
+
+/* a block, loop, if or else being validated, or the function body */
+struct wasm_ctrl {
+  int op;
+  int result; /* a valtype, or 0 */
+  int height; /* of the operand stack at its start */
+  bool unreachable;
+
+  /*
+   * Branches to the end, chained through wasm_branch.pc until it is
+   * reached, or -1. Loops are branched to at pc and next instead.
+   */
+  int pending;
+  int pc;
+  int next;
+  int if_branch; /* taken by an if that is false, or -1 */
+};
+
+/*
+ * wasm_checker type checks a function body as the spec's validation
+ * algorithm does. Operands of unreachable code are of type 0, unknown.
+ * Every branch it checks is added to the function's side table.
+ */
+struct wasm_checker {
+  struct wasm_reader *r;
+  struct wasm_module *m;
+  struct wasm_code *code;
+
+  unsigned char *vals;
+  int vals_len;
+  int vals_cap;
+  int vals_max;
+
+  struct wasm_ctrl *ctrls;
+  int ctrls_len;
+  int ctrls_cap;
+
+  struct wasm_branch *branches;
+  int branches_len;
+  int branches_cap;
+};
+
+void wasm_check_push(struct wasm_checker *c, int t) {
+  if (c->vals_len == c->vals_cap) {
+    c->vals_cap = c->vals_cap ? c->vals_cap * 2 : 64;
+    c->vals = realloc(c->vals, c->vals_cap);
+  }
+  c->vals[c->vals_len++] = t;
+  if (c->vals_len > c->vals_max) {
+    c->vals_max = c->vals_len;
+  }
+}
+
+int wasm_check_pop(struct wasm_checker *c) {
+  struct wasm_ctrl *f = c->ctrls + c->ctrls_len - 1;
+
+  if (c->vals_len == f->height) {
+    if (!f->unreachable) {
+      wasm_error(c->r, "type mismatch: stack underflow");
+    }
+    return 0;
+  }
+  return c->vals[--c->vals_len];
+}
+
+/* Pops an operand of type t, returning its type */
+int wasm_check_pop_type(struct wasm_checker *c, int t) {
+  int a = wasm_check_pop(c);
+
+  if (a && t && a != t) {
+    wasm_error(c->r, "type mismatch");
+  }
+  return a ? a : t;
+}
+
+void wasm_check_push_ctrl(struct wasm_checker *c, int op, int result) {
+  struct wasm_ctrl *f;
+
+  if (c->ctrls_len == c->ctrls_cap) {
+    c->ctrls_cap = c->ctrls_cap ? c->ctrls_cap * 2 : 16;
+    c->ctrls = realloc(c->ctrls, c->ctrls_cap * sizeof(*c->ctrls));
+  }
+  f = c->ctrls + c->ctrls_len++;
+  f->op = op;
+  f->result = result;
+  f->height = c->vals_len;
+  f->unreachable = false;
+  f->pending = -1;
+  f->pc = c->r->p - c->code->body;
+  f->next = c->branches_len;
+  f->if_branch = -1;
+}
+
+struct wasm_ctrl wasm_check_pop_ctrl(struct wasm_checker *c) {
+  struct wasm_ctrl f = c->ctrls[c->ctrls_len - 1];
+
+  if (f.result) {
+    wasm_check_pop_type(c, f.result);
+  }
+  if (c->vals_len != f.height) {
+    wasm_error(c->r, "type mismatch: values left on the stack");
+  }
+  c->ctrls_len--;
+  return f;
+}
+
+/* Marks the rest of the block unreachable */
+void wasm_check_unreachable(struct wasm_checker *c) {
+  struct wasm_ctrl *f = c->ctrls + c->ctrls_len - 1;
+  c->vals_len = f->height;
+  f->unreachable = true;
+}
+
+/* Returns the type a branch to f carries, or 0 */
+int wasm_label_type(struct wasm_ctrl *f) {
+  return f->op == WasmLoop ? 0 : f->result;
+}
+
+/* Reads a label, returning the block it labels or NULL */
+struct wasm_ctrl *wasm_check_label(struct wasm_checker *c) {
+  int l = wasm_read_u32(c->r);
+
+  if (l >= c->ctrls_len) {
+    wasm_error(c->r, "unknown label");
+    return NULL;
+  }
+  return c->ctrls + c->ctrls_len - 1 - l;
+}
+
+/* Adds a branch that keeps keep values and drops drop, returning it */
+int wasm_add_branch(struct wasm_checker *c, int keep, int drop) {
+  struct wasm_branch *b;
+
+  if (c->branches_len == c->branches_cap) {
+    c->branches_cap = c->branches_cap ? c->branches_cap * 2 : 16;
+    c->branches =
+        realloc(c->branches, c->branches_cap * sizeof(*c->branches));
+  }
+  b = c->branches + c->branches_len;
+  b->pc = -1;
+  b->next = -1;
+  b->keep = keep;
+  b->drop = drop;
+  return c->branches_len++;
+}
+
+/* Adds a branch to the block f labels from the current operand stack */
+void wasm_check_branch(struct wasm_checker *c, struct wasm_ctrl *f) {
+  int keep = wasm_label_type(f) != 0;
+  int drop = c->vals_len - f->height - keep;
+  /* unreachable code may have fewer operands, but is never run */
+  int b = wasm_add_branch(c, keep, drop > 0 ? drop : 0);
+
+  if (f->op == WasmLoop) {
+    c->branches[b].pc = f->pc;
+    c->branches[b].next = f->next;
+  } else {
+    c->branches[b].pc = f->pending;
+    f->pending = b;
+  }
+}
+
+/* Lands the chain of branches from b at pc */
+void wasm_resolve(struct wasm_checker *c, int b, int pc) {
+  while (b >= 0) {
+    int chained = c->branches[b].pc;
+    c->branches[b].pc = pc;
+    c->branches[b].next = c->branches_len;
+    b = chained;
+  }
+}
+
+int wasm_check_blocktype(struct wasm_reader *r) {
+  if (r->p < r->end && *r->p == WasmVoid) {
+    r->p++;
+    return 0;
+  }
+  return wasm_read_valtype(r);
+}
+
+/* Pops the params of a call of type and pushes its result */
+void wasm_check_call(struct wasm_checker *c, struct wasm_functype *type) {
+  int i;
+
+  for (i = type->params_len - 1; i >= 0; i--) {
+    wasm_check_pop_type(c, type->params[i]);
+  }
+  if (type->result) {
+    wasm_check_push(c, type->result);
+  }
+}
+
+/* the type of each operand and result of a range of numeric opcodes */
+#define NUMERIC(lo, hi, x, y, z)                                               \
+  if (op >= (lo) && op <= (hi)) {                                              \
+    *a = (x);                                                                  \
+    *b = (y);                                                                  \
+    *t = (z);                                                                  \
+    return true;                                                               \
+  }
+
+/*
+ * Sets the operand types a and b, 0 if op is unary, and the result t of
+ * numeric op. Returns false if op is not numeric.
+ */
+bool wasm_numeric_sig(int op, int *a, int *b, int *t) {
+  NUMERIC(0x45, 0x45, WasmI32, 0, WasmI32)
+  NUMERIC(0x46, 0x4f, WasmI32, WasmI32, WasmI32)
+  NUMERIC(0x50, 0x50, WasmI64, 0, WasmI32)
+  NUMERIC(0x51, 0x5a, WasmI64, WasmI64, WasmI32)
+  NUMERIC(0x5b, 0x60, WasmF32, WasmF32, WasmI32)
+  NUMERIC(0x61, 0x66, WasmF64, WasmF64, WasmI32)
+  NUMERIC(0x67, 0x69, WasmI32, 0, WasmI32)
+  NUMERIC(0x6a, 0x78, WasmI32, WasmI32, WasmI32)
+  NUMERIC(0x79, 0x7b, WasmI64, 0, WasmI64)
+  NUMERIC(0x7c, 0x8a, WasmI64, WasmI64, WasmI64)
+  NUMERIC(0x8b, 0x91, WasmF32, 0, WasmF32)
+  NUMERIC(0x92, 0x98, WasmF32, WasmF32, WasmF32)
+  NUMERIC(0x99, 0x9f, WasmF64, 0, WasmF64)
+  NUMERIC(0xa0, 0xa6, WasmF64, WasmF64, WasmF64)
+  NUMERIC(0xa7, 0xa7, WasmI64, 0, WasmI32)
+  NUMERIC(0xa8, 0xa9, WasmF32, 0, WasmI32)
+  NUMERIC(0xaa, 0xab, WasmF64, 0, WasmI32)
+  NUMERIC(0xac, 0xad, WasmI32, 0, WasmI64)
+  NUMERIC(0xae, 0xaf, WasmF32, 0, WasmI64)
+  NUMERIC(0xb0, 0xb1, WasmF64, 0, WasmI64)
+  NUMERIC(0xb2, 0xb3, WasmI32, 0, WasmF32)
+  NUMERIC(0xb4, 0xb5, WasmI64, 0, WasmF32)
+  NUMERIC(0xb6, 0xb6, WasmF64, 0, WasmF32)
+  NUMERIC(0xb7, 0xb8, WasmI32, 0, WasmF64)
+  NUMERIC(0xb9, 0xba, WasmI64, 0, WasmF64)
+  NUMERIC(0xbb, 0xbb, WasmF32, 0, WasmF64)
+  NUMERIC(0xbc, 0xbc, WasmF32, 0, WasmI32)
+  NUMERIC(0xbd, 0xbd, WasmF64, 0, WasmI64)
+  NUMERIC(0xbe, 0xbe, WasmI32, 0, WasmF32)
+  NUMERIC(0xbf, 0xbf, WasmI64, 0, WasmF64)
+  /* the sign extension operators */
+  NUMERIC(0xc0, 0xc1, WasmI32, 0, WasmI32)
+  NUMERIC(0xc2, 0xc4, WasmI64, 0, WasmI64)
+  return false;
+}
+
+#undef NUMERIC
+
+/* the type and log2 of the width of a range of loads or stores */
+#define ACCESS(lo, hi, type, width)                                            \
+  if (op >= (lo) && op <= (hi)) {                                              \
+    *t = (type);                                                               \
+    return (width);                                                            \
+  }
+
+/* Sets the type t of load or store op, returning its natural alignment */
+int wasm_access_sig(int op, int *t) {
+  ACCESS(0x28, 0x28, WasmI32, 2)
+  ACCESS(0x29, 0x29, WasmI64, 3)
+  ACCESS(0x2a, 0x2a, WasmF32, 2)
+  ACCESS(0x2b, 0x2b, WasmF64, 3)
+  ACCESS(0x2c, 0x2d, WasmI32, 0)
+  ACCESS(0x2e, 0x2f, WasmI32, 1)
+  ACCESS(0x30, 0x31, WasmI64, 0)
+  ACCESS(0x32, 0x33, WasmI64, 1)
+  ACCESS(0x34, 0x35, WasmI64, 2)
+  ACCESS(0x36, 0x36, WasmI32, 2)
+  ACCESS(0x37, 0x37, WasmI64, 3)
+  ACCESS(0x38, 0x38, WasmF32, 2)
+  ACCESS(0x39, 0x39, WasmF64, 3)
+  ACCESS(0x3a, 0x3a, WasmI32, 0)
+  ACCESS(0x3b, 0x3b, WasmI32, 1)
+  ACCESS(0x3c, 0x3c, WasmI64, 0)
+  ACCESS(0x3d, 0x3d, WasmI64, 1)
+  ACCESS(0x3e, 0x3e, WasmI64, 2)
+  *t = 0;
+  return 0;
+}
+
+#undef ACCESS
+
+/* locals a function may declare */
+#define WASM_LOCALS 50000
+
+/* Validates an instruction of WasmPrefixFC */
+void wasm_check_fc(struct wasm_checker *c, int op) {
+  struct wasm_reader *r = c->r;
+
+  switch (op) {
+  case WasmMemoryCopy:
+  case WasmMemoryFill:
+    if (wasm_read_byte(r) ||
+        (op == WasmMemoryCopy && wasm_read_byte(r)) || !c->m->has_memory) {
+      wasm_error(r, "unknown memory");
+      break;
+    }
+    wasm_check_pop_type(c, WasmI32);
+    wasm_check_pop_type(c, WasmI32);
+    wasm_check_pop_type(c, WasmI32);
+    break;
+  default:
+    /* the saturating truncations, from f32 or f64 to i32 or i64 */
+    if (op < 0 || op > 7) {
+      wasm_error(r, "unknown opcode");
+      break;
+    }
+    wasm_check_pop_type(c, op & 2 ? WasmF64 : WasmF32);
+    wasm_check_push(c, op & 4 ? WasmI64 : WasmI32);
+    break;
+  }
+}
+
+/* Validates one instruction of opcode op */
+void wasm_check_insn(struct wasm_checker *c, int op) {
+  struct wasm_reader *r = c->r;
+  struct wasm_module *m = c->m;
+  struct wasm_ctrl f, *g;
+  int a, b, t, i = 0, n;
+
+  switch (op) {
+  case WasmUnreachable:
+    wasm_check_unreachable(c);
+    break;
+  case WasmNop:
+    break;
+  case WasmBlock:
+  case WasmLoop:
+  case WasmIf:
+    t = wasm_check_blocktype(r);
+    if (op == WasmIf) {
+      wasm_check_pop_type(c, WasmI32);
+      i = wasm_add_branch(c, 0, 0);
+    }
+    wasm_check_push_ctrl(c, op, t);
+    if (op == WasmIf) {
+      c->ctrls[c->ctrls_len - 1].if_branch = i;
+    }
+    break;
+  case WasmElse:
+    if (c->ctrls[c->ctrls_len - 1].op != WasmIf) {
+      wasm_error(r, "else without if");
+      break;
+    }
+    f = wasm_check_pop_ctrl(c);
+    /* a false if lands past the branch the then arm ends in */
+    c->branches[f.if_branch].pc = r->p - c->code->body;
+    c->branches[f.if_branch].next = c->branches_len + 1;
+    wasm_check_push_ctrl(c, WasmElse, f.result);
+    c->ctrls[c->ctrls_len - 1].pending = f.pending;
+    wasm_check_branch(c, c->ctrls + c->ctrls_len - 1);
+    break;
+  case WasmEnd:
+    f = wasm_check_pop_ctrl(c);
+    if (f.op == WasmIf && f.result) {
+      wasm_error(r, "type mismatch: if without else has a result");
+    }
+    if (f.if_branch >= 0) {
+      c->branches[f.if_branch].pc = f.pending;
+      f.pending = f.if_branch;
+    }
+    /* branches out of the function land on its end, which returns */
+    wasm_resolve(c, f.pending,
+                 r->p - c->code->body - (c->ctrls_len ? 0 : 1));
+    if (f.result) {
+      wasm_check_push(c, f.result);
+    }
+    break;
+  case WasmBr:
+    if ((g = wasm_check_label(c))) {
+      wasm_check_branch(c, g);
+      if ((t = wasm_label_type(g))) {
+        wasm_check_pop_type(c, t);
+      }
+    }
+    wasm_check_unreachable(c);
+    break;
+  case WasmBrIf:
+    g = wasm_check_label(c);
+    wasm_check_pop_type(c, WasmI32);
+    if (g) {
+      wasm_check_branch(c, g);
+      if ((t = wasm_label_type(g))) {
+        wasm_check_pop_type(c, t);
+        wasm_check_push(c, t);
+      }
+    }
+    break;
+  case WasmBrTable:
+    n = wasm_read_count(r, 1);
+    wasm_check_pop_type(c, WasmI32);
+    t = -1;
+    for (i = 0; i <= n && !r->err; i++) {
+      if (!(g = wasm_check_label(c))) {
+        break;
+      }
+      wasm_check_branch(c, g);
+      a = wasm_label_type(g);
+      if (t >= 0 && a != t) {
+        wasm_error(r, "type mismatch: br_table labels differ");
+      }
+      t = a;
+    }
+    if (t > 0) {
+      wasm_check_pop_type(c, t);
+    }
+    wasm_check_unreachable(c);
+    break;
+  case WasmReturn:
+    if ((t = c->ctrls[0].result)) {
+      wasm_check_pop_type(c, t);
+    }
+    wasm_check_unreachable(c);
+    break;
+  case WasmCall:
+    i = wasm_read_u32(r);
+    if (i >= m->fns_len) {
+      wasm_error(r, "unknown function");
+      break;
+    }
+    wasm_check_call(c, m->types + m->fn_types[i]);
+    break;
+  case WasmCallIndirect:
+    i = wasm_read_u32(r);
+    if (i >= m->types_len) {
+      wasm_error(r, "unknown type");
+      break;
+    }
+    if (wasm_read_byte(r) || !m->has_table) {
+      wasm_error(r, "unknown table");
+      break;
+    }
+    wasm_check_pop_type(c, WasmI32);
+    wasm_check_call(c, m->types + i);
+    break;
+
+  case WasmDrop:
+    wasm_check_pop(c);
+    break;
+  case WasmSelect:
+    wasm_check_pop_type(c, WasmI32);
+    a = wasm_check_pop(c);
+    b = wasm_check_pop_type(c, a);
+    wasm_check_push(c, a ? a : b);
+    break;
+  case WasmLocalGet:
+  case WasmLocalSet:
+  case WasmLocalTee:
+    i = wasm_read_u32(r);
+    if (i >= c->code->locals_len) {
+      wasm_error(r, "unknown local");
+      break;
+    }
+    t = c->code->locals[i];
+    if (op != WasmLocalGet) {
+      wasm_check_pop_type(c, t);
+    }
+    if (op != WasmLocalSet) {
+      wasm_check_push(c, t);
+    }
+    break;
+  case WasmGlobalGet:
+  case WasmGlobalSet:
+    i = wasm_read_u32(r);
+    if (i >= m->globals_len) {
+      wasm_error(r, "unknown global");
+      break;
+    }
+    t = m->globals[i].type;
+    if (op == WasmGlobalGet) {
+      wasm_check_push(c, t);
+    } else if (!m->globals[i].mut) {
+      wasm_error(r, "global is immutable");
+    } else {
+      wasm_check_pop_type(c, t);
+    }
+    break;
+
+  case WasmMemorySize:
+  case WasmMemoryGrow:
+    if (wasm_read_byte(r) || !m->has_memory) {
+      wasm_error(r, "unknown memory");
+      break;
+    }
+    if (op == WasmMemoryGrow) {
+      wasm_check_pop_type(c, WasmI32);
+    }
+    wasm_check_push(c, WasmI32);
+    break;
+  case WasmI32Const:
+    wasm_read_sleb(r, 32);
+    wasm_check_push(c, WasmI32);
+    break;
+  case WasmI64Const:
+    wasm_read_sleb(r, 64);
+    wasm_check_push(c, WasmI64);
+    break;
+  case WasmF32Const:
+    wasm_read_bytes(r, 4);
+    wasm_check_push(c, WasmF32);
+    break;
+  case WasmF64Const:
+    wasm_read_bytes(r, 8);
+    wasm_check_push(c, WasmF64);
+    break;
+  case WasmPrefixFC:
+    wasm_check_fc(c, wasm_read_u32(r));
+    break;
+
+  default:
+    if (op >= WasmI32Load && op <= 0x3e) {
+      int align = wasm_access_sig(op, &t);
+      if (!m->has_memory) {
+        wasm_error(r, "unknown memory");
+        break;
+      }
+      if ((int)wasm_read_uleb(r, 32) > align) {
+        wasm_error(r, "alignment must not be larger than natural");
+      }
+      wasm_read_uleb(r, 32);
+      if (op >= WasmI32Store) {
+        wasm_check_pop_type(c, t);
+        wasm_check_pop_type(c, WasmI32);
+      } else {
+        wasm_check_pop_type(c, WasmI32);
+        wasm_check_push(c, t);
+      }
+    } else if (wasm_numeric_sig(op, &a, &b, &t)) {
+      if (b) {
+        wasm_check_pop_type(c, b);
+      }
+      wasm_check_pop_type(c, a);
+      wasm_check_push(c, t);
+    } else {
+      wasm_error(r, "unknown opcode");
+    }
+    break;
+  }
+}
+
+/* Decodes and validates the body of function fn, in r */
+void wasm_check_code(struct wasm_reader *r, struct wasm_module *m, int fn) {
+  struct wasm_functype *type = m->types + m->fn_types[fn];
+  struct wasm_code *code = m->code + fn - m->imports_len;
+  struct wasm_checker c;
+  long total = type->params_len;
+  int runs = wasm_read_count(r, 2);
+  const unsigned char *decls = r->p;
+  int i, j, n, t;
+
+  /* the runs of locals are counted before they are stored */
+  for (i = 0; i < runs && !r->err; i++) {
+    total += wasm_read_u32(r);
+    wasm_read_valtype(r);
+    if (total > WASM_LOCALS) {
+      wasm_error(r, "too many locals");
+    }
+  }
+  if (r->err) {
+    return;
+  }
+  code->locals = malloc(total + 1);
+  code->locals_len = total;
+  memcpy(code->locals, type->params, type->params_len);
+  r->p = decls;
+  for (i = 0, j = type->params_len; i < runs; i++) {
+    n = wasm_read_u32(r);
+    t = wasm_read_valtype(r);
+    memset(code->locals + j, t, n);
+    j += n;
+  }
+  code->body = r->p;
+  code->end = r->end;
+  code->results = type->result != 0;
+
+  memset(&c, 0, sizeof(c));
+  c.r = r;
+  c.m = m;
+  c.code = code;
+  wasm_check_push_ctrl(&c, WasmBlock, type->result);
+  while (c.ctrls_len && !r->err) {
+    wasm_check_insn(&c, wasm_read_byte(r));
+  }
+  if (!r->err && r->p != r->end) {
+    wasm_error(r, "section size mismatch: code past the end of a function");
+  }
+  code->branches = c.branches;
+  code->branches_len = c.branches_len;
+  code->max_stack = c.vals_max;
+  free(c.vals);
+  free(c.ctrls);
+}
+
+/*
+ * Sections
+ */
+
+void wasm_decode_types(struct wasm_reader *r, struct wasm_module *m) {
+  int i, j, n;
+
+  m->types_len = wasm_read_count(r, 3);
+  m->types = calloc(m->types_len + 1, sizeof(*m->types));
+  for (i = 0; i < m->types_len && !r->err; i++) {
+    struct wasm_functype *t = m->types + i;
+
+    if (wasm_read_byte(r) != WASM_FUNCTYPE) {
+      wasm_error(r, "malformed function type");
+      break;
+    }
+    t->params_len = wasm_read_count(r, 1);
+    t->params = malloc(t->params_len + 1);
+    for (j = 0; j < t->params_len; j++) {
+      t->params[j] = wasm_read_valtype(r);
+    }
+    n = wasm_read_count(r, 1);
+    if (n > 1) {
+      wasm_error(r, "multiple results are not supported");
+    } else if (n) {
+      t->result = wasm_read_valtype(r);
+    }
+  }
+}
+
+void wasm_decode_imports(struct wasm_reader *r, struct wasm_module *m) {
+  int i;
+
+  m->imports_len = wasm_read_count(r, 4);
+  m->imports = calloc(m->imports_len + 1, sizeof(*m->imports));
+  for (i = 0; i < m->imports_len && !r->err; i++) {
+    struct wasm_import_fn *im = m->imports + i;
+
+    im->module = wasm_read_name(r);
+    im->name = wasm_read_name(r);
+    if (wasm_read_byte(r) != FuncExt) {
+      wasm_error(r, "only functions can be imported");
+    }
+    im->type = wasm_read_u32(r);
+    if (im->type >= m->types_len) {
+      wasm_error(r, "unknown type");
+    }
+  }
+
+  m->fns_len = m->imports_len;
+  m->fn_types = realloc(m->fn_types, (m->fns_len + 1) * sizeof(int));
+  for (i = 0; i < m->imports_len; i++) {
+    m->fn_types[i] = m->imports[i].type;
+  }
+}
+
+void wasm_decode_fns(struct wasm_reader *r, struct wasm_module *m) {
+  int n = wasm_read_count(r, 1);
+  int i;
+
+  m->fn_types =
+      realloc(m->fn_types, (m->imports_len + n + 1) * sizeof(int));
+  m->code = calloc(n + 1, sizeof(*m->code));
+  for (i = 0; i < n && !r->err; i++) {
+    int t = wasm_read_u32(r);
+    if (t >= m->types_len) {
+      wasm_error(r, "unknown type");
+    }
+    m->fn_types[m->fns_len++] = t;
+  }
+}
+
+void wasm_decode_table(struct wasm_reader *r, struct wasm_module *m) {
+  int n = wasm_read_count(r, 1);
+
+  if (n > 1) {
+    wasm_error(r, "multiple tables");
+  } else if (n) {
+    if (wasm_read_byte(r) != WASM_FUNCREF) {
+      wasm_error(r, "tables must hold funcref");
+    }
+    wasm_read_limits(r, &m->table, 10000000L);
+    m->has_table = true;
+  }
+}
+
+void wasm_decode_memory(struct wasm_reader *r, struct wasm_module *m) {
+  int n = wasm_read_count(r, 1);
+
+  if (n > 1) {
+    wasm_error(r, "multiple memories");
+  } else if (n) {
+    wasm_read_limits(r, &m->memory, 65536L);
+    m->has_memory = true;
+  }
+}
+
+void wasm_decode_globals(struct wasm_reader *r, struct wasm_module *m) {
+  int i, mut;
+
+  m->globals_len = wasm_read_count(r, 3);
+  m->globals = calloc(m->globals_len + 1, sizeof(*m->globals));
+  for (i = 0; i < m->globals_len && !r->err; i++) {
+    m->globals[i].type = wasm_read_valtype(r);
+    if ((mut = wasm_read_byte(r)) > 1) {
+      wasm_error(r, "malformed mutability");
+    }
+    m->globals[i].mut = mut;
+    wasm_read_const(r, m->globals[i].type, &m->globals[i].init);
+  }
+}
+
+int wasm_name_cmp(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+void wasm_decode_exports(struct wasm_reader *r, struct wasm_module *m) {
+  char **names;
+  int i, len;
+
+  m->exports_len = wasm_read_count(r, 3);
+  m->exports = calloc(m->exports_len + 1, sizeof(*m->exports));
+  for (i = 0; i < m->exports_len && !r->err; i++) {
+    struct wasm_export *e = m->exports + i;
+
+    e->name = wasm_read_name(r);
+    e->kind = wasm_read_byte(r);
+    e->index = wasm_read_u32(r);
+    switch (e->kind) {
+    case FuncExt:
+      len = m->fns_len;
+      break;
+    case TableExt:
+      len = m->has_table;
+      break;
+    case MemExt:
+      len = m->has_memory;
+      break;
+    case GlobalExt:
+      len = m->globals_len;
+      break;
+    default:
+      len = 0;
+      wasm_error(r, "malformed export kind");
+      break;
+    }
+    if (e->index >= len) {
+      wasm_error(r, "unknown export");
+    }
+  }
+  if (r->err) {
+    return;
+  }
+
+  /* sorted, equal names are adjacent */
+  names = malloc((m->exports_len + 1) * sizeof(char *));
+  for (i = 0; i < m->exports_len; i++) {
+    names[i] = m->exports[i].name;
+  }
+  qsort(names, m->exports_len, sizeof(char *), wasm_name_cmp);
+  for (i = 1; i < m->exports_len; i++) {
+    if (!strcmp(names[i - 1], names[i])) {
+      wasm_error(r, "duplicate export name");
+    }
+  }
+  free(names);
+}
+
+void wasm_decode_start(struct wasm_reader *r, struct wasm_module *m) {
+  struct wasm_functype *t;
+
+  m->start = wasm_read_u32(r);
+  if (m->start >= m->fns_len) {
+    wasm_error(r, "unknown function");
+    return;
+  }
+  t = m->types + m->fn_types[m->start];
+  if (t->params_len || t->result) {
+    wasm_error(r, "start function must take and return nothing");
+  }
+}
+
+void wasm_decode_elems(struct wasm_reader *r, struct wasm_module *m) {
+  wasm_value off;
+  int i, j;
+
+  m->elems_len = wasm_read_count(r, 5);
+  m->elems = calloc(m->elems_len + 1, sizeof(*m->elems));
+  for (i = 0; i < m->elems_len && !r->err; i++) {
+    struct wasm_elem *e = m->elems + i;
+
+    if (wasm_read_u32(r) || !m->has_table) {
+      wasm_error(r, "only active segments of table 0 are supported");
+      break;
+    }
+    wasm_read_const(r, WasmI32, &off);
+    e->offset = (unsigned int)off.i32;
+    e->len = wasm_read_count(r, 1);
+    e->fns = malloc((e->len + 1) * sizeof(int));
+    for (j = 0; j < e->len; j++) {
+      e->fns[j] = wasm_read_u32(r);
+      if (e->fns[j] >= m->fns_len) {
+        wasm_error(r, "unknown function");
+      }
+    }
+  }
+}
+
+/* Returns the number of bodies */
+int wasm_decode_code(struct wasm_reader *r, struct wasm_module *m) {
+  int n = wasm_read_count(r, 2);
+  int i;
+
+  if (n != m->fns_len - m->imports_len) {
+    wasm_error(r, "function and code section have inconsistent lengths");
+    return 0;
+  }
+  for (i = 0; i < n && !r->err; i++) {
+    long size = wasm_read_u32(r);
+    struct wasm_reader body;
+
+    body.p = wasm_read_bytes(r, size);
+    body.end = body.p + size;
+    body.err = NULL;
+    if (body.p) {
+      wasm_check_code(&body, m, m->imports_len + i);
+    }
+    if (body.err) {
+      wasm_error(r, body.err);
+    }
+  }
+  return n;
+}
+
+void wasm_decode_datas(struct wasm_reader *r, struct wasm_module *m) {
+  wasm_value off;
+  int i;
+
+  m->datas_len = wasm_read_count(r, 4);
+  m->datas = calloc(m->datas_len + 1, sizeof(*m->datas));
+  for (i = 0; i < m->datas_len && !r->err; i++) {
+    struct wasm_data *d = m->datas + i;
+
+    if (wasm_read_u32(r) || !m->has_memory) {
+      wasm_error(r, "only active segments of memory 0 are supported");
+      break;
+    }
+    wasm_read_const(r, WasmI32, &off);
+    d->offset = (unsigned int)off.i32;
+    d->len = wasm_read_count(r, 1);
+    d->bytes = wasm_read_bytes(r, d->len);
+  }
+}
+
+struct wasm_module *wasm_decode(const unsigned char *bytes, long len,
+                                const char **err) {
+  struct wasm_module *m = calloc(1, sizeof(*m));
+  struct wasm_reader r;
+  int last = 0, codes = 0;
+
+  r.p = bytes;
+  r.end = bytes + len;
+  r.err = NULL;
+  m->start = -1;
+  m->fn_types = malloc(sizeof(int));
+
+  if (len < 8 || memcmp(bytes, "\0asm", 4)) {
+    wasm_error(&r, "magic header not detected");
+  } else if (memcmp(bytes + 4, "\1\0\0\0", 4)) {
+    wasm_error(&r, "unknown binary version");
+  } else {
+    r.p += 8;
+  }
+
+  while (r.p < r.end && !r.err) {
+    int id = wasm_read_byte(&r);
+    long size = wasm_read_u32(&r);
+    struct wasm_reader s;
+
+    s.p = wasm_read_bytes(&r, size);
+    s.end = s.p + size;
+    s.err = NULL;
+    if (!s.p) {
+      break;
+    }
+    if (id != CustomSec && id <= last) {
+      wasm_error(&r, "unexpected section");
+      break;
+    }
+    if (id != CustomSec) {
+      last = id;
+    }
+
+    switch (id) {
+    case CustomSec:
+      free(wasm_read_name(&s));
+      s.p = s.end;
+      break;
+    case TypeSec:
+      wasm_decode_types(&s, m);
+      break;
+    case ImportSec:
+      wasm_decode_imports(&s, m);
+      break;
+    case FunctionSec:
+      wasm_decode_fns(&s, m);
+      break;
+    case TableSec:
+      wasm_decode_table(&s, m);
+      break;
+    case MemorySec:
+      wasm_decode_memory(&s, m);
+      break;
+    case GlobalSec:
+      wasm_decode_globals(&s, m);
+      break;
+    case ExportSec:
+      wasm_decode_exports(&s, m);
+      break;
+    case StartSec:
+      wasm_decode_start(&s, m);
+      break;
+    case ElemSec:
+      wasm_decode_elems(&s, m);
+      break;
+    case CodeSec:
+      codes = wasm_decode_code(&s, m);
+      break;
+    case DataSec:
+      wasm_decode_datas(&s, m);
+      break;
+    default:
+      wasm_error(&s, "malformed section id");
+      break;
+    }
+    if (!s.err && s.p != s.end) {
+      wasm_error(&s, "section size mismatch");
+    }
+    if (s.err) {
+      wasm_error(&r, s.err);
+    }
+  }
+
+  if (!r.err && codes != m->fns_len - m->imports_len) {
+    wasm_error(&r, "function and code section have inconsistent lengths");
+  }
+  if (r.err) {
+    *err = r.err;
+    wasm_free(m);
+    return NULL;
+  }
+  return m;
+}
+
+void wasm_free(struct wasm_module *m) {
+  int i;
+
+  for (i = 0; i < m->types_len; i++) {
+    free(m->types[i].params);
+  }
+  for (i = 0; i < m->imports_len; i++) {
+    free(m->imports[i].module);
+    free(m->imports[i].name);
+  }
+  for (i = 0; m->code && i < m->fns_len - m->imports_len; i++) {
+    free(m->code[i].locals);
+    free(m->code[i].branches);
+  }
+  for (i = 0; i < m->exports_len; i++) {
+    free(m->exports[i].name);
+  }
+  for (i = 0; i < m->elems_len; i++) {
+    free(m->elems[i].fns);
+  }
+  free(m->types);
+  free(m->imports);
+  free(m->fn_types);
+  free(m->code);
+  free(m->globals);
+  free(m->exports);
+  free(m->elems);
+  free(m->datas);
+  free(m);
+}
+
+struct wasm_export *wasm_find_export(struct wasm_module *m, const char *name,
+                                     wasm_extern kind) {
+  int i;
+
+  for (i = 0; i < m->exports_len; i++) {
+    if (m->exports[i].kind == kind && !strcmp(m->exports[i].name, name)) {
+      return m->exports + i;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Running
+ */
+
+/*
+ * Reads an unsigned LEB128 at p, of a body already validated, into *v.
+ * Returns where it ends, so the pc of the caller stays in a register.
+ */
+const unsigned char *wasm_leb_at(const unsigned char *p, unsigned long *v) {
+  int shift = 0;
+
+  *v = 0;
+  do {
+    *v |= (unsigned long)(*p & 0x7f) << shift;
+    shift += 7;
+  } while (*p++ & 0x80);
+  return p;
+}
+
+/* Reads a signed LEB128 at p as wasm_leb_at does */
+const unsigned char *wasm_sleb_at(const unsigned char *p, long *v) {
+  unsigned long u = 0;
+  int shift = 0;
+
+  do {
+    u |= (unsigned long)(*p & 0x7f) << shift;
+    shift += 7;
+  } while (*p++ & 0x80);
+  if (shift < 64 && (p[-1] & 0x40)) {
+    u |= ~0UL << shift;
+  }
+  *v = (long)u;
+  return p;
+}
+
+/* Returns whether function types a and b are the same */
+bool wasm_same_type(struct wasm_module *m, int a, int b) {
+  struct wasm_functype *x = m->types + a;
+  struct wasm_functype *y = m->types + b;
+
+  return a == b ||
+         (x->result == y->result && x->params_len == y->params_len &&
+          !memcmp(x->params, y->params, x->params_len));
+}
+
+int wasm_clz(unsigned long x, int bits) {
+  int n = 0;
+
+  for (; n < bits && !(x >> (bits - 1 - n) & 1); n++) {
+  }
+  return n;
+}
+
+int wasm_ctz(unsigned long x, int bits) {
+  int n = 0;
+
+  for (; n < bits && !(x >> n & 1); n++) {
+  }
+  return n;
+}
+
+int wasm_popcnt(unsigned long x) {
+  int n = 0;
+
+  for (; x; x &= x - 1) {
+    n++;
+  }
+  return n;
+}
+
+bool wasm_signbit(double x) {
+  unsigned long bits;
+
+  memcpy(&bits, &x, sizeof(bits));
+  return bits >> 63;
+}
+
+/* min and max are NaN if either operand is, and order -0 below +0 */
+double wasm_fmin(double a, double b) {
+  if (a != a || b != b) {
+    return a + b;
+  }
+  if (a == b) {
+    return wasm_signbit(a) ? a : b;
+  }
+  return a < b ? a : b;
+}
+
+double wasm_fmax(double a, double b) {
+  if (a != a || b != b) {
+    return a + b;
+  }
+  if (a == b) {
+    return wasm_signbit(a) ? b : a;
+  }
+  return a > b ? a : b;
+}
+
+double wasm_trunc(double x) {
+  return x < 0 ? ceil(x) : floor(x);
+}
+
+/* Rounds x to the nearest integer, ties to even */
+double wasm_nearest(double x) {
+  double r, d;
+
+  /* which 2^52 and above, NaNs and infinities already are */
+  if (!(fabs(x) < 4503599627370496.0)) {
+    return x;
+  }
+  r = floor(x);
+  d = x - r;
+  if (d > 0.5 || (d == 0.5 && fmod(r, 2) != 0)) {
+    r += 1;
+  }
+  return r == 0 && wasm_signbit(x) ? -0.0 : r;
+}
+
+/* Runs the saturating truncation op of the prefix WasmPrefixFC on v */
+void wasm_trunc_sat(int op, wasm_value *v) {
+  double d = op & 2 ? v->f64 : v->f32;
+
+  switch (op & 5) {
+  case 0:
+    v->i32 = d != d                ? 0
+             : d <= -2147483648.0  ? INT_MIN
+             : d >= 2147483647.0   ? INT_MAX
+                                   : (int)d;
+    break;
+  case 1:
+    v->i32 = d != d || d <= 0      ? 0
+             : d >= 4294967295.0   ? -1
+                                   : (int)(unsigned int)d;
+    break;
+  case 4:
+    v->i64 = d != d                         ? 0
+             : d <= -9223372036854775808.0  ? LONG_MIN
+             : d >= 9223372036854775808.0   ? LONG_MAX
+                                            : (long)d;
+    break;
+  default:
+    v->i64 = d != d || d <= 0                ? 0
+             : d >= 18446744073709551616.0   ? -1
+                                             : (long)(unsigned long)d;
+    break;
+  }
+}
+
+void wasm_trap(struct wasm_instance *inst, const char *msg) {
+  if (!inst->trap) {
+    inst->trap = msg;
+  }
+}
+
+long wasm_grow(struct wasm_instance *inst, long pages) {
+  long old = inst->mem_len / WASM_PAGE;
+
+  if (pages < 0 ||
+      (unsigned long)pages > (inst->mem_max - inst->mem_len) / WASM_PAGE) {
+    return -1;
+  }
+  if (pages && mprotect(inst->mem + inst->mem_len, pages * WASM_PAGE,
+                        PROT_READ | PROT_WRITE)) {
+    return -1;
+  }
+  inst->mem_len += pages * WASM_PAGE;
+  return old;
+}
+
+/*
+ * Maps memory of min pages that may grow to max, -1 for the most an i32
+ * addresses. The rest stays mapped without access, so memory never moves,
+ * and stray accesses past it fault rather than reach other data.
+ */
+bool wasm_map_memory(struct wasm_instance *inst, long min, long max) {
+  long most = max >= 0 ? max : 65536;
+  void *p = MAP_FAILED;
+  int fd = open("/dev/zero", O_RDWR);
+
+  if (fd < 0) {
+    return false;
+  }
+  p = mmap(NULL, most * WASM_PAGE + WASM_GUARD, PROT_NONE, MAP_PRIVATE, fd,
+           0);
+  if (p == MAP_FAILED && most > min) {
+    /* address space may be limited, then memory cannot grow */
+    most = min;
+    p = mmap(NULL, most * WASM_PAGE + WASM_GUARD, PROT_NONE, MAP_PRIVATE, fd,
+             0);
+  }
+  close(fd);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  inst->mem = p;
+  inst->mem_max = most * WASM_PAGE;
+  return wasm_grow(inst, min) >= 0;
+}
+
+/* the operands of an operator, X also its result, once Y is popped */
+#define X sp[-1]
+#define Y sp[0]
+#define U32(v) ((unsigned int)(v).i32)
+#define U64(v) ((unsigned long)(v).i64)
+
+#define UNARY(field, expr)                                                     \
+  X.field = (expr);                                                            \
+  break
+#define BINARY(field, expr)                                                    \
+  sp--;                                                                        \
+  X.field = (expr);                                                            \
+  break
+
+/* a division, trapping on zero */
+#define DIVIDE(field, expr)                                                    \
+  sp--;                                                                        \
+  if (!Y.field) {                                                              \
+    TRAP("integer divide by zero");                                            \
+  }                                                                            \
+  X.field = (expr);                                                            \
+  break
+
+#define TRAP(msg)                                                              \
+  do {                                                                         \
+    inst->trap = (msg);                                                        \
+    return false;                                                              \
+  } while (0)
+
+#define ULEB(v)                                                                \
+  if (*pc < 0x80) {                                                            \
+    (v) = *pc++;                                                               \
+  } else {                                                                     \
+    pc = wasm_leb_at(pc, &leb);                                                \
+    (v) = leb;                                                                 \
+  }
+#define SKIP()                                                                 \
+  while (*pc++ & 0x80) {                                                       \
+  }
+
+/* Sets ea to the address of an n byte access at the operand v, or traps */
+#define EA(v, n)                                                               \
+  SKIP();                                                                      \
+  ULEB(off);                                                                   \
+  ea = (unsigned long)U32(v) + off;                                            \
+  if (ea + (n) > mem_len) {                                                    \
+    TRAP("out of bounds memory access");                                       \
+  }
+
+/* Stores the low n bytes of the operand at top, memory being little-endian */
+#define STORE(n)                                                               \
+  EA(sp[-2], n);                                                               \
+  memcpy(mem + ea, sp - 1, n);                                                 \
+  sp -= 2;                                                                     \
+  break
+
+#define CHECK_TRUNC(lo, hi)                                                    \
+  if (d != d) {                                                                \
+    TRAP("invalid conversion to integer");                                     \
+  }                                                                            \
+  if (!(d > (lo) && d < (hi))) {                                               \
+    TRAP("integer overflow");                                                  \
+  }
+
+/* Takes branch b, carrying its values and skipping to its next branch */
+#define BRANCH(b)                                                              \
+  do {                                                                         \
+    struct wasm_branch *to = (b);                                              \
+    if (to->drop) {                                                            \
+      if (to->keep) {                                                          \
+        sp[-1 - to->drop] = sp[-1];                                            \
+      }                                                                        \
+      sp -= to->drop;                                                          \
+    }                                                                          \
+    pc = code->body + to->pc;                                                  \
+    br = code->branches + to->next;                                            \
+  } while (0)
+
+/*
+ * Runs function callee with its args at the top of the value stack, below
+ * sp, until it returns its result in place of them. Returns false if it
+ * traps. Instructions are run where they were decoded from, with branches
+ * taken from the side tables validation built.
+ */
+bool wasm_exec(struct wasm_instance *inst, int callee, wasm_value *sp) {
+  struct wasm_module *m = inst->m;
+  struct wasm_frame *frame = inst->frames;
+  struct wasm_code *code = NULL;
+  struct wasm_branch *br = NULL;
+  struct wasm_functype *t;
+  const unsigned char *pc = NULL;
+  wasm_value *locals = NULL, v;
+  unsigned char *mem = inst->mem;
+  unsigned long mem_len = inst->mem_len, ea, off, i, n, leb;
+  long sleb;
+  short h;
+  int w;
+  double d;
+
+  goto call;
+  for (;;) {
+    switch (*pc++) {
+    case WasmUnreachable:
+      TRAP("unreachable");
+    case WasmNop:
+      break;
+    case WasmBlock:
+    case WasmLoop:
+      pc++;
+      break;
+    case WasmIf:
+      pc++;
+      if ((--sp)->i32) {
+        br++;
+      } else {
+        BRANCH(br);
+      }
+      break;
+    case WasmElse:
+    case WasmBr:
+      BRANCH(br);
+      break;
+    case WasmBrIf:
+      if ((--sp)->i32) {
+        BRANCH(br);
+      } else {
+        SKIP();
+        br++;
+      }
+      break;
+    case WasmBrTable:
+      ULEB(n);
+      i = U32(*--sp);
+      BRANCH(br + (i < n ? i : n));
+      break;
+    case WasmEnd:
+      if (pc != code->end) {
+        break;
+      }
+      /* fall through */
+    case WasmReturn:
+      if (code->results) {
+        locals[0] = sp[-1];
+      }
+      sp = locals + code->results;
+      if (--frame == inst->frames) {
+        return true;
+      }
+      pc = frame->pc;
+      br = frame->br;
+      locals = frame->locals;
+      code = frame->code;
+      break;
+
+    case WasmCall:
+      ULEB(callee);
+    call:
+      t = m->types + m->fn_types[callee];
+      if (callee < m->imports_len) {
+        sp -= t->params_len;
+        inst->hosts[callee](inst, sp, &v);
+        if (inst->trap) {
+          return false;
+        }
+        mem_len = inst->mem_len;
+        if (t->result) {
+          *sp++ = v;
+        }
+        break;
+      }
+      if (frame + 1 == inst->frames_end) {
+        TRAP("call stack exhausted");
+      }
+      frame->pc = pc;
+      frame->br = br;
+      frame->locals = locals;
+      frame->code = code;
+      frame++;
+
+      code = m->code + callee - m->imports_len;
+      locals = sp - t->params_len;
+      sp = locals + code->locals_len;
+      if (sp + code->max_stack > inst->vals_end) {
+        TRAP("call stack exhausted");
+      }
+      memset(locals + t->params_len, 0,
+             (code->locals_len - t->params_len) * sizeof(*sp));
+      pc = code->body;
+      br = code->branches;
+      break;
+    case WasmCallIndirect:
+      ULEB(n);
+      pc++;
+      i = U32(*--sp);
+      if (i >= (unsigned long)inst->table_len) {
+        TRAP("undefined element");
+      }
+      if ((callee = inst->table[i]) < 0) {
+        TRAP("uninitialized element");
+      }
+      if (!wasm_same_type(m, m->fn_types[callee], n)) {
+        TRAP("indirect call type mismatch");
+      }
+      goto call;
+
+    case WasmDrop:
+      sp--;
+      break;
+    case WasmSelect:
+      sp -= 2;
+      if (!sp[1].i32) {
+        sp[-1] = sp[0];
+      }
+      break;
+    case WasmLocalGet:
+      ULEB(i);
+      *sp++ = locals[i];
+      break;
+    case WasmLocalSet:
+      ULEB(i);
+      locals[i] = *--sp;
+      break;
+    case WasmLocalTee:
+      ULEB(i);
+      locals[i] = sp[-1];
+      break;
+    case WasmGlobalGet:
+      ULEB(i);
+      *sp++ = inst->globals[i];
+      break;
+    case WasmGlobalSet:
+      ULEB(i);
+      inst->globals[i] = *--sp;
+      break;
+
+    case WasmI32Load:
+      EA(X, 4);
+      memcpy(&X.i32, mem + ea, 4);
+      break;
+    case WasmI64Load:
+      EA(X, 8);
+      memcpy(&X.i64, mem + ea, 8);
+      break;
+    case WasmF32Load:
+      EA(X, 4);
+      memcpy(&X.f32, mem + ea, 4);
+      break;
+    case WasmF64Load:
+      EA(X, 8);
+      memcpy(&X.f64, mem + ea, 8);
+      break;
+    case WasmI32Load8S:
+      EA(X, 1);
+      X.i32 = (signed char)mem[ea];
+      break;
+    case WasmI32Load8U:
+      EA(X, 1);
+      X.i32 = mem[ea];
+      break;
+    case WasmI32Load16S:
+      EA(X, 2);
+      memcpy(&h, mem + ea, 2);
+      X.i32 = h;
+      break;
+    case WasmI32Load16U:
+      EA(X, 2);
+      memcpy(&h, mem + ea, 2);
+      X.i32 = (unsigned short)h;
+      break;
+    case WasmI64Load8S:
+      EA(X, 1);
+      X.i64 = (signed char)mem[ea];
+      break;
+    case WasmI64Load8U:
+      EA(X, 1);
+      X.i64 = mem[ea];
+      break;
+    case WasmI64Load16S:
+      EA(X, 2);
+      memcpy(&h, mem + ea, 2);
+      X.i64 = h;
+      break;
+    case WasmI64Load16U:
+      EA(X, 2);
+      memcpy(&h, mem + ea, 2);
+      X.i64 = (unsigned short)h;
+      break;
+    case WasmI64Load32S:
+      EA(X, 4);
+      memcpy(&w, mem + ea, 4);
+      X.i64 = w;
+      break;
+    case WasmI64Load32U:
+      EA(X, 4);
+      memcpy(&w, mem + ea, 4);
+      X.i64 = (unsigned int)w;
+      break;
+    case WasmI32Store:
+    case WasmF32Store:
+    case WasmI64Store32:
+      STORE(4);
+    case WasmI64Store:
+    case WasmF64Store:
+      STORE(8);
+    case WasmI32Store8:
+    case WasmI64Store8:
+      STORE(1);
+    case WasmI32Store16:
+    case WasmI64Store16:
+      STORE(2);
+    case WasmMemorySize:
+      pc++;
+      (sp++)->i32 = (int)(mem_len / WASM_PAGE);
+      break;
+    case WasmMemoryGrow:
+      pc++;
+      X.i32 = (int)wasm_grow(inst, (long)U32(X));
+      mem_len = inst->mem_len;
+      break;
+
+    case WasmI32Const:
+      if (*pc < 0x40) {
+        (sp++)->i32 = *pc++;
+      } else {
+        pc = wasm_sleb_at(pc, &sleb);
+        (sp++)->i32 = (int)sleb;
+      }
+      break;
+    case WasmI64Const:
+      if (*pc < 0x40) {
+        (sp++)->i64 = *pc++;
+      } else {
+        pc = wasm_sleb_at(pc, &sleb);
+        (sp++)->i64 = sleb;
+      }
+      break;
+    case WasmF32Const:
+      memcpy(&(sp++)->f32, pc, 4);
+      pc += 4;
+      break;
+    case WasmF64Const:
+      memcpy(&(sp++)->f64, pc, 8);
+      pc += 8;
+      break;
+
+    case WasmI32Eqz:
+      UNARY(i32, !X.i32);
+    case WasmI32Eq:
+      BINARY(i32, X.i32 == Y.i32);
+    case WasmI32Ne:
+      BINARY(i32, X.i32 != Y.i32);
+    case WasmI32LtS:
+      BINARY(i32, X.i32 < Y.i32);
+    case WasmI32LtU:
+      BINARY(i32, U32(X) < U32(Y));
+    case WasmI32GtS:
+      BINARY(i32, X.i32 > Y.i32);
+    case WasmI32GtU:
+      BINARY(i32, U32(X) > U32(Y));
+    case WasmI32LeS:
+      BINARY(i32, X.i32 <= Y.i32);
+    case WasmI32LeU:
+      BINARY(i32, U32(X) <= U32(Y));
+    case WasmI32GeS:
+      BINARY(i32, X.i32 >= Y.i32);
+    case WasmI32GeU:
+      BINARY(i32, U32(X) >= U32(Y));
+    case WasmI64Eqz:
+      UNARY(i32, !X.i64);
+    case WasmI64Eq:
+      BINARY(i32, X.i64 == Y.i64);
+    case WasmI64Ne:
+      BINARY(i32, X.i64 != Y.i64);
+    case WasmI64LtS:
+      BINARY(i32, X.i64 < Y.i64);
+    case WasmI64LtU:
+      BINARY(i32, U64(X) < U64(Y));
+    case WasmI64GtS:
+      BINARY(i32, X.i64 > Y.i64);
+    case WasmI64GtU:
+      BINARY(i32, U64(X) > U64(Y));
+    case WasmI64LeS:
+      BINARY(i32, X.i64 <= Y.i64);
+    case WasmI64LeU:
+      BINARY(i32, U64(X) <= U64(Y));
+    case WasmI64GeS:
+      BINARY(i32, X.i64 >= Y.i64);
+    case WasmI64GeU:
+      BINARY(i32, U64(X) >= U64(Y));
+    case WasmF32Eq:
+      BINARY(i32, X.f32 == Y.f32);
+    case WasmF32Ne:
+      BINARY(i32, X.f32 != Y.f32);
+    case WasmF32Lt:
+      BINARY(i32, X.f32 < Y.f32);
+    case WasmF32Gt:
+      BINARY(i32, X.f32 > Y.f32);
+    case WasmF32Le:
+      BINARY(i32, X.f32 <= Y.f32);
+    case WasmF32Ge:
+      BINARY(i32, X.f32 >= Y.f32);
+    case WasmF64Eq:
+      BINARY(i32, X.f64 == Y.f64);
+    case WasmF64Ne:
+      BINARY(i32, X.f64 != Y.f64);
+    case WasmF64Lt:
+      BINARY(i32, X.f64 < Y.f64);
+    case WasmF64Gt:
+      BINARY(i32, X.f64 > Y.f64);
+    case WasmF64Le:
+      BINARY(i32, X.f64 <= Y.f64);
+    case WasmF64Ge:
+      BINARY(i32, X.f64 >= Y.f64);
+
+    case WasmI32Clz:
+      UNARY(i32, wasm_clz(U32(X), 32));
+    case WasmI32Ctz:
+      UNARY(i32, wasm_ctz(U32(X), 32));
+    case WasmI32Popcnt:
+      UNARY(i32, wasm_popcnt(U32(X)));
+    case WasmI32Add:
+      BINARY(i32, (int)(U32(X) + U32(Y)));
+    case WasmI32Sub:
+      BINARY(i32, (int)(U32(X) - U32(Y)));
+    case WasmI32Mul:
+      BINARY(i32, (int)(U32(X) * U32(Y)));
+    case WasmI32DivS:
+      sp--;
+      if (!Y.i32) {
+        TRAP("integer divide by zero");
+      }
+      if (X.i32 == INT_MIN && Y.i32 == -1) {
+        TRAP("integer overflow");
+      }
+      X.i32 /= Y.i32;
+      break;
+    case WasmI32DivU:
+      DIVIDE(i32, (int)(U32(X) / U32(Y)));
+    case WasmI32RemS:
+      DIVIDE(i32, Y.i32 == -1 ? 0 : X.i32 % Y.i32);
+    case WasmI32RemU:
+      DIVIDE(i32, (int)(U32(X) % U32(Y)));
+    case WasmI32And:
+      BINARY(i32, X.i32 & Y.i32);
+    case WasmI32Or:
+      BINARY(i32, X.i32 | Y.i32);
+    case WasmI32Xor:
+      BINARY(i32, X.i32 ^ Y.i32);
+    case WasmI32Shl:
+      BINARY(i32, (int)(U32(X) << (Y.i32 & 31)));
+    case WasmI32ShrS:
+      BINARY(i32, X.i32 >> (Y.i32 & 31));
+    case WasmI32ShrU:
+      BINARY(i32, (int)(U32(X) >> (Y.i32 & 31)));
+    case WasmI32Rotl:
+      BINARY(i32, (int)(U32(X) << (Y.i32 & 31) |
+                        U32(X) >> ((32 - (Y.i32 & 31)) & 31)));
+    case WasmI32Rotr:
+      BINARY(i32, (int)(U32(X) >> (Y.i32 & 31) |
+                        U32(X) << ((32 - (Y.i32 & 31)) & 31)));
+
+    case WasmI64Clz:
+      UNARY(i64, wasm_clz(U64(X), 64));
+    case WasmI64Ctz:
+      UNARY(i64, wasm_ctz(U64(X), 64));
+    case WasmI64Popcnt:
+      UNARY(i64, wasm_popcnt(U64(X)));
+    case WasmI64Add:
+      BINARY(i64, (long)(U64(X) + U64(Y)));
+    case WasmI64Sub:
+      BINARY(i64, (long)(U64(X) - U64(Y)));
+    case WasmI64Mul:
+      BINARY(i64, (long)(U64(X) * U64(Y)));
+    case WasmI64DivS:
+      sp--;
+      if (!Y.i64) {
+        TRAP("integer divide by zero");
+      }
+      if (X.i64 == LONG_MIN && Y.i64 == -1) {
+        TRAP("integer overflow");
+      }
+      X.i64 /= Y.i64;
+      break;
+    case WasmI64DivU:
+      DIVIDE(i64, (long)(U64(X) / U64(Y)));
+    case WasmI64RemS:
+      DIVIDE(i64, Y.i64 == -1 ? 0 : X.i64 % Y.i64);
+    case WasmI64RemU:
+      DIVIDE(i64, (long)(U64(X) % U64(Y)));
+    case WasmI64And:
+      BINARY(i64, X.i64 & Y.i64);
+    case WasmI64Or:
+      BINARY(i64, X.i64 | Y.i64);
+    case WasmI64Xor:
+      BINARY(i64, X.i64 ^ Y.i64);
+    case WasmI64Shl:
+      BINARY(i64, (long)(U64(X) << (Y.i64 & 63)));
+    case WasmI64ShrS:
+      BINARY(i64, X.i64 >> (Y.i64 & 63));
+    case WasmI64ShrU:
+      BINARY(i64, (long)(U64(X) >> (Y.i64 & 63)));
+    case WasmI64Rotl:
+      BINARY(i64, (long)(U64(X) << (Y.i64 & 63) |
+                         U64(X) >> ((64 - (Y.i64 & 63)) & 63)));
+    case WasmI64Rotr:
+      BINARY(i64, (long)(U64(X) >> (Y.i64 & 63) |
+                         U64(X) << ((64 - (Y.i64 & 63)) & 63)));
+
+    /* abs, neg and copysign only touch the sign bit, even of NaNs */
+    case WasmF32Abs:
+      UNARY(i32, X.i32 & 0x7fffffff);
+    case WasmF32Neg:
+      UNARY(i32, (int)(U32(X) ^ 0x80000000U));
+    case WasmF32Ceil:
+      UNARY(f32, (float)ceil(X.f32));
+    case WasmF32Floor:
+      UNARY(f32, (float)floor(X.f32));
+    case WasmF32Trunc:
+      UNARY(f32, (float)wasm_trunc(X.f32));
+    case WasmF32Nearest:
+      UNARY(f32, (float)wasm_nearest(X.f32));
+    case WasmF32Sqrt:
+      UNARY(f32, (float)sqrt(X.f32));
+    case WasmF32Add:
+      BINARY(f32, X.f32 + Y.f32);
+    case WasmF32Sub:
+      BINARY(f32, X.f32 - Y.f32);
+    case WasmF32Mul:
+      BINARY(f32, X.f32 * Y.f32);
+    case WasmF32Div:
+      BINARY(f32, X.f32 / Y.f32);
+    case WasmF32Min:
+      BINARY(f32, (float)wasm_fmin(X.f32, Y.f32));
+    case WasmF32Max:
+      BINARY(f32, (float)wasm_fmax(X.f32, Y.f32));
+    case WasmF32Copysign:
+      BINARY(i32, (int)((U32(X) & 0x7fffffffU) | (U32(Y) & 0x80000000U)));
+    case WasmF64Abs:
+      UNARY(i64, (long)(U64(X) & ~(1UL << 63)));
+    case WasmF64Neg:
+      UNARY(i64, (long)(U64(X) ^ 1UL << 63));
+    case WasmF64Ceil:
+      UNARY(f64, ceil(X.f64));
+    case WasmF64Floor:
+      UNARY(f64, floor(X.f64));
+    case WasmF64Trunc:
+      UNARY(f64, wasm_trunc(X.f64));
+    case WasmF64Nearest:
+      UNARY(f64, wasm_nearest(X.f64));
+    case WasmF64Sqrt:
+      UNARY(f64, sqrt(X.f64));
+    case WasmF64Add:
+      BINARY(f64, X.f64 + Y.f64);
+    case WasmF64Sub:
+      BINARY(f64, X.f64 - Y.f64);
+    case WasmF64Mul:
+      BINARY(f64, X.f64 * Y.f64);
+    case WasmF64Div:
+      BINARY(f64, X.f64 / Y.f64);
+    case WasmF64Min:
+      BINARY(f64, wasm_fmin(X.f64, Y.f64));
+    case WasmF64Max:
+      BINARY(f64, wasm_fmax(X.f64, Y.f64));
+    case WasmF64Copysign:
+      BINARY(i64, (long)((U64(X) & ~(1UL << 63)) | (U64(Y) & 1UL << 63)));
+
+    case WasmI32WrapI64:
+      UNARY(i32, (int)X.i64);
+    case WasmI32TruncF32S:
+    case WasmI32TruncF64S:
+      d = pc[-1] == WasmI32TruncF32S ? X.f32 : X.f64;
+      CHECK_TRUNC(-2147483649.0, 2147483648.0);
+      UNARY(i32, (int)d);
+    case WasmI32TruncF32U:
+    case WasmI32TruncF64U:
+      d = pc[-1] == WasmI32TruncF32U ? X.f32 : X.f64;
+      CHECK_TRUNC(-1.0, 4294967296.0);
+      UNARY(i32, (int)(unsigned int)d);
+    case WasmI64ExtendI32S:
+      UNARY(i64, X.i32);
+    case WasmI64ExtendI32U:
+      UNARY(i64, U32(X));
+    case WasmI64TruncF32S:
+    case WasmI64TruncF64S:
+      d = pc[-1] == WasmI64TruncF32S ? X.f32 : X.f64;
+      /* the double below -2^63 */
+      CHECK_TRUNC(-9223372036854777856.0, 9223372036854775808.0);
+      UNARY(i64, (long)d);
+    case WasmI64TruncF32U:
+    case WasmI64TruncF64U:
+      d = pc[-1] == WasmI64TruncF32U ? X.f32 : X.f64;
+      CHECK_TRUNC(-1.0, 18446744073709551616.0);
+      UNARY(i64, (long)(unsigned long)d);
+    case WasmF32ConvertI32S:
+      UNARY(f32, (float)X.i32);
+    case WasmF32ConvertI32U:
+      UNARY(f32, (float)U32(X));
+    case WasmF32ConvertI64S:
+      UNARY(f32, (float)X.i64);
+    case WasmF32ConvertI64U:
+      UNARY(f32, (float)U64(X));
+    case WasmF32DemoteF64:
+      UNARY(f32, (float)X.f64);
+    case WasmF64ConvertI32S:
+      UNARY(f64, X.i32);
+    case WasmF64ConvertI32U:
+      UNARY(f64, U32(X));
+    case WasmF64ConvertI64S:
+      UNARY(f64, (double)X.i64);
+    case WasmF64ConvertI64U:
+      UNARY(f64, (double)U64(X));
+    case WasmF64PromoteF32:
+      UNARY(f64, X.f32);
+    case WasmI32ReinterpretF32:
+    case WasmI64ReinterpretF64:
+    case WasmF32ReinterpretI32:
+    case WasmF64ReinterpretI64:
+      /* values are held in their bits */
+      break;
+    case WasmI32Extend8S:
+      UNARY(i32, (signed char)X.i32);
+    case WasmI32Extend16S:
+      UNARY(i32, (short)X.i32);
+    case WasmI64Extend8S:
+      UNARY(i64, (signed char)X.i64);
+    case WasmI64Extend16S:
+      UNARY(i64, (short)X.i64);
+    case WasmI64Extend32S:
+      UNARY(i64, (int)X.i64);
+
+    case WasmPrefixFC:
+      ULEB(n);
+      if (n == WasmMemoryCopy || n == WasmMemoryFill) {
+        pc += n == WasmMemoryCopy ? 2 : 1;
+        sp -= 3;
+        /* [dst src len] or [dst byte len] */
+        if ((unsigned long)U32(sp[0]) + U32(sp[2]) > mem_len ||
+            (n == WasmMemoryCopy &&
+             (unsigned long)U32(sp[1]) + U32(sp[2]) > mem_len)) {
+          TRAP("out of bounds memory access");
+        }
+        if (n == WasmMemoryCopy) {
+          memmove(mem + U32(sp[0]), mem + U32(sp[1]), U32(sp[2]));
+        } else {
+          memset(mem + U32(sp[0]), sp[1].i32, U32(sp[2]));
+        }
+      } else {
+        wasm_trunc_sat((int)n, sp - 1);
+      }
+      break;
+
+    default:
+      TRAP("unknown opcode");
+    }
+  }
+}
+
+#undef X
+#undef Y
+#undef U32
+#undef U64
+#undef UNARY
+#undef BINARY
+#undef DIVIDE
+#undef TRAP
+#undef ULEB
+#undef SKIP
+#undef EA
+#undef STORE
+#undef CHECK_TRUNC
+#undef BRANCH
+
+bool wasm_invoke(struct wasm_instance *inst, int fn, wasm_value *args,
+                 wasm_value *result) {
+  struct wasm_functype *t = inst->m->types + inst->m->fn_types[fn];
+  wasm_value v;
+
+  inst->trap = NULL;
+  if (fn < inst->m->imports_len) {
+    inst->hosts[fn](inst, args, &v);
+  } else {
+    if (t->params_len) {
+      memcpy(inst->vals, args, t->params_len * sizeof(*args));
+    }
+    if (!wasm_exec(inst, fn, inst->vals + t->params_len)) {
+      return false;
+    }
+    v = inst->vals[0];
+  }
+  if (t->result && result) {
+    *result = v;
+  }
+  return !inst->trap;
+}
+
+struct wasm_instance *wasm_instantiate(struct wasm_module *m,
+                                       wasm_host_fn *hosts, const char **err) {
+  struct wasm_instance *inst = calloc(1, sizeof(*inst));
+  int i, j;
+
+  inst->m = m;
+  inst->out = stdout;
+  inst->hosts = calloc(m->imports_len + 1, sizeof(*hosts));
+  if (m->imports_len) {
+    memcpy(inst->hosts, hosts, m->imports_len * sizeof(*hosts));
+  }
+  inst->vals = calloc(WASM_VALUES, sizeof(wasm_value));
+  inst->vals_end = inst->vals + WASM_VALUES;
+  inst->frames = calloc(WASM_FRAMES, sizeof(struct wasm_frame));
+  inst->frames_end = inst->frames + WASM_FRAMES;
+
+  inst->globals = calloc(m->globals_len + 1, sizeof(wasm_value));
+  for (i = 0; i < m->globals_len; i++) {
+    inst->globals[i] = m->globals[i].init;
+  }
+
+  if (m->has_memory &&
+      !wasm_map_memory(inst, m->memory.min, m->memory.max)) {
+    *err = "could not map memory";
+    wasm_instance_free(inst);
+    return NULL;
+  }
+
+  inst->table_len = m->has_table ? m->table.min : 0;
+  inst->table = malloc((inst->table_len + 1) * sizeof(int));
+  for (i = 0; i < inst->table_len; i++) {
+    inst->table[i] = -1;
+  }
+  for (i = 0; i < m->elems_len; i++) {
+    struct wasm_elem *e = m->elems + i;
+
+    if (e->offset + e->len > inst->table_len) {
+      *err = "out of bounds table access";
+      wasm_instance_free(inst);
+      return NULL;
+    }
+    for (j = 0; j < e->len; j++) {
+      inst->table[e->offset + j] = e->fns[j];
+    }
+  }
+  for (i = 0; i < m->datas_len; i++) {
+    struct wasm_data *d = m->datas + i;
+
+    if ((unsigned long)(d->offset + d->len) > inst->mem_len) {
+      *err = "out of bounds memory access";
+      wasm_instance_free(inst);
+      return NULL;
+    }
+    memcpy(inst->mem + d->offset, d->bytes, d->len);
+  }
+
+  if (m->start >= 0 && !wasm_invoke(inst, m->start, NULL, NULL)) {
+    *err = inst->trap;
+    wasm_instance_free(inst);
+    return NULL;
+  }
+  return inst;
+}
+
+void wasm_instance_free(struct wasm_instance *inst) {
+  if (inst->mem) {
+    munmap(inst->mem, inst->mem_max + WASM_GUARD);
+  }
+  free(inst->hosts);
+  free(inst->vals);
+  free(inst->frames);
+  free(inst->globals);
+  free(inst->table);
+  free(inst);
+}
+
+/*
+ * The C library of modules chocc emits
+ */
+
+/* Returns whether a string is at p, trapping if it runs out of memory */
+bool wasm_libc_str(struct wasm_instance *inst, unsigned long p) {
+  if (p >= inst->mem_len || !memchr(inst->mem + p, 0, inst->mem_len - p)) {
+    wasm_trap(inst, "out of bounds memory access");
+    return false;
+  }
+  return true;
+}
+
+/* Returns n bytes at the end of the heap, growing memory, or 0 */
+unsigned long wasm_libc_sbrk(struct wasm_instance *inst, unsigned long n) {
+  unsigned long p, end;
+
+  if (!inst->brk) {
+    struct wasm_export *e =
+        wasm_find_export(inst->m, "__heap_base", GlobalExt);
+    inst->brk = e ? (unsigned int)inst->globals[e->index].i32 : inst->mem_len;
+  }
+  p = (inst->brk + 15) & ~15UL;
+  end = p + n;
+  if (end > inst->mem_len &&
+      wasm_grow(inst, (end - inst->mem_len + WASM_PAGE - 1) / WASM_PAGE) < 0) {
+    return 0;
+  }
+  inst->brk = end;
+  return p;
+}
+
+void wasm_libc_printf(struct wasm_instance *inst, wasm_value *args,
+                      wasm_value *result) {
+  unsigned long fmt = (unsigned int)args[0].i32;
+  unsigned long slots = (unsigned int)args[1].i32;
+  value vals[BUILTIN_ARGS];
+  int len;
+
+  if (!wasm_libc_str(inst, fmt)) {
+    return;
+  }
+  /* the format takes as many as it has conversions */
+  for (len = 0; len < BUILTIN_ARGS && slots + 8 * (len + 1) <= inst->mem_len;
+       len++) {
+    memcpy(vals + len, inst->mem + slots + 8 * len, 8);
+  }
+  result->i32 = interp_printf(inst->out, (char *)inst->mem + fmt, vals, len,
+                              (char *)inst->mem, inst->mem_len);
+}
+
+void wasm_libc_putchar(struct wasm_instance *inst, wasm_value *args,
+                       wasm_value *result) {
+  result->i32 = fputc(args[0].i32, inst->out);
+}
+
+void wasm_libc_puts(struct wasm_instance *inst, wasm_value *args,
+                    wasm_value *result) {
+  unsigned long s = (unsigned int)args[0].i32;
+
+  if (wasm_libc_str(inst, s)) {
+    result->i32 = fputs((char *)inst->mem + s, inst->out);
+    fputc('\n', inst->out);
+  }
+}
+
+void wasm_libc_malloc(struct wasm_instance *inst, wasm_value *args,
+                      wasm_value *result) {
+  result->i32 = (int)wasm_libc_sbrk(inst, (unsigned int)args[0].i32);
+}
+
+void wasm_libc_calloc(struct wasm_instance *inst, wasm_value *args,
+                      wasm_value *result) {
+  unsigned long n =
+      (unsigned long)(unsigned int)args[0].i32 * (unsigned int)args[1].i32;
+  unsigned long p = n >> 32 ? 0 : wasm_libc_sbrk(inst, n);
+
+  if (p) {
+    memset(inst->mem + p, 0, n);
+  }
+  result->i32 = (int)p;
+}
+
+/* the heap is never reused */
+void wasm_libc_free(struct wasm_instance *inst, wasm_value *args,
+                    wasm_value *result) {
+  (void)inst;
+  (void)args;
+  (void)result;
+}
+
+void wasm_libc_strlen(struct wasm_instance *inst, wasm_value *args,
+                      wasm_value *result) {
+  unsigned long s = (unsigned int)args[0].i32;
+
+  if (wasm_libc_str(inst, s)) {
+    result->i32 = (int)strlen((char *)inst->mem + s);
+  }
+}
+
+void wasm_libc_exit(struct wasm_instance *inst, wasm_value *args,
+                    wasm_value *result) {
+  (void)result;
+  fflush(inst->out);
+  exit(args[0].i32);
+}
+
+/* by wasm_import */
+wasm_host_fn wasm_libc_fns[] = {
+    wasm_libc_printf, wasm_libc_putchar, wasm_libc_puts,   wasm_libc_malloc,
+    wasm_libc_calloc, wasm_libc_free,    wasm_libc_strlen, wasm_libc_exit};
+
+/* Returns the wasm_import named module.name, or -1 */
+int wasm_libc_import(const char *module, const char *name) {
+  int i;
+
+  for (i = 0; !strcmp(module, "env") && i < ImportsLen; i++) {
+    if (!strcmp(wasm_import_names[i], name)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* Returns whether type t is written sig, as in wasm_import_types */
+bool wasm_libc_type(struct wasm_functype *t, const char *sig) {
+  int i;
+
+  for (i = 0; i < t->params_len && sig[i] == 'i'; i++) {
+    if (t->params[i] != WasmI32) {
+      return false;
+    }
+  }
+  return i == t->params_len && sig[i] == ':' &&
+         (t->result ? t->result == WasmI32 && sig[i + 1] == 'i'
+                    : !sig[i + 1]);
+}
+
+/* Copies the argc strings of argv to the heap, returning their array */
+unsigned long wasm_libc_argv(struct wasm_instance *inst, int argc,
+                             char **argv) {
+  unsigned long p = wasm_libc_sbrk(inst, 8 * (argc + 1));
+  long s;
+  int i;
+
+  for (i = 0; p && i <= argc; i++) {
+    s = 0;
+    if (i < argc && (s = wasm_libc_sbrk(inst, strlen(argv[i]) + 1))) {
+      memcpy(inst->mem + s, argv[i], strlen(argv[i]) + 1);
+    }
+    /* pointers are 8 bytes in memory, as on the host */
+    memcpy(inst->mem + p + 8 * i, &s, 8);
+  }
+  return p;
+}
+
+int wasm_run_main(struct wasm_module *m, FILE *out, int argc, char **argv) {
+  struct wasm_export *e = wasm_find_export(m, "main", FuncExt);
+  wasm_host_fn *hosts = calloc(m->imports_len + 1, sizeof(*hosts));
+  struct wasm_instance *inst = NULL;
+  struct wasm_functype *t;
+  wasm_value *args, result;
+  const char *err = e ? NULL : "no main function";
+  int i, w, status;
+
+  for (i = 0; i < m->imports_len && !err; i++) {
+    struct wasm_import_fn *im = m->imports + i;
+
+    w = wasm_libc_import(im->module, im->name);
+    if (w < 0 || !wasm_libc_type(m->types + im->type, wasm_import_types[w])) {
+      err = "unknown import";
+    } else {
+      hosts[i] = wasm_libc_fns[w];
+    }
+  }
+  if (!err) {
+    inst = wasm_instantiate(m, hosts, &err);
+  }
+  free(hosts);
+  if (!inst) {
+    printf("run: %s\n", err);
+    return 1;
+  }
+  inst->out = out;
+
+  t = m->types + m->fn_types[e->index];
+  args = calloc(t->params_len + 1, sizeof(*args));
+  if (t->params_len > 0) {
+    args[0].i32 = argc;
+  }
+  if (t->params_len > 1) {
+    args[1].i64 = (long)wasm_libc_argv(inst, argc, argv);
+  }
+  result.i32 = 0;
+  if (wasm_invoke(inst, e->index, args, &result)) {
+    status = t->result == WasmI32 ? result.i32 : 0;
+  } else {
+    fflush(out);
+    printf("run: %s\n", inst->trap);
+    status = 1;
+  }
+  fflush(out);
+  free(args);
+  wasm_instance_free(inst);
+  return status;
+}
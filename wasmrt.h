@@ -0,0 +1,218 @@
+#ifndef CHOCC_WASMRT_H
+#define CHOCC_WASMRT_H
+#pragma once
+
+#include <stdio.h>
+
+#include "chocc.h"
+#include "wasm.h"
+
+/* the value of a global, as its valtype says */
+typedef union wasm_value {
+  int i32;
+  long i64;
+  float f32;
+  double f64;
+} wasm_value;
+
+struct wasm_functype {
+  unsigned char *params;
+  int params_len;
+  unsigned char result; /* a valtype, or 0 */
+};
+
+struct wasm_import_fn {
+  char *module;
+  char *name;
+  int type;
+};
+
+struct wasm_global {
+  unsigned char type;
+  bool mut;
+  wasm_value init;
+};
+
+struct wasm_export {
+  char *name;
+  wasm_extern kind;
+  int index;
+};
+
+/*
+ * wasm_branch is where a branch lands, found by validation so that running
+ * code never scans for an end. A function's branches are in the order of
+ * the instructions taking them: one for each if, else, br and br_if, and
+ * one per label of a br_table.
+ */
+struct wasm_branch {
+  int pc;   /* the offset of the target in the body */
+  int next; /* the first branch past the target */
+  int keep; /* values carried to the target, 0 or 1 */
+  int drop; /* values dropped from under them */
+};
+
+/* the body of a function, in the bytes the module was decoded from */
+struct wasm_code {
+  const unsigned char *body; /* its first instruction */
+  const unsigned char *end;  /* past its final end */
+  unsigned char *locals;     /* types of the params and then the locals */
+  int locals_len;
+  int results; /* 0 or 1 */
+
+  struct wasm_branch *branches;
+  int branches_len;
+  int max_stack; /* operands on the stack at most */
+};
+
+/* an active segment of the table or memory */
+struct wasm_elem {
+  long offset;
+  int *fns;
+  int len;
+};
+
+struct wasm_data {
+  long offset;
+  const unsigned char *bytes;
+  long len;
+};
+
+/* limits of tables and memories, max -1 if none */
+struct wasm_limits {
+  long min;
+  long max;
+};
+
+/*
+ * wasm_module is a decoded and validated module. Functions are indexed
+ * imports first, and only functions are imported.
+ */
+struct wasm_module {
+  struct wasm_functype *types;
+  int types_len;
+
+  struct wasm_import_fn *imports;
+  int imports_len;
+
+  int *fn_types; /* by function index */
+  int fns_len;
+  struct wasm_code *code; /* by function index less imports_len */
+
+  bool has_table;
+  struct wasm_limits table;
+  bool has_memory;
+  struct wasm_limits memory; /* in pages */
+
+  struct wasm_global *globals;
+  int globals_len;
+
+  struct wasm_export *exports;
+  int exports_len;
+
+  int start; /* a function index, or -1 */
+
+  struct wasm_elem *elems;
+  int elems_len;
+  struct wasm_data *datas;
+  int datas_len;
+};
+
+/*
+ * Decodes the len byte module at bytes, validating it as it goes. Returns
+ * NULL with a message at *err if it is malformed or invalid. The module
+ * refers into bytes, which must outlive it.
+ */
+struct wasm_module *wasm_decode(const unsigned char *bytes, long len,
+                                const char **err);
+
+void wasm_free(struct wasm_module *);
+
+/* Returns the export of kind named name, or NULL */
+struct wasm_export *wasm_find_export(struct wasm_module *, const char *name,
+                                     wasm_extern kind);
+
+/*
+ * Running
+ */
+
+struct wasm_instance;
+
+/* a function an import is bound to, setting *result if it returns one */
+typedef void (*wasm_host_fn)(struct wasm_instance *, wasm_value *args,
+                             wasm_value *result);
+
+/* calls and operands a module may have live at once */
+#define WASM_FRAMES (1 << 16)
+#define WASM_VALUES (1 << 22)
+
+/* bytes past the most memory may grow to, never accessible */
+#define WASM_GUARD WASM_PAGE
+
+/* a call being run, as the one it called resumes it */
+struct wasm_frame {
+  const unsigned char *pc;
+  struct wasm_branch *br; /* its next branch */
+  wasm_value *locals;
+  struct wasm_code *code;
+};
+
+/*
+ * wasm_instance is a module with its imports bound, its memory, table and
+ * globals, and the stacks its calls run on. Memory is mapped once for the
+ * most it may grow to, followed by WASM_GUARD bytes, and only its first
+ * mem_len bytes are accessible.
+ */
+struct wasm_instance {
+  struct wasm_module *m;
+  wasm_host_fn *hosts; /* by import index */
+
+  unsigned char *mem;
+  unsigned long mem_len;
+  unsigned long mem_max;
+
+  int *table; /* function indexes, -1 if null */
+  long table_len;
+  wasm_value *globals;
+
+  wasm_value *vals;
+  wasm_value *vals_end;
+  struct wasm_frame *frames;
+  struct wasm_frame *frames_end;
+
+  const char *trap; /* why the last call stopped, or NULL */
+  FILE *out;        /* where the C library writes */
+  unsigned long brk; /* the end of the C library's heap, 0 before use */
+};
+
+/*
+ * Instantiates m with its imports bound to hosts, and runs its start
+ * function. Returns NULL with a message at *err if the segments do not fit
+ * or the start function traps.
+ */
+struct wasm_instance *wasm_instantiate(struct wasm_module *m,
+                                       wasm_host_fn *hosts, const char **err);
+
+void wasm_instance_free(struct wasm_instance *);
+
+/*
+ * Calls function fn with the args its type takes, setting *result if it
+ * returns one. Returns false if it traps, with the message at inst->trap.
+ */
+bool wasm_invoke(struct wasm_instance *inst, int fn, wasm_value *args,
+                 wasm_value *result);
+
+/* Stops the running call, from a host function */
+void wasm_trap(struct wasm_instance *, const char *msg);
+
+/* Grows memory by pages, returning its old size in pages or -1 */
+long wasm_grow(struct wasm_instance *, long pages);
+
+/*
+ * Instantiates a module chocc emitted with its C library writing to out,
+ * and calls its main with the argc args in argv. Returns the exit status,
+ * printing why if it traps.
+ */
+int wasm_run_main(struct wasm_module *, FILE *out, int argc, char **argv);
+
+#endif
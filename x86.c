@@ -0,0 +1,2169 @@
+#define _POSIX_C_SOURCE 200809L
+#include "x86.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * x86_reg enumerates the registers, general purpose in encoding order, then
+ * the vector registers holding doubles.
+ */
+typedef enum x86_reg {
+  Rax,
+  Rcx,
+  Rdx,
+  Rbx,
+  Rsp,
+  Rbp,
+  Rsi,
+  Rdi,
+  R8,
+  R9,
+  R10,
+  R11,
+  R12,
+  R13,
+  R14,
+  R15,
+  Xmm0,
+  Xmm14 = Xmm0 + 14,
+  Xmm15,
+  NoReg
+} x86_reg;
+
+const char *x86_gpr_names[4][16] = {
+    {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10",
+     "r11", "r12", "r13", "r14", "r15"},
+    {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d",
+     "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+    {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w",
+     "r11w", "r12w", "r13w", "r14w", "r15w"},
+    {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b",
+     "r11b", "r12b", "r13b", "r14b", "r15b"}};
+
+/*
+ * The general purpose registers values are allocated to, the callee-saved
+ * first. %rax, %rcx, %rdx and %r11 are kept for instruction selection, as
+ * are %xmm14 and %xmm15.
+ */
+#define X86_GPRS 10
+#define X86_SAVED 5
+const x86_reg x86_gprs[X86_GPRS] = {Rbx, R12, R13, R14, R15,
+                                    Rsi, Rdi, R8,  R9,  R10};
+#define X86_XMMS 14
+
+/* the registers integer args are passed in */
+const x86_reg x86_int_args[6] = {Rdi, Rsi, Rdx, Rcx, R8, R9};
+#define X86_FLOAT_ARGS 8
+
+/* conditions of the compares from IrEq to IrULe, and their inverses */
+const char *x86_conds[6] = {"e", "ne", "l", "le", "b", "be"};
+const char *x86_inverted[6] = {"ne", "e", "ge", "g", "ae", "a"};
+
+/*
+ * x86_loc is where a value lives: a register, a slot at off from %rbp, or
+ * nowhere if it is rematerialized at each use.
+ */
+struct x86_loc {
+  x86_reg reg;
+  long off;
+};
+
+/* x86_move is a move of value v, or the long k if v is -1, to dst */
+struct x86_move {
+  struct x86_loc dst;
+  struct x86_loc src;
+  int v;
+  long k;
+  bool xmm;
+  bool done;
+};
+
+/* x86_interval is the positions from the definition of v to its last use */
+struct x86_interval {
+  int v;
+  int start;
+  int end;
+  bool call; /* whether a call clobbers the registers it could be in */
+};
+
+/* x86_edge is a stub moving the operands of the phis of to */
+struct x86_edge {
+  int to;
+  int label;
+};
+
+struct x86_obj {
+  char *p;
+  long size;
+  int id; /* index in interp.objs */
+};
+
+/* x86_arg is an argument of a call, as a move */
+struct x86_arg {
+  int v;
+  long k;
+  bool xmm;
+};
+
+struct x86_gen {
+  writer *w;
+  struct ir_prog *p;
+  struct x86_jit *jit; /* the process the code is for, or NULL */
+  struct x86_obj *objs; /* by address */
+  int objs_len;
+  int labels; /* numbered so far */
+  bool div0;  /* whether a division may trap */
+  bool null;  /* whether a call may be through a null pointer */
+
+  /* the function being compiled */
+  struct ir_fn *f;
+  int *layout; /* its reachable blocks in reverse postorder */
+  int layout_len;
+  int *block_label;
+  int *start; /* position of each block's phis */
+  int *end;   /* position of each block's edges out */
+  int positions;
+  int *pos; /* of each value's definition */
+  int *uses;
+  bool *fused; /* compares only their branch tests */
+  struct x86_loc *locs;
+  bool used[NoReg + 1];
+  int slots;      /* of spilled values */
+  long saved;     /* bytes of callee-saved registers pushed */
+  long call_slot; /* holds the target of an indirect call */
+  long area;      /* of the args of calls from a JIT */
+  long frame;     /* bytes below %rbp */
+  int cur;        /* block being written */
+  int next;       /* block laid out after it, or -1 */
+  struct x86_edge *edges;
+  int edges_len;
+  struct x86_move *moves;
+  int moves_len;
+};
+
+void x86_fail(const char *msg, const char *name) {
+  if (name) {
+    printf("x86: %s %s\n", msg, name);
+  } else {
+    printf("x86: %s\n", msg);
+  }
+  exit(1);
+}
+
+/*
+ * Output
+ */
+
+bool x86_fits32(long k) { return k >= -2147483648L && k <= 2147483647L; }
+
+int x86_obj_cmp(const void *a, const void *b) {
+  const struct x86_obj *x = a, *y = b;
+  return x->p < y->p ? -1 : x->p > y->p;
+}
+
+/* Sorts the objects of the program by address */
+void x86_place(struct x86_gen *g) {
+  struct interp *in = g->p->in;
+  int i;
+
+  g->objs_len = in->objs_len;
+  g->objs = malloc((g->objs_len + 1) * sizeof(*g->objs));
+  for (i = 0; i < g->objs_len; i++) {
+    g->objs[i].p = in->objs[i].p;
+    g->objs[i].size = in->objs[i].size;
+    g->objs[i].id = i;
+  }
+  qsort(g->objs, g->objs_len, sizeof(*g->objs), x86_obj_cmp);
+}
+
+/* Returns the object p is in or just past, its offset there in off */
+int x86_obj_of(struct x86_gen *g, char *p, long *off) {
+  int lo = 0, hi = g->objs_len;
+
+  /* the last object starting at or before p */
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (g->objs[mid].p <= p) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (!lo || p > g->objs[lo - 1].p + g->objs[lo - 1].size) {
+    x86_fail("address of no object", NULL);
+  }
+  *off = p - g->objs[lo - 1].p;
+  return g->objs[lo - 1].id;
+}
+
+void x86_write_reg(struct x86_gen *g, x86_reg r, int size) {
+  write_char(g->w, '%');
+  if (r >= Xmm0) {
+    write_str(g->w, "xmm");
+    write_long(g->w, r - Xmm0);
+  } else {
+    write_str(g->w, x86_gpr_names[size][r]);
+  }
+}
+
+/* Writes value v as an operand: its register or slot, or an immediate */
+void x86_write_operand(struct x86_gen *g, int v) {
+  struct x86_loc l = g->locs[v];
+  struct ir_insn *i = g->f->insns + v;
+
+  if (l.reg != NoReg) {
+    x86_write_reg(g, l.reg, 0);
+  } else if (l.off) {
+    write_long(g->w, l.off);
+    write_str(g->w, "(%rbp)");
+  } else if (i->op == IrConst && !is_float_kind(i->kind) && x86_fits32(i->k)) {
+    write_char(g->w, '$');
+    write_long(g->w, i->k);
+  } else {
+    x86_fail("no operand for a value of", g->f->fn->name);
+  }
+}
+
+/* Writes the memory at address v, in base unless it is a frame or global */
+void x86_write_mem(struct x86_gen *g, int v, x86_reg base) {
+  struct ir_insn *i = g->f->insns + v;
+  long off;
+  int id;
+
+  if (base != NoReg) {
+    write_char(g->w, '(');
+    x86_write_reg(g, base, 0);
+    write_char(g->w, ')');
+  } else if (i->op == IrFrame) {
+    write_long(g->w, i->k - g->frame);
+    write_str(g->w, "(%rbp)");
+  } else {
+    id = x86_obj_of(g, i->p, &off);
+    write_str(g->w, ".Lobj");
+    write_long(g->w, id);
+    if (off) {
+      write_char(g->w, '+');
+      write_long(g->w, off);
+    }
+    write_str(g->w, "(%rip)");
+  }
+}
+
+/*
+ * Writes an instruction or directive on its own line. fmt is copied but for
+ * #q, #d, #w and #b, a register at 64, 32, 16 or 8 bits, #l a long, #s a
+ * string, #L a label number, #o a value as an operand, and #m a value and
+ * register as memory.
+ */
+void x86_ins(struct x86_gen *g, const char *fmt, ...) {
+  va_list ap;
+  int v;
+
+  va_start(ap, fmt);
+  write_char(g->w, '\t');
+  for (; *fmt; fmt++) {
+    if (*fmt != '#') {
+      write_char(g->w, *fmt);
+      continue;
+    }
+    switch (*++fmt) {
+    case 'q':
+      x86_write_reg(g, va_arg(ap, int), 0);
+      break;
+    case 'd':
+      x86_write_reg(g, va_arg(ap, int), 1);
+      break;
+    case 'w':
+      x86_write_reg(g, va_arg(ap, int), 2);
+      break;
+    case 'b':
+      x86_write_reg(g, va_arg(ap, int), 3);
+      break;
+    case 'l':
+      write_long(g->w, va_arg(ap, long));
+      break;
+    case 's':
+      write_str(g->w, va_arg(ap, const char *));
+      break;
+    case 'L':
+      write_str(g->w, ".L");
+      write_long(g->w, va_arg(ap, int));
+      break;
+    case 'o':
+      x86_write_operand(g, va_arg(ap, int));
+      break;
+    case 'm':
+      v = va_arg(ap, int);
+      x86_write_mem(g, v, va_arg(ap, int));
+      break;
+    }
+  }
+  write_char(g->w, '\n');
+  va_end(ap);
+}
+
+void x86_label(struct x86_gen *g, int label) {
+  write_str(g->w, ".L");
+  write_long(g->w, label);
+  write_str(g->w, ":\n");
+}
+
+/*
+ * Values
+ */
+
+/* Returns whether v is computed again wherever it is used */
+bool x86_remat(struct ir_insn *i) {
+  return i->op == IrConst || i->op == IrGlobal || i->op == IrFrame ||
+         i->op == IrFn;
+}
+
+/* Returns whether v is held in a register or slot */
+bool x86_placed(struct x86_gen *g, int v) {
+  return g->locs[v].reg != NoReg || g->locs[v].off;
+}
+
+/* Returns whether v is an integer constant instructions can hold */
+bool x86_is_imm(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+  return i->op == IrConst && !is_float_kind(i->kind) && x86_fits32(i->k);
+}
+
+bool x86_is_xmm(struct x86_gen *g, int v) {
+  return is_float_kind(g->f->insns[v].kind);
+}
+
+void x86_copy(struct x86_gen *g, x86_reg dst, x86_reg src) {
+  if (dst == src) {
+    return;
+  }
+  x86_ins(g, dst >= Xmm0 ? "movapd #q, #q" : "movq #q, #q", src, dst);
+}
+
+void x86_mov_imm(struct x86_gen *g, long k, x86_reg r) {
+  if (!k) {
+    x86_ins(g, "xorl #d, #d", r, r);
+  } else if (k > 0 && k <= 4294967295L) {
+    x86_ins(g, "movl $#l, #d", k, r);
+  } else if (x86_fits32(k)) {
+    x86_ins(g, "movq $#l, #q", k, r);
+  } else {
+    x86_ins(g, "movabsq $#l, #q", k, r);
+  }
+}
+
+/* Normalizes the integer of kind k in r, as norm does */
+void x86_norm(struct x86_gen *g, val_kind k, x86_reg r) {
+  switch (k) {
+  case I8V:
+    x86_ins(g, "movsbq #b, #q", r, r);
+    break;
+  case U8V:
+    x86_ins(g, "movzbl #b, #d", r, r);
+    break;
+  case I16V:
+    x86_ins(g, "movswq #w, #q", r, r);
+    break;
+  case U16V:
+    x86_ins(g, "movzwl #w, #d", r, r);
+    break;
+  case I32V:
+    x86_ins(g, "movslq #d, #q", r, r);
+    break;
+  case U32V:
+    x86_ins(g, "movl #d, #d", r, r);
+    break;
+  default:
+    break;
+  }
+}
+
+/* Rounds the double in r to float */
+void x86_round(struct x86_gen *g, x86_reg r) {
+  x86_ins(g, "cvtsd2ss #q, #q", r, r);
+  x86_ins(g, "cvtss2sd #q, #q", r, r);
+}
+
+/* Puts the value v in r */
+void x86_to_reg(struct x86_gen *g, int v, x86_reg r) {
+  struct x86_loc l = g->locs[v];
+  struct ir_insn *i = g->f->insns + v;
+  value c;
+
+  if (l.reg != NoReg) {
+    x86_copy(g, r, l.reg);
+    return;
+  }
+  if (l.off) {
+    x86_ins(g, r >= Xmm0 ? "movsd #l(%rbp), #q" : "movq #l(%rbp), #q", l.off,
+            r);
+    return;
+  }
+  switch (i->op) {
+  case IrConst:
+    if (!is_float_kind(i->kind)) {
+      x86_mov_imm(g, i->k, r);
+      return;
+    }
+    c.d = i->f;
+    if (!c.i) {
+      x86_ins(g, "xorpd #q, #q", r, r);
+      return;
+    }
+    x86_ins(g, "movabsq $#l, %rax", c.i);
+    x86_ins(g, "movq %rax, #q", r);
+    return;
+  case IrGlobal:
+  case IrFrame:
+    if (g->jit && i->op == IrGlobal) {
+      x86_ins(g, "movabsq $#l, #q", (long)i->p, r);
+    } else {
+      x86_ins(g, "leaq #m, #q", v, NoReg, r);
+    }
+    return;
+  case IrFn:
+    if (g->jit) {
+      x86_ins(g, "movabsq $#l, #q", (long)i->fn, r);
+    } else {
+      x86_ins(g, "leaq #s(%rip), #q", i->fn->name, r);
+    }
+    return;
+  default:
+    x86_fail("value without a place in", g->f->fn->name);
+  }
+}
+
+/* Returns the register v is in, putting it in scratch if it has none */
+x86_reg x86_reg_of(struct x86_gen *g, int v, x86_reg scratch) {
+  if (g->locs[v].reg != NoReg) {
+    return g->locs[v].reg;
+  }
+  x86_to_reg(g, v, scratch);
+  return scratch;
+}
+
+/* Returns the register v is computed in, scratch if it is spilled */
+x86_reg x86_dst(struct x86_gen *g, int v, x86_reg scratch) {
+  return g->locs[v].reg != NoReg ? g->locs[v].reg : scratch;
+}
+
+/* Stores v, computed in r, to its slot if it was spilled */
+void x86_def(struct x86_gen *g, int v, x86_reg r) {
+  if (g->locs[v].reg == NoReg && g->locs[v].off) {
+    x86_ins(g, r >= Xmm0 ? "movsd #q, #l(%rbp)" : "movq #q, #l(%rbp)", r,
+            g->locs[v].off);
+  }
+}
+
+/*
+ * Parallel moves
+ */
+
+void x86_add_move(struct x86_gen *g, struct x86_loc dst, int v, long k,
+                  bool xmm) {
+  struct x86_move *m = g->moves + g->moves_len++;
+
+  m->dst = dst;
+  m->v = v;
+  m->k = k;
+  m->xmm = xmm;
+  m->done = false;
+  m->src.reg = NoReg;
+  m->src.off = 0;
+  if (v >= 0) {
+    m->src = g->locs[v];
+  }
+}
+
+bool x86_same(struct x86_loc a, struct x86_loc b) {
+  return a.reg != NoReg ? a.reg == b.reg : b.reg == NoReg && a.off == b.off;
+}
+
+bool x86_nowhere(struct x86_loc l) { return l.reg == NoReg && !l.off; }
+
+/* Copies what is at src to dst, through %rax between slots */
+void x86_move_loc(struct x86_gen *g, struct x86_loc dst, struct x86_loc src,
+                  bool xmm) {
+  if (src.reg != NoReg && dst.reg != NoReg) {
+    x86_copy(g, dst.reg, src.reg);
+  } else if (src.reg != NoReg) {
+    x86_ins(g, xmm ? "movsd #q, #l(%rbp)" : "movq #q, #l(%rbp)", src.reg,
+            dst.off);
+  } else if (dst.reg != NoReg) {
+    x86_ins(g, xmm ? "movsd #l(%rbp), #q" : "movq #l(%rbp), #q", src.off,
+            dst.reg);
+  } else {
+    x86_ins(g, "movq #l(%rbp), %rax", src.off);
+    x86_ins(g, "movq %rax, #l(%rbp)", dst.off);
+  }
+}
+
+/* Computes the value of a move from nowhere into its destination */
+void x86_materialize(struct x86_gen *g, struct x86_move *m) {
+  long k = m->v >= 0 ? g->f->insns[m->v].k : m->k;
+  x86_reg r = m->xmm ? Xmm15 : Rax;
+
+  if (m->dst.reg != NoReg) {
+    if (m->v >= 0) {
+      x86_to_reg(g, m->v, m->dst.reg);
+    } else {
+      x86_mov_imm(g, k, m->dst.reg);
+    }
+    return;
+  }
+  if ((m->v < 0 || x86_is_imm(g, m->v)) && x86_fits32(k)) {
+    x86_ins(g, "movq $#l, #l(%rbp)", k, m->dst.off);
+    return;
+  }
+  if (m->v >= 0) {
+    x86_to_reg(g, m->v, r);
+  } else {
+    x86_mov_imm(g, k, r);
+  }
+  x86_ins(g, m->xmm ? "movsd #q, #l(%rbp)" : "movq #q, #l(%rbp)", r,
+          m->dst.off);
+}
+
+/*
+ * Performs the pending moves as if all at once. A move goes once nothing
+ * else still reads its destination; when only cycles are left, one
+ * destination is copied to a scratch register its readers then take. Values
+ * from nowhere come last, as nothing reads what they overwrite.
+ */
+void x86_resolve(struct x86_gen *g) {
+  struct x86_move *m = g->moves;
+  int len = g->moves_len, i, j;
+  struct x86_loc tmp;
+  bool pending, moved;
+
+  for (;;) {
+    pending = moved = false;
+    for (i = 0; i < len; i++) {
+      if (m[i].done || x86_nowhere(m[i].src)) {
+        continue;
+      }
+      pending = true;
+      for (j = 0; j < len; j++) {
+        if (j != i && !m[j].done && !x86_nowhere(m[j].src) &&
+            x86_same(m[j].src, m[i].dst) && !x86_same(m[j].src, m[j].dst)) {
+          break;
+        }
+      }
+      if (j == len) {
+        if (!x86_same(m[i].src, m[i].dst)) {
+          x86_move_loc(g, m[i].dst, m[i].src, m[i].xmm);
+        }
+        m[i].done = moved = true;
+      }
+    }
+    if (!pending) {
+      break;
+    }
+    if (moved) {
+      continue;
+    }
+    for (i = 0; m[i].done || x86_nowhere(m[i].src); i++) {
+    }
+    tmp.reg = m[i].xmm ? Xmm15 : R11;
+    tmp.off = 0;
+    x86_move_loc(g, tmp, m[i].dst, m[i].xmm);
+    for (j = 0; j < len; j++) {
+      if (!m[j].done && !x86_nowhere(m[j].src) &&
+          x86_same(m[j].src, m[i].dst)) {
+        m[j].src = tmp;
+      }
+    }
+  }
+  for (i = 0; i < len; i++) {
+    if (!m[i].done) {
+      x86_materialize(g, m + i);
+    }
+  }
+  g->moves_len = 0;
+}
+
+/* Moves the operands of the phis of block to from block from */
+void x86_phi_moves(struct x86_gen *g, int from, int to) {
+  struct ir_block *blk = g->f->blocks + to;
+  int k = ir_pred_index(g->f, to, from), phis = ir_phis(g->f, to), j, v;
+
+  for (j = 0; j < phis; j++) {
+    v = blk->insns[j];
+    if (x86_placed(g, v)) {
+      x86_add_move(g, g->locs[v], g->f->insns[v].args[k], 0,
+                   x86_is_xmm(g, v));
+    }
+  }
+  x86_resolve(g);
+}
+
+/*
+ * Register allocation
+ */
+
+/* Lays out the reachable blocks in reverse postorder and numbers them */
+void x86_layout(struct x86_gen *g) {
+  int n = g->f->blocks_len, b;
+  int *order = malloc((n + 1) * sizeof(int));
+  int *by_order = malloc((n + 1) * sizeof(int));
+
+  free(ir_dominators(g->f, order));
+  g->layout = malloc((n + 1) * sizeof(int));
+  g->layout_len = 0;
+  g->block_label = malloc((n + 1) * sizeof(int));
+  for (b = 0; b < n; b++) {
+    by_order[b] = -1;
+  }
+  for (b = 0; b < n; b++) {
+    if (order[b] >= 0) {
+      by_order[order[b]] = b;
+    }
+    g->block_label[b] = g->labels++;
+  }
+  for (b = 0; b < n; b++) {
+    if (by_order[b] >= 0) {
+      g->layout[g->layout_len++] = by_order[b];
+    }
+  }
+  free(order);
+  free(by_order);
+}
+
+/*
+ * Numbers the instructions in layout order, two apart so a block's phis
+ * come before its first instruction and its edges after its last. Counts
+ * the uses of each value, and finds the compares only a branch tests.
+ */
+void x86_number(struct x86_gen *g) {
+  struct ir_fn *f = g->f;
+  int c = 0, li, j, k, v, *u;
+
+  g->start = malloc((f->blocks_len + 1) * sizeof(int));
+  g->end = malloc((f->blocks_len + 1) * sizeof(int));
+  g->pos = calloc(f->insns_len + 1, sizeof(int));
+  g->uses = calloc(f->insns_len + 1, sizeof(int));
+  g->fused = calloc(f->insns_len + 1, sizeof(bool));
+  for (li = 0; li < g->layout_len; li++) {
+    struct ir_block *blk = f->blocks + g->layout[li];
+    g->start[g->layout[li]] = c;
+    for (j = 0; j < blk->len; j++) {
+      struct ir_insn *i = f->insns + blk->insns[j];
+      if (i->op == IrPhi || i->op == IrParam) {
+        g->pos[blk->insns[j]] = g->start[g->layout[li]];
+      } else {
+        c += 2;
+        g->pos[blk->insns[j]] = c;
+      }
+      for (k = 0; k < 2 + i->args_len; k++) {
+        u = ir_use(i, k);
+        if (*u >= 0) {
+          g->uses[*u]++;
+        }
+      }
+    }
+    g->end[g->layout[li]] = c + 1;
+    c += 2;
+  }
+  g->positions = c + 1;
+
+  for (li = 0; li < g->layout_len; li++) {
+    struct ir_block *blk = f->blocks + g->layout[li];
+    struct ir_insn *t = ir_terminator(f, g->layout[li]);
+    if (t->op != IrBranch || blk->len < 2) {
+      continue;
+    }
+    v = blk->insns[blk->len - 2];
+    if (v == t->a && g->uses[v] == 1 &&
+        ((IrEq <= f->insns[v].op && f->insns[v].op <= IrULe) ||
+         f->insns[v].op == IrNot)) {
+      g->fused[v] = true;
+    }
+  }
+}
+
+/* Returns whether v needs a register or slot */
+bool x86_allocated(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+  return ir_has_value(i->op) && i->kind != VoidV && !x86_remat(i) &&
+         !g->fused[v] && g->uses[v] > 0;
+}
+
+#define X86_BITS (8 * (int)sizeof(unsigned long))
+
+bool x86_bit(unsigned long *set, int v) {
+  return set[v / X86_BITS] >> (v % X86_BITS) & 1;
+}
+
+void x86_set(unsigned long *set, int v, bool on) {
+  if (on) {
+    set[v / X86_BITS] |= 1UL << (v % X86_BITS);
+  } else {
+    set[v / X86_BITS] &= ~(1UL << (v % X86_BITS));
+  }
+}
+
+/*
+ * Returns the values live out of each block, words bits apiece, iterating
+ * backwards over the layout until nothing changes. The operands of a phi
+ * are live out of the predecessor they come from.
+ */
+unsigned long *x86_liveness(struct x86_gen *g, int words) {
+  struct ir_fn *f = g->f;
+  unsigned long *out = calloc(f->blocks_len * words + 1, sizeof(long));
+  unsigned long *in = calloc(f->blocks_len * words + 1, sizeof(long));
+  unsigned long *live = malloc((words + 1) * sizeof(long));
+  bool changed = true;
+  int li, b, s, j, k, w, phis, *u;
+
+  while (changed) {
+    changed = false;
+    for (li = g->layout_len - 1; li >= 0; li--) {
+      struct ir_block *blk = f->blocks + (b = g->layout[li]);
+      struct ir_insn *t = ir_terminator(f, b);
+      memset(live, 0, words * sizeof(long));
+      for (j = 0; j < t->targets_len; j++) {
+        s = t->targets[j];
+        for (w = 0; w < words; w++) {
+          live[w] |= in[s * words + w];
+        }
+        k = ir_pred_index(f, s, b);
+        phis = ir_phis(f, s);
+        for (w = 0; w < phis; w++) {
+          x86_set(live, f->insns[f->blocks[s].insns[w]].args[k], true);
+        }
+      }
+      memcpy(out + b * words, live, words * sizeof(long));
+
+      phis = ir_phis(f, b);
+      for (j = blk->len - 1; j >= 0; j--) {
+        struct ir_insn *i = f->insns + blk->insns[j];
+        x86_set(live, blk->insns[j], false);
+        for (k = 0; j >= phis && k < 2 + i->args_len; k++) {
+          u = ir_use(i, k);
+          if (*u >= 0) {
+            x86_set(live, *u, true);
+          }
+        }
+      }
+      if (memcmp(live, in + b * words, words * sizeof(long))) {
+        memcpy(in + b * words, live, words * sizeof(long));
+        changed = true;
+      }
+    }
+  }
+  free(in);
+  free(live);
+  return out;
+}
+
+/* Raises the end of the interval of v, if it has one, to p */
+void x86_extend(struct x86_interval *ivs, int *iv_of, int v, int p) {
+  if (iv_of[v] >= 0 && ivs[iv_of[v]].end < p) {
+    ivs[iv_of[v]].end = p;
+  }
+}
+
+int x86_interval_cmp(const void *a, const void *b) {
+  const struct x86_interval *x = a, *y = b;
+  return x->start != y->start ? x->start - y->start : x->v - y->v;
+}
+
+/* Returns the live intervals of the function, by start, in len */
+struct x86_interval *x86_intervals(struct x86_gen *g, int *len) {
+  struct ir_fn *f = g->f;
+  int words = (f->insns_len + X86_BITS) / X86_BITS;
+  unsigned long *out = x86_liveness(g, words);
+  struct x86_interval *ivs = malloc((f->insns_len + 1) * sizeof(*ivs));
+  int *iv_of = malloc((f->insns_len + 1) * sizeof(int));
+  int *calls = calloc(g->positions + 2, sizeof(int));
+  int li, b, j, k, v, p, *u;
+
+  *len = 0;
+  for (v = 0; v < f->insns_len; v++) {
+    iv_of[v] = -1;
+  }
+  for (li = 0; li < g->layout_len; li++) {
+    struct ir_block *blk = f->blocks + (b = g->layout[li]);
+    struct ir_insn *t = ir_terminator(f, b);
+    for (j = 0; j < blk->len; j++) {
+      struct ir_insn *i = f->insns + (v = blk->insns[j]);
+      if (x86_allocated(g, v)) {
+        iv_of[v] = *len;
+        ivs[*len].v = v;
+        ivs[*len].start = ivs[*len].end = g->pos[v];
+        ivs[*len].call = false;
+        ++*len;
+      }
+      if (i->op == IrCall || i->op == IrCallPtr || i->op == IrBuiltin ||
+          i->op == IrMemCopy || i->op == IrMemZero) {
+        calls[g->pos[v] + 1] = 1;
+      }
+      /* phis read their operands at the end of the predecessor */
+      if (i->op == IrPhi) {
+        continue;
+      }
+      /* a fused compare reads its operands at the branch */
+      p = g->fused[v] ? g->pos[v] + 2 : g->pos[v];
+      for (k = 0; k < 2 + i->args_len; k++) {
+        u = ir_use(i, k);
+        if (*u >= 0) {
+          x86_extend(ivs, iv_of, *u, p);
+        }
+      }
+    }
+    for (j = 0; j < t->targets_len; j++) {
+      int s = t->targets[j], pred = ir_pred_index(f, s, b);
+      for (k = 0; k < ir_phis(f, s); k++) {
+        x86_extend(ivs, iv_of, f->insns[f->blocks[s].insns[k]].args[pred],
+                   g->end[b]);
+      }
+    }
+    for (v = 0; v < f->insns_len; v++) {
+      if (x86_bit(out + b * words, v)) {
+        x86_extend(ivs, iv_of, v, g->end[b]);
+      }
+    }
+  }
+
+  /* calls[p] counts the calls before position p */
+  for (p = 1; p < g->positions + 2; p++) {
+    calls[p] += calls[p - 1];
+  }
+  for (j = 0; j < *len; j++) {
+    ivs[j].call = ivs[j].end > ivs[j].start + 1 &&
+                  calls[ivs[j].end] > calls[ivs[j].start + 1];
+  }
+  qsort(ivs, *len, sizeof(*ivs), x86_interval_cmp);
+  free(out);
+  free(iv_of);
+  free(calls);
+  return ivs;
+}
+
+/* Returns whether a value could be in r, crossing a call or not */
+bool x86_fits(x86_reg r, bool xmm, bool call) {
+  int j;
+
+  if (xmm) {
+    return r >= Xmm0 && !call;
+  }
+  for (j = 0; j < (call ? X86_SAVED : X86_GPRS); j++) {
+    if (x86_gprs[j] == r) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Returns a free register for a value, caller-saved first, or NoReg */
+x86_reg x86_free_reg(bool *busy, bool xmm, bool call) {
+  int j;
+
+  if (xmm) {
+    for (j = 0; j < X86_XMMS && !call; j++) {
+      if (!busy[Xmm0 + j]) {
+        return Xmm0 + j;
+      }
+    }
+    return NoReg;
+  }
+  for (j = X86_SAVED; j < X86_GPRS && !call; j++) {
+    if (!busy[x86_gprs[j]]) {
+      return x86_gprs[j];
+    }
+  }
+  for (j = 0; j < X86_SAVED; j++) {
+    if (!busy[x86_gprs[j]]) {
+      return x86_gprs[j];
+    }
+  }
+  return NoReg;
+}
+
+/*
+ * Allocates registers by linear scan over the live intervals, spilling the
+ * interval ending last when none is free, then lays out the frame: the
+ * callee-saved registers, the spill slots, the call slot, then the frame
+ * of the lowered function.
+ */
+void x86_allocate(struct x86_gen *g) {
+  struct ir_fn *f = g->f;
+  int len, active_len = 0, j, k, best, v;
+  struct x86_interval *ivs = x86_intervals(g, &len), *cur, *a;
+  int *active = malloc((len + 1) * sizeof(int));
+  bool busy[NoReg + 1];
+  x86_reg r;
+  bool xmm;
+
+  g->locs = malloc((f->insns_len + 1) * sizeof(*g->locs));
+  for (v = 0; v < f->insns_len; v++) {
+    g->locs[v].reg = NoReg;
+    g->locs[v].off = 0;
+  }
+  memset(busy, 0, sizeof(busy));
+  memset(g->used, 0, sizeof(g->used));
+  g->slots = 0;
+
+  for (k = 0; k < len; k++) {
+    cur = ivs + k;
+    for (j = 0; j < active_len;) {
+      a = ivs + active[j];
+      if (a->end <= cur->start) {
+        busy[g->locs[a->v].reg] = false;
+        active[j] = active[--active_len];
+      } else {
+        j++;
+      }
+    }
+
+    xmm = x86_is_xmm(g, cur->v);
+    r = x86_free_reg(busy, xmm, cur->call);
+    if (r == NoReg) {
+      best = -1;
+      for (j = 0; j < active_len; j++) {
+        a = ivs + active[j];
+        if (x86_fits(g->locs[a->v].reg, xmm, cur->call) &&
+            (best < 0 || a->end > ivs[active[best]].end)) {
+          best = j;
+        }
+      }
+      if (best >= 0 && ivs[active[best]].end > cur->end) {
+        a = ivs + active[best];
+        r = g->locs[a->v].reg;
+        g->locs[a->v].reg = NoReg;
+        g->locs[a->v].off = -++g->slots;
+        active[best] = active[--active_len];
+      }
+    }
+    if (r == NoReg) {
+      g->locs[cur->v].off = -++g->slots;
+      continue;
+    }
+    g->locs[cur->v].reg = r;
+    busy[r] = g->used[r] = true;
+    active[active_len++] = k;
+  }
+
+  g->saved = 0;
+  for (j = 0; j < X86_SAVED; j++) {
+    g->saved += g->used[x86_gprs[j]] ? 8 : 0;
+  }
+  for (v = 0; v < f->insns_len; v++) {
+    if (g->locs[v].off) {
+      g->locs[v].off = -(g->saved + 8 * -g->locs[v].off);
+    }
+  }
+  g->call_slot = -(g->saved + 8 * g->slots + 8);
+  g->area = g->call_slot;
+  if (g->jit) {
+    /* builtin_call has room for BUILTIN_ARGS */
+    k = BUILTIN_ARGS;
+    for (v = 0; v < f->insns_len; v++) {
+      k = f->insns[v].args_len > k ? f->insns[v].args_len : k;
+    }
+    g->area -= 8 * k;
+  }
+  g->frame = (-g->area + f->fn->frame_size + 15) / 16 * 16;
+  free(ivs);
+  free(active);
+}
+
+/*
+ * Instruction selection
+ */
+
+void x86_binary(struct x86_gen *g, int v, const char *op, bool commutes) {
+  struct ir_insn *i = g->f->insns + v;
+  x86_reg dst = x86_dst(g, v, Rax), rb = NoReg;
+  int a = i->a, b = i->b;
+
+  /* a goes to dst first, so b must not be there */
+  if (g->locs[b].reg == dst && g->locs[a].reg != dst && commutes) {
+    b = a;
+    a = i->b;
+  }
+  if ((!x86_placed(g, b) && !x86_is_imm(g, b)) ||
+      (g->locs[b].reg == dst && g->locs[a].reg != dst)) {
+    x86_to_reg(g, b, rb = Rcx);
+  }
+  x86_to_reg(g, a, dst);
+  if (rb != NoReg) {
+    x86_ins(g, "#s #q, #q", op, rb, dst);
+  } else {
+    x86_ins(g, "#s #o, #q", op, b, dst);
+  }
+  x86_norm(g, i->kind, dst);
+  x86_def(g, v, dst);
+}
+
+void x86_unary(struct x86_gen *g, int v, const char *op) {
+  struct ir_insn *i = g->f->insns + v;
+  x86_reg dst = x86_dst(g, v, Rax);
+
+  x86_to_reg(g, i->a, dst);
+  x86_ins(g, "#s #q", op, dst);
+  x86_norm(g, i->kind, dst);
+  x86_def(g, v, dst);
+}
+
+/* Shifts by the count masked to 63, as the lowered tree does */
+void x86_shift(struct x86_gen *g, int v, const char *op) {
+  struct ir_insn *i = g->f->insns + v;
+  x86_reg dst = x86_dst(g, v, Rax);
+
+  if (x86_is_imm(g, i->b)) {
+    x86_to_reg(g, i->a, dst);
+    x86_ins(g, "#s $#l, #q", op, g->f->insns[i->b].k & 63, dst);
+  } else {
+    x86_to_reg(g, i->b, Rcx);
+    x86_to_reg(g, i->a, dst);
+    x86_ins(g, "#s %cl, #q", op, dst);
+  }
+  if (i->op == IrShl) {
+    x86_norm(g, i->kind, dst);
+  }
+  x86_def(g, v, dst);
+}
+
+/*
+ * Divides in %rax and %rdx, trapping on a zero divisor. The quotient of the
+ * least long by -1 faults, so a signed division by -1 negates instead.
+ */
+void x86_div(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v, *d = g->f->insns + i->b;
+  bool sign = i->op == IrDiv || i->op == IrMod;
+  bool rem = i->op == IrMod || i->op == IrUMod;
+  bool known = d->op == IrConst;
+  int other = -1, done = -1;
+
+  if (known && !d->k) {
+    g->div0 = true;
+    x86_ins(g, "jmp .Ldiv0");
+    return;
+  }
+  x86_to_reg(g, i->b, Rcx);
+  if (!known) {
+    g->div0 = true;
+    x86_ins(g, "testq %rcx, %rcx");
+    x86_ins(g, "jz .Ldiv0");
+  }
+  if (sign && (!known || d->k == -1)) {
+    if (!known) {
+      other = g->labels++;
+      done = g->labels++;
+      x86_ins(g, "cmpq $-1, %rcx");
+      x86_ins(g, "jne #L", other);
+    }
+    if (rem) {
+      x86_ins(g, "xorl %eax, %eax");
+    } else {
+      x86_to_reg(g, i->a, Rax);
+      x86_ins(g, "negq %rax");
+    }
+    if (!known) {
+      x86_ins(g, "jmp #L", done);
+      x86_label(g, other);
+    }
+  }
+  if (!sign || !known || d->k != -1) {
+    x86_to_reg(g, i->a, Rax);
+    if (sign) {
+      x86_ins(g, "cqto");
+      x86_ins(g, "idivq %rcx");
+    } else {
+      x86_ins(g, "xorl %edx, %edx");
+      x86_ins(g, "divq %rcx");
+    }
+    if (rem) {
+      x86_ins(g, "movq %rdx, %rax");
+    }
+  }
+  if (done >= 0) {
+    x86_label(g, done);
+  }
+  x86_norm(g, i->kind, Rax);
+  x86_copy(g, x86_dst(g, v, Rax), Rax);
+  x86_def(g, v, x86_dst(g, v, Rax));
+}
+
+/* Compares the operands of compare or not i, returning its condition */
+int x86_cmp(struct x86_gen *g, struct ir_insn *i) {
+  x86_reg ra, rb = NoReg;
+
+  if (i->op == IrNot) {
+    ra = x86_reg_of(g, i->a, Rax);
+    x86_ins(g, "testq #q, #q", ra, ra);
+    return 0;
+  }
+  if (!x86_placed(g, i->b) && !x86_is_imm(g, i->b)) {
+    x86_to_reg(g, i->b, rb = Rcx);
+  }
+  ra = x86_reg_of(g, i->a, Rax);
+  if (rb != NoReg) {
+    x86_ins(g, "cmpq #q, #q", rb, ra);
+  } else {
+    x86_ins(g, "cmpq #o, #q", i->b, ra);
+  }
+  return i->op - IrEq;
+}
+
+void x86_compare(struct x86_gen *g, int v) {
+  x86_reg dst = x86_dst(g, v, Rax);
+
+  x86_ins(g, "set#s #b", x86_conds[x86_cmp(g, g->f->insns + v)], dst);
+  x86_ins(g, "movzbl #b, #d", dst, dst);
+  x86_def(g, v, dst);
+}
+
+void x86_fbinary(struct x86_gen *g, int v, const char *op, bool commutes) {
+  struct ir_insn *i = g->f->insns + v;
+  x86_reg dst = x86_dst(g, v, Xmm15), rb = NoReg;
+  int a = i->a, b = i->b;
+
+  if (g->locs[b].reg == dst && g->locs[a].reg != dst && commutes) {
+    b = a;
+    a = i->b;
+  }
+  if (!x86_placed(g, b) ||
+      (g->locs[b].reg == dst && g->locs[a].reg != dst)) {
+    x86_to_reg(g, b, rb = Xmm14);
+  }
+  x86_to_reg(g, a, dst);
+  if (rb != NoReg) {
+    x86_ins(g, "#s #q, #q", op, rb, dst);
+  } else {
+    x86_ins(g, "#s #o, #q", op, b, dst);
+  }
+  if (i->kind == F32V) {
+    x86_round(g, dst);
+  }
+  x86_def(g, v, dst);
+}
+
+/* Negates by flipping the sign bit, as for -0.0 */
+void x86_fneg(struct x86_gen *g, int v) {
+  x86_reg dst = x86_dst(g, v, Xmm15);
+
+  x86_to_reg(g, g->f->insns[v].a, dst);
+  x86_ins(g, "movq #q, %rax", dst);
+  x86_ins(g, "btcq $63, %rax");
+  x86_ins(g, "movq %rax, #q", dst);
+  x86_def(g, v, dst);
+}
+
+/* Compares doubles, false when either is NaN but for != */
+void x86_fcompare(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+  x86_reg dst = x86_dst(g, v, Rax), ra;
+  int a = i->a, b = i->b;
+
+  /* a < b as b > a, which is false for NaNs */
+  if (i->op == IrFLt || i->op == IrFLe) {
+    a = i->b;
+    b = i->a;
+  }
+  ra = x86_reg_of(g, a, Xmm15);
+  if (!x86_placed(g, b)) {
+    x86_to_reg(g, b, Xmm14);
+    x86_ins(g, "ucomisd %xmm14, #q", ra);
+  } else {
+    x86_ins(g, "ucomisd #o, #q", b, ra);
+  }
+  switch (i->op) {
+  case IrFEq:
+    x86_ins(g, "sete #b", dst);
+    x86_ins(g, "setnp %cl");
+    x86_ins(g, "andb %cl, #b", dst);
+    break;
+  case IrFNe:
+    x86_ins(g, "setne #b", dst);
+    x86_ins(g, "setp %cl");
+    x86_ins(g, "orb %cl, #b", dst);
+    break;
+  case IrFLt:
+    x86_ins(g, "seta #b", dst);
+    break;
+  default:
+    x86_ins(g, "setae #b", dst);
+    break;
+  }
+  x86_ins(g, "movzbl #b, #d", dst, dst);
+  x86_def(g, v, dst);
+}
+
+/* Converts an integer to double, unsigned longs past the longs halved */
+void x86_int_to_float(struct x86_gen *g, struct ir_insn *i, x86_reg dst) {
+  x86_reg ra = x86_reg_of(g, i->a, Rax);
+  int other, done;
+
+  if (i->x != U64V && i->x != PtrV) {
+    x86_ins(g, "cvtsi2sdq #q, #q", ra, dst);
+    return;
+  }
+  other = g->labels++;
+  done = g->labels++;
+  x86_ins(g, "testq #q, #q", ra, ra);
+  x86_ins(g, "js #L", other);
+  x86_ins(g, "cvtsi2sdq #q, #q", ra, dst);
+  x86_ins(g, "jmp #L", done);
+  /* keeping the low bit rounds as the conversion of the whole would */
+  x86_label(g, other);
+  x86_ins(g, "movq #q, %rcx", ra);
+  x86_ins(g, "shrq %rcx");
+  x86_ins(g, "movq #q, %rdx", ra);
+  x86_ins(g, "andl $1, %edx");
+  x86_ins(g, "orq %rdx, %rcx");
+  x86_ins(g, "cvtsi2sdq %rcx, #q", dst);
+  x86_ins(g, "addsd #q, #q", dst, dst);
+  x86_label(g, done);
+}
+
+/* Truncates a double to an integer, 2^63 taken off past the longs */
+void x86_float_to_int(struct x86_gen *g, struct ir_insn *i, x86_reg dst) {
+  x86_reg ra = x86_reg_of(g, i->a, Xmm15);
+  int other, done;
+
+  if (i->kind != U64V) {
+    x86_ins(g, "cvttsd2siq #q, #q", ra, dst);
+    x86_norm(g, i->kind, dst);
+    return;
+  }
+  other = g->labels++;
+  done = g->labels++;
+  x86_ins(g, "movabsq $#l, %rdx", 0x43e0000000000000L);
+  x86_ins(g, "movq %rdx, %xmm14");
+  x86_ins(g, "ucomisd %xmm14, #q", ra);
+  x86_ins(g, "jae #L", other);
+  x86_ins(g, "cvttsd2siq #q, #q", ra, dst);
+  x86_ins(g, "jmp #L", done);
+  x86_label(g, other);
+  x86_copy(g, Xmm15, ra);
+  x86_ins(g, "subsd %xmm14, %xmm15");
+  x86_ins(g, "cvttsd2siq %xmm15, #q", dst);
+  x86_ins(g, "btcq $63, #q", dst);
+  x86_label(g, done);
+}
+
+void x86_conv(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+  bool from = is_float_kind(i->x), to = is_float_kind(i->kind);
+  x86_reg dst = x86_dst(g, v, to ? Xmm15 : Rax);
+
+  if (!from && !to) {
+    x86_to_reg(g, i->a, dst);
+    x86_norm(g, i->kind, dst);
+  } else if (!from) {
+    x86_int_to_float(g, i, dst);
+    if (i->kind == F32V) {
+      x86_round(g, dst);
+    }
+  } else if (to) {
+    x86_to_reg(g, i->a, dst);
+    if (i->kind == F32V && i->x != F32V) {
+      x86_round(g, dst);
+    }
+  } else {
+    x86_float_to_int(g, i, dst);
+  }
+  x86_def(g, v, dst);
+}
+
+/* Returns the register holding address v, or NoReg for a frame or global */
+x86_reg x86_base(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+
+  if ((i->op == IrFrame || (i->op == IrGlobal && !g->jit)) &&
+      !x86_placed(g, v)) {
+    return NoReg;
+  }
+  return x86_reg_of(g, v, R11);
+}
+
+void x86_load(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+  x86_reg base = x86_base(g, i->a);
+  x86_reg dst = x86_dst(g, v, is_float_kind(i->kind) ? Xmm15 : Rax);
+
+  switch (i->kind) {
+  case I8V:
+    x86_ins(g, "movsbq #m, #q", i->a, base, dst);
+    break;
+  case U8V:
+    x86_ins(g, "movzbl #m, #d", i->a, base, dst);
+    break;
+  case I16V:
+    x86_ins(g, "movswq #m, #q", i->a, base, dst);
+    break;
+  case U16V:
+    x86_ins(g, "movzwl #m, #d", i->a, base, dst);
+    break;
+  case I32V:
+    x86_ins(g, "movslq #m, #q", i->a, base, dst);
+    break;
+  case U32V:
+    x86_ins(g, "movl #m, #d", i->a, base, dst);
+    break;
+  case F32V:
+    x86_ins(g, "cvtss2sd #m, #q", i->a, base, dst);
+    break;
+  case F64V:
+    x86_ins(g, "movsd #m, #q", i->a, base, dst);
+    break;
+  default:
+    x86_ins(g, "movq #m, #q", i->a, base, dst);
+    break;
+  }
+  x86_def(g, v, dst);
+}
+
+void x86_store(struct x86_gen *g, struct ir_insn *i) {
+  struct ir_insn *b = g->f->insns + i->b;
+  int size = i->kind == I8V || i->kind == U8V     ? 3
+             : i->kind == I16V || i->kind == U16V ? 2
+             : i->kind == I32V || i->kind == U32V ? 1
+                                                  : 0;
+  const char *op[4] = {"movq", "movl", "movw", "movb"};
+  const char *reg[4] = {"#q", "#d", "#w", "#b"};
+  char fmt[32];
+  x86_reg rb = NoReg, base;
+  long mask[4] = {-1L, 0xffffffffL, 0xffffL, 0xffL};
+
+  if (is_float_kind(i->kind)) {
+    rb = x86_reg_of(g, i->b, Xmm15);
+    if (i->kind == F32V) {
+      x86_ins(g, "cvtsd2ss #q, %xmm14", rb);
+    }
+    base = x86_base(g, i->a);
+    if (i->kind == F32V) {
+      x86_ins(g, "movss %xmm14, #m", i->a, base);
+    } else {
+      x86_ins(g, "movsd #q, #m", rb, i->a, base);
+    }
+    return;
+  }
+  if (b->op != IrConst || x86_placed(g, i->b) ||
+      (!size && !x86_fits32(b->k))) {
+    rb = x86_reg_of(g, i->b, Rcx);
+  }
+  base = x86_base(g, i->a);
+  if (rb == NoReg) {
+    sprintf(fmt, "%s $#l, #m", op[size]);
+    x86_ins(g, fmt, size ? b->k & mask[size] : b->k, i->a, base);
+  } else {
+    sprintf(fmt, "%s %s, #m", op[size], reg[size]);
+    x86_ins(g, fmt, rb, i->a, base);
+  }
+}
+
+void x86_ptr_add(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+  x86_reg dst = x86_dst(g, v, Rax), ra, rb;
+  long k = i->k,
+       off = (long)((unsigned long)g->f->insns[i->b].k * (unsigned long)k);
+
+  if (x86_is_imm(g, i->b) && x86_fits32(off)) {
+    ra = x86_reg_of(g, i->a, Rax);
+    x86_ins(g, "leaq #l(#q), #q", off, ra, dst);
+  } else {
+    rb = x86_reg_of(g, i->b, Rcx);
+    ra = x86_reg_of(g, i->a, Rax);
+    if (k == 1 || k == 2 || k == 4 || k == 8) {
+      x86_ins(g, "leaq (#q,#q,#l), #q", ra, rb, k, dst);
+    } else {
+      x86_ins(g, "imulq $#l, #q, %rcx", k, rb);
+      x86_ins(g, "leaq (#q,%rcx), #q", ra, dst);
+    }
+  }
+  x86_def(g, v, dst);
+}
+
+void x86_ptr_diff(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+  x86_reg dst = x86_dst(g, v, Rax), rb = x86_reg_of(g, i->b, Rcx);
+
+  x86_to_reg(g, i->a, Rax);
+  x86_ins(g, "subq #q, %rax", rb);
+  if (i->k != 1) {
+    x86_ins(g, "cqto");
+    x86_ins(g, "movq $#l, %rcx", i->k);
+    x86_ins(g, "idivq %rcx");
+  }
+  x86_copy(g, dst, Rax);
+  x86_def(g, v, dst);
+}
+
+/* Pushes a call argument passed on the stack */
+void x86_push(struct x86_gen *g, struct x86_arg *arg) {
+  if (arg->v < 0) {
+    x86_ins(g, "pushq $#l", arg->k);
+  } else if (x86_placed(g, arg->v) && g->locs[arg->v].reg < Xmm0) {
+    x86_ins(g, "pushq #o", arg->v);
+  } else if (g->locs[arg->v].reg != NoReg) {
+    x86_ins(g, "subq $8, %rsp");
+    x86_ins(g, "movsd #q, (%rsp)", g->locs[arg->v].reg);
+  } else if (x86_is_imm(g, arg->v)) {
+    x86_ins(g, "pushq #o", arg->v);
+  } else {
+    x86_to_reg(g, arg->v, arg->xmm ? Xmm15 : Rax);
+    if (arg->xmm) {
+      x86_ins(g, "movq %xmm15, %rax");
+    }
+    x86_ins(g, "pushq %rax");
+  }
+}
+
+/* Returns the address the function pointer at fn holds */
+long x86_fn_addr(const void *fn) {
+  long addr;
+
+  memcpy(&addr, fn, sizeof(addr));
+  return addr;
+}
+
+/* Calls the function at addr, which JIT code cannot reach relatively */
+void x86_call_addr(struct x86_gen *g, long addr) {
+  x86_ins(g, "movabsq $#l, %rax", addr);
+  x86_ins(g, "call *%rax");
+}
+
+/* Takes the value of call v from where it was returned */
+void x86_result(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+  x86_reg r;
+
+  if (!ir_has_value(i->op) || i->kind == VoidV || !x86_placed(g, v)) {
+    return;
+  }
+  r = x86_is_xmm(g, v) ? Xmm0 : Rax;
+  if (g->jit && r == Xmm0) {
+    /* everything returns its bits in %rax there */
+    r = x86_dst(g, v, Xmm15);
+    x86_ins(g, "movq %rax, #q", r);
+  } else if (r == Rax) {
+    x86_norm(g, i->kind, Rax);
+  }
+  x86_copy(g, x86_dst(g, v, r), r);
+  x86_def(g, v, r);
+}
+
+/*
+ * Calls a function or builtin from JIT code. The args are stored to the
+ * call area as the interpreter passes them, then a compiled callee is
+ * called directly, the rest through jit->call or jit->builtin.
+ */
+void x86_jit_call(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+  struct x86_jit *jit = g->jit;
+  struct x86_loc dst;
+  int slow, done = -1, j;
+  x86_reg r;
+
+  if (i->op == IrCallPtr) {
+    r = x86_reg_of(g, i->a, Rax);
+    x86_ins(g, "movq #q, #l(%rbp)", r, g->call_slot);
+  }
+  dst.reg = NoReg;
+  for (j = 0; j < i->args_len; j++) {
+    dst.off = g->area + 8 * j;
+    x86_add_move(g, dst, i->args[j], 0, x86_is_xmm(g, i->args[j]));
+  }
+  x86_resolve(g);
+
+  if (i->op == IrBuiltin) {
+    x86_ins(g, "movabsq $#l, %rdi", (long)jit->p->in);
+    x86_ins(g, "movl $#l, %esi", i->k);
+    x86_ins(g, "leaq #l(%rbp), %rdx", g->area);
+    x86_ins(g, "movl $#l, %ecx", (long)i->args_len);
+    x86_call_addr(g, x86_fn_addr(&jit->builtin));
+    x86_result(g, v);
+    return;
+  }
+  /* too few args fail in jit->call, as in the interpreter */
+  if (i->op == IrCall && i->args_len >= i->fn->params_len) {
+    slow = g->labels++;
+    done = g->labels++;
+    x86_ins(g, "movabsq $#l, %rax", (long)(jit->code + i->fn->id));
+    x86_ins(g, "movq (%rax), %rax");
+    x86_ins(g, "testq %rax, %rax");
+    x86_ins(g, "jz #L", slow);
+    x86_ins(g, "leaq #l(%rbp), %rdi", g->area);
+    x86_ins(g, "call *%rax");
+    x86_ins(g, "jmp #L", done);
+    x86_label(g, slow);
+  }
+  x86_ins(g, "movabsq $#l, %rdi", (long)jit->p);
+  if (i->op == IrCall) {
+    x86_ins(g, "movabsq $#l, %rsi", (long)i->fn);
+  } else {
+    x86_ins(g, "movq #l(%rbp), %rsi", g->call_slot);
+  }
+  x86_ins(g, "leaq #l(%rbp), %rdx", g->area);
+  x86_ins(g, "movl $#l, %ecx", (long)i->args_len);
+  x86_call_addr(g, x86_fn_addr(&jit->call));
+  if (done >= 0) {
+    x86_label(g, done);
+  }
+  x86_result(g, v);
+}
+
+/*
+ * Calls a function, builtin, memcpy or memset: args past the registers are
+ * pushed last first, the stack kept 16 byte aligned, then the rest are
+ * moved to their registers together.
+ */
+void x86_call(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+  struct x86_arg *args = malloc((i->args_len + 3) * sizeof(*args));
+  x86_reg *regs = malloc((i->args_len + 3) * sizeof(x86_reg));
+  int len = 0, ints = 0, floats = 0, stack = 0, j;
+  struct x86_loc dst;
+  x86_reg r;
+
+  if (g->jit && i->op != IrMemCopy && i->op != IrMemZero) {
+    x86_jit_call(g, v);
+    free(args);
+    free(regs);
+    return;
+  }
+  if (i->op == IrCallPtr) {
+    g->null = true;
+    r = x86_reg_of(g, i->a, Rax);
+    x86_ins(g, "testq #q, #q", r, r);
+    x86_ins(g, "jz .Lnull");
+    x86_ins(g, "movq #q, #l(%rbp)", r, g->call_slot);
+  }
+  if (i->op == IrMemCopy || i->op == IrMemZero) {
+    args[len].v = i->a;
+    args[len++].xmm = false;
+    args[len].v = i->op == IrMemCopy ? i->b : -1;
+    args[len].k = 0;
+    args[len++].xmm = false;
+    args[len].v = -1;
+    args[len].k = i->k;
+    args[len++].xmm = false;
+  }
+  for (j = 0; j < i->args_len; j++) {
+    args[len].v = i->args[j];
+    args[len++].xmm = x86_is_xmm(g, i->args[j]);
+  }
+
+  for (j = 0; j < len; j++) {
+    if (args[j].xmm && floats < X86_FLOAT_ARGS) {
+      regs[j] = Xmm0 + floats++;
+    } else if (!args[j].xmm && ints < 6) {
+      regs[j] = x86_int_args[ints++];
+    } else {
+      regs[j] = NoReg;
+      stack++;
+    }
+  }
+  if (stack % 2) {
+    x86_ins(g, "subq $8, %rsp");
+  }
+  for (j = len - 1; j >= 0; j--) {
+    if (regs[j] == NoReg) {
+      x86_push(g, args + j);
+    }
+  }
+  dst.off = 0;
+  for (j = 0; j < len; j++) {
+    if (regs[j] != NoReg) {
+      dst.reg = regs[j];
+      x86_add_move(g, dst, args[j].v, args[j].k, args[j].xmm);
+    }
+  }
+  x86_resolve(g);
+
+  switch (i->op) {
+  case IrMemCopy:
+    if (g->jit) {
+      x86_call_addr(g, x86_fn_addr(&g->jit->move));
+    } else {
+      x86_ins(g, "call memmove@PLT");
+    }
+    break;
+  case IrMemZero:
+    if (g->jit) {
+      x86_call_addr(g, x86_fn_addr(&g->jit->zero));
+    } else {
+      x86_ins(g, "call memset@PLT");
+    }
+    break;
+  case IrBuiltin:
+    /* printf is variadic, told how many vector registers it has */
+    x86_ins(g, "movl $#l, %eax", (long)floats);
+    x86_ins(g, "call #s@PLT", builtin_names[i->k]);
+    break;
+  case IrCall:
+    x86_ins(g, "call #s", i->fn->name);
+    break;
+  default:
+    x86_ins(g, "call *#l(%rbp)", g->call_slot);
+    break;
+  }
+  if (stack) {
+    x86_ins(g, "addq $#l, %rsp", (long)(stack + stack % 2) * 8);
+  }
+  x86_result(g, v);
+  free(args);
+  free(regs);
+}
+
+/* Writes the epilogue returning from the function */
+void x86_leave(struct x86_gen *g) {
+  int j;
+
+  if (g->saved) {
+    x86_ins(g, "leaq #l(%rbp), %rsp", -g->saved);
+  } else {
+    x86_ins(g, "movq %rbp, %rsp");
+  }
+  for (j = X86_SAVED - 1; j >= 0; j--) {
+    if (g->used[x86_gprs[j]]) {
+      x86_ins(g, "popq #q", x86_gprs[j]);
+    }
+  }
+  x86_ins(g, "popq %rbp");
+  x86_ins(g, "ret");
+}
+
+void x86_ret(struct x86_gen *g, struct ir_insn *i) {
+  if (i->a >= 0) {
+    x86_to_reg(g, i->a, x86_is_xmm(g, i->a) ? Xmm0 : Rax);
+    if (g->jit && x86_is_xmm(g, i->a)) {
+      x86_ins(g, "movq %xmm0, %rax");
+    }
+  } else if (is_float_kind(g->f->fn->ret_kind) && !g->jit) {
+    x86_ins(g, "xorpd %xmm0, %xmm0");
+  } else {
+    x86_ins(g, "xorl %eax, %eax");
+  }
+  x86_leave(g);
+}
+
+/* Returns the label an edge to block to jumps to, a stub if it has phis */
+int x86_target(struct x86_gen *g, int to) {
+  int j;
+
+  if (!ir_phis(g->f, to)) {
+    return g->block_label[to];
+  }
+  for (j = 0; j < g->edges_len; j++) {
+    if (g->edges[j].to == to) {
+      return g->edges[j].label;
+    }
+  }
+  g->edges[g->edges_len].to = to;
+  g->edges[g->edges_len].label = g->labels++;
+  return g->edges[g->edges_len++].label;
+}
+
+/*
+ * Writes a terminator. A jump moves the phi operands of its target first,
+ * branches and switches go through a stub per target doing so, the first
+ * stub falling through from the terminator.
+ */
+void x86_branch(struct x86_gen *g, struct ir_insn *t) {
+  int *labels = malloc((t->targets_len + 1) * sizeof(int));
+  int fall, j, cond;
+  x86_reg ra;
+
+  if (t->op == IrJump) {
+    x86_phi_moves(g, g->cur, t->targets[0]);
+    if (t->targets[0] != g->next) {
+      x86_ins(g, "jmp #L", g->block_label[t->targets[0]]);
+    }
+    free(labels);
+    return;
+  }
+
+  g->edges = malloc((t->targets_len + 1) * sizeof(*g->edges));
+  g->edges_len = 0;
+  for (j = 0; j < t->targets_len; j++) {
+    labels[j] = x86_target(g, t->targets[j]);
+  }
+  fall = g->edges_len   ? g->edges[0].label
+         : g->next >= 0 ? g->block_label[g->next]
+                        : -1;
+  if (t->op == IrBranch) {
+    if (g->fused[t->a]) {
+      cond = x86_cmp(g, g->f->insns + t->a);
+    } else {
+      ra = x86_reg_of(g, t->a, Rax);
+      x86_ins(g, "testq #q, #q", ra, ra);
+      cond = 1;
+    }
+    if (labels[0] == fall) {
+      x86_ins(g, "j#s #L", x86_inverted[cond], labels[1]);
+    } else {
+      x86_ins(g, "j#s #L", x86_conds[cond], labels[0]);
+      if (labels[1] != fall) {
+        x86_ins(g, "jmp #L", labels[1]);
+      }
+    }
+  } else {
+    ra = x86_reg_of(g, t->a, Rax);
+    for (j = 0; j < t->targets_len - 1; j++) {
+      if (x86_fits32(t->cases[j])) {
+        x86_ins(g, "cmpq $#l, #q", t->cases[j], ra);
+      } else {
+        x86_ins(g, "movabsq $#l, %rcx", t->cases[j]);
+        x86_ins(g, "cmpq %rcx, #q", ra);
+      }
+      x86_ins(g, "je #L", labels[j]);
+    }
+    if (labels[j] != fall) {
+      x86_ins(g, "jmp #L", labels[j]);
+    }
+  }
+
+  for (j = 0; j < g->edges_len; j++) {
+    x86_label(g, g->edges[j].label);
+    x86_phi_moves(g, g->cur, g->edges[j].to);
+    if (j < g->edges_len - 1 || g->edges[j].to != g->next) {
+      x86_ins(g, "jmp #L", g->block_label[g->edges[j].to]);
+    }
+  }
+  free(g->edges);
+  free(labels);
+}
+
+void x86_insn(struct x86_gen *g, int v) {
+  struct ir_insn *i = g->f->insns + v;
+
+  if (g->fused[v]) {
+    return;
+  }
+  switch (i->op) {
+  case IrNop:
+  case IrConst:
+  case IrParam:
+  case IrFrame:
+  case IrGlobal:
+  case IrFn:
+  case IrPhi:
+    break;
+  case IrCopy:
+    if (x86_placed(g, v)) {
+      x86_to_reg(g, i->a, x86_dst(g, v, x86_is_xmm(g, v) ? Xmm15 : Rax));
+      x86_def(g, v, x86_dst(g, v, x86_is_xmm(g, v) ? Xmm15 : Rax));
+    }
+    break;
+  case IrLoad:
+    x86_load(g, v);
+    break;
+  case IrStore:
+    x86_store(g, i);
+    break;
+  case IrConv:
+    x86_conv(g, v);
+    break;
+  case IrAdd:
+    x86_binary(g, v, "addq", true);
+    break;
+  case IrSub:
+    x86_binary(g, v, "subq", false);
+    break;
+  case IrMul:
+    x86_binary(g, v, "imulq", true);
+    break;
+  case IrAnd:
+    x86_binary(g, v, "andq", true);
+    break;
+  case IrOr:
+    x86_binary(g, v, "orq", true);
+    break;
+  case IrXor:
+    x86_binary(g, v, "xorq", true);
+    break;
+  case IrDiv:
+  case IrUDiv:
+  case IrMod:
+  case IrUMod:
+    x86_div(g, v);
+    break;
+  case IrShl:
+    x86_shift(g, v, "shlq");
+    break;
+  case IrShr:
+    x86_shift(g, v, "sarq");
+    break;
+  case IrUShr:
+    x86_shift(g, v, "shrq");
+    break;
+  case IrNeg:
+    x86_unary(g, v, "negq");
+    break;
+  case IrCompl:
+    x86_unary(g, v, "notq");
+    break;
+  case IrFAdd:
+    x86_fbinary(g, v, "addsd", true);
+    break;
+  case IrFSub:
+    x86_fbinary(g, v, "subsd", false);
+    break;
+  case IrFMul:
+    x86_fbinary(g, v, "mulsd", true);
+    break;
+  case IrFDiv:
+    x86_fbinary(g, v, "divsd", false);
+    break;
+  case IrFNeg:
+    x86_fneg(g, v);
+    break;
+  case IrFEq:
+  case IrFNe:
+  case IrFLt:
+  case IrFLe:
+    x86_fcompare(g, v);
+    break;
+  case IrPtrAdd:
+    x86_ptr_add(g, v);
+    break;
+  case IrPtrDiff:
+    x86_ptr_diff(g, v);
+    break;
+  case IrMemCopy:
+  case IrMemZero:
+  case IrCall:
+  case IrCallPtr:
+  case IrBuiltin:
+    x86_call(g, v);
+    break;
+  case IrRet:
+    x86_ret(g, i);
+    break;
+  default:
+    if (IrEq <= i->op && i->op <= IrNot) {
+      x86_compare(g, v);
+    } else {
+      x86_branch(g, i);
+    }
+    break;
+  }
+}
+
+/*
+ * Functions
+ */
+
+/* Loads the params of JIT code from the value array at %rdi */
+void x86_jit_params(struct x86_gen *g) {
+  struct ir_block *blk = g->f->blocks;
+  struct x86_loc l;
+  int j, v;
+
+  x86_ins(g, "movq %rdi, %r11");
+  for (j = 0; j < blk->len; j++) {
+    struct ir_insn *i = g->f->insns + (v = blk->insns[j]);
+    if (i->op != IrParam || !x86_placed(g, v) ||
+        i->k >= g->f->fn->params_len) {
+      continue;
+    }
+    l = g->locs[v];
+    if (l.reg == NoReg) {
+      x86_ins(g, "movq #l(%r11), %rax", 8 * i->k);
+      x86_ins(g, "movq %rax, #l(%rbp)", l.off);
+    } else {
+      x86_ins(g, l.reg >= Xmm0 ? "movsd #l(%r11), #q" : "movq #l(%r11), #q",
+              8 * i->k, l.reg);
+    }
+  }
+}
+
+/* Moves the params from where the caller passed them */
+void x86_params(struct x86_gen *g) {
+  struct ir_fn *f = g->f;
+  struct interp_fn *fn = f->fn;
+  struct x86_loc *from = malloc((fn->params_len + 1) * sizeof(*from));
+  struct ir_block *blk = f->blocks;
+  bool is_main = !strcmp(fn->name, "main");
+  int ints = 0, floats = 0, stack = 0, j, k, v;
+
+  if (g->jit) {
+    x86_jit_params(g);
+    free(from);
+    return;
+  }
+  for (k = 0; k < fn->params_len; k++) {
+    bool xmm = is_float_kind(fn->param_kind[k]);
+    from[k].off = 0;
+    if (xmm && floats < X86_FLOAT_ARGS) {
+      from[k].reg = Xmm0 + floats++;
+    } else if (!xmm && ints < 6) {
+      from[k].reg = x86_int_args[ints++];
+    } else {
+      from[k].reg = NoReg;
+      from[k].off = 16 + 8 * stack++;
+    }
+  }
+  for (j = 0; j < blk->len; j++) {
+    struct ir_insn *i = f->insns + (v = blk->insns[j]);
+    if (i->op != IrParam || !x86_placed(g, v) || i->k >= fn->params_len) {
+      continue;
+    }
+    x86_add_move(g, g->locs[v], -1, 0, x86_is_xmm(g, v));
+    g->moves[g->moves_len - 1].src = from[i->k];
+  }
+  x86_resolve(g);
+
+  /* main is called from C, with its int params as it passed them */
+  for (j = 0; is_main && j < blk->len; j++) {
+    struct ir_insn *i = f->insns + (v = blk->insns[j]);
+    if (i->op == IrParam && x86_placed(g, v) && !x86_is_xmm(g, v)) {
+      x86_to_reg(g, v, Rax);
+      x86_norm(g, i->kind, Rax);
+      x86_copy(g, x86_dst(g, v, Rax), Rax);
+      x86_def(g, v, Rax);
+    }
+  }
+  free(from);
+}
+
+/* Writes a stub of JIT code failing through jit->fail */
+void x86_jit_trap(struct x86_gen *g, const char *label, const char *msg,
+                  const char *name) {
+  write_str(g->w, label);
+  write_str(g->w, ":\n");
+  x86_ins(g, "andq $-16, %rsp");
+  x86_ins(g, "movabsq $#l, %rdi", (long)g->p->in);
+  x86_ins(g, "movabsq $#l, %rsi", (long)msg);
+  if (name) {
+    x86_ins(g, "movabsq $#l, %rdx", (long)name);
+  } else {
+    x86_ins(g, "xorl %edx, %edx");
+  }
+  x86_call_addr(g, x86_fn_addr(&g->jit->fail));
+}
+
+void x86_fn(struct x86_gen *g, struct ir_fn *f) {
+  int moves = f->insns_len + 8, li, j;
+
+  g->f = f;
+  g->moves = malloc(moves * sizeof(*g->moves));
+  g->moves_len = 0;
+  x86_layout(g);
+  x86_number(g);
+  x86_allocate(g);
+
+  if (!g->jit) {
+    x86_ins(g, ".p2align 4");
+  }
+  if (!g->jit && !strcmp(f->fn->name, "main") && f->fn->id < g->p->fns_len) {
+    x86_ins(g, ".globl main");
+  }
+  write_str(g->w, f->fn->name);
+  write_str(g->w, ":\n");
+  x86_ins(g, "pushq %rbp");
+  x86_ins(g, "movq %rsp, %rbp");
+  for (j = 0; j < X86_SAVED; j++) {
+    if (g->used[x86_gprs[j]]) {
+      x86_ins(g, "pushq #q", x86_gprs[j]);
+    }
+  }
+  if (g->frame > g->saved) {
+    x86_ins(g, "subq $#l, %rsp", g->frame - g->saved);
+  }
+  if (g->jit) {
+    x86_ins(g, "movabsq $#l, %rax", (long)g->jit->limit);
+    x86_ins(g, "cmpq %rax, %rsp");
+    x86_ins(g, "jb .Lstack");
+  }
+  x86_params(g);
+
+  for (li = 0; li < g->layout_len; li++) {
+    struct ir_block *blk = f->blocks + g->layout[li];
+    g->cur = g->layout[li];
+    g->next = li + 1 < g->layout_len ? g->layout[li + 1] : -1;
+    x86_label(g, g->block_label[g->cur]);
+    for (j = 0; j < blk->len; j++) {
+      x86_insn(g, blk->insns[j]);
+    }
+  }
+  if (g->jit && g->div0) {
+    x86_jit_trap(g, ".Ldiv0", "division by zero", NULL);
+  }
+  if (g->jit) {
+    x86_jit_trap(g, ".Lstack", "stack overflow in", f->fn->name);
+  }
+
+  free(g->layout);
+  free(g->block_label);
+  free(g->start);
+  free(g->end);
+  free(g->pos);
+  free(g->uses);
+  free(g->fused);
+  free(g->locs);
+  free(g->moves);
+}
+
+/* Writes a stub printing msg as the interpreter does, then exiting 1 */
+void x86_trap(struct x86_gen *g, const char *label, const char *msg) {
+  write_str(g->w, label);
+  write_str(g->w, ":\n");
+  x86_ins(g, "andq $-16, %rsp");
+  x86_ins(g, "leaq #s_msg(%rip), %rdi", label);
+  x86_ins(g, "call puts@PLT");
+  x86_ins(g, "movl $1, %edi");
+  x86_ins(g, "call exit@PLT");
+  x86_ins(g, ".section .rodata");
+  write_str(g->w, label);
+  write_str(g->w, "_msg:\n");
+  x86_ins(g, ".string \"#s\"", msg);
+  x86_ins(g, ".text");
+}
+
+/* Writes the globals, statics and string literals */
+void x86_data(struct x86_gen *g) {
+  struct interp *in = g->p->in;
+  int i;
+  long j, k;
+
+  for (i = 0; i < in->objs_len; i++) {
+    struct interp_obj *o = in->objs + i;
+    for (j = 0; j < o->size && !o->p[j]; j++) {
+    }
+    x86_ins(g, j == o->size ? ".bss" : ".data");
+    x86_ins(g, ".p2align 4");
+    write_str(g->w, ".Lobj");
+    write_long(g->w, i);
+    write_str(g->w, ":\n");
+    if (j == o->size) {
+      x86_ins(g, ".zero #l", o->size ? o->size : 1L);
+      continue;
+    }
+    for (j = 0; j < o->size; j += 16) {
+      write_str(g->w, "\t.byte ");
+      for (k = j; k < o->size && k < j + 16; k++) {
+        if (k > j) {
+          write_char(g->w, ',');
+        }
+        write_long(g->w, (unsigned char)o->p[k]);
+      }
+      write_char(g->w, '\n');
+    }
+  }
+}
+
+void x86_compile(writer *w, struct ir_prog *p) {
+  struct x86_gen g;
+  int i;
+
+  memset(&g, 0, sizeof(g));
+  g.w = w;
+  g.p = p;
+  x86_place(&g);
+
+  x86_ins(&g, ".text");
+  for (i = 0; i < p->fns_len; i++) {
+    x86_fn(&g, p->fns[i]);
+  }
+  if (p->in->inits_len) {
+    x86_fn(&g, p->fns[p->fns_len]);
+  }
+  if (g.div0) {
+    x86_trap(&g, ".Ldiv0", "run: division by zero");
+  }
+  if (g.null) {
+    x86_trap(&g, ".Lnull", "run: call through a null pointer");
+  }
+  if (p->in->inits_len) {
+    x86_ins(&g, ".section .init_array,\"aw\"");
+    x86_ins(&g, ".p2align 3");
+    x86_ins(&g, ".quad #s", p->fns[p->fns_len]->fn->name);
+  }
+  x86_data(&g);
+  x86_ins(&g, ".section .note.GNU-stack,\"\",@progbits");
+  free(g.objs);
+}
+
+void x86_jit_fn(writer *w, struct x86_jit *jit, struct ir_fn *f) {
+  struct x86_gen g;
+
+  memset(&g, 0, sizeof(g));
+  g.w = w;
+  g.p = jit->p;
+  g.jit = jit;
+  x86_fn(&g, f);
+}
+
+/*
+ * Linking and running
+ */
+
+char *x86_link(struct ir_prog *p, const char *cc) {
+  char *dir = malloc(32), *src = malloc(40), *exe = malloc(40);
+  FILE *f;
+  writer w;
+  pid_t pid;
+  int status = 1;
+
+  strcpy(dir, "/tmp/chocc-XXXXXX");
+  if (!mkdtemp(dir)) {
+    free(dir);
+    free(src);
+    free(exe);
+    return NULL;
+  }
+  sprintf(src, "%s/a.s", dir);
+  sprintf(exe, "%s/a.out", dir);
+  if ((f = fopen(src, "w"))) {
+    w = new_writer(f);
+    x86_compile(&w, p);
+    free_writer(&w);
+    fclose(f);
+    fflush(stdout);
+    if (!(pid = fork())) {
+      execlp(cc, cc, "-o", exe, src, "-lm", (char *)NULL);
+      _exit(127);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+      status = 1;
+    }
+    remove(src);
+  }
+  free(src);
+  if (status) {
+    remove(exe);
+    rmdir(dir);
+    free(dir);
+    free(exe);
+    return NULL;
+  }
+  free(dir);
+  return exe;
+}
+
+int x86_exec(const char *path, int argc, char **argv, FILE *out) {
+  char **args = malloc((argc + 1) * sizeof(char *));
+  pid_t pid;
+  int status = 0;
+
+  memcpy(args, argv, argc * sizeof(char *));
+  args[argc] = NULL;
+  fflush(stdout);
+  fflush(out);
+  if (!(pid = fork())) {
+    dup2(fileno(out), 1);
+    execv(path, args);
+    _exit(127);
+  }
+  free(args);
+  if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+    return 127;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+void x86_unlink(char *path) {
+  remove(path);
+  *strrchr(path, '/') = '\0';
+  rmdir(path);
+  free(path);
+}
@@ -0,0 +1,62 @@
+#ifndef CHOCC_X86_H
+#define CHOCC_X86_H
+#pragma once
+
+#include <stdio.h>
+
+#include "chocc.h"
+#include "io.h"
+#include "ir.h"
+
+/* the names of the general purpose registers at 64, 32, 16 and 8 bits */
+extern const char *x86_gpr_names[4][16];
+
+/*
+ * Writes the program p as GNU assembler for x86-64 under the System V ABI,
+ * to be linked against libc. The values of each function are allocated to
+ * registers by linear scan over the live intervals of its SSA form, and
+ * its initializers run from .init_array before main.
+ */
+void x86_compile(writer *w, struct ir_prog *p);
+
+/*
+ * Compiles p, then assembles and links it with the C compiler cc into a
+ * new temporary directory. Returns the path of the executable, or NULL if
+ * it could not be built.
+ */
+char *x86_link(struct ir_prog *p, const char *cc);
+
+/*
+ * Runs the executable at path with the argc strings of argv, its stdout
+ * going to out. Returns its exit status, or 128 plus the signal that
+ * killed it.
+ */
+int x86_exec(const char *path, int argc, char **argv, FILE *out);
+
+/* Removes an executable x86_link built, and its directory */
+void x86_unlink(char *path);
+
+/*
+ * x86_jit is the running interpreter code x86_jit_fn writes is part of, its
+ * memory and entry points addressed absolutely.
+ */
+struct x86_jit {
+  struct ir_prog *p;
+  void **code; /* the entry of each function compiled so far, by id */
+  value (*call)(struct ir_prog *, struct interp_fn *, value *, int);
+  value (*builtin)(struct interp *, builtin, value *, int);
+  void (*fail)(struct interp *, const char *, const char *);
+  void *(*move)(void *, const void *, size_t);
+  void *(*zero)(void *, int, size_t);
+  char *limit; /* the lowest %rsp the code may run at */
+};
+
+/*
+ * Writes f as assembler for the process jit describes. Called with its
+ * args in a value array at %rdi, it returns the bits of its value in %rax.
+ * It calls compiled functions directly and the rest through jit->call, and
+ * fails through jit->fail with the interpreter's messages.
+ */
+void x86_jit_fn(writer *w, struct x86_jit *jit, struct ir_fn *f);
+
+#endif